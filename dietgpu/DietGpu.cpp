@@ -26,10 +26,18 @@ FloatType getFloatTypeFromDtype(at::ScalarType t) {
       return FloatType::kBFloat16;
     case at::ScalarType::Float:
       return FloatType::kFloat32;
+    case at::ScalarType::Double:
+      return FloatType::kFloat64;
+    case at::ScalarType::Float8_e4m3fn:
+      return FloatType::kFloat8E4M3;
+    case at::ScalarType::Float8_e5m2:
+      return FloatType::kFloat8E5M2;
     default:
       TORCH_CHECK(
           t == at::ScalarType::Half || t == at::ScalarType::BFloat16 ||
-          t == at::ScalarType::Float);
+          t == at::ScalarType::Float || t == at::ScalarType::Double ||
+          t == at::ScalarType::Float8_e4m3fn ||
+          t == at::ScalarType::Float8_e5m2);
       return FloatType::kUndefined;
   }
 }
@@ -42,10 +50,17 @@ at::ScalarType getDtypeFromFloatType(FloatType ft) {
       return at::ScalarType::BFloat16;
     case FloatType::kFloat32:
       return at::ScalarType::Float;
+    case FloatType::kFloat64:
+      return at::ScalarType::Double;
+    case FloatType::kFloat8E4M3:
+      return at::ScalarType::Float8_e4m3fn;
+    case FloatType::kFloat8E5M2:
+      return at::ScalarType::Float8_e5m2;
     default:
       TORCH_CHECK(
           ft == FloatType::kFloat16 || ft == FloatType::kBFloat16 ||
-          ft == FloatType::kFloat32);
+          ft == FloatType::kFloat32 || ft == FloatType::kFloat64 ||
+          ft == FloatType::kFloat8E4M3 || ft == FloatType::kFloat8E5M2);
       return at::ScalarType::Half;
   }
 }
@@ -115,10 +130,15 @@ constexpr int kDefaultPrecision = 10;
 
 std::tuple<int64_t, int64_t> max_float_compressed_output_size(
     const std::vector<torch::Tensor>& ts) {
-  auto sizes = getTotalAndMaxSize(ts);
+  // The batch may mix float types
+  int64_t maxCompSize = 0;
 
-  auto maxCompSize = getMaxFloatCompressedSize(
-      getFloatTypeFromTensor(ts[0]), std::get<1>(sizes));
+  for (auto& t : ts) {
+    maxCompSize = std::max(
+        maxCompSize,
+        (int64_t)getMaxFloatCompressedSize(
+            getFloatTypeFromTensor(t), t.numel()));
+  }
 
   return std::make_tuple(ts.size(), maxCompSize);
 }
@@ -172,10 +192,8 @@ std::tuple<torch::Tensor, torch::Tensor, int64_t> compress_data_res(
     // device must be consistent
     TORCH_CHECK(t.get_device() == dev);
 
-    // must be all the same type unless we are compressing bytewise
+    // the float types may differ between tensors
     if (compressAsFloat) {
-      TORCH_CHECK(t.dtype() == tIns[0].dtype());
-
       // must be a supported float type
       TORCH_CHECK(
           getFloatTypeFromDtype(t.dtype().toScalarType()) !=
@@ -204,12 +222,15 @@ std::tuple<torch::Tensor, torch::Tensor, int64_t> compress_data_res(
 
   auto inPtrs = std::vector<const void*>(tIns.size());
   auto inSize = std::vector<uint32_t>(tIns.size());
+  auto inTypes = std::vector<FloatType>(tIns.size());
   auto compPtrs = std::vector<void*>(tIns.size());
 
   for (size_t i = 0; i < tIns.size(); ++i) {
     auto& t = tIns[i];
 
     inPtrs[i] = t.data_ptr();
+    inTypes[i] =
+        compressAsFloat ? getFloatTypeFromTensor(t) : FloatType::kUndefined;
     inSize[i] = compressAsFloat ? t.numel() : (t.numel() * t.element_size());
     compPtrs[i] = (uint8_t*)comp.data_ptr() + i * comp.size(1);
   }
@@ -243,10 +264,11 @@ std::tuple<torch::Tensor, torch::Tensor, int64_t> compress_data_res(
         false /* we'll figure this out later */,
         checksum);
 
-    floatCompress(
+    floatCompressMixed(
         res,
         config,
         tIns.size(),
+        inTypes.data(),
         inPtrs.data(),
         inSize.data(),
         compPtrs.data(),
@@ -540,6 +562,7 @@ int64_t decompress_data_res(
   auto inPtrs = std::vector<const void*>(tIns.size());
   auto outPtrs = std::vector<void*>(tIns.size());
   auto outCapacity = std::vector<uint32_t>(tOuts.size());
+  auto outTypes = std::vector<FloatType>(tOuts.size());
 
   for (size_t i = 0; i < tIns.size(); ++i) {
     auto& tIn = tIns[i];
@@ -557,7 +580,11 @@ int64_t decompress_data_res(
     if (compressAsFloat) {
       TORCH_CHECK(
           tOut.dtype() == torch::kFloat16 || tOut.dtype() == torch::kBFloat16 ||
-          tOut.dtype() == torch::kFloat32);
+          tOut.dtype() == torch::kFloat32 || tOut.dtype() == torch::kFloat64 ||
+          tOut.dtype() == torch::kFloat8_e4m3fn ||
+          tOut.dtype() == torch::kFloat8_e5m2);
+
+      outTypes[i] = getFloatTypeFromTensor(tOut);
     }
 
     inPtrs[i] = tIn.data_ptr();
@@ -596,10 +623,12 @@ int64_t decompress_data_res(
         false /* we'll figure this out later */,
         checksum);
 
-    auto decStatus = floatDecompress(
+    // The float type of each archive is that of its output tensor
+    auto decStatus = floatDecompressMixed(
         res,
         config,
         tIns.size(),
+        outTypes.data(),
         inPtrs.data(),
         outPtrs.data(),
         outCapacity.data(),
@@ -730,7 +759,9 @@ int64_t decompress_data_split_size(
   if (compressAsFloat) {
     TORCH_CHECK(
         tOut.dtype() == torch::kFloat16 || tOut.dtype() == torch::kBFloat16 ||
-        tOut.dtype() == torch::kFloat32);
+        tOut.dtype() == torch::kFloat32 || tOut.dtype() == torch::kFloat64 ||
+        tOut.dtype() == torch::kFloat8_e4m3fn ||
+        tOut.dtype() == torch::kFloat8_e5m2);
   }
 
   auto outSize =
@@ -882,7 +913,7 @@ std::vector<torch::Tensor> decompress_data_simple(
     torch::Tensor tOut;
 
     if (compressAsFloat) {
-      TORCH_CHECK(type == types[0]); // must be consistent dtype
+      TORCH_CHECK((FloatType)type != FloatType::kUndefined);
 
       tOut = torch::empty(
           {(int)size},
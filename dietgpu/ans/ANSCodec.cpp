@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Host-only parts of the ANS codec API, shared by the GPU (gpu_ans) and host
+// (cpu_ans) implementations so that the latter does not require the former
+
+#include "dietgpu/ans/GpuANSCodec.h"
+#include "dietgpu/ans/GpuANSUtils.cuh"
+
+#include <glog/logging.h>
+#include <limits>
+#include <sstream>
+
+namespace dietgpu {
+
+uint32_t getMaxCompressedSize(
+    uint32_t uncompressedBytes,
+    uint32_t blockSize,
+    bool useWideState,
+    uint32_t numTables,
+    bool useBlockChecksum) {
+  CHECK(isValidANSBlockSize(blockSize))
+      << "unsupported block size " << blockSize;
+  CHECK(numTables >= 1 && numTables <= kANSMaxTables)
+      << "unsupported number of pdfs " << numTables;
+
+  uint32_t blocks = divUp(uncompressedBytes, blockSize);
+
+  // Blocks that ANS coding would not shrink are stored, so the data is never
+  // larger than the input (with each block padded to kBlockAlignment, which
+  // only affects the last block)
+  size_t rawSize = ANSCoalescedHeader::getCompressedOverhead(
+      blocks, useWideState, false, numTables);
+  rawSize += roundUp((size_t)uncompressedBytes, (size_t)kBlockAlignment);
+
+  if (useBlockChecksum) {
+    rawSize += getBlockChecksumSize(uncompressedBytes);
+  }
+
+  // When used in batches, we must align everything to 16 byte boundaries (due
+  // to uint4 read/writes)
+  rawSize = roundUp(rawSize, sizeof(uint4));
+  CHECK_LE(rawSize, std::numeric_limits<int32_t>::max());
+
+  return rawSize;
+}
+
+void addBlockChecksumFailure(
+    int batch,
+    std::vector<uint32_t> failed,
+    size_t numBlocks,
+    std::vector<std::pair<int, std::vector<uint32_t>>>& failedBlocks,
+    std::vector<std::pair<int, std::string>>& errorInfo) {
+  std::stringstream errStr;
+  errStr << "Block checksum mismatch in batch member " << batch << ": ";
+
+  if (failed.empty()) {
+    errStr << "all blocks match, but the checksum of all of them does not "
+           << "(the checksums are corrupt)\n";
+  } else {
+    errStr << failed.size() << " of " << numBlocks << " blocks of "
+           << kANSChecksumBlockSize << " bytes failed, the first being block "
+           << failed.front() << "\n";
+  }
+
+  errorInfo.push_back(std::make_pair(batch, errStr.str()));
+  failedBlocks.push_back(std::make_pair(batch, std::move(failed)));
+}
+
+namespace {
+
+// FNV-1a over the precision and pdf
+uint32_t hashDictionary(int probBits, const uint16_t* probs) {
+  constexpr uint32_t kPrime = 16777619U;
+  uint32_t h = 2166136261U;
+
+  auto add = [&](uint32_t v) {
+    for (int i = 0; i < sizeof(uint16_t); ++i) {
+      h = (h ^ ((v >> (i * 8)) & 0xffU)) * kPrime;
+    }
+  };
+
+  add(probBits);
+  for (int i = 0; i < kNumSymbols; ++i) {
+    add(probs[i]);
+  }
+
+  return h;
+}
+
+} // namespace
+
+ANSDictionary::ANSDictionary(int probBits, const uint16_t* probs)
+    : probBits_(probBits),
+      id_(hashDictionary(probBits, probs)),
+      probs_(probs, probs + kNumSymbols),
+      encodeTable_(kNumSymbols),
+      decodeTable_(getANSDecodeTableWords(probBits)) {
+  CHECK(isValidANSProbBits(probBits)) << "unhandled pdf precision " << probBits;
+
+  uint32_t cdf = 0;
+  for (int i = 0; i < kNumSymbols; ++i) {
+    CHECK_GT(probs[i], 0) << "dictionary symbol " << i << " has zero pdf";
+
+    encodeTable_[i] = makeANSEncodeTableEntry(probs[i], cdf);
+    cdf += probs[i];
+  }
+
+  CHECK_EQ(cdf, 1U << probBits) << "dictionary pdf must sum to 2^probBits";
+
+  ansFillDecodeTable(probs, probBits, decodeTable_.data());
+}
+
+ANSDictionary::~ANSDictionary() = default;
+
+} // namespace dietgpu
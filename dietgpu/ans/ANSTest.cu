@@ -6,13 +6,16 @@
  */
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <cmath>
 #include <random>
 #include <vector>
 #include <stdio.h>
 #include <string>
 
+#include "dietgpu/ans/CpuANSCodec.h"
 #include "dietgpu/ans/GpuANSCodec.h"
+#include "dietgpu/ans/GpuANSUtils.cuh"
 #include "dietgpu/utils/StackDeviceMemory.h"
 
 using namespace dietgpu;
@@ -87,9 +90,12 @@ void runBatchPointer(
     StackDeviceMemory& res,
     int prec,
     const std::vector<uint32_t>& batchSizes,
-    double lambda = 100.0) {
+    double lambda = 100.0,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false) {
   // run on a different stream to test stream assignment
   auto stream = CudaStream::makeNonBlocking();
+  auto config = ANSCodecConfig(prec, true, blockSize, useWideState);
 
   int numInBatch = batchSizes.size();
   uint32_t maxSize = 0;
@@ -97,7 +103,7 @@ void runBatchPointer(
     maxSize = std::max(maxSize, v);
   }
 
-  auto outBatchStride = getMaxCompressedSize(maxSize);
+  auto outBatchStride = getMaxCompressedSize(maxSize, blockSize, useWideState);
 
   auto batch_host = genBatch(batchSizes, lambda);
   auto batch_dev = toDevice(res, batch_host, stream);
@@ -120,7 +126,7 @@ void runBatchPointer(
 
   ansEncodeBatchPointer(
       res,
-      ANSCodecConfig(prec, true),
+      config,
       numInBatch,
       inPtrs.data(),
       batchSizes.data(),
@@ -149,7 +155,7 @@ void runBatchPointer(
 
   ansDecodeBatchPointer(
       res,
-      ANSCodecConfig(prec, true),
+      config,
       numInBatch,
       (const void**)encPtrs.data(),
       decPtrs.data(),
@@ -276,6 +282,54 @@ TEST(ANSTest, BatchPointerLarge) {
   runBatchPointer(res, 10, sizes);
 }
 
+TEST(ANSTest, BlockSize) {
+  auto res = makeStackMemory();
+
+  for (uint32_t blockSize = kANSMinBlockSize; blockSize <= kANSMaxBlockSize;
+       blockSize *= 2) {
+    for (auto prec : {9, 10, 11}) {
+      runBatchPointer(
+          res,
+          prec,
+          {1, blockSize - 1, blockSize, blockSize + 1, 5 * blockSize + 1234},
+          100.0,
+          blockSize);
+    }
+  }
+}
+
+TEST(ANSTest, HighPrecision) {
+  auto res = makeStackMemory();
+
+  for (auto prec : {12, 13, 14}) {
+    for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+      runBatchPointer(res, prec, {1}, lambda);
+      runBatchPointer(res, prec, {4096, 4095, 4096}, lambda);
+      runBatchPointer(res, prec, {10000, 10013, 10000}, lambda);
+      runBatchPointer(
+          res, prec, {123456}, lambda, kANSDefaultBlockSize, true);
+    }
+  }
+}
+
+TEST(ANSTest, WideState) {
+  auto res = makeStackMemory();
+
+  for (auto blockSize : {kANSMinBlockSize, kANSDefaultBlockSize}) {
+    for (auto prec : {9, 10, 11}) {
+      for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+        runBatchPointer(
+            res,
+            prec,
+            {1, blockSize - 1, blockSize, 5 * blockSize + 1234},
+            lambda,
+            blockSize,
+            true);
+      }
+    }
+  }
+}
+
 TEST(ANSTest, BatchStride) {
   auto res = makeStackMemory();
 
@@ -409,4 +463,939 @@ TEST(ANSTest, SaveToFile) {
       }
     }
   }
-}
\ No newline at end of file
+}
+// Archives produced by the CPU encoder must match those produced by the GPU
+// encoder, and each must be decodable by the other
+void runCpuCompatBatch(
+    StackDeviceMemory& res,
+    int prec,
+    const std::vector<std::vector<uint8_t>>& batch_host,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false,
+    const ANSDictionary* dict = nullptr) {
+  auto stream = CudaStream::makeNonBlocking();
+  auto& pool = getDefaultThreadPool();
+  auto config = ANSCodecConfig(prec, true, blockSize, useWideState, dict);
+
+  int numInBatch = batch_host.size();
+  auto batchSizes = std::vector<uint32_t>();
+  for (auto& b : batch_host) {
+    batchSizes.push_back(b.size());
+  }
+
+  auto batch_dev = toDevice(res, batch_host, stream);
+
+  auto maxSizes = std::vector<uint32_t>();
+  auto inPtrs_host = std::vector<const void*>();
+  auto inPtrs_dev = std::vector<const void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    maxSizes.push_back(
+        getMaxCompressedSize(batchSizes[i], blockSize, useWideState));
+    inPtrs_host.push_back(batch_host[i].data());
+    inPtrs_dev.push_back(batch_dev[i].data());
+  }
+
+  // GPU encode
+  auto encGpu_dev = buffersToDevice(res, maxSizes, stream);
+  auto encGpuPtrs = std::vector<void*>();
+  for (auto& v : encGpu_dev) {
+    encGpuPtrs.push_back(v.data());
+  }
+
+  ansEncodeBatchPointer(
+      res,
+      config,
+      numInBatch,
+      inPtrs_dev.data(),
+      batchSizes.data(),
+      nullptr,
+      encGpuPtrs.data(),
+      nullptr,
+      stream);
+
+  auto encGpu = toHost(res, encGpu_dev, stream);
+
+  // CPU encode
+  auto encCpu = std::vector<std::vector<uint8_t>>();
+  auto encCpuPtrs = std::vector<void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    encCpu.emplace_back(std::vector<uint8_t>(maxSizes[i]));
+    encCpuPtrs.push_back(encCpu[i].data());
+  }
+
+  ansEncodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs_host.data(),
+      batchSizes.data(),
+      nullptr,
+      encCpuPtrs.data(),
+      nullptr);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    // The GPU leaves alignment padding uninitialized, so we only compare the
+    // meaningful portions of the archive
+    auto hGpu = (const ANSCoalescedHeader*)encGpu[i].data();
+    auto hCpu = (const ANSCoalescedHeader*)encCpu[i].data();
+    auto numBlocks = hCpu->getNumBlocks();
+
+    EXPECT_EQ(hGpu->magicAndVersion, hCpu->magicAndVersion);
+    EXPECT_EQ(hGpu->getNumBlocks(), numBlocks);
+    EXPECT_EQ(
+        hGpu->getTotalUncompressedWords(), hCpu->getTotalUncompressedWords());
+    EXPECT_EQ(hGpu->getTotalCompressedWords(), hCpu->getTotalCompressedWords());
+    EXPECT_EQ(hGpu->getProbBits(), hCpu->getProbBits());
+    EXPECT_EQ(hGpu->getUseChecksum(), hCpu->getUseChecksum());
+    EXPECT_EQ(hGpu->getBlockSize(), hCpu->getBlockSize());
+    EXPECT_EQ(hGpu->getUseWideState(), hCpu->getUseWideState());
+    EXPECT_EQ(hGpu->getUseDictionary(), hCpu->getUseDictionary());
+    EXPECT_EQ(hGpu->getDictionaryId(), hCpu->getDictionaryId());
+    EXPECT_EQ(hGpu->getChecksum(), hCpu->getChecksum());
+
+    if (numBlocks == 0) {
+      continue;
+    }
+
+    EXPECT_EQ(hGpu->getSymbolProbsSize(), hCpu->getSymbolProbsSize());
+    EXPECT_EQ(0, memcmp(hGpu + 1, hCpu + 1, hCpu->getSymbolProbsSize()));
+
+    EXPECT_EQ(
+        0,
+        memcmp(
+            hGpu->getWarpStates<uint8_t>(),
+            hCpu->getWarpStates<uint8_t>(),
+            ANSCoalescedHeader::getWarpStateSize(useWideState) * numBlocks));
+
+    for (uint32_t b = 0; b < numBlocks; ++b) {
+      auto bwGpu = hGpu->getBlockWords(numBlocks)[b];
+      auto bwCpu = hCpu->getBlockWords(numBlocks)[b];
+      EXPECT_EQ(bwGpu.x, bwCpu.x);
+      EXPECT_EQ(bwGpu.y, bwCpu.y);
+
+      auto wordSize = ANSCoalescedHeader::getEncodedWordSize(useWideState);
+
+      EXPECT_EQ(
+          0,
+          memcmp(
+              hGpu->getBlockDataStart<uint8_t>(numBlocks) +
+                  getBlockCompressedWordStart(bwGpu) * wordSize,
+              hCpu->getBlockDataStart<uint8_t>(numBlocks) +
+                  getBlockCompressedWordStart(bwCpu) * wordSize,
+              wordSize * hCpu->getBlockDataWords(bwCpu)));
+    }
+  }
+
+  // Decode the CPU archives on the GPU
+  {
+    auto enc_dev = toDevice(res, encCpu, stream);
+    auto encPtrs = std::vector<const void*>();
+    for (auto& v : enc_dev) {
+      encPtrs.push_back(v.data());
+    }
+
+    auto dec_dev = buffersToDevice(res, batchSizes, stream);
+    auto decPtrs = std::vector<void*>();
+    for (auto& v : dec_dev) {
+      decPtrs.push_back(v.data());
+    }
+
+    auto status = ansDecodeBatchPointer(
+        res,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        nullptr,
+        stream);
+
+    EXPECT_EQ(status.error, ANSDecodeError::None);
+    EXPECT_EQ(batch_host, toHost(res, dec_dev, stream));
+  }
+
+  // Decode the GPU archives on the CPU
+  {
+    auto encPtrs = std::vector<const void*>();
+    for (auto& v : encGpu) {
+      encPtrs.push_back(v.data());
+    }
+
+    auto dec = std::vector<std::vector<uint8_t>>();
+    auto decPtrs = std::vector<void*>();
+    for (int i = 0; i < numInBatch; ++i) {
+      dec.emplace_back(std::vector<uint8_t>(batchSizes[i]));
+      decPtrs.push_back(dec[i].data());
+    }
+
+    auto status = ansDecodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        nullptr);
+
+    EXPECT_EQ(status.error, ANSDecodeError::None);
+    EXPECT_EQ(batch_host, dec);
+  }
+}
+
+void runCpuCompat(
+    StackDeviceMemory& res,
+    int prec,
+    const std::vector<uint32_t>& batchSizes,
+    double lambda,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false,
+    const ANSDictionary* dict = nullptr) {
+  runCpuCompatBatch(
+      res, prec, genBatch(batchSizes, lambda), blockSize, useWideState, dict);
+}
+
+TEST(ANSTest, CpuCompat) {
+  auto res = makeStackMemory();
+
+  for (auto prec : {9, 10, 11}) {
+    for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+      runCpuCompat(res, prec, {0, 1, 4095, 4096, 10013}, lambda);
+      runCpuCompat(res, prec, {123456, 1234, 2345}, lambda);
+    }
+  }
+}
+
+TEST(ANSTest, CpuCompatBlockSize) {
+  auto res = makeStackMemory();
+
+  for (uint32_t blockSize = kANSMinBlockSize; blockSize <= kANSMaxBlockSize;
+       blockSize *= 2) {
+    runCpuCompat(
+        res, 10, {0, 1, blockSize, 3 * blockSize + 17}, 10.0, blockSize);
+  }
+}
+
+TEST(ANSTest, CpuCompatWideState) {
+  auto res = makeStackMemory();
+
+  for (auto prec : {9, 10, 11}) {
+    for (auto lambda : {1.0, 100.0}) {
+      runCpuCompat(
+          res,
+          prec,
+          {0, 1, 4095, 4096, 123456},
+          lambda,
+          kANSDefaultBlockSize,
+          true);
+    }
+  }
+
+  runCpuCompat(
+      res, 10, {3 * kANSMaxBlockSize + 17}, 10.0, kANSMaxBlockSize, true);
+}
+
+TEST(ANSTest, CpuCompatHighPrecision) {
+  auto res = makeStackMemory();
+
+  for (auto prec : {12, 13, 14}) {
+    for (auto lambda : {1.0, 100.0}) {
+      runCpuCompat(res, prec, {0, 1, 4095, 4096, 123456}, lambda);
+    }
+  }
+}
+
+TEST(ANSTest, CpuCompatDictionary) {
+  auto res = makeStackMemory();
+  auto& pool = getDefaultThreadPool();
+
+  for (auto prec : {10, 12, 14}) {
+    auto samples = genBatch({100000}, 100.0);
+    const void* in[] = {samples[0].data()};
+    uint32_t inSize[] = {100000};
+
+    uint16_t probs[kNumSymbols];
+    ansTrainDictionaryCpu(pool, prec, 1, in, inSize, probs);
+    auto dict = ANSDictionary(prec, probs);
+
+    for (auto wide : {false, true}) {
+      for (auto lambda : {1.0, 100.0}) {
+        runCpuCompat(
+            res,
+            prec,
+            {0, 1, 4095, 4096, 123456},
+            lambda,
+            kANSDefaultBlockSize,
+            wide,
+            &dict);
+      }
+    }
+  }
+}
+
+// Stored and constant blocks are chosen, laid out and decoded identically on
+// the GPU and the CPU
+TEST(ANSTest, CpuCompatBlockModes) {
+  auto res = makeStackMemory();
+  std::mt19937 gen(1);
+
+  for (auto useWideState : {false, true}) {
+    for (auto blockSize : {kANSMinBlockSize, kANSMaxBlockSize}) {
+      // A random, a constant and a compressible block, then a partial block
+      auto mixed = std::vector<uint8_t>(blockSize);
+      for (auto& v : mixed) {
+        v = gen();
+      }
+
+      mixed.insert(mixed.end(), blockSize, 0x5a);
+
+      auto symbols = generateSymbols(blockSize, 100.0);
+      mixed.insert(mixed.end(), symbols.begin(), symbols.end());
+      mixed.insert(mixed.end(), {1, 2, 3});
+
+      auto random = std::vector<uint8_t>(3 * blockSize + 17);
+      for (auto& v : random) {
+        v = gen();
+      }
+
+      auto constant = std::vector<uint8_t>(2 * blockSize + 5, 7);
+
+      for (auto prec : {9, 14}) {
+        runCpuCompatBatch(
+            res, prec, {mixed, random, constant}, blockSize, useWideState);
+      }
+    }
+  }
+}
+
+// Archives using features that only the host codec decodes are reported as
+// failures by the GPU decoder, rather than decoded into garbage
+TEST(ANSTest, HostOnlyArchivesFail) {
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  auto& pool = getDefaultThreadPool();
+
+  auto batch_host = genBatch({100000, 4096, 1}, 10.0);
+  auto ref_host = genBatch({100000, 4096, 1}, 10.0);
+  int numInBatch = batch_host.size();
+
+  auto inPtrs = std::vector<const void*>();
+  auto refPtrs = std::vector<const void*>();
+  auto batchSizes = std::vector<uint32_t>();
+  for (int i = 0; i < numInBatch; ++i) {
+    inPtrs.push_back(batch_host[i].data());
+    refPtrs.push_back(ref_host[i].data());
+    batchSizes.push_back(batch_host[i].size());
+  }
+
+  // Contexts, segments and shuffling, which the GPU does not decode, and
+  // deltas, which are decoded here without their reference
+  for (int feature = 0; feature < 4; ++feature) {
+    auto config = ANSCodecConfig(10);
+    config.numContexts = feature == 0 ? 4 : 1;
+    config.maxSegments = feature == 1 ? 4 : 1;
+    config.shuffleWidth = feature == 2 ? 4 : 1;
+
+    auto enc = std::vector<std::vector<uint8_t>>();
+    auto encPtrs = std::vector<void*>();
+    for (int i = 0; i < numInBatch; ++i) {
+      enc.emplace_back(std::vector<uint8_t>(getMaxCompressedSize(
+          batchSizes[i],
+          config.blockSize,
+          config.useWideState,
+          config.getMaxTables())));
+      encPtrs.push_back(enc[i].data());
+    }
+
+    ansEncodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        encPtrs.data(),
+        nullptr,
+        feature == 3 ? refPtrs.data() : nullptr);
+
+    auto enc_dev = toDevice(res, enc, stream);
+    auto encDevPtrs = std::vector<const void*>();
+    for (auto& v : enc_dev) {
+      encDevPtrs.push_back(v.data());
+    }
+
+    auto dec_dev = buffersToDevice(res, batchSizes, stream);
+    auto decPtrs = std::vector<void*>();
+    for (auto& v : dec_dev) {
+      decPtrs.push_back(v.data());
+    }
+
+    auto success_dev = res.alloc<uint8_t>(stream, numInBatch);
+
+    ansDecodeBatchPointer(
+        res,
+        config,
+        numInBatch,
+        encDevPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        success_dev.data(),
+        nullptr,
+        stream);
+
+    // The encoder may not use the feature for every member (e.g., a single
+    // segment where one pdf suits all blocks)
+    auto success = success_dev.copyToHost(stream);
+    for (int i = 0; i < numInBatch; ++i) {
+      auto header = (const ANSCoalescedHeader*)enc[i].data();
+      bool fails = header->getNumTables() > 1 ||
+          header->getShuffleWidth() > 1 || header->getUseDelta();
+
+      EXPECT_EQ(bool(success[i]), !fails)
+          << "feature " << feature << " member " << i;
+    }
+  }
+}
+
+TEST(ANSTest, Delta) {
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  auto& pool = getDefaultThreadPool();
+  auto config = ANSCodecConfig(10, true);
+
+  // Each member differs from its reference in a few bytes; the second member
+  // is coded without a reference
+  auto ref_host = genBatch({100000, 4097, 1}, 10.0);
+  auto batch_host = ref_host;
+  for (auto& b : batch_host) {
+    for (size_t j = 0; j < b.size(); j += 7) {
+      b[j] ^= j % 251 + 1;
+    }
+  }
+
+  int numInBatch = batch_host.size();
+  auto batch_dev = toDevice(res, batch_host, stream);
+  auto ref_dev = toDevice(res, ref_host, stream);
+
+  auto batchSizes = std::vector<uint32_t>();
+  auto maxSizes = std::vector<uint32_t>();
+  auto inPtrs_host = std::vector<const void*>();
+  auto inPtrs_dev = std::vector<const void*>();
+  auto refPtrs_host = std::vector<const void*>();
+  auto refPtrs_dev = std::vector<const void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    batchSizes.push_back(batch_host[i].size());
+    maxSizes.push_back(getMaxCompressedSize(batchSizes[i]));
+    inPtrs_host.push_back(batch_host[i].data());
+    inPtrs_dev.push_back(batch_dev[i].data());
+    refPtrs_host.push_back(i == 1 ? nullptr : ref_host[i].data());
+    refPtrs_dev.push_back(i == 1 ? nullptr : ref_dev[i].data());
+  }
+
+  // GPU encode
+  auto encGpu_dev = buffersToDevice(res, maxSizes, stream);
+  auto encGpuPtrs = std::vector<void*>();
+  for (auto& v : encGpu_dev) {
+    encGpuPtrs.push_back(v.data());
+  }
+
+  ansEncodeBatchPointer(
+      res,
+      config,
+      numInBatch,
+      inPtrs_dev.data(),
+      batchSizes.data(),
+      nullptr,
+      encGpuPtrs.data(),
+      nullptr,
+      stream,
+      refPtrs_dev.data());
+
+  auto encGpu = toHost(res, encGpu_dev, stream);
+
+  // CPU encode
+  auto encCpu = std::vector<std::vector<uint8_t>>();
+  auto encCpuPtrs = std::vector<void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    encCpu.emplace_back(std::vector<uint8_t>(maxSizes[i]));
+    encCpuPtrs.push_back(encCpu[i].data());
+  }
+
+  ansEncodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs_host.data(),
+      batchSizes.data(),
+      nullptr,
+      encCpuPtrs.data(),
+      nullptr,
+      refPtrs_host.data());
+
+  for (int i = 0; i < numInBatch; ++i) {
+    auto hGpu = (const ANSCoalescedHeader*)encGpu[i].data();
+    auto hCpu = (const ANSCoalescedHeader*)encCpu[i].data();
+
+    EXPECT_EQ(hGpu->getUseDelta(), i != 1);
+    EXPECT_EQ(hGpu->magicAndVersion, hCpu->magicAndVersion);
+    EXPECT_EQ(hGpu->getChecksum(), hCpu->getChecksum());
+  }
+
+  auto decodeGpu = [&](const std::vector<std::vector<uint8_t>>& enc,
+                       const void** refPtrs) {
+    auto enc_dev = toDevice(res, enc, stream);
+    auto encPtrs = std::vector<const void*>();
+    for (auto& v : enc_dev) {
+      encPtrs.push_back(v.data());
+    }
+
+    auto dec_dev = buffersToDevice(res, batchSizes, stream);
+    auto decPtrs = std::vector<void*>();
+    for (auto& v : dec_dev) {
+      decPtrs.push_back(v.data());
+    }
+
+    auto success_dev = res.alloc<uint8_t>(stream, numInBatch);
+
+    auto status = ansDecodeBatchPointer(
+        res,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        success_dev.data(),
+        nullptr,
+        stream,
+        refPtrs);
+
+    auto success = success_dev.copyToHost(stream);
+    auto dec = toHost(res, dec_dev, stream);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      // Without the references, only the member not in delta mode decodes
+      EXPECT_EQ(bool(success[i]), refPtrs || i == 1) << "member " << i;
+      if (success[i]) {
+        EXPECT_EQ(batch_host[i], dec[i]) << "member " << i;
+      }
+    }
+
+    if (refPtrs) {
+      EXPECT_EQ(status.error, ANSDecodeError::None);
+    }
+  };
+
+  // Decode the GPU and CPU archives on the GPU, with and without the
+  // references
+  decodeGpu(encGpu, refPtrs_dev.data());
+  decodeGpu(encCpu, refPtrs_dev.data());
+  decodeGpu(encGpu, nullptr);
+
+  // Decode the GPU archives on the CPU
+  {
+    auto encPtrs = std::vector<const void*>();
+    for (auto& v : encGpu) {
+      encPtrs.push_back(v.data());
+    }
+
+    auto dec = std::vector<std::vector<uint8_t>>();
+    auto decPtrs = std::vector<void*>();
+    for (int i = 0; i < numInBatch; ++i) {
+      dec.emplace_back(std::vector<uint8_t>(batchSizes[i]));
+      decPtrs.push_back(dec[i].data());
+    }
+
+    auto status = ansDecodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        nullptr,
+        refPtrs_host.data());
+
+    EXPECT_EQ(status.error, ANSDecodeError::None);
+    EXPECT_EQ(batch_host, dec);
+  }
+}
+
+TEST(ANSTest, BlockChecksum) {
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  auto& pool = getDefaultThreadPool();
+  auto config = ANSCodecConfig(10);
+  config.useBlockChecksum = true;
+
+  // Partial and whole checksum blocks; the last member is coded in delta
+  // mode, whose checksums are of the data rather than its XOR
+  auto batch_host = genBatch({0, 1, 4095, 4096, 100000, 12345}, 10.0);
+  auto ref_host = genBatch({12345}, 10.0);
+  auto batch_dev = toDevice(res, batch_host, stream);
+  auto ref_dev = toDevice(res, ref_host, stream);
+
+  int numInBatch = batch_host.size();
+  auto batchSizes = std::vector<uint32_t>();
+  auto maxSizes = std::vector<uint32_t>();
+  auto inPtrs_host = std::vector<const void*>();
+  auto inPtrs_dev = std::vector<const void*>();
+  auto refPtrs_host = std::vector<const void*>(numInBatch);
+  auto refPtrs_dev = std::vector<const void*>(numInBatch);
+  for (int i = 0; i < numInBatch; ++i) {
+    batchSizes.push_back(batch_host[i].size());
+    maxSizes.push_back(getMaxCompressedSize(
+        batchSizes[i], config.blockSize, false, 1, true));
+    inPtrs_host.push_back(batch_host[i].data());
+    inPtrs_dev.push_back(batch_dev[i].data());
+  }
+
+  refPtrs_host.back() = ref_host[0].data();
+  refPtrs_dev.back() = ref_dev[0].data();
+
+  // GPU encode
+  auto encGpu_dev = buffersToDevice(res, maxSizes, stream);
+  auto encGpuPtrs = std::vector<void*>();
+  for (auto& v : encGpu_dev) {
+    encGpuPtrs.push_back(v.data());
+  }
+
+  ansEncodeBatchPointer(
+      res,
+      config,
+      numInBatch,
+      inPtrs_dev.data(),
+      batchSizes.data(),
+      nullptr,
+      encGpuPtrs.data(),
+      nullptr,
+      stream,
+      refPtrs_dev.data());
+
+  auto encGpu = toHost(res, encGpu_dev, stream);
+
+  // CPU encode
+  auto encCpu = std::vector<std::vector<uint8_t>>();
+  auto encCpuPtrs = std::vector<void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    encCpu.emplace_back(std::vector<uint8_t>(maxSizes[i]));
+    encCpuPtrs.push_back(encCpu[i].data());
+  }
+
+  ansEncodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs_host.data(),
+      batchSizes.data(),
+      nullptr,
+      encCpuPtrs.data(),
+      nullptr,
+      refPtrs_host.data());
+
+  // The checksums, including their zero padding, match those of the host
+  for (int i = 0; i < numInBatch; ++i) {
+    auto hGpu = (const ANSCoalescedHeader*)encGpu[i].data();
+    auto hCpu = (const ANSCoalescedHeader*)encCpu[i].data();
+
+    EXPECT_TRUE(hGpu->getUseBlockChecksum());
+    EXPECT_EQ(hGpu->magicAndVersion, hCpu->magicAndVersion);
+    EXPECT_EQ(
+        0,
+        memcmp(
+            hGpu->getBlockChecksums(),
+            hCpu->getBlockChecksums(),
+            getBlockChecksumSize(batchSizes[i])))
+        << "member " << i;
+  }
+
+  // Corrupt the checksum of block 1 of member 4 in a copy of the archives
+  auto encCorrupt = encGpu;
+  ((ANSCoalescedHeader*)encCorrupt[4].data())->getBlockChecksums()[1] ^= 1;
+
+  auto decodeGpu = [&](const std::vector<std::vector<uint8_t>>& enc) {
+    auto enc_dev = toDevice(res, enc, stream);
+    auto encPtrs = std::vector<const void*>();
+    for (auto& v : enc_dev) {
+      encPtrs.push_back(v.data());
+    }
+
+    auto dec_dev = buffersToDevice(res, batchSizes, stream);
+    auto decPtrs = std::vector<void*>();
+    for (auto& v : dec_dev) {
+      decPtrs.push_back(v.data());
+    }
+
+    // Without a status array, which verification must provide itself
+    auto status = ansDecodeBatchPointer(
+        res,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        nullptr,
+        stream,
+        refPtrs_dev.data());
+
+    EXPECT_EQ(batch_host, toHost(res, dec_dev, stream));
+    return status;
+  };
+
+  auto status = decodeGpu(encGpu);
+  EXPECT_EQ(status.error, ANSDecodeError::None);
+  EXPECT_TRUE(status.failedBlocks.empty());
+
+  status = decodeGpu(encCpu);
+  EXPECT_EQ(status.error, ANSDecodeError::None);
+
+  // The corrupt checksum is reported as on the host
+  status = decodeGpu(encCorrupt);
+  EXPECT_EQ(status.error, ANSDecodeError::ChecksumMismatch);
+
+  auto encPtrs = std::vector<const void*>();
+  auto dec = std::vector<std::vector<uint8_t>>();
+  auto decPtrs = std::vector<void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs.push_back(encCorrupt[i].data());
+    dec.emplace_back(std::vector<uint8_t>(batchSizes[i]));
+    decPtrs.push_back(dec[i].data());
+  }
+
+  auto statusCpu = ansDecodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      encPtrs.data(),
+      decPtrs.data(),
+      batchSizes.data(),
+      nullptr,
+      nullptr,
+      refPtrs_host.data());
+
+  auto expected = std::vector<std::pair<int, std::vector<uint32_t>>>{
+      {4, std::vector<uint32_t>{1}}};
+  EXPECT_EQ(status.failedBlocks, expected);
+  EXPECT_EQ(statusCpu.failedBlocks, expected);
+  EXPECT_EQ(status.errorInfo, statusCpu.errorInfo);
+}
+
+TEST(ANSTest, RangeDecode) {
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  std::mt19937 gen(5);
+
+  for (auto useWideState : {false, true}) {
+    auto config = ANSCodecConfig(10, false, kANSMinBlockSize, useWideState);
+
+    auto batchSizes = std::vector<uint32_t>{1, 4097, 20000};
+    int numInBatch = batchSizes.size();
+
+    auto batch_host = genBatch(batchSizes, 20.0);
+
+    // A constant run and a random run, to cover blocks of all modes
+    std::fill(batch_host[2].begin() + 5000, batch_host[2].begin() + 9000, 9);
+    for (int i = 12000; i < 14000; ++i) {
+      batch_host[2][i] = gen();
+    }
+
+    auto batch_dev = toDevice(res, batch_host, stream);
+
+    auto inPtrs = std::vector<const void*>(numInBatch);
+    auto encSizes = std::vector<uint32_t>(numInBatch);
+    for (int i = 0; i < numInBatch; ++i) {
+      inPtrs[i] = batch_dev[i].data();
+      encSizes[i] =
+          getMaxCompressedSize(batchSizes[i], kANSMinBlockSize, useWideState);
+    }
+
+    auto enc_dev = buffersToDevice(res, encSizes, stream);
+    auto encPtrs = std::vector<void*>(numInBatch);
+    for (int i = 0; i < numInBatch; ++i) {
+      encPtrs[i] = enc_dev[i].data();
+    }
+
+    ansEncodeBatchPointer(
+        res,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        encPtrs.data(),
+        nullptr,
+        stream);
+
+    for (int iter = 0; iter < 10; ++iter) {
+      auto offsets = std::vector<uint32_t>(numInBatch);
+      auto sizes = std::vector<uint32_t>(numInBatch);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        offsets[i] = gen() % batchSizes[i];
+        sizes[i] = gen() % (batchSizes[i] - offsets[i] + 1);
+      }
+
+      // The last iteration tries a range past the end of the data
+      if (iter == 9) {
+        sizes[1] = batchSizes[1] - offsets[1] + 1;
+      }
+
+      // Leave room so that a failed range is still a valid allocation
+      auto decSizes = sizes;
+      for (auto& s : decSizes) {
+        s = std::max(s, 1U);
+      }
+
+      auto dec_dev = buffersToDevice(res, decSizes, stream);
+      auto decPtrs = std::vector<void*>(numInBatch);
+      for (int i = 0; i < numInBatch; ++i) {
+        decPtrs[i] = dec_dev[i].data();
+      }
+
+      auto outSuccess_dev = res.alloc<uint8_t>(stream, numInBatch);
+
+      ansDecodeRangeBatchPointer(
+          res,
+          config,
+          numInBatch,
+          (const void**)encPtrs.data(),
+          offsets.data(),
+          sizes.data(),
+          decPtrs.data(),
+          outSuccess_dev.data(),
+          stream);
+
+      auto outSuccess = outSuccess_dev.copyToHost(stream);
+      auto dec = toHost(res, dec_dev, stream);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        if (iter == 9 && i == 1) {
+          EXPECT_FALSE(outSuccess[i]);
+          continue;
+        }
+
+        EXPECT_TRUE(outSuccess[i]);
+        EXPECT_TRUE(std::equal(
+            dec[i].begin(),
+            dec[i].begin() + sizes[i],
+            batch_host[i].begin() + offsets[i]));
+      }
+    }
+  }
+}
+
+// The device buffers of a batch being encoded and decoded on a stream
+struct StreamRoundTrip {
+  std::vector<GpuMemoryReservation<uint8_t>> in;
+  GpuMemoryReservation<uint8_t> enc;
+  std::vector<GpuMemoryReservation<uint8_t>> dec;
+  GpuMemoryReservation<uint8_t> outSuccess;
+};
+
+// Enqueues the encoding and decoding of the batch on `stream`, with all
+// memory temporary, without waiting for either
+StreamRoundTrip enqueueRoundTrip(
+    StackDeviceMemory& res,
+    const ANSCodecConfig& config,
+    const std::vector<std::vector<uint8_t>>& batch,
+    const std::vector<uint32_t>& sizes,
+    cudaStream_t stream) {
+  int numInBatch = batch.size();
+  auto rt = StreamRoundTrip();
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    rt.in.emplace_back(res.copyAlloc(stream, batch[i]));
+    rt.dec.emplace_back(res.alloc<uint8_t>(stream, sizes[i]));
+    inPtrs[i] = rt.in[i].data();
+    decPtrs[i] = rt.dec[i].data();
+  }
+
+  auto outBatchStride = getMaxCompressedSize(
+      *std::max_element(sizes.begin(), sizes.end()), config.blockSize);
+  rt.enc = res.alloc<uint8_t>(stream, numInBatch * outBatchStride);
+
+  auto encPtrs = std::vector<void*>(numInBatch);
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs[i] = rt.enc.data() + i * outBatchStride;
+  }
+
+  auto outCompressedSize_dev = res.alloc<uint32_t>(stream, numInBatch);
+
+  ansEncodeBatchPointer(
+      res,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      sizes.data(),
+      nullptr,
+      encPtrs.data(),
+      outCompressedSize_dev.data(),
+      stream);
+
+  rt.outSuccess = res.alloc<uint8_t>(stream, numInBatch);
+
+  ansDecodeBatchPointer(
+      res,
+      config,
+      numInBatch,
+      (const void**)encPtrs.data(),
+      decPtrs.data(),
+      sizes.data(),
+      rt.outSuccess.data(),
+      nullptr,
+      stream);
+
+  return rt;
+}
+
+// Two streams sharing one region in stream-ordered mode, each reusing the
+// temporary memory freed by the other while its work may still be running
+TEST(ANSTest, StreamOrderedMemory) {
+  // (a region size that is not a multiple of kSDMAlignment)
+  auto res = makeStackMemory(64 * 1024 * 1024 + 100, AllocMode::StreamOrdered);
+  EXPECT_TRUE(res.getMode() == AllocMode::StreamOrdered);
+
+  constexpr int kNumStreams = 2;
+  auto streams = std::vector<CudaStream>();
+  for (int s = 0; s < kNumStreams; ++s) {
+    streams.emplace_back(CudaStream::makeNonBlocking());
+  }
+
+  auto config = ANSCodecConfig(10, false);
+  std::mt19937 gen(10);
+
+  for (int iter = 0; iter < 10; ++iter) {
+    auto batches = std::vector<std::vector<std::vector<uint8_t>>>();
+    auto sizes = std::vector<std::vector<uint32_t>>(kNumStreams);
+    auto rts = std::vector<StreamRoundTrip>();
+
+    for (int s = 0; s < kNumStreams; ++s) {
+      for (int i = 0; i < 5; ++i) {
+        sizes[s].push_back(1 + gen() % 1000000);
+      }
+
+      batches.push_back(genBatch(sizes[s], 10.0 + s * 100.0));
+      rts.emplace_back(
+          enqueueRoundTrip(res, config, batches[s], sizes[s], streams[s]));
+    }
+
+    for (int s = 0; s < kNumStreams; ++s) {
+      auto outSuccess = rts[s].outSuccess.copyToHost(streams[s]);
+      auto dec = toHost(res, rts[s].dec, streams[s]);
+
+      for (int i = 0; i < outSuccess.size(); ++i) {
+        EXPECT_TRUE(outSuccess[i]);
+      }
+
+      EXPECT_EQ(dec, batches[s]);
+    }
+  }
+
+  // Nothing needed more than the region
+  EXPECT_LE(res.getMaxMemoryUsage(), res.getSizeTotal());
+}
@@ -17,14 +17,20 @@ struct BatchWriter {
   inline __device__ BatchWriter(void* out)
       : out_((uint8_t*)out), outBlock_(nullptr) {}
 
-  inline __device__ void setBlock(uint32_t block) {
-    outBlock_ = out_ + block * kDefaultBlockSize;
+  inline __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    outBlock_ = out_ + block * blockSize;
   }
 
   inline __device__ void write(uint32_t offset, uint8_t sym) {
     outBlock_[offset] = sym;
   }
 
+  // Writes the symbol decoded at `offset` within the current block to word
+  // `pos` of the output (see BatchRangeWriter)
+  inline __device__ void writeAt(uint32_t pos, uint32_t offset, uint8_t sym) {
+    out_[pos] = sym;
+  }
+
   // template <typename Vec>
   // inline __device__ void writeVec(uint32_t offset, Vec symV) {
   //   ((Vec*)outBlock_)[offset] = symV;
@@ -193,4 +199,107 @@ struct BatchProviderInlinePointerCapacity {
   uint32_t capacity_dev_[N];
 };
 
+// Restricts the output of a writer to the words [begin, end) of the decoded
+// data, which are written to the start of its output
+template <typename Writer>
+struct BatchRangeWriter {
+  inline __device__ BatchRangeWriter(
+      const Writer& writer,
+      uint32_t begin,
+      uint32_t end)
+      : writer_(writer), begin_(begin), end_(end), blockStart_(0) {}
+
+  inline __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    writer_.setBlock(block, blockSize);
+    blockStart_ = block * blockSize;
+  }
+
+  inline __device__ void write(uint32_t offset, uint8_t sym) {
+    uint32_t pos = blockStart_ + offset;
+
+    if (pos >= begin_ && pos < end_) {
+      writer_.writeAt(pos - begin_, offset, sym);
+    }
+  }
+
+  Writer writer_;
+  uint32_t begin_;
+  uint32_t end_;
+  uint32_t blockStart_;
+};
+
+// Writes the XOR of the decoded data with a reference of the same size, undoing
+// delta mode (see ansXorBatch); a null reference writes the data as is. Wraps
+// any range writer, so as to see the positions in the whole of the data
+template <typename Writer>
+struct BatchDeltaWriter {
+  inline __device__ BatchDeltaWriter(const Writer& writer, const void* ref)
+      : writer_(writer), ref_((const uint8_t*)ref), refBlock_(nullptr) {}
+
+  inline __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    writer_.setBlock(block, blockSize);
+    refBlock_ = ref_ ? ref_ + block * blockSize : nullptr;
+  }
+
+  inline __device__ void write(uint32_t offset, uint8_t sym) {
+    writer_.write(offset, refBlock_ ? sym ^ refBlock_[offset] : sym);
+  }
+
+  Writer writer_;
+  const uint8_t* ref_;
+  const uint8_t* refBlock_;
+};
+
+// Wraps an output provider so as to decode only a range of each batch member;
+// range_dev[batch] holds the {offset, size} in words of the range, and the
+// output of the wrapped provider receives only those words
+template <typename OutProvider>
+struct BatchProviderRange {
+  using Writer = BatchRangeWriter<typename OutProvider::Writer>;
+
+  __host__ BatchProviderRange(
+      const OutProvider& outProvider,
+      const uint2* range_dev)
+      : outProvider_(outProvider), range_dev_(range_dev) {}
+
+  __device__ void* getBatchStart(uint32_t batch) {
+    return outProvider_.getBatchStart(batch);
+  }
+
+  __device__ Writer getWriter(uint32_t batch) {
+    auto range = range_dev_[batch];
+
+    return Writer(outProvider_.getWriter(batch), range.x, range.x + range.y);
+  }
+
+  // The output holds exactly the range
+  __device__ uint32_t getBatchSize(uint32_t batch) {
+    return range_dev_[batch].y;
+  }
+
+  __device__ uint2 getRange(uint32_t batch) {
+    return range_dev_[batch];
+  }
+
+  OutProvider outProvider_;
+  const uint2* range_dev_;
+};
+
+// The {offset, size} in words of the decoded data of a batch member of
+// `totalSize` words that an output provider receives; this is all of it, other
+// than for BatchProviderRange
+template <typename OutProvider>
+inline __device__ uint2
+getBatchOutputRange(OutProvider& provider, uint32_t batch, uint32_t totalSize) {
+  return make_uint2(0, totalSize);
+}
+
+template <typename OutProvider>
+inline __device__ uint2 getBatchOutputRange(
+    BatchProviderRange<OutProvider>& provider,
+    uint32_t batch,
+    uint32_t totalSize) {
+  return provider.getRange(batch);
+}
+
 } // namespace dietgpu
@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/utils/Crc32c.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Number of checksum blocks whose CRCs are computed by a single task
+constexpr size_t kChecksumChunkBlocks = 64;
+
+size_t getNumChecksumBlocks(size_t bytes) {
+  return divUp(bytes, (size_t)kANSChecksumBlockSize);
+}
+
+// The start of each batch member's blocks in the CRCs of all of them; members
+// for which checksums is given and null have none
+std::vector<size_t> getChecksumBlockStart(
+    uint32_t numInBatch,
+    const uint32_t* size,
+    uint32_t wordSize,
+    const uint32_t** checksums) {
+  auto blockStart = std::vector<size_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    bool use = !checksums || checksums[i];
+    blockStart[i + 1] = blockStart[i] +
+        (use ? getNumChecksumBlocks((size_t)size[i] * wordSize) : 0);
+  }
+
+  return blockStart;
+}
+
+// Computes the CRC32C of each block of the data into crc, with the blocks of
+// member i starting at blockStart[i]
+void checksumBlocks(
+    ThreadPool& pool,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    uint32_t wordSize,
+    const std::vector<size_t>& blockStart,
+    uint32_t* crc) {
+  auto crcFn = getCrc32cCpu(getCpuSimdLevel());
+  size_t numBlocks = blockStart[numInBatch];
+
+  pool.parallelFor(divUp(numBlocks, kChecksumChunkBlocks), [&](size_t chunk) {
+    size_t begin = chunk * kChecksumChunkBlocks;
+    size_t end = std::min(numBlocks, begin + kChecksumChunkBlocks);
+
+    // A chunk may span several (small) batch members
+    uint32_t batch =
+        std::upper_bound(blockStart.begin(), blockStart.end(), begin) -
+        blockStart.begin() - 1;
+
+    for (size_t block = begin; block < end; ++block) {
+      while (block >= blockStart[batch + 1]) {
+        ++batch;
+      }
+
+      size_t bytes = (size_t)size[batch] * wordSize;
+      size_t offset = (block - blockStart[batch]) * kANSChecksumBlockSize;
+
+      crc[block] = crcFn(
+          (const uint8_t*)in[batch] + offset,
+          std::min(bytes - offset, (size_t)kANSChecksumBlockSize),
+          0);
+    }
+  });
+}
+
+// The CRC32C of all of `bytes` bytes of data, from the CRC32C of each of its
+// blocks
+uint32_t combineBlockChecksums(const uint32_t* crc, size_t bytes) {
+  static const Crc32cCombiner combineBlock(kANSChecksumBlockSize);
+
+  size_t numBlocks = getNumChecksumBlocks(bytes);
+  uint32_t all = 0;
+
+  for (size_t b = 0; b + 1 < numBlocks; ++b) {
+    all = combineBlock(all, crc[b]);
+  }
+
+  // The last block may be partial
+  if (numBlocks > 0) {
+    all = crc32cCombine(
+        all,
+        crc[numBlocks - 1],
+        bytes - (numBlocks - 1) * kANSChecksumBlockSize);
+  }
+
+  return all;
+}
+
+} // namespace
+
+void ansChecksumPiecesCpu(
+    const void* data,
+    size_t begin,
+    size_t end,
+    uint32_t pieceBytes,
+    uint32_t* crc) {
+  auto crcFn = getCrc32cCpu(getCpuSimdLevel());
+
+  for (size_t offset = begin; offset < end; offset += pieceBytes) {
+    crc[offset / pieceBytes] = crcFn(
+        (const uint8_t*)data + offset,
+        std::min(end - offset, (size_t)pieceBytes),
+        0);
+  }
+}
+
+void ansBlockChecksumsFromPiecesCpu(
+    const uint32_t* pieceCrc,
+    uint32_t pieceBytes,
+    size_t bytes,
+    uint32_t* out) {
+  CHECK(pieceBytes > 0 && kANSChecksumBlockSize % pieceBytes == 0)
+      << "pieces of " << pieceBytes << " bytes do not divide checksum blocks";
+
+  size_t numBlocks = getNumChecksumBlocks(bytes);
+  size_t numPieces = divUp(bytes, (size_t)pieceBytes);
+  size_t blockPieces = kANSChecksumBlockSize / pieceBytes;
+
+  if (blockPieces == 1) {
+    if (pieceCrc != out) {
+      std::memcpy(out, pieceCrc, numBlocks * sizeof(uint32_t));
+    }
+  } else {
+    Crc32cCombiner combinePiece(pieceBytes);
+
+    for (size_t b = 0; b < numBlocks; ++b) {
+      uint32_t crc = 0;
+
+      for (size_t p = b * blockPieces;
+           p < std::min(numPieces, (b + 1) * blockPieces);
+           ++p) {
+        // The last piece may be partial
+        size_t size = std::min(bytes - p * pieceBytes, (size_t)pieceBytes);
+        crc = size == pieceBytes ? combinePiece(crc, pieceCrc[p])
+                                 : crc32cCombine(crc, pieceCrc[p], size);
+      }
+
+      out[b] = crc;
+    }
+  }
+
+  out[numBlocks] = combineBlockChecksums(out, bytes);
+
+  std::memset(
+      out + numBlocks + 1,
+      0,
+      getBlockChecksumSize(bytes) - (numBlocks + 1) * sizeof(uint32_t));
+}
+
+bool ansCheckBlockChecksumBatchCpu(
+    ThreadPool& pool,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    uint32_t wordSize,
+    const uint32_t** checksums,
+    std::vector<std::pair<int, std::vector<uint32_t>>>& failedBlocks,
+    std::vector<std::pair<int, std::string>>& errorInfo) {
+  auto blockStart =
+      getChecksumBlockStart(numInBatch, size, wordSize, checksums);
+  auto crc = std::vector<uint32_t>(blockStart[numInBatch]);
+
+  checksumBlocks(
+      pool, numInBatch, in, size, wordSize, blockStart, crc.data());
+
+  auto failed = std::vector<std::vector<uint32_t>>(numInBatch);
+  auto allMatch = std::vector<uint8_t>(numInBatch, 1);
+
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    if (!checksums[batch]) {
+      return;
+    }
+
+    size_t bytes = (size_t)size[batch] * wordSize;
+    size_t numBlocks = blockStart[batch + 1] - blockStart[batch];
+    auto blockCrc = crc.data() + blockStart[batch];
+
+    for (size_t b = 0; b < numBlocks; ++b) {
+      if (blockCrc[b] != checksums[batch][b]) {
+        failed[batch].push_back(b);
+      }
+    }
+
+    allMatch[batch] =
+        combineBlockChecksums(blockCrc, bytes) == checksums[batch][numBlocks];
+  });
+
+  bool ok = true;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (failed[i].empty() && allMatch[i]) {
+      continue;
+    }
+
+    ok = false;
+    addBlockChecksumFailure(
+        i,
+        std::move(failed[i]),
+        blockStart[i + 1] - blockStart[i],
+        failedBlocks,
+        errorInfo);
+  }
+
+  return ok;
+}
+
+} // namespace dietgpu
@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "dietgpu/ans/GpuANSCodec.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+namespace dietgpu {
+
+//
+// Host (CPU) implementation of the ANS codec
+//
+// These functions produce and consume exactly the same archive format as
+// ansEncodeBatch* / ansDecodeBatch* (the ANSCoalescedHeader, the pdf table,
+// per-block warp states, the block word index and 16 byte aligned block data),
+// so data compressed on the host can be decompressed on the GPU and vice
+// versa. All pointers are host pointers, and no GPU is required.
+//
+// Work is spread across the threads of `pool` at the granularity of blocks
+// (of config.blockSize on compression, or of the block size recorded in each
+// archive on decompression) across all members of the batch.
+//
+
+void ansEncodeBatchCpu(
+    ThreadPool& pool,
+    // Compression configuration
+    const ANSCodecConfig& config,
+
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the input batch
+    // to compress
+    const void** in,
+    // Host array with sizes of batch members
+    const uint32_t* inSize,
+
+    // Optional (can be null): host array of size numInBatch x 256 words
+    // containing pre-calculated symbol counts (histogram) of the data to be
+    // compressed. Unused with segments, which need per-block statistics
+    const uint32_t* histogram,
+
+    // Host array with addresses of host pointers for the compressed output
+    // arrays. Each out[i] must be a region of memory of size at least
+    // getMaxCompressedSize(inSize[i], config.blockSize,
+    // config.useWideState, config.getMaxTables(), config.useBlockChecksum)
+    void** out,
+    // Host array of size numInBatch (optional)
+    // Provides the size of actual used memory in each output compressed batch
+    uint32_t* outSize,
+
+    // Delta mode (optional, can be nullptr): host array with addresses of host
+    // pointers to a reference of inSize[i] bytes for each batch member, or
+    // nullptr for a member coded without one. A member with a reference is
+    // coded as the XOR of its data with the reference, which is then largely
+    // zero where the two agree (e.g., successive checkpoints of a weight).
+    // The histogram (if given) and checksum are those of the XOR, and the
+    // archive records that the reference is needed to decode it
+    const void** ref = nullptr);
+
+// The block checksums of archives that hold them (see
+// ANSCodecConfig::useBlockChecksum) are verified against the decoded data,
+// with any blocks that do not match reported in the returned status
+ANSDecodeStatus ansDecodeBatchCpu(
+    ThreadPool& pool,
+    // Expected compression configuration (we verify this upon decompression)
+    const ANSCodecConfig& config,
+
+    // Number of separate, independent decompression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers corresponding to compressed
+    // inputs
+    const void** in,
+
+    // Host array with addresses of host pointers corresponding to
+    // uncompressed outputs
+    void** out,
+
+    // Host array with size of memory regions provided in out; if the seen
+    // decompressed size is greater than this, then there will be an error in
+    // decompression
+    const uint32_t* outCapacity,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with true/false
+    // for whether or not decompression status was successful
+    uint8_t* outSuccess,
+
+    // Decode size status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with either the
+    // size decompressed reported if successful, or the required size reported
+    // if our outCapacity was insufficient
+    uint32_t* outSize,
+
+    // Host array with addresses of host pointers to the reference of each
+    // batch member coded in delta mode (see ansEncodeBatchCpu), which is XORed
+    // into the decoded data. Required if any member is a delta archive, and
+    // otherwise unused (can be nullptr)
+    const void** ref = nullptr);
+
+// Random-access decode: decompresses only bytes
+// [rangeOffset[i], rangeOffset[i] + rangeSize[i]) of each archive into out[i],
+// decoding only the blocks that cover the range (found via the per-block
+// index in the archive) and trimming the first and last of them. A range that
+// extends past the end of the archive's data is a decode failure. The
+// checksum covers the entire data, so config.useChecksum must be false; block
+// checksums are not verified
+void ansDecodeRangeBatchCpu(
+    ThreadPool& pool,
+    // Expected compression configuration (we verify this upon decompression)
+    const ANSCodecConfig& config,
+
+    // Number of separate, independent decompression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers corresponding to compressed
+    // inputs
+    const void** in,
+
+    // Host arrays with the byte offset and size of the range to decode from
+    // each batch member
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+
+    // Host array with addresses of host pointers, each to a region of memory
+    // of at least rangeSize[i] bytes
+    void** out,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with true/false
+    // for whether or not the range could be decoded
+    uint8_t* outSuccess,
+
+    // References of the members coded in delta mode, as for
+    // ansDecodeBatchCpu; the bytes of the reference at the range are used
+    const void** ref = nullptr);
+
+// Trains a dictionary pdf (for ANSDictionary) of precision probBits from the
+// combined symbol statistics of a batch of representative sample inputs. Every
+// symbol is given a non-zero probability, so that the dictionary can encode
+// any data, not just data seen in training
+void ansTrainDictionaryCpu(
+    ThreadPool& pool,
+    int probBits,
+
+    // Number of sample inputs
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers to the sample inputs
+    const void** in,
+    // Host array with sizes of the sample inputs
+    const uint32_t* inSize,
+
+    // Host array of size 256 receiving the pdf
+    uint16_t* probsOut);
+
+} // namespace dietgpu
@@ -0,0 +1,804 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Decodes either all of each archive (if rangeOffset is null) or only the bytes
+// [rangeOffset[i], rangeOffset[i] + rangeSize[i]) of it; in the latter case
+// out[i] receives the range alone and outCapacity and outSize are unused
+ANSDecodeStatus ansDecodeBatchCpuImpl(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  CHECK(isValidANSProbBits(config.probBits))
+      << "unhandled pdf precision " << config.probBits;
+
+  auto dict = config.dictionary;
+  CHECK(!dict || dict->getProbBits() == config.probBits)
+      << "dictionary precision " << dict->getProbBits()
+      << " does not match probBits " << config.probBits;
+
+  // The first block of each batch member in the global list of blocks; members
+  // that we cannot decode contribute no blocks
+  auto blockStart = std::vector<uint32_t>(numInBatch + 1);
+
+  // The byte range of each batch member that we decode, and the first block
+  // covering it
+  auto range = std::vector<std::pair<uint32_t, uint32_t>>(numInBatch);
+  auto firstBlock = std::vector<uint32_t>(numInBatch);
+
+  // The offset of the decoding table of each batch member (followed by those
+  // of its other contexts or segments, if any). With a dictionary, all batch
+  // members share its decoding table
+  auto tableWords = getANSDecodeTableWords(config.probBits);
+  auto tableStart = std::vector<uint32_t>(numInBatch + 1);
+
+  // The context of each symbol, for batch members using contexts
+  auto symbolContext = std::vector<uint8_t>(numInBatch * kNumSymbols);
+
+  // Whether each batch member is a valid archive that we decode; corrupt
+  // archives are reported as failures
+  auto isValid = std::vector<uint8_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const ANSCoalescedHeader*)in[i];
+
+    if (!header->isValidMagicAndVersion()) {
+      if (outSuccess) {
+        outSuccess[i] = false;
+      }
+
+      if (outSize && !rangeOffset) {
+        outSize[i] = 0;
+      }
+
+      tableStart[i + 1] = tableStart[i];
+      blockStart[i + 1] = blockStart[i];
+      continue;
+    }
+
+    isValid[i] = true;
+
+    // Is the data what we expect?
+    CHECK_EQ(header->getProbBits(), config.probBits);
+    CHECK_EQ(header->getUseWideState(), config.useWideState);
+    CHECK_EQ(header->getUseDictionary(), dict != nullptr)
+        << "archive and config disagree on the use of a dictionary";
+
+    if (dict) {
+      CHECK_EQ(header->getDictionaryId(), dict->getId())
+          << "archive was compressed with a different dictionary";
+    } else {
+      tableStart[i + 1] =
+          tableStart[i] + header->getNumTables() * tableWords;
+    }
+
+    auto uncompressedBytes =
+        header->getTotalUncompressedWords() * sizeof(ANSDecodedT);
+    bool success;
+
+    if (rangeOffset) {
+      // Does the range lie within the data?
+      success = rangeOffset[i] <= uncompressedBytes &&
+          rangeSize[i] <= uncompressedBytes - rangeOffset[i];
+      range[i] = std::make_pair(rangeOffset[i], rangeOffset[i] + rangeSize[i]);
+    } else {
+      // Do we have enough space for the decompressed data?
+      success = outCapacity[i] >= uncompressedBytes;
+      range[i] = std::make_pair(0U, uncompressedBytes);
+
+      if (outSize) {
+        outSize[i] = uncompressedBytes;
+      }
+    }
+
+    if (outSuccess) {
+      outSuccess[i] = success;
+    }
+
+    auto blockSize = header->getBlockSize();
+    firstBlock[i] = range[i].first / blockSize;
+    uint32_t endBlock = range[i].first == range[i].second
+        ? firstBlock[i]
+        : divUp(range[i].second, blockSize);
+
+    blockStart[i + 1] =
+        blockStart[i] + (success ? endBlock - firstBlock[i] : 0);
+  }
+
+  auto table = std::vector<TableT>(tableStart[numInBatch]);
+  auto tableData = dict ? dict->getDecodeTable() : table.data();
+
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    if (!dict && blockStart[batch + 1] != blockStart[batch]) {
+      auto header = (const ANSCoalescedHeader*)in[batch];
+      auto batchTable = table.data() + tableStart[batch];
+
+      uint16_t probs[kNumSymbols];
+      bool isValidTable = true;
+
+      if (header->getNumTables() == 1) {
+        header->readSymbolProbs(probs);
+        isValidTable = ansDecodeTableCpu(probs, config.probBits, batchTable);
+      } else {
+        header->getSymbolContexts(symbolContext.data() + batch * kNumSymbols);
+
+        for (uint32_t t = 0; t < header->getNumTables(); ++t) {
+          header->readTableSymbolProbs(t, probs);
+
+          // A context that no symbol was coded in has an empty pdf
+          bool isEmpty = std::all_of(
+              probs, probs + kNumSymbols, [](uint16_t p) { return p == 0; });
+
+          if (isEmpty) {
+            std::memset(
+                batchTable + t * tableWords, 0, tableWords * sizeof(TableT));
+          } else if (!ansDecodeTableCpu(
+                         probs, config.probBits, batchTable + t * tableWords)) {
+            isValidTable = false;
+          }
+        }
+      }
+
+      // The blocks of a member with a corrupt pdf are not decoded
+      if (!isValidTable) {
+        isValid[batch] = false;
+
+        if (outSuccess) {
+          outSuccess[batch] = false;
+        }
+      }
+    }
+  });
+
+  // The vectorized decoders only handle 32 bit states
+  auto decodeBlock = config.useWideState
+      ? nullptr
+      : getANSDecodeBlockCpu(config.probBits, getCpuSimdLevel());
+
+  pool.parallelFor(blockStart[numInBatch], [&](size_t globalBlock) {
+    uint32_t batch =
+        std::upper_bound(blockStart.begin(), blockStart.end(), globalBlock) -
+        blockStart.begin() - 1;
+
+    if (!isValid[batch]) {
+      return;
+    }
+
+    auto header = (const ANSCoalescedHeader*)in[batch];
+    auto numBlocks = header->getNumBlocks();
+    auto blockSize = header->getBlockSize();
+    uint32_t block = firstBlock[batch] + (globalBlock - blockStart[batch]);
+
+    auto blockWords = header->getBlockWords(numBlocks)[block];
+    uint32_t uncompressedWords = getBlockUncompressedWords(blockWords);
+    uint32_t compressedWords = getBlockCompressedWords(blockWords);
+
+    // The part of the block within the range we are decoding; blocks at the
+    // edges of a range are decoded in full to temporary memory and trimmed
+    uint32_t blockBegin = block * blockSize;
+    uint32_t begin = std::max(blockBegin, range[batch].first);
+    uint32_t end =
+        std::min(blockBegin + uncompressedWords, range[batch].second);
+    bool isTrimmed =
+        begin != blockBegin || end != blockBegin + uncompressedWords;
+
+    auto tmpBlock = std::vector<ANSDecodedT>(isTrimmed ? uncompressedWords : 0);
+    auto outBlock = isTrimmed
+        ? tmpBlock.data()
+        : (ANSDecodedT*)out[batch] + (blockBegin - range[batch].first);
+
+    auto wordStart = header->getBlockWordStart(blockWords);
+    auto batchTable = tableData + tableStart[batch] +
+        header->getBlockSegment(blockWords) * tableWords;
+
+    // Blocks that are not ANS coded hold the input or a single symbol
+    auto mode = header->getBlockMode(blockWords);
+
+    if (mode == ANSBlockMode::Stored) {
+      std::memcpy(
+          outBlock,
+          header->getBlockDataStart<uint8_t>(numBlocks) +
+              wordStart *
+                  ANSCoalescedHeader::getEncodedWordSize(config.useWideState),
+          uncompressedWords * sizeof(ANSDecodedT));
+    } else if (mode == ANSBlockMode::Constant) {
+      std::memset(
+          outBlock,
+          getBlockConstantSymbol(blockWords),
+          uncompressedWords * sizeof(ANSDecodedT));
+    } else if (header->getUseContexts()) {
+      auto batchSymbolContext = symbolContext.data() + batch * kNumSymbols;
+
+#define RUN_DECODE_CONTEXT(BITS, WIDE)                                      \
+  case BITS:                                                                \
+    ansDecodeContextBlockCpu<BITS, WIDE>(                                   \
+        header->getWarpStates<typename ANSStateInfo<WIDE>::WarpState>() +   \
+            block,                                                          \
+        uncompressedWords,                                                  \
+        compressedWords,                                                    \
+        header->getBlockDataStart<typename ANSStateInfo<WIDE>::EncodedT>(   \
+            numBlocks) +                                                    \
+            wordStart,                                                      \
+        batchTable,                                                         \
+        batchSymbolContext,                                                 \
+        outBlock);                                                          \
+    break
+
+      if (config.useWideState) {
+        switch (config.probBits) {
+          RUN_DECODE_CONTEXT(9, true);
+          RUN_DECODE_CONTEXT(10, true);
+          RUN_DECODE_CONTEXT(11, true);
+          RUN_DECODE_CONTEXT(12, true);
+          RUN_DECODE_CONTEXT(13, true);
+          RUN_DECODE_CONTEXT(14, true);
+          default:
+            CHECK(false) << "unhandled pdf precision " << config.probBits;
+        }
+      } else {
+        switch (config.probBits) {
+          RUN_DECODE_CONTEXT(9, false);
+          RUN_DECODE_CONTEXT(10, false);
+          RUN_DECODE_CONTEXT(11, false);
+          RUN_DECODE_CONTEXT(12, false);
+          RUN_DECODE_CONTEXT(13, false);
+          RUN_DECODE_CONTEXT(14, false);
+          default:
+            CHECK(false) << "unhandled pdf precision " << config.probBits;
+        }
+      }
+
+#undef RUN_DECODE_CONTEXT
+    } else if (!config.useWideState) {
+      decodeBlock(
+          header->getWarpStates() + block,
+          uncompressedWords,
+          compressedWords,
+          header->getBlockDataStart(numBlocks) + wordStart,
+          batchTable,
+          outBlock);
+    } else {
+      auto state = header->getWarpStates<ANSWideWarpState>() + block;
+      auto inBlock =
+          header->getBlockDataStart<ANSWideEncodedT>(numBlocks) + wordStart;
+
+#define RUN_DECODE_WIDE(BITS)      \
+  case BITS:                       \
+    ansDecodeBlockCpu<BITS, true>( \
+        state,                     \
+        uncompressedWords,         \
+        compressedWords,           \
+        inBlock,                   \
+        batchTable,                \
+        outBlock);                 \
+    break
+
+      switch (config.probBits) {
+        RUN_DECODE_WIDE(9);
+        RUN_DECODE_WIDE(10);
+        RUN_DECODE_WIDE(11);
+        RUN_DECODE_WIDE(12);
+        RUN_DECODE_WIDE(13);
+        RUN_DECODE_WIDE(14);
+        default:
+          CHECK(false) << "unhandled pdf precision " << config.probBits;
+      }
+
+#undef RUN_DECODE_WIDE
+    }
+
+    if (isTrimmed) {
+      std::memcpy(
+          (ANSDecodedT*)out[batch] + (begin - range[batch].first),
+          outBlock + (begin - blockBegin),
+          (end - begin) * sizeof(ANSDecodedT));
+    }
+  });
+
+  ANSDecodeStatus status;
+
+  // Perform optional checksum, if desired
+  if (config.useChecksum) {
+    auto newChecksums = std::vector<uint32_t>(numInBatch);
+
+    pool.parallelFor(numInBatch, [&](size_t batch) {
+      auto header = (const ANSCoalescedHeader*)in[batch];
+      if (!isValid[batch]) {
+        return;
+      }
+
+      newChecksums[batch] = ansChecksumCpu(
+          (const uint8_t*)out[batch],
+          std::min(
+              header->getTotalUncompressedWords() * sizeof(ANSDecodedT),
+              (size_t)outCapacity[batch]));
+    });
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      auto header = (const ANSCoalescedHeader*)in[i];
+
+      // Corrupt archives have already failed
+      if (isValid[i] && header->getChecksum() != newChecksums[i]) {
+        status.error = ANSDecodeError::ChecksumMismatch;
+
+        std::stringstream errStr;
+        errStr << "Checksum mismatch in batch member " << i
+               << ": expected checksum " << std::hex << header->getChecksum()
+               << " got " << newChecksums[i] << "\n";
+        status.errorInfo.push_back(std::make_pair(i, errStr.str()));
+      }
+    }
+  }
+
+  return status;
+}
+
+// Returns the shuffle width of an archive, or 1 if it is not valid (which the
+// decoder reports)
+uint32_t getArchiveShuffleWidth(const void* in) {
+  auto header = (const ANSCoalescedHeader*)in;
+  return header->isValidMagicAndVersion() ? header->getShuffleWidth() : 1;
+}
+
+// Returns whether an archive is coded in delta mode, or false if it is not
+// valid (which the decoder reports)
+bool getArchiveUseDelta(const void* in) {
+  auto header = (const ANSCoalescedHeader*)in;
+  return header->isValidMagicAndVersion() && header->getUseDelta();
+}
+
+// Returns which batch members are coded in delta mode, checking that each of
+// them has a reference
+std::vector<uint8_t>
+getBatchUseDelta(uint32_t numInBatch, const void** in, const void** ref) {
+  auto isDelta = std::vector<uint8_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    isDelta[i] = getArchiveUseDelta(in[i]);
+    CHECK(!isDelta[i] || (ref && ref[i]))
+        << "batch member " << i << " is coded in delta mode and needs a "
+        << "reference to decode";
+  }
+
+  return isDelta;
+}
+
+// As ansDecodeBatchCpu, leaving members coded in delta mode as decoded
+ANSDecodeStatus ansDecodeBatchShuffledCpu(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  // Shuffled batch members are decoded to temporary space, then unshuffled
+  // into the output
+  auto width = std::vector<uint32_t>(numInBatch);
+  auto tmpStart = std::vector<size_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const ANSCoalescedHeader*)in[i];
+    width[i] = getArchiveShuffleWidth(in[i]);
+
+    size_t size = width[i] > 1
+        ? std::min(
+              header->getTotalUncompressedWords() * sizeof(ANSDecodedT),
+              (size_t)outCapacity[i])
+        : 0;
+    tmpStart[i + 1] = tmpStart[i] + roundUp(size, (size_t)kBlockAlignment);
+  }
+
+  if (tmpStart[numInBatch] == 0) {
+    return ansDecodeBatchCpuImpl(
+        pool,
+        config,
+        numInBatch,
+        in,
+        nullptr,
+        nullptr,
+        out,
+        outCapacity,
+        outSuccess,
+        outSize);
+  }
+
+  auto tmp = std::vector<uint8_t>(tmpStart[numInBatch]);
+  auto decOut = std::vector<void*>(out, out + numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (tmpStart[i + 1] != tmpStart[i]) {
+      decOut[i] = tmp.data() + tmpStart[i];
+    }
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto size = std::vector<uint32_t>(numInBatch);
+
+  auto status = ansDecodeBatchCpuImpl(
+      pool,
+      config,
+      numInBatch,
+      in,
+      nullptr,
+      nullptr,
+      decOut.data(),
+      outCapacity,
+      success.data(),
+      size.data());
+
+  // Unshuffle the members that were decoded to temporary space, in chunks of
+  // elements
+  constexpr uint32_t kUnshuffleChunkSize = 64 * 1024;
+  auto chunkStart = std::vector<uint32_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    bool isShuffled = decOut[i] != out[i] && success[i];
+    chunkStart[i + 1] = chunkStart[i] +
+        (isShuffled ? divUp(size[i] / width[i], kUnshuffleChunkSize) : 0);
+
+    // The trailing partial element kept its place
+    if (isShuffled) {
+      uint32_t tailStart = size[i] / width[i] * width[i];
+      std::memcpy(
+          (uint8_t*)out[i] + tailStart,
+          (const uint8_t*)decOut[i] + tailStart,
+          size[i] - tailStart);
+    }
+  }
+
+  pool.parallelFor(chunkStart[numInBatch], [&](size_t chunk) {
+    uint32_t batch =
+        std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+        chunkStart.begin() - 1;
+
+    uint32_t begin = (chunk - chunkStart[batch]) * kUnshuffleChunkSize;
+    uint32_t end =
+        std::min(size[batch] / width[batch], begin + kUnshuffleChunkSize);
+
+    ansUnshuffleCpu(
+        (const uint8_t*)decOut[batch],
+        size[batch],
+        width[batch],
+        begin,
+        end,
+        (uint8_t*)out[batch]);
+  });
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = size[i];
+    }
+  }
+
+  return status;
+}
+
+// As ansDecodeRangeBatchCpu, leaving members coded in delta mode as decoded
+void ansDecodeRangeBatchShuffledCpu(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    uint8_t* outSuccess) {
+  CHECK(!config.useChecksum)
+      << "the checksum cannot be verified when decoding a range";
+
+  // The range of a shuffled batch member covers a run of elements in each of
+  // its planes, followed by part of the trailing partial element. These
+  // sub-ranges of the shuffled data are decoded to temporary space, and the
+  // range is gathered from them. Other members are decoded as a single
+  // sub-range directly to the output
+  auto width = std::vector<uint32_t>(numInBatch);
+  auto subStart = std::vector<uint32_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const ANSCoalescedHeader*)in[i];
+    width[i] = getArchiveShuffleWidth(in[i]);
+
+    // A range outside of the data fails to decode either way
+    auto uncompressedBytes =
+        header->getTotalUncompressedWords() * sizeof(ANSDecodedT);
+    if (rangeOffset[i] > uncompressedBytes ||
+        rangeSize[i] > uncompressedBytes - rangeOffset[i]) {
+      width[i] = 1;
+    }
+
+    subStart[i + 1] = subStart[i] + (width[i] > 1 ? width[i] + 1 : 1);
+  }
+
+  uint32_t numSub = subStart[numInBatch];
+
+  if (numSub == numInBatch) {
+    ansDecodeBatchCpuImpl(
+        pool,
+        config,
+        numInBatch,
+        in,
+        rangeOffset,
+        rangeSize,
+        out,
+        nullptr,
+        outSuccess,
+        nullptr);
+    return;
+  }
+
+  auto subIn = std::vector<const void*>(numSub);
+  auto subOffset = std::vector<uint32_t>(numSub);
+  auto subSize = std::vector<uint32_t>(numSub);
+  auto subOut = std::vector<void*>(numSub);
+  auto subTmpStart = std::vector<size_t>(numSub + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto sub = subStart[i];
+
+    if (width[i] == 1) {
+      subIn[sub] = in[i];
+      subOffset[sub] = rangeOffset[i];
+      subSize[sub] = rangeSize[i];
+      subTmpStart[sub + 1] = subTmpStart[sub];
+      continue;
+    }
+
+    auto header = (const ANSCoalescedHeader*)in[i];
+    uint32_t size = header->getTotalUncompressedWords() * sizeof(ANSDecodedT);
+    uint32_t numElements = size / width[i];
+    uint32_t tailStart = numElements * width[i];
+
+    uint32_t begin = rangeOffset[i];
+    uint32_t end = rangeOffset[i] + rangeSize[i];
+
+    // The elements covering the range, in each plane
+    uint32_t beginElement = std::min(begin / width[i], numElements);
+    uint32_t endElement = std::min(divUp(end, width[i]), numElements);
+
+    for (uint32_t j = 0; j <= width[i]; ++j, ++sub) {
+      subIn[sub] = in[i];
+
+      if (j < width[i]) {
+        subOffset[sub] = j * numElements + beginElement;
+        subSize[sub] = endElement - beginElement;
+      } else {
+        subOffset[sub] = std::max(begin, tailStart);
+        subSize[sub] = end - std::min(end, subOffset[sub]);
+      }
+
+      subTmpStart[sub + 1] = subTmpStart[sub] + subSize[sub];
+    }
+  }
+
+  auto tmp = std::vector<uint8_t>(subTmpStart[numSub]);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    for (auto sub = subStart[i]; sub < subStart[i + 1]; ++sub) {
+      subOut[sub] = width[i] == 1 ? out[i] : tmp.data() + subTmpStart[sub];
+    }
+  }
+
+  auto subSuccess = std::vector<uint8_t>(numSub);
+
+  ansDecodeBatchCpuImpl(
+      pool,
+      config,
+      numSub,
+      subIn.data(),
+      subOffset.data(),
+      subSize.data(),
+      subOut.data(),
+      nullptr,
+      subSuccess.data(),
+      nullptr);
+
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    bool success = std::all_of(
+        subSuccess.begin() + subStart[batch],
+        subSuccess.begin() + subStart[batch + 1],
+        [](uint8_t s) { return s != 0; });
+
+    if (outSuccess) {
+      outSuccess[batch] = success;
+    }
+
+    if (!success || width[batch] == 1) {
+      return;
+    }
+
+    auto w = width[batch];
+    auto header = (const ANSCoalescedHeader*)in[batch];
+    uint32_t size = header->getTotalUncompressedWords() * sizeof(ANSDecodedT);
+    uint32_t numElements = size / w;
+    uint32_t tailStart = numElements * w;
+
+    uint32_t begin = rangeOffset[batch];
+    uint32_t beginElement = std::min(begin / w, numElements);
+    auto sub = subStart[batch];
+    auto outBytes = (uint8_t*)out[batch];
+
+    for (uint32_t p = begin; p < begin + rangeSize[batch]; ++p) {
+      *outBytes++ = p < tailStart
+          ? ((const uint8_t*)subOut[sub + p % w])[p / w - beginElement]
+          : ((const uint8_t*)subOut[sub + w])[p - subOffset[sub + w]];
+    }
+  });
+}
+
+} // namespace
+
+ANSDecodeStatus ansDecodeBatchCpu(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize,
+    const void** ref) {
+  auto isDelta = getBatchUseDelta(numInBatch, in, ref);
+
+  bool anyDelta = std::any_of(
+      isDelta.begin(), isDelta.end(), [](uint8_t d) { return d != 0; });
+  bool anyBlockChecksum = false;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const ANSCoalescedHeader*)in[i];
+    anyBlockChecksum = anyBlockChecksum || header->getUseBlockChecksum();
+  }
+
+  if (!anyDelta && !anyBlockChecksum) {
+    return ansDecodeBatchShuffledCpu(
+        pool,
+        config,
+        numInBatch,
+        in,
+        out,
+        outCapacity,
+        outSuccess,
+        outSize);
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto size = std::vector<uint32_t>(numInBatch);
+
+  auto status = ansDecodeBatchShuffledCpu(
+      pool,
+      config,
+      numInBatch,
+      in,
+      out,
+      outCapacity,
+      success.data(),
+      size.data());
+
+  // XOR the reference back into the delta members that we could decode
+  if (anyDelta) {
+    auto deltaRef = std::vector<const void*>(numInBatch);
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      deltaRef[i] = isDelta[i] && success[i] ? ref[i] : nullptr;
+    }
+
+    ansXorBatchCpu(
+        pool,
+        numInBatch,
+        (const void**)out,
+        deltaRef.data(),
+        size.data(),
+        1,
+        out);
+  }
+
+  // The block checksums are of the original data, so they are verified last
+  if (anyBlockChecksum) {
+    auto checksums = std::vector<const uint32_t*>(numInBatch);
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      auto header = (const ANSCoalescedHeader*)in[i];
+
+      if (header->getUseBlockChecksum() && success[i]) {
+        checksums[i] = header->getBlockChecksums();
+      }
+    }
+
+    if (!ansCheckBlockChecksumBatchCpu(
+            pool,
+            numInBatch,
+            (const void**)out,
+            size.data(),
+            1,
+            checksums.data(),
+            status.failedBlocks,
+            status.errorInfo)) {
+      status.error = ANSDecodeError::ChecksumMismatch;
+    }
+  }
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = size[i];
+    }
+  }
+
+  return status;
+}
+
+void ansDecodeRangeBatchCpu(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    uint8_t* outSuccess,
+    const void** ref) {
+  auto isDelta = getBatchUseDelta(numInBatch, in, ref);
+  auto success = std::vector<uint8_t>(numInBatch);
+
+  ansDecodeRangeBatchShuffledCpu(
+      pool,
+      config,
+      numInBatch,
+      in,
+      rangeOffset,
+      rangeSize,
+      out,
+      success.data());
+
+  // The range of a delta member is XORed with the same range of its reference
+  auto deltaRef = std::vector<const void*>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    deltaRef[i] = isDelta[i] && success[i]
+        ? (const uint8_t*)ref[i] + rangeOffset[i]
+        : nullptr;
+  }
+
+  ansXorBatchCpu(
+      pool,
+      numInBatch,
+      (const void**)out,
+      deltaRef.data(),
+      rangeSize,
+      1,
+      out);
+
+  if (outSuccess) {
+    std::copy(success.begin(), success.end(), outSuccess);
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,369 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSUtils.h"
+
+#include <glog/logging.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DIETGPU_CPU_X86 1
+#include <immintrin.h>
+#endif
+
+namespace dietgpu {
+
+namespace {
+
+// Decodes the final (partial) warp iteration of the encoder, in which only the
+// lanes [0, numLanes) were valid. Returns the new position in the compressed
+// words
+template <int ProbBits>
+const ANSEncodedT* decodePartialStep(
+    ANSStateT* laneState,
+    uint32_t numLanes,
+    const ANSEncodedT* in,
+    const TableT* __restrict__ table,
+    ANSDecodedT* __restrict__ out) {
+  constexpr ANSStateT StateMask = (ANSStateT(1) << ProbBits) - ANSStateT(1);
+
+  for (int lane = numLanes - 1; lane >= 0; --lane) {
+    ANSStateT s = laneState[lane];
+
+    uint32_t sym;
+    uint32_t pdf;
+    uint32_t sMinusCdf;
+    ansDecodeLookup<ProbBits>(table, s & StateMask, sym, pdf, sMinusCdf);
+
+    out[lane] = sym;
+    s = pdf * (s >> ProbBits) + ANSStateT(sMinusCdf);
+
+    if (s < kANSMinState) {
+      s = (s << kANSEncodedBits) + ANSStateT(*(--in));
+    }
+
+    laneState[lane] = s;
+  }
+
+  return in;
+}
+
+#ifdef DIETGPU_CPU_X86
+
+//
+// AVX2: the 32 lanes of the warp are held in 4 vectors of 8 lanes
+//
+
+// For each 8 bit lane mask, the rank of each lane among the set lanes
+struct ExpandTableAVX2 {
+  ExpandTableAVX2() {
+    for (int mask = 0; mask < 256; ++mask) {
+      int rank = 0;
+      for (int lane = 0; lane < 8; ++lane) {
+        idx[mask][lane] = rank;
+        rank += (mask >> lane) & 1;
+      }
+    }
+  }
+
+  alignas(32) int32_t idx[256][8];
+};
+
+const ExpandTableAVX2 kExpandTableAVX2;
+
+// Looks up the symbol, pdf and (sBar - cdf) for 8 lanes, as ansDecodeLookup
+template <int ProbBits>
+__attribute__((target("avx2"))) inline void lookupLanesAVX2(
+    __m256i sBar,
+    const TableT* __restrict__ table,
+    __m256i& sym,
+    __m256i& pdf,
+    __m256i& sMinusCdf) {
+  if (ProbBits <= kANSMaxPackedProbBits) {
+    auto lookup =
+        _mm256_i32gather_epi32((const int*)table, sBar, sizeof(TableT));
+
+    sym = _mm256_and_si256(lookup, _mm256_set1_epi32(0xff));
+    pdf = _mm256_and_si256(
+        _mm256_srli_epi32(lookup, 8), _mm256_set1_epi32(0xfff));
+    sMinusCdf = _mm256_srli_epi32(lookup, 20);
+  } else {
+    // The 4 byte gather of the symbol reads past the end of the symbols for
+    // the last buckets, which is the pdf/cdf data that follows
+    sym = _mm256_and_si256(
+        _mm256_i32gather_epi32((const int*)table, sBar, 1),
+        _mm256_set1_epi32(0xff));
+
+    auto info = _mm256_i32gather_epi32(
+        (const int*)(table + (1 << ProbBits) / sizeof(TableT)),
+        sym,
+        sizeof(TableT));
+
+    pdf = _mm256_and_si256(info, _mm256_set1_epi32(0xffff));
+    sMinusCdf = _mm256_sub_epi32(sBar, _mm256_srli_epi32(info, 16));
+  }
+}
+
+// Decodes a step for 8 lanes, with `in` pointing one past the next compressed
+// word to be read. Returns the new position in the compressed words
+template <int ProbBits>
+__attribute__((target("avx2"))) inline const ANSEncodedT* decodeLanesAVX2(
+    __m256i& s,
+    __m256i& sym,
+    const ANSEncodedT* in,
+    const TableT* __restrict__ table) {
+  const __m256i kStateMask = _mm256_set1_epi32((1 << ProbBits) - 1);
+  const __m256i kMinState = _mm256_set1_epi32(kANSMinState);
+
+  __m256i pdf;
+  __m256i sMinusCdf;
+  lookupLanesAVX2<ProbBits>(
+      _mm256_and_si256(s, kStateMask), table, sym, pdf, sMinusCdf);
+
+  s = _mm256_add_epi32(
+      _mm256_mullo_epi32(pdf, _mm256_srli_epi32(s, ProbBits)), sMinusCdf);
+
+  // States are < 2^31, so a signed comparison suffices
+  auto renorm = _mm256_cmpgt_epi32(kMinState, s);
+  uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(renorm));
+
+  if (mask) {
+    uint32_t num = __builtin_popcount(mask);
+
+    // The lanes that renormalize read the last `num` words in increasing lane
+    // order. We load the 8 words ending at `in` (there is always other archive
+    // data before the block data) and route the last `num` of them to the
+    // lanes that need them
+    auto words = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128((const __m128i*)(in - 8)));
+    auto idx = _mm256_add_epi32(
+        _mm256_load_si256((const __m256i*)kExpandTableAVX2.idx[mask]),
+        _mm256_set1_epi32(8 - num));
+    words = _mm256_permutevar8x32_epi32(words, idx);
+
+    s = _mm256_blendv_epi8(
+        s,
+        _mm256_or_si256(_mm256_slli_epi32(s, kANSEncodedBits), words),
+        renorm);
+
+    in -= num;
+  }
+
+  return in;
+}
+
+template <int ProbBits>
+__attribute__((target("avx2"))) void ansDecodeBlockAVX2(
+    const ANSWarpState* __restrict__ state,
+    uint32_t uncompressedWords,
+    uint32_t compressedWords,
+    const ANSEncodedT* __restrict__ in,
+    const TableT* __restrict__ table,
+    ANSDecodedT* __restrict__ out) {
+  ANSStateT laneState[kWarpSize];
+  std::memcpy(laneState, state->warpState, sizeof(laneState));
+
+  // We read the compressed words in reverse
+  in += compressedWords;
+
+  uint32_t remainder = uncompressedWords % kWarpSize;
+  uint32_t offset = uncompressedWords - remainder;
+
+  if (remainder) {
+    in = decodePartialStep<ProbBits>(
+        laneState, remainder, in, table, out + offset);
+  }
+
+  __m256i s[4];
+  for (int i = 0; i < 4; ++i) {
+    s[i] = _mm256_loadu_si256((const __m256i*)(laneState + i * 8));
+  }
+
+  const __m256i kPackOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  while (offset > 0) {
+    offset -= kWarpSize;
+
+    // Higher lanes read first
+    __m256i sym[4];
+    for (int i = 3; i >= 0; --i) {
+      in = decodeLanesAVX2<ProbBits>(s[i], sym[i], in, table);
+    }
+
+    // Pack the 32 x 32 bit symbols down to 32 bytes in lane order
+    auto sym01 = _mm256_packus_epi32(sym[0], sym[1]);
+    auto sym23 = _mm256_packus_epi32(sym[2], sym[3]);
+    auto sym0123 = _mm256_packus_epi16(sym01, sym23);
+    sym0123 = _mm256_permutevar8x32_epi32(sym0123, kPackOrder);
+
+    _mm256_storeu_si256((__m256i*)(out + offset), sym0123);
+  }
+}
+
+//
+// AVX-512: the 32 lanes of the warp are held in 2 vectors of 16 lanes
+//
+
+// Looks up the symbol, pdf and (sBar - cdf) for 16 lanes, as ansDecodeLookup
+template <int ProbBits>
+__attribute__((target("avx512f"))) inline void lookupLanesAVX512(
+    __m512i sBar,
+    const TableT* __restrict__ table,
+    __m512i& sym,
+    __m512i& pdf,
+    __m512i& sMinusCdf) {
+  if (ProbBits <= kANSMaxPackedProbBits) {
+    auto lookup =
+        _mm512_i32gather_epi32(sBar, (const int*)table, sizeof(TableT));
+
+    sym = _mm512_and_si512(lookup, _mm512_set1_epi32(0xff));
+    pdf = _mm512_and_si512(
+        _mm512_srli_epi32(lookup, 8), _mm512_set1_epi32(0xfff));
+    sMinusCdf = _mm512_srli_epi32(lookup, 20);
+  } else {
+    // The 4 byte gather of the symbol reads past the end of the symbols for
+    // the last buckets, which is the pdf/cdf data that follows
+    sym = _mm512_and_si512(
+        _mm512_i32gather_epi32(sBar, (const int*)table, 1),
+        _mm512_set1_epi32(0xff));
+
+    auto info = _mm512_i32gather_epi32(
+        sym,
+        (const int*)(table + (1 << ProbBits) / sizeof(TableT)),
+        sizeof(TableT));
+
+    pdf = _mm512_and_si512(info, _mm512_set1_epi32(0xffff));
+    sMinusCdf = _mm512_sub_epi32(sBar, _mm512_srli_epi32(info, 16));
+  }
+}
+
+template <int ProbBits>
+__attribute__((target("avx512f"))) inline const ANSEncodedT*
+decodeLanesAVX512(
+    __m512i& s,
+    ANSDecodedT* __restrict__ out,
+    const ANSEncodedT* in,
+    const TableT* __restrict__ table) {
+  const __m512i kStateMask = _mm512_set1_epi32((1 << ProbBits) - 1);
+  const __m512i kMinState = _mm512_set1_epi32(kANSMinState);
+
+  __m512i sym;
+  __m512i pdf;
+  __m512i sMinusCdf;
+  lookupLanesAVX512<ProbBits>(
+      _mm512_and_si512(s, kStateMask), table, sym, pdf, sMinusCdf);
+
+  _mm_storeu_si128((__m128i*)out, _mm512_cvtepi32_epi8(sym));
+
+  s = _mm512_add_epi32(
+      _mm512_mullo_epi32(pdf, _mm512_srli_epi32(s, ProbBits)), sMinusCdf);
+
+  __mmask16 renorm = _mm512_cmplt_epu32_mask(s, kMinState);
+
+  if (renorm) {
+    uint32_t num = __builtin_popcount(renorm);
+
+    // The lanes that renormalize read the last `num` words in increasing lane
+    // order. We load the 16 words ending at `in` (there is always other archive
+    // data before the block data), shift the last `num` of them down to the
+    // start and expand them into the lanes that need them
+    auto words = _mm512_cvtepu16_epi32(
+        _mm256_loadu_si256((const __m256i*)(in - 16)));
+    auto idx = _mm512_add_epi32(
+        _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+        _mm512_set1_epi32(16 - num));
+    words = _mm512_maskz_expand_epi32(
+        renorm, _mm512_permutexvar_epi32(idx, words));
+
+    s = _mm512_mask_or_epi32(
+        s, renorm, _mm512_slli_epi32(s, kANSEncodedBits), words);
+
+    in -= num;
+  }
+
+  return in;
+}
+
+template <int ProbBits>
+__attribute__((target("avx512f"))) void ansDecodeBlockAVX512(
+    const ANSWarpState* __restrict__ state,
+    uint32_t uncompressedWords,
+    uint32_t compressedWords,
+    const ANSEncodedT* __restrict__ in,
+    const TableT* __restrict__ table,
+    ANSDecodedT* __restrict__ out) {
+  ANSStateT laneState[kWarpSize];
+  std::memcpy(laneState, state->warpState, sizeof(laneState));
+
+  // We read the compressed words in reverse
+  in += compressedWords;
+
+  uint32_t remainder = uncompressedWords % kWarpSize;
+  uint32_t offset = uncompressedWords - remainder;
+
+  if (remainder) {
+    in = decodePartialStep<ProbBits>(
+        laneState, remainder, in, table, out + offset);
+  }
+
+  auto sLo = _mm512_loadu_si512(laneState);
+  auto sHi = _mm512_loadu_si512(laneState + 16);
+
+  while (offset > 0) {
+    offset -= kWarpSize;
+
+    // Higher lanes read first
+    in = decodeLanesAVX512<ProbBits>(sHi, out + offset + 16, in, table);
+    in = decodeLanesAVX512<ProbBits>(sLo, out + offset, in, table);
+  }
+}
+
+#endif // DIETGPU_CPU_X86
+
+template <int ProbBits>
+ANSDecodeBlockCpuFn getDecodeBlock(CpuSimdLevel level) {
+#ifdef DIETGPU_CPU_X86
+  switch (level) {
+    case CpuSimdLevel::AVX512:
+      return ansDecodeBlockAVX512<ProbBits>;
+    case CpuSimdLevel::AVX2:
+      return ansDecodeBlockAVX2<ProbBits>;
+    default:
+      break;
+  }
+#endif
+
+  return ansDecodeBlockCpu<ProbBits>;
+}
+
+} // namespace
+
+ANSDecodeBlockCpuFn getANSDecodeBlockCpu(int probBits, CpuSimdLevel level) {
+  CHECK(isCpuSimdLevelSupported(level))
+      << "instruction set " << getCpuSimdLevelName(level)
+      << " is not supported by this CPU";
+
+  switch (probBits) {
+    case 9:
+      return getDecodeBlock<9>(level);
+    case 10:
+      return getDecodeBlock<10>(level);
+    case 11:
+      return getDecodeBlock<11>(level);
+    case 12:
+      return getDecodeBlock<12>(level);
+    case 13:
+      return getDecodeBlock<13>(level);
+    case 14:
+      return getDecodeBlock<14>(level);
+    default:
+      CHECK(false) << "unhandled pdf precision " << probBits;
+  }
+
+  return nullptr;
+}
+
+} // namespace dietgpu
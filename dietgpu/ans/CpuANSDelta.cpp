@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSUtils.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Number of bytes that are XORed together in parallel
+constexpr size_t kXorChunkSize = 256 * 1024;
+
+} // namespace
+
+void ansXorBatchCpu(
+    ThreadPool& pool,
+    uint32_t numInBatch,
+    const void** in,
+    const void** ref,
+    const uint32_t* size,
+    uint32_t wordSize,
+    void** out) {
+  auto chunkStart = std::vector<size_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    size_t bytes = ref[i] ? (size_t)size[i] * wordSize : 0;
+    chunkStart[i + 1] = chunkStart[i] + divUp(bytes, kXorChunkSize);
+  }
+
+  pool.parallelFor(chunkStart[numInBatch], [&](size_t chunk) {
+    uint32_t batch =
+        std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+        chunkStart.begin() - 1;
+
+    size_t bytes = (size_t)size[batch] * wordSize;
+    size_t begin = (chunk - chunkStart[batch]) * kXorChunkSize;
+    size_t end = std::min(bytes, begin + kXorChunkSize);
+
+    auto inBytes = (const uint8_t*)in[batch];
+    auto refBytes = (const uint8_t*)ref[batch];
+    auto outBytes = (uint8_t*)out[batch];
+
+    for (size_t j = begin; j < end; ++j) {
+      outBytes[j] = inBytes[j] ^ refBytes[j];
+    }
+  });
+}
+
+} // namespace dietgpu
@@ -0,0 +1,826 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "dietgpu/utils/HostArena.h"
+
+namespace dietgpu {
+
+namespace {
+
+// Size of the chunks of input that we compute statistics over in parallel
+constexpr uint32_t kStatisticsChunkSize = 64 * 1024;
+
+// Context statistics depend upon the block layout, so chunks must not split
+// blocks
+static_assert(
+    isEvenDivisor(kStatisticsChunkSize, kANSMaxBlockSize),
+    "chunks must hold whole blocks");
+
+// Number of elements that are shuffled together in parallel
+constexpr uint32_t kShuffleChunkSize = 64 * 1024;
+
+// Maximum number of runs of blocks that segment boundaries are chosen between;
+// larger inputs have boundaries placed at a coarser granularity
+constexpr uint32_t kMaxSegmentUnits = 256;
+
+// Encodes a block into `out`, which receives the warp state followed by the
+// compressed words
+// With more than one context, `table` holds the table of each context and
+// symbolContext the context of each symbol
+template <int ProbBits, bool Wide>
+uint32_t encodeBlock(
+    const ANSDecodedT* in,
+    uint32_t inWords,
+    uint32_t blockSize,
+    const uint4* table,
+    uint32_t numContexts,
+    const uint8_t* symbolContext,
+    void* out) {
+  using Info = ANSStateInfo<Wide>;
+  using EncodedT = typename Info::EncodedT;
+
+  auto state = (typename Info::WarpState*)out;
+  auto outWords = numContexts > 1
+      ? ansEncodeContextBlockCpu<ProbBits, Wide>(
+            in,
+            inWords,
+            table,
+            numContexts,
+            symbolContext,
+            state,
+            (EncodedT*)(state + 1))
+      : ansEncodeBlockCpu<ProbBits, Wide>(
+            in, inWords, table, state, (EncodedT*)(state + 1));
+
+  // As on the GPU, the max compressed size bound must hold
+  CHECK_LE(outWords, getRawCompBlockMaxSize(blockSize) / sizeof(EncodedT));
+
+  return outWords;
+}
+
+template <int ProbBits>
+uint32_t encodeBlock(
+    bool useWideState,
+    const ANSDecodedT* in,
+    uint32_t inWords,
+    uint32_t blockSize,
+    const uint4* table,
+    uint32_t numContexts,
+    const uint8_t* symbolContext,
+    void* out) {
+  return useWideState
+      ? encodeBlock<ProbBits, true>(
+            in, inWords, blockSize, table, numContexts, symbolContext, out)
+      : encodeBlock<ProbBits, false>(
+            in, inWords, blockSize, table, numContexts, symbolContext, out);
+}
+
+// Encodes the batch as ansEncodeBatchCpu, with the input already shuffled by
+// config.shuffleWidth. If checksumIn is given, the archives hold the block
+// checksums of checksumIn[i], the input as given (see
+// ANSCodecConfig::useBlockChecksum), which is in[i] unless it is a delta or
+// has been shuffled
+void ansEncodeBatchCpuImpl(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    const uint32_t* histogram,
+    void** out,
+    uint32_t* outSize,
+    const void** checksumIn) {
+  CHECK(isValidANSProbBits(config.probBits))
+      << "unhandled pdf precision " << config.probBits;
+  CHECK(isValidANSBlockSize(config.blockSize))
+      << "unsupported block size " << config.blockSize;
+
+  CHECK(config.numContexts >= 1 && config.numContexts <= kANSMaxContexts)
+      << "unhandled number of contexts " << config.numContexts;
+  CHECK(config.maxSegments >= 1 && config.maxSegments <= kANSMaxSegments)
+      << "unhandled number of segments " << config.maxSegments;
+
+  uint32_t blockSize = config.blockSize;
+  bool useWideState = config.useWideState;
+  uint32_t maxContexts = config.numContexts;
+  uint32_t maxSegments = config.getMaxSegments();
+
+  auto dict = config.dictionary;
+  CHECK(!dict || dict->getProbBits() == config.probBits)
+      << "dictionary precision " << dict->getProbBits()
+      << " does not match probBits " << config.probBits;
+  CHECK(!dict || maxContexts == 1)
+      << "contexts cannot be used with a dictionary";
+  CHECK(!dict || maxSegments == 1)
+      << "segments cannot be used with a dictionary";
+  CHECK(maxContexts == 1 || maxSegments == 1)
+      << "contexts and segments cannot be used together";
+
+  uint32_t stateSize = ANSCoalescedHeader::getWarpStateSize(useWideState);
+  uint32_t wordSize = ANSCoalescedHeader::getEncodedWordSize(useWideState);
+
+  // Maximum size of each block in the uncoalesced scratch output (warp state
+  // followed by the compressed words)
+  uint32_t uncoalescedBlockMaxSize =
+      stateSize + getRawCompBlockMaxSize(blockSize);
+
+  // The first block of each batch member in the global list of blocks
+  auto blockStart = std::vector<uint32_t>(numInBatch + 1);
+
+  // The first statistics chunk of each batch member
+  auto chunkStart = std::vector<uint32_t>(numInBatch + 1);
+
+  // With segments, the first segmentation unit (a run of unitBlocks blocks
+  // whose statistics are gathered together) of each batch member
+  auto unitStart = std::vector<uint32_t>(numInBatch + 1);
+  auto unitBlocks = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    // all input must meet alignment requirements
+    CHECK_EQ(uintptr_t(in[i]) % kANSRequiredAlignment, 0);
+
+    auto words = inSize[i] / sizeof(ANSDecodedT);
+    uint32_t numBlocks = divUp(words, blockSize);
+    blockStart[i + 1] = blockStart[i] + numBlocks;
+    chunkStart[i + 1] = chunkStart[i] + divUp(words, kStatisticsChunkSize);
+
+    unitBlocks[i] = std::max(divUp(numBlocks, kMaxSegmentUnits), 1U);
+    unitStart[i + 1] = unitStart[i] +
+        (maxSegments > 1 ? divUp(numBlocks, unitBlocks[i]) : 0);
+  }
+
+  uint32_t totalBlocks = blockStart[numInBatch];
+  uint32_t totalChunks = chunkStart[numInBatch];
+  uint32_t totalUnits = unitStart[numInBatch];
+
+  // With block checksums, the CRC32C of the part of each checksum block
+  // within each block (all of the checksum block, unless blocks are smaller)
+  uint32_t pieceBytes = std::min(blockSize, kANSChecksumBlockSize);
+  auto pieceStart = std::vector<size_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch && checksumIn; ++i) {
+    pieceStart[i + 1] = pieceStart[i] + divUp(inSize[i], pieceBytes);
+  }
+
+  auto pieceCrc = std::vector<uint32_t>(pieceStart[numInBatch]);
+
+  // 1. Compute symbol statistics and the optional checksum over chunks of all
+  // of the input. With a dictionary, all batch members share its encoding
+  // table instead. With contexts, each batch member has a table per context,
+  // for the contexts chosen from its symbol statistics. With segments, the
+  // statistics are gathered per unit instead, and each batch member has a
+  // table per segment of units
+  bool needHistogram = !histogram && !dict && maxSegments == 1;
+  uint32_t tableStride = dict ? 0 : kNumSymbols * config.getMaxTables();
+  auto table = std::vector<uint4>(numInBatch * tableStride);
+  auto tableData = dict ? dict->getEncodeTable() : table.data();
+
+  auto numContexts = std::vector<uint32_t>(numInBatch, 1);
+  auto contextSymbol = std::vector<uint8_t>(numInBatch * kANSMaxContexts);
+  auto symbolContext = std::vector<uint8_t>(numInBatch * kNumSymbols);
+
+  auto numSegments = std::vector<uint32_t>(numInBatch, 1);
+  auto blockSegment = std::vector<uint8_t>(maxSegments > 1 ? totalBlocks : 0);
+
+  {
+    auto chunkHistogram =
+        std::vector<uint32_t>(needHistogram ? totalChunks * kNumSymbols : 0);
+    auto chunkChecksum =
+        std::vector<uint32_t>(config.useChecksum ? totalChunks : 0);
+    auto unitHistogram = std::vector<uint32_t>(totalUnits * kNumSymbols);
+
+    if (needHistogram || config.useChecksum) {
+      pool.parallelFor(totalChunks, [&](size_t chunk) {
+        uint32_t batch =
+            std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+            chunkStart.begin() - 1;
+
+        auto start = (chunk - chunkStart[batch]) * kStatisticsChunkSize;
+        auto size =
+            std::min(inSize[batch] - start, (size_t)kStatisticsChunkSize);
+        auto inChunk = (const ANSDecodedT*)in[batch] + start;
+
+        if (needHistogram) {
+          ansHistogramCpu(
+              inChunk, size, chunkHistogram.data() + chunk * kNumSymbols);
+        }
+
+        if (config.useChecksum) {
+          chunkChecksum[chunk] = ansChecksumCpu(inChunk, size);
+        }
+      });
+    }
+
+    pool.parallelFor(totalUnits, [&](size_t unit) {
+      uint32_t batch =
+          std::upper_bound(unitStart.begin(), unitStart.end(), unit) -
+          unitStart.begin() - 1;
+
+      auto unitWords = (size_t)unitBlocks[batch] * blockSize;
+      auto start = (unit - unitStart[batch]) * unitWords;
+
+      ansHistogramCpu(
+          (const ANSDecodedT*)in[batch] + start,
+          std::min(inSize[batch] - start, unitWords),
+          unitHistogram.data() + unit * kNumSymbols);
+    });
+
+    pool.parallelFor(numInBatch, [&](size_t batch) {
+      if (!dict && maxSegments > 1) {
+        uint32_t numUnits = unitStart[batch + 1] - unitStart[batch];
+        auto batchUnitHistogram =
+            unitHistogram.data() + unitStart[batch] * kNumSymbols;
+        auto unitSegment = std::vector<uint32_t>(numUnits);
+
+        numSegments[batch] = ansChooseSegmentsCpu(
+            batchUnitHistogram,
+            numUnits,
+            config.probBits,
+            maxSegments,
+            unitSegment.data());
+
+        for (uint32_t seg = 0; seg < numSegments[batch]; ++seg) {
+          uint32_t counts[kNumSymbols] = {};
+          uint32_t total = 0;
+
+          for (uint32_t u = 0; u < numUnits; ++u) {
+            if (unitSegment[u] == seg) {
+              for (int s = 0; s < kNumSymbols; ++s) {
+                counts[s] += batchUnitHistogram[u * kNumSymbols + s];
+                total += batchUnitHistogram[u * kNumSymbols + s];
+              }
+            }
+          }
+
+          ansCalcWeightsCpu(
+              counts,
+              total,
+              config.probBits,
+              table.data() + batch * tableStride + seg * kNumSymbols);
+        }
+
+        for (auto b = blockStart[batch]; b < blockStart[batch + 1]; ++b) {
+          auto unit = (b - blockStart[batch]) / unitBlocks[batch];
+          blockSegment[b] = unitSegment[unit];
+        }
+      } else if (!dict) {
+        uint32_t counts[kNumSymbols];
+
+        if (histogram) {
+          std::memcpy(counts, histogram + batch * kNumSymbols, sizeof(counts));
+        } else {
+          std::memset(counts, 0, sizeof(counts));
+
+          for (auto c = chunkStart[batch]; c < chunkStart[batch + 1]; ++c) {
+            for (int s = 0; s < kNumSymbols; ++s) {
+              counts[s] += chunkHistogram[c * kNumSymbols + s];
+            }
+          }
+        }
+
+        if (maxContexts > 1) {
+          numContexts[batch] = ansChooseContextsCpu(
+              counts,
+              maxContexts,
+              contextSymbol.data() + batch * kANSMaxContexts,
+              symbolContext.data() + batch * kNumSymbols);
+        }
+
+        // The tables of contexts are computed below
+        if (numContexts[batch] == 1) {
+          ansCalcWeightsCpu(
+              counts,
+              inSize[batch] / sizeof(ANSDecodedT),
+              config.probBits,
+              table.data() + batch * tableStride);
+        }
+      }
+    });
+
+    bool anyContexts = std::any_of(
+        numContexts.begin(), numContexts.end(), [](uint32_t n) {
+          return n > 1;
+        });
+
+    if (anyContexts) {
+      // Count the symbols of each context, over the same chunks
+      auto chunkContextHistogram =
+          std::vector<uint32_t>(totalChunks * maxContexts * kNumSymbols);
+
+      pool.parallelFor(totalChunks, [&](size_t chunk) {
+        uint32_t batch =
+            std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+            chunkStart.begin() - 1;
+
+        if (numContexts[batch] == 1) {
+          return;
+        }
+
+        auto start = (chunk - chunkStart[batch]) * kStatisticsChunkSize;
+        auto size =
+            std::min(inSize[batch] - start, (size_t)kStatisticsChunkSize);
+
+        ansContextHistogramCpu(
+            (const ANSDecodedT*)in[batch] + start,
+            size,
+            blockSize,
+            symbolContext.data() + batch * kNumSymbols,
+            chunkContextHistogram.data() + chunk * maxContexts * kNumSymbols);
+      });
+
+      pool.parallelFor(numInBatch, [&](size_t batch) {
+        for (uint32_t c = 0; c < numContexts[batch]; ++c) {
+          uint32_t counts[kNumSymbols] = {};
+          uint32_t total = 0;
+
+          for (auto ch = chunkStart[batch]; ch < chunkStart[batch + 1]; ++ch) {
+            auto h = chunkContextHistogram.data() +
+                (ch * maxContexts + c) * kNumSymbols;
+
+            for (int s = 0; s < kNumSymbols; ++s) {
+              counts[s] += h[s];
+              total += h[s];
+            }
+          }
+
+          ansCalcWeightsCpu(
+              counts,
+              total,
+              config.probBits,
+              table.data() + batch * tableStride + c * kNumSymbols);
+        }
+      });
+    }
+
+    pool.parallelFor(numInBatch, [&](size_t batch) {
+      uint32_t checksum = 0;
+      if (config.useChecksum) {
+        for (auto c = chunkStart[batch]; c < chunkStart[batch + 1]; ++c) {
+          checksum ^= chunkChecksum[c];
+        }
+      }
+
+      // Write out the header and pdf. The number of compressed words, use of
+      // block modes and thus the version are filled in below once known
+      auto header = (ANSCoalescedHeader*)out[batch];
+      std::memset(header, 0, sizeof(ANSCoalescedHeader));
+
+      header->setNumBlocks(blockStart[batch + 1] - blockStart[batch]);
+      header->setTotalUncompressedWords(inSize[batch] / sizeof(ANSDecodedT));
+      header->setProbBits(config.probBits);
+      header->setUseChecksum(config.useChecksum);
+      header->setBlockSize(blockSize);
+      header->setUseWideState(useWideState);
+      header->setUseDictionary(dict != nullptr);
+      header->setDictionaryId(dict ? dict->getId() : 0);
+      header->setChecksum(checksum);
+      header->setNumContexts(numContexts[batch]);
+      header->setShuffleWidth(config.shuffleWidth);
+
+      if (numSegments[batch] > 1) {
+        header->setNumSegments(numSegments[batch]);
+      }
+
+      auto batchTable = table.data() + batch * tableStride;
+
+      if (header->getNumTables() > 1) {
+        header->writeTableSymbolProbs(
+            contextSymbol.data() + batch * kANSMaxContexts, batchTable);
+      } else if (!dict) {
+        uint32_t numSymbols = 0;
+        uint32_t maxPdf = 0;
+
+        for (int i = 0; i < kNumSymbols; ++i) {
+          numSymbols += batchTable[i].x > 0;
+          maxPdf = std::max(maxPdf, batchTable[i].x);
+        }
+
+        header->setSymbolProbsFormat(numSymbols, maxPdf);
+        header->writeSymbolProbs(batchTable);
+      }
+    });
+  }
+
+  // 2. Encode all blocks across the batch into scratch space. Each thread
+  // writes the blocks it encodes into its own arena, so the scratch is local
+  // to the thread that produces it and is sized by the actual compressed
+  // output rather than the worst case. Blocks that are constant are not
+  // encoded, and blocks that do not shrink are stored from the input instead.
+  // Block checksums are computed here too, while the block is in cache
+  auto arenas = HostArenaSet(pool.getNumThreads());
+  auto compressedBlocks = std::vector<const uint8_t*>(totalBlocks);
+  auto compressedWords = std::vector<uint32_t>(totalBlocks);
+  auto blockCodes = std::vector<uint32_t>(totalBlocks);
+
+  pool.parallelFor(totalBlocks, [&](size_t block) {
+    uint32_t batch =
+        std::upper_bound(blockStart.begin(), blockStart.end(), block) -
+        blockStart.begin() - 1;
+
+    auto start = (block - blockStart[batch]) * blockSize;
+    auto words = std::min(
+        inSize[batch] / sizeof(ANSDecodedT) - start, (size_t)blockSize);
+
+    auto inBlock = (const ANSDecodedT*)in[batch] + start;
+    auto batchTable = tableData + batch * tableStride +
+        (maxSegments > 1 ? blockSegment[block] * kNumSymbols : 0);
+    auto batchSymbolContext = symbolContext.data() + batch * kNumSymbols;
+
+    if (checksumIn) {
+      ansChecksumPiecesCpu(
+          checksumIn[batch],
+          start,
+          start + words,
+          pieceBytes,
+          pieceCrc.data() + pieceStart[batch]);
+    }
+
+    auto sym = inBlock[0];
+    bool isConstant = std::all_of(
+        inBlock, inBlock + words, [sym](ANSDecodedT v) { return v == sym; });
+
+    if (isConstant) {
+      compressedBlocks[block] = nullptr;
+      compressedWords[block] = 0;
+      blockCodes[block] = getBlockCode(ANSBlockMode::Constant, 0, sym);
+      return;
+    }
+
+    auto& arena = arenas.get();
+    auto outBlock = (uint8_t*)arena.alloc(uncoalescedBlockMaxSize);
+    uint32_t outWords = 0;
+
+    switch (config.probBits) {
+      case 9:
+        outWords = encodeBlock<9>(
+            useWideState,
+            inBlock,
+            words,
+            blockSize,
+            batchTable,
+            numContexts[batch],
+            batchSymbolContext,
+            outBlock);
+        break;
+      case 10:
+        outWords = encodeBlock<10>(
+            useWideState,
+            inBlock,
+            words,
+            blockSize,
+            batchTable,
+            numContexts[batch],
+            batchSymbolContext,
+            outBlock);
+        break;
+      case 11:
+        outWords = encodeBlock<11>(
+            useWideState,
+            inBlock,
+            words,
+            blockSize,
+            batchTable,
+            numContexts[batch],
+            batchSymbolContext,
+            outBlock);
+        break;
+      case 12:
+        outWords = encodeBlock<12>(
+            useWideState,
+            inBlock,
+            words,
+            blockSize,
+            batchTable,
+            numContexts[batch],
+            batchSymbolContext,
+            outBlock);
+        break;
+      case 13:
+        outWords = encodeBlock<13>(
+            useWideState,
+            inBlock,
+            words,
+            blockSize,
+            batchTable,
+            numContexts[batch],
+            batchSymbolContext,
+            outBlock);
+        break;
+      case 14:
+        outWords = encodeBlock<14>(
+            useWideState,
+            inBlock,
+            words,
+            blockSize,
+            batchTable,
+            numContexts[batch],
+            batchSymbolContext,
+            outBlock);
+        break;
+      default:
+        CHECK(false) << "unhandled pdf precision " << config.probBits;
+    }
+
+    auto mode = ANSCoalescedHeader::chooseBlockMode(
+        false, words, outWords, useWideState);
+
+    if (mode == ANSBlockMode::Stored) {
+      arena.shrinkLast(outBlock, 0);
+
+      compressedBlocks[block] = nullptr;
+      compressedWords[block] =
+          ANSCoalescedHeader::getStoredBlockWords(words, useWideState);
+    } else {
+      arena.shrinkLast(outBlock, stateSize + outWords * wordSize);
+
+      compressedBlocks[block] = outBlock;
+      compressedWords[block] = outWords;
+    }
+
+    blockCodes[block] = getBlockCode(mode, outWords, sym);
+  });
+
+  // 3. Exclusive prefix sum of the compressed words per block, with each block
+  // aligned to kBlockAlignment
+  uint32_t alignWords = kBlockAlignment / wordSize;
+  auto compressedWordsPrefix = std::vector<uint32_t>(totalBlocks);
+
+  for (uint32_t batch = 0; batch < numInBatch; ++batch) {
+    uint32_t prefix = 0;
+    bool anyNotANS = false;
+
+    for (auto b = blockStart[batch]; b < blockStart[batch + 1]; ++b) {
+      compressedWordsPrefix[b] = prefix;
+      prefix += roundUp(compressedWords[b], alignWords);
+      anyNotANS |= (blockCodes[b] & kANSBlockStoredCode) != 0;
+    }
+
+    auto header = (ANSCoalescedHeader*)out[batch];
+    auto numBlocks = header->getNumBlocks();
+    header->setTotalCompressedWords(prefix);
+    header->setUseBlockModes(anyNotANS);
+    header->setUseBlockChecksum(checksumIn != nullptr);
+
+    // depends upon the options above
+    header->setMagicAndVersion();
+
+    // The block checksums follow the data, after alignment padding
+    if (checksumIn) {
+      uint32_t dataEnd =
+          header->getBlockDataOffset(numBlocks) + prefix * wordSize;
+
+      std::memset(
+          (uint8_t*)out[batch] + dataEnd,
+          0,
+          header->getBlockChecksumsOffset() - dataEnd);
+
+      ansBlockChecksumsFromPiecesCpu(
+          pieceCrc.data() + pieceStart[batch],
+          pieceBytes,
+          inSize[batch],
+          header->getBlockChecksums());
+    }
+
+    if (outSize) {
+      outSize[batch] = header->getTotalCompressedSize();
+    }
+
+    // Zero the block word entry used for alignment padding, if any
+    auto blockWordsOut = header->getBlockWords(numBlocks);
+    auto dataStart =
+        (uint2*)header->getBlockDataStart<uint8_t>(numBlocks);
+    for (auto p = blockWordsOut + numBlocks; p < dataStart; ++p) {
+      *p = uint2{0, 0};
+    }
+  }
+
+  // 4. Coalesce the per-block states and data into the output
+  pool.parallelFor(totalBlocks, [&](size_t globalBlock) {
+    uint32_t batch =
+        std::upper_bound(blockStart.begin(), blockStart.end(), globalBlock) -
+        blockStart.begin() - 1;
+
+    auto header = (ANSCoalescedHeader*)out[batch];
+    auto numBlocks = header->getNumBlocks();
+    uint32_t block = globalBlock - blockStart[batch];
+
+    // Blocks that are not ANS coded have no uncoalesced scratch, and an
+    // unused, zeroed warp state
+    auto uncoalescedBlock = compressedBlocks[globalBlock];
+    auto stateOut = header->getWarpStates<uint8_t>() + block * stateSize;
+
+    if (uncoalescedBlock) {
+      std::memcpy(stateOut, uncoalescedBlock, stateSize);
+    } else {
+      std::memset(stateOut, 0, stateSize);
+    }
+
+    uint32_t lastBlockWords = header->getTotalUncompressedWords() % blockSize;
+    lastBlockWords = lastBlockWords == 0 ? blockSize : lastBlockWords;
+
+    uint32_t blockWords = (block == numBlocks - 1) ? lastBlockWords : blockSize;
+
+    auto numWords = compressedWords[globalBlock];
+    auto prefix = compressedWordsPrefix[globalBlock];
+
+    uint32_t segment = maxSegments > 1 ? blockSegment[globalBlock] : 0;
+
+    header->getBlockWords(numBlocks)[block] = packBlockWords(
+        blockWords,
+        blockCodes[globalBlock],
+        header->makeBlockWordStart(prefix, segment));
+
+    // Copy the compressed words (or stored input), zero-filling the remainder
+    // of the aligned segment
+    auto outWords = header->getBlockDataStart<uint8_t>(numBlocks) +
+        prefix * wordSize;
+    uint32_t dataBytes = numWords * wordSize;
+
+    if (uncoalescedBlock) {
+      std::memcpy(outWords, uncoalescedBlock + stateSize, dataBytes);
+    } else if (numWords > 0) {
+      dataBytes = blockWords * sizeof(ANSDecodedT);
+      std::memcpy(
+          outWords,
+          (const ANSDecodedT*)in[batch] + block * blockSize,
+          dataBytes);
+    }
+
+    std::memset(
+        outWords + dataBytes,
+        0,
+        roundUp(numWords, alignWords) * wordSize - dataBytes);
+  });
+}
+
+// Encodes the batch as ansEncodeBatchCpu, with any delta already taken
+void ansEncodeBatchCpuShuffled(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    const uint32_t* histogram,
+    void** out,
+    uint32_t* outSize,
+    const void** checksumIn) {
+  uint32_t width = config.shuffleWidth;
+
+  CHECK(isValidANSShuffleWidth(width)) << "unhandled shuffle width " << width;
+
+  if (width == 1) {
+    ansEncodeBatchCpuImpl(
+        pool,
+        config,
+        numInBatch,
+        in,
+        inSize,
+        histogram,
+        out,
+        outSize,
+        checksumIn);
+    return;
+  }
+
+  CHECK(!config.dictionary) << "shuffling cannot be used with a dictionary";
+  CHECK_EQ(config.numContexts, 1) << "shuffling cannot be used with contexts";
+
+  // Shuffle each batch member into temporary space
+  auto shuffledStart = std::vector<size_t>(numInBatch + 1);
+  auto chunkStart = std::vector<uint32_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    shuffledStart[i + 1] =
+        shuffledStart[i] + roundUp(inSize[i], kBlockAlignment);
+    chunkStart[i + 1] =
+        chunkStart[i] + divUp(inSize[i] / width, kShuffleChunkSize);
+  }
+
+  auto shuffled = std::vector<uint8_t>(shuffledStart[numInBatch]);
+
+  pool.parallelFor(chunkStart[numInBatch], [&](size_t chunk) {
+    uint32_t batch =
+        std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+        chunkStart.begin() - 1;
+
+    uint32_t begin = (chunk - chunkStart[batch]) * kShuffleChunkSize;
+    uint32_t end = std::min(inSize[batch] / width, begin + kShuffleChunkSize);
+
+    ansShuffleCpu(
+        (const uint8_t*)in[batch],
+        inSize[batch],
+        width,
+        begin,
+        end,
+        shuffled.data() + shuffledStart[batch]);
+  });
+
+  auto shuffledIn = std::vector<const void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    // The trailing partial element keeps its place
+    uint32_t tailStart = inSize[i] / width * width;
+    std::memcpy(
+        shuffled.data() + shuffledStart[i] + tailStart,
+        (const uint8_t*)in[i] + tailStart,
+        inSize[i] - tailStart);
+
+    shuffledIn[i] = shuffled.data() + shuffledStart[i];
+  }
+
+  // Shuffling does not change the histogram, so it still applies
+  ansEncodeBatchCpuImpl(
+      pool,
+      config,
+      numInBatch,
+      shuffledIn.data(),
+      inSize,
+      histogram,
+      out,
+      outSize,
+      checksumIn);
+}
+
+} // namespace
+
+void ansEncodeBatchCpu(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    const uint32_t* histogram,
+    void** out,
+    uint32_t* outSize,
+    const void** ref) {
+  // Block checksums cover the input as given, and follow the archive of it
+  auto checksumIn = config.useBlockChecksum ? in : nullptr;
+
+  // In delta mode, the XOR of each member with its reference is coded
+  if (ref) {
+    auto deltaStart = std::vector<size_t>(numInBatch + 1);
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      deltaStart[i + 1] = deltaStart[i] +
+          (ref[i] ? roundUp(inSize[i], kANSRequiredAlignment) : 0);
+    }
+
+    auto delta = std::vector<uint8_t>(deltaStart[numInBatch]);
+    auto deltaIn = std::vector<const void*>(in, in + numInBatch);
+    auto deltaOut = std::vector<void*>(numInBatch);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      deltaOut[i] = delta.data() + deltaStart[i];
+    }
+
+    ansXorBatchCpu(pool, numInBatch, in, ref, inSize, 1, deltaOut.data());
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      if (ref[i]) {
+        deltaIn[i] = deltaOut[i];
+      }
+    }
+
+    ansEncodeBatchCpuShuffled(
+        pool,
+        config,
+        numInBatch,
+        deltaIn.data(),
+        inSize,
+        histogram,
+        out,
+        outSize,
+        checksumIn);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      auto header = (ANSCoalescedHeader*)out[i];
+      header->setUseDelta(ref[i] != nullptr);
+      header->setMagicAndVersion();
+    }
+
+    return;
+  }
+
+  ansEncodeBatchCpuShuffled(
+      pool,
+      config,
+      numInBatch,
+      in,
+      inSize,
+      histogram,
+      out,
+      outSize,
+      checksumIn);
+}
+
+} // namespace dietgpu
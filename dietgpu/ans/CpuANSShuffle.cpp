@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSUtils.h"
+
+#include <glog/logging.h>
+
+namespace dietgpu {
+
+namespace {
+
+// The width is a template parameter so that the loop over the bytes of an
+// element is unrolled
+template <uint32_t Width>
+void shuffleElements(
+    const uint8_t* __restrict__ in,
+    uint32_t numElements,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* __restrict__ out) {
+  for (uint32_t e = begin; e < end; ++e) {
+    for (uint32_t j = 0; j < Width; ++j) {
+      out[j * numElements + e] = in[e * Width + j];
+    }
+  }
+}
+
+template <uint32_t Width>
+void unshuffleElements(
+    const uint8_t* __restrict__ in,
+    uint32_t numElements,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* __restrict__ out) {
+  for (uint32_t e = begin; e < end; ++e) {
+    for (uint32_t j = 0; j < Width; ++j) {
+      out[e * Width + j] = in[j * numElements + e];
+    }
+  }
+}
+
+} // namespace
+
+void ansShuffleCpu(
+    const uint8_t* in,
+    uint32_t size,
+    uint32_t width,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* out) {
+  uint32_t numElements = size / width;
+
+  switch (width) {
+    case 1:
+      std::memcpy(out + begin, in + begin, end - begin);
+      break;
+    case 2:
+      shuffleElements<2>(in, numElements, begin, end, out);
+      break;
+    case 4:
+      shuffleElements<4>(in, numElements, begin, end, out);
+      break;
+    case 8:
+      shuffleElements<8>(in, numElements, begin, end, out);
+      break;
+    case 16:
+      shuffleElements<16>(in, numElements, begin, end, out);
+      break;
+    default:
+      CHECK(false) << "unhandled shuffle width " << width;
+      break;
+  }
+}
+
+void ansUnshuffleCpu(
+    const uint8_t* in,
+    uint32_t size,
+    uint32_t width,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* out) {
+  uint32_t numElements = size / width;
+
+  switch (width) {
+    case 1:
+      std::memcpy(out + begin, in + begin, end - begin);
+      break;
+    case 2:
+      unshuffleElements<2>(in, numElements, begin, end, out);
+      break;
+    case 4:
+      unshuffleElements<4>(in, numElements, begin, end, out);
+      break;
+    case 8:
+      unshuffleElements<8>(in, numElements, begin, end, out);
+      break;
+    case 16:
+      unshuffleElements<16>(in, numElements, begin, end, out);
+      break;
+    default:
+      CHECK(false) << "unhandled shuffle width " << width;
+      break;
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,400 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace dietgpu {
+
+void ansHistogramCpu(
+    const ANSDecodedT* in,
+    uint32_t size,
+    uint32_t* histogram) {
+  // Interleave several sub-histograms so that runs of the same symbol do not
+  // serialize on a single counter
+  constexpr int kSub = 4;
+  uint32_t counts[kSub][kNumSymbols] = {};
+
+  uint32_t i = 0;
+  for (; i + kSub <= size; i += kSub) {
+    for (int j = 0; j < kSub; ++j) {
+      counts[j][in[i + j]]++;
+    }
+  }
+
+  for (; i < size; ++i) {
+    counts[0][in[i]]++;
+  }
+
+  for (int s = 0; s < kNumSymbols; ++s) {
+    uint32_t sum = 0;
+    for (int j = 0; j < kSub; ++j) {
+      sum += counts[j][s];
+    }
+
+    histogram[s] += sum;
+  }
+}
+
+uint32_t ansChecksumCpu(const uint8_t* in, uint32_t size) {
+  uint64_t checksum64 = 0;
+
+  uint32_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t v;
+    std::memcpy(&v, in + i, sizeof(uint64_t));
+    checksum64 ^= v;
+  }
+
+  uint32_t checksum = 0;
+  for (; i < size; ++i) {
+    checksum ^= in[i];
+  }
+
+  // Fold the bytes
+  for (int j = 0; j < sizeof(uint64_t); ++j) {
+    checksum ^= (checksum64 >> (j * 8)) & 0xffU;
+  }
+
+  return checksum;
+}
+
+void ansCalcWeightsCpu(
+    const uint32_t* counts,
+    uint32_t totalNum,
+    int probBits,
+    uint4* table) {
+  // There's nothing to do if the input array was of zero size, other than
+  // produce an empty pdf, as the GPU does
+  if (totalNum == 0) {
+    std::memset(table, 0, sizeof(uint4) * kNumSymbols);
+    return;
+  }
+
+  uint32_t kProbWeight = 1 << probBits;
+
+  // Rough initial quantization
+  uint32_t qProb[kNumSymbols];
+  int qProbSum = 0;
+
+  for (int i = 0; i < kNumSymbols; ++i) {
+    uint32_t count = counts[i];
+    qProb[i] = kProbWeight * ((float)count / (float)totalNum);
+
+    // All weights for symbols present must be > 0
+    qProb[i] = (count > 0 && qProb[i] == 0) ? 1 : qProb[i];
+
+    qProbSum += qProb[i];
+  }
+
+  // Sort (weight, symbol) pairs by descending weight, in the same order that
+  // the radix sort on the GPU produces
+  uint32_t sortedPair[kNumSymbols];
+  for (int i = 0; i < kNumSymbols; ++i) {
+    sortedPair[i] = (qProb[i] << 16) | i;
+  }
+
+  std::sort(sortedPair, sortedPair + kNumSymbols, std::greater<uint32_t>());
+
+  uint32_t rankSymbol[kNumSymbols];
+  uint32_t rankProb[kNumSymbols];
+
+  for (int i = 0; i < kNumSymbols; ++i) {
+    rankSymbol[i] = sortedPair[i] & 0xffffU;
+    rankProb[i] = sortedPair[i] >> 16;
+  }
+
+  // How far below (positive) or above (negative) our current first-pass
+  // quantization is from our target sum 2^probBits
+  int diff = (int)kProbWeight - qProbSum;
+
+  if (diff > 0) {
+    while (diff > 0) {
+      int iterToApply = diff < kNumSymbols ? diff : kNumSymbols;
+
+      // Note: this selects by symbol value rather than by sorted rank, which
+      // we must reproduce to match the GPU
+      for (int i = 0; i < kNumSymbols; ++i) {
+        if ((int)rankSymbol[i] < iterToApply) {
+          rankProb[i] += 1;
+        }
+      }
+
+      diff -= iterToApply;
+    }
+  } else if (diff < 0) {
+    // Subtract 1 from the smallest values that are > 1
+    diff = -diff;
+
+    while (diff > 0) {
+      int qNumGt1s = 0;
+      for (int i = 0; i < kNumSymbols; ++i) {
+        qNumGt1s += (int)(rankProb[i] > 1);
+      }
+
+      int iterToApply = diff < qNumGt1s ? diff : qNumGt1s;
+      CHECK_GT(iterToApply, 0);
+      int startIndex = qNumGt1s - iterToApply;
+
+      for (int i = startIndex; i < qNumGt1s; ++i) {
+        rankProb[i] -= 1;
+      }
+
+      diff -= iterToApply;
+    }
+  }
+
+  // Recover the pre-sort order
+  uint32_t symPdf[kNumSymbols];
+  for (int i = 0; i < kNumSymbols; ++i) {
+    symPdf[rankSymbol[i]] = rankProb[i];
+  }
+
+  uint32_t symCdf = 0;
+
+  for (int i = 0; i < kNumSymbols; ++i) {
+    table[i] = makeANSEncodeTableEntry(symPdf[i], symCdf);
+    symCdf += symPdf[i];
+  }
+}
+
+bool ansDecodeTableCpu(const uint16_t* probs, int probBits, TableT* table) {
+  uint32_t cdf = 0;
+  for (int sym = 0; sym < kNumSymbols; ++sym) {
+    cdf += probs[sym];
+  }
+
+  // should be a power of 2
+  if (cdf != (1U << probBits)) {
+    return false;
+  }
+
+  ansFillDecodeTable(probs, probBits, table);
+  return true;
+}
+
+uint32_t ansChooseContextsCpu(
+    const uint32_t* counts,
+    uint32_t maxContexts,
+    uint8_t* contextSymbol,
+    uint8_t* symbolContext) {
+  CHECK(maxContexts >= 1 && maxContexts <= kANSMaxContexts)
+      << "unhandled number of contexts " << maxContexts;
+
+  int order[kNumSymbols];
+  for (int s = 0; s < kNumSymbols; ++s) {
+    order[s] = s;
+  }
+
+  std::stable_sort(order, order + kNumSymbols, [counts](int a, int b) {
+    return counts[a] > counts[b];
+  });
+
+  std::memset(contextSymbol, 0, kANSMaxContexts);
+  std::memset(symbolContext, 0, kNumSymbols);
+
+  uint32_t numContexts = 1;
+  for (; numContexts < maxContexts; ++numContexts) {
+    int sym = order[numContexts - 1];
+    if (counts[sym] == 0) {
+      break;
+    }
+
+    contextSymbol[numContexts] = sym;
+    symbolContext[sym] = numContexts;
+  }
+
+  // Empty data has nothing to model
+  return counts[order[0]] > 0 ? numContexts : 1;
+}
+
+namespace {
+
+// Estimated size in bits of data with the given symbol counts when coded with
+// its own pdf: its entropy, plus the size of the compact pdf
+double segmentCost(const uint32_t* counts, int probBits) {
+  uint64_t total = 0;
+  uint32_t numSymbols = 0;
+
+  for (int s = 0; s < kNumSymbols; ++s) {
+    total += counts[s];
+    numSymbols += counts[s] > 0;
+  }
+
+  double bits = 0;
+  for (int s = 0; s < kNumSymbols; ++s) {
+    if (counts[s] > 0) {
+      bits += counts[s] * std::log2(double(total) / counts[s]);
+    }
+  }
+
+  return bits +
+      8.0 * ANSCoalescedHeader::getCompactSymbolProbsSize(numSymbols, probBits);
+}
+
+} // namespace
+
+uint32_t ansChooseSegmentsCpu(
+    const uint32_t* histograms,
+    uint32_t numUnits,
+    int probBits,
+    uint32_t maxSegments,
+    uint32_t* unitSegment) {
+  CHECK(maxSegments >= 1 && maxSegments <= kANSMaxSegments)
+      << "unhandled number of segments " << maxSegments;
+
+  if (numUnits == 0) {
+    return 1;
+  }
+
+  // The counts, cost and first unit of each segment, and the change in cost
+  // from merging each segment with the next
+  struct Segment {
+    uint32_t counts[kNumSymbols];
+    double cost;
+    uint32_t firstUnit;
+    double mergeDelta;
+  };
+
+  auto segments = std::vector<Segment>(numUnits);
+
+  for (uint32_t i = 0; i < numUnits; ++i) {
+    std::memcpy(
+        segments[i].counts,
+        histograms + i * kNumSymbols,
+        sizeof(segments[i].counts));
+    segments[i].cost = segmentCost(segments[i].counts, probBits);
+    segments[i].firstUnit = i;
+  }
+
+  auto updateDelta = [&](uint32_t i) {
+    if (i + 1 >= segments.size()) {
+      return;
+    }
+
+    uint32_t merged[kNumSymbols];
+    for (int s = 0; s < kNumSymbols; ++s) {
+      merged[s] = segments[i].counts[s] + segments[i + 1].counts[s];
+    }
+
+    segments[i].mergeDelta = segmentCost(merged, probBits) - segments[i].cost -
+        segments[i + 1].cost;
+  };
+
+  for (uint32_t i = 0; i < numUnits; ++i) {
+    updateDelta(i);
+  }
+
+  while (segments.size() > 1) {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i + 1 < segments.size(); ++i) {
+      if (segments[i].mergeDelta < segments[best].mergeDelta) {
+        best = i;
+      }
+    }
+
+    if (segments.size() <= maxSegments && segments[best].mergeDelta >= 0) {
+      break;
+    }
+
+    auto& seg = segments[best];
+    for (int s = 0; s < kNumSymbols; ++s) {
+      seg.counts[s] += segments[best + 1].counts[s];
+    }
+
+    seg.cost += segments[best + 1].cost + seg.mergeDelta;
+    segments.erase(segments.begin() + best + 1);
+
+    updateDelta(best);
+    if (best > 0) {
+      updateDelta(best - 1);
+    }
+  }
+
+  for (uint32_t seg = 0; seg < segments.size(); ++seg) {
+    uint32_t end =
+        seg + 1 < segments.size() ? segments[seg + 1].firstUnit : numUnits;
+
+    for (uint32_t i = segments[seg].firstUnit; i < end; ++i) {
+      unitSegment[i] = seg;
+    }
+  }
+
+  return segments.size();
+}
+
+void ansContextHistogramCpu(
+    const ANSDecodedT* in,
+    uint32_t size,
+    uint32_t blockSize,
+    const uint8_t* symbolContext,
+    uint32_t* histogram) {
+  for (uint32_t start = 0; start < size; start += blockSize) {
+    uint32_t blockWords = std::min(size - start, blockSize);
+    uint32_t stripe = getContextStripeSize(blockWords);
+    auto block = in + start;
+
+    for (uint32_t i = 0; i < blockWords; ++i) {
+      // The last symbol of each stripe is coded with neighbor 0
+      uint32_t next = i + 1;
+      ANSDecodedT nextSym =
+          (next % stripe != 0 && next < blockWords) ? block[next] : 0;
+
+      histogram[symbolContext[nextSym] * kNumSymbols + block[i]]++;
+    }
+  }
+}
+
+void ansTrainDictionaryCpu(
+    ThreadPool& pool,
+    int probBits,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    uint16_t* probsOut) {
+  CHECK(isValidANSProbBits(probBits)) << "unhandled pdf precision " << probBits;
+
+  auto batchHistogram = std::vector<uint32_t>(numInBatch * kNumSymbols);
+
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    ansHistogramCpu(
+        (const ANSDecodedT*)in[batch],
+        inSize[batch],
+        batchHistogram.data() + batch * kNumSymbols);
+  });
+
+  // Every symbol is counted once more than seen, so that all symbols receive a
+  // non-zero probability
+  uint32_t counts[kNumSymbols];
+  uint32_t totalNum = kNumSymbols;
+
+  for (int s = 0; s < kNumSymbols; ++s) {
+    counts[s] = 1;
+
+    for (uint32_t batch = 0; batch < numInBatch; ++batch) {
+      counts[s] += batchHistogram[batch * kNumSymbols + s];
+    }
+
+    totalNum += counts[s] - 1;
+  }
+
+  uint4 table[kNumSymbols];
+  ansCalcWeightsCpu(counts, totalNum, probBits, table);
+
+  for (int s = 0; s < kNumSymbols; ++s) {
+    probsOut[s] = table[s].x;
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,2002 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/utils/Crc32c.h"
+
+using namespace dietgpu;
+
+std::vector<uint8_t> generateSymbols(int num, float lambda = 20.0f) {
+  std::random_device rd;
+  std::mt19937 gen(10);
+  std::exponential_distribution<float> dist(lambda);
+
+  auto out = std::vector<uint8_t>(num);
+  for (auto& v : out) {
+    auto sample = std::min(dist(gen), 1.0f);
+
+    v = sample * 256.0;
+  }
+
+  return out;
+}
+
+std::vector<std::vector<uint8_t>> genBatch(
+    const std::vector<uint32_t>& sizes,
+    double lambda) {
+  auto out = std::vector<std::vector<uint8_t>>();
+
+  for (auto s : sizes) {
+    out.push_back(generateSymbols(s, lambda));
+  }
+
+  return out;
+}
+
+// Compresses the batch on the host, returning the compressed archives
+std::vector<std::vector<uint8_t>> encodeBatch(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    const std::vector<std::vector<uint8_t>>& batch) {
+  int numInBatch = batch.size();
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto inSize = std::vector<uint32_t>(numInBatch);
+  auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto encPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    inPtrs[i] = batch[i].data();
+    inSize[i] = batch[i].size();
+    enc[i].resize(getMaxCompressedSize(
+        inSize[i],
+        config.blockSize,
+        config.useWideState,
+        config.getMaxTables(),
+        config.useBlockChecksum));
+    encPtrs[i] = enc[i].data();
+  }
+
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  ansEncodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      inSize.data(),
+      nullptr,
+      encPtrs.data(),
+      encSize.data());
+
+  for (int i = 0; i < numInBatch; ++i) {
+    // Reported compressed sizes in bytes should be a multiple of 16 for aligned
+    // packing
+    EXPECT_EQ(encSize[i] % 16, 0);
+    EXPECT_LE(encSize[i], enc[i].size());
+    enc[i].resize(encSize[i]);
+  }
+
+  return enc;
+}
+
+// Decompresses archives on the host, which must succeed
+std::vector<std::vector<uint8_t>> decodeBatch(
+    ThreadPool& pool,
+    const ANSCodecConfig& config,
+    const std::vector<std::vector<uint8_t>>& enc,
+    const std::vector<uint32_t>& sizes) {
+  int numInBatch = enc.size();
+
+  auto encPtrs = std::vector<const void*>(numInBatch);
+  auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs[i] = enc[i].data();
+    dec[i].resize(sizes[i]);
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto status = ansDecodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      encPtrs.data(),
+      decPtrs.data(),
+      sizes.data(),
+      nullptr,
+      nullptr);
+  EXPECT_EQ(status.error, ANSDecodeError::None);
+
+  return dec;
+}
+
+void runBatchPointer(
+    ThreadPool& pool,
+    int prec,
+    const std::vector<uint32_t>& batchSizes,
+    double lambda = 100.0,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false,
+    const ANSDictionary* dict = nullptr) {
+  int numInBatch = batchSizes.size();
+  auto config = ANSCodecConfig(prec, true, blockSize, useWideState, dict);
+
+  auto batch = genBatch(batchSizes, lambda);
+  auto enc = encodeBatch(pool, config, batch);
+
+  auto encPtrs = std::vector<const void*>(numInBatch);
+  auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs[i] = enc[i].data();
+    dec[i].resize(batchSizes[i]);
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto outSuccess = std::vector<uint8_t>(numInBatch);
+  auto outSize = std::vector<uint32_t>(numInBatch);
+
+  auto status = ansDecodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      encPtrs.data(),
+      decPtrs.data(),
+      batchSizes.data(),
+      outSuccess.data(),
+      outSize.data());
+
+  EXPECT_EQ(status.error, ANSDecodeError::None);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    EXPECT_TRUE(outSuccess[i]);
+    EXPECT_EQ(outSize[i], batchSizes[i]);
+  }
+
+  EXPECT_EQ(batch, dec);
+}
+
+TEST(CpuANSTest, ZeroSized) {
+  ThreadPool pool(4);
+  runBatchPointer(pool, 10, {0}, 10.0);
+}
+
+TEST(CpuANSTest, BatchPointer) {
+  ThreadPool pool(4);
+
+  for (auto prec : {9, 10, 11}) {
+    for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+      runBatchPointer(pool, prec, {1}, lambda);
+      runBatchPointer(pool, prec, {1, 1}, lambda);
+      runBatchPointer(pool, prec, {4096, 4095, 4096}, lambda);
+      runBatchPointer(pool, prec, {1234, 2345, 3456}, lambda);
+      runBatchPointer(pool, prec, {10000, 10013, 10000}, lambda);
+    }
+  }
+}
+
+TEST(CpuANSTest, BatchPointerLarge) {
+  ThreadPool pool(4);
+
+  std::mt19937 gen(10);
+  std::uniform_int_distribution<uint32_t> dist(100, 100000);
+
+  std::vector<uint32_t> sizes;
+  for (int i = 0; i < 100; ++i) {
+    sizes.push_back(dist(gen));
+  }
+
+  runBatchPointer(pool, 10, sizes);
+}
+
+// The archive layout must be exactly what the GPU decoder expects
+TEST(CpuANSTest, ArchiveLayout) {
+  ThreadPool pool(4);
+
+  for (auto prec : {9, 10, 11}) {
+    auto batch = genBatch({0, 1, 4095, 4096, 4097, 10013}, 10.0);
+    auto enc = encodeBatch(pool, ANSCodecConfig(prec, false), batch);
+
+    for (int i = 0; i < batch.size(); ++i) {
+      auto header = (const ANSCoalescedHeader*)enc[i].data();
+      uint32_t words = batch[i].size();
+      auto numBlocks = header->getNumBlocks();
+
+      // The pdf is stored in the compact format, introduced in version 4;
+      // single symbol blocks are constant blocks, which need version 5
+      bool constant = false;
+      for (uint32_t start = 0; start < words; start += kDefaultBlockSize) {
+        auto first = batch[i].data() + start;
+        auto last = first + std::min(kDefaultBlockSize, words - start);
+        constant |=
+            std::all_of(first, last, [&](uint8_t v) { return v == *first; });
+      }
+
+      EXPECT_EQ(
+          header->magicAndVersion, (kANSMagic << 16) | (constant ? 5 : 4));
+      EXPECT_EQ(header->getUseBlockModes(), constant);
+      EXPECT_TRUE(header->getUseCompactProbs());
+      EXPECT_FALSE(header->getUseWideState());
+      EXPECT_EQ(numBlocks, divUp(words, kDefaultBlockSize));
+      EXPECT_EQ(header->getTotalUncompressedWords(), words);
+      EXPECT_EQ(header->getProbBits(), prec);
+      EXPECT_FALSE(header->getUseChecksum());
+      EXPECT_EQ(header->getBlockSize(), kDefaultBlockSize);
+      EXPECT_EQ(header->getTotalCompressedSize(), enc[i].size());
+
+      // pdf sums to 2^prec, and all present symbols are representable
+      if (words > 0) {
+        uint32_t counts[kNumSymbols] = {};
+        ansHistogramCpu(batch[i].data(), words, counts);
+
+        uint32_t sum = 0;
+        for (int s = 0; s < kNumSymbols; ++s) {
+          auto pdf = header->getSymbolProb(s);
+          if (counts[s] > 0) {
+            EXPECT_GT(pdf, 0);
+          }
+          sum += pdf;
+        }
+
+        EXPECT_EQ(sum, 1 << prec);
+      }
+
+      // Blocks are packed in order, each aligned to 16 bytes
+      uint32_t prefix = 0;
+      uint32_t totalUncompressed = 0;
+      for (uint32_t b = 0; b < numBlocks; ++b) {
+        auto bw = header->getBlockWords(numBlocks)[b];
+
+        EXPECT_EQ(getBlockCompressedWordStart(bw), prefix);
+        prefix += roundUp(
+            header->getBlockDataWords(bw), kBlockAlignment / sizeof(uint16_t));
+        totalUncompressed += getBlockUncompressedWords(bw);
+
+        if (b < numBlocks - 1) {
+          EXPECT_EQ(getBlockUncompressedWords(bw), kDefaultBlockSize);
+        }
+      }
+
+      EXPECT_EQ(prefix, header->getTotalCompressedWords());
+      EXPECT_EQ(totalUncompressed, words);
+    }
+  }
+}
+
+// The output must not depend upon how the work was split across threads
+TEST(CpuANSTest, Deterministic) {
+  ThreadPool pool1(1);
+  ThreadPool pool4(4);
+
+  auto batch = genBatch({1, 70000, 4096, 123457, 0, 333}, 20.0);
+
+  for (auto useChecksum : {false, true}) {
+    auto config = ANSCodecConfig(10, useChecksum);
+    EXPECT_EQ(
+        encodeBatch(pool1, config, batch), encodeBatch(pool4, config, batch));
+  }
+}
+
+TEST(CpuANSTest, Checksum) {
+  ThreadPool pool(4);
+  auto config = ANSCodecConfig(10, true);
+
+  auto batch = genBatch({100000, 5000}, 10.0);
+  auto enc = encodeBatch(pool, config, batch);
+
+  for (int i = 0; i < batch.size(); ++i) {
+    uint32_t checksum = 0;
+    for (auto v : batch[i]) {
+      checksum ^= v;
+    }
+
+    EXPECT_EQ(
+        ((const ANSCoalescedHeader*)enc[i].data())->getChecksum(), checksum);
+  }
+
+  // Corrupt the stored checksum of the second member, which decoding should
+  // catch
+  auto header = (ANSCoalescedHeader*)enc[1].data();
+  header->setChecksum(header->getChecksum() ^ 0x1);
+
+  auto encPtrs = std::vector<const void*>{enc[0].data(), enc[1].data()};
+  auto dec = std::vector<std::vector<uint8_t>>{
+      std::vector<uint8_t>(100000), std::vector<uint8_t>(5000)};
+  auto decPtrs = std::vector<void*>{dec[0].data(), dec[1].data()};
+  auto capacity = std::vector<uint32_t>{100000, 5000};
+
+  auto status = ansDecodeBatchCpu(
+      pool,
+      config,
+      2,
+      encPtrs.data(),
+      decPtrs.data(),
+      capacity.data(),
+      nullptr,
+      nullptr);
+
+  EXPECT_EQ(status.error, ANSDecodeError::ChecksumMismatch);
+  EXPECT_EQ(status.errorInfo.size(), 1);
+  EXPECT_EQ(status.errorInfo[0].first, 1);
+  EXPECT_EQ(dec, batch);
+}
+
+TEST(CpuANSTest, InsufficientCapacity) {
+  ThreadPool pool(4);
+  auto config = ANSCodecConfig(10, false);
+
+  auto batch = genBatch({10000}, 10.0);
+  auto enc = encodeBatch(pool, config, batch);
+
+  auto encPtrs = std::vector<const void*>{enc[0].data()};
+  auto dec = std::vector<uint8_t>(9999);
+  auto decPtrs = std::vector<void*>{dec.data()};
+  uint32_t capacity = dec.size();
+
+  uint8_t outSuccess = true;
+  uint32_t outSize = 0;
+
+  ansDecodeBatchCpu(
+      pool,
+      config,
+      1,
+      encPtrs.data(),
+      decPtrs.data(),
+      &capacity,
+      &outSuccess,
+      &outSize);
+
+  EXPECT_FALSE(outSuccess);
+  EXPECT_EQ(outSize, 10000);
+}
+
+// Archives with an invalid header or pdf fail to decode, while the rest of
+// the batch decodes
+TEST(CpuANSTest, CorruptArchive) {
+  ThreadPool pool(4);
+  auto config = ANSCodecConfig(10, true);
+
+  auto batch = genBatch({10000, 10000, 10000}, 10.0);
+  auto enc = encodeBatch(pool, config, batch);
+
+  // Bad magic number, and a pdf that no longer sums to 2^probBits
+  auto header = (ANSCoalescedHeader*)enc[0].data();
+  header->magicAndVersion ^= 0xffff0000U;
+  enc[2][sizeof(ANSCoalescedHeader)] ^= 0x11;
+
+  auto encPtrs = std::vector<const void*>();
+  auto dec = std::vector<std::vector<uint8_t>>(3, std::vector<uint8_t>(10000));
+  auto decPtrs = std::vector<void*>();
+  auto capacity = std::vector<uint32_t>(3, 10000);
+  for (int i = 0; i < 3; ++i) {
+    encPtrs.push_back(enc[i].data());
+    decPtrs.push_back(dec[i].data());
+  }
+
+  uint8_t outSuccess[3];
+
+  auto status = ansDecodeBatchCpu(
+      pool,
+      config,
+      3,
+      encPtrs.data(),
+      decPtrs.data(),
+      capacity.data(),
+      outSuccess,
+      nullptr);
+
+  // The failed members are not reported again as checksum mismatches
+  EXPECT_EQ(status.error, ANSDecodeError::None);
+  EXPECT_FALSE(outSuccess[0]);
+  EXPECT_TRUE(outSuccess[1]);
+  EXPECT_FALSE(outSuccess[2]);
+  EXPECT_EQ(dec[1], batch[1]);
+}
+
+// All vectorized block decoders must produce the same output as the scalar
+// decoder
+TEST(CpuANSTest, SimdDecode) {
+  ThreadPool pool(1);
+
+  for (auto prec : {9, 10, 11, 12, 13, 14}) {
+    for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+      auto batch = genBatch({1, 31, 32, 33, 4095, 4096, 10013}, lambda);
+      auto enc = encodeBatch(pool, ANSCodecConfig(prec, false), batch);
+
+      for (int i = 0; i < batch.size(); ++i) {
+        auto header = (const ANSCoalescedHeader*)enc[i].data();
+        auto numBlocks = header->getNumBlocks();
+
+        uint16_t probs[kNumSymbols];
+        header->readSymbolProbs(probs);
+
+        auto table = std::vector<TableT>(getANSDecodeTableWords(prec));
+        ansDecodeTableCpu(probs, prec, table.data());
+
+        for (auto level :
+             {CpuSimdLevel::Scalar, CpuSimdLevel::AVX2, CpuSimdLevel::AVX512}) {
+          if (!isCpuSimdLevelSupported(level)) {
+            continue;
+          }
+
+          auto decodeBlock = getANSDecodeBlockCpu(prec, level);
+          auto dec = std::vector<uint8_t>(batch[i].size());
+
+          for (uint32_t b = 0; b < numBlocks; ++b) {
+            auto bw = header->getBlockWords(numBlocks)[b];
+
+            // Only ANS coded blocks go through the block decoder
+            if (header->getBlockMode(bw) == ANSBlockMode::Constant) {
+              std::memset(
+                  dec.data() + b * kDefaultBlockSize,
+                  getBlockConstantSymbol(bw),
+                  getBlockUncompressedWords(bw));
+              continue;
+            }
+
+            ASSERT_EQ(header->getBlockMode(bw), ANSBlockMode::ANS);
+
+            decodeBlock(
+                header->getWarpStates() + b,
+                getBlockUncompressedWords(bw),
+                getBlockCompressedWords(bw),
+                header->getBlockDataStart(numBlocks) +
+                    getBlockCompressedWordStart(bw),
+                table.data(),
+                dec.data() + b * kDefaultBlockSize);
+          }
+
+          EXPECT_EQ(batch[i], dec) << getCpuSimdLevelName(level);
+        }
+      }
+    }
+  }
+}
+
+TEST(CpuANSTest, BlockSize) {
+  ThreadPool pool(4);
+
+  for (uint32_t blockSize = kANSMinBlockSize; blockSize <= kANSMaxBlockSize;
+       blockSize *= 2) {
+    for (auto prec : {9, 10, 11}) {
+      runBatchPointer(
+          pool,
+          prec,
+          {1,
+           blockSize - 1,
+           blockSize,
+           blockSize + 1,
+           3 * blockSize,
+           5 * blockSize + 1234},
+          100.0,
+          blockSize);
+    }
+
+    // The block size is recorded in the archive, and the block index must
+    // describe blocks of that size
+    auto batch = genBatch({4 * blockSize + 17}, 10.0);
+    auto enc = encodeBatch(pool, ANSCodecConfig(10, false, blockSize), batch);
+
+    auto header = (const ANSCoalescedHeader*)enc[0].data();
+    auto numBlocks = header->getNumBlocks();
+    EXPECT_EQ(header->getBlockSize(), blockSize);
+    EXPECT_EQ(numBlocks, 5);
+
+    for (uint32_t b = 0; b < numBlocks; ++b) {
+      auto bw = header->getBlockWords(numBlocks)[b];
+      EXPECT_EQ(
+          getBlockUncompressedWords(bw), b < numBlocks - 1 ? blockSize : 17);
+    }
+
+    // The bound on the compressed size must hold for incompressible data
+    auto random = std::vector<uint8_t>(3 * blockSize + 5);
+    std::mt19937 gen(blockSize);
+    for (auto& v : random) {
+      v = gen();
+    }
+
+    enc = encodeBatch(pool, ANSCodecConfig(11, false, blockSize), {random});
+    EXPECT_LE(enc[0].size(), getMaxCompressedSize(random.size(), blockSize));
+  }
+}
+
+// Larger blocks amortize the per-block overhead
+TEST(CpuANSTest, BlockSizeOverhead) {
+  ThreadPool pool(4);
+
+  auto batch = genBatch({1024 * 1024}, 10.0);
+  auto enc4K = encodeBatch(pool, ANSCodecConfig(10, false, 4096), batch);
+  auto enc64K = encodeBatch(pool, ANSCodecConfig(10, false, 65536), batch);
+
+  EXPECT_LT(enc64K[0].size(), enc4K[0].size());
+  EXPECT_LT(
+      getMaxCompressedSize(batch[0].size(), 65536),
+      getMaxCompressedSize(batch[0].size(), 4096));
+}
+
+TEST(CpuANSTest, WideState) {
+  ThreadPool pool(4);
+
+  for (auto blockSize : {kANSMinBlockSize, kANSDefaultBlockSize}) {
+    for (auto prec : {9, 10, 11}) {
+      for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+        runBatchPointer(
+            pool,
+            prec,
+            {1, 33, blockSize - 1, blockSize, 3 * blockSize + 1234},
+            lambda,
+            blockSize,
+            true);
+      }
+    }
+  }
+
+  runBatchPointer(pool, 10, {0}, 10.0, kANSMaxBlockSize, true);
+  runBatchPointer(pool, 10, {300000}, 10.0, kANSMaxBlockSize, true);
+}
+
+TEST(CpuANSTest, WideStateArchive) {
+  ThreadPool pool(4);
+
+  // Highly skewed data renormalizes rarely, so the wide state stores fewer,
+  // larger words
+  auto batch = genBatch({0, 1, 4096, 100000}, 1.0);
+  auto config = ANSCodecConfig(11, false, kANSDefaultBlockSize, true);
+  auto enc = encodeBatch(pool, config, batch);
+  auto encNarrow = encodeBatch(pool, ANSCodecConfig(11, false), batch);
+
+  for (int i = 0; i < batch.size(); ++i) {
+    auto header = (const ANSCoalescedHeader*)enc[i].data();
+    auto narrowHeader = (const ANSCoalescedHeader*)encNarrow[i].data();
+    auto numBlocks = header->getNumBlocks();
+
+    EXPECT_EQ(header->magicAndVersion, narrowHeader->magicAndVersion);
+    EXPECT_TRUE(header->isValidMagicAndVersion());
+    EXPECT_TRUE(header->getUseWideState());
+    EXPECT_EQ(header->getTotalCompressedSize(), enc[i].size());
+    EXPECT_EQ(
+        header->getCompressedOverhead(),
+        narrowHeader->getCompressedOverhead() +
+            (sizeof(ANSWideWarpState) - sizeof(ANSWarpState)) * numBlocks);
+    EXPECT_LE(
+        header->getCompressedOverhead(),
+        ANSCoalescedHeader::getCompressedOverhead(numBlocks, true));
+
+    // The statistics do not depend upon the state width
+    EXPECT_EQ(
+        0,
+        std::memcmp(
+            header + 1, narrowHeader + 1, header->getSymbolProbsSize()));
+
+    if (batch[i].size() >= 4096) {
+      EXPECT_LT(
+          header->getTotalCompressedWords(),
+          narrowHeader->getTotalCompressedWords());
+    }
+  }
+
+  // Output is deterministic, and within bounds for incompressible data
+  ThreadPool pool1(1);
+  EXPECT_EQ(enc, encodeBatch(pool1, config, batch));
+
+  auto random = std::vector<uint8_t>(3 * kANSDefaultBlockSize + 5);
+  std::mt19937 gen(1);
+  for (auto& v : random) {
+    v = gen();
+  }
+
+  enc = encodeBatch(pool, config, {random});
+  EXPECT_LE(
+      enc[0].size(),
+      getMaxCompressedSize(random.size(), kANSDefaultBlockSize, true));
+}
+
+TEST(CpuANSTest, HighPrecision) {
+  ThreadPool pool(4);
+
+  for (auto prec : {12, 13, 14}) {
+    for (auto lambda : {1.0, 10.0, 100.0, 1000.0}) {
+      runBatchPointer(pool, prec, {1}, lambda);
+      runBatchPointer(pool, prec, {4096, 4095, 4096}, lambda);
+      runBatchPointer(pool, prec, {10000, 10013, 10000}, lambda);
+      runBatchPointer(pool, prec, {1234}, lambda, kANSMinBlockSize);
+      runBatchPointer(pool, prec, {300000}, lambda, kANSMaxBlockSize, true);
+    }
+
+    // A single symbol has pdf == 2^prec
+    auto single = std::vector<uint8_t>(5000, 7);
+    auto enc = encodeBatch(pool, ANSCodecConfig(prec, false), {single});
+    auto header = (const ANSCoalescedHeader*)enc[0].data();
+    EXPECT_EQ(header->getProbBits(), prec);
+    EXPECT_EQ(header->getSymbolProb(7), 1 << prec);
+
+    runBatchPointer(pool, prec, {0}, 10.0);
+  }
+
+  // The split decoding table for the higher precisions is smaller than the
+  // packed table
+  EXPECT_EQ(getANSDecodeTableWords(11), 2048);
+  EXPECT_EQ(getANSDecodeTableWords(12), 1024 + kNumSymbols);
+  EXPECT_EQ(getANSDecodeTableWords(14), 4096 + kNumSymbols);
+}
+
+// Highly skewed data has rare symbols whose probability is overstated at low
+// precision, at the expense of the common symbols
+TEST(CpuANSTest, HighPrecisionRatio) {
+  ThreadPool pool(4);
+
+  auto batch = genBatch({1024 * 1024}, 100.0);
+
+  uint32_t prevSize = 0;
+  for (auto prec : {11, 12, 13, 14}) {
+    auto enc = encodeBatch(pool, ANSCodecConfig(prec, false), batch);
+
+    if (prevSize > 0) {
+      EXPECT_LT(enc[0].size(), prevSize) << prec;
+    }
+
+    prevSize = enc[0].size();
+  }
+}
+
+std::unique_ptr<ANSDictionary>
+trainDictionary(ThreadPool& pool, int prec, double lambda) {
+  auto samples = genBatch({100000, 1000}, lambda);
+  const void* in[] = {samples[0].data(), samples[1].data()};
+  uint32_t inSize[] = {100000, 1000};
+
+  uint16_t probs[kNumSymbols];
+  ansTrainDictionaryCpu(pool, prec, 2, in, inSize, probs);
+
+  return std::make_unique<ANSDictionary>(prec, probs);
+}
+
+TEST(CpuANSTest, Dictionary) {
+  ThreadPool pool(4);
+
+  for (auto prec : {9, 10, 11, 12, 14}) {
+    for (auto lambda : {1.0, 100.0}) {
+      auto dict = trainDictionary(pool, prec, lambda);
+
+      // All symbols can be encoded, even those not seen in training
+      for (int i = 0; i < kNumSymbols; ++i) {
+        EXPECT_GT(dict->getSymbolProbs()[i], 0);
+      }
+
+      for (auto wide : {false, true}) {
+        auto bs = kANSDefaultBlockSize;
+
+        runBatchPointer(pool, prec, {0}, lambda, bs, wide, dict.get());
+        runBatchPointer(
+            pool, prec, {1, 100, 4096, 10000}, lambda, bs, wide, dict.get());
+
+        // Data of a different distribution than the dictionary was trained on
+        runBatchPointer(
+            pool, prec, {1234, 100000}, lambda * 10, bs, wide, dict.get());
+      }
+    }
+  }
+}
+
+TEST(CpuANSTest, DictionaryArchive) {
+  ThreadPool pool(4);
+
+  // At higher precision, the probability reserved for symbols unseen in
+  // training is small
+  auto dict = trainDictionary(pool, 12, 100.0);
+  auto batch = genBatch({0, 1, 100, 1000, 10000}, 100.0);
+
+  for (auto wide : {false, true}) {
+    auto config =
+        ANSCodecConfig(12, false, kANSDefaultBlockSize, wide, dict.get());
+    auto enc = encodeBatch(pool, config, batch);
+    auto encOwn = encodeBatch(
+        pool, ANSCodecConfig(12, false, kANSDefaultBlockSize, wide), batch);
+
+    for (int i = 0; i < batch.size(); ++i) {
+      auto header = (const ANSCoalescedHeader*)enc[i].data();
+      auto numBlocks = header->getNumBlocks();
+
+      // Dictionaries were introduced in version 3 (the single symbol input is
+      // a constant block, introduced in version 5)
+      EXPECT_EQ(
+          header->magicAndVersion,
+          (kANSMagic << 16) | (batch[i].size() == 1 ? 5 : 3));
+      EXPECT_TRUE(header->isValidMagicAndVersion());
+      EXPECT_TRUE(header->getUseDictionary());
+      EXPECT_EQ(header->getDictionaryId(), dict->getId());
+      EXPECT_EQ(header->getUseWideState(), wide);
+      EXPECT_EQ(header->getTotalCompressedSize(), enc[i].size());
+
+      // The archive omits the pdf
+      EXPECT_EQ(
+          header->getCompressedOverhead() + sizeof(uint16_t) * kNumSymbols,
+          ANSCoalescedHeader::getCompressedOverhead(numBlocks, wide));
+
+      // which for small inputs outweighs the cost of the less specific pdf
+      if (batch[i].size() <= 1000) {
+        EXPECT_LT(enc[i].size(), encOwn[i].size());
+      }
+
+      // An older decoder cannot read the archive
+      auto old = *header;
+      old.magicAndVersion = (kANSMagic << 16) | 2;
+      EXPECT_FALSE(old.isValidMagicAndVersion());
+    }
+
+    // Output is deterministic
+    ThreadPool pool1(1);
+    EXPECT_EQ(enc, encodeBatch(pool1, config, batch));
+  }
+
+  // Dictionaries differing in precision or pdf have different IDs
+  auto dict11 = trainDictionary(pool, 11, 100.0);
+  auto dict1 = trainDictionary(pool, 12, 1.0);
+  EXPECT_NE(dict->getId(), dict11->getId());
+  EXPECT_NE(dict->getId(), dict1->getId());
+  EXPECT_EQ(dict->getId(), trainDictionary(pool, 12, 100.0)->getId());
+}
+
+// The pdf of archives holds only the symbols present
+TEST(CpuANSTest, CompactProbs) {
+  ThreadPool pool(4);
+
+  // A single symbol of pdf 2^10 - 1 + 1 needs 10 bits
+  auto single = std::vector<uint8_t>(5000, 7);
+  auto enc = encodeBatch(pool, ANSCodecConfig(10, false), {single});
+  auto header = (const ANSCoalescedHeader*)enc[0].data();
+
+  EXPECT_TRUE(header->getUseCompactProbs());
+  EXPECT_EQ(header->getCompactProbsNumSymbols(), 1);
+  EXPECT_EQ(header->getCompactProbsBits(), 10);
+
+  // 32 byte bitmap + 10 bits, padded to 16 bytes
+  EXPECT_EQ(header->getSymbolProbsSize(), 48);
+  EXPECT_EQ(
+      header->getCompressedOverhead(),
+      ANSCoalescedHeader::getCompressedOverhead(header->getNumBlocks()) -
+          512 + 48);
+  EXPECT_EQ(header->getTotalCompressedSize(), enc[0].size());
+
+  // 30 symbols of equal probability each have a pdf of 34 or 35 (of 1024),
+  // needing 6 bits each
+  auto uniform = std::vector<uint8_t>(30 * 1000);
+  for (int i = 0; i < uniform.size(); ++i) {
+    uniform[i] = i % 30;
+  }
+
+  enc = encodeBatch(pool, ANSCodecConfig(10, false), {uniform});
+  header = (const ANSCoalescedHeader*)enc[0].data();
+
+  EXPECT_EQ(header->getCompactProbsNumSymbols(), 30);
+  EXPECT_EQ(header->getCompactProbsBits(), 6);
+  EXPECT_EQ(header->getSymbolProbsSize(), roundUp(32 + divUp(30 * 6, 8), 16));
+  EXPECT_EQ(
+      ANSCoalescedHeader::getCompressedOverhead(header->getNumBlocks()) -
+          header->getCompressedOverhead(),
+      512 - 64);
+
+  // An empty input has an empty pdf
+  enc = encodeBatch(pool, ANSCodecConfig(10, false), {{}});
+  header = (const ANSCoalescedHeader*)enc[0].data();
+
+  EXPECT_EQ(header->getCompactProbsNumSymbols(), 0);
+  EXPECT_EQ(header->getSymbolProbsSize(), 32);
+  EXPECT_EQ(enc[0].size(), sizeof(ANSCoalescedHeader) + 32);
+}
+
+// The compact pdf format round-trips all pdfs at all precisions
+TEST(CpuANSTest, CompactProbsFormat) {
+  std::mt19937 gen(1);
+
+  for (int prec = kANSMinProbBits; prec <= kANSMaxProbBits; ++prec) {
+    for (auto numSymbols : {1, 2, 3, 17, 100, 255, 256}) {
+      // A random pdf over a random subset of the symbols
+      auto symbols = std::vector<int>(kNumSymbols);
+      for (int i = 0; i < kNumSymbols; ++i) {
+        symbols[i] = i;
+      }
+
+      std::shuffle(symbols.begin(), symbols.end(), gen);
+
+      auto table = std::vector<uint4>(kNumSymbols, uint4{0, 0, 0, 0});
+      uint32_t remaining = (1U << prec) - numSymbols;
+
+      for (int i = 0; i < numSymbols; ++i) {
+        uint32_t extra =
+            i == numSymbols - 1 ? remaining : gen() % (remaining + 1);
+        table[symbols[i]].x = 1 + extra;
+        remaining -= extra;
+      }
+
+      uint32_t maxPdf = 0;
+      for (auto& t : table) {
+        maxPdf = std::max(maxPdf, t.x);
+      }
+
+      auto buf = std::vector<uint8_t>(
+          sizeof(ANSCoalescedHeader) +
+              ANSCoalescedHeader::getSymbolProbsSize(false),
+          0xff);
+      auto header = (ANSCoalescedHeader*)buf.data();
+      std::memset(header, 0, sizeof(ANSCoalescedHeader));
+      header->setProbBits(prec);
+      header->setSymbolProbsFormat(numSymbols, maxPdf);
+      header->writeSymbolProbs(table.data());
+
+      EXPECT_TRUE(header->getUseCompactProbs());
+      EXPECT_EQ(header->getCompactProbsNumSymbols(), numSymbols);
+      EXPECT_LT(
+          header->getSymbolProbsSize(),
+          ANSCoalescedHeader::getSymbolProbsSize(false));
+
+      for (int i = 0; i < kNumSymbols; ++i) {
+        EXPECT_EQ(header->getSymbolProb(i), table[i].x) << prec << " " << i;
+      }
+
+      // Padding is zeroed, and nothing beyond the pdf is written
+      auto packedEnd = buf.data() + sizeof(ANSCoalescedHeader) + 32 +
+          divUp(numSymbols * header->getCompactProbsBits(), 8);
+      auto end = buf.data() + header->getWarpStatesOffset();
+
+      for (auto p = packedEnd; p < end; ++p) {
+        EXPECT_EQ(*p, 0);
+      }
+
+      for (auto p = end; p < buf.data() + buf.size(); ++p) {
+        EXPECT_EQ(*p, 0xff);
+      }
+    }
+  }
+}
+
+// Archives holding a dense pdf (as written before the compact pdf was
+// introduced) remain readable
+TEST(CpuANSTest, DenseProbsCompat) {
+  ThreadPool pool(4);
+
+  auto batch = genBatch({33, 4096, 10013}, 10.0);
+  auto config = ANSCodecConfig(10, false);
+  auto enc = encodeBatch(pool, config, batch);
+
+  for (int i = 0; i < batch.size(); ++i) {
+    auto header = (const ANSCoalescedHeader*)enc[i].data();
+    ASSERT_FALSE(header->getUseBlockModes());
+
+    auto compactSize = header->getSymbolProbsSize();
+    auto denseSize = ANSCoalescedHeader::getSymbolProbsSize(false);
+
+    // Rewrite the archive with a dense pdf as version 1
+    auto dense = std::vector<uint8_t>(enc[i].size() - compactSize + denseSize);
+    auto denseHeader = (ANSCoalescedHeader*)dense.data();
+    *denseHeader = *header;
+    // (clear the compact pdf options)
+    denseHeader->options &= 0xfc000fffU;
+    denseHeader->setMagicAndVersion();
+    EXPECT_EQ(denseHeader->getVersion(), kANSMinVersion);
+
+    header->readSymbolProbs(denseHeader->getSymbolProbs());
+    std::memcpy(
+        dense.data() + denseHeader->getWarpStatesOffset(),
+        enc[i].data() + header->getWarpStatesOffset(),
+        enc[i].size() - header->getWarpStatesOffset());
+    EXPECT_EQ(denseHeader->getTotalCompressedSize(), dense.size());
+
+    const void* in[] = {dense.data()};
+    auto dec = std::vector<uint8_t>(batch[i].size());
+    void* out[] = {dec.data()};
+    uint32_t outCapacity[] = {(uint32_t)dec.size()};
+
+    auto status = ansDecodeBatchCpu(
+        pool, config, 1, in, out, outCapacity, nullptr, nullptr);
+    EXPECT_EQ(status.error, ANSDecodeError::None);
+    EXPECT_EQ(dec, batch[i]);
+  }
+}
+
+// Blocks that ANS coding would not shrink are stored, and blocks of a single
+// repeated symbol hold no data, so archives are never larger than the input
+// plus the archive overhead
+TEST(CpuANSTest, BlockModes) {
+  ThreadPool pool(4);
+  std::mt19937 gen(1);
+
+  for (auto wide : {false, true}) {
+    for (auto blockSize : {kANSMinBlockSize, kANSMaxBlockSize}) {
+      auto config = ANSCodecConfig(10, true, blockSize, wide);
+      auto wordSize = ANSCoalescedHeader::getEncodedWordSize(wide);
+
+      // A random, a constant and a compressible block, then a partial block
+      auto mixed = std::vector<uint8_t>(blockSize);
+      for (auto& v : mixed) {
+        v = gen();
+      }
+
+      mixed.insert(mixed.end(), blockSize, 0x5a);
+
+      auto symbols = generateSymbols(blockSize, 100.0);
+      mixed.insert(mixed.end(), symbols.begin(), symbols.end());
+      mixed.insert(mixed.end(), {1, 2, 3});
+
+      auto enc = encodeBatch(pool, config, {mixed});
+      auto header = (const ANSCoalescedHeader*)enc[0].data();
+      auto numBlocks = header->getNumBlocks();
+      auto blockWords = header->getBlockWords(numBlocks);
+
+      EXPECT_EQ(header->getVersion(), 5);
+      EXPECT_TRUE(header->getUseBlockModes());
+      ASSERT_EQ(numBlocks, 4);
+
+      EXPECT_EQ(header->getBlockMode(blockWords[0]), ANSBlockMode::Stored);
+      EXPECT_EQ(header->getBlockDataWords(blockWords[0]), blockSize / wordSize);
+
+      EXPECT_EQ(header->getBlockMode(blockWords[1]), ANSBlockMode::Constant);
+      EXPECT_EQ(getBlockConstantSymbol(blockWords[1]), 0x5a);
+      EXPECT_EQ(header->getBlockDataWords(blockWords[1]), 0);
+
+      EXPECT_EQ(header->getBlockMode(blockWords[2]), ANSBlockMode::ANS);
+      EXPECT_LT(header->getBlockDataWords(blockWords[2]) * wordSize, blockSize);
+
+      // Stored data is the raw input
+      EXPECT_EQ(
+          0,
+          std::memcmp(
+              header->getBlockDataStart<uint8_t>(numBlocks) +
+                  getBlockCompressedWordStart(blockWords[0]) * wordSize,
+              mixed.data(),
+              blockSize));
+
+      EXPECT_LE(
+          enc[0].size(), getMaxCompressedSize(mixed.size(), blockSize, wide));
+      EXPECT_EQ(
+          decodeBatch(pool, config, enc, {(uint32_t)mixed.size()})[0], mixed);
+    }
+  }
+}
+
+// The bound on the compressed size holds for any input
+TEST(CpuANSTest, MaxCompressedSize) {
+  ThreadPool pool(4);
+  std::mt19937 gen(2);
+  std::uniform_int_distribution<uint32_t> sizeDist(1, 100000);
+
+  for (int iter = 0; iter < 20; ++iter) {
+    auto wide = (iter % 2) == 1;
+    auto blockSize = kANSMinBlockSize << (iter % 7);
+    auto size = sizeDist(gen);
+
+    // Runs of random bytes, of a repeated byte and of a few distinct bytes
+    auto in = std::vector<uint8_t>(size);
+    for (uint32_t i = 0; i < size;) {
+      auto kind = gen() % 3;
+      auto run = std::min(size - i, uint32_t(gen() % (3 * blockSize)) + 1);
+      auto v = uint8_t(gen());
+
+      for (uint32_t j = 0; j < run; ++j, ++i) {
+        in[i] = kind == 0 ? gen() : (kind == 1 ? v : v + gen() % 4);
+      }
+    }
+
+    for (auto prec : {9, 14}) {
+      auto config = ANSCodecConfig(prec, false, blockSize, wide);
+      auto enc = encodeBatch(pool, config, {in});
+      auto header = (const ANSCoalescedHeader*)enc[0].data();
+
+      EXPECT_LE(enc[0].size(), getMaxCompressedSize(size, blockSize, wide));
+      EXPECT_LE(
+          enc[0].size(),
+          header->getCompressedOverhead() + roundUp(size, kBlockAlignment));
+      EXPECT_EQ(decodeBatch(pool, config, enc, {size})[0], in);
+    }
+  }
+}
+
+TEST(CpuANSTest, RangeDecode) {
+  ThreadPool pool(4);
+  std::mt19937 gen(5);
+
+  for (auto wide : {false, true}) {
+    auto config = ANSCodecConfig(10, false, kANSMinBlockSize, wide);
+
+    // Compressible data with a constant run and a random run, so that the
+    // ranges cover blocks of all modes
+    auto data = generateSymbols(20000, 20.0);
+    std::fill(data.begin() + 5000, data.begin() + 9000, 0x7e);
+    for (int i = 12000; i < 14000; ++i) {
+      data[i] = gen();
+    }
+
+    auto enc = encodeBatch(pool, config, {data});
+    uint32_t size = data.size();
+
+    // offset, size
+    auto ranges = std::vector<std::pair<uint32_t, uint32_t>>{
+        {0, size},
+        {0, 1},
+        {size - 1, 1},
+        {size, 0},
+        {100, 200},
+        {kANSMinBlockSize, kANSMinBlockSize},
+        {kANSMinBlockSize - 3, 7},
+        {4999, 9003},
+        {1234, size - 1234},
+    };
+
+    for (int i = 0; i < 30; ++i) {
+      uint32_t offset = gen() % size;
+      ranges.push_back(std::make_pair(offset, gen() % (size - offset + 1)));
+    }
+
+    for (auto& r : ranges) {
+      // Guard bytes past the range must be left alone
+      constexpr uint32_t kGuard = 16;
+      auto out = std::vector<uint8_t>(r.second + kGuard, 0xcd);
+
+      auto encPtr = (const void*)enc[0].data();
+      auto outPtr = (void*)out.data();
+      uint8_t success = false;
+
+      ansDecodeRangeBatchCpu(
+          pool,
+          config,
+          1,
+          &encPtr,
+          &r.first,
+          &r.second,
+          &outPtr,
+          &success);
+
+      ASSERT_TRUE(success) << r.first << " " << r.second;
+      EXPECT_TRUE(std::equal(
+          out.begin(), out.begin() + r.second, data.begin() + r.first))
+          << r.first << " " << r.second;
+      EXPECT_TRUE(std::all_of(
+          out.begin() + r.second, out.end(), [](uint8_t v) {
+            return v == 0xcd;
+          }));
+    }
+
+    // Ranges past the end of the data fail
+    for (auto& r : std::vector<std::pair<uint32_t, uint32_t>>{
+             {0, size + 1}, {size, 1}, {size + 1, 0}, {10, 0xffffffffU}}) {
+      auto out = std::vector<uint8_t>(16);
+
+      auto encPtr = (const void*)enc[0].data();
+      auto outPtr = (void*)out.data();
+      uint8_t success = true;
+
+      ansDecodeRangeBatchCpu(
+          pool,
+          config,
+          1,
+          &encPtr,
+          &r.first,
+          &r.second,
+          &outPtr,
+          &success);
+
+      EXPECT_FALSE(success) << r.first << " " << r.second;
+    }
+  }
+}
+
+// Data where each symbol mostly determines its neighbor, with numStates
+// distinct symbols
+std::vector<uint8_t> generateMarkovSymbols(int num, int numStates) {
+  std::mt19937 gen(11);
+  std::exponential_distribution<float> dist(2.0f);
+
+  auto out = std::vector<uint8_t>(num);
+  uint32_t state = 0;
+
+  for (auto& v : out) {
+    state = (state * 5 + 1 + uint32_t(dist(gen))) % numStates;
+    v = state * 3;
+  }
+
+  return out;
+}
+
+TEST(CpuANSTest, ChooseContexts) {
+  uint32_t counts[kNumSymbols] = {};
+  counts[7] = 10;
+  counts[3] = 50;
+  counts[200] = 10;
+  counts[9] = 20;
+
+  uint8_t contextSymbol[kANSMaxContexts];
+  uint8_t symbolContext[kNumSymbols];
+
+  // The most frequent symbols have their own context, ties going to the lower
+  // symbol
+  EXPECT_EQ(ansChooseContextsCpu(counts, 4, contextSymbol, symbolContext), 4);
+  EXPECT_EQ(contextSymbol[1], 3);
+  EXPECT_EQ(contextSymbol[2], 9);
+  EXPECT_EQ(contextSymbol[3], 7);
+  EXPECT_EQ(symbolContext[3], 1);
+  EXPECT_EQ(symbolContext[9], 2);
+  EXPECT_EQ(symbolContext[7], 3);
+  EXPECT_EQ(symbolContext[200], 0);
+  EXPECT_EQ(symbolContext[0], 0);
+
+  // No more contexts than symbols present, plus one for all others
+  EXPECT_EQ(ansChooseContextsCpu(counts, 16, contextSymbol, symbolContext), 5);
+  EXPECT_EQ(symbolContext[200], 4);
+
+  std::memset(counts, 0, sizeof(counts));
+  EXPECT_EQ(ansChooseContextsCpu(counts, 16, contextSymbol, symbolContext), 1);
+}
+
+TEST(CpuANSTest, Contexts) {
+  ThreadPool pool(4);
+
+  for (auto wide : {false, true}) {
+    for (auto prec : {9, 11, 14}) {
+      for (auto maxContexts : {2, 4, 16}) {
+        for (auto blockSize : {kANSMinBlockSize, kANSDefaultBlockSize}) {
+          auto config =
+              ANSCodecConfig(prec, true, blockSize, wide, nullptr, maxContexts);
+
+          for (uint32_t size : {0, 1, 33, 1000, 4096, 10013, 300000}) {
+            // 6 distinct symbols
+            auto data = generateMarkovSymbols(size, 6);
+
+            auto enc = encodeBatch(pool, config, {data});
+            auto header = (const ANSCoalescedHeader*)enc[0].data();
+
+            if (size > 0) {
+              EXPECT_EQ(header->getVersion(), 6);
+              EXPECT_TRUE(header->getUseContexts());
+              // One context per distinct symbol, plus one
+              auto distinct = std::vector<bool>(kNumSymbols);
+              for (auto v : data) {
+                distinct[v] = true;
+              }
+
+              EXPECT_EQ(
+                  header->getNumContexts(),
+                  std::min<uint32_t>(
+                      maxContexts,
+                      std::count(distinct.begin(), distinct.end(), true) + 1));
+            } else {
+              EXPECT_FALSE(header->getUseContexts());
+            }
+
+            EXPECT_LE(
+                enc[0].size(),
+                getMaxCompressedSize(size, blockSize, wide, maxContexts));
+            EXPECT_EQ(decodeBatch(pool, config, enc, {size})[0], data);
+
+            // Decoding needs no knowledge of the contexts
+            auto decConfig = ANSCodecConfig(prec, true, blockSize, wide);
+            EXPECT_EQ(decodeBatch(pool, decConfig, enc, {size})[0], data);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(CpuANSTest, ContextsRatio) {
+  ThreadPool pool(4);
+
+  auto data = generateMarkovSymbols(1000000, 12);
+  auto order0 = encodeBatch(pool, ANSCodecConfig(11, false), {data});
+
+  uint32_t lastSize = order0[0].size();
+
+  for (auto maxContexts : {4, 16}) {
+    auto config = ANSCodecConfig(
+        11, false, kANSDefaultBlockSize, false, nullptr, maxContexts);
+    auto enc = encodeBatch(pool, config, {data});
+
+    // More contexts model the data better
+    EXPECT_LT(enc[0].size(), lastSize);
+    lastSize = enc[0].size();
+
+    EXPECT_EQ(
+        decodeBatch(pool, config, enc, {(uint32_t)data.size()})[0], data);
+  }
+
+  // All contexts are modeled with 16, for a gain well beyond the table cost
+  EXPECT_LT(lastSize * 3, order0[0].size() * 2);
+}
+
+TEST(CpuANSTest, ContextsRangeDecode) {
+  ThreadPool pool(4);
+
+  auto config =
+      ANSCodecConfig(10, false, kANSMinBlockSize, false, nullptr, 8);
+  auto data = generateMarkovSymbols(20000, 5);
+  std::fill(data.begin() + 5000, data.begin() + 9000, 0x7e);
+
+  auto enc = encodeBatch(pool, config, {data});
+
+  for (auto& r : std::vector<std::pair<uint32_t, uint32_t>>{
+           {0, 20000}, {1, 1}, {1000, 1100}, {4999, 9003}, {19999, 1}}) {
+    auto out = std::vector<uint8_t>(r.second);
+
+    auto encPtr = (const void*)enc[0].data();
+    auto outPtr = (void*)out.data();
+    uint8_t success = false;
+
+    ansDecodeRangeBatchCpu(
+        pool, config, 1, &encPtr, &r.first, &r.second, &outPtr, &success);
+
+    ASSERT_TRUE(success);
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + r.first));
+  }
+}
+
+// Concatenated runs of data of different distributions, like the exponents of
+// successive layers of a model
+std::vector<uint8_t> generateMixedSymbols(const std::vector<uint32_t>& sizes) {
+  std::mt19937 gen(12);
+  auto out = std::vector<uint8_t>();
+
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    std::normal_distribution<float> dist(40.0f * (i % 5) + 20.0f, 2.0f + i % 3);
+
+    for (uint32_t j = 0; j < sizes[i]; ++j) {
+      out.push_back(std::min(std::max(dist(gen), 0.0f), 255.0f));
+    }
+  }
+
+  return out;
+}
+
+TEST(CpuANSTest, ChooseSegments) {
+  auto peak = [](uint32_t* h, int sym) {
+    std::memset(h, 0, kNumSymbols * sizeof(uint32_t));
+    for (int i = -3; i <= 3; ++i) {
+      h[sym + i] = 1000 >> std::abs(i);
+    }
+  };
+
+  // 3 units of one distribution followed by 5 of another
+  auto histograms = std::vector<uint32_t>(8 * kNumSymbols);
+  for (int u = 0; u < 8; ++u) {
+    peak(histograms.data() + u * kNumSymbols, u < 3 ? 20 : 200);
+  }
+
+  uint32_t unitSegment[8];
+  EXPECT_EQ(
+      ansChooseSegmentsCpu(histograms.data(), 8, 10, 16, unitSegment), 2);
+  for (int u = 0; u < 8; ++u) {
+    EXPECT_EQ(unitSegment[u], u < 3 ? 0 : 1);
+  }
+
+  // At most the number of segments requested
+  EXPECT_EQ(ansChooseSegmentsCpu(histograms.data(), 8, 10, 1, unitSegment), 1);
+  for (int u = 0; u < 8; ++u) {
+    EXPECT_EQ(unitSegment[u], 0);
+  }
+
+  // Units of the same distribution are not worth a pdf each
+  for (int u = 0; u < 8; ++u) {
+    peak(histograms.data() + u * kNumSymbols, 100);
+  }
+
+  EXPECT_EQ(
+      ansChooseSegmentsCpu(histograms.data(), 8, 10, 16, unitSegment), 1);
+}
+
+TEST(CpuANSTest, Segments) {
+  ThreadPool pool(4);
+
+  for (auto wide : {false, true}) {
+    for (auto prec : {9, 11, 14}) {
+      for (auto maxSegments : {2, 4, 16}) {
+        auto config = ANSCodecConfig(
+            prec, true, kANSMinBlockSize, wide, nullptr, 1, maxSegments);
+
+        for (auto& sizes : std::vector<std::vector<uint32_t>>{
+                 {},
+                 {1},
+                 {1000},
+                 {3000, 5000},
+                 {10000, 3000, 20000, 7000, 15000, 4000, 9000},
+                 {300000, 200000, 100000}}) {
+          auto data = generateMixedSymbols(sizes);
+          uint32_t size = data.size();
+
+          auto enc = encodeBatch(pool, config, {data});
+          auto header = (const ANSCoalescedHeader*)enc[0].data();
+          auto numBlocks = header->getNumBlocks();
+
+          if (sizes.size() > 1) {
+            EXPECT_EQ(header->getVersion(), 7);
+            EXPECT_TRUE(header->getUseSegments());
+            EXPECT_FALSE(header->getUseContexts());
+            EXPECT_LE(header->getNumSegments(), maxSegments);
+          } else {
+            EXPECT_FALSE(header->getUseSegments());
+          }
+
+          // Segments are contiguous runs of blocks
+          uint32_t lastSegment = 0;
+          for (uint32_t b = 0; b < numBlocks; ++b) {
+            auto segment =
+                header->getBlockSegment(header->getBlockWords(numBlocks)[b]);
+            EXPECT_TRUE(segment == lastSegment || segment == lastSegment + 1);
+            lastSegment = segment;
+          }
+
+          EXPECT_EQ(lastSegment + 1, header->getNumSegments());
+          EXPECT_LE(
+              enc[0].size(),
+              getMaxCompressedSize(size, kANSMinBlockSize, wide, maxSegments));
+          EXPECT_EQ(decodeBatch(pool, config, enc, {size})[0], data);
+
+          // A range spanning segments
+          if (size > 2) {
+            uint32_t offset = size / 3;
+            uint32_t rangeSize = size / 2;
+            auto out = std::vector<uint8_t>(rangeSize);
+
+            auto encPtr = (const void*)enc[0].data();
+            auto outPtr = (void*)out.data();
+            uint8_t success = false;
+
+            auto rangeConfig = config;
+            rangeConfig.useChecksum = false;
+
+            ansDecodeRangeBatchCpu(
+                pool,
+                rangeConfig,
+                1,
+                &encPtr,
+                &offset,
+                &rangeSize,
+                &outPtr,
+                &success);
+
+            EXPECT_TRUE(success);
+            EXPECT_TRUE(
+                std::equal(out.begin(), out.end(), data.begin() + offset));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(CpuANSTest, SegmentsRatio) {
+  ThreadPool pool(4);
+
+  auto data = generateMixedSymbols(
+      {200000, 50000, 300000, 100000, 250000, 80000, 400000, 120000});
+
+  auto single = encodeBatch(pool, ANSCodecConfig(10), {data});
+  auto segmented = encodeBatch(
+      pool,
+      ANSCodecConfig(10, false, kANSDefaultBlockSize, false, nullptr, 1, 8),
+      {data});
+
+  auto header = (const ANSCoalescedHeader*)segmented[0].data();
+  EXPECT_EQ(header->getNumSegments(), 8);
+
+  // Each run is coded with a pdf close to its own distribution
+  EXPECT_LT(segmented[0].size() * 3, single[0].size() * 2);
+  EXPECT_EQ(
+      decodeBatch(pool, ANSCodecConfig(10), segmented, {(uint32_t)data.size()})
+          [0],
+      data);
+}
+
+// Generates `num` little-endian integers of `width` bytes uniformly
+// distributed in [0, maxValue], followed by `tail` further bytes
+std::vector<uint8_t> generateIntegers(
+    uint32_t num,
+    uint32_t width,
+    uint64_t maxValue,
+    int tail = 0) {
+  std::mt19937_64 gen(30 + num);
+  std::uniform_int_distribution<uint64_t> dist(0, maxValue);
+
+  auto out = std::vector<uint8_t>(num * width + tail);
+  for (uint32_t i = 0; i < num; ++i) {
+    uint64_t v = dist(gen);
+    for (uint32_t j = 0; j < width; ++j) {
+      out[i * width + j] = j < sizeof(v) ? v >> (8 * j) : 0;
+    }
+  }
+
+  for (int i = 0; i < tail; ++i) {
+    out[num * width + i] = gen();
+  }
+
+  return out;
+}
+
+TEST(CpuANSTest, Shuffle) {
+  ThreadPool pool(4);
+  std::mt19937 gen(12);
+
+  for (auto wide : {false, true}) {
+    for (uint32_t width : {2, 4, 8, 16}) {
+      auto config = ANSCodecConfig(
+          10, true, kANSMinBlockSize, wide, nullptr, 1, 1, width);
+
+      auto batch = std::vector<std::vector<uint8_t>>();
+      for (uint32_t num : {0, 1, 100, 4097, 100003}) {
+        for (int tail : {0, 1}) {
+          batch.push_back(generateIntegers(num, width, 100000, tail));
+        }
+      }
+
+      auto sizes = std::vector<uint32_t>();
+      for (auto& b : batch) {
+        sizes.push_back(b.size());
+      }
+
+      auto enc = encodeBatch(pool, config, batch);
+
+      for (auto& e : enc) {
+        auto header = (const ANSCoalescedHeader*)e.data();
+        EXPECT_EQ(header->getShuffleWidth(), width);
+        EXPECT_EQ(header->getVersion(), 8);
+        EXPECT_LE(header->getNumSegments(), width);
+      }
+
+      EXPECT_EQ(decodeBatch(pool, config, enc, sizes), batch);
+
+      // Random ranges, which gather from each plane and the tail
+      auto rangeConfig = config;
+      rangeConfig.useChecksum = false;
+
+      int numInBatch = batch.size();
+      auto encPtrs = std::vector<const void*>(numInBatch);
+      auto offsets = std::vector<uint32_t>(numInBatch);
+      auto lengths = std::vector<uint32_t>(numInBatch);
+      auto out = std::vector<std::vector<uint8_t>>(numInBatch);
+      auto outPtrs = std::vector<void*>(numInBatch);
+      auto success = std::vector<uint8_t>(numInBatch);
+
+      for (int iter = 0; iter < 5; ++iter) {
+        for (int i = 0; i < numInBatch; ++i) {
+          encPtrs[i] = enc[i].data();
+          offsets[i] = gen() % (sizes[i] + 1);
+          lengths[i] = gen() % (sizes[i] - offsets[i] + 1);
+          out[i].assign(lengths[i], 0);
+          outPtrs[i] = out[i].data();
+        }
+
+        ansDecodeRangeBatchCpu(
+            pool,
+            rangeConfig,
+            numInBatch,
+            encPtrs.data(),
+            offsets.data(),
+            lengths.data(),
+            outPtrs.data(),
+            success.data());
+
+        for (int i = 0; i < numInBatch; ++i) {
+          EXPECT_TRUE(success[i]);
+          EXPECT_TRUE(std::equal(
+              out[i].begin(), out[i].end(), batch[i].begin() + offsets[i]));
+        }
+      }
+
+      // A range past the end of the data fails
+      offsets[0] = sizes.back();
+      lengths[0] = 1;
+      encPtrs[0] = enc.back().data();
+      ansDecodeRangeBatchCpu(
+          pool,
+          rangeConfig,
+          1,
+          encPtrs.data(),
+          offsets.data(),
+          lengths.data(),
+          outPtrs.data(),
+          success.data());
+      EXPECT_FALSE(success[0]);
+    }
+  }
+}
+
+TEST(CpuANSTest, ShuffleRatio) {
+  ThreadPool pool(4);
+
+  // int32 ids and int64 offsets, whose high order bytes are mostly zero
+  for (uint32_t width : {4, 8}) {
+    auto data = generateIntegers(250000, width, 1000000);
+
+    auto plain = encodeBatch(pool, ANSCodecConfig(10), {data});
+    auto shuffled = encodeBatch(
+        pool,
+        ANSCodecConfig(
+            10, false, kANSDefaultBlockSize, false, nullptr, 1, 1, width),
+        {data});
+
+    // Each plane is coded with its own pdf, and the planes of uniform low
+    // order bytes are stored
+    EXPECT_LT(shuffled[0].size() * 6, plain[0].size() * 5);
+    EXPECT_TRUE(
+        ((const ANSCoalescedHeader*)shuffled[0].data())->getUseBlockModes());
+    EXPECT_EQ(
+        decodeBatch(
+            pool, ANSCodecConfig(10), shuffled, {(uint32_t)data.size()})[0],
+        data);
+  }
+}
+
+TEST(CpuANSTest, Delta) {
+  ThreadPool pool(4);
+  std::mt19937 gen(13);
+
+  auto config = ANSCodecConfig(10, true, kANSMinBlockSize);
+  auto sizes = std::vector<uint32_t>{0, 1, 100, 4097, 100003, 200000};
+  int numInBatch = sizes.size();
+
+  // A reference for the odd members only, from which 5% of the bytes differ
+  auto batch = std::vector<std::vector<uint8_t>>();
+  auto refs = std::vector<std::vector<uint8_t>>();
+  auto refPtrs = std::vector<const void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    batch.push_back(generateIntegers(sizes[i], 1, 255));
+    refs.push_back(batch[i]);
+
+    for (auto& b : refs[i]) {
+      if (gen() % 20 == 0) {
+        b = gen();
+      }
+    }
+
+    refPtrs[i] = (i % 2) ? refs[i].data() : nullptr;
+  }
+
+  auto plain = encodeBatch(pool, config, batch);
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto encPtrs = std::vector<void*>(numInBatch);
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    inPtrs[i] = batch[i].data();
+    enc[i].resize(getMaxCompressedSize(sizes[i], config.blockSize));
+    encPtrs[i] = enc[i].data();
+  }
+
+  ansEncodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      sizes.data(),
+      nullptr,
+      encPtrs.data(),
+      encSize.data(),
+      refPtrs.data());
+
+  for (int i = 0; i < numInBatch; ++i) {
+    enc[i].resize(encSize[i]);
+    auto header = (const ANSCoalescedHeader*)enc[i].data();
+    EXPECT_EQ(header->getUseDelta(), refPtrs[i] != nullptr);
+
+    // Members without a reference are coded as usual, while those with one
+    // mostly code zeros
+    if (refPtrs[i]) {
+      EXPECT_EQ(header->getVersion(), 9);
+      if (sizes[i] >= 100000) {
+        EXPECT_LT(enc[i].size() * 3, plain[i].size());
+      }
+    } else {
+      EXPECT_EQ(enc[i], plain[i]);
+    }
+  }
+
+  // Decoding XORs the references back in, and verifies the checksum of the
+  // delta
+  auto decEncPtrs = std::vector<const void*>(numInBatch);
+  auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto decSize = std::vector<uint32_t>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    decEncPtrs[i] = enc[i].data();
+    dec[i].resize(sizes[i]);
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto status = ansDecodeBatchCpu(
+      pool,
+      config,
+      numInBatch,
+      decEncPtrs.data(),
+      decPtrs.data(),
+      sizes.data(),
+      success.data(),
+      decSize.data(),
+      refPtrs.data());
+
+  EXPECT_EQ(status.error, ANSDecodeError::None);
+  for (int i = 0; i < numInBatch; ++i) {
+    EXPECT_TRUE(success[i]);
+    EXPECT_EQ(decSize[i], sizes[i]);
+  }
+
+  EXPECT_EQ(dec, batch);
+
+  // Random ranges use the reference bytes at the range
+  auto rangeConfig = config;
+  rangeConfig.useChecksum = false;
+
+  auto offsets = std::vector<uint32_t>(numInBatch);
+  auto lengths = std::vector<uint32_t>(numInBatch);
+
+  for (int iter = 0; iter < 5; ++iter) {
+    for (int i = 0; i < numInBatch; ++i) {
+      offsets[i] = gen() % (sizes[i] + 1);
+      lengths[i] = gen() % (sizes[i] - offsets[i] + 1);
+      dec[i].assign(lengths[i], 0);
+      decPtrs[i] = dec[i].data();
+    }
+
+    ansDecodeRangeBatchCpu(
+        pool,
+        rangeConfig,
+        numInBatch,
+        decEncPtrs.data(),
+        offsets.data(),
+        lengths.data(),
+        decPtrs.data(),
+        success.data(),
+        refPtrs.data());
+
+    for (int i = 0; i < numInBatch; ++i) {
+      EXPECT_TRUE(success[i]);
+      EXPECT_TRUE(std::equal(
+          dec[i].begin(), dec[i].end(), batch[i].begin() + offsets[i]));
+    }
+  }
+}
+
+TEST(CpuANSTest, Crc32c) {
+  // The standard check value
+  const char* check = "123456789";
+  EXPECT_EQ(crc32cCpu(check, 9), 0xe3069283);
+  EXPECT_EQ(crc32cCpu(check, 0), 0);
+
+  auto data = generateIntegers(20000, 1, 255);
+  auto portable = getCrc32cCpu(CpuSimdLevel::Scalar);
+
+  for (auto level : {CpuSimdLevel::AVX2, CpuSimdLevel::AVX512}) {
+    if (!isCpuSimdLevelSupported(level)) {
+      continue;
+    }
+
+    // All implementations agree, at any alignment and length
+    auto crc = getCrc32cCpu(level);
+
+    for (size_t offset = 0; offset < 9; ++offset) {
+      for (size_t size : {0, 1, 7, 8, 9, 767, 768, 769, 4096, 19991}) {
+        EXPECT_EQ(
+            crc(data.data() + offset, size, 0),
+            portable(data.data() + offset, size, 0))
+            << getCpuSimdLevelName(level) << " " << offset << " " << size;
+      }
+    }
+  }
+
+  // The CRC of data continued from, or combined with, that of preceding data
+  // is that of both
+  for (size_t split : {0, 1, 4096, 12345, 20000}) {
+    uint32_t a = crc32cCpu(data.data(), split);
+    uint32_t b = crc32cCpu(data.data() + split, data.size() - split);
+    uint32_t all = crc32cCpu(data.data(), data.size());
+
+    EXPECT_EQ(crc32cCpu(data.data() + split, data.size() - split, a), all);
+    EXPECT_EQ(crc32cCombine(a, b, data.size() - split), all);
+    EXPECT_EQ(Crc32cCombiner(data.size() - split)(a, b), all);
+  }
+}
+
+TEST(CpuANSTest, BlockChecksum) {
+  ThreadPool pool(4);
+
+  auto sizes = std::vector<uint32_t>{0, 1, 4095, 4096, 4097, 100003, 200000};
+  int numInBatch = sizes.size();
+
+  auto batch = std::vector<std::vector<uint8_t>>();
+  for (auto size : sizes) {
+    batch.push_back(generateIntegers(size, 1, 255));
+  }
+
+  for (uint32_t shuffle : {1, 4}) {
+    auto config = ANSCodecConfig(10, true);
+    config.shuffleWidth = shuffle;
+    auto plain = encodeBatch(pool, config, batch);
+
+    config.useBlockChecksum = true;
+    auto enc = encodeBatch(pool, config, batch);
+
+    // The checksums follow the archive without them
+    for (int i = 0; i < numInBatch; ++i) {
+      auto header = (const ANSCoalescedHeader*)enc[i].data();
+      EXPECT_TRUE(header->getUseBlockChecksum());
+      EXPECT_EQ(header->getVersion(), 10);
+      EXPECT_EQ(
+          enc[i].size(),
+          header->getBlockChecksumsOffset() + getBlockChecksumSize(sizes[i]));
+      EXPECT_EQ(header->getBlockChecksumsOffset(), plain[i].size());
+      EXPECT_TRUE(std::equal(
+          enc[i].begin() + sizeof(ANSCoalescedHeader),
+          enc[i].begin() + plain[i].size(),
+          plain[i].begin() + sizeof(ANSCoalescedHeader)));
+
+      uint32_t numBlocks = divUp(sizes[i], kANSChecksumBlockSize);
+      auto checksums = header->getBlockChecksums();
+
+      for (uint32_t b = 0; b < numBlocks; ++b) {
+        uint32_t begin = b * kANSChecksumBlockSize;
+        uint32_t end = std::min(sizes[i], begin + kANSChecksumBlockSize);
+        EXPECT_EQ(
+            checksums[b], crc32cCpu(batch[i].data() + begin, end - begin));
+      }
+
+      EXPECT_EQ(
+          checksums[numBlocks], crc32cCpu(batch[i].data(), batch[i].size()));
+    }
+
+    EXPECT_EQ(decodeBatch(pool, config, enc, sizes), batch);
+
+    // Corrupt the data of 2 coded blocks of the largest member; with the
+    // default block size, each covers a checksum block of the (possibly
+    // shuffled) data
+    auto last = numInBatch - 1;
+    auto header = (const ANSCoalescedHeader*)enc[last].data();
+    auto numBlocks = header->getNumBlocks();
+
+    for (uint32_t b : {3, 40}) {
+      auto bw = header->getBlockWords(numBlocks)[b];
+      auto offset = header->getBlockDataOffset(numBlocks) +
+          getBlockCompressedWordStart(bw) * sizeof(ANSEncodedT);
+
+      enc[last][offset + 100] ^= 0x10;
+    }
+
+    auto encPtrs = std::vector<const void*>(numInBatch);
+    auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto decPtrs = std::vector<void*>(numInBatch);
+    auto success = std::vector<uint8_t>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      encPtrs[i] = enc[i].data();
+      dec[i].resize(sizes[i]);
+      decPtrs[i] = dec[i].data();
+    }
+
+    auto status = ansDecodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        sizes.data(),
+        success.data(),
+        nullptr);
+
+    EXPECT_EQ(status.error, ANSDecodeError::ChecksumMismatch);
+    ASSERT_EQ(status.failedBlocks.size(), 1);
+    EXPECT_EQ(status.failedBlocks[0].first, last);
+
+    // Exactly the blocks that decoded incorrectly fail
+    auto& failed = status.failedBlocks[0].second;
+    ASSERT_FALSE(failed.empty());
+
+    for (uint32_t b = 0; b < divUp(sizes[last], kANSChecksumBlockSize); ++b) {
+      uint32_t begin = b * kANSChecksumBlockSize;
+      uint32_t end = std::min(sizes[last], begin + kANSChecksumBlockSize);
+
+      EXPECT_EQ(
+          std::equal(
+              dec[last].begin() + begin,
+              dec[last].begin() + end,
+              batch[last].begin() + begin),
+          std::find(failed.begin(), failed.end(), b) == failed.end());
+    }
+
+    if (shuffle == 1) {
+      EXPECT_EQ(failed, (std::vector<uint32_t>{3, 40}));
+    }
+
+    for (int i = 0; i < last; ++i) {
+      EXPECT_TRUE(success[i]);
+      EXPECT_EQ(dec[i], batch[i]);
+    }
+  }
+}
+
+// Block checksums are computed from the pieces of checksum blocks that each
+// coded block holds, and cover the input as given rather than its delta
+TEST(CpuANSTest, BlockChecksumBlockSize) {
+  ThreadPool pool(4);
+  std::mt19937 gen(17);
+
+  auto sizes = std::vector<uint32_t>{0, 1, 1000, 4097, 100003, 200000};
+  int numInBatch = sizes.size();
+
+  auto batch = std::vector<std::vector<uint8_t>>();
+  auto refs = std::vector<std::vector<uint8_t>>();
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto refPtrs = std::vector<const void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    batch.push_back(generateIntegers(sizes[i], 1, 255));
+    refs.push_back(batch[i]);
+
+    for (auto& b : refs[i]) {
+      if (gen() % 20 == 0) {
+        b = gen();
+      }
+    }
+
+    inPtrs[i] = batch[i].data();
+    refPtrs[i] = (i % 2) ? refs[i].data() : nullptr;
+  }
+
+  for (uint32_t blockSize :
+       {kANSMinBlockSize, 2048U, 16384U, kANSMaxBlockSize}) {
+    auto config = ANSCodecConfig(10, true, blockSize);
+    config.useBlockChecksum = true;
+
+    auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto encPtrs = std::vector<void*>(numInBatch);
+    auto encSize = std::vector<uint32_t>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      enc[i].resize(
+          getMaxCompressedSize(sizes[i], blockSize, false, 1, true));
+      encPtrs[i] = enc[i].data();
+    }
+
+    ansEncodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        sizes.data(),
+        nullptr,
+        encPtrs.data(),
+        encSize.data(),
+        refPtrs.data());
+
+    for (int i = 0; i < numInBatch; ++i) {
+      enc[i].resize(encSize[i]);
+
+      auto header = (const ANSCoalescedHeader*)enc[i].data();
+      EXPECT_TRUE(header->getUseBlockChecksum());
+      EXPECT_EQ(header->getUseDelta(), refPtrs[i] != nullptr);
+
+      uint32_t numBlocks = divUp(sizes[i], kANSChecksumBlockSize);
+      auto checksums = header->getBlockChecksums();
+
+      for (uint32_t b = 0; b < numBlocks; ++b) {
+        uint32_t begin = b * kANSChecksumBlockSize;
+        uint32_t end = std::min(sizes[i], begin + kANSChecksumBlockSize);
+        EXPECT_EQ(
+            checksums[b], crc32cCpu(batch[i].data() + begin, end - begin));
+      }
+
+      EXPECT_EQ(
+          checksums[numBlocks], crc32cCpu(batch[i].data(), batch[i].size()));
+    }
+
+    auto decEncPtrs = std::vector<const void*>(numInBatch);
+    auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto decPtrs = std::vector<void*>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      decEncPtrs[i] = enc[i].data();
+      dec[i].resize(sizes[i]);
+      decPtrs[i] = dec[i].data();
+    }
+
+    auto status = ansDecodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        decEncPtrs.data(),
+        decPtrs.data(),
+        sizes.data(),
+        nullptr,
+        nullptr,
+        refPtrs.data());
+
+    EXPECT_EQ(status.error, ANSDecodeError::None);
+    EXPECT_EQ(dec, batch);
+  }
+}
+
+TEST(CpuANSTest, BlockChecksumCorrupt) {
+  ThreadPool pool(4);
+
+  auto config = ANSCodecConfig(10);
+  config.useBlockChecksum = true;
+
+  auto sizes = std::vector<uint32_t>{50000, 50000, 50000};
+  auto batch = genBatch(sizes, 10.0);
+  auto enc = encodeBatch(pool, config, batch);
+
+  // A corrupted block checksum fails its block, while a corrupted checksum of
+  // all blocks fails none
+  ((ANSCoalescedHeader*)enc[1].data())->getBlockChecksums()[5] ^= 0x100;
+  ((ANSCoalescedHeader*)enc[2].data())->getBlockChecksums()[13] ^= 0x1;
+
+  auto encPtrs = std::vector<const void*>(3);
+  auto dec = std::vector<std::vector<uint8_t>>(3);
+  auto decPtrs = std::vector<void*>(3);
+
+  for (int i = 0; i < 3; ++i) {
+    encPtrs[i] = enc[i].data();
+    dec[i].resize(sizes[i]);
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto status = ansDecodeBatchCpu(
+      pool,
+      config,
+      3,
+      encPtrs.data(),
+      decPtrs.data(),
+      sizes.data(),
+      nullptr,
+      nullptr);
+
+  EXPECT_EQ(status.error, ANSDecodeError::ChecksumMismatch);
+  EXPECT_EQ(status.errorInfo.size(), 2);
+  ASSERT_EQ(status.failedBlocks.size(), 2);
+  EXPECT_EQ(status.failedBlocks[0].first, 1);
+  EXPECT_EQ(status.failedBlocks[0].second, std::vector<uint32_t>{5});
+  EXPECT_EQ(status.failedBlocks[1].first, 2);
+  EXPECT_TRUE(status.failedBlocks[1].second.empty());
+  EXPECT_EQ(dec, batch);
+
+  // Ranges decode as usual, without verification
+  auto offsets = std::vector<uint32_t>{0, 20000, 49000};
+  auto lengths = std::vector<uint32_t>{50000, 100, 1000};
+
+  for (int i = 0; i < 3; ++i) {
+    dec[i].assign(lengths[i], 0);
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto success = std::vector<uint8_t>(3);
+  ansDecodeRangeBatchCpu(
+      pool,
+      config,
+      3,
+      encPtrs.data(),
+      offsets.data(),
+      lengths.data(),
+      decPtrs.data(),
+      success.data());
+
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_TRUE(success[i]);
+    EXPECT_TRUE(std::equal(
+        dec[i].begin(), dec[i].end(), batch[i].begin() + offsets[i]));
+  }
+}
@@ -0,0 +1,437 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+// for the __host__/__align__ etc. qualifiers used in the format definitions
+#include <cuda_runtime.h>
+#include "dietgpu/ans/GpuANSUtils.cuh"
+#include "dietgpu/utils/CpuFeatures.h"
+#include "dietgpu/utils/DeviceDefs.cuh"
+#include "dietgpu/utils/StaticUtils.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dietgpu {
+
+//
+// Host (CPU) equivalents of the building blocks of the GPU ANS codec. These
+// reproduce the GPU computation exactly (down to the quantized pdf and the
+// interleaving of the 32 warp lanes), so that data produced by either side can
+// be consumed by the other.
+//
+
+// Accumulates the symbol counts of `in` into `histogram` (size kNumSymbols)
+void ansHistogramCpu(
+    const ANSDecodedT* in,
+    uint32_t size,
+    uint32_t* histogram);
+
+// Same value as produced by checksumBatch (XOR of all bytes in the input)
+uint32_t ansChecksumCpu(const uint8_t* in, uint32_t size);
+
+// Quantizes the histogram to probabilities of 1/2^probBits and computes the
+// encoding table {pdf, cdf, div_m1, div_shift}, with results identical to
+// normalizeProbabilitiesFromHistogram
+void ansCalcWeightsCpu(
+    // size kNumSymbols
+    const uint32_t* counts,
+    // sum of counts
+    uint32_t totalNum,
+    int probBits,
+    // size kNumSymbols
+    uint4* table);
+
+// Builds the decoding table (getANSDecodeTableWords(probBits) words) from the
+// pdf stored in an archive, as ansDecodeTable does. Returns false, building
+// no table, if the pdf does not sum to 2^probBits (the archive is corrupt)
+bool ansDecodeTableCpu(const uint16_t* probs, int probBits, TableT* table);
+
+// Chooses the contexts for order-1 context modeling (see
+// ANSCodecConfig::numContexts) of data with the given symbol counts: each of
+// the most frequent symbols, up to maxContexts - 1 of them, has its own
+// context, with ties broken by the lower symbol. Writes the symbol of each
+// context c > 0 to contextSymbol[c] (size kANSMaxContexts) and the context of
+// each symbol to symbolContext (size kNumSymbols).
+// Returns the number of contexts, which is 1 (no contexts) for empty data
+uint32_t ansChooseContextsCpu(
+    // size kNumSymbols
+    const uint32_t* counts,
+    uint32_t maxContexts,
+    uint8_t* contextSymbol,
+    uint8_t* symbolContext);
+
+// Partitions a sequence of numUnits runs of data, given the histogram of each
+// (at a stride of kNumSymbols), into at most maxSegments contiguous segments
+// coded with a pdf each (see ANSCodecConfig::maxSegments), so as to minimize
+// the estimated compressed size: the entropy of each segment plus the size of
+// its pdf at probBits precision. Adjacent runs are merged greedily while that
+// reduces the estimate, or while there are too many segments.
+// Writes the segment of each run to unitSegment, returning the number of
+// segments
+uint32_t ansChooseSegmentsCpu(
+    const uint32_t* histograms,
+    uint32_t numUnits,
+    int probBits,
+    uint32_t maxSegments,
+    uint32_t* unitSegment);
+
+// Byte shuffle (see ANSCodecConfig::shuffleWidth): views the first
+// size / width * width bytes of `in` as elements of `width` bytes, and writes
+// byte j of element e to out[j * (size / width) + e], for the elements
+// [begin, end) (so that the work may be divided). The size % width trailing
+// bytes keep their position, and are not handled here
+void ansShuffleCpu(
+    const uint8_t* in,
+    uint32_t size,
+    uint32_t width,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* out);
+
+// The inverse of ansShuffleCpu, for the elements [begin, end)
+void ansUnshuffleCpu(
+    const uint8_t* in,
+    uint32_t size,
+    uint32_t width,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* out);
+
+// Delta mode (see ansEncodeBatchCpu): for each batch member with a non-null
+// ref[i], writes the XOR of the size[i] * wordSize bytes of in[i] and ref[i]
+// to out[i], which may be in[i]. Members without a reference are untouched.
+// The work is divided among the threads of `pool`
+void ansXorBatchCpu(
+    ThreadPool& pool,
+    uint32_t numInBatch,
+    const void** in,
+    const void** ref,
+    const uint32_t* size,
+    uint32_t wordSize,
+    void** out);
+
+// Block checksums (see ANSCodecConfig::useBlockChecksum) are computed by the
+// encoders within the tasks that already read the data, in pieces of
+// pieceBytes bytes (a divisor of kANSChecksumBlockSize) that need not be
+// whole blocks. Computes the CRC32C of each piece of bytes [begin, end) of
+// `data` into crc[begin / pieceBytes] onwards; `begin` must be a multiple of
+// pieceBytes, and `end` one as well unless it is the end of the data
+void ansChecksumPiecesCpu(
+    const void* data,
+    size_t begin,
+    size_t end,
+    uint32_t pieceBytes,
+    uint32_t* crc);
+
+// From the CRC32C of each piece of the `bytes` bytes of data, as computed by
+// ansChecksumPiecesCpu, writes the CRC32C of each kANSChecksumBlockSize block
+// followed by that of all of them to out (getBlockChecksumSize(bytes) bytes,
+// zero padded). pieceCrc may be `out` if pieceBytes is kANSChecksumBlockSize
+void ansBlockChecksumsFromPiecesCpu(
+    const uint32_t* pieceCrc,
+    uint32_t pieceBytes,
+    size_t bytes,
+    uint32_t* out);
+
+// Verifies decompressed data against its block checksums: for each batch
+// member with non-null checksums[i] (as written by
+// ansBlockChecksumsFromPiecesCpu), recomputes those of the size[i] * wordSize
+// bytes of in[i]. Each member with a mismatch is appended to failedBlocks
+// with the indices of its failed blocks, and to errorInfo with a
+// description. Returns true if all match
+bool ansCheckBlockChecksumBatchCpu(
+    ThreadPool& pool,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    uint32_t wordSize,
+    const uint32_t** checksums,
+    std::vector<std::pair<int, std::vector<uint32_t>>>& failedBlocks,
+    std::vector<std::pair<int, std::string>>& errorInfo);
+
+// Accumulates the symbol counts of `in` per context into `histogram` (size
+// number of contexts x kNumSymbols), where the context of each symbol is that
+// of its neighbor as coded in blocks of blockSize (see getContextStripeSize).
+// `in` must start at a block boundary
+void ansContextHistogramCpu(
+    const ANSDecodedT* in,
+    uint32_t size,
+    uint32_t blockSize,
+    // size kNumSymbols
+    const uint8_t* symbolContext,
+    uint32_t* histogram);
+
+// Encodes a single block of data as the 32 interleaved lanes of a warp would
+// in ansEncodeWarpBlock, writing the final lane states to `state` and the
+// compressed words to `out`. `Wide` selects the 64 bit state / 32 bit word
+// variant of the coder.
+// Returns the number of compressed words (Info::EncodedT) written
+template <int ProbBits, bool Wide = false>
+uint32_t ansEncodeBlockCpu(
+    const ANSDecodedT* __restrict__ in,
+    uint32_t inWords,
+    const uint4* __restrict__ table,
+    typename ANSStateInfo<Wide>::WarpState* __restrict__ state,
+    typename ANSStateInfo<Wide>::EncodedT* __restrict__ out) {
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
+  using EncodedT = typename Info::EncodedT;
+
+  constexpr StateT kStateCheckMul = StateT(1)
+      << (Info::kStateBits - ProbBits);
+
+  // The per-symbol lookup in the form used by the coder
+  typename Info::EncodeLookup lookup[kNumSymbols];
+  for (int i = 0; i < kNumSymbols; ++i) {
+    lookup[i] = Info::makeEncodeLookup(table[i]);
+  }
+
+  StateT laneState[kWarpSize];
+  for (int i = 0; i < kWarpSize; ++i) {
+    laneState[i] = Info::getStartState();
+  }
+
+  uint32_t outOffset = 0;
+
+  for (uint32_t start = 0; start < inWords; start += kWarpSize) {
+    uint32_t numLanes = std::min(inWords - start, (uint32_t)kWarpSize);
+
+    // Lanes write out in increasing lane order within a warp iteration
+    for (uint32_t lane = 0; lane < numLanes; ++lane) {
+      const auto& l = lookup[in[start + lane]];
+
+      StateT s = laneState[lane];
+
+      if (s >= Info::getPdf(l) * kStateCheckMul) {
+        out[outOffset++] = EncodedT(s);
+        s >>= Info::kEncodedBits;
+      }
+
+      // (s / pdf) via the same mul and shift as the GPU
+      laneState[lane] = ansEncodeState<ProbBits>(s, l);
+    }
+  }
+
+  std::memcpy(state->warpState, laneState, sizeof(laneState));
+
+  return outOffset;
+}
+
+// Decodes a single block of data produced by ansEncodeBlockCpu or
+// ansEncodeWarpBlock. `in` points to the start of the compressed words for
+// the block
+template <int ProbBits, bool Wide = false>
+void ansDecodeBlockCpu(
+    const typename ANSStateInfo<Wide>::WarpState* __restrict__ state,
+    uint32_t uncompressedWords,
+    uint32_t compressedWords,
+    const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
+    const TableT* __restrict__ table,
+    ANSDecodedT* __restrict__ out) {
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
+  constexpr StateT StateMask = (StateT(1) << ProbBits) - StateT(1);
+
+  StateT laneState[kWarpSize];
+  std::memcpy(laneState, state->warpState, sizeof(laneState));
+
+  // We read the compressed words in reverse
+  in += compressedWords;
+
+  // Only the lanes covering the remainder of the data were valid in the last
+  // warp iteration of the encoder, which we handle first
+  uint32_t remainder = uncompressedWords % kWarpSize;
+  uint32_t offset = uncompressedWords - remainder;
+  uint32_t numLanes = remainder ? remainder : kWarpSize;
+
+  if (remainder == 0) {
+    if (offset == 0) {
+      return;
+    }
+
+    offset -= kWarpSize;
+  }
+
+  while (true) {
+    // The highest lane that reads takes the last remaining compressed word
+    for (int lane = numLanes - 1; lane >= 0; --lane) {
+      StateT s = laneState[lane];
+
+      uint32_t sym;
+      uint32_t pdf;
+      uint32_t sMinusCdf;
+      ansDecodeLookup<ProbBits>(
+          table, uint32_t(s & StateMask), sym, pdf, sMinusCdf);
+
+      out[offset + lane] = sym;
+      s = pdf * (s >> ProbBits) + StateT(sMinusCdf);
+
+      if (s < Info::getMinState()) {
+        s = (s << Info::kEncodedBits) + StateT(*(--in));
+      }
+
+      laneState[lane] = s;
+    }
+
+    if (offset == 0) {
+      break;
+    }
+
+    offset -= kWarpSize;
+    numLanes = kWarpSize;
+  }
+}
+
+// Encodes a single block of data with contexts, as ansEncodeBlockCpu does but
+// with each lane coding a stripe of the block (see getContextStripeSize), and
+// each symbol coded with the lookup of the context of the following symbol of
+// its stripe.
+// Returns the number of compressed words (Info::EncodedT) written
+template <int ProbBits, bool Wide = false>
+uint32_t ansEncodeContextBlockCpu(
+    const ANSDecodedT* __restrict__ in,
+    uint32_t inWords,
+    // size numContexts x kNumSymbols
+    const uint4* __restrict__ table,
+    uint32_t numContexts,
+    // size kNumSymbols
+    const uint8_t* __restrict__ symbolContext,
+    typename ANSStateInfo<Wide>::WarpState* __restrict__ state,
+    typename ANSStateInfo<Wide>::EncodedT* __restrict__ out) {
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
+  using EncodedT = typename Info::EncodedT;
+
+  constexpr StateT kStateCheckMul = StateT(1)
+      << (Info::kStateBits - ProbBits);
+
+  auto lookup =
+      std::vector<typename Info::EncodeLookup>(numContexts * kNumSymbols);
+  for (uint32_t i = 0; i < numContexts * kNumSymbols; ++i) {
+    lookup[i] = Info::makeEncodeLookup(table[i]);
+  }
+
+  StateT laneState[kWarpSize];
+  for (int i = 0; i < kWarpSize; ++i) {
+    laneState[i] = Info::getStartState();
+  }
+
+  uint32_t stripe = getContextStripeSize(inWords);
+  uint32_t outOffset = 0;
+
+  for (uint32_t k = 0; k < stripe; ++k) {
+    // The lanes whose stripe covers k are a prefix of the warp, and write out
+    // in increasing lane order
+    for (uint32_t pos = k; pos < inWords; pos += stripe) {
+      uint32_t lane = pos / stripe;
+
+      // The last symbol of a stripe is coded in context 0's neighbor
+      ANSDecodedT next =
+          (k + 1 < stripe && pos + 1 < inWords) ? in[pos + 1] : 0;
+      const auto& l = lookup[symbolContext[next] * kNumSymbols + in[pos]];
+
+      StateT s = laneState[lane];
+
+      if (s >= Info::getPdf(l) * kStateCheckMul) {
+        out[outOffset++] = EncodedT(s);
+        s >>= Info::kEncodedBits;
+      }
+
+      laneState[lane] = ansEncodeState<ProbBits>(s, l);
+    }
+  }
+
+  std::memcpy(state->warpState, laneState, sizeof(laneState));
+
+  return outOffset;
+}
+
+// Decodes a single block of data produced by ansEncodeContextBlockCpu. `table`
+// holds the decoding table of each context, at a stride of
+// getANSDecodeTableWords(ProbBits)
+template <int ProbBits, bool Wide = false>
+void ansDecodeContextBlockCpu(
+    const typename ANSStateInfo<Wide>::WarpState* __restrict__ state,
+    uint32_t uncompressedWords,
+    uint32_t compressedWords,
+    const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
+    const TableT* __restrict__ table,
+    // size kNumSymbols
+    const uint8_t* __restrict__ symbolContext,
+    ANSDecodedT* __restrict__ out) {
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
+  constexpr StateT StateMask = (StateT(1) << ProbBits) - StateT(1);
+  constexpr uint32_t kTableWords = getANSDecodeTableWords(ProbBits);
+
+  StateT laneState[kWarpSize];
+  std::memcpy(laneState, state->warpState, sizeof(laneState));
+
+  // The symbol last decoded by each lane, which follows the one it decodes
+  // next
+  ANSDecodedT laneNext[kWarpSize] = {};
+
+  // We read the compressed words in reverse
+  in += compressedWords;
+
+  uint32_t stripe = getContextStripeSize(uncompressedWords);
+
+  for (int k = int(stripe) - 1; k >= 0; --k) {
+    // The highest lane that reads takes the last remaining compressed word
+    uint32_t numLanes = divUp(uncompressedWords - k, stripe);
+
+    for (int lane = numLanes - 1; lane >= 0; --lane) {
+      StateT s = laneState[lane];
+
+      uint32_t sym;
+      uint32_t pdf;
+      uint32_t sMinusCdf;
+      ansDecodeLookup<ProbBits>(
+          table + symbolContext[laneNext[lane]] * kTableWords,
+          uint32_t(s & StateMask),
+          sym,
+          pdf,
+          sMinusCdf);
+
+      out[lane * stripe + k] = sym;
+      laneNext[lane] = sym;
+      s = pdf * (s >> ProbBits) + StateT(sMinusCdf);
+
+      if (s < Info::getMinState()) {
+        s = (s << Info::kEncodedBits) + StateT(*(--in));
+      }
+
+      laneState[lane] = s;
+    }
+  }
+}
+
+using ANSDecodeBlockCpuFn = void (*)(
+    const ANSWarpState* __restrict__ state,
+    uint32_t uncompressedWords,
+    uint32_t compressedWords,
+    const ANSEncodedT* __restrict__ in,
+    const TableT* __restrict__ table,
+    ANSDecodedT* __restrict__ out);
+
+// Returns a block decoder equivalent to ansDecodeBlockCpu<probBits> that is
+// vectorized using the given instruction set (which must be supported by the
+// host CPU); lanes of the warp map to SIMD lanes, with the renormalization
+// reads routed to lanes via a permute (AVX2) or expand (AVX-512). The
+// vectorized decoders may read (but do not use) up to 32 bytes before the
+// start of the block data, which is always valid within an archive. Only
+// archives with 32 bit states are handled; wide state archives are decoded
+// with ansDecodeBlockCpu<probBits, true>
+ANSDecodeBlockCpuFn getANSDecodeBlockCpu(int probBits, CpuSimdLevel level);
+
+} // namespace dietgpu
@@ -8,6 +8,10 @@
 #pragma once
 
 #include <cuda.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "dietgpu/utils/StackDeviceMemory.h"
 
 namespace dietgpu {
@@ -19,18 +23,185 @@ constexpr int kANSRequiredAlignment = 4;
 // not specified
 constexpr int kANSDefaultProbBits = 10;
 
-uint32_t getMaxCompressedSize(uint32_t uncompressedBytes);
+// Supported range of probability quantization bits
+constexpr int kANSMinProbBits = 9;
+constexpr int kANSMaxProbBits = 14;
+
+inline bool isValidANSProbBits(int probBits) {
+  return probBits >= kANSMinProbBits && probBits <= kANSMaxProbBits;
+}
+
+// Default size in bytes of the blocks that the input is divided into, each of
+// which is independently coded by a single warp, if an alternative is not
+// specified
+constexpr uint32_t kANSDefaultBlockSize = 4096;
+
+// Supported range of block sizes; the block size must be a power of 2 in this
+// range
+constexpr uint32_t kANSMinBlockSize = 1024;
+constexpr uint32_t kANSMaxBlockSize = 65536;
+
+inline bool isValidANSBlockSize(uint32_t blockSize) {
+  return blockSize >= kANSMinBlockSize && blockSize <= kANSMaxBlockSize &&
+      (blockSize & (blockSize - 1)) == 0;
+}
+
+// Maximum number of pdfs that an archive may hold: one per context for
+// order-1 context modeling, or one per segment of blocks (see
+// ANSCodecConfig::numContexts and ANSCodecConfig::maxSegments)
+constexpr uint32_t kANSMaxTables = 16;
+constexpr uint32_t kANSMaxContexts = kANSMaxTables;
+constexpr uint32_t kANSMaxSegments = kANSMaxTables;
+
+// Maximum element width in bytes of the byte shuffle (see
+// ANSCodecConfig::shuffleWidth). A shuffled input has a segment per plane, so
+// this is at most kANSMaxSegments
+constexpr uint32_t kANSMaxShuffleWidth = 16;
+static_assert(kANSMaxShuffleWidth <= kANSMaxSegments, "");
+
+inline bool isValidANSShuffleWidth(uint32_t width) {
+  return width >= 1 && width <= kANSMaxShuffleWidth &&
+      (width & (width - 1)) == 0;
+}
+
+// Size in bytes of the blocks of the uncompressed data that each have their
+// own checksum (see ANSCodecConfig::useBlockChecksum), independent of the ANS
+// block size
+constexpr uint32_t kANSChecksumBlockSize = 4096;
+
+// Returns the maximum possible compressed size in bytes of `uncompressedBytes`
+// bytes of input compressed using blocks of size `blockSize`, with wide states
+// if `useWideState`, with up to `numTables` pdfs (see
+// ANSCodecConfig::getMaxTables) and with block checksums if
+// `useBlockChecksum`. As blocks that would not compress are stored raw, this
+// is the input size plus the archive overhead
+uint32_t getMaxCompressedSize(
+    uint32_t uncompressedBytes,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false,
+    uint32_t numTables = 1,
+    bool useBlockChecksum = false);
+
+/// A pre-trained symbol probability table shared by many archives (see
+/// ANSCodecConfig::dictionary). Archives compressed with a dictionary do not
+/// embed their own pdf, and instead record the dictionary ID, so the same
+/// dictionary must be provided for decompression.
+/// The prepared encoding and decoding tables are kept on the host, and are
+/// uploaded once to each device on which they are used, so that compression
+/// and decompression with a dictionary skip the statistics and table
+/// construction passes altogether.
+/// Instances must outlive all work using them on any stream.
+class ANSDictionary {
+ public:
+  /// Creates a dictionary from a pdf of kNumSymbols (256) quantized
+  /// probabilities summing to 2^probBits. As the dictionary must be able to
+  /// encode any data, every symbol must have a non-zero probability (see
+  /// ansTrainDictionaryCpu). As this reserves at least 256 / 2^probBits of
+  /// the probability for rare symbols, dictionaries favor higher probBits
+  ANSDictionary(int probBits, const uint16_t* probs);
+  ANSDictionary(const ANSDictionary&) = delete;
+  ANSDictionary& operator=(const ANSDictionary&) = delete;
+  ~ANSDictionary();
+
+  int getProbBits() const {
+    return probBits_;
+  }
+
+  /// A hash of the precision and pdf which identifies this dictionary in the
+  /// archives that use it
+  uint32_t getId() const {
+    return id_;
+  }
+
+  /// The pdf (256 entries)
+  const uint16_t* getSymbolProbs() const {
+    return probs_.data();
+  }
+
+  /// The host encoding table of {pdf, cdf, div_m1, div_shift} (256 entries)
+  const uint4* getEncodeTable() const {
+    return encodeTable_.data();
+  }
+
+  /// The host decoding table (of getANSDecodeTableWords(probBits) words)
+  const uint32_t* getDecodeTable() const {
+    return decodeTable_.data();
+  }
+
+  /// The tables resident on the current device, which are uploaded on first
+  /// use (ordered with respect to all streams on the device)
+  const uint4* getEncodeTableDevice(cudaStream_t stream) const;
+  const uint32_t* getDecodeTableDevice(cudaStream_t stream) const;
+
+ private:
+  /// Returns the device allocation holding the encoding table followed by the
+  /// decoding table on the current device, uploading it if needed
+  const uint8_t* getDeviceTables(cudaStream_t stream) const;
+
+  int probBits_;
+  uint32_t id_;
+  std::vector<uint16_t> probs_;
+  std::vector<uint4> encodeTable_;
+  std::vector<uint32_t> decodeTable_;
+
+  /// Protects deviceTables_
+  mutable std::mutex mutex_;
+
+  /// Device -> resident tables on that device, which free themselves (so that
+  /// the host-only parts of the dictionary do not require the CUDA runtime)
+  mutable std::unordered_map<int, std::shared_ptr<uint8_t>> deviceTables_;
+};
 
 struct ANSCodecConfig {
-  inline ANSCodecConfig() : probBits(kANSDefaultProbBits), useChecksum(false) {}
-
-  explicit inline ANSCodecConfig(int pb, bool checksum = false)
-      : probBits(pb), useChecksum(checksum) {}
+  inline ANSCodecConfig()
+      : probBits(kANSDefaultProbBits),
+        useChecksum(false),
+        blockSize(kANSDefaultBlockSize),
+        useWideState(false),
+        dictionary(nullptr),
+        numContexts(1),
+        maxSegments(1),
+        shuffleWidth(1),
+        useBlockChecksum(false) {}
+
+  explicit inline ANSCodecConfig(
+      int pb,
+      bool checksum = false,
+      uint32_t bs = kANSDefaultBlockSize,
+      bool wideState = false,
+      const ANSDictionary* dict = nullptr,
+      uint32_t contexts = 1,
+      uint32_t segments = 1,
+      uint32_t shuffle = 1,
+      bool blockChecksum = false)
+      : probBits(pb),
+        useChecksum(checksum),
+        blockSize(bs),
+        useWideState(wideState),
+        dictionary(dict),
+        numContexts(contexts),
+        maxSegments(segments),
+        shuffleWidth(shuffle),
+        useBlockChecksum(blockChecksum) {}
+
+  // The most segments that an input may be partitioned into; shuffled input
+  // has at least one per byte plane
+  inline uint32_t getMaxSegments() const {
+    return maxSegments > shuffleWidth ? maxSegments : shuffleWidth;
+  }
+
+  // The most pdfs that an archive compressed with this config may hold
+  inline uint32_t getMaxTables() const {
+    return numContexts > getMaxSegments() ? numContexts : getMaxSegments();
+  }
 
   // What the ANS probability accuracy is; all symbols have quantized
   // probabilities of 1/2^probBits.
-  // 9, 10, 11 are only valid values. When in doubt, use 10 (e.g., all symbol
-  // probabilities are one of {1/1024, 2/1024, ..., 1023/1024, 1024/1024})
+  // 9 to 14 are the only valid values. When in doubt, use 10 (e.g., all symbol
+  // probabilities are one of {1/1024, 2/1024, ..., 1023/1024, 1024/1024}).
+  // Precisions above 11 benefit highly skewed distributions, where the
+  // probability of the rare symbols is otherwise overstated, but use a decoding
+  // table with a two step lookup
   int probBits;
 
   // If true, we calculate a checksum on the uncompressed input data to
@@ -40,6 +211,86 @@ struct ANSCodecConfig {
   // This is an optional feature useful if DietGPU data will be stored
   // persistently on disk.
   bool useChecksum;
+
+  // Size in bytes of the independently coded blocks of the input (compression
+  // only; the block size is recorded in the archive, and decompression handles
+  // archives of any block size). Must satisfy isValidANSBlockSize.
+  // Larger blocks reduce the per-block overhead (the 32 warp lane states and
+  // the block index entry, 136 bytes per block) but expose less parallelism
+  // for small inputs.
+  // Compressed output bounds must be computed with the same block size via
+  // getMaxCompressedSize(size, blockSize)
+  uint32_t blockSize;
+
+  // If true, the rANS state of each warp lane is 64 bits and is renormalized
+  // by 32 bit words, rather than a 32 bit state renormalized by 16 bit words.
+  // Renormalization then happens half as often, which benefits highly skewed
+  // (low entropy) data, at the cost of 128 more bytes of state per block.
+  // Like probBits, this is recorded in the archive and must match upon
+  // decompression
+  bool useWideState;
+
+  // Optional (can be null): if present, all batch members are compressed with
+  // this shared pdf rather than their own, which saves the pdf in each
+  // archive and the statistics pass over the input. This pays off for small
+  // inputs of similar distributions (e.g., many tensors of the same kind).
+  // dictionary->getProbBits() must equal probBits, and decompression must be
+  // given the same dictionary
+  const ANSDictionary* dictionary;
+
+  // Order-1 context modeling (compression only; the contexts are recorded in
+  // the archive). If greater than 1, each symbol is coded with one of up to
+  // numContexts pdfs, selected by the neighboring symbol: the numContexts - 1
+  // most frequent symbols each have their own context, and all other symbols
+  // share one. This captures structure above the byte level (e.g., the
+  // correlation between the bytes of float16 words, or of successive
+  // exponents) at the cost of a pdf per context in the archive, a decoding
+  // table per context and a dependent table selection per symbol.
+  // At most kANSMaxContexts; cannot be combined with a dictionary.
+  // Context modeled archives are at present coded by the host codec (see
+  // CpuANSCodec.h) only, as a reference for its ratio and throughput
+  uint32_t numContexts;
+
+  // Segmented statistics (compression only). If greater than 1, the blocks of
+  // each input are partitioned into up to maxSegments contiguous segments,
+  // each coded with its own pdf, with the boundaries chosen to minimize the
+  // estimated size (entropy plus pdf size) from per-block statistics; each
+  // block index entry records the segment of its block. This benefits inputs
+  // that concatenate data of different distributions (e.g., the exponents of
+  // many layers of a model), where a single pdf fits none of them well.
+  // At most kANSMaxSegments; cannot be combined with a dictionary or
+  // contexts. Like contexts, segmented archives are at present coded by the
+  // host codec only
+  uint32_t maxSegments;
+
+  // Byte shuffle (compression only; the width is recorded in the archive). If
+  // greater than 1, the input is viewed as elements of shuffleWidth bytes (2,
+  // 4, 8 or 16; a trailing partial element is left in place) and transposed
+  // into shuffleWidth planes, each holding the same byte of every element,
+  // before coding; decompression transposes it back. Structured data whose
+  // byte positions have different distributions (e.g., int32 ids, int64
+  // offsets or packed structs) then forms runs of similar symbols. The input
+  // is coded with up to getMaxSegments() segments, so that each plane may
+  // have its own pdf, and blocks that would not shrink (e.g., of a plane of
+  // near uniform low order bytes) are stored raw (see ANSBlockMode).
+  // Cannot be combined with a dictionary or contexts. Like segments, shuffled
+  // archives are at present coded by the host codec only
+  uint32_t shuffleWidth;
+
+  // If true, a CRC32C of each kANSChecksumBlockSize block of the uncompressed
+  // input, followed by a CRC32C of the whole input, is stored after the
+  // compressed data. Decompression recomputes them and reports the blocks
+  // that do not match (see ANSDecodeStatus::failedBlocks), so that data
+  // stored or transferred in pieces can be repaired by re-fetching only
+  // those. This detects far more corruptions than the 8 bit useChecksum, and
+  // the two may be combined. The checksums cover the data as given, before
+  // any delta or shuffle. The host codec computes the CRCs using the SSE4.2
+  // crc32 instruction where available (see Crc32c.h), and always verifies
+  // them on decompression. The GPU codec computes each block's CRC in a CUDA
+  // block, combining those of 32 byte pieces (see GpuChecksum.cuh), and
+  // verifies them on decompression only if this is set, as reporting the
+  // failed blocks synchronizes with the stream
+  bool useBlockChecksum;
 };
 
 enum class ANSDecodeError : uint32_t {
@@ -56,6 +307,13 @@ struct ANSDecodeStatus {
 
   // Error-specific information for the batch
   std::vector<std::pair<int, std::string>> errorInfo;
+
+  // The batch members whose block checksums did not match (see
+  // ANSCodecConfig::useBlockChecksum), each with the indices of its failed
+  // kANSChecksumBlockSize blocks of decompressed data in increasing order.
+  // A member may be listed with no blocks if only its whole-data checksum
+  // did not match, i.e., the checksums themselves were corrupted
+  std::vector<std::pair<int, std::vector<uint32_t>>> failedBlocks;
 };
 
 //
@@ -125,7 +383,14 @@ void ansEncodeBatchPointer(
     uint32_t* outSize_dev,
 
     // stream on the current device on which this runs
-    cudaStream_t stream);
+    cudaStream_t stream,
+
+    // Optional (can be null): host array with addresses of device pointers to
+    // a reference for each batch member, of the same size as in[i]. A member
+    // with a reference is coded in delta mode, as its XOR with the reference,
+    // and a nullptr entry codes the member as is. histogram_dev must be null
+    // if any reference is given
+    const void** ref = nullptr);
 
 void ansEncodeBatchSplitSize(
     StackDeviceMemory& res,
@@ -166,6 +431,16 @@ void ansEncodeBatchSplitSize(
 //
 // Decode
 //
+// Archives that the GPU decoder does not handle (those using contexts,
+// segments or shuffling, which are at present decoded by the host codec only)
+// or that do not match the config (probBits, useWideState or dictionary) are
+// not decoded, and are reported as failures in outSuccess_dev.
+// Delta archives (see ansEncodeBatchPointer) are decoded by the functions
+// taking a `ref` host array of device pointers, with ref[i] the reference of
+// archive i, of its uncompressed size, or nullptr if archive i is not in delta
+// mode. An archive in delta mode without a reference, or with a reference but
+// not in delta mode, is reported as a failure
+//
 
 ANSDecodeStatus ansDecodeBatchStride(
     StackDeviceMemory& res,
@@ -260,7 +535,11 @@ ANSDecodeStatus ansDecodeBatchPointer(
     uint32_t* outSize_dev,
 
     // stream on the current device on which this runs
-    cudaStream_t stream);
+    cudaStream_t stream,
+
+    // Optional (can be null): host array with addresses of device pointers to
+    // the reference of each delta archive, or nullptr for the other archives
+    const void** ref = nullptr);
 
 ANSDecodeStatus ansDecodeBatchSplitSize(
     StackDeviceMemory& res,
@@ -302,6 +581,48 @@ ANSDecodeStatus ansDecodeBatchSplitSize(
     // stream on the current device on which this runs
     cudaStream_t stream);
 
+// Random-access decode: decompresses only bytes
+// [rangeOffset[i], rangeOffset[i] + rangeSize[i]) of each archive into out[i].
+// Only the blocks covering the range are decoded, located via the per-block
+// index in the archive, with the first and last of them trimmed to the range.
+// The checksums cover the entire data, so config.useChecksum and
+// config.useBlockChecksum must be false
+void ansDecodeRangeBatchPointer(
+    StackDeviceMemory& res,
+
+    // Expected compression configuration (we verify this upon decompression)
+    const ANSCodecConfig& config,
+
+    // Number of separate, independent decompression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of device pointers corresponding to compressed
+    // inputs
+    const void** in,
+
+    // Host arrays with the byte offset and size of the range to decode from
+    // each batch member
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+
+    // Host array with addresses of device pointers, each to a region of memory
+    // of at least rangeSize[i] bytes
+    void** out,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a device pointer to an array of length numInBatch,
+    // with true/false for whether or not the range could be decoded (it must
+    // lie within the data)
+    uint8_t* outSuccess_dev,
+
+    // stream on the current device on which this runs
+    cudaStream_t stream,
+
+    // Optional (can be null): host array with addresses of device pointers to
+    // the reference of each delta archive (covering the whole of its data, not
+    // just the range), or nullptr for the other archives
+    const void** ref = nullptr);
+
 //
 // Information
 //
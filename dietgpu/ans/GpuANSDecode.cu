@@ -53,7 +53,11 @@ ANSDecodeStatus ansDecodeBatchPointer(
     const uint32_t* outCapacity,
     uint8_t* outSuccess_dev,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    const void** ref) {
+  auto ref_dev =
+      res.copyAlloc<void*>(stream, (void**)ref, ref ? numInBatch : 0);
+
   // If the batch size is <= kBSLimit, we avoid cudaMemcpy and send all data at
   // kernel launch
   constexpr int kBSLimit = 128;
@@ -72,7 +76,8 @@ ANSDecodeStatus ansDecodeBatchPointer(
         outProvider,
         outSuccess_dev,
         outSize_dev,
-        stream);
+        stream,
+        ref ? ref_dev.data() : nullptr);
   }
 
   // Otherwise, we have to perform h2d copies
@@ -116,7 +121,8 @@ ANSDecodeStatus ansDecodeBatchPointer(
       outProvider,
       outSuccess_dev,
       outSize_dev,
-      stream);
+      stream,
+      ref ? ref_dev.data() : nullptr);
 }
 
 ANSDecodeStatus ansDecodeBatchSplitSize(
@@ -192,4 +198,47 @@ ANSDecodeStatus ansDecodeBatchSplitSize(
       stream);
 }
 
+void ansDecodeRangeBatchPointer(
+    StackDeviceMemory& res,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    uint8_t* outSuccess_dev,
+    cudaStream_t stream,
+    const void** ref) {
+  CHECK(!config.useChecksum)
+      << "the checksum cannot be verified when decoding a range";
+  CHECK(!config.useBlockChecksum)
+      << "block checksums cannot be verified when decoding a range";
+
+  auto range = std::vector<uint2>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    range[i] = make_uint2(rangeOffset[i], rangeSize[i]);
+  }
+
+  auto range_dev = res.copyAlloc<uint2>(stream, range);
+  auto in_dev = res.copyAlloc<void*>(stream, (void**)in, numInBatch);
+  auto out_dev = res.copyAlloc<void*>(stream, out, numInBatch);
+  auto ref_dev =
+      res.copyAlloc<void*>(stream, (void**)ref, ref ? numInBatch : 0);
+
+  auto inProvider = BatchProviderPointer(in_dev.data());
+  auto outProvider = BatchProviderRange<BatchProviderPointer>(
+      BatchProviderPointer(out_dev.data()), range_dev.data());
+
+  ansDecodeBatch(
+      res,
+      config,
+      numInBatch,
+      inProvider,
+      outProvider,
+      outSuccess_dev,
+      nullptr,
+      stream,
+      ref ? ref_dev.data() : nullptr);
+}
+
 } // namespace dietgpu
@@ -26,35 +26,9 @@
 
 namespace dietgpu {
 
-using TableT = uint32_t;
-
-// We are limited to 11 bits of probability resolution
-// (worst case, prec = 12, pdf == 2^12, single symbol. 2^12 cannot be
-// represented in 12 bits)
-inline __device__ TableT
-packDecodeLookup(uint32_t sym, uint32_t pdf, uint32_t cdf) {
-  static_assert(sizeof(ANSDecodedT) == 1, "");
-  // [31:20] cdf
-  // [19:8] pdf
-  // [7:0] symbol
-  return (cdf << 20) | (pdf << 8) | sym;
-}
-
-inline __device__ void
-unpackDecodeLookup(TableT v, uint32_t& sym, uint32_t& pdf, uint32_t& cdf) {
-  // [31:20] cdf
-  // [19:8] pdf
-  // [7:0] symbol
-  sym = v & 0xffU;
-  v >>= 8;
-  pdf = v & 0xfffU;
-  v >>= 12;
-  cdf = v;
-}
-
-template <int ProbBits>
+template <int ProbBits, bool Wide>
 __device__ void decodeOneWarp(
-    ANSStateT& state,
+    typename ANSStateInfo<Wide>::StateT& state,
 
     // Start offset where this warp is reading from the
     // compressed input. As a variable number of lanes
@@ -63,7 +37,7 @@ __device__ void decodeOneWarp(
     // the last offset, if any, this warp will be reading rom.
     uint32_t compressedOffset,
 
-    const ANSEncodedT* __restrict__ in,
+    const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
 
     // Shared memory LUTs
     const TableT* lookup,
@@ -73,21 +47,23 @@ __device__ void decodeOneWarp(
 
     // Output: decoded symbol for this iteration
     ANSDecodedT& outSym) {
-  constexpr ANSStateT StateMask = (ANSStateT(1) << ProbBits) - ANSStateT(1);
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
+  constexpr StateT StateMask = (StateT(1) << ProbBits) - StateT(1);
 
   auto s_bar = state & StateMask;
 
   uint32_t sym;
   uint32_t pdf;
   uint32_t sMinusCdf;
-  unpackDecodeLookup(lookup[s_bar], sym, pdf, sMinusCdf);
+  ansDecodeLookup<ProbBits>(lookup, uint32_t(s_bar), sym, pdf, sMinusCdf);
 
   // We always write a decoded value
   outSym = sym;
-  state = pdf * (state >> ProbBits) + ANSStateT(sMinusCdf);
+  state = pdf * (state >> ProbBits) + StateT(sMinusCdf);
 
   // We only sometimes read a new encoded value
-  bool read = state < kANSMinState;
+  bool read = state < Info::getMinState();
   auto vote = __ballot_sync(0xffffffff, read);
   // We are reading in the same order as we wrote, except by decrementing from
   // compressedOffset, so we need to count down from the highest lane in the
@@ -97,17 +73,17 @@ __device__ void decodeOneWarp(
   if (read) {
     // auto v = in[compressedOffset - prefix];
     auto v = in[-prefix];
-    state = (state << kANSEncodedBits) + ANSStateT(v);
+    state = (state << Info::kEncodedBits) + StateT(v);
   }
 
   // how many values we actually read from the compressed input
   outNumRead = __popc(vote);
 }
 
-template <int ProbBits>
+template <int ProbBits, bool Wide>
 __device__ void decodeOnePartialWarp(
     bool valid,
-    ANSStateT& state,
+    typename ANSStateInfo<Wide>::StateT& state,
 
     // Start offset where this warp is reading from the
     // compressed input. As a variable number of lanes
@@ -116,7 +92,7 @@ __device__ void decodeOnePartialWarp(
     // the last offset, if any, this warp will be reading rom.
     uint32_t compressedOffset,
 
-    const ANSEncodedT* __restrict__ in,
+    const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
 
     // Shared memory LUTs
     const TableT* lookup,
@@ -126,22 +102,24 @@ __device__ void decodeOnePartialWarp(
 
     // Output: decoded symbol for this iteration (only if valid)
     ANSDecodedT& outSym) {
-  constexpr ANSStateT StateMask = (ANSStateT(1) << ProbBits) - ANSStateT(1);
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
+  constexpr StateT StateMask = (StateT(1) << ProbBits) - StateT(1);
 
   auto s_bar = state & StateMask;
 
   uint32_t sym;
   uint32_t pdf;
   uint32_t sMinusCdf;
-  unpackDecodeLookup(lookup[s_bar], sym, pdf, sMinusCdf);
+  ansDecodeLookup<ProbBits>(lookup, uint32_t(s_bar), sym, pdf, sMinusCdf);
 
   if (valid) {
     outSym = sym;
-    state = pdf * (state >> ProbBits) + ANSStateT(sMinusCdf);
+    state = pdf * (state >> ProbBits) + StateT(sMinusCdf);
   }
 
   // We only sometimes read a new encoded value
-  bool read = valid && (state < kANSMinState);
+  bool read = valid && (state < Info::getMinState());
   auto vote = __ballot_sync(0xffffffff, read);
   // We are reading in the same order as we wrote, except by decrementing from
   // compressedOffset, so we need to count down from the highest lane in the
@@ -151,20 +129,20 @@ __device__ void decodeOnePartialWarp(
   if (read) {
     // auto v = in[compressedOffset - prefix];
     auto v = in[-prefix];
-    state = (state << kANSEncodedBits) + ANSStateT(v);
+    state = (state << Info::kEncodedBits) + StateT(v);
   }
 
   // how many values we actually read from the compressed input
   outNumRead = __popc(vote);
 }
 
-template <typename Writer, int ProbBits>
+template <typename Writer, int ProbBits, bool Wide>
 __device__ void ansDecodeWarpBlock(
     int laneId,
-    ANSStateT state,
+    typename ANSStateInfo<Wide>::StateT state,
     uint32_t uncompressedWords,
     uint32_t compressedWords,
-    const ANSEncodedT* __restrict__ in,
+    const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
     Writer& writer,
     const TableT* __restrict__ table) {
   // The compressed input may not be a whole multiple of a warp.
@@ -188,7 +166,7 @@ __device__ void ansDecodeWarpBlock(
     uint32_t numCompressedRead;
     ANSDecodedT sym;
 
-    decodeOnePartialWarp<ProbBits>(
+    decodeOnePartialWarp<ProbBits, Wide>(
         valid, state, compressedOffset, in, table, numCompressedRead, sym);
 
     if (valid) {
@@ -206,7 +184,7 @@ __device__ void ansDecodeWarpBlock(
     uint32_t numCompressedRead;
     ANSDecodedT sym;
 
-    decodeOneWarp<ProbBits>(
+    decodeOneWarp<ProbBits, Wide>(
         state, compressedOffset, in, table, numCompressedRead, sym);
 
     writer.write(uncompressedOffset + laneId, sym);
@@ -216,7 +194,12 @@ __device__ void ansDecodeWarpBlock(
   }
 }
 
-template <typename Writer, int ProbBits, int BlockSize, bool UseVec4>
+template <
+    typename Writer,
+    int ProbBits,
+    bool Wide,
+    int BlockSize,
+    bool UseVec4>
 struct ANSDecodeWarpFullBlock;
 
 // template <typename Writer, int ProbBits, int BlockSize>
@@ -271,13 +254,13 @@ struct ANSDecodeWarpFullBlock;
 // };
 
 // Non-vectorized full block implementation
-template <typename Writer, int ProbBits, int BlockSize>
-struct ANSDecodeWarpFullBlock<Writer, ProbBits, BlockSize, false> {
+template <typename Writer, int ProbBits, bool Wide, int BlockSize>
+struct ANSDecodeWarpFullBlock<Writer, ProbBits, Wide, BlockSize, false> {
   static __device__ void decode(
       int laneId,
-      ANSStateT state,
+      typename ANSStateInfo<Wide>::StateT state,
       uint32_t compressedWords,
-      const ANSEncodedT* __restrict__ in,
+      const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
       Writer& writer,
       const TableT* __restrict__ table) {
     in += compressedWords;
@@ -286,7 +269,7 @@ struct ANSDecodeWarpFullBlock<Writer, ProbBits, BlockSize, false> {
       ANSDecodedT sym;
       uint32_t numCompressedRead;
 
-      decodeOneWarp<ProbBits>(
+      decodeOneWarp<ProbBits, Wide>(
           state, compressedWords, in, table, numCompressedRead, sym);
 
       in -= numCompressedRead;
@@ -296,35 +279,112 @@ struct ANSDecodeWarpFullBlock<Writer, ProbBits, BlockSize, false> {
   }
 };
 
+// Decodes a full block, with the loop bounds specialized to each supported
+// block size; returns false if the block size is not one that we handle
+template <typename Writer, int ProbBits, bool Wide>
+__device__ bool ansDecodeWarpFullBlockDispatch(
+    uint32_t blockSize,
+    int laneId,
+    typename ANSStateInfo<Wide>::StateT state,
+    uint32_t compressedWords,
+    const typename ANSStateInfo<Wide>::EncodedT* __restrict__ in,
+    Writer& writer,
+    const TableT* __restrict__ table) {
+#define DECODE_FULL_BLOCK(BLOCK_SIZE)                                          \
+  case BLOCK_SIZE:                                                             \
+    ANSDecodeWarpFullBlock<Writer, ProbBits, Wide, BLOCK_SIZE, false>::decode( \
+        laneId, state, compressedWords, in, writer, table);                    \
+    return true
+
+  switch (blockSize) {
+    DECODE_FULL_BLOCK(1024);
+    DECODE_FULL_BLOCK(2048);
+    DECODE_FULL_BLOCK(4096);
+    DECODE_FULL_BLOCK(8192);
+    DECODE_FULL_BLOCK(16384);
+    DECODE_FULL_BLOCK(32768);
+    DECODE_FULL_BLOCK(65536);
+    default:
+      return false;
+  }
+
+#undef DECODE_FULL_BLOCK
+}
+
+// Returns whether the GPU decoder handles the format and features of an
+// archive. Archives using contexts, segments or shuffling are only decoded by
+// the host codec at present
+inline __device__ bool ansIsGpuDecodable(const ANSCoalescedHeader& header) {
+  return header.isValidMagicAndVersion() && header.getNumTables() == 1 &&
+      header.getShuffleWidth() == 1;
+}
+
+// Decodes a stored or constant block, whose data (if any) is the raw input
+template <typename Writer>
+__device__ void ansDecodeWarpRawBlock(
+    int laneId,
+    ANSBlockMode mode,
+    ANSDecodedT sym,
+    uint32_t uncompressedWords,
+    const ANSDecodedT* __restrict__ in,
+    Writer& writer) {
+  bool isConstant = mode == ANSBlockMode::Constant;
+
+  for (uint32_t i = laneId; i < uncompressedWords; i += kWarpSize) {
+    writer.write(i, isConstant ? sym : in[i]);
+  }
+}
+
 template <
     typename InProvider,
     typename OutProvider,
     int Threads,
     int ProbBits,
-    int BlockSize>
+    bool Wide>
 __global__ __launch_bounds__(128) void ansDecodeKernel(
     InProvider inProvider,
+    // [batch][tableStride] decoding tables
     const TableT* __restrict__ table,
+    // 0 if all batch members share a single (dictionary) table
+    uint32_t tableStride,
+    // The ANSDictionary::getId() of the dictionary, if tableStride == 0
+    uint32_t dictionaryId,
     OutProvider outProvider,
+    // Optional per-batch member reference for delta archives (see
+    // BatchDeltaWriter)
+    const void* const* __restrict__ ref,
     uint8_t* __restrict__ outSuccess,
     uint32_t* __restrict__ outSize) {
   int tid = threadIdx.x;
   auto batch = blockIdx.y;
+  auto curRef = ref ? ref[batch] : nullptr;
 
   // Interpret header as uint4
   auto headerIn = (const ANSCoalescedHeader*)inProvider.getBatchStart(batch);
-  headerIn->checkMagicAndVersion();
 
   auto header = *headerIn;
   auto numBlocks = header.getNumBlocks();
   auto totalUncompressedWords = header.getTotalUncompressedWords();
-
-  // Is the data what we expect?
-  assert(ProbBits == header.getProbBits());
-
-  // Do we have enough space for the decompressed data?
+  auto blockSize = header.getBlockSize();
+
+  // Is the data what we expect, and can we decode it? Archives that cannot
+  // be decoded, and delta archives without a reference (or a reference given
+  // for an archive not in delta mode), are reported as failures
+  bool supported = ansIsGpuDecodable(header) &&
+      ProbBits == header.getProbBits() && Wide == header.getUseWideState() &&
+      header.getUseDictionary() == (tableStride == 0) &&
+      (tableStride != 0 || header.getDictionaryId() == dictionaryId) &&
+      header.getUseDelta() == (curRef != nullptr);
+
+  // The part of the data that we decode, which is all of it unless the output
+  // provider restricts it to a range
   auto uncompressedBytes = totalUncompressedWords * sizeof(ANSDecodedT);
-  bool success = outProvider.getBatchSize(batch) >= uncompressedBytes;
+  auto range = getBatchOutputRange(outProvider, batch, uncompressedBytes);
+
+  // Does the range lie within the data, and do we have enough space for it?
+  bool success = supported && range.x <= uncompressedBytes &&
+      range.y <= uncompressedBytes - range.x &&
+      outProvider.getBatchSize(batch) >= range.y;
 
   if (blockIdx.x == 0 && tid == 0) {
     if (outSuccess) {
@@ -332,7 +392,7 @@ __global__ __launch_bounds__(128) void ansDecodeKernel(
     }
 
     if (outSize) {
-      outSize[batch] = uncompressedBytes;
+      outSize[batch] = range.y;
     }
   }
 
@@ -341,25 +401,26 @@ __global__ __launch_bounds__(128) void ansDecodeKernel(
   }
 
   // Initialize symbol, pdf, cdf tables
-  constexpr int kBuckets = 1 << ProbBits;
-  __shared__ TableT lookup[kBuckets];
+  constexpr int kTableWords = getANSDecodeTableWords(ProbBits);
+  __shared__ __align__(16) TableT lookup[kTableWords];
 
   {
     uint4* lookup4 = (uint4*)lookup;
-    const uint4* table4 = (const uint4*)(table + batch * (1 << ProbBits));
-
-    static_assert(isEvenDivisor(kBuckets, Threads * 4), "");
-    for (int j = 0;
-         // loading by uint4 words
-         j < kBuckets / (Threads * (sizeof(uint4) / sizeof(TableT)));
-         ++j) {
-      lookup4[j * Threads + tid] = table4[j * Threads + tid];
+    const uint4* table4 = (const uint4*)(table + batch * tableStride);
+
+    // loading by uint4 words
+    constexpr int kTableWords4 = kTableWords / (sizeof(uint4) / sizeof(TableT));
+    static_assert(kTableWords4 >= Threads, "");
+
+    for (int j = tid; j < kTableWords4; j += Threads) {
+      lookup4[j] = table4[j];
     }
   }
 
   __syncthreads();
 
-  auto writer = outProvider.getWriter(batch);
+  using Writer = BatchDeltaWriter<typename OutProvider::Writer>;
+  auto writer = Writer(outProvider.getWriter(batch), curRef);
 
   // warp id taking into account warps in the current block
   // do this so the compiler knows it is warp uniform
@@ -369,28 +430,55 @@ __global__ __launch_bounds__(128) void ansDecodeKernel(
   int warpsPerGrid = gridDim.x * Threads / kWarpSize;
   int laneId = getLaneId();
 
-  for (int block = globalWarpId; block < numBlocks; block += warpsPerGrid) {
+  using Info = ANSStateInfo<Wide>;
+
+  // Only the blocks covering the range are decoded
+  uint32_t firstBlock = range.x / blockSize;
+  uint32_t endBlock = range.y ? divUp(range.x + range.y, blockSize) : 0;
+
+  for (int block = firstBlock + globalWarpId; block < endBlock;
+       block += warpsPerGrid) {
     // Load state
-    ANSStateT state = headerIn->getWarpStates()[block].warpState[laneId];
+    auto state = headerIn->template getWarpStates<typename Info::WarpState>()
+                     [block]
+                         .warpState[laneId];
 
     // Load per-block size data
     auto blockWords = headerIn->getBlockWords(numBlocks)[block];
-    uint32_t uncompressedWords = (blockWords.x >> 16);
-    uint32_t compressedWords = (blockWords.x & 0xffff);
-    uint32_t blockCompressedWordStart = blockWords.y;
+    uint32_t uncompressedWords = getBlockUncompressedWords(blockWords);
+    uint32_t compressedWords = getBlockCompressedWords(blockWords);
+    uint32_t blockCompressedWordStart = header.getBlockWordStart(blockWords);
 
     // Get block addresses for encoded/decoded data
     auto blockDataIn =
-        headerIn->getBlockDataStart(numBlocks) + blockCompressedWordStart;
+        headerIn->template getBlockDataStart<typename Info::EncodedT>(
+            numBlocks) +
+        blockCompressedWordStart;
+
+    writer.setBlock(block, blockSize);
 
-    writer.setBlock(block);
+    auto mode = headerIn->getBlockMode(blockWords);
+    if (mode != ANSBlockMode::ANS) {
+      ansDecodeWarpRawBlock(
+          laneId,
+          mode,
+          getBlockConstantSymbol(blockWords),
+          uncompressedWords,
+          (const ANSDecodedT*)blockDataIn,
+          writer);
+      continue;
+    }
 
-    using Writer = typename OutProvider::Writer;
-    if (uncompressedWords == BlockSize) {
-      ANSDecodeWarpFullBlock<Writer, ProbBits, BlockSize, false>::decode(
-          laneId, state, compressedWords, blockDataIn, writer, lookup);
-    } else {
-      ansDecodeWarpBlock<Writer, ProbBits>(
+    if (uncompressedWords != blockSize ||
+        !ansDecodeWarpFullBlockDispatch<Writer, ProbBits, Wide>(
+            blockSize,
+            laneId,
+            state,
+            compressedWords,
+            blockDataIn,
+            writer,
+            lookup)) {
+      ansDecodeWarpBlock<Writer, ProbBits, Wide>(
           laneId,
           state,
           uncompressedWords,
@@ -412,27 +500,25 @@ __global__ void ansDecodeTable(
   int warpId = tid / kWarpSize;
   int laneId = getLaneId();
 
-  table += batch * (1 << probBits);
+  table += batch * getANSDecodeTableWords(probBits);
   auto headerIn = (const ANSCoalescedHeader*)inProvider.getBatchStart(batch);
 
   auto header = *headerIn;
 
-  // Is this an expected header?
-  header.checkMagicAndVersion();
-
-  // Is our probability resolution what we expected?
-  assert(header.getProbBits() == probBits);
+  // Is this an expected header, with our probability resolution? If not, the
+  // decoding kernel reports the failure
+  if (!ansIsGpuDecodable(header) || header.getProbBits() != probBits) {
+    return;
+  }
 
   if (header.getTotalUncompressedWords() == 0) {
     // nothing to do; compressed empty array
     return;
   }
 
-  // Skip to pdf table
-  auto probs = headerIn->getSymbolProbs();
-
+  // Read the pdf in either format
   static_assert(Threads >= kNumSymbols, "");
-  uint32_t pdf = tid < kNumSymbols ? probs[tid] : 0;
+  uint32_t pdf = tid < kNumSymbols ? headerIn->getSymbolProb(tid) : 0;
   uint32_t cdf = 0;
 
   // Get the CDF from the PDF
@@ -459,22 +545,69 @@ __global__ void ansDecodeTable(
   // Build the table for each pdf/cdf bucket
   constexpr int kWarpsPerBlock = Threads / kWarpSize;
 
-  for (int i = warpId; i < kNumSymbols; i += kWarpsPerBlock) {
-    auto v = smemPdfCdf[i];
+  if (probBits <= kANSMaxPackedProbBits) {
+    for (int i = warpId; i < kNumSymbols; i += kWarpsPerBlock) {
+      auto v = smemPdfCdf[i];
 
-    auto pdf = v.x;
-    auto begin = v.y;
-    auto end = begin + pdf;
+      auto pdf = v.x;
+      auto begin = v.y;
+      auto end = begin + pdf;
 
-    for (int j = begin + laneId; j < end; j += kWarpSize) {
-      table[j] = packDecodeLookup(
-          i, // symbol
-          pdf, // bucket pdf
-          j - begin); // within-bucket cdf
+      for (int j = begin + laneId; j < end; j += kWarpSize) {
+        table[j] = packDecodeLookup(
+            i, // symbol
+            pdf, // bucket pdf
+            j - begin); // within-bucket cdf
+      }
+    }
+  } else {
+    // Split table: the symbol for each bucket, followed by the pdf/cdf for
+    // each symbol
+    auto symbols = (uint8_t*)table;
+
+    for (int i = warpId; i < kNumSymbols; i += kWarpsPerBlock) {
+      auto v = smemPdfCdf[i];
+
+      auto begin = v.y;
+      auto end = begin + v.x;
+
+      for (int j = begin + laneId; j < end; j += kWarpSize) {
+        symbols[j] = i;
+      }
+    }
+
+    if (tid < kNumSymbols) {
+      table[(1 << probBits) / sizeof(TableT) + tid] =
+          packDecodeSymbol(smemPdfCdf[tid].x, smemPdfCdf[tid].y);
     }
   }
 }
 
+// The block checksums stored in the archives of ansDecodeBatch, for
+// verifyBlockChecksumBatch; only those of the archives that were decoded are
+// verified
+template <typename InProvider>
+struct ANSBlockChecksumIn {
+  __device__ const ANSCoalescedHeader* getHeader(uint32_t batch) {
+    return (const ANSCoalescedHeader*)inProvider.getBatchStart(batch);
+  }
+
+  __device__ uint32_t* getBlockChecksums(uint32_t batch) {
+    auto header = getHeader(batch);
+
+    return success[batch] && header->getUseBlockChecksum()
+        ? const_cast<uint32_t*>(header->getBlockChecksums())
+        : nullptr;
+  }
+
+  __device__ uint32_t getBytes(uint32_t batch) {
+    return getHeader(batch)->getTotalUncompressedWords() * sizeof(ANSDecodedT);
+  }
+
+  InProvider inProvider;
+  const uint8_t* success;
+};
+
 template <typename InProvider, typename OutProvider>
 ANSDecodeStatus ansDecodeBatch(
     StackDeviceMemory& res,
@@ -484,12 +617,36 @@ ANSDecodeStatus ansDecodeBatch(
     OutProvider& outProvider,
     uint8_t* outSuccess_dev,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
-  auto table_dev =
-      res.alloc<TableT>(stream, numInBatch * (1 << config.probBits));
+    cudaStream_t stream,
+    // Optional device array of numInBatch device pointers to the reference of
+    // each delta archive, or nullptr for the other archives
+    const void* const* ref_dev = nullptr) {
+  auto dict = config.dictionary;
+  CHECK(!dict || dict->getProbBits() == config.probBits)
+      << "dictionary precision " << dict->getProbBits()
+      << " does not match probBits " << config.probBits;
+
+  // With a dictionary, all batch members share its resident decoding table
+  auto tableStride = dict ? 0 : getANSDecodeTableWords(config.probBits);
+  auto table_dev = res.alloc<TableT>(stream, numInBatch * tableStride);
+  auto table = dict ? dict->getDecodeTableDevice(stream) : table_dev.data();
+
+  // Verifying block checksums needs the status of each batch member, which we
+  // hold in temporary memory if the caller does not want it
+  bool verifyBlockChecksum = config.useBlockChecksum;
+
+  auto tempSuccess_dev = res.alloc<uint8_t>(
+      stream, verifyBlockChecksum && !outSuccess_dev ? numInBatch : 0);
+  auto tempSize_dev = res.alloc<uint32_t>(
+      stream, verifyBlockChecksum && !outSize_dev ? numInBatch : 0);
+
+  if (verifyBlockChecksum) {
+    outSuccess_dev = outSuccess_dev ? outSuccess_dev : tempSuccess_dev.data();
+    outSize_dev = outSize_dev ? outSize_dev : tempSize_dev.data();
+  }
 
   // Build the rANS decoding table from the compression header
-  {
+  if (!dict) {
     constexpr int kThreads = 512;
     ansDecodeTable<InProvider, kThreads><<<numInBatch, kThreads, 0, stream>>>(
         inProvider, config.probBits, table_dev.data());
@@ -503,52 +660,65 @@ ANSDecodeStatus ansDecodeBatch(
     // blocks will exit if there isn't enough work, or will loop if there is
     // more work. We aim for a grid >4x larger than what the device can sustain,
     // to help cover up tail effects and unequal provisioning across the batch
-#define RUN_DECODE(BITS)                                           \
-  do {                                                             \
-    constexpr int kThreads = 128;                                  \
-    auto& props = getCurrentDeviceProperties();                    \
-    int maxBlocksPerSM = 0;                                        \
-    CUDA_VERIFY(cudaOccupancyMaxActiveBlocksPerMultiprocessor(     \
-        &maxBlocksPerSM,                                           \
-        ansDecodeKernel<                                           \
-            InProvider,                                            \
-            OutProvider,                                           \
-            kThreads,                                              \
-            BITS,                                                  \
-            kDefaultBlockSize>,                                    \
-        kThreads,                                                  \
-        0));                                                       \
-    uint32_t maxGrid = maxBlocksPerSM * props.multiProcessorCount; \
-    uint32_t perBatchGrid = divUp(maxGrid, numInBatch) * 4;        \
-    auto grid = dim3(perBatchGrid, numInBatch);                    \
-                                                                   \
-    ansDecodeKernel<                                               \
-        InProvider,                                                \
-        OutProvider,                                               \
-        kThreads,                                                  \
-        BITS,                                                      \
-        kDefaultBlockSize><<<grid, kThreads, 0, stream>>>(         \
-        inProvider,                                                \
-        table_dev.data(),                                          \
-        outProvider,                                               \
-        outSuccess_dev,                                            \
-        outSize_dev);                                              \
+#define RUN_DECODE(BITS, WIDE)                                          \
+  do {                                                                  \
+    constexpr int kThreads = 128;                                       \
+    auto& props = getCurrentDeviceProperties();                         \
+    int maxBlocksPerSM = 0;                                             \
+    CUDA_VERIFY(cudaOccupancyMaxActiveBlocksPerMultiprocessor(          \
+        &maxBlocksPerSM,                                                \
+        ansDecodeKernel<InProvider, OutProvider, kThreads, BITS, WIDE>, \
+        kThreads,                                                       \
+        0));                                                            \
+    uint32_t maxGrid = maxBlocksPerSM * props.multiProcessorCount;      \
+    uint32_t perBatchGrid = divUp(maxGrid, numInBatch) * 4;             \
+    auto grid = dim3(perBatchGrid, numInBatch);                         \
+                                                                        \
+    ansDecodeKernel<InProvider, OutProvider, kThreads, BITS, WIDE>      \
+        <<<grid, kThreads, 0, stream>>>(                                \
+            inProvider,                                                 \
+            table,                                                      \
+            tableStride,                                                \
+            dict ? dict->getId() : 0,                                   \
+            outProvider,                                                \
+            ref_dev,                                                    \
+            outSuccess_dev,                                             \
+            outSize_dev);                                               \
+  } while (false)
+
+#define RUN_DECODE_ALL(BITS)   \
+  do {                         \
+    if (config.useWideState) { \
+      RUN_DECODE(BITS, true);  \
+    } else {                   \
+      RUN_DECODE(BITS, false); \
+    }                          \
   } while (false)
 
     switch (config.probBits) {
       case 9:
-        RUN_DECODE(9);
+        RUN_DECODE_ALL(9);
         break;
       case 10:
-        RUN_DECODE(10);
+        RUN_DECODE_ALL(10);
         break;
       case 11:
-        RUN_DECODE(11);
+        RUN_DECODE_ALL(11);
+        break;
+      case 12:
+        RUN_DECODE_ALL(12);
+        break;
+      case 13:
+        RUN_DECODE_ALL(13);
+        break;
+      case 14:
+        RUN_DECODE_ALL(14);
         break;
       default:
         CHECK(false) << "unhandled pdf precision " << config.probBits;
     }
 
+#undef RUN_DECODE_ALL
 #undef RUN_DECODE
   }
 
@@ -560,8 +730,10 @@ ANSDecodeStatus ansDecodeBatch(
     auto sizes_dev = res.alloc<uint32_t>(stream, numInBatch);
     auto archiveChecksum_dev = res.alloc<uint32_t>(stream, numInBatch);
 
-    // Checksum the output data
-    checksumBatch(numInBatch, outProvider, checksum_dev.data(), stream);
+    // Checksum the output data; that of a delta archive covers its XOR with
+    // the reference
+    checksumBatch(
+        numInBatch, outProvider, checksum_dev.data(), stream, ref_dev);
 
     // Get prior checksum from the ANS headers
     ansGetCompressedInfo(
@@ -590,6 +762,48 @@ ANSDecodeStatus ansDecodeBatch(
     }
   }
 
+  // Verify the block checksums of the decoded archives that hold them
+  // (optional). These cover the data as given, so delta archives are
+  // verified against their decoded output as is
+  if (verifyBlockChecksum) {
+    auto success = std::vector<uint8_t>(numInBatch);
+    auto sizes = std::vector<uint32_t>(numInBatch);
+
+    CUDA_VERIFY(cudaMemcpyAsync(
+        success.data(),
+        outSuccess_dev,
+        sizeof(uint8_t) * numInBatch,
+        cudaMemcpyDeviceToHost,
+        stream));
+    CUDA_VERIFY(cudaMemcpyAsync(
+        sizes.data(),
+        outSize_dev,
+        sizeof(uint32_t) * numInBatch,
+        cudaMemcpyDeviceToHost,
+        stream));
+    CUDA_VERIFY(cudaStreamSynchronize(stream));
+
+    // The size of a member that failed to decode may be anything
+    uint32_t maxBytes = 0;
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      if (success[i]) {
+        maxBytes = std::max(maxBytes, sizes[i]);
+      }
+    }
+
+    if (!verifyBlockChecksumBatch(
+            res,
+            numInBatch,
+            outProvider,
+            ANSBlockChecksumIn<InProvider>{inProvider, outSuccess_dev},
+            maxBytes,
+            status.failedBlocks,
+            status.errorInfo,
+            stream)) {
+      status.error = ANSDecodeError::ChecksumMismatch;
+    }
+  }
+
   CUDA_TEST_ERROR();
 
   return status;
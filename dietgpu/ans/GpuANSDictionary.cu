@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/GpuANSCodec.h"
+#include "dietgpu/ans/GpuANSUtils.cuh"
+#include "dietgpu/utils/DeviceUtils.h"
+
+#include <glog/logging.h>
+
+namespace dietgpu {
+
+const uint4* ANSDictionary::getEncodeTableDevice(cudaStream_t stream) const {
+  return (const uint4*)getDeviceTables(stream);
+}
+
+const uint32_t* ANSDictionary::getDecodeTableDevice(
+    cudaStream_t stream) const {
+  return (const uint32_t*)(getDeviceTables(stream) +
+                           encodeTable_.size() * sizeof(uint4));
+}
+
+const uint8_t* ANSDictionary::getDeviceTables(cudaStream_t stream) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto device = getCurrentDevice();
+  auto it = deviceTables_.find(device);
+  if (it != deviceTables_.end()) {
+    return it->second.get();
+  }
+
+  auto encodeBytes = encodeTable_.size() * sizeof(uint4);
+  auto decodeBytes = decodeTable_.size() * sizeof(uint32_t);
+
+  uint8_t* tables = nullptr;
+  CUDA_VERIFY(cudaMalloc(&tables, encodeBytes + decodeBytes));
+
+  // Freed along with the dictionary
+  auto deviceTables = std::shared_ptr<uint8_t>(tables, [device](uint8_t* p) {
+    DeviceScope s(device);
+    CUDA_VERIFY(cudaFree(p));
+  });
+
+  CUDA_VERIFY(cudaMemcpyAsync(
+      tables,
+      encodeTable_.data(),
+      encodeBytes,
+      cudaMemcpyHostToDevice,
+      stream));
+  CUDA_VERIFY(cudaMemcpyAsync(
+      tables + encodeBytes,
+      decodeTable_.data(),
+      decodeBytes,
+      cudaMemcpyHostToDevice,
+      stream));
+
+  // Later users of the tables may be on other streams
+  CUDA_VERIFY(cudaStreamSynchronize(stream));
+
+  deviceTables_[device] = std::move(deviceTables);
+  return tables;
+}
+
+} // namespace dietgpu
@@ -10,20 +10,6 @@
 
 namespace dietgpu {
 
-uint32_t getMaxCompressedSize(uint32_t uncompressedBytes) {
-  uint32_t blocks = divUp(uncompressedBytes, kDefaultBlockSize);
-
-  size_t rawSize = ANSCoalescedHeader::getCompressedOverhead(kDefaultBlockSize);
-  rawSize += (size_t)getMaxBlockSizeCoalesced(kDefaultBlockSize) * blocks;
-
-  // When used in batches, we must align everything to 16 byte boundaries (due
-  // to uint4 read/writes)
-  rawSize = roundUp(rawSize, sizeof(uint4));
-  CHECK_LE(rawSize, std::numeric_limits<int32_t>::max());
-
-  return rawSize;
-}
-
 void ansEncodeBatchStride(
     StackDeviceMemory& res,
     const ANSCodecConfig& config,
@@ -52,6 +38,94 @@ void ansEncodeBatchStride(
       stream);
 }
 
+namespace {
+
+// ansEncodeBatchPointer in delta mode: the members with a reference are
+// coded as their XOR with it, formed in temporary memory
+void ansEncodeBatchDeltaPointer(
+    StackDeviceMemory& res,
+    const ANSCodecConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    const uint32_t* histogram_dev,
+    void** out,
+    uint32_t* outSize_dev,
+    cudaStream_t stream,
+    const void** ref) {
+  CHECK(!histogram_dev)
+      << "a histogram of the input does not apply to its XOR with a reference";
+
+  // Where the XOR of each member with its reference is written, each aligned
+  // to a uint4 word for ansXorBatch
+  auto deltaStart = std::vector<size_t>(numInBatch + 1);
+  uint32_t maxSize = 0;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    deltaStart[i + 1] =
+        deltaStart[i] + (ref[i] ? roundUp(inSize[i], sizeof(uint4)) : 0);
+    maxSize = std::max(maxSize, inSize[i]);
+  }
+
+  auto delta_dev = res.alloc<uint8_t>(stream, deltaStart[numInBatch]);
+
+  auto deltaIn = std::vector<const void*>(in, in + numInBatch);
+  auto deltaOut = std::vector<void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (ref[i]) {
+      deltaOut[i] = delta_dev.data() + deltaStart[i];
+      deltaIn[i] = deltaOut[i];
+    }
+  }
+
+  auto in_dev = res.copyAlloc<void*>(stream, (void**)in, numInBatch);
+  auto inSize_dev = res.copyAlloc<uint32_t>(stream, inSize, numInBatch);
+  auto ref_dev = res.copyAlloc<void*>(stream, (void**)ref, numInBatch);
+  auto deltaIn_dev =
+      res.copyAlloc<void*>(stream, (void**)deltaIn.data(), numInBatch);
+  auto deltaOut_dev = res.copyAlloc<void*>(stream, deltaOut.data(), numInBatch);
+  auto out_dev = res.copyAlloc<void*>(stream, out, numInBatch);
+
+  {
+    auto inProvider = BatchProviderPointer(in_dev.data(), inSize_dev.data());
+
+    constexpr int kThreads = 256;
+    int maxBlocks = 0;
+    CUDA_VERIFY(cudaOccupancyMaxActiveBlocksPerMultiprocessor(
+        &maxBlocks,
+        ansXorBatch<BatchProviderPointer, kThreads>,
+        kThreads,
+        0));
+    maxBlocks *= getCurrentDeviceProperties().multiProcessorCount;
+
+    // The y block dimension will be for each batch element
+    auto grid = dim3(divUp(maxBlocks, numInBatch), numInBatch);
+
+    ansXorBatch<BatchProviderPointer, kThreads><<<grid, kThreads, 0, stream>>>(
+        inProvider, ref_dev.data(), deltaOut_dev.data());
+    CUDA_TEST_ERROR();
+  }
+
+  auto inProvider =
+      BatchProviderPointer(deltaIn_dev.data(), inSize_dev.data());
+  auto outProvider = BatchProviderPointer(out_dev.data());
+
+  ansEncodeBatchDevice(
+      res,
+      config,
+      numInBatch,
+      inProvider,
+      nullptr,
+      maxSize,
+      outProvider,
+      outSize_dev,
+      stream,
+      ref_dev.data());
+}
+
+} // namespace
+
 void ansEncodeBatchPointer(
     StackDeviceMemory& res,
     const ANSCodecConfig& config,
@@ -61,7 +135,22 @@ void ansEncodeBatchPointer(
     const uint32_t* histogram_dev,
     void** out,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    const void** ref) {
+  if (ref) {
+    return ansEncodeBatchDeltaPointer(
+        res,
+        config,
+        numInBatch,
+        in,
+        inSize,
+        histogram_dev,
+        out,
+        outSize_dev,
+        stream,
+        ref);
+  }
+
   // Get the total and maximum input size
   uint32_t maxSize = 0;
 
@@ -27,42 +27,48 @@
 
 namespace dietgpu {
 
-// maximum raw compressed data block size in bytes
-constexpr __host__ __device__ uint32_t
-getRawCompBlockMaxSize(uint32_t uncompressedBlockBytes) {
-  // (an estimate from zstd)
-  return roundUp(
-      uncompressedBlockBytes + (uncompressedBlockBytes / 4), kBlockAlignment);
+inline uint32_t getMaxBlockSizeUnCoalesced(
+    uint32_t uncompressedBlockBytes,
+    bool useWideState = false) {
+  // uncoalesced data has a warp state header
+  return ANSCoalescedHeader::getWarpStateSize(useWideState) +
+      getRawCompBlockMaxSize(uncompressedBlockBytes);
 }
 
-inline uint32_t getMaxBlockSizeUnCoalesced(uint32_t uncompressedBlockBytes) {
-  // uncoalesced data has a warp state header
-  return sizeof(ANSWarpState) + getRawCompBlockMaxSize(uncompressedBlockBytes);
+// The encoders record each block in the uncoalesced scratch as the code of its
+// block index entry (see getBlockCode) in the upper 16 bits, and the number of
+// words of its data in the lower 16 bits
+inline __host__ __device__ uint32_t
+packEncodedBlock(uint32_t code, uint32_t dataWords) {
+  return (code << 16) | dataWords;
+}
+
+inline __host__ __device__ uint32_t getEncodedBlockCode(uint32_t v) {
+  return v >> 16;
 }
 
-inline uint32_t getMaxBlockSizeCoalesced(uint32_t uncompressedBlockBytes) {
-  return getRawCompBlockMaxSize(uncompressedBlockBytes);
+inline __host__ __device__ uint32_t getEncodedBlockDataWords(uint32_t v) {
+  return v & 0xffffU;
 }
 
 // Returns number of values written to the compressed output
 // Assumes all lanes in the warp are presented valid input symbols
-template <int ProbBits>
+template <int ProbBits, bool Wide>
 __device__ __forceinline__ uint32_t encodeOneWarp(
-    ANSStateT& state,
+    typename ANSStateInfo<Wide>::StateT& state,
     ANSDecodedT sym,
     uint32_t outOffset,
-    ANSEncodedT* __restrict__ out,
-    const uint4* __restrict__ smemLookup) {
-  auto lookup = smemLookup[sym];
+    typename ANSStateInfo<Wide>::EncodedT* __restrict__ out,
+    const typename ANSStateInfo<Wide>::EncodeLookup* __restrict__ smemLookup) {
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
 
-  uint32_t pdf = lookup.x;
-  uint32_t cdf = lookup.y;
-  uint32_t div_m1 = lookup.z;
-  uint32_t div_shift = lookup.w;
+  auto lookup = smemLookup[sym];
 
-  constexpr ANSStateT kStateCheckMul = 1 << (kANSStateBits - ProbBits);
+  constexpr StateT kStateCheckMul = StateT(1)
+      << (Info::kStateBits - ProbBits);
 
-  ANSStateT maxStateCheck = pdf * kStateCheckMul;
+  StateT maxStateCheck = Info::getPdf(lookup) * kStateCheckMul;
   bool write = (state >= maxStateCheck);
 
   auto vote = __ballot_sync(0xffffffff, write);
@@ -70,20 +76,12 @@ __device__ __forceinline__ uint32_t encodeOneWarp(
 
   // Some lanes wish to write out their data
   if (write) {
-    out[outOffset + prefix] = state & kANSEncodedMask;
-    state >>= kANSEncodedBits;
+    out[outOffset + prefix] = state & ((StateT(1) << Info::kEncodedBits) - 1);
+    state >>= Info::kEncodedBits;
   }
 
-  constexpr uint32_t kProbBitsMul = 1 << ProbBits;
-
-  uint32_t t = __umulhi(state, div_m1);
-  // We prevent addition overflow here by restricting `state` to < 2^31
-  // (kANSStateBits)
-  uint32_t div = (t + state) >> div_shift;
-  auto mod = state - (div * pdf);
-
   // calculating ((state / pdf) << ProbBits) + (state % pdf) + cdf
-  state = div * kProbBitsMul + mod + cdf;
+  state = ansEncodeState<ProbBits>(state, lookup);
 
   // how many values we actually write to the compressed output
   return __popc(vote);
@@ -91,25 +89,24 @@ __device__ __forceinline__ uint32_t encodeOneWarp(
 
 // Returns number of values written to the compressed output
 // Assumes only some lanes in the warp are presented valid input symbols
-template <int ProbBits>
+template <int ProbBits, bool Wide>
 __device__ __forceinline__ uint32_t encodeOnePartialWarp(
     // true for the lanes in the warp for which data read is valid
     bool valid,
-    ANSStateT& state,
+    typename ANSStateInfo<Wide>::StateT& state,
     ANSDecodedT sym,
     uint32_t outOffset,
-    ANSEncodedT* __restrict__ out,
-    const uint4* __restrict__ smemLookup) {
-  auto lookup = smemLookup[sym];
+    typename ANSStateInfo<Wide>::EncodedT* __restrict__ out,
+    const typename ANSStateInfo<Wide>::EncodeLookup* __restrict__ smemLookup) {
+  using Info = ANSStateInfo<Wide>;
+  using StateT = typename Info::StateT;
 
-  uint32_t pdf = lookup.x;
-  uint32_t cdf = lookup.y;
-  uint32_t div_m1 = lookup.z;
-  uint32_t div_shift = lookup.w;
+  auto lookup = smemLookup[sym];
 
-  constexpr ANSStateT kStateCheckMul = 1 << (kANSStateBits - ProbBits);
+  constexpr StateT kStateCheckMul = StateT(1)
+      << (Info::kStateBits - ProbBits);
 
-  ANSStateT maxStateCheck = pdf * kStateCheckMul;
+  StateT maxStateCheck = Info::getPdf(lookup) * kStateCheckMul;
   bool write = valid && (state >= maxStateCheck);
 
   auto vote = __ballot_sync(0xffffffff, write);
@@ -117,19 +114,12 @@ __device__ __forceinline__ uint32_t encodeOnePartialWarp(
 
   // Some lanes wish to write out their data
   if (write) {
-    out[outOffset + prefix] = state & kANSEncodedMask;
-    state >>= kANSEncodedBits;
+    out[outOffset + prefix] = state & ((StateT(1) << Info::kEncodedBits) - 1);
+    state >>= Info::kEncodedBits;
   }
 
-  uint32_t t = __umulhi(state, div_m1);
-  // We prevent addition overflow here by restricting `state` to < 2^31
-  // (kANSStateBits)
-  uint32_t div = (t + state) >> div_shift;
-  auto mod = state - (div * pdf);
-
   // calculating ((state / pdf) << ProbBits) + (state % pdf) + cdf
-  constexpr uint32_t kProbBitsMul = 1 << ProbBits;
-  state = valid ? div * kProbBitsMul + mod + cdf : state;
+  state = valid ? ansEncodeState<ProbBits>(state, lookup) : state;
 
   // how many values we actually write to the compressed output
   return __popc(vote);
@@ -137,8 +127,9 @@ __device__ __forceinline__ uint32_t encodeOnePartialWarp(
 
 // Fully encode a single block of data, along with the state for that block as
 // the initial header.
-// Returns the number of compressed words (ANSEncodedT) written
-template <int ProbBits>
+// Returns the number of compressed words (ANSEncodedT, or ANSWideEncodedT if
+// Wide) written
+template <int ProbBits, bool Wide>
 __device__ uint32_t ansEncodeWarpBlock(
     // Current lane ID in the warp
     uint32_t laneId,
@@ -147,14 +138,16 @@ __device__ uint32_t ansEncodeWarpBlock(
     // Number of ANSDecodedT words in this block
     uint32_t inWords,
     // encoded table in smem
-    const uint4* __restrict__ table,
+    const typename ANSStateInfo<Wide>::EncodeLookup* __restrict__ table,
     // Output for this block
-    ANSWarpState* __restrict__ out) {
+    typename ANSStateInfo<Wide>::WarpState* __restrict__ out) {
+  using Info = ANSStateInfo<Wide>;
+
   // where we write the compressed words
-  ANSEncodedT* outWords = (ANSEncodedT*)(out + 1);
+  auto outWords = (typename Info::EncodedT*)(out + 1);
 
   // Start state value for this warp
-  ANSStateT state = kANSStartState;
+  typename Info::StateT state = Info::getStartState();
 
   uint32_t inOffset = laneId;
   uint32_t outOffset = 0;
@@ -174,8 +167,8 @@ __device__ uint32_t ansEncodeWarpBlock(
 
 #pragma unroll
       for (int j = 0; j < kUnroll; ++j) {
-        outOffset +=
-            encodeOneWarp<ProbBits>(state, sym[j], outOffset, outWords, table);
+        outOffset += encodeOneWarp<ProbBits, Wide>(
+            state, sym[j], outOffset, outWords, table);
       }
     }
   }
@@ -188,8 +181,8 @@ __device__ uint32_t ansEncodeWarpBlock(
     for (; inOffset < limit; inOffset += kWarpSize) {
       ANSDecodedT sym = in[inOffset];
 
-      outOffset +=
-          encodeOneWarp<ProbBits>(state, sym, outOffset, outWords, table);
+      outOffset += encodeOneWarp<ProbBits, Wide>(
+          state, sym, outOffset, outWords, table);
     }
 
     // Partial warp iteration
@@ -198,7 +191,7 @@ __device__ uint32_t ansEncodeWarpBlock(
       bool valid = inOffset < inWords;
       ANSDecodedT sym = valid ? in[inOffset] : ANSDecodedT(0);
 
-      outOffset += encodeOnePartialWarp<ProbBits>(
+      outOffset += encodeOnePartialWarp<ProbBits, Wide>(
           valid, state, sym, outOffset, outWords, table);
     }
   }
@@ -210,6 +203,104 @@ __device__ uint32_t ansEncodeWarpBlock(
   return outOffset;
 }
 
+// Returns (uniformly across the warp) whether all symbols of a block are the
+// same as its first, which is returned in sym
+inline __device__ bool ansWarpBlockIsConstant(
+    uint32_t laneId,
+    const ANSDecodedT* __restrict__ in,
+    uint32_t inWords,
+    ANSDecodedT& sym) {
+  // Blocks meet kANSRequiredAlignment, so we can compare a word at a time
+  using VecT = uint32_t;
+  static_assert(sizeof(VecT) <= kANSRequiredAlignment, "");
+
+  sym = in[0];
+  VecT symV = uint32_t(sym) * 0x01010101U;
+
+  auto inV = (const VecT*)in;
+  uint32_t numV = inWords / sizeof(VecT);
+  bool same = true;
+
+  for (uint32_t i = laneId; i < numV; i += kWarpSize) {
+    same &= (inV[i] == symV);
+  }
+
+  for (uint32_t i = numV * sizeof(VecT) + laneId; i < inWords; i += kWarpSize) {
+    same &= (in[i] == sym);
+  }
+
+  return __all_sync(0xffffffff, same);
+}
+
+// Copies the input of a stored block to its data, zero padding the last
+// kBlockAlignment segment
+inline __device__ void ansWarpStoreBlock(
+    uint32_t laneId,
+    const ANSDecodedT* __restrict__ in,
+    uint32_t inWords,
+    uint8_t* __restrict__ out) {
+  using VecT = uint32_t;
+  static_assert(sizeof(VecT) <= kANSRequiredAlignment, "");
+
+  auto inV = (const VecT*)in;
+  auto outV = (VecT*)out;
+  uint32_t numV = inWords / sizeof(VecT);
+
+  for (uint32_t i = laneId; i < numV; i += kWarpSize) {
+    outV[i] = inV[i];
+  }
+
+  uint32_t end =
+      roundUp(inWords * (uint32_t)sizeof(ANSDecodedT), kBlockAlignment);
+
+  for (uint32_t i = numV * sizeof(VecT) + laneId; i < end; i += kWarpSize) {
+    out[i] = i < inWords ? in[i] : ANSDecodedT(0);
+  }
+}
+
+// Encodes a block in the mode chosen for it (see
+// ANSCoalescedHeader::chooseBlockMode), returning its packEncodedBlock entry
+template <int ProbBits, bool Wide>
+__device__ uint32_t ansEncodeWarpBlockMode(
+    uint32_t laneId,
+    const ANSDecodedT* __restrict__ in,
+    uint32_t inWords,
+    uint32_t blockSize,
+    const typename ANSStateInfo<Wide>::EncodeLookup* __restrict__ table,
+    typename ANSStateInfo<Wide>::WarpState* __restrict__ out) {
+  using Info = ANSStateInfo<Wide>;
+
+  ANSDecodedT sym;
+  bool isConstant = ansWarpBlockIsConstant(laneId, in, inWords, sym);
+
+  // Constant blocks need not be encoded at all
+  uint32_t outWords = 0;
+  if (!isConstant) {
+    outWords =
+        ansEncodeWarpBlock<ProbBits, Wide>(laneId, in, inWords, table, out);
+
+    // If the bound on max compressed size is not correct, this assert will go
+    // off. This block of data was then somewhat adversarial in terms of
+    // incompressibility. In this case, the getRawCompBlockMaxSize max estimate
+    // needs to increase.
+    assert(
+        outWords <=
+        getRawCompBlockMaxSize(blockSize) / sizeof(typename Info::EncodedT));
+  }
+
+  auto mode = ANSCoalescedHeader::chooseBlockMode(
+      isConstant, inWords, outWords, Wide);
+
+  if (mode == ANSBlockMode::Stored) {
+    // The input replaces the coded data written by other lanes
+    __syncwarp();
+    ansWarpStoreBlock(laneId, in, inWords, (uint8_t*)(out + 1));
+    outWords = ANSCoalescedHeader::getStoredBlockWords(inWords, Wide);
+  }
+
+  return packEncodedBlock(getBlockCode(mode, outWords, sym), outWords);
+}
+
 // Fully encode a single, full sized block of data, along with the state for
 // that block as the initial header.
 // Returns the number of compressed words (ANSEncodedT) written
@@ -294,26 +385,32 @@ struct ANSEncodeWarpFullBlock<ProbBits, BlockSize, false> {
       // Output for this block
       ANSWarpState* __restrict__ out) {
     // Just use the normal implementation
-    return ansEncodeWarpBlock<ProbBits>(laneId, in, BlockSize, table, out);
+    return ansEncodeWarpBlock<ProbBits, false>(
+        laneId, in, BlockSize, table, out);
   }
 };
 
-template <int ProbBits, int BlockSize>
+template <int ProbBits, bool Wide>
 __device__ void ansEncodeBlocksFull(
     // input data for all blocks
     const ANSDecodedT* __restrict__ in,
     // length in ANSDecodedT words
     uint32_t uncompressedWords,
+    // size of each block in ANSDecodedT words
+    uint32_t blockSize,
     // number of blocks that different warps will process
     uint32_t numBlocks,
     // the stride of each encoded output block
     uint32_t outBlockStride,
     // address of the output for all blocks
     uint8_t* __restrict__ out,
-    // output array of per-block sizes of number of ANSEncodedT words per block
+    // output array of the packEncodedBlock entry of each block, with sizes in
+    // ANSEncodedT (or ANSWideEncodedT) words
     uint32_t* __restrict__ compressedWords,
     // the encoding table that we will load into smem
     const uint4* __restrict__ table) {
+  using Info = ANSStateInfo<Wide>;
+
   // grid-wide warp id
   int tid = threadIdx.x;
   // so we know the block is warp uniform
@@ -321,71 +418,71 @@ __device__ void ansEncodeBlocksFull(
       __shfl_sync(0xffffffff, (blockIdx.x * blockDim.x + tid) / kWarpSize, 0);
   int laneId = getLaneId();
 
-  __shared__ uint4 smemLookup[kNumSymbols];
+  __shared__ typename Info::EncodeLookup smemLookup[kNumSymbols];
 
   // we always have at least 256 threads
   if (tid < kNumSymbols) {
-    smemLookup[tid] = table[tid];
+    smemLookup[tid] = Info::makeEncodeLookup(table[tid]);
   }
 
   __syncthreads();
 
   // How big is this block?
-  uint32_t start = block * BlockSize;
-  uint32_t end = min(start + BlockSize, uncompressedWords);
+  uint32_t start = block * blockSize;
+  uint32_t end = min(start + blockSize, uncompressedWords);
 
-  auto blockSize = end - start;
+  auto curBlockSize = end - start;
 
   // Either the warp is an excess one, or the last block is not a full block and
   // needs to be processed using the partial kernel
-  if (block >= numBlocks || blockSize != BlockSize) {
+  if (block >= numBlocks || curBlockSize != blockSize) {
     return;
   }
 
   auto inBlock = in + start;
-  auto outBlock = (ANSWarpState*)(out + block * outBlockStride);
+  auto outBlock = (typename Info::WarpState*)(out + block * outBlockStride);
 
   // all input blocks must meet alignment requirements
   assert(isPointerAligned(inBlock, kANSRequiredAlignment));
 
-  auto outWords = ANSEncodeWarpFullBlock<ProbBits, BlockSize, false>::encode(
-      laneId, inBlock, smemLookup, outBlock);
+  auto encodedBlock = ansEncodeWarpBlockMode<ProbBits, Wide>(
+      laneId, inBlock, blockSize, blockSize, smemLookup, outBlock);
 
   if (laneId == 0) {
-    // If the bound on max compressed size is not correct, this assert will go
-    // off. This block of data was then somewhat adversarial in terms of
-    // incompressibility. In this case, the getRawCompBlockMaxSize max estimate
-    // needs to increase.
-    assert(outWords <= getRawCompBlockMaxSize(BlockSize) / sizeof(ANSEncodedT));
-    compressedWords[block] = outWords;
+    compressedWords[block] = encodedBlock;
   }
 }
 
-template <int ProbBits, int BlockSize>
+template <int ProbBits, bool Wide>
 __device__ void ansEncodeBlocksPartial(
     // input data for all blocks
     const ANSDecodedT* __restrict__ in,
     // length in ANSDecodedT words
     uint32_t uncompressedWords,
+    // size of each block in ANSDecodedT words
+    uint32_t blockSize,
     // number of blocks that different warps will process
     uint32_t numBlocks,
     // the stride of each encoded output block
     uint32_t outBlockStride,
     // address of the output for all blocks
     uint8_t* __restrict__ out,
-    // output array of per-block sizes of number of ANSEncodedT words per block
+    // output array of the packEncodedBlock entry of each block, with sizes in
+    // ANSEncodedT (or ANSWideEncodedT) words
     uint32_t* __restrict__ compressedWords,
     // the encoding table that we will load into smem
     const uint4* __restrict__ table) {
+  using Info = ANSStateInfo<Wide>;
+
   int block = numBlocks - 1;
   uint32_t tid = threadIdx.x;
   int laneId = getLaneId();
 
-  __shared__ uint4 smemLookup[kNumSymbols];
+  __shared__ typename Info::EncodeLookup smemLookup[kNumSymbols];
 
   // we always have at least 256 threads
   if (tid < kNumSymbols) {
-    smemLookup[tid] = table[tid];
+    smemLookup[tid] = Info::makeEncodeLookup(table[tid]);
   }
 
   __syncthreads();
@@ -396,40 +493,37 @@ __device__ void ansEncodeBlocksPartial(
   }
 
   // How big is this block?
-  uint32_t start = block * BlockSize;
-  uint32_t end = min(start + BlockSize, uncompressedWords);
+  uint32_t start = block * blockSize;
+  uint32_t end = min(start + blockSize, uncompressedWords);
 
-  auto blockSize = end - start;
+  auto curBlockSize = end - start;
 
   // If the end block is a full block, it would have been handled by the full
   // block kernel
-  if (blockSize == BlockSize) {
+  if (curBlockSize == blockSize) {
     return;
   }
 
   auto inBlock = in + start;
-  auto outBlock = (ANSWarpState*)(out + block * outBlockStride);
+  auto outBlock = (typename Info::WarpState*)(out + block * outBlockStride);
 
   // all input blocks must meet required alignment
   assert(isPointerAligned(inBlock, kANSRequiredAlignment));
 
-  auto outWords = ansEncodeWarpBlock<ProbBits>(
-      laneId, inBlock, blockSize, smemLookup, outBlock);
+  auto encodedBlock = ansEncodeWarpBlockMode<ProbBits, Wide>(
+      laneId, inBlock, curBlockSize, blockSize, smemLookup, outBlock);
 
   if (laneId == 0) {
-    // If the bound on max compressed size is not correct, this assert will go
-    // off. This block of data was then somewhat adversarial in terms of
-    // incompressibility. In this case, the getRawCompBlockMaxSize max estimate
-    // needs to increase.
-    assert(outWords <= getRawCompBlockMaxSize(BlockSize) / sizeof(ANSEncodedT));
-    compressedWords[block] = outWords;
+    compressedWords[block] = encodedBlock;
   }
 }
 
-template <typename InProvider, int ProbBits, int BlockSize>
+template <typename InProvider, int ProbBits, bool Wide>
 __global__ void ansEncodeBatchFull(
     // Input data for all blocks
     InProvider inProvider,
+    // size of each block in ANSDecodedT words
+    uint32_t blockSize,
     // maximum number of blocks across all the batch
     uint32_t maxNumCompressedBlocks,
     // maximum size of a compressed block
@@ -441,29 +535,34 @@ __global__ void ansEncodeBatchFull(
     // [batch][numBlocks]
     uint32_t* __restrict__ compressedWords,
     // the encoding table that we will load into smem
-    // [batch][kNumSymbols]
-    const uint4* __restrict__ table) {
+    // [batch][tableStride]
+    const uint4* __restrict__ table,
+    // kNumSymbols, or 0 if all batch members share a single (dictionary) table
+    uint32_t tableStride) {
   // which batch element we are processing
   int batch = blockIdx.y;
 
   // Number of blocks for the current problem
   uint32_t curSize = inProvider.getBatchSize(batch);
-  uint32_t numBlocks = divUp(curSize, BlockSize);
+  uint32_t numBlocks = divUp(curSize, blockSize);
 
-  ansEncodeBlocksFull<ProbBits, BlockSize>(
+  ansEncodeBlocksFull<ProbBits, Wide>(
       (const ANSDecodedT*)inProvider.getBatchStart(batch),
       curSize,
+      blockSize,
       numBlocks,
       maxCompressedBlockSize,
       out + batch * maxNumCompressedBlocks * maxCompressedBlockSize,
       compressedWords + batch * maxNumCompressedBlocks,
-      table + batch * kNumSymbols);
+      table + batch * tableStride);
 }
 
-template <typename InProvider, int ProbBits, int BlockSize>
+template <typename InProvider, int ProbBits, bool Wide>
 __global__ void ansEncodeBatchPartial(
     // input data for all blocks
     InProvider inProvider,
+    // size of each block in ANSDecodedT words
+    uint32_t blockSize,
     // maximum number of blocks across all the batch
     uint32_t maxNumCompressedBlocks,
     // maximum size of a compressed block
@@ -475,27 +574,32 @@ __global__ void ansEncodeBatchPartial(
     // [batch][numBlocks]
     uint32_t* __restrict__ compressedWords,
     // the encoding table that we will load into smem
-    // [batch][kNumSymbols]
-    const uint4* __restrict__ table) {
+    // [batch][tableStride]
+    const uint4* __restrict__ table,
+    // kNumSymbols, or 0 if all batch members share a single (dictionary) table
+    uint32_t tableStride) {
   // which batch element we are processing
   int batch = blockIdx.y;
 
   // Number of blocks for the current problem
   uint32_t curSize = inProvider.getBatchSize(batch);
-  uint32_t numBlocks = divUp(curSize, BlockSize);
+  uint32_t numBlocks = divUp(curSize, blockSize);
 
-  ansEncodeBlocksPartial<ProbBits, BlockSize>(
+  ansEncodeBlocksPartial<ProbBits, Wide>(
       (const ANSDecodedT*)inProvider.getBatchStart(batch),
       inProvider.getBatchSize(batch),
+      blockSize,
       numBlocks,
       maxCompressedBlockSize,
       out + batch * maxNumCompressedBlocks * maxCompressedBlockSize,
       compressedWords + batch * maxNumCompressedBlocks,
-      table + batch * kNumSymbols);
+      table + batch * tableStride);
 }
 
+// The number of data words of a packEncodedBlock entry, rounded up to a
+// multiple of B bytes
 template <typename A, int B>
-struct Align {
+struct AlignBlockDataWords {
   typedef uint32_t argument_type;
   typedef uint32_t result_type;
 
@@ -504,10 +608,53 @@ struct Align {
     constexpr int kDiv = B / sizeof(A);
     constexpr int kSize = kDiv < 1 ? 1 : kDiv;
 
-    return roundUp(x, T(kSize));
+    return roundUp(getEncodedBlockDataWords(x), uint32_t(kSize));
   }
 };
 
+// Exclusive prefix sum of the number of data EncodedT words per block (given
+// the packEncodedBlock entries), with each block aligned to kBlockAlignment
+// bytes
+template <typename EncodedT>
+void ansCompressedWordsPrefixSum(
+    StackDeviceMemory& res,
+    const uint32_t* compressedWords_dev,
+    uint32_t* compressedWordsPrefix_dev,
+    uint32_t numInBatch,
+    uint32_t maxNumCompressedBlocks,
+    cudaStream_t stream) {
+  // FIXME: probably some way to do this via thrust::exclusive_scan_by_key with
+  // transform iterators and what not
+  auto sizeRequired =
+      getBatchExclusivePrefixSumTempSize(numInBatch, maxNumCompressedBlocks);
+
+  using AlignT = AlignBlockDataWords<EncodedT, kBlockAlignment>;
+
+  // FIXME: we can run a more minimal segmented prefix sum instead of using
+  // maxNumCompressedBlocks
+  if (sizeRequired == 0) {
+    batchExclusivePrefixSum<uint32_t, AlignT>(
+        compressedWords_dev,
+        compressedWordsPrefix_dev,
+        nullptr,
+        numInBatch,
+        maxNumCompressedBlocks,
+        AlignT(),
+        stream);
+  } else {
+    auto tempPrefixSum_dev = res.alloc<uint8_t>(stream, sizeRequired);
+
+    batchExclusivePrefixSum<uint32_t, AlignT>(
+        compressedWords_dev,
+        compressedWordsPrefix_dev,
+        tempPrefixSum_dev.data(),
+        numInBatch,
+        maxNumCompressedBlocks,
+        AlignT(),
+        stream);
+  }
+}
+
 template <int Threads>
 __device__ void ansEncodeCoalesce(
     const uint8_t* __restrict__ inUncoalescedBlocks,
@@ -518,6 +665,12 @@ __device__ void ansEncodeCoalesce(
     const uint4* __restrict__ table,
     uint32_t probBits,
     bool useChecksum,
+    bool useWideState,
+    bool useDictionary,
+    uint32_t dictionaryId,
+    bool useDelta,
+    bool useBlockChecksum,
+    uint32_t blockSize,
     uint32_t numBlocks,
     uint32_t uncompressedWords,
     uint8_t* __restrict__ out,
@@ -525,51 +678,105 @@ __device__ void ansEncodeCoalesce(
   int block = blockIdx.x;
   int tid = threadIdx.x;
 
-  ANSCoalescedHeader* headerOut = (ANSCoalescedHeader*)out;
+  // The number of symbols present and the largest pdf, which determine the
+  // format of the pdf and thus the archive layout
+  __shared__ uint32_t smemNumSymbols;
+  __shared__ uint32_t smemMaxPdf;
 
-  // The first block will be responsible for the coalesced header
-  if (block == 0) {
+  if (!useDictionary) {
     if (tid == 0) {
-      uint32_t totalCompressedWords = 0;
-
-      // Could be a header for a zero sized array
-      if (numBlocks > 0) {
-        totalCompressedWords =
-            // total number of compressed words in all blocks
-            // this is already a multiple of kBlockAlignment /
-            // sizeof(ANSEncodedT)
-            compressedWordsPrefix[numBlocks - 1] +
-            // this is not yet a multiple of kBlockAlignment /
-            // sizeof(ANSEncodedT), but needs to be
-            roundUp(
-                compressedWords[numBlocks - 1],
-                kBlockAlignment / sizeof(ANSEncodedT));
-      }
+      smemNumSymbols = 0;
+      smemMaxPdf = 0;
+    }
 
-      ANSCoalescedHeader header;
-      header.setMagicAndVersion();
-      header.setNumBlocks(numBlocks);
-      header.setTotalUncompressedWords(uncompressedWords);
-      header.setTotalCompressedWords(totalCompressedWords);
-      header.setProbBits(probBits);
-      header.setUseChecksum(useChecksum);
+    __syncthreads();
 
-      if (useChecksum) {
-        header.setChecksum(*checksum);
-      }
+    uint32_t numSymbols = 0;
+    uint32_t maxPdf = 0;
 
-      if (compressedBytes) {
-        *compressedBytes = header.getTotalCompressedSize();
-      }
+    for (int i = tid; i < kNumSymbols; i += Threads) {
+      uint32_t pdf = table[i].x;
+      numSymbols += pdf > 0;
+      maxPdf = max(maxPdf, pdf);
+    }
+
+    atomicAdd(&smemNumSymbols, numSymbols);
+    atomicMax(&smemMaxPdf, maxPdf);
+
+    __syncthreads();
+  }
+
+  uint32_t totalCompressedWords = 0;
+
+  // Could be a header for a zero sized array
+  if (numBlocks > 0) {
+    totalCompressedWords =
+        // total number of compressed words in all blocks
+        // this is already a multiple of kBlockAlignment /
+        // sizeof(ANSEncodedT)
+        compressedWordsPrefix[numBlocks - 1] +
+        // this is not yet a multiple of kBlockAlignment /
+        // sizeof(ANSEncodedT), but needs to be
+        roundUp(
+            getEncodedBlockDataWords(compressedWords[numBlocks - 1]),
+            kBlockAlignment /
+                ANSCoalescedHeader::getEncodedWordSize(useWideState));
+  }
 
-      *headerOut = header;
+  // Only the first block, which writes the header, needs to know whether any
+  // block is not ANS coded; this does not affect the archive layout
+  bool useBlockModes = false;
+
+  if (block == 0) {
+    bool anyNotANS = false;
+
+    for (int i = tid; i < numBlocks; i += Threads) {
+      anyNotANS |=
+          (getEncodedBlockCode(compressedWords[i]) & kANSBlockStoredCode) != 0;
     }
 
-    auto probsOut = headerOut->getSymbolProbs();
+    useBlockModes = __syncthreads_or(anyNotANS);
+  }
 
-    // Write out pdf
-    for (int i = tid; i < kNumSymbols; i += Threads) {
-      probsOut[i] = table[i].x;
+  // Every block constructs the header, as the layout of the archive that the
+  // block writes into depends upon it; the first block writes it out
+  ANSCoalescedHeader header{};
+  header.setNumBlocks(numBlocks);
+  header.setTotalUncompressedWords(uncompressedWords);
+  header.setTotalCompressedWords(totalCompressedWords);
+  header.setProbBits(probBits);
+  header.setUseChecksum(useChecksum);
+  header.setBlockSize(blockSize);
+  header.setUseWideState(useWideState);
+  header.setUseDictionary(useDictionary);
+  header.setDictionaryId(useDictionary ? dictionaryId : 0);
+  header.setUseBlockModes(useBlockModes);
+  header.setUseDelta(useDelta);
+  header.setUseBlockChecksum(useBlockChecksum);
+
+  if (!useDictionary) {
+    header.setSymbolProbsFormat(smemNumSymbols, smemMaxPdf);
+  }
+
+  // depends upon the options above
+  header.setMagicAndVersion();
+
+  ANSCoalescedHeader* headerOut = (ANSCoalescedHeader*)out;
+
+  if (block == 0 && tid == 0) {
+    if (useChecksum) {
+      header.setChecksum(*checksum);
+    }
+
+    if (compressedBytes) {
+      *compressedBytes = header.getTotalCompressedSize();
+    }
+
+    *headerOut = header;
+
+    // Write out pdf, unless the decoder has it via the dictionary
+    if (!useDictionary) {
+      headerOut->writeSymbolProbs(table);
     }
   }
 
@@ -580,31 +787,46 @@ __device__ void ansEncodeCoalesce(
   // where our per-warp data lies
   auto uncoalescedBlock = inUncoalescedBlocks + block * uncoalescedBlockStride;
 
+  // Blocks that are not ANS coded have an unused, zeroed warp state
+  uint32_t encodedBlock = compressedWords[block];
+  bool isANS = !(getEncodedBlockCode(encodedBlock) & kANSBlockStoredCode);
+
   // Write per-block warp state
   if (tid < kWarpSize) {
-    auto warpStateIn = (ANSWarpState*)uncoalescedBlock;
+    if (useWideState) {
+      auto warpStateIn = (const ANSWideWarpState*)uncoalescedBlock;
+      auto warpStatesOut =
+          (ANSWideWarpState*)(out + header.getWarpStatesOffset());
+
+      warpStatesOut[block].warpState[tid] =
+          isANS ? warpStateIn->warpState[tid] : ANSWideStateT(0);
+    } else {
+      auto warpStateIn = (const ANSWarpState*)uncoalescedBlock;
+      auto warpStatesOut = (ANSWarpState*)(out + header.getWarpStatesOffset());
 
-    headerOut->getWarpStates()[block].warpState[tid] =
-        warpStateIn->warpState[tid];
+      warpStatesOut[block].warpState[tid] =
+          isANS ? warpStateIn->warpState[tid] : ANSStateT(0);
+    }
   }
 
-  auto blockWordsOut = headerOut->getBlockWords(numBlocks);
+  auto blockWordsOut = (uint2*)(out + header.getBlockWordsOffset(numBlocks));
 
   // Write out per-block word length
   for (int i = blockIdx.x * Threads + tid; i < numBlocks;
        i += gridDim.x * Threads) {
-    uint32_t lastBlockWords = uncompressedWords % kDefaultBlockSize;
-    lastBlockWords = lastBlockWords == 0 ? kDefaultBlockSize : lastBlockWords;
+    uint32_t lastBlockWords = uncompressedWords % blockSize;
+    lastBlockWords = lastBlockWords == 0 ? blockSize : lastBlockWords;
 
-    uint32_t blockWords =
-        (i == numBlocks - 1) ? lastBlockWords : kDefaultBlockSize;
+    uint32_t blockWords = (i == numBlocks - 1) ? lastBlockWords : blockSize;
 
-    blockWordsOut[i] = uint2{
-        (blockWords << 16) | compressedWords[i], compressedWordsPrefix[i]};
+    blockWordsOut[i] = packBlockWords(
+        blockWords,
+        getEncodedBlockCode(compressedWords[i]),
+        compressedWordsPrefix[i]);
   }
 
-  // Number of compressed words in this block
-  uint32_t numWords = compressedWords[block];
+  // Number of data words in this block
+  uint32_t numWords = getEncodedBlockDataWords(encodedBlock);
 
   // We always have a valid multiple of kBlockAlignment bytes on both
   // uncoalesced src and coalesced dest, even though numWords (actual encoded
@@ -612,11 +834,13 @@ __device__ void ansEncodeCoalesce(
   using LoadT = uint4;
   static_assert(sizeof(LoadT) == kBlockAlignment, "");
 
-  uint32_t limitEnd = divUp(numWords, kBlockAlignment / sizeof(ANSEncodedT));
+  uint32_t wordSize = ANSCoalescedHeader::getEncodedWordSize(useWideState);
+  uint32_t limitEnd = divUp(numWords, kBlockAlignment / wordSize);
 
-  auto inT = (const LoadT*)(uncoalescedBlock + sizeof(ANSWarpState));
-  auto outT =
-      (LoadT*)(headerOut->getBlockDataStart(numBlocks) + compressedWordsPrefix[block]);
+  auto inT = (const LoadT*)(uncoalescedBlock +
+                            ANSCoalescedHeader::getWarpStateSize(useWideState));
+  auto outT = (LoadT*)(out + header.getBlockDataOffset(numBlocks) +
+                       compressedWordsPrefix[block] * wordSize);
 
   for (uint32_t i = tid; i < limitEnd; i += Threads) {
     outT[i] = inT[i];
@@ -633,15 +857,23 @@ __global__ void ansEncodeCoalesceBatch(
     const uint32_t* __restrict__ compressedWordsPrefix,
     const uint32_t* __restrict__ checksum,
     const uint4* __restrict__ table,
+    // kNumSymbols, or 0 if all batch members share a single (dictionary) table
+    uint32_t tableStride,
     uint32_t probBits,
     bool useChecksum,
+    bool useWideState,
+    uint32_t dictionaryId,
+    // The reference of each batch member coded in delta mode (optional)
+    const void* const* __restrict__ ref,
+    bool useBlockChecksum,
+    uint32_t blockSize,
     OutProvider outProvider,
     uint32_t* __restrict__ compressedBytes) {
   int batch = blockIdx.y;
   auto uncompressedWords = sizeProvider.getBatchSize(batch);
 
   // Number of compressed blocks in this batch element
-  auto numBlocks = divUp(uncompressedWords, kDefaultBlockSize);
+  auto numBlocks = divUp(uncompressedWords, blockSize);
 
   // Advance all pointers to handle our specific batch member
   inUncoalescedBlocks +=
@@ -650,7 +882,7 @@ __global__ void ansEncodeCoalesceBatch(
   compressedWordsPrefix += batch * maxNumCompressedBlocks;
   compressedBytes += batch;
   checksum += batch;
-  table += batch * kNumSymbols;
+  table += batch * tableStride;
 
   ansEncodeCoalesce<Threads>(
       inUncoalescedBlocks,
@@ -661,12 +893,82 @@ __global__ void ansEncodeCoalesceBatch(
       table,
       probBits,
       useChecksum,
+      useWideState,
+      tableStride == 0,
+      dictionaryId,
+      ref && ref[batch],
+      useBlockChecksum,
+      blockSize,
       numBlocks,
       uncompressedWords,
       (uint8_t*)outProvider.getBatchStart(batch),
       compressedBytes);
 }
 
+// Writes the XOR of each batch member with its reference to out[batch], for
+// members with a reference (ref[batch] != nullptr), which are then coded in
+// delta mode. The XOR is formed once ahead of encoding, as the input is read
+// by the histogram, checksum and encoding kernels in turn
+template <typename InProvider, int Threads>
+__global__ void ansXorBatch(
+    InProvider inProvider,
+    const void* const* __restrict__ ref,
+    void* const* __restrict__ out) {
+  int batch = blockIdx.y;
+
+  if (!ref[batch]) {
+    return;
+  }
+
+  auto in = (const uint8_t*)inProvider.getBatchStart(batch);
+  auto curRef = (const uint8_t*)ref[batch];
+  auto curOut = (uint8_t*)out[batch];
+  uint32_t size = inProvider.getBatchSize(batch);
+
+  // out is aligned to a uint4 word, so we can proceed by uint4 words
+  // if the input and reference are as well
+  uint32_t numU4 = 0;
+
+  if (isPointerAligned(in, sizeof(uint4)) &&
+      isPointerAligned(curRef, sizeof(uint4))) {
+    numU4 = size / sizeof(uint4);
+
+    for (uint32_t i = blockIdx.x * Threads + threadIdx.x; i < numU4;
+         i += gridDim.x * Threads) {
+      uint4 v = ((const uint4*)in)[i];
+      uint4 r = ((const uint4*)curRef)[i];
+
+      ((uint4*)curOut)[i] =
+          make_uint4(v.x ^ r.x, v.y ^ r.y, v.z ^ r.z, v.w ^ r.w);
+    }
+  }
+
+  for (uint32_t i = numU4 * sizeof(uint4) + blockIdx.x * Threads + threadIdx.x;
+       i < size;
+       i += gridDim.x * Threads) {
+    curOut[i] = in[i] ^ curRef[i];
+  }
+}
+
+// The block checksums of the archives written by ansEncodeCoalesceBatch, for
+// blockChecksumBatch
+template <typename OutProvider>
+struct ANSBlockChecksumOut {
+  __device__ ANSCoalescedHeader* getHeader(uint32_t batch) {
+    return (ANSCoalescedHeader*)outProvider.getBatchStart(batch);
+  }
+
+  __device__ uint32_t* getBlockChecksums(uint32_t batch) {
+    return getHeader(batch)->getBlockChecksums();
+  }
+
+  __device__ uint32_t getBytes(uint32_t batch) {
+    return getHeader(batch)->getTotalUncompressedWords() * sizeof(ANSDecodedT);
+  }
+
+  OutProvider outProvider;
+};
+
 template <typename InProvider, typename OutProvider>
 void ansEncodeBatchDevice(
     StackDeviceMemory& res,
@@ -677,15 +979,44 @@ void ansEncodeBatchDevice(
     uint32_t maxSize,
     OutProvider outProvider,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    // Optional device array of numInBatch device pointers to the reference of
+    // each batch member coded in delta mode, or nullptr for the others. The
+    // input of such a member is the XOR of the data with the reference (see
+    // ansXorBatch), and its block checksums are of the data
+    const void* const* ref_dev = nullptr) {
+  CHECK(isValidANSProbBits(config.probBits))
+      << "unhandled pdf precision " << config.probBits;
+  CHECK(isValidANSBlockSize(config.blockSize))
+      << "unsupported block size " << config.blockSize;
+
   auto maxUncompressedWords = maxSize / sizeof(ANSDecodedT);
   uint32_t maxNumCompressedBlocks =
-      divUp(maxUncompressedWords, kDefaultBlockSize);
-
-  // 1. Compute symbol statistics
-  auto table_dev = res.alloc<uint4>(stream, numInBatch * kNumSymbols);
-
-  if (histogram_dev) {
+      divUp(maxUncompressedWords, config.blockSize);
+
+  auto dict = config.dictionary;
+  CHECK(!dict || dict->getProbBits() == config.probBits)
+      << "dictionary precision " << dict->getProbBits()
+      << " does not match probBits " << config.probBits;
+
+  // Context modeling, segments and shuffling are only implemented by the host
+  // codec at present
+  CHECK_EQ(config.numContexts, 1)
+      << "contexts are not supported by the GPU encoder";
+  CHECK_EQ(config.maxSegments, 1)
+      << "segments are not supported by the GPU encoder";
+  CHECK_EQ(config.shuffleWidth, 1)
+      << "shuffling is not supported by the GPU encoder";
+
+  // 1. Compute symbol statistics. With a dictionary, all batch members share
+  // its resident encoding table instead
+  uint32_t tableStride = dict ? 0 : kNumSymbols;
+  auto table_dev = res.alloc<uint4>(stream, numInBatch * tableStride);
+  auto table = dict ? dict->getEncodeTableDevice(stream) : table_dev.data();
+
+  if (dict) {
+    // the dictionary tables are used as-is
+  } else if (histogram_dev) {
     // use pre-calculated histogram
     ansCalcWeights(
         numInBatch,
@@ -719,7 +1050,7 @@ void ansEncodeBatchDevice(
   // 3. Allocate memory for the per-warp results
   // How much space in bytes we need to reserve for each warp's output
   uint32_t uncoalescedBlockStride =
-      getMaxBlockSizeUnCoalesced(kDefaultBlockSize);
+      getMaxBlockSizeUnCoalesced(config.blockSize, config.useWideState);
 
   auto compressedBlocks_dev = res.alloc<uint8_t>(
       stream, numInBatch * maxNumCompressedBlocks * uncoalescedBlockStride);
@@ -746,74 +1077,86 @@ void ansEncodeBatchDevice(
     // in the batch
     auto gridPartial = dim3(1, numInBatch);
 
-#define RUN_ENCODE(BITS)                                       \
-  do {                                                         \
-    ansEncodeBatchFull<InProvider, BITS, kDefaultBlockSize>    \
-        <<<gridFull, kThreads, 0, stream>>>(                   \
-            inProvider,                                        \
-            maxNumCompressedBlocks,                            \
-            uncoalescedBlockStride,                            \
-            compressedBlocks_dev.data(),                       \
-            compressedWords_dev.data(),                        \
-            table_dev.data());                                 \
-                                                               \
-    ansEncodeBatchPartial<InProvider, BITS, kDefaultBlockSize> \
-        <<<gridPartial, kThreads, 0, stream>>>(                \
-            inProvider,                                        \
-            maxNumCompressedBlocks,                            \
-            uncoalescedBlockStride,                            \
-            compressedBlocks_dev.data(),                       \
-            compressedWords_dev.data(),                        \
-            table_dev.data());                                 \
+#define RUN_ENCODE(BITS, WIDE)                    \
+  do {                                            \
+    ansEncodeBatchFull<InProvider, BITS, WIDE>    \
+        <<<gridFull, kThreads, 0, stream>>>(      \
+            inProvider,                           \
+            config.blockSize,                     \
+            maxNumCompressedBlocks,               \
+            uncoalescedBlockStride,               \
+            compressedBlocks_dev.data(),          \
+            compressedWords_dev.data(),           \
+            table,                                \
+            tableStride);                         \
+                                                  \
+    ansEncodeBatchPartial<InProvider, BITS, WIDE> \
+        <<<gridPartial, kThreads, 0, stream>>>(   \
+            inProvider,                           \
+            config.blockSize,                     \
+            maxNumCompressedBlocks,               \
+            uncoalescedBlockStride,               \
+            compressedBlocks_dev.data(),          \
+            compressedWords_dev.data(),           \
+            table,                                \
+            tableStride);                         \
+  } while (false)
+
+#define RUN_ENCODE_ALL(BITS)   \
+  do {                         \
+    if (config.useWideState) { \
+      RUN_ENCODE(BITS, true);  \
+    } else {                   \
+      RUN_ENCODE(BITS, false); \
+    }                          \
   } while (false)
 
     switch (config.probBits) {
       case 9:
-        RUN_ENCODE(9);
+        RUN_ENCODE_ALL(9);
         break;
       case 10:
-        RUN_ENCODE(10);
+        RUN_ENCODE_ALL(10);
         break;
       case 11:
-        RUN_ENCODE(11);
+        RUN_ENCODE_ALL(11);
+        break;
+      case 12:
+        RUN_ENCODE_ALL(12);
+        break;
+      case 13:
+        RUN_ENCODE_ALL(13);
+        break;
+      case 14:
+        RUN_ENCODE_ALL(14);
         break;
       default:
         CHECK(false) << "unhandled pdf precision " << config.probBits;
     }
 
+#undef RUN_ENCODE_ALL
 #undef RUN_ENCODE
   }
 
   // Perform exclusive prefix sum of the number of compressed words per block,
   // so we know where to write the output. We align the blocks so that we can
   // write state values at 4 byte alignment at the beginning.
-  // FIXME: probably some way to do this via thrust::exclusive_scan_by_key with
-  // transform iterators and what not
   if (maxNumCompressedBlocks > 0) {
-    auto sizeRequired =
-        getBatchExclusivePrefixSumTempSize(numInBatch, maxNumCompressedBlocks);
-
-    // FIXME: we can run a more minimal segmented prefix sum instead of using
-    // maxNumCompressedBlocks
-    if (sizeRequired == 0) {
-      batchExclusivePrefixSum<uint32_t, Align<ANSEncodedT, kBlockAlignment>>(
+    if (config.useWideState) {
+      ansCompressedWordsPrefixSum<ANSWideEncodedT>(
+          res,
           compressedWords_dev.data(),
           compressedWordsPrefix_dev.data(),
-          nullptr,
           numInBatch,
           maxNumCompressedBlocks,
-          Align<ANSEncodedT, kBlockAlignment>(),
           stream);
     } else {
-      auto tempPrefixSum_dev = res.alloc<uint8_t>(stream, sizeRequired);
-
-      batchExclusivePrefixSum<uint32_t, Align<ANSEncodedT, kBlockAlignment>>(
+      ansCompressedWordsPrefixSum<ANSEncodedT>(
+          res,
           compressedWords_dev.data(),
           compressedWordsPrefix_dev.data(),
-          tempPrefixSum_dev.data(),
           numInBatch,
           maxNumCompressedBlocks,
-          Align<ANSEncodedT, kBlockAlignment>(),
           stream);
     }
   }
@@ -834,13 +1177,32 @@ void ansEncodeBatchDevice(
             compressedWords_dev.data(),
             compressedWordsPrefix_dev.data(),
             checksum_dev.data(),
-            table_dev.data(),
+            table,
+            tableStride,
             config.probBits,
             config.useChecksum,
+            config.useWideState,
+            dict ? dict->getId() : 0,
+            ref_dev,
+            config.useBlockChecksum,
+            config.blockSize,
             outProvider,
             outSize_dev);
   }
 
+  // 4. Compute block checksums on the input data (optional), written to the
+  // end of the archive now that its layout is known
+  if (config.useBlockChecksum) {
+    blockChecksumBatch(
+        res,
+        numInBatch,
+        inProvider,
+        ANSBlockChecksumOut<OutProvider>{outProvider},
+        maxUncompressedWords * sizeof(ANSDecodedT),
+        stream,
+        ref_dev);
+  }
+
   CUDA_TEST_ERROR();
 }
 
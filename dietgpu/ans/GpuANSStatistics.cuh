@@ -189,8 +189,14 @@ __device__ void normalizeProbabilitiesFromHistogram(
   constexpr int kNumSymPerThread =
       kNumSymbols == Threads ? 1 : (kNumSymbols / Threads);
 
-  // There's nothing to do if the input array in the batch was of zero size
+  // There's nothing to do if the input array in the batch was of zero size,
+  // other than produce an empty pdf (which determines the size of the archive
+  // header)
   if (totalNum == 0) {
+    for (int i = threadIdx.x; i < kNumSymbols; i += Threads) {
+      table[i] = uint4{0, 0, 0, 0};
+    }
+
     return;
   }
 
@@ -9,6 +9,10 @@
 
 #include <assert.h>
 #include <cuda.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "dietgpu/ans/GpuANSCodec.h"
 #include "dietgpu/utils/DeviceDefs.cuh"
 #include "dietgpu/utils/StaticUtils.h"
 
@@ -18,6 +22,11 @@ using ANSStateT = uint32_t;
 using ANSEncodedT = uint16_t;
 using ANSDecodedT = uint8_t;
 
+// State and renormalization word types for archives using wide states (see
+// ANSCodecConfig::useWideState)
+using ANSWideStateT = uint64_t;
+using ANSWideEncodedT = uint32_t;
+
 struct __align__(16) ANSDecodedTx16 {
   ANSDecodedT x[16];
 };
@@ -34,7 +43,7 @@ constexpr uint32_t kNumSymbols = 1 << (sizeof(ANSDecodedT) * 8);
 static_assert(kNumSymbols > 1, "");
 
 // Default block size for compression (in bytes)
-constexpr uint32_t kDefaultBlockSize = 4096;
+constexpr uint32_t kDefaultBlockSize = kANSDefaultBlockSize;
 
 // limit state to 2^31 - 1, so as to prevent addition overflow in the integer
 // division via mul and shift by constants
@@ -48,45 +57,579 @@ constexpr ANSStateT kANSStartState = ANSStateT(1)
 constexpr ANSStateT kANSMinState = ANSStateT(1)
     << (kANSStateBits - kANSEncodedBits);
 
+// Wide states are likewise limited to 2^63 - 1, and are renormalized by 32
+// bits at a time
+constexpr int kANSWideStateBits = sizeof(ANSWideStateT) * 8 - 1;
+constexpr int kANSWideEncodedBits = sizeof(ANSWideEncodedT) * 8;
+constexpr ANSWideStateT kANSWideEncodedMask =
+    (ANSWideStateT(1) << kANSWideEncodedBits) - ANSWideStateT(1);
+
+constexpr ANSWideStateT kANSWideStartState = ANSWideStateT(1)
+    << (kANSWideStateBits - kANSWideEncodedBits);
+constexpr ANSWideStateT kANSWideMinState = ANSWideStateT(1)
+    << (kANSWideStateBits - kANSWideEncodedBits);
+
 // magic number to verify archive integrity
 constexpr uint32_t kANSMagic = 0xd00d;
 
-// current DietGPU version number
-constexpr uint32_t kANSVersion = 0x0001;
+// current DietGPU version number. Archives are written with the oldest version
+// that can represent them (see ANSCoalescedHeader::getRequiredVersion): wide
+// states require version 2, dictionaries version 3, compact pdfs version 4,
+// block modes version 5, contexts version 6, segments version 7, byte
+// shuffling version 8, deltas version 9 and block checksums version 10
+constexpr uint32_t kANSVersion = 0x000a;
+
+// oldest version that we can decode
+constexpr uint32_t kANSMinVersion = 0x0001;
+
+// Size in bytes of the block checksums of `bytes` bytes of data (see
+// ANSCodecConfig::useBlockChecksum): a CRC32C per kANSChecksumBlockSize block
+// of the data, followed by the CRC32C of all of it, padded to 16 bytes
+inline __host__ __device__ uint32_t getBlockChecksumSize(uint64_t bytes) {
+  uint32_t numBlocks = divUp(bytes, (uint64_t)kANSChecksumBlockSize);
+  return roundUp((numBlocks + 1) * (uint32_t)sizeof(uint32_t), 16U);
+}
+
+// Records a batch member whose block checksums did not match, as
+// ANSDecodeStatus::failedBlocks and errorInfo hold them. `failed` holds the
+// indices of the failed blocks of its numBlocks blocks, and is empty if only
+// the checksum of all of them did not match. Shared by the host and GPU
+// decoders
+void addBlockChecksumFailure(
+    int batch,
+    std::vector<uint32_t> failed,
+    size_t numBlocks,
+    std::vector<std::pair<int, std::vector<uint32_t>>>& failedBlocks,
+    std::vector<std::pair<int, std::string>>& errorInfo);
 
 // Each block of compressed data (either coalesced or uncoalesced) is aligned to
 // this number of bytes and has a valid (if not all used) segment with this
 // multiple of bytes
 constexpr uint32_t kBlockAlignment = 16;
 
+// maximum raw compressed data block size in bytes, before the block is
+// possibly stored instead (see ANSBlockMode). With a pdf not derived from the
+// block itself (from other blocks, or a dictionary), each symbol may add up to
+// about probBits + 1 < 16 bits to the state. Each lane writes at most one
+// ANSEncodedT word per symbol, and at most one ANSWideEncodedT word per two
+// symbols plus a final word
+constexpr __host__ __device__ uint32_t
+getRawCompBlockMaxSize(uint32_t uncompressedBlockBytes) {
+  return roundUp(
+      2 * uncompressedBlockBytes + kWarpSize * sizeof(ANSWideEncodedT),
+      kBlockAlignment);
+}
+
+// Decoding lookup table entry, indexed by (state & (2^probBits - 1))
+using TableT = uint32_t;
+
+// The packed table entry is limited to 11 bits of probability resolution
+// (worst case, prec = 12, pdf == 2^12, single symbol. 2^12 cannot be
+// represented in 12 bits); see ansDecodeLookup for higher resolutions
+inline __host__ __device__ TableT
+packDecodeLookup(uint32_t sym, uint32_t pdf, uint32_t cdf) {
+  static_assert(sizeof(ANSDecodedT) == 1, "");
+  // [31:20] cdf
+  // [19:8] pdf
+  // [7:0] symbol
+  return (cdf << 20) | (pdf << 8) | sym;
+}
+
+inline __host__ __device__ void
+unpackDecodeLookup(TableT v, uint32_t& sym, uint32_t& pdf, uint32_t& cdf) {
+  // [31:20] cdf
+  // [19:8] pdf
+  // [7:0] symbol
+  sym = v & 0xffU;
+  v >>= 8;
+  pdf = v & 0xfffU;
+  v >>= 12;
+  cdf = v;
+}
+
+// Highest probBits whose decoding table uses the packed entry above. Beyond
+// this, the table is split into a uint8 symbol per bucket (2^probBits bytes)
+// followed by a {pdf, cdf} TableT entry per symbol; this needs a dependent
+// second lookup, but is also smaller than a packed table would be
+constexpr int kANSMaxPackedProbBits = 11;
+
+// Size of the decoding table in TableT words for the given probBits. This is
+// always a multiple of 4, so tables may be loaded as uint4
+inline __host__ __device__ constexpr uint32_t getANSDecodeTableWords(
+    int probBits) {
+  return probBits <= kANSMaxPackedProbBits
+      ? (1U << probBits)
+      : (1U << probBits) / sizeof(TableT) + kNumSymbols;
+}
+
+// {pdf, cdf} entry of the split decoding table
+inline __host__ __device__ TableT packDecodeSymbol(uint32_t pdf, uint32_t cdf) {
+  // [31:16] cdf
+  // [15:0] pdf
+  return (cdf << 16) | pdf;
+}
+
+// Looks up the symbol, pdf and (sBar - cdf) for sBar = state & (2^ProbBits - 1)
+// in a decoding table of either layout
+template <int ProbBits>
+inline __host__ __device__ void ansDecodeLookup(
+    const TableT* __restrict__ table,
+    uint32_t sBar,
+    uint32_t& sym,
+    uint32_t& pdf,
+    uint32_t& sMinusCdf) {
+  if (ProbBits <= kANSMaxPackedProbBits) {
+    unpackDecodeLookup(table[sBar], sym, pdf, sMinusCdf);
+  } else {
+    sym = ((const uint8_t*)table)[sBar];
+
+    auto v = table[(1U << ProbBits) / sizeof(TableT) + sym];
+    pdf = v & 0xffffU;
+    sMinusCdf = sBar - (v >> 16);
+  }
+}
+
+// Fills the decoding table (getANSDecodeTableWords(probBits) words) for a pdf
+// that sums to 2^probBits, in the same layout that ansDecodeTable produces
+inline __host__ __device__ void
+ansFillDecodeTable(const uint16_t* probs, int probBits, TableT* table) {
+  bool packed = probBits <= kANSMaxPackedProbBits;
+
+  // For the split table, the symbol for each bucket followed by the pdf/cdf
+  // for each symbol
+  auto symbols = (uint8_t*)table;
+  auto symbolInfo = table + (1U << probBits) / sizeof(TableT);
+
+  uint32_t cdf = 0;
+
+  for (uint32_t sym = 0; sym < kNumSymbols; ++sym) {
+    uint32_t pdf = probs[sym];
+
+    if (packed) {
+      for (uint32_t j = 0; j < pdf; ++j) {
+        table[cdf + j] = packDecodeLookup(sym, pdf, j);
+      }
+    } else {
+      for (uint32_t j = 0; j < pdf; ++j) {
+        symbols[cdf + j] = sym;
+      }
+
+      symbolInfo[sym] = packDecodeSymbol(pdf, cdf);
+    }
+
+    cdf += pdf;
+  }
+}
+
+// The per-block index entry (see ANSCoalescedHeader) holds the uncompressed
+// and compressed word counts of the block in 16 bits each. As a block is never
+// empty, an uncompressed count of 0 denotes 2^16 words (a full block of
+// kANSMaxBlockSize). Blocks whose ANS coded data would not be smaller than the
+// input are stored (see ANSBlockMode), so the compressed count always fits
+static_assert(kANSMaxBlockSize <= 65536, "");
+
+inline __host__ __device__ uint2 packBlockWords(
+    uint32_t uncompressedWords,
+    uint32_t compressedWords,
+    uint32_t compressedWordStart) {
+  return uint2{
+      ((uncompressedWords & 0xffffU) << 16) | compressedWords,
+      compressedWordStart};
+}
+
+inline __host__ __device__ uint32_t getBlockUncompressedWords(uint2 bw) {
+  uint32_t words = bw.x >> 16;
+  return words == 0 ? 65536 : words;
+}
+
+inline __host__ __device__ uint32_t getBlockCompressedWords(uint2 bw) {
+  return bw.x & 0xffffU;
+}
+
+inline __host__ __device__ uint32_t getBlockCompressedWordStart(uint2 bw) {
+  return bw.y;
+}
+
+// The coding mode of a block (see ANSCoalescedHeader::getUseBlockModes)
+enum class ANSBlockMode : uint32_t {
+  // rANS coded data
+  ANS = 0,
+  // The raw input, as ANS coding would not have made it smaller
+  Stored = 1,
+  // A single repeated symbol, with no data
+  Constant = 2,
+};
+
+// In archives using block modes, the compressed word count of a block index
+// entry holds a code for the mode. ANS coded blocks are always smaller than
+// their input and thus leave the highest bit of the count clear; it is set for
+// stored blocks, and together with the next highest bit for constant blocks,
+// whose symbol is held in the low bits
+constexpr uint32_t kANSBlockStoredCode = 0x8000U;
+constexpr uint32_t kANSBlockConstantCode = 0xc000U;
+
+static_assert(
+    kANSMaxBlockSize / sizeof(ANSEncodedT) <= kANSBlockStoredCode,
+    "");
+
+inline __host__ __device__ uint32_t
+getBlockCode(ANSBlockMode mode, uint32_t compressedWords, ANSDecodedT sym) {
+  switch (mode) {
+    case ANSBlockMode::Stored:
+      return kANSBlockStoredCode;
+    case ANSBlockMode::Constant:
+      return kANSBlockConstantCode | sym;
+    default:
+      return compressedWords;
+  }
+}
+
+inline __host__ __device__ ANSDecodedT getBlockConstantSymbol(uint2 bw) {
+  return bw.x & 0xffU;
+}
+
+// In archives using contexts (see ANSCodecConfig::numContexts), lane i of the
+// warp codes the contiguous stripe of symbols
+// [i * stripe, min((i + 1) * stripe, n)) of a block of n symbols, rather than
+// every 32nd symbol, so that the neighbor of each symbol is coded by the same
+// lane. As the decoder runs backwards, the context of a symbol is that of the
+// following symbol in its stripe (which is decoded first), or that of symbol
+// 0 for the last symbol of a stripe
+inline __host__ __device__ uint32_t getContextStripeSize(uint32_t blockWords) {
+  return divUp(blockWords, (uint32_t)kWarpSize);
+}
+
+// Precedes the pdfs in archives holding more than one (using contexts or
+// segments)
+struct ANSTableInfo {
+  // With contexts, the symbol whose context is c, for each context c > 0; all
+  // other symbols have context 0. Unused with segments
+  uint8_t symbol[kANSMaxTables];
+
+  // Bits per packed pdf - 1 of the compact pdf of each context or segment
+  uint8_t pdfBits[kANSMaxTables];
+};
+
+static_assert(
+    isEvenDivisor(sizeof(ANSTableInfo), (size_t)kBlockAlignment),
+    "");
+
+// In segmented archives, the word start of a block index entry holds the
+// segment of the block in its high bits, and the start of its data in units of
+// kBlockAlignment (to which it is aligned) in the remainder
+constexpr uint32_t kANSSegmentShift = 28;
+constexpr uint32_t kANSSegmentStartMask = (1U << kANSSegmentShift) - 1;
+
+static_assert(kANSMaxSegments <= (1U << (32 - kANSSegmentShift)), "");
+
 struct ANSWarpState {
   // The ANS state data for this warp
   ANSStateT warpState[kWarpSize];
 };
 
+struct ANSWideWarpState {
+  // The ANS state data for this warp
+  ANSWideStateT warpState[kWarpSize];
+};
+
+static_assert(isEvenDivisor(sizeof(ANSWarpState), (size_t)kBlockAlignment), "");
+static_assert(
+    isEvenDivisor(sizeof(ANSWideWarpState), (size_t)kBlockAlignment),
+    "");
+
+inline __host__ __device__ uint32_t ansPopc(uint32_t v) {
+#ifdef __CUDA_ARCH__
+  return __popc(v);
+#else
+  return __builtin_popcount(v);
+#endif
+}
+
+// High 32 bits of the 64 bit product a * b
+inline __host__ __device__ uint32_t ansMulHi(uint32_t a, uint32_t b) {
+#ifdef __CUDA_ARCH__
+  return __umulhi(a, b);
+#else
+  return uint32_t((uint64_t(a) * b) >> 32);
+#endif
+}
+
+// High 64 bits of the 128 bit product a * b
+inline __host__ __device__ uint64_t ansMulHi(uint64_t a, uint64_t b) {
+#ifdef __CUDA_ARCH__
+  return __umul64hi(a, b);
+#else
+  return uint64_t(((unsigned __int128)a * b) >> 64);
+#endif
+}
+
+// The {pdf, cdf, div_m1, div_shift} encoding table entry for a symbol, where
+// div_m1 and div_shift implement division by pdf via multiplication and shift
+inline __host__ __device__ uint4
+makeANSEncodeTableEntry(uint32_t pdf, uint32_t cdf) {
+  uint32_t shift = 0;
+  uint32_t magic = 0;
+
+  if (pdf > 0) {
+    // ceil(log2(pdf))
+    while ((1U << shift) < pdf) {
+      ++shift;
+    }
+
+    constexpr uint64_t one = 1;
+    uint64_t magic64 = ((one << 32) * ((one << shift) - pdf)) / pdf + 1;
+
+    // should not overflow
+    magic = (uint32_t)magic64;
+  }
+
+  return uint4{pdf, cdf, magic, shift};
+}
+
+// Encoding table entry for wide states: the 64 bit equivalent of the
+// {pdf, cdf, div_m1, div_shift} encoding table entry, such that
+// s / pdf == (mulhi(s, divM1) + s) >> divShift for all s < 2^63
+struct __align__(16) ANSWideEncodeLookup {
+  uint64_t divM1;
+  uint32_t pdf;
+  uint16_t cdf;
+  uint16_t divShift;
+};
+
+static_assert(sizeof(ANSWideEncodeLookup) == sizeof(uint4), "");
+
+inline __host__ __device__ ANSWideEncodeLookup
+makeANSWideEncodeLookup(uint4 lookup) {
+  uint32_t pdf = lookup.x;
+  uint32_t shift = lookup.w;
+
+  // The 32 bit div_m1 is floor(2^32 * (2^shift - pdf) / pdf) + 1; we extend
+  // the long division by another 32 bits
+  uint64_t divM1 = 0;
+  if (pdf > 0) {
+    uint64_t num = ((uint64_t(1) << shift) - pdf) << 32;
+    uint64_t hi = num / pdf;
+    uint64_t lo = ((num - hi * pdf) << 32) / pdf;
+
+    divM1 = (hi << 32) + lo + 1;
+  }
+
+  return ANSWideEncodeLookup{divM1, pdf, uint16_t(lookup.y), uint16_t(shift)};
+}
+
+// Computes the encoder state transition
+// ((s / pdf) << ProbBits) + (s % pdf) + cdf, with the division performed via
+// multiplication and shift
+template <int ProbBits>
+inline __host__ __device__ ANSStateT
+ansEncodeState(ANSStateT s, const uint4& lookup) {
+  uint32_t pdf = lookup.x;
+  uint32_t cdf = lookup.y;
+  uint32_t div_m1 = lookup.z;
+  uint32_t div_shift = lookup.w;
+
+  uint32_t t = ansMulHi(s, div_m1);
+  // We prevent addition overflow here by restricting `state` to < 2^31
+  // (kANSStateBits)
+  uint32_t div = (t + s) >> div_shift;
+  auto mod = s - (div * pdf);
+
+  constexpr uint32_t kProbBitsMul = 1 << ProbBits;
+  return div * kProbBitsMul + mod + cdf;
+}
+
+template <int ProbBits>
+inline __host__ __device__ ANSWideStateT
+ansEncodeState(ANSWideStateT s, const ANSWideEncodeLookup& lookup) {
+  uint64_t t = ansMulHi(s, lookup.divM1);
+  // We prevent addition overflow here by restricting `state` to < 2^63
+  // (kANSWideStateBits)
+  uint64_t div = (t + s) >> lookup.divShift;
+  auto mod = s - (div * lookup.pdf);
+
+  return (div << ProbBits) + mod + lookup.cdf;
+}
+
+// Types and constants for archives of either state width, for code that is
+// templated on the state width
+template <bool Wide>
+struct ANSStateInfo;
+
+template <>
+struct ANSStateInfo<false> {
+  using StateT = ANSStateT;
+  using EncodedT = ANSEncodedT;
+  using WarpState = ANSWarpState;
+  using EncodeLookup = uint4;
+
+  static constexpr int kStateBits = kANSStateBits;
+  static constexpr int kEncodedBits = kANSEncodedBits;
+
+  static __host__ __device__ StateT getStartState() {
+    return kANSStartState;
+  }
+
+  static __host__ __device__ StateT getMinState() {
+    return kANSMinState;
+  }
+
+  static __host__ __device__ EncodeLookup makeEncodeLookup(uint4 lookup) {
+    return lookup;
+  }
+
+  static __host__ __device__ uint32_t getPdf(const EncodeLookup& lookup) {
+    return lookup.x;
+  }
+};
+
+template <>
+struct ANSStateInfo<true> {
+  using StateT = ANSWideStateT;
+  using EncodedT = ANSWideEncodedT;
+  using WarpState = ANSWideWarpState;
+  using EncodeLookup = ANSWideEncodeLookup;
+
+  static constexpr int kStateBits = kANSWideStateBits;
+  static constexpr int kEncodedBits = kANSWideEncodedBits;
+
+  static __host__ __device__ StateT getStartState() {
+    return kANSWideStartState;
+  }
+
+  static __host__ __device__ StateT getMinState() {
+    return kANSWideMinState;
+  }
+
+  static __host__ __device__ EncodeLookup makeEncodeLookup(uint4 lookup) {
+    return makeANSWideEncodeLookup(lookup);
+  }
+
+  static __host__ __device__ uint32_t getPdf(const EncodeLookup& lookup) {
+    return lookup.pdf;
+  }
+};
+
 struct __align__(32) ANSCoalescedHeader {
   static __host__ __device__ uint32_t getCompressedOverhead(
-      uint32_t numBlocks) {
+      uint32_t numBlocks,
+      bool useWideState = false,
+      bool useDictionary = false,
+      uint32_t numTables = 1) {
     constexpr int kAlignment = kBlockAlignment / sizeof(uint2) == 0
         ? 1
         : kBlockAlignment / sizeof(uint2);
 
     return sizeof(ANSCoalescedHeader) +
-        // probs
-        sizeof(uint16_t) * kNumSymbols +
+        // probs (at most)
+        getSymbolProbsSize(useDictionary, numTables) +
         // states
-        sizeof(ANSWarpState) * numBlocks +
+        getWarpStateSize(useWideState) * numBlocks +
         // block words
         sizeof(uint2) * roundUp(numBlocks, kAlignment);
   }
 
+  // The maximum size of the pdf (or of numTables pdfs, one per context or
+  // segment); archives using a dictionary do not hold their own pdf
+  static __host__ __device__ uint32_t
+  getSymbolProbsSize(bool useDictionary, uint32_t numTables = 1) {
+    if (useDictionary) {
+      return 0;
+    }
+
+    return numTables > 1 ? getMaxTableProbsSize(numTables)
+                         : sizeof(uint16_t) * kNumSymbols;
+  }
+
+  // The maximum size of the pdfs of an archive holding more than one: the
+  // ANSTableInfo, followed by the compact pdf of each
+  static __host__ __device__ uint32_t
+  getMaxTableProbsSize(uint32_t numTables) {
+    uint32_t maxPdfBits = getCompactProbsBitsFor(1U << kANSMaxProbBits);
+
+    return sizeof(ANSTableInfo) +
+        numTables * getCompactSymbolProbsSize(kNumSymbols, maxPdfBits);
+  }
+
+  // Size of the compact pdf (see setSymbolProbsFormat): a bitmap of the
+  // symbols present, followed by pdf - 1 of each present symbol packed in
+  // pdfBits bits each, padded to kBlockAlignment
+  static __host__ __device__ uint32_t
+  getCompactSymbolProbsSize(uint32_t numSymbols, uint32_t pdfBits) {
+    return roundUp(
+        kNumSymbols / 8 + divUp(numSymbols * pdfBits, 8U), kBlockAlignment);
+  }
+
+  // The number of bits needed to hold pdf - 1 for all pdfs up to maxPdf
+  static __host__ __device__ uint32_t getCompactProbsBitsFor(uint32_t maxPdf) {
+    uint32_t pdfBits = 1;
+    while (maxPdf > 0 && ((maxPdf - 1) >> pdfBits) != 0) {
+      ++pdfBits;
+    }
+
+    return pdfBits;
+  }
+
+  // The actual size of the pdf (or of all pdfs) in the archive
+  __host__ __device__ uint32_t getSymbolProbsSize() const {
+    if (getNumTables() > 1) {
+      return tableProbsSize;
+    }
+
+    if (getUseCompactProbs()) {
+      return getCompactSymbolProbsSize(
+          getCompactProbsNumSymbols(), getCompactProbsBits());
+    }
+
+    return getSymbolProbsSize(getUseDictionary());
+  }
+
+  static __host__ __device__ uint32_t getWarpStateSize(bool useWideState) {
+    return useWideState ? sizeof(ANSWideWarpState) : sizeof(ANSWarpState);
+  }
+
+  static __host__ __device__ uint32_t getEncodedWordSize(bool useWideState) {
+    return useWideState ? sizeof(ANSWideEncodedT) : sizeof(ANSEncodedT);
+  }
+
+  // Number of encoded words holding a stored block of uncompressedWords
+  static __host__ __device__ uint32_t
+  getStoredBlockWords(uint32_t uncompressedWords, bool useWideState) {
+    return divUp(
+        uncompressedWords * (uint32_t)sizeof(ANSDecodedT),
+        getEncodedWordSize(useWideState));
+  }
+
+  // Chooses the mode of a block of uncompressedWords: a block holding a single
+  // repeated symbol is constant, and one that ANS coding (into
+  // compressedWords) would not shrink is stored
+  static __host__ __device__ ANSBlockMode chooseBlockMode(
+      bool isConstant,
+      uint32_t uncompressedWords,
+      uint32_t compressedWords,
+      bool useWideState) {
+    if (isConstant) {
+      return ANSBlockMode::Constant;
+    }
+
+    return compressedWords * getEncodedWordSize(useWideState) >=
+            uncompressedWords * sizeof(ANSDecodedT)
+        ? ANSBlockMode::Stored
+        : ANSBlockMode::ANS;
+  }
+
   __host__ __device__ uint32_t getTotalCompressedSize() const {
+    if (getUseBlockChecksum()) {
+      return getBlockChecksumsOffset() +
+          getBlockChecksumSize(getTotalUncompressedWords());
+    }
+
     return getCompressedOverhead() +
-        getTotalCompressedWords() * sizeof(ANSEncodedT);
+        getTotalCompressedWords() * getEncodedWordSize(getUseWideState());
   }
 
   __host__ __device__ uint32_t getCompressedOverhead() const {
-    return getCompressedOverhead(getNumBlocks());
+    return getCompressedOverhead(getNumBlocks(), getUseWideState(), true) +
+        getSymbolProbsSize();
   }
 
   __host__ __device__ float getCompressionRatio() const {
@@ -102,13 +645,52 @@ struct __align__(32) ANSCoalescedHeader {
     numBlocks = nb;
   }
 
+  // The oldest version able to represent an archive with our options
+  __host__ __device__ uint32_t getRequiredVersion() const {
+    // block checksums were introduced in version 10, deltas in version 9, byte
+    // shuffling in version 8, segments in version 7, contexts in version 6,
+    // block modes in version 5, compact pdfs in version 4, dictionaries in
+    // version 3 and wide states in version 2
+    if (getUseBlockChecksum()) {
+      return 10;
+    } else if (getUseDelta()) {
+      return 9;
+    } else if (getShuffleWidth() > 1) {
+      return 8;
+    } else if (getUseSegments()) {
+      return 7;
+    } else if (getUseContexts()) {
+      return 6;
+    } else if (getUseBlockModes()) {
+      return 5;
+    } else if (getUseCompactProbs()) {
+      return 4;
+    } else if (getUseDictionary()) {
+      return 3;
+    } else if (getUseWideState()) {
+      return 2;
+    }
+
+    return kANSMinVersion;
+  }
+
+  // Archives are written with the oldest version able to represent them, so
+  // this must be called after all options are set
   __host__ __device__ void setMagicAndVersion() {
-    magicAndVersion = (kANSMagic << 16) | kANSVersion;
+    magicAndVersion = (kANSMagic << 16) | getRequiredVersion();
+  }
+
+  __host__ __device__ uint32_t getVersion() const {
+    return magicAndVersion & 0xffffU;
+  }
+
+  __host__ __device__ bool isValidMagicAndVersion() const {
+    return (magicAndVersion >> 16) == kANSMagic &&
+        getVersion() >= getRequiredVersion() && getVersion() <= kANSVersion;
   }
 
   __host__ __device__ void checkMagicAndVersion() const {
-    assert((magicAndVersion >> 16) == kANSMagic);
-    assert((magicAndVersion & 0xffffU) == kANSVersion);
+    assert(isValidMagicAndVersion());
   }
 
   __host__ __device__ uint32_t getTotalUncompressedWords() const {
@@ -144,6 +726,407 @@ struct __align__(32) ANSCoalescedHeader {
     options = (options & 0xffffffef) | (uint32_t(uc) << 4);
   }
 
+  // The block size is stored as log2(block size); archives written before the
+  // block size was configurable hold 0, and use kDefaultBlockSize
+  __host__ __device__ uint32_t getBlockSize() const {
+    uint32_t log2BlockSize = (options >> 5) & 0x1f;
+    return log2BlockSize == 0 ? kDefaultBlockSize : (1U << log2BlockSize);
+  }
+
+  __host__ __device__ void setBlockSize(uint32_t blockSize) {
+    assert(isPowerOf2(blockSize));
+
+    uint32_t log2BlockSize = 0;
+    while ((1U << log2BlockSize) < blockSize) {
+      ++log2BlockSize;
+    }
+
+    options = (options & 0xfffffc1fU) | (log2BlockSize << 5);
+  }
+
+  __host__ __device__ bool getUseWideState() const {
+    return options & 0x400;
+  }
+
+  __host__ __device__ void setUseWideState(bool ws) {
+    options = (options & 0xfffffbffU) | (uint32_t(ws) << 10);
+  }
+
+  __host__ __device__ bool getUseDictionary() const {
+    return options & 0x800;
+  }
+
+  __host__ __device__ void setUseDictionary(bool ud) {
+    options = (options & 0xfffff7ffU) | (uint32_t(ud) << 11);
+  }
+
+  __host__ __device__ bool getUseCompactProbs() const {
+    return options & 0x1000;
+  }
+
+  // Bits per packed pdf - 1 of the compact pdf
+  __host__ __device__ uint32_t getCompactProbsBits() const {
+    return ((options >> 13) & 0xf) + 1;
+  }
+
+  // Number of symbols present in the compact pdf
+  __host__ __device__ uint32_t getCompactProbsNumSymbols() const {
+    return (options >> 17) & 0x1ff;
+  }
+
+  // Whether the block index holds per-block modes (see getBlockMode); this is
+  // set only if some block is not ANS coded
+  __host__ __device__ bool getUseBlockModes() const {
+    return options & 0x4000000;
+  }
+
+  __host__ __device__ void setUseBlockModes(bool ubm) {
+    options = (options & 0xfbffffffU) | (uint32_t(ubm) << 26);
+  }
+
+  // The number of pdfs held in the archive, which is more than 1 when using
+  // contexts or segments
+  __host__ __device__ uint32_t getNumTables() const {
+    return (options >> 28) + 1;
+  }
+
+  // Whether the archive is coded with order-1 contexts, with a pdf per
+  // context (see ANSCodecConfig::numContexts) rather than a single pdf
+  __host__ __device__ bool getUseContexts() const {
+    return options & 0x8000000;
+  }
+
+  // The number of contexts, which is 1 if contexts are not used
+  __host__ __device__ uint32_t getNumContexts() const {
+    return getUseContexts() ? getNumTables() : 1;
+  }
+
+  __host__ __device__ void setNumContexts(uint32_t nc) {
+    assert(nc >= 1 && nc <= kANSMaxContexts);
+    options = (options & 0x07ffffffU) |
+        (nc > 1 ? (0x8000000U | ((nc - 1) << 28)) : 0);
+  }
+
+  // Whether the blocks are partitioned into segments, with a pdf per segment
+  // (see ANSCodecConfig::maxSegments) rather than a single pdf
+  __host__ __device__ bool getUseSegments() const {
+    return !getUseContexts() && getNumTables() > 1;
+  }
+
+  // The number of segments, which is 1 if segments are not used
+  __host__ __device__ uint32_t getNumSegments() const {
+    return getUseSegments() ? getNumTables() : 1;
+  }
+
+  __host__ __device__ void setNumSegments(uint32_t ns) {
+    assert(ns >= 1 && ns <= kANSMaxSegments);
+    options = (options & 0x07ffffffU) | ((ns - 1) << 28);
+  }
+
+  // The start of the data of a block given its index entry, in encoded words
+  __host__ __device__ uint32_t getBlockWordStart(uint2 bw) const {
+    if (!getUseSegments()) {
+      return getBlockCompressedWordStart(bw);
+    }
+
+    return (bw.y & kANSSegmentStartMask) *
+        (kBlockAlignment / getEncodedWordSize(getUseWideState()));
+  }
+
+  // The segment (and thus pdf) of a block given its index entry
+  __host__ __device__ uint32_t getBlockSegment(uint2 bw) const {
+    return getUseSegments() ? bw.y >> kANSSegmentShift : 0;
+  }
+
+  // The word start entry of a block index entry for a block with data
+  // starting at compressedWordStart (aligned to kBlockAlignment) and coded in
+  // `segment`, for use with packBlockWords
+  __host__ __device__ uint32_t
+  makeBlockWordStart(uint32_t compressedWordStart, uint32_t segment) const {
+    if (!getUseSegments()) {
+      return compressedWordStart;
+    }
+
+    uint32_t start = compressedWordStart /
+        (kBlockAlignment / getEncodedWordSize(getUseWideState()));
+    assert(start <= kANSSegmentStartMask);
+
+    return (segment << kANSSegmentShift) | start;
+  }
+
+  // The mode of a block given its index entry
+  __host__ __device__ ANSBlockMode getBlockMode(uint2 bw) const {
+    if (!getUseBlockModes() || !(bw.x & kANSBlockStoredCode)) {
+      return ANSBlockMode::ANS;
+    }
+
+    return (bw.x & kANSBlockConstantCode) == kANSBlockConstantCode
+        ? ANSBlockMode::Constant
+        : ANSBlockMode::Stored;
+  }
+
+  // The number of encoded words of data held for a block given its index entry
+  __host__ __device__ uint32_t getBlockDataWords(uint2 bw) const {
+    switch (getBlockMode(bw)) {
+      case ANSBlockMode::Stored:
+        return getStoredBlockWords(
+            getBlockUncompressedWords(bw), getUseWideState());
+      case ANSBlockMode::Constant:
+        return 0;
+      default:
+        return getBlockCompressedWords(bw);
+    }
+  }
+
+  // Selects the smaller of the dense (uint16_t per symbol) and compact
+  // encodings of the pdf, for a pdf with numSymbols non-zero entries of which
+  // the largest is maxPdf. This determines the archive layout, so it must
+  // precede any use of the offsets of the data following the header
+  __host__ __device__ void setSymbolProbsFormat(
+      uint32_t numSymbols,
+      uint32_t maxPdf) {
+    uint32_t pdfBits = getCompactProbsBitsFor(maxPdf);
+
+    bool compact = getCompactSymbolProbsSize(numSymbols, pdfBits) <
+        getSymbolProbsSize(false);
+
+    options = (options & 0xfc000fffU) |
+        (compact ? (0x1000U | ((pdfBits - 1) << 13) | (numSymbols << 17)) : 0);
+  }
+
+  // Writes the pdf (the pdf entry of each symbol of an encoding table) in the
+  // format chosen by setSymbolProbsFormat
+  __host__ __device__ void writeSymbolProbs(const uint4* table) {
+    if (!getUseCompactProbs()) {
+      auto probs = getSymbolProbs();
+      for (int i = 0; i < kNumSymbols; ++i) {
+        probs[i] = table[i].x;
+      }
+
+      return;
+    }
+
+    writeCompactSymbolProbs((uint8_t*)(this + 1), table, getCompactProbsBits());
+  }
+
+  // Writes the compact pdf of an encoding table to `out`, returning its size
+  // (see getCompactSymbolProbsSize)
+  static __host__ __device__ uint32_t
+  writeCompactSymbolProbs(uint8_t* out, const uint4* table, uint32_t pdfBits) {
+    auto bitmap = (uint32_t*)out;
+    auto packed = (uint8_t*)(bitmap + kNumSymbols / 32);
+    uint32_t numSymbols = 0;
+
+    // Bits not yet written, lowest first
+    uint32_t bits = 0;
+    uint32_t numBits = 0;
+
+    for (int w = 0; w < kNumSymbols / 32; ++w) {
+      uint32_t word = 0;
+
+      for (int j = 0; j < 32; ++j) {
+        uint32_t pdf = table[w * 32 + j].x;
+        if (pdf == 0) {
+          continue;
+        }
+
+        word |= 1U << j;
+        bits |= (pdf - 1) << numBits;
+        numBits += pdfBits;
+        ++numSymbols;
+
+        for (; numBits >= 8; numBits -= 8) {
+          *packed++ = bits;
+          bits >>= 8;
+        }
+      }
+
+      bitmap[w] = word;
+    }
+
+    // Remaining bits and padding
+    if (numBits > 0) {
+      *packed++ = bits;
+    }
+
+    uint32_t size = getCompactSymbolProbsSize(numSymbols, pdfBits);
+    while (packed < out + size) {
+      *packed++ = 0;
+    }
+
+    return size;
+  }
+
+  // Reads the pdf entry of a symbol in either format
+  __host__ __device__ uint32_t getSymbolProb(uint32_t sym) const {
+    if (!getUseCompactProbs()) {
+      return getSymbolProbs()[sym];
+    }
+
+    return readCompactSymbolProb(
+        (const uint8_t*)(this + 1), getCompactProbsBits(), sym);
+  }
+
+  // Reads the pdf entry of a symbol from a compact pdf
+  static __host__ __device__ uint32_t
+  readCompactSymbolProb(const uint8_t* in, uint32_t pdfBits, uint32_t sym) {
+    auto bitmap = (const uint32_t*)in;
+    auto packed = (const uint8_t*)(bitmap + kNumSymbols / 32);
+
+    uint32_t word = bitmap[sym / 32];
+    uint32_t bit = 1U << (sym % 32);
+
+    if (!(word & bit)) {
+      return 0;
+    }
+
+    // The number of present symbols before this one
+    uint32_t rank = ansPopc(word & (bit - 1));
+    for (uint32_t w = 0; w < sym / 32; ++w) {
+      rank += ansPopc(bitmap[w]);
+    }
+
+    uint32_t start = rank * pdfBits;
+
+    uint32_t v = 0;
+    for (uint32_t b = start / 8; b * 8 < start + pdfBits; ++b) {
+      v |= uint32_t(packed[b]) << (b * 8 - start / 8 * 8);
+    }
+
+    return ((v >> (start % 8)) & ((1U << pdfBits) - 1)) + 1;
+  }
+
+  // Reads the pdf of all symbols in either format
+  __host__ __device__ void readSymbolProbs(uint16_t* probs) const {
+    for (uint32_t i = 0; i < kNumSymbols; ++i) {
+      probs[i] = getSymbolProb(i);
+    }
+  }
+
+  // The symbol of each context, and the format of the pdf of each context or
+  // segment, in archives holding more than one pdf
+  __host__ __device__ const ANSTableInfo* getTableInfo() const {
+    return (const ANSTableInfo*)(this + 1);
+  }
+
+  // Fills the context of each symbol (kNumSymbols entries)
+  __host__ __device__ void getSymbolContexts(uint8_t* symbolContext) const {
+    for (uint32_t i = 0; i < kNumSymbols; ++i) {
+      symbolContext[i] = 0;
+    }
+
+    auto info = getTableInfo();
+    for (uint32_t c = 1; c < getNumContexts(); ++c) {
+      symbolContext[info->symbol[c]] = c;
+    }
+  }
+
+  // Writes the table information and the pdf of each of getNumTables()
+  // contexts or segments (given the encoding table of each, at a stride of
+  // kNumSymbols). With contexts, contextSymbol[c] is the symbol of context
+  // c > 0; with segments, it is unused. This determines the archive layout, so
+  // it must precede any use of the offsets of the data following the header
+  __host__ __device__ void writeTableSymbolProbs(
+      const uint8_t* contextSymbol,
+      const uint4* tables) {
+    auto info = (ANSTableInfo*)(this + 1);
+    auto out = (uint8_t*)(info + 1);
+
+    for (uint32_t t = 0; t < kANSMaxTables; ++t) {
+      info->symbol[t] = 0;
+      info->pdfBits[t] = 0;
+    }
+
+    bool useContexts = getUseContexts();
+
+    for (uint32_t t = 0; t < getNumTables(); ++t) {
+      auto table = tables + t * kNumSymbols;
+
+      uint32_t maxPdf = 0;
+      for (uint32_t i = 0; i < kNumSymbols; ++i) {
+        maxPdf = table[i].x > maxPdf ? table[i].x : maxPdf;
+      }
+
+      uint32_t pdfBits = getCompactProbsBitsFor(maxPdf);
+
+      info->symbol[t] = (useContexts && t > 0) ? contextSymbol[t] : 0;
+      info->pdfBits[t] = pdfBits - 1;
+      out += writeCompactSymbolProbs(out, table, pdfBits);
+    }
+
+    tableProbsSize = out - (uint8_t*)info;
+    assert(tableProbsSize == out - (uint8_t*)info);
+  }
+
+  // Reads the pdf of all symbols of a context or segment
+  __host__ __device__ void readTableSymbolProbs(
+      uint32_t table,
+      uint16_t* probs) const {
+    auto info = getTableInfo();
+    auto in = (const uint8_t*)(info + 1);
+
+    // The compact pdfs of the tables preceding this one
+    for (uint32_t t = 0; t < table; ++t) {
+      uint32_t numSymbols = 0;
+      for (uint32_t w = 0; w < kNumSymbols / 32; ++w) {
+        numSymbols += ansPopc(((const uint32_t*)in)[w]);
+      }
+
+      in += getCompactSymbolProbsSize(numSymbols, info->pdfBits[t] + 1);
+    }
+
+    for (uint32_t i = 0; i < kNumSymbols; ++i) {
+      probs[i] = readCompactSymbolProb(in, info->pdfBits[table] + 1, i);
+    }
+  }
+
+  // The element width in bytes by which the data was shuffled before coding
+  // (see ANSCodecConfig::shuffleWidth), which is 1 if it was not
+  __host__ __device__ uint32_t getShuffleWidth() const {
+    return 1U << log2ShuffleWidth;
+  }
+
+  __host__ __device__ void setShuffleWidth(uint32_t width) {
+    assert(isPowerOf2(width) && width <= kANSMaxShuffleWidth);
+
+    uint32_t log2Width = 0;
+    while ((1U << log2Width) < width) {
+      ++log2Width;
+    }
+
+    log2ShuffleWidth = log2Width;
+  }
+
+  // Whether the archive holds the XOR of the data with a reference of the
+  // same size, which must be supplied to decode it (see ansEncodeBatchCpu)
+  __host__ __device__ bool getUseDelta() const {
+    return flags & 0x1;
+  }
+
+  __host__ __device__ void setUseDelta(bool ud) {
+    flags = (flags & 0xfe) | uint8_t(ud);
+  }
+
+  // Whether the compressed data is followed by the block checksums of the
+  // uncompressed data (see ANSCodecConfig::useBlockChecksum and
+  // getBlockChecksums)
+  __host__ __device__ bool getUseBlockChecksum() const {
+    return flags & 0x2;
+  }
+
+  __host__ __device__ void setUseBlockChecksum(bool ub) {
+    flags = (flags & 0xfd) | (uint8_t(ub) << 1);
+  }
+
+  // The ANSDictionary::getId() of the dictionary used, if getUseDictionary()
+  __host__ __device__ uint32_t getDictionaryId() const {
+    return dictionaryId;
+  }
+
+  __host__ __device__ void setDictionaryId(uint32_t id) {
+    dictionaryId = id;
+  }
+
   __host__ __device__ uint32_t getChecksum() const {
     return checksum;
   }
@@ -152,48 +1135,89 @@ struct __align__(32) ANSCoalescedHeader {
     checksum = c;
   }
 
-  __device__ uint16_t* getSymbolProbs() {
+  // The dense pdf; not present if getUseDictionary() or getUseCompactProbs()
+  // (see getSymbolProb)
+  __host__ __device__ uint16_t* getSymbolProbs() {
     return (uint16_t*)(this + 1);
   }
 
-  __device__ const uint16_t* getSymbolProbs() const {
+  __host__ __device__ const uint16_t* getSymbolProbs() const {
     return (const uint16_t*)(this + 1);
   }
 
-  __device__ ANSWarpState* getWarpStates() {
-    return (ANSWarpState*)(getSymbolProbs() + kNumSymbols);
+  // The warp states are ANSWarpState, or ANSWideWarpState if
+  // getUseWideState()
+  // Byte offsets from the start of the archive of the data following the
+  // header. These depend only upon the header fields, so they may be computed
+  // from a copy of the header while the archive itself is being written
+  __host__ __device__ uint32_t getWarpStatesOffset() const {
+    return sizeof(ANSCoalescedHeader) + getSymbolProbsSize();
   }
 
-  __device__ const ANSWarpState* getWarpStates() const {
-    return (const ANSWarpState*)(getSymbolProbs() + kNumSymbols);
+  __host__ __device__ uint32_t getBlockWordsOffset(uint32_t numBlocks) const {
+    // All of the warp states are already kBlockAlignment aligned
+    return getWarpStatesOffset() +
+        getWarpStateSize(getUseWideState()) * numBlocks;
   }
 
-  __device__ uint2* getBlockWords(uint32_t numBlocks) {
-    // All of the ANSWarpStates are already kBlockAlignment aligned
-    return (uint2*)(getWarpStates() + numBlocks);
+  __host__ __device__ uint32_t getBlockDataOffset(uint32_t numBlocks) const {
+    constexpr int kAlignment = kBlockAlignment / sizeof(uint2) == 0
+        ? 1
+        : kBlockAlignment / sizeof(uint2);
+
+    return getBlockWordsOffset(numBlocks) +
+        sizeof(uint2) * roundUp(numBlocks, kAlignment);
   }
 
-  __device__ const uint2* getBlockWords(uint32_t numBlocks) const {
-    // All of the ANSWarpStates are already kBlockAlignment aligned
-    return (const uint2*)(getWarpStates() + numBlocks);
+  // The block checksums follow the compressed data of all blocks
+  __host__ __device__ uint32_t getBlockChecksumsOffset() const {
+    return roundUp(
+        getBlockDataOffset(getNumBlocks()) +
+            getTotalCompressedWords() * getEncodedWordSize(getUseWideState()),
+        kBlockAlignment);
   }
 
-  __device__ ANSEncodedT* getBlockDataStart(uint32_t numBlocks) {
-    constexpr int kAlignment = kBlockAlignment / sizeof(uint2) == 0
-        ? 1
-        : kBlockAlignment / sizeof(uint2);
+  // getBlockChecksumSize(getTotalUncompressedWords()) bytes, if
+  // getUseBlockChecksum()
+  __host__ __device__ uint32_t* getBlockChecksums() {
+    return (uint32_t*)((uint8_t*)this + getBlockChecksumsOffset());
+  }
 
-    return (
-        ANSEncodedT*)(getBlockWords(numBlocks) + roundUp(numBlocks, kAlignment));
+  __host__ __device__ const uint32_t* getBlockChecksums() const {
+    return (const uint32_t*)((const uint8_t*)this + getBlockChecksumsOffset());
   }
 
-  __device__ const ANSEncodedT* getBlockDataStart(uint32_t numBlocks) const {
-    constexpr int kAlignment = kBlockAlignment / sizeof(uint2) == 0
-        ? 1
-        : kBlockAlignment / sizeof(uint2);
+  template <typename WarpStateT = ANSWarpState>
+  __host__ __device__ WarpStateT* getWarpStates() {
+    return (WarpStateT*)((uint8_t*)this + getWarpStatesOffset());
+  }
 
-    return (
-        const ANSEncodedT*)(getBlockWords(numBlocks) + roundUp(numBlocks, kAlignment));
+  template <typename WarpStateT = ANSWarpState>
+  __host__ __device__ const WarpStateT* getWarpStates() const {
+    return (const WarpStateT*)((const uint8_t*)this + getWarpStatesOffset());
+  }
+
+  __host__ __device__ uint2* getBlockWords(uint32_t numBlocks) {
+    return (uint2*)((uint8_t*)this + getBlockWordsOffset(numBlocks));
+  }
+
+  __host__ __device__ const uint2* getBlockWords(uint32_t numBlocks) const {
+    return (const uint2*)((const uint8_t*)this +
+                          getBlockWordsOffset(numBlocks));
+  }
+
+  // The compressed words are ANSEncodedT, or ANSWideEncodedT if
+  // getUseWideState()
+  template <typename EncodedT = ANSEncodedT>
+  __host__ __device__ EncodedT* getBlockDataStart(uint32_t numBlocks) {
+    return (EncodedT*)((uint8_t*)this + getBlockDataOffset(numBlocks));
+  }
+
+  template <typename EncodedT = ANSEncodedT>
+  __host__ __device__ const EncodedT* getBlockDataStart(
+      uint32_t numBlocks) const {
+    return (const EncodedT*)((const uint8_t*)this +
+                             getBlockDataOffset(numBlocks));
   }
 
   // (16: magic)(16: version)
@@ -202,28 +1226,61 @@ struct __align__(32) ANSCoalescedHeader {
   uint32_t totalUncompressedWords;
   uint32_t totalCompressedWords;
 
-  // (27: unused)(1: use checksum)(4: probBits)
+  // (4: number of pdfs - 1)(1: use contexts, else segments if > 1 pdf)
+  // (1: use block modes)
+  // (9: compact pdf symbols)(4: compact pdf bits - 1)
+  // (1: use compact pdf)(1: use dictionary)(1: use wide state)
+  // (5: log2 block size)(1: use checksum)(4: probBits)
   uint32_t options;
   uint32_t checksum;
-  uint32_t unused0;
-  uint32_t unused1;
+  uint32_t dictionaryId;
+
+  // The size in bytes of the table information and pdfs, if
+  // getNumTables() > 1
+  uint16_t tableProbsSize;
+
+  // log2 of getShuffleWidth(); archives written before byte shuffling hold 0
+  // here, as the high half of a 32 bit tableProbsSize
+  uint8_t log2ShuffleWidth;
+
+  // (6: unused)(1: use block checksum)(1: use delta); archives written before
+  // deltas hold 0 here
+  uint8_t flags;
 
   // Data that follows after the header (some of which is variable length):
 
-  // Fixed length array
+  // Fixed length array (omitted if getUseDictionary()):
   // uint16_t probs[kNumSymbols];
+  //
+  // or if getUseCompactProbs(), the variable length compact pdf:
+  // uint32_t symbolBitmap[kNumSymbols / 32];
+  // (getCompactProbsBits() bits: pdf - 1 of each present symbol)
+  // (zero padding to kBlockAlignment)
+  //
+  // or if getNumTables() > 1, tableProbsSize bytes of:
+  // ANSTableInfo info;
+  // (the compact pdf of each of getNumTables() contexts or segments)
 
-  // Variable length array:
+  // Variable length array (of ANSWideWarpState if getUseWideState()):
   // ANSWarpState states[numBlocks];
 
-  // Per-block information:
-  // (uint16: uncompressedWords, uint16: compressedWords)
-  // uint32: blockCompressedWordStart
+  // Per-block information (see packBlockWords), with compressed word counts
+  // and offsets in units of ANSEncodedT (or ANSWideEncodedT):
+  // (uint16: uncompressedWords, uint16: compressedWords or block mode code)
+  // uint32: blockCompressedWordStart (or if getUseSegments(), see
+  // makeBlockWordStart)
   //
   // Variable length array:
   // uint2 blockWords[roundUp(numBlocks, kBlockAlignment / sizeof(uint2))];
 
-  // Then follows the compressed per-warp/block data for each segment
+  // Then follows the compressed per-warp/block data for each segment; stored
+  // blocks hold their raw input here (and an unused warp state above), while
+  // constant blocks have no data
+
+  // If getUseBlockChecksum(), at the next kBlockAlignment boundary:
+  // uint32_t blockCrc[divUp(totalUncompressedWords, kANSChecksumBlockSize)];
+  // uint32_t crc;
+  // (zero padding to 16 bytes)
 };
 
 static_assert(sizeof(ANSCoalescedHeader) == 32, "");
@@ -6,12 +6,17 @@
  */
 #pragma once
 
+#include "dietgpu/ans/GpuANSUtils.cuh"
 #include "dietgpu/utils/DeviceDefs.cuh"
 #include "dietgpu/utils/DeviceUtils.h"
 #include "dietgpu/utils/PtxUtils.cuh"
+#include "dietgpu/utils/StackDeviceMemory.h"
 #include "dietgpu/utils/StaticUtils.h"
 
 #include <cub/cub.cuh>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace dietgpu {
 
@@ -93,12 +98,22 @@ __device__ void checksumSingle(
 }
 
 template <typename InProvider, int Threads>
-__global__ void checksumBatch(InProvider in, uint32_t* out) {
+__global__ void
+checksumBatch(InProvider in, const void* const* ref, uint32_t* out) {
   int batch = blockIdx.y;
   out += batch;
 
-  checksumSingle<Threads>(
-      (const uint8_t*)in.getBatchStart(batch), in.getBatchSize(batch), out);
+  auto size = in.getBatchSize(batch);
+
+  checksumSingle<Threads>((const uint8_t*)in.getBatchStart(batch), size, out);
+
+  // The checksum folds the data by XOR, so that of the XOR of the data with a
+  // reference is the XOR of their checksums
+  if (ref && ref[batch]) {
+    // checksumSingle reuses its shared memory
+    __syncthreads();
+    checksumSingle<Threads>((const uint8_t*)ref[batch], size, out);
+  }
 }
 
 template <typename InProvider>
@@ -107,7 +122,11 @@ void checksumBatch(
     InProvider inProvider,
     // size numInBatch
     uint32_t* checksum_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    // Optional device array of numInBatch device pointers to a reference of
+    // the same size as each batch member, or nullptr for a member without one;
+    // the checksum is then that of the XOR of the member with its reference
+    const void* const* ref_dev = nullptr) {
   // zero out checksum before proceeding, as we aggregate with atomic xor
   CUDA_VERIFY(
       cudaMemsetAsync(checksum_dev, 0, sizeof(uint32_t) * numInBatch, stream));
@@ -127,9 +146,462 @@ void checksumBatch(
   auto grid = dim3(xBlocks, numInBatch);
 
   checksumBatch<InProvider, kThreads>
-      <<<grid, kThreads, 0, stream>>>(inProvider, checksum_dev);
+      <<<grid, kThreads, 0, stream>>>(inProvider, ref_dev, checksum_dev);
 
   CUDA_TEST_ERROR();
 }
 
+//
+// Block checksums (see ANSCodecConfig::useBlockChecksum): the CRC32C of each
+// kANSChecksumBlockSize block of a batch member, and of all of it, as computed
+// by crc32cCpu on the host.
+//
+// The CRC is computed without its initial and final inversions, which makes
+// it linear: the CRC of data A followed by data B is that of A multiplied by
+// x^(8 * size of B) modulo the CRC polynomial, XOR that of B. Each thread
+// computes the CRC of a piece of a block a byte at a time, and the pieces are
+// then combined, as are the blocks into the CRC of all of them. Leading zero
+// bytes leave the CRC at zero, so a partial last block is treated as a full
+// one preceded by zeros
+//
+
+// The CRC32C polynomial, bit reflected
+constexpr uint32_t kCrc32cPoly = 0x82f63b78;
+
+// Each thread computes the CRC of a piece of this many bytes of a block
+constexpr uint32_t kCrc32cPieceShift = 5;
+constexpr uint32_t kCrc32cPieceBytes = 1 << kCrc32cPieceShift;
+
+// So a block is handled by this many threads
+constexpr int kCrc32cThreads = kANSChecksumBlockSize / kCrc32cPieceBytes;
+static_assert(kCrc32cThreads % kWarpSize == 0, "");
+
+// Multiplies the polynomials a and b (bit reflected, so the high bit is x^0)
+// modulo the CRC polynomial; a must not be zero
+__host__ __device__ inline uint32_t crc32cMultModP(uint32_t a, uint32_t b) {
+  uint32_t m = 1U << 31;
+  uint32_t p = 0;
+
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) {
+        break;
+      }
+    }
+
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kCrc32cPoly : b >> 1;
+  }
+
+  return p;
+}
+
+// Returns x^(8 * bytes) modulo the CRC polynomial, which advances a CRC past
+// `bytes` zero bytes
+__host__ __device__ inline uint32_t crc32cXPowBytes(uint64_t bytes) {
+  // x^0 and x^8
+  uint32_t p = 1U << 31;
+  uint32_t square = 1U << 23;
+
+  while (bytes) {
+    if (bytes & 1) {
+      p = crc32cMultModP(square, p);
+    }
+
+    bytes >>= 1;
+    if (bytes) {
+      square = crc32cMultModP(square, square);
+    }
+  }
+
+  return p;
+}
+
+// The CRC32C of data of `bytes` bytes, given its CRC without the inversions
+__host__ __device__ inline uint32_t
+crc32cFromRaw(uint32_t raw, uint64_t bytes) {
+  return ~(crc32cMultModP(crc32cXPowBytes(bytes), ~0U) ^ raw);
+}
+
+struct Crc32cSmem {
+  // The CRC of each byte value
+  uint32_t table[256];
+
+  // x^(8 * 2^k) modulo the CRC polynomial, to advance a CRC past 2^k bytes
+  uint32_t pow2[32];
+
+  // The CRC of the part of a block handled by each warp
+  uint32_t warpCrc[kCrc32cThreads / kWarpSize];
+};
+
+__device__ inline void crc32cInit(Crc32cSmem& smem) {
+  for (int i = threadIdx.x; i < 256; i += kCrc32cThreads) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = crc & 1 ? (crc >> 1) ^ kCrc32cPoly : crc >> 1;
+    }
+
+    smem.table[i] = crc;
+  }
+
+  if (threadIdx.x < 32) {
+    // x^8, squared k times
+    uint32_t p = 1U << 23;
+    for (uint32_t k = 0; k < threadIdx.x; ++k) {
+      p = crc32cMultModP(p, p);
+    }
+
+    smem.pow2[threadIdx.x] = p;
+  }
+
+  __syncthreads();
+}
+
+__device__ __forceinline__ uint32_t
+crc32cByte(const Crc32cSmem& smem, uint32_t crc, uint32_t byte) {
+  return (crc >> 8) ^ smem.table[(crc ^ byte) & 0xff];
+}
+
+__device__ __forceinline__ uint32_t
+crc32cWord(const Crc32cSmem& smem, uint32_t crc, uint32_t word) {
+  // little endian
+  for (int i = 0; i < sizeof(uint32_t); ++i) {
+    crc = crc32cByte(smem, crc, word >> (i * 8));
+  }
+
+  return crc;
+}
+
+// Advances crc past `bytes` zero bytes
+__device__ inline uint32_t
+crc32cShift(const Crc32cSmem& smem, uint32_t crc, uint32_t bytes) {
+  for (int k = 0; bytes; ++k, bytes >>= 1) {
+    if (bytes & 1) {
+      crc = crc32cMultModP(smem.pow2[k], crc);
+    }
+  }
+
+  return crc;
+}
+
+// Returns, in thread 0, the CRC without the inversions of the n <=
+// kANSChecksumBlockSize bytes of a block at `in`, XORed with `ref` if given.
+// Called by all kCrc32cThreads threads
+__device__ inline uint32_t crc32cBlockRaw(
+    Crc32cSmem& smem,
+    const uint8_t* __restrict__ in,
+    const uint8_t* __restrict__ ref,
+    uint32_t n) {
+  // The block is preceded by zero bytes to a full block
+  uint32_t skip = kANSChecksumBlockSize - n;
+  uint32_t begin = threadIdx.x * kCrc32cPieceBytes;
+  uint32_t crc = 0;
+
+  if (skip == 0 && isPointerAligned(in, sizeof(uint4)) &&
+      (!ref || isPointerAligned(ref, sizeof(uint4)))) {
+    auto in4 = (const uint4*)(in + begin);
+    auto ref4 = ref ? (const uint4*)(ref + begin) : nullptr;
+
+    for (int i = 0; i < kCrc32cPieceBytes / sizeof(uint4); ++i) {
+      uint4 v = in4[i];
+
+      if (ref4) {
+        uint4 r = ref4[i];
+        v = make_uint4(v.x ^ r.x, v.y ^ r.y, v.z ^ r.z, v.w ^ r.w);
+      }
+
+      crc = crc32cWord(smem, crc, v.x);
+      crc = crc32cWord(smem, crc, v.y);
+      crc = crc32cWord(smem, crc, v.z);
+      crc = crc32cWord(smem, crc, v.w);
+    }
+  } else {
+    for (uint32_t i = max(begin, skip); i < begin + kCrc32cPieceBytes; ++i) {
+      uint32_t byte = in[i - skip];
+      if (ref) {
+        byte ^= ref[i - skip];
+      }
+
+      crc = crc32cByte(smem, crc, byte);
+    }
+  }
+
+  // Combine the pieces of the warp pairwise, each step doubling the size of
+  // the pieces, so lane 0 ends with the CRC of all of them
+  int laneId = getLaneId();
+
+#pragma unroll
+  for (int k = 0; (1 << k) < kWarpSize; ++k) {
+    uint32_t right = __shfl_down_sync(0xffffffff, crc, 1 << k);
+
+    if ((laneId & ((2 << k) - 1)) == 0) {
+      crc = crc32cMultModP(smem.pow2[kCrc32cPieceShift + k], crc) ^ right;
+    }
+  }
+
+  if (laneId == 0) {
+    smem.warpCrc[threadIdx.x / kWarpSize] = crc;
+  }
+
+  __syncthreads();
+
+  if (threadIdx.x == 0) {
+    constexpr int kWarpShift = kCrc32cPieceShift + log2(kWarpSize);
+
+    crc = smem.warpCrc[0];
+    for (int w = 1; w < kCrc32cThreads / kWarpSize; ++w) {
+      crc = crc32cMultModP(smem.pow2[kWarpShift], crc) ^ smem.warpCrc[w];
+    }
+  }
+
+  // warpCrc is reused by the next block
+  __syncthreads();
+
+  return crc;
+}
+
+// Computes the block checksums of each batch member for which
+// checksumProvider.getBlockChecksums(batch) is not null, of
+// checksumProvider.getBytes(batch) bytes, writing the CRC of each block there
+// and accumulating the raw CRC of all blocks in rawAll[batch] (which must be
+// zeroed). If ref is given, the data is the XOR of the input with ref[batch]
+// where that is not null
+template <typename InProvider, typename ChecksumProvider>
+__global__ __launch_bounds__(kCrc32cThreads) void blockChecksumKernel(
+    InProvider inProvider,
+    const void* const* __restrict__ ref,
+    ChecksumProvider checksumProvider,
+    uint32_t* __restrict__ rawAll) {
+  __shared__ Crc32cSmem smem;
+  crc32cInit(smem);
+
+  int batch = blockIdx.y;
+  auto checksums = checksumProvider.getBlockChecksums(batch);
+  if (!checksums) {
+    return;
+  }
+
+  uint32_t bytes = checksumProvider.getBytes(batch);
+  auto in = (const uint8_t*)inProvider.getBatchStart(batch);
+  auto curRef = ref ? (const uint8_t*)ref[batch] : nullptr;
+
+  uint32_t numBlocks = divUp(bytes, kANSChecksumBlockSize);
+
+  for (uint32_t block = blockIdx.x; block < numBlocks; block += gridDim.x) {
+    uint32_t start = block * kANSChecksumBlockSize;
+    uint32_t n = min(bytes - start, kANSChecksumBlockSize);
+
+    uint32_t raw =
+        crc32cBlockRaw(smem, in + start, curRef ? curRef + start : nullptr, n);
+
+    if (threadIdx.x == 0) {
+      checksums[block] = ~(crc32cShift(smem, ~0U, n) ^ raw);
+
+      // The CRC of all blocks is the XOR of that of each block advanced past
+      // the blocks that follow it
+      atomicXor(&rawAll[batch], crc32cShift(smem, raw, bytes - start - n));
+    }
+  }
+}
+
+// Completes the block checksums written by blockChecksumKernel with the CRC of
+// all blocks and the zero padding
+template <typename ChecksumProvider>
+__global__ void blockChecksumFinishKernel(
+    ChecksumProvider checksumProvider,
+    const uint32_t* __restrict__ rawAll,
+    uint32_t numInBatch) {
+  uint32_t batch = blockIdx.x * blockDim.x + threadIdx.x;
+  if (batch >= numInBatch) {
+    return;
+  }
+
+  auto checksums = checksumProvider.getBlockChecksums(batch);
+  if (!checksums) {
+    return;
+  }
+
+  uint32_t bytes = checksumProvider.getBytes(batch);
+  uint32_t numBlocks = divUp(bytes, kANSChecksumBlockSize);
+
+  checksums[numBlocks] = crc32cFromRaw(rawAll[batch], bytes);
+
+  for (uint32_t i = numBlocks + 1;
+       i < getBlockChecksumSize(bytes) / sizeof(uint32_t);
+       ++i) {
+    checksums[i] = 0;
+  }
+}
+
+// Compares the block checksums computed into `checksums` (at stride
+// `checksumStride`) for the batch members with stored checksums in
+// storedProvider, setting failed[batch * checksumStride + i] for each
+// mismatch (i being the number of blocks for the CRC of all of them) and the
+// number of blocks of each member in numBlocks (0 for those not verified)
+template <typename ChecksumProvider>
+__global__ void blockChecksumCompareKernel(
+    ChecksumProvider storedProvider,
+    const uint32_t* __restrict__ checksums,
+    uint32_t checksumStride,
+    uint8_t* __restrict__ failed,
+    uint32_t* __restrict__ numBlocks) {
+  int batch = blockIdx.y;
+  auto stored = storedProvider.getBlockChecksums(batch);
+
+  uint32_t curNumBlocks = stored
+      ? divUp(storedProvider.getBytes(batch), kANSChecksumBlockSize)
+      : 0;
+
+  checksums += batch * checksumStride;
+  failed += batch * checksumStride;
+
+  for (uint32_t i = blockIdx.x * blockDim.x + threadIdx.x; i < checksumStride;
+       i += gridDim.x * blockDim.x) {
+    failed[i] = stored && i <= curNumBlocks && checksums[i] != stored[i];
+  }
+
+  if (blockIdx.x == 0 && threadIdx.x == 0) {
+    numBlocks[batch] = curNumBlocks;
+  }
+}
+
+// Block checksums in temporary memory, for the batch members with stored
+// checksums in StoredProvider
+template <typename StoredProvider>
+struct BlockChecksumTemp {
+  __device__ uint32_t* getBlockChecksums(uint32_t batch) {
+    return storedProvider.getBlockChecksums(batch)
+        ? checksums + batch * checksumStride
+        : nullptr;
+  }
+
+  __device__ uint32_t getBytes(uint32_t batch) {
+    return storedProvider.getBytes(batch);
+  }
+
+  StoredProvider storedProvider;
+  uint32_t* checksums;
+  uint32_t checksumStride;
+};
+
+// Writes the block checksums (see ANSCodecConfig::useBlockChecksum) of the
+// data of each batch member to checksumProvider.getBlockChecksums(batch), for
+// the members for which this is not null, given the size in bytes of the data
+// by checksumProvider.getBytes(batch), of at most maxBytes
+template <typename InProvider, typename ChecksumProvider>
+void blockChecksumBatch(
+    StackDeviceMemory& res,
+    uint32_t numInBatch,
+    InProvider inProvider,
+    ChecksumProvider checksumProvider,
+    uint32_t maxBytes,
+    cudaStream_t stream,
+    // Optional device array of numInBatch device pointers to a reference, or
+    // nullptr, for each batch member; the data is then the XOR of the member
+    // with its reference
+    const void* const* ref_dev = nullptr) {
+  auto rawAll_dev = res.alloc<uint32_t>(stream, numInBatch);
+  CUDA_VERIFY(cudaMemsetAsync(
+      rawAll_dev.data(), 0, sizeof(uint32_t) * numInBatch, stream));
+
+  uint32_t maxBlocks = divUp(maxBytes, kANSChecksumBlockSize);
+
+  if (maxBlocks > 0) {
+    // Enough blocks to saturate the GPU, each looping over blocks of data if
+    // there are more
+    int maxBlocksPerSM = 0;
+    CUDA_VERIFY(cudaOccupancyMaxActiveBlocksPerMultiprocessor(
+        &maxBlocksPerSM,
+        blockChecksumKernel<InProvider, ChecksumProvider>,
+        kCrc32cThreads,
+        0));
+    uint32_t maxGrid =
+        maxBlocksPerSM * getCurrentDeviceProperties().multiProcessorCount;
+
+    auto grid =
+        dim3(std::min(maxBlocks, divUp(maxGrid, numInBatch)), numInBatch);
+
+    blockChecksumKernel<InProvider, ChecksumProvider>
+        <<<grid, kCrc32cThreads, 0, stream>>>(
+            inProvider, ref_dev, checksumProvider, rawAll_dev.data());
+  }
+
+  blockChecksumFinishKernel<ChecksumProvider>
+      <<<divUp(numInBatch, 128), 128, 0, stream>>>(
+          checksumProvider, rawAll_dev.data(), numInBatch);
+
+  CUDA_TEST_ERROR();
+}
+
+// Verifies the data of each batch member against its stored block checksums,
+// for the members for which storedProvider.getBlockChecksums(batch) is not
+// null, given the size in bytes of the data by storedProvider.getBytes(batch),
+// of at most maxBytes. Each member with a mismatch is appended to
+// failedBlocks and errorInfo as for ANSDecodeStatus. Returns true if all
+// match. This synchronizes with `stream`
+template <typename InProvider, typename ChecksumProvider>
+bool verifyBlockChecksumBatch(
+    StackDeviceMemory& res,
+    uint32_t numInBatch,
+    InProvider inProvider,
+    ChecksumProvider storedProvider,
+    uint32_t maxBytes,
+    std::vector<std::pair<int, std::vector<uint32_t>>>& failedBlocks,
+    std::vector<std::pair<int, std::string>>& errorInfo,
+    cudaStream_t stream) {
+  uint32_t checksumStride = getBlockChecksumSize(maxBytes) / sizeof(uint32_t);
+
+  auto checksums_dev = res.alloc<uint32_t>(stream, numInBatch * checksumStride);
+  auto failed_dev = res.alloc<uint8_t>(stream, numInBatch * checksumStride);
+  auto numBlocks_dev = res.alloc<uint32_t>(stream, numInBatch);
+
+  blockChecksumBatch(
+      res,
+      numInBatch,
+      inProvider,
+      BlockChecksumTemp<ChecksumProvider>{
+          storedProvider, checksums_dev.data(), checksumStride},
+      maxBytes,
+      stream);
+
+  constexpr int kThreads = 128;
+  auto grid = dim3(divUp(checksumStride, kThreads), numInBatch);
+
+  blockChecksumCompareKernel<ChecksumProvider><<<grid, kThreads, 0, stream>>>(
+      storedProvider,
+      checksums_dev.data(),
+      checksumStride,
+      failed_dev.data(),
+      numBlocks_dev.data());
+
+  CUDA_TEST_ERROR();
+
+  auto failed = failed_dev.copyToHost(stream);
+  auto numBlocks = numBlocks_dev.copyToHost(stream);
+
+  bool ok = true;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto curFailed = failed.data() + i * checksumStride;
+    auto failedBlock = std::vector<uint32_t>();
+
+    for (uint32_t b = 0; b < numBlocks[i]; ++b) {
+      if (curFailed[b]) {
+        failedBlock.push_back(b);
+      }
+    }
+
+    if (failedBlock.empty() && !curFailed[numBlocks[i]]) {
+      continue;
+    }
+
+    ok = false;
+    addBlockChecksumFailure(
+        i, std::move(failedBlock), numBlocks[i], failedBlocks, errorInfo);
+  }
+
+  return ok;
+}
+
 } // namespace dietgpu
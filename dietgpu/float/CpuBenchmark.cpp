@@ -0,0 +1,598 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Throughput benchmark of the host (CPU) ANS, float and integer codecs, which
+// requires no GPU. Compresses and decompresses a batch of arrays of mixed sizes
+// with increasing numbers of threads, then compares the ANS probability
+// precisions against the size of the decoding table that each requires, the
+// number of order-1 contexts against their cost in throughput, the number of
+// segments on data concatenated from layers of different exponent ranges, the
+// byte shuffle width on integer data, and the integer codec on index streams.
+//
+// Usage: cpu_benchmark [max threads] [batch size] [max array size in words]
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+#include "dietgpu/int/CpuIntCodec.h"
+#include "dietgpu/utils/CpuFeatures.h"
+
+using namespace dietgpu;
+
+namespace {
+
+struct Batch {
+  std::vector<uint32_t> sizes;
+  std::vector<std::vector<uint8_t>> data;
+  std::vector<std::vector<uint8_t>> enc;
+  std::vector<std::vector<uint8_t>> dec;
+
+  std::vector<const void*> inPtrs;
+  std::vector<void*> encPtrs;
+  std::vector<const void*> encConstPtrs;
+  std::vector<void*> decPtrs;
+
+  size_t totalBytes = 0;
+};
+
+// Generates a batch of normally distributed floats of type `ft` with sizes
+// uniformly distributed in [1, maxSize] words. Each array is the concatenation
+// of numLayers equal runs of a different scale, like a flattened model, and
+// about zeroFraction of the words are zero, like activations after a ReLU
+Batch makeBatch(
+    FloatType ft,
+    uint32_t numInBatch,
+    uint32_t maxSize,
+    uint32_t numLayers = 1,
+    float zeroFraction = 0.0f) {
+  std::mt19937 gen(10);
+  std::uniform_int_distribution<uint32_t> sizeDist(1, maxSize);
+  std::normal_distribution<float> dist;
+  std::bernoulli_distribution isZero(zeroFraction);
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+
+  Batch b;
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto size = sizeDist(gen);
+    auto data = std::vector<uint8_t>(size * wordSize);
+
+    for (uint32_t j = 0; j < size; ++j) {
+      uint32_t layer = (uint64_t)j * numLayers / size;
+      float f = std::ldexp(dist(gen), (layer % 8) * 3 - 12);
+      if (zeroFraction > 0.0f && isZero(gen)) {
+        f = 0.0f;
+      }
+
+      if (wordSize == sizeof(double)) {
+        double d = f;
+        std::memcpy(data.data() + j * wordSize, &d, wordSize);
+        continue;
+      }
+
+      uint32_t x;
+      std::memcpy(&x, &f, sizeof(float));
+
+      // float16 data is approximated by the top half of the float32 word;
+      // only the distribution of the exponent matters here
+      if (wordSize == sizeof(uint16_t)) {
+        x >>= 16;
+      }
+
+      std::memcpy(data.data() + j * wordSize, &x, wordSize);
+    }
+
+    b.sizes.push_back(size);
+    b.data.push_back(std::move(data));
+    b.totalBytes += size * wordSize;
+  }
+
+  // Sized for any number of contexts or segments
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    b.enc.emplace_back(getMaxFloatCompressedSize(
+        ft, b.sizes[i], kANSDefaultBlockSize, false, kANSMaxTables));
+    b.dec.emplace_back(b.data[i].size());
+  }
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    b.inPtrs.push_back(b.data[i].data());
+    b.encPtrs.push_back(b.enc[i].data());
+    b.encConstPtrs.push_back(b.enc[i].data());
+    b.decPtrs.push_back(b.dec[i].data());
+  }
+
+  return b;
+}
+
+// Kinds of integer data, all of values in [0, maxValue]
+enum class IntegerKind {
+  // uniformly distributed
+  kUniform,
+  // token ids, where half of the phrases of 2 to 24 tokens repeat one of the
+  // last 4096 tokens
+  kTokenIds,
+  // embedding table lookups, skewed towards the most popular (lowest) rows
+  kEmbeddingIds,
+  // sorted indices of the non-zero entries of a sparse gradient of density
+  // about 1/16
+  kSparseIndices,
+};
+
+// Generates a batch of little-endian integers of `width` bytes of the given
+// kind, with sizes uniformly distributed in [1, maxSize] integers
+Batch makeIntegerBatch(
+    IntegerKind kind,
+    uint32_t width,
+    uint32_t numInBatch,
+    uint32_t maxSize,
+    uint64_t maxValue) {
+  std::mt19937_64 gen(10);
+  std::uniform_int_distribution<uint32_t> sizeDist(1, maxSize);
+  std::uniform_int_distribution<uint64_t> dist(0, maxValue);
+  std::uniform_int_distribution<uint32_t> phraseDist(2, 24);
+  std::uniform_real_distribution<double> unitDist;
+  std::geometric_distribution<uint64_t> gapDist(1.0 / 16);
+
+  Batch b;
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto size = sizeDist(gen);
+    auto values = std::vector<uint64_t>();
+
+    while (values.size() < size) {
+      switch (kind) {
+        case IntegerKind::kUniform:
+          values.push_back(dist(gen));
+          break;
+        case IntegerKind::kTokenIds: {
+          uint32_t phrase = phraseDist(gen);
+
+          if (values.size() > phrase && unitDist(gen) < 0.5) {
+            size_t back = std::min<size_t>(4096, values.size() - phrase);
+            size_t start = values.size() - phrase - gen() % back;
+
+            for (uint32_t j = 0; j < phrase; ++j) {
+              values.push_back(values[start + j]);
+            }
+          } else {
+            for (uint32_t j = 0; j < phrase; ++j) {
+              values.push_back(dist(gen));
+            }
+          }
+          break;
+        }
+        case IntegerKind::kEmbeddingIds:
+          values.push_back(uint64_t(maxValue * std::pow(unitDist(gen), 4.0)));
+          break;
+        case IntegerKind::kSparseIndices:
+          values.push_back(
+              std::min(
+                  maxValue,
+                  (values.empty() ? 0 : values.back() + 1) + gapDist(gen)));
+          break;
+      }
+    }
+
+    auto data = std::vector<uint8_t>(size * width);
+    for (uint32_t j = 0; j < size; ++j) {
+      std::memcpy(data.data() + j * width, &values[j], width);
+    }
+
+    b.sizes.push_back(size);
+    b.data.push_back(std::move(data));
+    b.dec.emplace_back(size * width);
+    b.totalBytes += size * width;
+  }
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    b.inPtrs.push_back(b.data[i].data());
+    b.decPtrs.push_back(b.dec[i].data());
+  }
+
+  return b;
+}
+
+// Returns the best time in seconds over several runs of fn
+template <typename Fn>
+double timeBest(Fn fn) {
+  constexpr int kRuns = 5;
+  double best = 1e30;
+
+  for (int i = 0; i < kRuns; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+
+    best = std::min(best, std::chrono::duration<double>(end - start).count());
+  }
+
+  return best;
+}
+
+void report(
+    const std::string& name,
+    int numThreads,
+    size_t bytes,
+    size_t compressedBytes,
+    double compSec,
+    double decompSec) {
+  std::cout << std::setw(12) << name << std::setw(9) << numThreads
+            << std::fixed << std::setprecision(3) << std::setw(10)
+            << double(compressedBytes) / double(bytes) << std::setw(12)
+            << bytes / compSec * 1e-9 << std::setw(12)
+            << bytes / decompSec * 1e-9 << "\n";
+}
+
+void benchFloat(
+    ThreadPool& pool,
+    FloatType ft,
+    const std::string& name,
+    Batch& b,
+    const ANSCodecConfig& ansConfig = ANSCodecConfig(10),
+    float sparseThreshold = kFloatDefaultSparseThreshold) {
+  uint32_t numInBatch = b.sizes.size();
+  auto config = FloatCodecConfig(ft, ansConfig, false);
+  config.sparseThreshold = sparseThreshold;
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  auto compSec = timeBest([&]() {
+    floatCompressCpu(
+        pool,
+        config,
+        numInBatch,
+        b.inPtrs.data(),
+        b.sizes.data(),
+        b.encPtrs.data(),
+        encSize.data());
+  });
+
+  auto decompSec = timeBest([&]() {
+    floatDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        b.encConstPtrs.data(),
+        b.decPtrs.data(),
+        b.sizes.data(),
+        nullptr,
+        nullptr);
+  });
+
+  CHECK(b.data == b.dec);
+
+  size_t compressedBytes = 0;
+  for (auto s : encSize) {
+    compressedBytes += s;
+  }
+
+  report(
+      name,
+      pool.getNumThreads(),
+      b.totalBytes,
+      compressedBytes,
+      compSec,
+      decompSec);
+}
+
+void benchInt(
+    ThreadPool& pool,
+    Batch& b,
+    const IntCodecConfig& config,
+    const std::string& name) {
+  uint32_t numInBatch = b.sizes.size();
+
+  auto intEnc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto intEncPtrs = std::vector<void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    intEnc[i].resize(getMaxIntCompressedSize(
+        config.intType,
+        b.sizes[i],
+        config.ansConfig.blockSize,
+        config.ansConfig.useWideState,
+        config.ansConfig.getMaxTables(),
+        config.ansConfig.useBlockChecksum));
+    intEncPtrs[i] = intEnc[i].data();
+  }
+
+  auto intEncConstPtrs =
+      std::vector<const void*>(intEncPtrs.begin(), intEncPtrs.end());
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  auto compSec = timeBest([&]() {
+    intCompressCpu(
+        pool,
+        config,
+        numInBatch,
+        b.inPtrs.data(),
+        b.sizes.data(),
+        intEncPtrs.data(),
+        encSize.data());
+  });
+
+  auto decompSec = timeBest([&]() {
+    intDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        intEncConstPtrs.data(),
+        b.decPtrs.data(),
+        b.sizes.data(),
+        nullptr,
+        nullptr);
+  });
+
+  CHECK(b.data == b.dec);
+
+  size_t compressedBytes = 0;
+  for (auto s : encSize) {
+    compressedBytes += s;
+  }
+
+  report(
+      name,
+      pool.getNumThreads(),
+      b.totalBytes,
+      compressedBytes,
+      compSec,
+      decompSec);
+}
+
+// Compresses the raw bytes of the batch with the ANS codec directly
+void benchANS(
+    ThreadPool& pool,
+    Batch& b,
+    const ANSCodecConfig& config,
+    const std::string& name) {
+  uint32_t numInBatch = b.sizes.size();
+
+  auto byteSizes = std::vector<uint32_t>(numInBatch);
+  auto ansEnc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto ansEncPtrs = std::vector<void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    byteSizes[i] = b.data[i].size();
+    ansEnc[i].resize(getMaxCompressedSize(
+        byteSizes[i],
+        config.blockSize,
+        config.useWideState,
+        config.getMaxTables()));
+    ansEncPtrs[i] = ansEnc[i].data();
+  }
+
+  auto ansEncConstPtrs =
+      std::vector<const void*>(ansEncPtrs.begin(), ansEncPtrs.end());
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  auto compSec = timeBest([&]() {
+    ansEncodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        b.inPtrs.data(),
+        byteSizes.data(),
+        nullptr,
+        ansEncPtrs.data(),
+        encSize.data());
+  });
+
+  auto decompSec = timeBest([&]() {
+    ansDecodeBatchCpu(
+        pool,
+        config,
+        numInBatch,
+        ansEncConstPtrs.data(),
+        b.decPtrs.data(),
+        byteSizes.data(),
+        nullptr,
+        nullptr);
+  });
+
+  CHECK(b.data == b.dec);
+
+  size_t compressedBytes = 0;
+  for (auto s : encSize) {
+    compressedBytes += s;
+  }
+
+  report(
+      name,
+      pool.getNumThreads(),
+      b.totalBytes,
+      compressedBytes,
+      compSec,
+      decompSec);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  int maxThreads = argc > 1 ? std::stoi(argv[1])
+                            : std::max(1U, std::thread::hardware_concurrency());
+  uint32_t numInBatch = argc > 2 ? std::stoul(argv[2]) : 64;
+  uint32_t maxSize = argc > 3 ? std::stoul(argv[3]) : 1024 * 1024;
+
+  std::cout << "batch of " << numInBatch << " arrays of up to " << maxSize
+            << " words, SIMD decode level "
+            << getCpuSimdLevelName(getCpuSimdLevel()) << "\n";
+  std::cout << std::setw(12) << "codec" << std::setw(9) << "threads"
+            << std::setw(10) << "ratio" << std::setw(12) << "comp GB/s"
+            << std::setw(12) << "decomp GB/s"
+            << "\n";
+
+  auto bf16 = makeBatch(FloatType::kBFloat16, numInBatch, maxSize);
+  auto f32 = makeBatch(FloatType::kFloat32, numInBatch, maxSize);
+  auto f64 = makeBatch(FloatType::kFloat64, numInBatch, maxSize);
+
+  for (int t = 1;; t = std::min(t * 2, maxThreads)) {
+    ThreadPool pool(t);
+
+    benchANS(pool, bf16, ANSCodecConfig(10), "ans");
+    benchANS(
+        pool,
+        bf16,
+        ANSCodecConfig(10, false, kANSDefaultBlockSize, true),
+        "ans-wide");
+    benchFloat(pool, FloatType::kBFloat16, "bfloat16", bf16);
+    benchFloat(pool, FloatType::kFloat32, "float32", f32);
+    benchFloat(pool, FloatType::kFloat64, "float64", f64);
+
+    if (t == maxThreads) {
+      break;
+    }
+  }
+
+  std::cout << "\nbfloat16 by probBits (decode table bytes)\n";
+  ThreadPool pool(maxThreads);
+
+  for (int probBits = kANSMinProbBits; probBits <= kANSMaxProbBits;
+       ++probBits) {
+    auto name = "p" + std::to_string(probBits) + " (" +
+        std::to_string(getANSDecodeTableWords(probBits) * sizeof(TableT)) + ")";
+
+    benchFloat(
+        pool, FloatType::kBFloat16, name, bf16, ANSCodecConfig(probBits));
+  }
+
+  // Contexts capture the dependence between the two bytes of each word when
+  // coding raw bytes, and between successive exponents in the float codec
+  std::cout << "\nbfloat16 by number of order-1 contexts\n";
+
+  for (uint32_t numContexts = 1; numContexts <= kANSMaxContexts;
+       numContexts *= 2) {
+    auto suffix = " c" + std::to_string(numContexts);
+
+    benchANS(
+        pool,
+        bf16,
+        ANSCodecConfig(
+            10, false, kANSDefaultBlockSize, false, nullptr, numContexts),
+        "ans" + suffix);
+    benchFloat(
+        pool,
+        FloatType::kBFloat16,
+        "bf16" + suffix,
+        bf16,
+        ANSCodecConfig(
+            10, false, kANSDefaultBlockSize, false, nullptr, numContexts));
+  }
+
+  // Segments give each layer's exponents a pdf of their own
+  std::cout << "\nbfloat16 of 16 layers by maximum number of segments\n";
+  auto layers = makeBatch(FloatType::kBFloat16, numInBatch, maxSize, 16);
+
+  for (uint32_t maxSegments = 1; maxSegments <= kANSMaxSegments;
+       maxSegments *= 2) {
+    benchFloat(
+        pool,
+        FloatType::kBFloat16,
+        "bf16 s" + std::to_string(maxSegments),
+        layers,
+        ANSCodecConfig(
+            10, false, kANSDefaultBlockSize, false, nullptr, 1, maxSegments));
+  }
+
+  // Sparse mode stores a bit for each zero word in place of its exponent and
+  // non-compressed bytes
+  std::cout << "\nby fraction of zero words, dense (d) and sparse (s)\n";
+
+  for (int zeroPercent : {10, 50, 90}) {
+    auto suffix = " z" + std::to_string(zeroPercent);
+    auto zeroFraction = zeroPercent / 100.0f;
+
+    auto sparseBf16 = makeBatch(
+        FloatType::kBFloat16, numInBatch, maxSize, 1, zeroFraction);
+    auto sparseF32 =
+        makeBatch(FloatType::kFloat32, numInBatch, maxSize, 1, zeroFraction);
+
+    benchFloat(
+        pool,
+        FloatType::kBFloat16,
+        "bf16 d" + suffix,
+        sparseBf16,
+        ANSCodecConfig(10),
+        2.0f);
+    benchFloat(pool, FloatType::kBFloat16, "bf16 s" + suffix, sparseBf16);
+    benchFloat(
+        pool,
+        FloatType::kFloat32,
+        "f32 d" + suffix,
+        sparseF32,
+        ANSCodecConfig(10),
+        2.0f);
+    benchFloat(pool, FloatType::kFloat32, "f32 s" + suffix, sparseF32);
+  }
+
+  // The byte shuffle gathers the mostly zero high order bytes of integers
+  // into planes of their own
+  std::cout << "\nint32 and int64 of up to 2^20 by byte shuffle width\n";
+
+  for (uint32_t width : {4, 8}) {
+    auto ints = makeIntegerBatch(
+        IntegerKind::kUniform, width, numInBatch, maxSize, 1 << 20);
+    auto prefix = "i" + std::to_string(width * 8);
+
+    for (uint32_t shuffleWidth : {1U, width}) {
+      benchANS(
+          pool,
+          ints,
+          ANSCodecConfig(
+              10,
+              false,
+              kANSDefaultBlockSize,
+              false,
+              nullptr,
+              1,
+              1,
+              shuffleWidth),
+          prefix + " w" + std::to_string(shuffleWidth));
+    }
+  }
+
+  // The integer codec against byte shuffled ANS alone, on index streams
+  std::cout << "\nindex streams by codec (lz: the integer codec)\n";
+
+  struct IndexStream {
+    IntegerKind kind;
+    IntType intType;
+    uint64_t maxValue;
+    std::string name;
+  };
+
+  for (auto& stream :
+       {IndexStream{IntegerKind::kTokenIds, IntType::kInt32, 50000, "tok32"},
+        IndexStream{
+            IntegerKind::kEmbeddingIds, IntType::kInt64, 1 << 24, "emb64"},
+        IndexStream{
+            IntegerKind::kSparseIndices, IntType::kInt32, ~0U, "sparse32"}}) {
+    auto width = getWordSizeFromIntType(stream.intType);
+    auto ints = makeIntegerBatch(
+        stream.kind, width, numInBatch, maxSize, stream.maxValue);
+
+    auto ansConfig = ANSCodecConfig(10);
+    ansConfig.shuffleWidth = width;
+    benchANS(pool, ints, ansConfig, stream.name + " ans");
+
+    benchInt(
+        pool,
+        ints,
+        IntCodecConfig(stream.intType, ANSCodecConfig(10)),
+        stream.name + " lz");
+  }
+
+  return 0;
+}
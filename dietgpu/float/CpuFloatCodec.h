@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+namespace dietgpu {
+
+//
+// Host (CPU) implementation of the float codec
+//
+// These functions produce and consume exactly the same archive format as
+// floatCompress / floatDecompress, so data compressed on the host can be
+// decompressed on the GPU and vice versa. All pointers are host pointers, and
+// no GPU is required.
+//
+// Work is spread across the threads of `pool`; the float split/join passes are
+// performed over fixed-size chunks of all members of the batch, and the ANS
+// stage over ANS blocks (see CpuANSCodec.h).
+//
+
+void floatCompressCpu(
+    ThreadPool& pool,
+    // How should we compress our data?
+    const FloatCompressConfig& config,
+
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the batch
+    const void** in,
+    // Host array with sizes of batch members (in float words, NOT bytes)
+    const uint32_t* inSize,
+
+    // Host array with addresses of host pointers of outputs, each pointing
+    // to a valid region of memory of at least size
+    // getMaxFloatCompressedSize(ft, inSize[i], config.ansConfig.blockSize,
+    // config.ansConfig.useWideState, config.ansConfig.getMaxTables(),
+    // config.predictor, config.useBlockChecksum)
+    void** out,
+    // Host array of size numInBatch (optional)
+    // Provides the size of actual used memory in bytes for each batch element
+    uint32_t* outSize,
+
+    // Delta mode (optional, can be nullptr): host array with addresses of host
+    // pointers to a reference of inSize[i] float words for each batch member,
+    // or nullptr for a member compressed without one. A member with a
+    // reference is compressed as the XOR of its words with the reference, so
+    // the sign and exponent bits that the two share (e.g., successive
+    // checkpoints of a weight) become zero symbols, and words that are
+    // unchanged become zero words (see FloatCompressConfig::sparseThreshold).
+    // The checksum is that of the XOR. Delta archives that are not sparse can
+    // also be decompressed on the GPU (see floatDecompress)
+    const void** ref = nullptr);
+
+// The block checksums of archives that hold them (see
+// FloatCodecConfig::useBlockChecksum) are verified against the decompressed
+// words, with any blocks that do not match reported in the returned status
+FloatDecompressStatus floatDecompressCpu(
+    ThreadPool& pool,
+    // How should we decompress our data?
+    const FloatDecompressConfig& config,
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the batch
+    const void** in,
+
+    // Host array with addresses of host pointers of outputs, each pointing
+    // to a valid region of memory of at least size outCapacity[i]
+    void** out,
+    // Host array of size numInBatch
+    // Provides the maximum amount of space present for decompressing each
+    // batch problem, in float words
+    const uint32_t* outCapacity,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with true/false
+    // for whether or not decompression status was successful
+    uint8_t* outSuccess,
+
+    // Decode size status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with either the
+    // size decompressed reported if successful, or the required size reported
+    // if our outCapacity was insufficient. Size reported is in float words
+    uint32_t* outSize,
+
+    // Host array with addresses of host pointers to the reference of each
+    // batch member compressed in delta mode (see floatCompressCpu), which is
+    // XORed into the decompressed words. Required if any member is a delta
+    // archive, and otherwise unused (can be nullptr)
+    const void** ref = nullptr);
+
+// Random-access decode: decompresses only float words
+// [rangeOffset[i], rangeOffset[i] + rangeSize[i]) of each archive into out[i],
+// decoding only the ANS blocks that cover the range (see
+// ansDecodeRangeBatchCpu). config.useChecksum must be false, as the checksum
+// covers the entire data; block checksums are not verified
+void floatDecompressRangeCpu(
+    ThreadPool& pool,
+    // How should we decompress our data?
+    const FloatDecompressConfig& config,
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the batch
+    const void** in,
+
+    // Host arrays with the offset and size of the range to decode from each
+    // batch member, in float words
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+
+    // Host array with addresses of host pointers of outputs, each pointing
+    // to a valid region of memory of at least rangeSize[i] float words
+    void** out,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with true/false
+    // for whether or not the range could be decoded
+    uint8_t* outSuccess,
+
+    // References of the members compressed in delta mode, as for
+    // floatDecompressCpu; the words of the reference at the range are used
+    const void** ref = nullptr);
+
+// Mixed-type batches: compresses a batch whose member i is of float type
+// floatTypes[i] (config.floatType is ignored), with the members of each type
+// compressed as a sub-batch by floatCompressCpu. Other arguments are as for
+// floatCompressCpu, with each out[i] sized for floatTypes[i]
+void floatCompressMixedCpu(
+    ThreadPool& pool,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    // Host array with the float type of each batch member
+    const FloatType* floatTypes,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize);
+
+// Decompresses a batch of archives that may be of different float types,
+// each decompressed as the type recorded in its header (config.floatType is
+// ignored). outCapacity[i] and the reported sizes are in words of the type of
+// member i. Other arguments are as for floatDecompressCpu; the errorInfo index
+// of the returned status is the index of the member in the batch
+FloatDecompressStatus floatDecompressMixedCpu(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize);
+
+} // namespace dietgpu
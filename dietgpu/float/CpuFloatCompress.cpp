@@ -0,0 +1,758 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Block checksums are computed by the tasks that split or gather each chunk,
+// so chunks of the smallest words must hold whole checksum blocks
+static_assert(
+    isEvenDivisor(kFloatChunkSize, kANSChecksumBlockSize),
+    "chunks must hold whole checksum blocks");
+
+// Computes the block checksums of the words [start, start + num) of member
+// `batch` of checksumIn (if given) into checksums[batch]
+void checksumChunk(
+    const void** checksumIn,
+    uint32_t** checksums,
+    uint32_t batch,
+    uint32_t wordSize,
+    uint32_t start,
+    uint32_t num) {
+  if (checksumIn && checksumIn[batch]) {
+    ansChecksumPiecesCpu(
+        checksumIn[batch],
+        (size_t)start * wordSize,
+        (size_t)(start + num) * wordSize,
+        kANSChecksumBlockSize,
+        checksums[batch]);
+  }
+}
+
+// Splits words [start, start + num) of a float array of `size` words into the
+// compressed symbols and non-compressed portion, accumulating the histogram
+// of the compressed symbols
+template <FloatType FT>
+void splitFloatChunk(
+    const void* in,
+    uint32_t size,
+    uint32_t start,
+    uint32_t num,
+    uint8_t* compOut,
+    uint8_t* nonCompOut,
+    uint32_t* histogram) {
+  using FTI = FloatTypeInfo<FT>;
+  using WordT = typename FTI::WordT;
+  using CompT = typename FTI::CompT;
+  using NonCompT = typename FTI::NonCompT;
+
+  auto inWords = (const WordT*)in;
+
+  for (uint32_t i = start; i < start + num; ++i) {
+    CompT comp;
+    NonCompT nonComp;
+    FTI::split(inWords[i], comp, nonComp);
+
+    compOut[i] = comp;
+    CpuFloatNonComp<FT>::write(nonCompOut, size, i, nonComp);
+    histogram[comp]++;
+  }
+}
+
+// As splitFloatChunk, for the bit packed float8 types. `start` is a multiple
+// of kFloat8GroupSize, so each chunk writes whole bytes of the planes
+template <FloatType FT>
+void splitFloat8Chunk(
+    const void* in,
+    uint32_t size,
+    uint32_t start,
+    uint32_t num,
+    uint8_t* compOut,
+    uint8_t* nonCompOut,
+    uint32_t* histogram) {
+  using FTI = FloatTypeInfo<FT>;
+
+  auto inWords = (const typename FTI::WordT*)in;
+
+  for (uint32_t i = start; i < start + num; i += kFloat8GroupSize) {
+    uint32_t n = std::min(kFloat8GroupSize, start + num - i);
+    typename FTI::NonCompT nonComp[kFloat8GroupSize] = {0};
+
+    for (uint32_t j = 0; j < n; ++j) {
+      typename FTI::CompT comp;
+      FTI::split(inWords[i + j], comp, nonComp[j]);
+
+      compOut[i + j] = comp;
+      histogram[comp]++;
+    }
+
+    FTI::writeGroup(nonCompOut, size, i / kFloat8GroupSize, nonComp);
+  }
+}
+
+// Returns the number of the words [start, start + num) of `in` that are not
+// zero
+template <typename WordT>
+uint32_t countNonZeroChunk(const void* in, uint32_t start, uint32_t num) {
+  auto inWords = (const WordT*)in;
+
+  uint32_t n = 0;
+  for (uint32_t i = start; i < start + num; ++i) {
+    n += inWords[i] != 0;
+  }
+
+  return n;
+}
+
+// Gathers the non-zero words of words [start, start + num) of `in` to `out`,
+// writing their bits of the zero bitmap. `start` is a multiple of 32, so each
+// chunk writes whole words of the bitmap
+template <typename WordT>
+void gatherNonZeroChunk(
+    const void* in,
+    uint32_t start,
+    uint32_t num,
+    void* out,
+    uint32_t* bitmap) {
+  auto inWords = (const WordT*)in;
+  auto outWords = (WordT*)out;
+
+  for (uint32_t i = start; i < start + num; i += 32) {
+    uint32_t n = std::min(32U, start + num - i);
+    uint32_t bits = 0;
+
+    for (uint32_t j = 0; j < n; ++j) {
+      auto w = inWords[i + j];
+      if (w != 0) {
+        bits |= 1U << j;
+        *outWords++ = w;
+      }
+    }
+
+    bitmap[i / 32] = bits;
+  }
+}
+
+// Compresses each batch member as a dense archive, splitting every word. The
+// block checksums of checksumIn (see floatCompressCpuImpl) are computed while
+// splitting
+void floatCompressDenseCpu(
+    ThreadPool& pool,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize,
+    const void** checksumIn,
+    uint32_t** checksums) {
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+  auto chunks = CpuFloatChunks(numInBatch, inSize);
+  auto numChunks = chunks.getNumChunks();
+
+  // Temporary space for the extracted exponents; all rows must be 16 byte
+  // aligned
+  auto compStart = std::vector<size_t>(numInBatch + 1);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    CHECK_EQ(uintptr_t(in[i]) % wordSize, 0);
+    compStart[i + 1] = compStart[i] + roundUp(inSize[i], sizeof(uint4));
+  }
+
+  auto toComp = std::vector<uint8_t>(compStart[numInBatch]);
+
+  auto chunkHistogram = std::vector<uint32_t>(numChunks * kNumSymbols);
+  auto chunkChecksum =
+      std::vector<uint32_t>(config.useChecksum ? numChunks : 0);
+
+  // Write the headers, and zero the alignment padding of the non-compressed
+  // data so the output is deterministic
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    auto header = (GpuFloatHeader*)out[batch];
+    std::memset(header, 0, sizeof(GpuFloatHeader));
+
+    header->size = inSize[batch];
+    header->setFloatType(config.floatType);
+    header->setUseChecksum(config.useChecksum);
+    header->setMagicAndVersion();
+
+    auto size = inSize[batch];
+    auto nonCompOut = (uint8_t*)(header + 1);
+    auto uncompSize = getFloatUncompDataSize(*header);
+
+    if (config.floatType == FloatType::kFloat32) {
+      auto lowEnd = 2 * size;
+      auto highStart = 2 * roundUp(size, 8);
+      std::memset(nonCompOut + lowEnd, 0, highStart - lowEnd);
+      std::memset(
+          nonCompOut + highStart + size, 0, uncompSize - (highStart + size));
+    } else if (config.floatType == FloatType::kFloat64) {
+      auto lowEnd = 4 * size;
+      auto midStart = 4 * roundUp(size, 4);
+      auto midEnd = midStart + 2 * size;
+      auto highStart = midStart + 2 * roundUp(size, 8);
+      std::memset(nonCompOut + lowEnd, 0, midStart - lowEnd);
+      std::memset(nonCompOut + midEnd, 0, highStart - midEnd);
+      std::memset(
+          nonCompOut + highStart + size, 0, uncompSize - (highStart + size));
+    } else if (
+        config.floatType == FloatType::kFloat8E4M3 ||
+        config.floatType == FloatType::kFloat8E5M2) {
+      // The float8 planes are small, and a final partial group may write
+      // past the end of its plane's data into the padding
+      std::memset(nonCompOut, 0, uncompSize);
+    } else {
+      std::memset(nonCompOut + size, 0, uncompSize - size);
+    }
+
+    std::memset(
+        toComp.data() + compStart[batch] + size,
+        0,
+        compStart[batch + 1] - compStart[batch] - size);
+  });
+
+  // Split the floats and compute the histogram of the compressed symbols
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+    uint32_t size = inSize[batch];
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+    uint32_t num = std::min(size - start, kFloatChunkSize);
+
+    auto compOut = toComp.data() + compStart[batch];
+    auto nonCompOut = (uint8_t*)out[batch] + sizeof(GpuFloatHeader);
+    auto histogram = chunkHistogram.data() + chunk * kNumSymbols;
+
+    switch (config.floatType) {
+      case FloatType::kFloat16:
+        splitFloatChunk<FloatType::kFloat16>(
+            in[batch], size, start, num, compOut, nonCompOut, histogram);
+        break;
+      case FloatType::kBFloat16:
+        splitFloatChunk<FloatType::kBFloat16>(
+            in[batch], size, start, num, compOut, nonCompOut, histogram);
+        break;
+      case FloatType::kFloat32:
+        splitFloatChunk<FloatType::kFloat32>(
+            in[batch], size, start, num, compOut, nonCompOut, histogram);
+        break;
+      case FloatType::kFloat64:
+        splitFloatChunk<FloatType::kFloat64>(
+            in[batch], size, start, num, compOut, nonCompOut, histogram);
+        break;
+      case FloatType::kFloat8E4M3:
+        splitFloat8Chunk<FloatType::kFloat8E4M3>(
+            in[batch], size, start, num, compOut, nonCompOut, histogram);
+        break;
+      case FloatType::kFloat8E5M2:
+        splitFloat8Chunk<FloatType::kFloat8E5M2>(
+            in[batch], size, start, num, compOut, nonCompOut, histogram);
+        break;
+      default:
+        CHECK(false);
+        break;
+    }
+
+    // As with the GPU codec, the checksum covers the first `size` bytes of
+    // the input (the batch size in float words, interpreted as bytes). Chunk
+    // `chunk` covers bytes [start, start + num) of that range
+    if (config.useChecksum) {
+      chunkChecksum[chunk] =
+          ansChecksumCpu((const uint8_t*)in[batch] + start, num);
+    }
+
+    checksumChunk(checksumIn, checksums, batch, wordSize, start, num);
+  });
+
+  // Reduce the per-chunk histograms and checksums for each batch member
+  auto histogram = std::vector<uint32_t>(numInBatch * kNumSymbols);
+
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    auto batchHistogram = histogram.data() + batch * kNumSymbols;
+    uint32_t checksum = 0;
+
+    for (auto c = chunks.chunkStart[batch]; c < chunks.chunkStart[batch + 1];
+         ++c) {
+      for (int s = 0; s < kNumSymbols; ++s) {
+        batchHistogram[s] += chunkHistogram[c * kNumSymbols + s];
+      }
+
+      if (config.useChecksum) {
+        checksum ^= chunkChecksum[c];
+      }
+    }
+
+    if (config.useChecksum) {
+      ((GpuFloatHeader*)out[batch])->setChecksum(checksum);
+    }
+  });
+
+  // Compress the extracted symbols, placing the ANS archive after the
+  // non-compressed data
+  auto compIn = std::vector<const void*>(numInBatch);
+  auto ansOut = std::vector<void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    compIn[i] = toComp.data() + compStart[i];
+    ansOut[i] = (uint8_t*)out[i] + sizeof(GpuFloatHeader) +
+        getFloatUncompDataSize(*(const GpuFloatHeader*)out[i]);
+  }
+
+  ansEncodeBatchCpu(
+      pool,
+      config.ansConfig,
+      numInBatch,
+      compIn.data(),
+      inSize,
+      histogram.data(),
+      ansOut.data(),
+      outSize);
+
+  // outSize as reported by ansEncodeBatchCpu is just the ANS-encoded portion
+  // of the data
+  if (outSize) {
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      outSize[i] += sizeof(GpuFloatHeader) +
+          getFloatUncompDataSize(*(const GpuFloatHeader*)out[i]);
+    }
+  }
+}
+
+// Compresses the batch as floatCompressCpu, without block checksums in the
+// archives. If checksumIn is given, the CRC32C of each kANSChecksumBlockSize
+// block of checksumIn[i], the input as given (of which in[i] may be a delta or
+// the residuals), is computed into checksums[i] as each chunk is read
+void floatCompressCpuImpl(
+    ThreadPool& pool,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize,
+    const void** ref,
+    const void** checksumIn,
+    uint32_t** checksums) {
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+
+  // In delta mode, the XOR of each member with its reference is compressed
+  if (ref) {
+    auto deltaStart = std::vector<size_t>(numInBatch + 1);
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      deltaStart[i + 1] = deltaStart[i] +
+          (ref[i] ? roundUp((size_t)inSize[i] * wordSize, kANSRequiredAlignment)
+                  : 0);
+    }
+
+    auto delta = std::vector<uint8_t>(deltaStart[numInBatch]);
+    auto deltaIn = std::vector<const void*>(in, in + numInBatch);
+    auto deltaOut = std::vector<void*>(numInBatch);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      deltaOut[i] = delta.data() + deltaStart[i];
+    }
+
+    ansXorBatchCpu(
+        pool, numInBatch, in, ref, inSize, wordSize, deltaOut.data());
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      if (ref[i]) {
+        deltaIn[i] = deltaOut[i];
+      }
+    }
+
+    floatCompressCpuImpl(
+        pool,
+        config,
+        numInBatch,
+        deltaIn.data(),
+        inSize,
+        out,
+        outSize,
+        nullptr,
+        checksumIn,
+        checksums);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      auto header = (GpuFloatHeader*)out[i];
+      header->setUseDelta(ref[i] != nullptr);
+      header->setMagicAndVersion();
+    }
+
+    return;
+  }
+
+  // With a predictor, the residuals are compressed as an ordinary archive
+  // following the header and grid
+  if (config.predictor != FloatPredictor::kNone) {
+    auto residualStart = std::vector<size_t>(numInBatch + 1);
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      residualStart[i + 1] =
+          residualStart[i] + roundUp((size_t)inSize[i] * wordSize, 16);
+    }
+
+    auto residual = std::vector<uint8_t>(residualStart[numInBatch]);
+    auto residualPtrs = std::vector<void*>(numInBatch);
+    auto innerOut = std::vector<void*>(numInBatch);
+    auto innerSize = std::vector<uint32_t>(numInBatch);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      residualPtrs[i] = residual.data() + residualStart[i];
+      innerOut[i] = (uint8_t*)out[i] + sizeof(GpuFloatHeader) +
+          sizeof(FloatGridHeader);
+    }
+
+    floatPredictBatchCpu(
+        pool,
+        config.floatType,
+        config.predictor,
+        config.gridDims,
+        numInBatch,
+        in,
+        inSize,
+        residualPtrs.data());
+
+    auto innerConfig = config;
+    innerConfig.predictor = FloatPredictor::kNone;
+
+    floatCompressCpuImpl(
+        pool,
+        innerConfig,
+        numInBatch,
+        (const void**)residualPtrs.data(),
+        inSize,
+        innerOut.data(),
+        innerSize.data(),
+        nullptr,
+        checksumIn,
+        checksums);
+
+    // The checksum is that of the residuals, as verified by the inner archive
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      auto header = (GpuFloatHeader*)out[i];
+      std::memset(header, 0, sizeof(GpuFloatHeader) + sizeof(FloatGridHeader));
+
+      header->size = inSize[i];
+      header->setFloatType(config.floatType);
+      header->setUseChecksum(config.useChecksum);
+      header->setPredictor(config.predictor);
+      header->setChecksum(((const GpuFloatHeader*)innerOut[i])->getChecksum());
+      header->setMagicAndVersion();
+
+      auto grid = (FloatGridHeader*)(header + 1);
+      grid->gridDims[0] = config.gridDims[0];
+      grid->gridDims[1] = config.gridDims[1];
+
+      if (outSize) {
+        outSize[i] =
+            sizeof(GpuFloatHeader) + sizeof(FloatGridHeader) + innerSize[i];
+      }
+    }
+
+    return;
+  }
+
+  auto chunks = CpuFloatChunks(numInBatch, inSize);
+  auto numChunks = chunks.getNumChunks();
+  bool trySparse = config.sparseThreshold <= 1.0f;
+
+  // Count the non-zero words of each chunk
+  auto chunkNonZero = std::vector<uint32_t>(numChunks);
+
+  if (trySparse) {
+    pool.parallelFor(numChunks, [&](size_t chunk) {
+      uint32_t batch = chunks.getBatch(chunk);
+      uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+      uint32_t num = std::min(inSize[batch] - start, kFloatChunkSize);
+
+      switch (wordSize) {
+        case sizeof(uint8_t):
+          chunkNonZero[chunk] =
+              countNonZeroChunk<uint8_t>(in[batch], start, num);
+          break;
+        case sizeof(uint16_t):
+          chunkNonZero[chunk] =
+              countNonZeroChunk<uint16_t>(in[batch], start, num);
+          break;
+        case sizeof(uint32_t):
+          chunkNonZero[chunk] =
+              countNonZeroChunk<uint32_t>(in[batch], start, num);
+          break;
+        case sizeof(uint64_t):
+          chunkNonZero[chunk] =
+              countNonZeroChunk<uint64_t>(in[batch], start, num);
+          break;
+        default:
+          CHECK(false);
+          break;
+      }
+    });
+  }
+
+  // Choose the batch members compressed in sparse mode. Each chunk's non-zero
+  // words are gathered after those of the preceding chunks of its member
+  auto sparse = std::vector<uint8_t>(numInBatch);
+  auto nonZero = std::vector<uint32_t>(numInBatch);
+  auto chunkNonZeroStart = std::vector<uint32_t>(numChunks);
+  bool anySparse = false;
+
+  for (uint32_t i = 0; i < numInBatch && trySparse; ++i) {
+    for (auto c = chunks.chunkStart[i]; c < chunks.chunkStart[i + 1]; ++c) {
+      chunkNonZeroStart[c] = nonZero[i];
+      nonZero[i] += chunkNonZero[c];
+    }
+
+    uint32_t size = inSize[i];
+    uint32_t zero = size - nonZero[i];
+
+    // The sparse archive must fit in the space reserved for the dense one
+    auto maxDenseSize = getMaxFloatCompressedSize(
+        config.floatType,
+        size,
+        config.ansConfig.blockSize,
+        config.ansConfig.useWideState,
+        config.ansConfig.getMaxTables());
+    auto maxSparseSize = sizeof(GpuFloatHeader) +
+        getFloatSparseBitmapSize(size) +
+        getMaxFloatCompressedSize(
+            config.floatType,
+            nonZero[i],
+            config.ansConfig.blockSize,
+            config.ansConfig.useWideState,
+            config.ansConfig.getMaxTables());
+
+    sparse[i] = size > 0 && zero >= config.sparseThreshold * size &&
+        maxSparseSize <= maxDenseSize;
+    anySparse = anySparse || sparse[i];
+  }
+
+  if (!anySparse) {
+    floatCompressDenseCpu(
+        pool,
+        config,
+        numInBatch,
+        in,
+        inSize,
+        out,
+        outSize,
+        checksumIn,
+        checksums);
+    return;
+  }
+
+  // The non-zero words of the sparse members are gathered into temporary space
+  // and compressed as a dense archive, which follows the sparse archive's
+  // header and zero bitmap
+  auto gatherStart = std::vector<size_t>(numInBatch + 1);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    gatherStart[i + 1] =
+        gatherStart[i] + (sparse[i] ? (size_t)nonZero[i] * wordSize : 0);
+  }
+
+  auto gathered = std::vector<uint8_t>(gatherStart[numInBatch]);
+
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+
+    if (!sparse[batch]) {
+      return;
+    }
+
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+    uint32_t num = std::min(inSize[batch] - start, kFloatChunkSize);
+
+    auto gatherOut = gathered.data() + gatherStart[batch] +
+        (size_t)chunkNonZeroStart[chunk] * wordSize;
+    auto bitmap = (uint32_t*)((GpuFloatHeader*)out[batch] + 1);
+
+    switch (wordSize) {
+      case sizeof(uint8_t):
+        gatherNonZeroChunk<uint8_t>(in[batch], start, num, gatherOut, bitmap);
+        break;
+      case sizeof(uint16_t):
+        gatherNonZeroChunk<uint16_t>(in[batch], start, num, gatherOut, bitmap);
+        break;
+      case sizeof(uint32_t):
+        gatherNonZeroChunk<uint32_t>(in[batch], start, num, gatherOut, bitmap);
+        break;
+      case sizeof(uint64_t):
+        gatherNonZeroChunk<uint64_t>(in[batch], start, num, gatherOut, bitmap);
+        break;
+      default:
+        CHECK(false);
+        break;
+    }
+
+    checksumChunk(checksumIn, checksums, batch, wordSize, start, num);
+  });
+
+  auto denseIn = std::vector<const void*>(numInBatch);
+  auto denseSize = std::vector<uint32_t>(numInBatch);
+  auto denseOut = std::vector<void*>(numInBatch);
+  auto denseOutSize = std::vector<uint32_t>(numInBatch);
+
+  // The block checksums of the sparse members were computed while gathering
+  auto denseChecksumIn = std::vector<const void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    denseChecksumIn[i] = checksumIn && !sparse[i] ? checksumIn[i] : nullptr;
+
+    if (sparse[i]) {
+      denseIn[i] = gathered.data() + gatherStart[i];
+      denseSize[i] = nonZero[i];
+      denseOut[i] = (uint8_t*)out[i] + sizeof(GpuFloatHeader) +
+          getFloatSparseBitmapSize(inSize[i]);
+    } else {
+      denseIn[i] = in[i];
+      denseSize[i] = inSize[i];
+      denseOut[i] = out[i];
+    }
+  }
+
+  floatCompressDenseCpu(
+      pool,
+      config,
+      numInBatch,
+      denseIn.data(),
+      denseSize.data(),
+      denseOut.data(),
+      denseOutSize.data(),
+      denseChecksumIn.data(),
+      checksums);
+
+  // Write the headers of the sparse members, whose checksum covers the
+  // original input, and zero the padding of their bitmaps
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    if (!sparse[batch]) {
+      return;
+    }
+
+    auto size = inSize[batch];
+    auto header = (GpuFloatHeader*)out[batch];
+    std::memset(header, 0, sizeof(GpuFloatHeader));
+
+    header->size = size;
+    header->setFloatType(config.floatType);
+    header->setUseChecksum(config.useChecksum);
+    header->setUseSparse(true);
+
+    if (config.useChecksum) {
+      header->setChecksum(ansChecksumCpu((const uint8_t*)in[batch], size));
+    }
+
+    header->setMagicAndVersion();
+
+    auto bitmapEnd = divUp(size, 32U) * sizeof(uint32_t);
+    std::memset(
+        (uint8_t*)(header + 1) + bitmapEnd,
+        0,
+        getFloatSparseBitmapSize(size) - bitmapEnd);
+  });
+
+  if (outSize) {
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      outSize[i] = denseOutSize[i];
+
+      if (sparse[i]) {
+        outSize[i] +=
+            sizeof(GpuFloatHeader) + getFloatSparseBitmapSize(inSize[i]);
+      }
+    }
+  }
+}
+
+} // namespace
+
+void floatCompressCpu(
+    ThreadPool& pool,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize,
+    const void** ref) {
+  // not allowed in float mode
+  CHECK(!config.ansConfig.useChecksum);
+  CHECK(!config.ansConfig.useBlockChecksum)
+      << "block checksums are stored at the float level";
+
+  if (!config.useBlockChecksum) {
+    floatCompressCpuImpl(
+        pool,
+        config,
+        numInBatch,
+        in,
+        inSize,
+        out,
+        outSize,
+        ref,
+        nullptr,
+        nullptr);
+    return;
+  }
+
+  // With block checksums, the words are compressed as an ordinary archive
+  // following the header and the checksums of the words, which are computed
+  // as the words are compressed
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+  auto checksumOut = std::vector<uint32_t*>(numInBatch);
+  auto innerOut = std::vector<void*>(numInBatch);
+  auto innerSize = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    checksumOut[i] = (uint32_t*)((GpuFloatHeader*)out[i] + 1);
+    innerOut[i] = (uint8_t*)checksumOut[i] +
+        getBlockChecksumSize((uint64_t)inSize[i] * wordSize);
+  }
+
+  floatCompressCpuImpl(
+      pool,
+      config,
+      numInBatch,
+      in,
+      inSize,
+      innerOut.data(),
+      innerSize.data(),
+      ref,
+      in,
+      checksumOut.data());
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (GpuFloatHeader*)out[i];
+    std::memset(header, 0, sizeof(GpuFloatHeader));
+
+    header->size = inSize[i];
+    header->setFloatType(config.floatType);
+    header->setUseChecksum(config.useChecksum);
+    header->setUseBlockChecksum(true);
+    header->setChecksum(((const GpuFloatHeader*)innerOut[i])->getChecksum());
+    header->setMagicAndVersion();
+
+    // Add the checksum of all blocks
+    ansBlockChecksumsFromPiecesCpu(
+        checksumOut[i],
+        kANSChecksumBlockSize,
+        (size_t)inSize[i] * wordSize,
+        checksumOut[i]);
+
+    if (outSize) {
+      outSize[i] = (uint8_t*)innerOut[i] - (uint8_t*)out[i] + innerSize[i];
+    }
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,935 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Rejoins words [start, start + num) of the part of a float array of `size`
+// words beginning at word `offset` from the decompressed symbols and the
+// non-compressed portion
+template <FloatType FT>
+void joinFloatChunk(
+    const uint8_t* compIn,
+    const uint8_t* nonCompIn,
+    uint32_t size,
+    uint32_t offset,
+    uint32_t start,
+    uint32_t num,
+    void* out) {
+  using FTI = FloatTypeInfo<FT>;
+  using WordT = typename FTI::WordT;
+
+  auto outWords = (WordT*)out;
+
+  for (uint32_t i = start; i < start + num; ++i) {
+    outWords[i] = FTI::join(
+        compIn[i], CpuFloatNonComp<FT>::read(nonCompIn, size, offset + i));
+  }
+}
+
+// As joinFloatChunk, for the bit packed float8 types
+template <FloatType FT>
+void joinFloat8Chunk(
+    const uint8_t* compIn,
+    const uint8_t* nonCompIn,
+    uint32_t size,
+    uint32_t offset,
+    uint32_t start,
+    uint32_t num,
+    void* out) {
+  using FTI = FloatTypeInfo<FT>;
+
+  auto outWords = (typename FTI::WordT*)out;
+
+  for (uint32_t i = start; i < start + num; ++i) {
+    outWords[i] = FTI::join(compIn[i], FTI::read(nonCompIn, size, offset + i));
+  }
+}
+
+// Returns the number of bits set among bits [start, end) of `bitmap`
+uint32_t countBits(const uint32_t* bitmap, uint32_t start, uint32_t end) {
+  uint32_t n = 0;
+
+  for (uint32_t i = start; i < end;) {
+    uint32_t num = std::min(32 - i % 32, end - i);
+    uint32_t bits = bitmap[i / 32] >> (i % 32);
+
+    if (num < 32) {
+      bits &= (1U << num) - 1;
+    }
+
+    n += __builtin_popcount(bits);
+    i += num;
+  }
+
+  return n;
+}
+
+// Writes words [start, start + num) of a sparse array to `out`, taking the
+// words whose bit is set in `bitmap` in turn from `in` and zeroing the others.
+// This is branch free, so `in` may be read one word past its end
+template <typename WordT>
+void scatterNonZeroChunk(
+    const void* in,
+    const uint32_t* bitmap,
+    uint32_t start,
+    uint32_t num,
+    void* out) {
+  auto inWords = (const WordT*)in;
+  auto outWords = (WordT*)out;
+
+  for (uint32_t i = 0; i < num; ++i) {
+    uint32_t pos = start + i;
+    uint32_t bit = (bitmap[pos / 32] >> (pos % 32)) & 1;
+
+    WordT mask = WordT(0) - WordT(bit);
+    outWords[i] = *inWords & mask;
+    inWords += bit;
+  }
+}
+
+// Decodes either all of each dense archive (if rangeOffset is null) or only
+// the words [rangeOffset[i], rangeOffset[i] + rangeSize[i]) of it; in the
+// latter case out[i] receives the range alone and outCapacity and outSize are
+// unused
+FloatDecompressStatus floatDecompressDenseCpu(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+
+  // not allowed in float mode
+  CHECK(!config.ansConfig.useChecksum);
+
+  auto sizes = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+
+    CHECK(header->isValidMagicAndVersion())
+        << "batch member " << i << " has invalid float magic and version "
+        << std::hex << header->magicAndVersion;
+    CHECK(!header->getUseSparse());
+    CHECK(header->getFloatType() == config.floatType)
+        << "batch member " << i << " has float type "
+        << uint32_t(header->getFloatType()) << " but expected "
+        << uint32_t(config.floatType);
+
+    sizes[i] = header->size;
+  }
+
+  // The words of each batch member that we decode
+  auto offsets = std::vector<uint32_t>(numInBatch);
+  auto lengths = std::vector<uint32_t>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    offsets[i] = rangeOffset ? rangeOffset[i] : 0;
+    lengths[i] = rangeOffset ? rangeSize[i] : sizes[i];
+  }
+
+  // Temporary space for the decompressed exponents
+  auto compStart = std::vector<size_t>(numInBatch + 1);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    compStart[i + 1] = compStart[i] + roundUp(lengths[i], sizeof(uint4));
+  }
+
+  auto fromComp = std::vector<uint8_t>(compStart[numInBatch]);
+
+  auto ansIn = std::vector<const void*>(numInBatch);
+  auto compOut = std::vector<void*>(numInBatch);
+  auto compCapacity = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    ansIn[i] = (const uint8_t*)in[i] + sizeof(GpuFloatHeader) +
+        getFloatUncompDataSize(*(const GpuFloatHeader*)in[i]);
+    compOut[i] = fromComp.data() + compStart[i];
+
+    // The temporary space only holds as many symbols as the header states
+    compCapacity[i] = rangeOffset ? 0 : std::min(outCapacity[i], sizes[i]);
+  }
+
+  auto ansSuccess = std::vector<uint8_t>(numInBatch);
+  auto ansSize = std::vector<uint32_t>(numInBatch);
+
+  // One exponent is encoded per float word, so the float range is also the
+  // range of ANS symbols
+  if (rangeOffset) {
+    ansDecodeRangeBatchCpu(
+        pool,
+        config.ansConfig,
+        numInBatch,
+        ansIn.data(),
+        offsets.data(),
+        lengths.data(),
+        compOut.data(),
+        ansSuccess.data());
+  } else {
+    ansDecodeBatchCpu(
+        pool,
+        config.ansConfig,
+        numInBatch,
+        ansIn.data(),
+        compOut.data(),
+        compCapacity.data(),
+        ansSuccess.data(),
+        ansSize.data());
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    success[i] = ansSuccess[i] && (rangeOffset || ansSize[i] == sizes[i]);
+  }
+
+  // Rejoin the floats of the members that we could decompress
+  auto chunks = CpuFloatChunks(numInBatch, lengths.data());
+  auto numChunks = chunks.getNumChunks();
+  auto chunkChecksum =
+      std::vector<uint32_t>(config.useChecksum ? numChunks : 0);
+
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+    uint32_t size = sizes[batch];
+    uint32_t length = lengths[batch];
+
+    if (!success[batch]) {
+      return;
+    }
+
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+    uint32_t num = std::min(length - start, kFloatChunkSize);
+
+    auto compIn = fromComp.data() + compStart[batch];
+    auto nonCompIn = (const uint8_t*)in[batch] + sizeof(GpuFloatHeader);
+
+    switch (config.floatType) {
+      case FloatType::kFloat16:
+        joinFloatChunk<FloatType::kFloat16>(
+            compIn, nonCompIn, size, offsets[batch], start, num, out[batch]);
+        break;
+      case FloatType::kBFloat16:
+        joinFloatChunk<FloatType::kBFloat16>(
+            compIn, nonCompIn, size, offsets[batch], start, num, out[batch]);
+        break;
+      case FloatType::kFloat32:
+        joinFloatChunk<FloatType::kFloat32>(
+            compIn, nonCompIn, size, offsets[batch], start, num, out[batch]);
+        break;
+      case FloatType::kFloat64:
+        joinFloatChunk<FloatType::kFloat64>(
+            compIn, nonCompIn, size, offsets[batch], start, num, out[batch]);
+        break;
+      case FloatType::kFloat8E4M3:
+        joinFloat8Chunk<FloatType::kFloat8E4M3>(
+            compIn, nonCompIn, size, offsets[batch], start, num, out[batch]);
+        break;
+      case FloatType::kFloat8E5M2:
+        joinFloat8Chunk<FloatType::kFloat8E5M2>(
+            compIn, nonCompIn, size, offsets[batch], start, num, out[batch]);
+        break;
+      default:
+        CHECK(false);
+        break;
+    }
+  });
+
+  // The checksum covers the first `size` bytes of the output, which may have
+  // been written by any chunk of the join, so this is a separate pass
+  if (config.useChecksum) {
+    pool.parallelFor(numChunks, [&](size_t chunk) {
+      uint32_t batch = chunks.getBatch(chunk);
+      uint32_t size = sizes[batch];
+
+      if (!success[batch]) {
+        return;
+      }
+
+      uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+      uint32_t num = std::min(size - start, kFloatChunkSize);
+
+      chunkChecksum[chunk] =
+          ansChecksumCpu((const uint8_t*)out[batch] + start, num);
+    });
+  }
+
+  FloatDecompressStatus status;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = sizes[i];
+    }
+
+    // Perform optional checksum, if desired
+    if (config.useChecksum && success[i]) {
+      auto header = (const GpuFloatHeader*)in[i];
+
+      uint32_t checksum = 0;
+      for (auto c = chunks.chunkStart[i]; c < chunks.chunkStart[i + 1]; ++c) {
+        checksum ^= chunkChecksum[c];
+      }
+
+      if (header->getChecksum() != checksum) {
+        status.error = FloatDecompressError::ChecksumMismatch;
+
+        std::stringstream errStr;
+        errStr << "Checksum mismatch in batch member " << i
+               << ": expected checksum " << std::hex << header->getChecksum()
+               << " got " << checksum << "\n";
+        status.errorInfo.push_back(std::make_pair(i, errStr.str()));
+      }
+    }
+  }
+
+  return status;
+}
+
+// Decodes as floatDecompressDenseCpu, for archives that may be sparse. A
+// sparse member is decoded by decoding the non-zero words of the range from
+// its dense archive into temporary space, then scattering them
+FloatDecompressStatus floatDecompressCpuImpl(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  bool anySparse = false;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+
+    CHECK(header->isValidMagicAndVersion())
+        << "batch member " << i << " has invalid float magic and version "
+        << std::hex << header->magicAndVersion;
+    anySparse = anySparse || header->getUseSparse();
+  }
+
+  if (!anySparse) {
+    return floatDecompressDenseCpu(
+        pool,
+        config,
+        numInBatch,
+        in,
+        rangeOffset,
+        rangeSize,
+        out,
+        outCapacity,
+        outSuccess,
+        outSize);
+  }
+
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+
+  // The words of each batch member that we decode
+  auto sizes = std::vector<uint32_t>(numInBatch);
+  auto offsets = std::vector<uint32_t>(numInBatch);
+  auto lengths = std::vector<uint32_t>(numInBatch);
+  auto sparse = std::vector<uint8_t>(numInBatch);
+  auto valid = std::vector<uint8_t>(numInBatch);
+
+  // The dense archives that we decode, and the words decoded from each
+  auto denseIn = std::vector<const void*>(numInBatch);
+  auto denseOffset = std::vector<uint32_t>(numInBatch);
+  auto denseLength = std::vector<uint32_t>(numInBatch);
+  auto denseOut = std::vector<void*>(numInBatch);
+  auto denseCapacity = std::vector<uint32_t>(numInBatch);
+  auto scatterStart = std::vector<size_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+
+    sizes[i] = header->size;
+    sparse[i] = header->getUseSparse();
+    offsets[i] = rangeOffset ? rangeOffset[i] : 0;
+    lengths[i] = rangeOffset ? rangeSize[i] : sizes[i];
+
+    if (!sparse[i]) {
+      denseIn[i] = in[i];
+      denseOffset[i] = offsets[i];
+      denseLength[i] = lengths[i];
+      denseOut[i] = out[i];
+      denseCapacity[i] = rangeOffset ? 0 : outCapacity[i];
+      scatterStart[i + 1] = scatterStart[i];
+      continue;
+    }
+
+    auto bitmap = (const uint32_t*)(header + 1);
+    denseIn[i] = (const uint8_t*)bitmap + getFloatSparseBitmapSize(sizes[i]);
+
+    // The range must lie within the data, and the output must hold all of it
+    valid[i] = rangeOffset ? (uint64_t)offsets[i] + lengths[i] <= sizes[i]
+                           : outCapacity[i] >= sizes[i];
+
+    if (valid[i]) {
+      denseOffset[i] = countBits(bitmap, 0, offsets[i]);
+      denseLength[i] = countBits(bitmap, offsets[i], offsets[i] + lengths[i]);
+    }
+
+    denseCapacity[i] = denseLength[i];
+    scatterStart[i + 1] = scatterStart[i] + (size_t)denseLength[i] * wordSize;
+  }
+
+  // (padded by a word for scatterNonZeroChunk)
+  auto nonZero = std::vector<uint8_t>(scatterStart[numInBatch] + wordSize);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (sparse[i]) {
+      denseOut[i] = nonZero.data() + scatterStart[i];
+    }
+  }
+
+  auto denseSuccess = std::vector<uint8_t>(numInBatch);
+  auto denseSize = std::vector<uint32_t>(numInBatch);
+
+  auto status = floatDecompressDenseCpu(
+      pool,
+      config,
+      numInBatch,
+      denseIn.data(),
+      rangeOffset ? denseOffset.data() : nullptr,
+      rangeOffset ? denseLength.data() : nullptr,
+      denseOut.data(),
+      rangeOffset ? nullptr : denseCapacity.data(),
+      denseSuccess.data(),
+      denseSize.data());
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    success[i] = denseSuccess[i] && (!sparse[i] || valid[i]);
+  }
+
+  // Scatter the non-zero words of the sparse members that we could decode. The
+  // non-zero words of each chunk (counted first) follow those of the preceding
+  // chunks
+  auto chunks = CpuFloatChunks(numInBatch, lengths.data());
+  auto numChunks = chunks.getNumChunks();
+  auto chunkNonZeroStart = std::vector<uint32_t>(numChunks);
+
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+
+    if (!sparse[batch] || !success[batch]) {
+      return;
+    }
+
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+    uint32_t num = std::min(lengths[batch] - start, kFloatChunkSize);
+    auto bitmap = (const uint32_t*)((const GpuFloatHeader*)in[batch] + 1);
+
+    chunkNonZeroStart[chunk] =
+        countBits(bitmap, offsets[batch] + start, offsets[batch] + start + num);
+  });
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    uint32_t n = 0;
+    for (auto c = chunks.chunkStart[i]; c < chunks.chunkStart[i + 1]; ++c) {
+      uint32_t count = chunkNonZeroStart[c];
+      chunkNonZeroStart[c] = n;
+      n += count;
+    }
+  }
+
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+
+    if (!sparse[batch] || !success[batch]) {
+      return;
+    }
+
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+    uint32_t num = std::min(lengths[batch] - start, kFloatChunkSize);
+    auto bitmap = (const uint32_t*)((const GpuFloatHeader*)in[batch] + 1);
+    auto scatterIn = nonZero.data() + scatterStart[batch] +
+        (size_t)chunkNonZeroStart[chunk] * wordSize;
+    auto scatterOut = (uint8_t*)out[batch] + (size_t)start * wordSize;
+
+    switch (wordSize) {
+      case sizeof(uint8_t):
+        scatterNonZeroChunk<uint8_t>(
+            scatterIn, bitmap, offsets[batch] + start, num, scatterOut);
+        break;
+      case sizeof(uint16_t):
+        scatterNonZeroChunk<uint16_t>(
+            scatterIn, bitmap, offsets[batch] + start, num, scatterOut);
+        break;
+      case sizeof(uint32_t):
+        scatterNonZeroChunk<uint32_t>(
+            scatterIn, bitmap, offsets[batch] + start, num, scatterOut);
+        break;
+      case sizeof(uint64_t):
+        scatterNonZeroChunk<uint64_t>(
+            scatterIn, bitmap, offsets[batch] + start, num, scatterOut);
+        break;
+      default:
+        CHECK(false);
+        break;
+    }
+  });
+
+  // The checksum of a sparse member covers its original data, as for a dense
+  // member (the checksum of the dense archive within it, covering the
+  // non-zero words, has been checked as well)
+  auto checksumMismatch = std::vector<uint8_t>(numInBatch);
+
+  if (config.useChecksum) {
+    pool.parallelFor(numInBatch, [&](size_t batch) {
+      if (!sparse[batch] || !success[batch]) {
+        return;
+      }
+
+      auto header = (const GpuFloatHeader*)in[batch];
+      checksumMismatch[batch] = header->getChecksum() !=
+          ansChecksumCpu((const uint8_t*)out[batch], sizes[batch]);
+    });
+  }
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = sparse[i] ? sizes[i] : denseSize[i];
+    }
+
+    if (checksumMismatch[i]) {
+      status.error = FloatDecompressError::ChecksumMismatch;
+
+      std::stringstream errStr;
+      errStr << "Checksum mismatch in batch member " << i
+             << " of sparse float data\n";
+      status.errorInfo.push_back(std::make_pair(i, errStr.str()));
+    }
+  }
+
+  return status;
+}
+
+// Decodes as floatDecompressCpuImpl, for archives that may be predicted. A
+// predicted member is decoded by decoding its residuals in full (into its
+// output, or temporary space when decoding a range) and reconstructing the
+// words from them
+FloatDecompressStatus floatDecompressPredictedCpu(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  auto predictor = std::vector<FloatPredictor>(numInBatch);
+  bool anyPredicted = false;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+
+    CHECK(header->isValidMagicAndVersion())
+        << "batch member " << i << " has invalid float magic and version "
+        << std::hex << header->magicAndVersion;
+    predictor[i] = header->getPredictor();
+    anyPredicted = anyPredicted || predictor[i] != FloatPredictor::kNone;
+  }
+
+  if (!anyPredicted) {
+    return floatDecompressCpuImpl(
+        pool,
+        config,
+        numInBatch,
+        in,
+        rangeOffset,
+        rangeSize,
+        out,
+        outCapacity,
+        outSuccess,
+        outSize);
+  }
+
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+
+  auto sizes = std::vector<uint32_t>(numInBatch);
+  auto gridDims = std::vector<uint32_t>(2 * numInBatch);
+  auto innerIn = std::vector<const void*>(in, in + numInBatch);
+  auto innerOut = std::vector<void*>(out, out + numInBatch);
+  auto innerOffset = std::vector<uint32_t>(numInBatch);
+  auto innerLength = std::vector<uint32_t>(numInBatch);
+  auto tempStart = std::vector<size_t>(numInBatch + 1);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+    sizes[i] = header->size;
+
+    if (rangeOffset) {
+      innerOffset[i] = rangeOffset[i];
+      innerLength[i] = rangeSize[i];
+    }
+
+    bool usesTemp = false;
+
+    if (predictor[i] != FloatPredictor::kNone) {
+      auto grid = (const FloatGridHeader*)(header + 1);
+      gridDims[2 * i] = grid->gridDims[0];
+      gridDims[2 * i + 1] = grid->gridDims[1];
+      innerIn[i] = grid + 1;
+
+      // A range needs the whole member
+      if (rangeOffset) {
+        innerOffset[i] = 0;
+        innerLength[i] = sizes[i];
+        usesTemp = true;
+      }
+    }
+
+    tempStart[i + 1] = tempStart[i] +
+        (usesTemp ? roundUp((size_t)sizes[i] * wordSize, 16) : 0);
+  }
+
+  auto temp = std::vector<uint8_t>(tempStart[numInBatch]);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (tempStart[i + 1] > tempStart[i]) {
+      innerOut[i] = temp.data() + tempStart[i];
+    }
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto size = std::vector<uint32_t>(numInBatch);
+
+  auto status = floatDecompressCpuImpl(
+      pool,
+      config,
+      numInBatch,
+      innerIn.data(),
+      rangeOffset ? innerOffset.data() : nullptr,
+      rangeOffset ? innerLength.data() : nullptr,
+      innerOut.data(),
+      outCapacity,
+      success.data(),
+      size.data());
+
+  // Reconstruct the words of the members whose residuals we decoded
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (!success[i]) {
+      predictor[i] = FloatPredictor::kNone;
+    }
+  }
+
+  floatUnpredictBatchCpu(
+      pool,
+      config.floatType,
+      predictor.data(),
+      gridDims.data(),
+      numInBatch,
+      (const void**)innerOut.data(),
+      sizes.data(),
+      innerOut.data());
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (rangeOffset && tempStart[i + 1] > tempStart[i]) {
+      // The range must lie within the data
+      success[i] = success[i] &&
+          (uint64_t)rangeOffset[i] + rangeSize[i] <= sizes[i];
+
+      if (success[i]) {
+        std::memcpy(
+            out[i],
+            (const uint8_t*)innerOut[i] + (size_t)rangeOffset[i] * wordSize,
+            (size_t)rangeSize[i] * wordSize);
+      }
+    }
+
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = size[i];
+    }
+  }
+
+  return status;
+}
+
+// Returns whether any member of the batch is coded in delta mode, checking
+// that those that are have a reference
+bool getBatchUseDelta(
+    uint32_t numInBatch,
+    const void** in,
+    const void** ref) {
+  bool anyDelta = false;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (((const GpuFloatHeader*)in[i])->getUseDelta()) {
+      CHECK(ref && ref[i]) << "batch member " << i
+                           << " is coded in delta mode and needs a reference "
+                           << "to decode";
+      anyDelta = true;
+    }
+  }
+
+  return anyDelta;
+}
+
+// The references at the decoded part of each successfully decoded delta
+// member, for XORing into the output
+std::vector<const void*> getDeltaRefs(
+    uint32_t numInBatch,
+    const void** in,
+    const void** ref,
+    const uint32_t* rangeOffset,
+    uint32_t wordSize,
+    const uint8_t* success) {
+  auto deltaRef = std::vector<const void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (success[i] && ((const GpuFloatHeader*)in[i])->getUseDelta()) {
+      deltaRef[i] = (const uint8_t*)ref[i] +
+          (rangeOffset ? (size_t)rangeOffset[i] * wordSize : 0);
+    }
+  }
+
+  return deltaRef;
+}
+
+// Returns whether any member of the batch has block checksums, writing the
+// archive following the checksums of each such member, and the archive of
+// each other member, to innerIn
+bool getBatchBlockChecksumInner(
+    uint32_t numInBatch,
+    const void** in,
+    std::vector<const void*>& innerIn) {
+  bool anyBlockChecksum = false;
+  innerIn.assign(in, in + numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+
+    CHECK(header->isValidMagicAndVersion())
+        << "batch member " << i << " has invalid float magic and version "
+        << std::hex << header->magicAndVersion;
+
+    if (header->getUseBlockChecksum()) {
+      auto wordSize = getWordSizeFromFloatType(header->getFloatType());
+
+      innerIn[i] = (const uint8_t*)(header + 1) +
+          getBlockChecksumSize((uint64_t)header->size * wordSize);
+      anyBlockChecksum = true;
+    }
+  }
+
+  return anyBlockChecksum;
+}
+
+} // namespace
+
+FloatDecompressStatus floatDecompressCpu(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize,
+    const void** ref) {
+  // The words of the members with block checksums are decoded from the inner
+  // archives, then verified
+  auto innerIn = std::vector<const void*>();
+
+  if (getBatchBlockChecksumInner(numInBatch, in, innerIn)) {
+    auto success = std::vector<uint8_t>(numInBatch);
+    auto size = std::vector<uint32_t>(numInBatch);
+
+    auto status = floatDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        innerIn.data(),
+        out,
+        outCapacity,
+        success.data(),
+        size.data(),
+        ref);
+
+    auto checksums = std::vector<const uint32_t*>(numInBatch);
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      if (innerIn[i] != in[i] && success[i]) {
+        checksums[i] = (const uint32_t*)((const GpuFloatHeader*)in[i] + 1);
+      }
+    }
+
+    if (!ansCheckBlockChecksumBatchCpu(
+            pool,
+            numInBatch,
+            (const void**)out,
+            size.data(),
+            getWordSizeFromFloatType(config.floatType),
+            checksums.data(),
+            status.failedBlocks,
+            status.errorInfo)) {
+      status.error = FloatDecompressError::ChecksumMismatch;
+    }
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      if (outSuccess) {
+        outSuccess[i] = success[i];
+      }
+
+      if (outSize) {
+        outSize[i] = size[i];
+      }
+    }
+
+    return status;
+  }
+
+  if (!getBatchUseDelta(numInBatch, in, ref)) {
+    return floatDecompressPredictedCpu(
+        pool,
+        config,
+        numInBatch,
+        in,
+        nullptr,
+        nullptr,
+        out,
+        outCapacity,
+        outSuccess,
+        outSize);
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto size = std::vector<uint32_t>(numInBatch);
+
+  auto status = floatDecompressPredictedCpu(
+      pool,
+      config,
+      numInBatch,
+      in,
+      nullptr,
+      nullptr,
+      out,
+      outCapacity,
+      success.data(),
+      size.data());
+
+  // The checksum is that of the XOR, so it has already been verified
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+  auto deltaRef =
+      getDeltaRefs(numInBatch, in, ref, nullptr, wordSize, success.data());
+
+  ansXorBatchCpu(
+      pool,
+      numInBatch,
+      (const void**)out,
+      deltaRef.data(),
+      size.data(),
+      wordSize,
+      out);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = size[i];
+    }
+  }
+
+  return status;
+}
+
+void floatDecompressRangeCpu(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    uint8_t* outSuccess,
+    const void** ref) {
+  CHECK(!config.useChecksum)
+      << "the checksum cannot be verified when decoding a range";
+
+  // Nor can the block checksums, so the archives following them are decoded
+  auto innerIn = std::vector<const void*>();
+
+  if (getBatchBlockChecksumInner(numInBatch, in, innerIn)) {
+    floatDecompressRangeCpu(
+        pool,
+        config,
+        numInBatch,
+        innerIn.data(),
+        rangeOffset,
+        rangeSize,
+        out,
+        outSuccess,
+        ref);
+    return;
+  }
+
+  bool anyDelta = getBatchUseDelta(numInBatch, in, ref);
+  auto success = std::vector<uint8_t>(numInBatch);
+
+  floatDecompressPredictedCpu(
+      pool,
+      config,
+      numInBatch,
+      in,
+      rangeOffset,
+      rangeSize,
+      out,
+      nullptr,
+      success.data(),
+      nullptr);
+
+  if (anyDelta) {
+    auto wordSize = getWordSizeFromFloatType(config.floatType);
+    auto deltaRef = getDeltaRefs(
+        numInBatch, in, ref, rangeOffset, wordSize, success.data());
+
+    ansXorBatchCpu(
+        pool,
+        numInBatch,
+        (const void**)out,
+        deltaRef.data(),
+        rangeSize,
+        wordSize,
+        out);
+  }
+
+  if (outSuccess) {
+    std::copy(success.begin(), success.end(), outSuccess);
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+
+#include <glog/logging.h>
+#include <vector>
+
+namespace dietgpu {
+
+void floatCompressMixedCpu(
+    ThreadPool& pool,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    const FloatType* floatTypes,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize) {
+  for (auto& g : groupFloatBatchByType(numInBatch, floatTypes)) {
+    uint32_t num = g.members.size();
+    auto groupIn = std::vector<const void*>(num);
+    auto groupInSize = std::vector<uint32_t>(num);
+    auto groupOut = std::vector<void*>(num);
+    auto groupOutSize = std::vector<uint32_t>(num);
+
+    for (uint32_t i = 0; i < num; ++i) {
+      groupIn[i] = in[g.members[i]];
+      groupInSize[i] = inSize[g.members[i]];
+      groupOut[i] = out[g.members[i]];
+    }
+
+    auto groupConfig = config;
+    groupConfig.floatType = g.floatType;
+
+    floatCompressCpu(
+        pool,
+        groupConfig,
+        num,
+        groupIn.data(),
+        groupInSize.data(),
+        groupOut.data(),
+        groupOutSize.data());
+
+    if (outSize) {
+      for (uint32_t i = 0; i < num; ++i) {
+        outSize[g.members[i]] = groupOutSize[i];
+      }
+    }
+  }
+}
+
+FloatDecompressStatus floatDecompressMixedCpu(
+    ThreadPool& pool,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  // Dispatch upon the types recorded in the archives
+  auto types = std::vector<FloatType>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const GpuFloatHeader*)in[i];
+
+    CHECK(header->isValidMagicAndVersion())
+        << "batch member " << i << " has invalid float magic and version "
+        << std::hex << header->magicAndVersion;
+
+    types[i] = header->getFloatType();
+  }
+
+  auto status = FloatDecompressStatus();
+
+  for (auto& g : groupFloatBatchByType(numInBatch, types.data())) {
+    uint32_t num = g.members.size();
+    auto groupIn = std::vector<const void*>(num);
+    auto groupOut = std::vector<void*>(num);
+    auto groupOutCapacity = std::vector<uint32_t>(num);
+    auto groupOutSuccess = std::vector<uint8_t>(num);
+    auto groupOutSize = std::vector<uint32_t>(num);
+
+    for (uint32_t i = 0; i < num; ++i) {
+      groupIn[i] = in[g.members[i]];
+      groupOut[i] = out[g.members[i]];
+      groupOutCapacity[i] = outCapacity[g.members[i]];
+    }
+
+    auto groupConfig = config;
+    groupConfig.floatType = g.floatType;
+
+    auto groupStatus = floatDecompressCpu(
+        pool,
+        groupConfig,
+        num,
+        groupIn.data(),
+        groupOut.data(),
+        groupOutCapacity.data(),
+        groupOutSuccess.data(),
+        groupOutSize.data());
+
+    if (groupStatus.error != FloatDecompressError::None) {
+      status.error = groupStatus.error;
+    }
+
+    for (auto& info : groupStatus.errorInfo) {
+      status.errorInfo.push_back(
+          std::make_pair(g.members[info.first], std::move(info.second)));
+    }
+
+    for (auto& failed : groupStatus.failedBlocks) {
+      status.failedBlocks.push_back(
+          std::make_pair(g.members[failed.first], std::move(failed.second)));
+    }
+
+    for (uint32_t i = 0; i < num; ++i) {
+      if (outSuccess) {
+        outSuccess[g.members[i]] = groupOutSuccess[i];
+      }
+      if (outSize) {
+        outSize[g.members[i]] = groupOutSize[i];
+      }
+    }
+  }
+
+  return status;
+}
+
+} // namespace dietgpu
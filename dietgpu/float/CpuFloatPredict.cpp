@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/float/CpuFloatUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+template <typename WordT>
+constexpr WordT kSignBit = WordT(WordT(1) << (sizeof(WordT) * 8 - 1));
+
+// Maps the bit pattern of a float to an integer with the same order as the
+// float's value (for non-NaN values), so that integer differences of nearby
+// values are small whatever their sign
+template <typename WordT>
+inline WordT toOrdered(WordT w) {
+  return (w & kSignBit<WordT>) ? WordT(~w) : WordT(w | kSignBit<WordT>);
+}
+
+template <typename WordT>
+inline WordT fromOrdered(WordT u) {
+  return (u & kSignBit<WordT>) ? WordT(u & ~kSignBit<WordT>) : WordT(~u);
+}
+
+// The strides and extents of a grid of `size` words (see
+// FloatCodecConfig::gridDims)
+struct FloatGrid {
+  FloatGrid(const uint32_t* gridDims, uint32_t size) {
+    CHECK(gridDims[0] > 0 || gridDims[1] == 0)
+        << "a grid with y extent " << gridDims[1] << " needs an x extent";
+
+    numDims = gridDims[0] == 0 ? 1 : (gridDims[1] == 0 ? 2 : 3);
+    nx = numDims > 1 ? gridDims[0] : std::max(size, 1U);
+    ny = numDims > 2 ? gridDims[1] : std::max(divUp(size, nx), 1U);
+    strideZ = (size_t)nx * ny;
+  }
+
+  uint32_t numDims;
+  uint32_t nx;
+  uint32_t ny;
+  size_t strideZ;
+};
+
+// Returns the Lorenzo prediction of word i at grid coordinates (x, y, z) in
+// the ordered integer domain, from the words of `data` preceding it. Terms
+// with a neighbor outside the grid are zero, which reduces the predictor on
+// the faces of the grid to that of the face's dimension
+template <typename WordT>
+inline WordT predictWord(
+    const WordT* data,
+    const FloatGrid& grid,
+    size_t i,
+    uint32_t x,
+    uint32_t y,
+    uint32_t z) {
+  auto u = [data](size_t j) { return toOrdered(data[j]); };
+
+  bool hasX = x > 0;
+  bool hasY = y > 0;
+  bool hasZ = z > 0;
+  size_t nx = grid.nx;
+  size_t nz = grid.strideZ;
+
+  // Accumulated with wraparound; only the low bits of WordT matter
+  WordT pred = 0;
+
+  if (hasX) {
+    pred += u(i - 1);
+  }
+
+  if (hasY) {
+    pred += u(i - nx);
+
+    if (hasX) {
+      pred -= u(i - nx - 1);
+    }
+  }
+
+  if (hasZ) {
+    pred += u(i - nz);
+
+    if (hasX) {
+      pred -= u(i - nz - 1);
+    }
+
+    if (hasY) {
+      pred -= u(i - nz - nx);
+
+      if (hasX) {
+        pred += u(i - nz - nx - 1);
+      }
+    }
+  }
+
+  return pred;
+}
+
+template <typename WordT>
+inline WordT getResidual(FloatPredictor predictor, WordT w, WordT pred) {
+  if (predictor == FloatPredictor::kXor) {
+    return w ^ fromOrdered(pred);
+  }
+
+  // zigzag encode the difference
+  WordT diff = toOrdered(w) - pred;
+  return WordT(diff << 1) ^ WordT(-WordT(diff >> (sizeof(WordT) * 8 - 1)));
+}
+
+template <typename WordT>
+inline WordT getWord(FloatPredictor predictor, WordT residual, WordT pred) {
+  if (predictor == FloatPredictor::kXor) {
+    return residual ^ fromOrdered(pred);
+  }
+
+  WordT diff = WordT(residual >> 1) ^ WordT(-WordT(residual & 1));
+  return fromOrdered(WordT(pred + diff));
+}
+
+// Calls fn(i, x, y, z) for words [begin, end) of the grid in order
+template <typename Fn>
+inline void
+forEachWord(const FloatGrid& grid, size_t begin, size_t end, Fn fn) {
+  uint32_t x = begin % grid.nx;
+  uint32_t y = (begin / grid.nx) % grid.ny;
+  uint32_t z = begin / grid.strideZ;
+
+  for (size_t i = begin; i < end; ++i) {
+    fn(i, x, y, z);
+
+    if (++x == grid.nx) {
+      x = 0;
+      if (++y == grid.ny) {
+        y = 0;
+        ++z;
+      }
+    }
+  }
+}
+
+template <typename WordT>
+void predictChunk(
+    FloatPredictor predictor,
+    const FloatGrid& grid,
+    const void* in,
+    size_t begin,
+    size_t end,
+    void* out) {
+  auto inWords = (const WordT*)in;
+  auto outWords = (WordT*)out;
+
+  forEachWord(
+      grid, begin, end, [&](size_t i, uint32_t x, uint32_t y, uint32_t z) {
+        outWords[i] = getResidual(
+            predictor, inWords[i], predictWord(inWords, grid, i, x, y, z));
+      });
+}
+
+template <typename WordT>
+void unpredictArray(
+    FloatPredictor predictor,
+    const FloatGrid& grid,
+    const void* in,
+    size_t size,
+    void* out) {
+  auto inWords = (const WordT*)in;
+  auto outWords = (WordT*)out;
+
+  forEachWord(grid, 0, size, [&](size_t i, uint32_t x, uint32_t y, uint32_t z) {
+    // The residual is read before the word is written, so `in` may be `out`
+    outWords[i] = getWord(
+        predictor, inWords[i], predictWord(outWords, grid, i, x, y, z));
+  });
+}
+
+} // namespace
+
+void floatPredictBatchCpu(
+    ThreadPool& pool,
+    FloatType ft,
+    FloatPredictor predictor,
+    const uint32_t* gridDims,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    void** out) {
+  CHECK(predictor != FloatPredictor::kNone);
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+  auto chunks = CpuFloatChunks(numInBatch, size);
+
+  auto grids = std::vector<FloatGrid>();
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    grids.emplace_back(gridDims, size[i]);
+  }
+
+  // Each residual depends only upon the input, so chunks are independent
+  pool.parallelFor(chunks.getNumChunks(), [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+    size_t begin = (size_t)(chunk - chunks.chunkStart[batch]) * kFloatChunkSize;
+    size_t end = std::min<size_t>(size[batch], begin + kFloatChunkSize);
+    auto& grid = grids[batch];
+
+    switch (wordSize) {
+      case sizeof(uint8_t):
+        predictChunk<uint8_t>(
+            predictor, grid, in[batch], begin, end, out[batch]);
+        break;
+      case sizeof(uint16_t):
+        predictChunk<uint16_t>(
+            predictor, grid, in[batch], begin, end, out[batch]);
+        break;
+      case sizeof(uint32_t):
+        predictChunk<uint32_t>(
+            predictor, grid, in[batch], begin, end, out[batch]);
+        break;
+      case sizeof(uint64_t):
+        predictChunk<uint64_t>(
+            predictor, grid, in[batch], begin, end, out[batch]);
+        break;
+      default:
+        CHECK(false);
+        break;
+    }
+  });
+}
+
+void floatUnpredictBatchCpu(
+    ThreadPool& pool,
+    FloatType ft,
+    const FloatPredictor* predictor,
+    const uint32_t* gridDims,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    void** out) {
+  auto wordSize = getWordSizeFromFloatType(ft);
+
+  // Each word depends upon those before it, so each member is reconstructed
+  // in order by a single thread
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    if (predictor[batch] == FloatPredictor::kNone) {
+      return;
+    }
+
+    auto grid = FloatGrid(gridDims + 2 * batch, size[batch]);
+    auto p = predictor[batch];
+
+    switch (wordSize) {
+      case sizeof(uint8_t):
+        unpredictArray<uint8_t>(p, grid, in[batch], size[batch], out[batch]);
+        break;
+      case sizeof(uint16_t):
+        unpredictArray<uint16_t>(p, grid, in[batch], size[batch], out[batch]);
+        break;
+      case sizeof(uint32_t):
+        unpredictArray<uint32_t>(p, grid, in[batch], size[batch], out[batch]);
+        break;
+      case sizeof(uint64_t):
+        unpredictArray<uint64_t>(p, grid, in[batch], size[batch], out[batch]);
+        break;
+      default:
+        CHECK(false);
+        break;
+    }
+  });
+}
+
+} // namespace dietgpu
@@ -0,0 +1,1584 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+#include "dietgpu/utils/Crc32c.h"
+
+using namespace dietgpu;
+
+// Returns the bit pattern of `f` in the given float type (rounding toward
+// zero, which is sufficient for generating test data)
+uint64_t toFloatWord(FloatType ft, float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, sizeof(float));
+
+  switch (ft) {
+    case FloatType::kFloat16: {
+      uint32_t sign = (x >> 16) & 0x8000;
+      int exp = int((x >> 23) & 0xff) - 127 + 15;
+      uint32_t mantissa = (x >> 13) & 0x3ff;
+
+      if (exp <= 0) {
+        return sign;
+      } else if (exp >= 31) {
+        return sign | 0x7c00;
+      }
+
+      return sign | (exp << 10) | mantissa;
+    }
+    case FloatType::kBFloat16:
+      return x >> 16;
+    case FloatType::kFloat64: {
+      double d = f;
+      uint64_t w;
+      std::memcpy(&w, &d, sizeof(double));
+      return w;
+    }
+    case FloatType::kFloat8E4M3:
+    case FloatType::kFloat8E5M2: {
+      // (saturating to the largest finite value)
+      int expBits = ft == FloatType::kFloat8E4M3 ? 4 : 5;
+      int mantBits = 7 - expBits;
+      int bias = (1 << (expBits - 1)) - 1;
+      uint32_t maxFinite = ft == FloatType::kFloat8E4M3 ? 0x7e : 0x7b;
+
+      uint32_t sign = (x >> 24) & 0x80;
+      int exp = int((x >> 23) & 0xff) - 127 + bias;
+      uint32_t mantissa = (x & 0x7fffff) >> (23 - mantBits);
+      uint32_t w = (uint32_t(exp) << mantBits) | mantissa;
+
+      if (exp <= 0) {
+        return sign;
+      } else if (exp >= (1 << expBits) || w > maxFinite) {
+        return sign | maxFinite;
+      }
+
+      return sign | w;
+    }
+    default:
+      return x;
+  }
+}
+
+// Generates normally distributed floats of type `ft` as bytes
+std::vector<uint8_t> generateFloats(FloatType ft, uint32_t num) {
+  std::mt19937 gen(10 + num);
+  std::normal_distribution<float> dist;
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+  auto out = std::vector<uint8_t>(num * wordSize);
+
+  for (uint32_t i = 0; i < num; ++i) {
+    auto w = toFloatWord(ft, dist(gen));
+    std::memcpy(out.data() + i * wordSize, &w, wordSize);
+  }
+
+  return out;
+}
+
+std::vector<std::vector<uint8_t>> compressBatch(
+    ThreadPool& pool,
+    const FloatCompressConfig& config,
+    const std::vector<std::vector<uint8_t>>& batch,
+    const std::vector<uint32_t>& batchSizes) {
+  int numInBatch = batch.size();
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto encPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    inPtrs[i] = batch[i].data();
+    enc[i].resize(getMaxFloatCompressedSize(
+        config.floatType,
+        batchSizes[i],
+        config.ansConfig.blockSize,
+        config.ansConfig.useWideState,
+        config.ansConfig.getMaxTables(),
+        config.predictor,
+        config.useBlockChecksum));
+    encPtrs[i] = enc[i].data();
+  }
+
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  floatCompressCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      batchSizes.data(),
+      encPtrs.data(),
+      encSize.data());
+
+  for (int i = 0; i < numInBatch; ++i) {
+    EXPECT_LE(encSize[i], enc[i].size());
+    enc[i].resize(encSize[i]);
+  }
+
+  return enc;
+}
+
+void runBatchPointer(
+    ThreadPool& pool,
+    FloatType ft,
+    int probBits,
+    const std::vector<uint32_t>& batchSizes,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false) {
+  int numInBatch = batchSizes.size();
+  auto config = FloatCodecConfig(
+      ft,
+      ANSCodecConfig(probBits, false, blockSize, useWideState),
+      false,
+      true);
+
+  auto batch = std::vector<std::vector<uint8_t>>();
+  for (auto s : batchSizes) {
+    batch.push_back(generateFloats(ft, s));
+  }
+
+  auto enc = compressBatch(pool, config, batch, batchSizes);
+
+  auto encPtrs = std::vector<const void*>(numInBatch);
+  auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs[i] = enc[i].data();
+    dec[i].resize(batch[i].size());
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto outSuccess = std::vector<uint8_t>(numInBatch);
+  auto outSize = std::vector<uint32_t>(numInBatch);
+
+  auto status = floatDecompressCpu(
+      pool,
+      config,
+      numInBatch,
+      encPtrs.data(),
+      decPtrs.data(),
+      batchSizes.data(),
+      outSuccess.data(),
+      outSize.data());
+
+  EXPECT_EQ(status.error, FloatDecompressError::None);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    EXPECT_TRUE(outSuccess[i]);
+    EXPECT_EQ(outSize[i], batchSizes[i]);
+  }
+
+  EXPECT_EQ(batch, dec);
+}
+
+TEST(CpuFloatTest, BatchPointer) {
+  ThreadPool pool(4);
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64,
+        FloatType::kFloat8E4M3,
+        FloatType::kFloat8E5M2}) {
+    for (auto probBits : {9, 10, 11}) {
+      runBatchPointer(pool, ft, probBits, {0});
+      runBatchPointer(pool, ft, probBits, {1});
+      runBatchPointer(pool, ft, probBits, {1, 1});
+      runBatchPointer(pool, ft, probBits, {4096, 4095, 4096});
+      runBatchPointer(pool, ft, probBits, {1234, 2345, 3456});
+      runBatchPointer(pool, ft, probBits, {10000, 10013, 10000});
+      runBatchPointer(pool, ft, probBits, {200000, 3, 100001});
+    }
+  }
+}
+
+TEST(CpuFloatTest, BlockSize) {
+  ThreadPool pool(4);
+
+  for (uint32_t blockSize = kANSMinBlockSize; blockSize <= kANSMaxBlockSize;
+       blockSize *= 2) {
+    for (auto ft :
+         {FloatType::kFloat16,
+          FloatType::kBFloat16,
+          FloatType::kFloat32,
+          FloatType::kFloat64}) {
+      runBatchPointer(
+          pool, ft, 10, {1, blockSize, blockSize + 1, 200000}, blockSize);
+    }
+  }
+}
+
+TEST(CpuFloatTest, WideState) {
+  ThreadPool pool(4);
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64}) {
+    for (auto probBits : {9, 10, 11}) {
+      runBatchPointer(
+          pool,
+          ft,
+          probBits,
+          {0, 1, 4095, 10013, 200000},
+          kANSDefaultBlockSize,
+          true);
+    }
+  }
+}
+
+// The archive layout must be exactly what the GPU decoder expects
+TEST(CpuFloatTest, ArchiveLayout) {
+  ThreadPool pool(4);
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64}) {
+    auto sizes = std::vector<uint32_t>{1, 17, 100000};
+    auto batch = std::vector<std::vector<uint8_t>>();
+    for (auto s : sizes) {
+      batch.push_back(generateFloats(ft, s));
+    }
+
+    auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, true);
+    auto enc = compressBatch(pool, config, batch, sizes);
+
+    for (int i = 0; i < sizes.size(); ++i) {
+      auto header = (const GpuFloatHeader*)enc[i].data();
+      EXPECT_EQ(
+          header->magicAndVersion, (kFloatMagic << 16) | kFloatMinVersion);
+      EXPECT_EQ(header->size, sizes[i]);
+      EXPECT_EQ(header->getFloatType(), ft);
+      EXPECT_TRUE(header->getUseChecksum());
+
+      // The checksum covers the first `size` bytes of the input, as on the GPU
+      uint32_t checksum = 0;
+      for (uint32_t j = 0; j < sizes[i]; ++j) {
+        checksum ^= batch[i][j];
+      }
+
+      EXPECT_EQ(header->getChecksum(), checksum);
+
+      // The ANS archive follows the non-compressed data, and holds one
+      // symbol per float
+      auto ansHeader = (const ANSCoalescedHeader*)(enc[i].data() +
+                                                   sizeof(GpuFloatHeader) +
+                                                   getFloatUncompDataSize(
+                                                       ft, sizes[i]));
+      // (single symbol blocks are constant blocks, which need version 5)
+      EXPECT_EQ(
+          ansHeader->magicAndVersion,
+          (kANSMagic << 16) | (ansHeader->getUseBlockModes() ? 5 : 4));
+      EXPECT_TRUE(ansHeader->getUseCompactProbs());
+      EXPECT_EQ(ansHeader->getTotalUncompressedWords(), sizes[i]);
+      EXPECT_EQ(
+          (const uint8_t*)ansHeader + ansHeader->getTotalCompressedSize(),
+          enc[i].data() + enc[i].size());
+    }
+  }
+}
+
+// The output must not depend upon how the work was split across threads
+TEST(CpuFloatTest, Deterministic) {
+  ThreadPool pool1(1);
+  ThreadPool pool4(4);
+
+  auto sizes = std::vector<uint32_t>{1, 300000, 4096, 0, 333};
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64,
+        FloatType::kFloat8E4M3,
+        FloatType::kFloat8E5M2}) {
+    auto batch = std::vector<std::vector<uint8_t>>();
+    for (auto s : sizes) {
+      batch.push_back(generateFloats(ft, s));
+    }
+
+    auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, true);
+    EXPECT_EQ(
+        compressBatch(pool1, config, batch, sizes),
+        compressBatch(pool4, config, batch, sizes));
+  }
+}
+
+TEST(CpuFloatTest, Checksum) {
+  ThreadPool pool(4);
+
+  auto ft = FloatType::kBFloat16;
+  auto sizes = std::vector<uint32_t>{100000, 5000};
+  auto batch = std::vector<std::vector<uint8_t>>{
+      generateFloats(ft, sizes[0]), generateFloats(ft, sizes[1])};
+
+  auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, true);
+  auto enc = compressBatch(pool, config, batch, sizes);
+
+  // Corrupt the stored checksum of the second member, which decompression
+  // should catch
+  auto header = (GpuFloatHeader*)enc[1].data();
+  header->setChecksum(header->getChecksum() ^ 0x1);
+
+  auto encPtrs = std::vector<const void*>{enc[0].data(), enc[1].data()};
+  auto dec = std::vector<std::vector<uint8_t>>{
+      std::vector<uint8_t>(batch[0].size()),
+      std::vector<uint8_t>(batch[1].size())};
+  auto decPtrs = std::vector<void*>{dec[0].data(), dec[1].data()};
+
+  auto status = floatDecompressCpu(
+      pool,
+      config,
+      2,
+      encPtrs.data(),
+      decPtrs.data(),
+      sizes.data(),
+      nullptr,
+      nullptr);
+
+  EXPECT_EQ(status.error, FloatDecompressError::ChecksumMismatch);
+  EXPECT_EQ(status.errorInfo.size(), 1);
+  EXPECT_EQ(status.errorInfo[0].first, 1);
+  EXPECT_EQ(dec, batch);
+}
+
+TEST(CpuFloatTest, InsufficientCapacity) {
+  ThreadPool pool(4);
+
+  auto ft = FloatType::kFloat32;
+  auto sizes = std::vector<uint32_t>{10000};
+  auto batch = std::vector<std::vector<uint8_t>>{generateFloats(ft, 10000)};
+
+  auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false);
+  auto enc = compressBatch(pool, config, batch, sizes);
+
+  auto encPtrs = std::vector<const void*>{enc[0].data()};
+  auto dec = std::vector<uint8_t>(9999 * sizeof(float));
+  auto decPtrs = std::vector<void*>{dec.data()};
+  uint32_t capacity = 9999;
+
+  uint8_t outSuccess = true;
+  uint32_t outSize = 0;
+
+  floatDecompressCpu(
+      pool,
+      config,
+      1,
+      encPtrs.data(),
+      decPtrs.data(),
+      &capacity,
+      &outSuccess,
+      &outSize);
+
+  EXPECT_FALSE(outSuccess);
+  EXPECT_EQ(outSize, 10000);
+}
+
+TEST(CpuFloatTest, RangeDecode) {
+  ThreadPool pool(4);
+  std::mt19937 gen(7);
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64,
+        FloatType::kFloat8E4M3,
+        FloatType::kFloat8E5M2}) {
+    auto config = FloatCodecConfig(
+        ft, ANSCodecConfig(10, false, kANSMinBlockSize), false);
+    auto wordSize = getWordSizeFromFloatType(ft);
+
+    auto batchSizes = std::vector<uint32_t>{1, 4097, 33333};
+    int numInBatch = batchSizes.size();
+
+    auto batch = std::vector<std::vector<uint8_t>>();
+    for (auto s : batchSizes) {
+      batch.push_back(generateFloats(ft, s));
+    }
+
+    auto enc = compressBatch(pool, config, batch, batchSizes);
+
+    auto encPtrs = std::vector<const void*>(numInBatch);
+    for (int i = 0; i < numInBatch; ++i) {
+      encPtrs[i] = enc[i].data();
+    }
+
+    for (int iter = 0; iter < 10; ++iter) {
+      auto offsets = std::vector<uint32_t>(numInBatch);
+      auto sizes = std::vector<uint32_t>(numInBatch);
+      auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+      auto decPtrs = std::vector<void*>(numInBatch);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        offsets[i] = gen() % batchSizes[i];
+        sizes[i] = gen() % (batchSizes[i] - offsets[i] + 1);
+
+        dec[i].resize(sizes[i] * wordSize);
+        decPtrs[i] = dec[i].data();
+      }
+
+      auto outSuccess = std::vector<uint8_t>(numInBatch);
+
+      floatDecompressRangeCpu(
+          pool,
+          config,
+          numInBatch,
+          encPtrs.data(),
+          offsets.data(),
+          sizes.data(),
+          decPtrs.data(),
+          outSuccess.data());
+
+      for (int i = 0; i < numInBatch; ++i) {
+        EXPECT_TRUE(outSuccess[i]);
+        EXPECT_TRUE(std::equal(
+            dec[i].begin(),
+            dec[i].end(),
+            batch[i].begin() + offsets[i] * wordSize));
+      }
+    }
+
+    // A range past the end of the data fails
+    uint32_t offset = batchSizes[1] - 1;
+    uint32_t size = 2;
+    auto dec = std::vector<uint8_t>(size * wordSize);
+    auto decPtr = (void*)dec.data();
+    uint8_t success = true;
+
+    floatDecompressRangeCpu(
+        pool, config, 1, &encPtrs[1], &offset, &size, &decPtr, &success);
+    EXPECT_FALSE(success);
+  }
+}
+
+TEST(CpuFloatTest, Float64) {
+  using FTI = FloatTypeInfo<FloatType::kFloat64>;
+
+  // Every bit pattern survives the split and join, and the compressed symbol
+  // is the high 8 bits of the exponent
+  std::mt19937_64 gen64(3);
+  auto words = std::vector<double>{
+      0.0,
+      -0.0,
+      1.0,
+      -2.5,
+      std::numeric_limits<double>::denorm_min(),
+      std::numeric_limits<double>::max(),
+      std::numeric_limits<double>::infinity(),
+      -std::numeric_limits<double>::infinity(),
+      std::numeric_limits<double>::quiet_NaN()};
+
+  for (auto d : words) {
+    uint64_t w;
+    std::memcpy(&w, &d, sizeof(double));
+
+    uint8_t comp;
+    uint64_t nonComp;
+    FTI::split(w, comp, nonComp);
+
+    EXPECT_EQ(comp, ((w >> 52) & 0x7ff) >> 3);
+    EXPECT_LT(nonComp, uint64_t(1) << 56);
+    EXPECT_EQ(FTI::join(comp, nonComp), w);
+  }
+
+  for (int i = 0; i < 10000; ++i) {
+    uint64_t w = gen64();
+
+    uint8_t comp;
+    uint64_t nonComp;
+    FTI::split(w, comp, nonComp);
+    EXPECT_EQ(FTI::join(comp, nonComp), w);
+  }
+
+  // Normally distributed doubles with full precision significands compress
+  // to about (56 + the exponent entropy) / 64 of their size
+  ThreadPool pool(4);
+  std::mt19937 gen(5);
+  std::normal_distribution<double> dist;
+
+  uint32_t size = 100000;
+  auto batch = std::vector<std::vector<uint8_t>>{
+      std::vector<uint8_t>(size * sizeof(double))};
+  for (uint32_t i = 0; i < size; ++i) {
+    double d = dist(gen);
+    std::memcpy(batch[0].data() + i * sizeof(double), &d, sizeof(double));
+  }
+
+  auto config =
+      FloatCodecConfig(FloatType::kFloat64, ANSCodecConfig(10), false, true);
+  auto enc = compressBatch(pool, config, batch, {size});
+
+  double ratio = double(enc[0].size()) / double(batch[0].size());
+  EXPECT_GT(ratio, 56.0 / 64.0);
+  EXPECT_LT(ratio, 0.9);
+
+  auto encPtr = (const void*)enc[0].data();
+  auto dec = std::vector<uint8_t>(batch[0].size());
+  auto decPtr = (void*)dec.data();
+  uint8_t success = false;
+  uint32_t decSize = 0;
+
+  auto status = floatDecompressCpu(
+      pool, config, 1, &encPtr, &decPtr, &size, &success, &decSize);
+
+  EXPECT_EQ(status.error, FloatDecompressError::None);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(decSize, size);
+  EXPECT_EQ(dec, batch[0]);
+}
+
+// Generates floats as for generateFloats, with about the given fraction of the
+// words zero
+std::vector<uint8_t>
+generateSparseFloats(FloatType ft, uint32_t num, float zeroFraction) {
+  std::mt19937 gen(20 + num);
+  std::bernoulli_distribution isZero(zeroFraction);
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+  auto out = generateFloats(ft, num);
+
+  for (uint32_t i = 0; i < num; ++i) {
+    if (isZero(gen)) {
+      std::memset(out.data() + i * wordSize, 0, wordSize);
+    }
+  }
+
+  return out;
+}
+
+TEST(CpuFloatTest, Sparse) {
+  ThreadPool pool(4);
+  std::mt19937 gen(9);
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64}) {
+    for (float zeroFraction : {0.0f, 0.05f, 0.5f, 0.9f, 1.0f}) {
+      auto wordSize = getWordSizeFromFloatType(ft);
+      auto sizes = std::vector<uint32_t>{1, 33, 4097, 100000, 200001};
+      int numInBatch = sizes.size();
+
+      auto batch = std::vector<std::vector<uint8_t>>();
+      for (auto s : sizes) {
+        batch.push_back(generateSparseFloats(ft, s, zeroFraction));
+      }
+
+      auto config = FloatCodecConfig(
+          ft, ANSCodecConfig(10, false, kANSMinBlockSize), false, true);
+      auto enc = compressBatch(pool, config, batch, sizes);
+
+      auto denseConfig = config;
+      denseConfig.sparseThreshold = 2.0f;
+      auto denseEnc = compressBatch(pool, denseConfig, batch, sizes);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        auto header = (const GpuFloatHeader*)enc[i].data();
+        auto denseHeader = (const GpuFloatHeader*)denseEnc[i].data();
+        EXPECT_FALSE(denseHeader->getUseSparse());
+
+        // Sparse mode is chosen for members with enough zeros, and (but for
+        // the fixed overhead on tiny members) then compresses better
+        if (sizes[i] >= 4097) {
+          EXPECT_EQ(header->getUseSparse(), zeroFraction >= 0.5f);
+          if (header->getUseSparse()) {
+            EXPECT_LT(enc[i].size(), denseEnc[i].size());
+          }
+        }
+
+        if (header->getUseSparse()) {
+          EXPECT_EQ(header->magicAndVersion, (kFloatMagic << 16) | 2);
+        } else {
+          EXPECT_EQ(enc[i], denseEnc[i]);
+        }
+      }
+
+      // Sparse and dense members decompress together
+      auto encPtrs = std::vector<const void*>(numInBatch);
+      auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+      auto decPtrs = std::vector<void*>(numInBatch);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        encPtrs[i] = enc[i].data();
+        dec[i].resize(batch[i].size());
+        decPtrs[i] = dec[i].data();
+      }
+
+      auto outSuccess = std::vector<uint8_t>(numInBatch);
+      auto outSize = std::vector<uint32_t>(numInBatch);
+
+      auto status = floatDecompressCpu(
+          pool,
+          config,
+          numInBatch,
+          encPtrs.data(),
+          decPtrs.data(),
+          sizes.data(),
+          outSuccess.data(),
+          outSize.data());
+
+      EXPECT_EQ(status.error, FloatDecompressError::None);
+      for (int i = 0; i < numInBatch; ++i) {
+        EXPECT_TRUE(outSuccess[i]);
+        EXPECT_EQ(outSize[i], sizes[i]);
+      }
+
+      EXPECT_EQ(dec, batch);
+
+      // As does any range of them
+      auto rangeConfig = config;
+      rangeConfig.useChecksum = false;
+
+      for (int iter = 0; iter < 5; ++iter) {
+        auto offsets = std::vector<uint32_t>(numInBatch);
+        auto lengths = std::vector<uint32_t>(numInBatch);
+
+        for (int i = 0; i < numInBatch; ++i) {
+          offsets[i] = gen() % sizes[i];
+          lengths[i] = gen() % (sizes[i] - offsets[i] + 1);
+
+          dec[i].assign(lengths[i] * wordSize, 0xff);
+          decPtrs[i] = dec[i].data();
+        }
+
+        floatDecompressRangeCpu(
+            pool,
+            rangeConfig,
+            numInBatch,
+            encPtrs.data(),
+            offsets.data(),
+            lengths.data(),
+            decPtrs.data(),
+            outSuccess.data());
+
+        for (int i = 0; i < numInBatch; ++i) {
+          EXPECT_TRUE(outSuccess[i]);
+          EXPECT_TRUE(std::equal(
+              dec[i].begin(),
+              dec[i].end(),
+              batch[i].begin() + offsets[i] * wordSize));
+        }
+      }
+
+      // A range past the end of the data fails
+      uint32_t offset = sizes[3] - 1;
+      uint32_t length = 2;
+      auto rangeDec = std::vector<uint8_t>(length * wordSize);
+      auto rangeDecPtr = (void*)rangeDec.data();
+      uint8_t success = true;
+
+      floatDecompressRangeCpu(
+          pool,
+          rangeConfig,
+          1,
+          &encPtrs[3],
+          &offset,
+          &length,
+          &rangeDecPtr,
+          &success);
+      EXPECT_FALSE(success);
+    }
+  }
+}
+
+TEST(CpuFloatTest, Float8) {
+  ThreadPool pool(4);
+
+  for (auto ft : {FloatType::kFloat8E4M3, FloatType::kFloat8E5M2}) {
+    uint32_t mantBits = ft == FloatType::kFloat8E4M3 ? 3 : 2;
+
+    // Every bit pattern survives the split and join, and the compressed symbol
+    // is the sign and exponent
+    for (uint32_t w = 0; w < 256; ++w) {
+      uint8_t comp;
+      uint8_t nonComp;
+
+      if (ft == FloatType::kFloat8E4M3) {
+        using FTI = FloatTypeInfo<FloatType::kFloat8E4M3>;
+        FTI::split(w, comp, nonComp);
+        EXPECT_EQ(FTI::join(comp, nonComp), w);
+      } else {
+        using FTI = FloatTypeInfo<FloatType::kFloat8E5M2>;
+        FTI::split(w, comp, nonComp);
+        EXPECT_EQ(FTI::join(comp, nonComp), w);
+      }
+
+      EXPECT_EQ(comp, w >> mantBits);
+    }
+
+    // Sizes that end part way through a group of packed significands, and in
+    // which the sparse mode is and is not chosen
+    auto sizes = std::vector<uint32_t>{1, 7, 9, 4097, 100003, 300000};
+    int numInBatch = sizes.size();
+
+    for (float zeroFraction : {0.0f, 0.5f}) {
+      auto batch = std::vector<std::vector<uint8_t>>();
+      for (auto s : sizes) {
+        batch.push_back(generateSparseFloats(ft, s, zeroFraction));
+      }
+
+      auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, true);
+      auto enc = compressBatch(pool, config, batch, sizes);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        auto header = (const GpuFloatHeader*)enc[i].data();
+        EXPECT_EQ(header->magicAndVersion, (kFloatMagic << 16) | 3);
+        EXPECT_EQ(header->getFloatType(), ft);
+        EXPECT_EQ(header->getUseSparse(), sizes[i] > 9 && zeroFraction > 0);
+      }
+
+      // For normally distributed data the sign and exponent take about 3
+      // bits, and the significand costs its width
+      if (zeroFraction == 0) {
+        double ratio = double(enc.back().size()) / double(sizes.back());
+        EXPECT_LT(ratio, ft == FloatType::kFloat8E4M3 ? 0.85 : 0.74);
+      }
+
+      auto encPtrs = std::vector<const void*>(numInBatch);
+      auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+      auto decPtrs = std::vector<void*>(numInBatch);
+
+      for (int i = 0; i < numInBatch; ++i) {
+        encPtrs[i] = enc[i].data();
+        dec[i].resize(batch[i].size());
+        decPtrs[i] = dec[i].data();
+      }
+
+      auto outSuccess = std::vector<uint8_t>(numInBatch);
+      auto outSize = std::vector<uint32_t>(numInBatch);
+
+      auto status = floatDecompressCpu(
+          pool,
+          config,
+          numInBatch,
+          encPtrs.data(),
+          decPtrs.data(),
+          sizes.data(),
+          outSuccess.data(),
+          outSize.data());
+
+      EXPECT_EQ(status.error, FloatDecompressError::None);
+      for (int i = 0; i < numInBatch; ++i) {
+        EXPECT_TRUE(outSuccess[i]);
+        EXPECT_EQ(outSize[i], sizes[i]);
+      }
+
+      EXPECT_EQ(dec, batch);
+    }
+  }
+}
+
+TEST(CpuFloatTest, Delta) {
+  ThreadPool pool(4);
+  std::mt19937 gen(14);
+
+  for (auto ft : {FloatType::kBFloat16, FloatType::kFloat32}) {
+    auto wordSize = getWordSizeFromFloatType(ft);
+    auto sizes = std::vector<uint32_t>{1, 33, 4097, 100000, 300001};
+    int numInBatch = sizes.size();
+
+    // Successive checkpoints of a weight: 70% of the words are updated by a
+    // small step, which changes only their low order significand bits
+    uint64_t stepMask = ft == FloatType::kBFloat16 ? 0x7 : 0xfff;
+
+    auto batch = std::vector<std::vector<uint8_t>>();
+    auto refs = std::vector<std::vector<uint8_t>>();
+    auto refPtrs = std::vector<const void*>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      refs.push_back(generateFloats(ft, sizes[i]));
+      batch.push_back(refs[i]);
+
+      for (uint32_t j = 0; j < sizes[i]; ++j) {
+        if (gen() % 10 < 7) {
+          uint64_t w = 0;
+          std::memcpy(&w, batch[i].data() + j * wordSize, wordSize);
+          w ^= gen() & stepMask;
+          std::memcpy(batch[i].data() + j * wordSize, &w, wordSize);
+        }
+      }
+
+      // The first member is compressed without a reference
+      refPtrs[i] = i > 0 ? refs[i].data() : nullptr;
+    }
+
+    auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, true);
+    auto plain = compressBatch(pool, config, batch, sizes);
+
+    auto inPtrs = std::vector<const void*>(numInBatch);
+    auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto encPtrs = std::vector<void*>(numInBatch);
+    auto encSize = std::vector<uint32_t>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      inPtrs[i] = batch[i].data();
+      enc[i].resize(getMaxFloatCompressedSize(ft, sizes[i]));
+      encPtrs[i] = enc[i].data();
+    }
+
+    floatCompressCpu(
+        pool,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        sizes.data(),
+        encPtrs.data(),
+        encSize.data(),
+        refPtrs.data());
+
+    for (int i = 0; i < numInBatch; ++i) {
+      enc[i].resize(encSize[i]);
+      auto header = (const GpuFloatHeader*)enc[i].data();
+      EXPECT_EQ(header->getUseDelta(), refPtrs[i] != nullptr);
+
+      // The unchanged words become zero, and the sign and exponent of the
+      // changed ones zero symbols (the non-compressed significand bits of
+      // float32 are still stored as is, which limits its gain)
+      if (refPtrs[i]) {
+        EXPECT_EQ(header->magicAndVersion, (kFloatMagic << 16) | 4);
+        if (sizes[i] >= 100000) {
+          EXPECT_LT(enc[i].size() * 4, plain[i].size() * 3);
+        }
+      } else {
+        EXPECT_EQ(enc[i], plain[i]);
+      }
+    }
+
+    // Decompression XORs the references back in
+    auto decEncPtrs = std::vector<const void*>(numInBatch);
+    auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto decPtrs = std::vector<void*>(numInBatch);
+    auto success = std::vector<uint8_t>(numInBatch);
+    auto decSize = std::vector<uint32_t>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      decEncPtrs[i] = enc[i].data();
+      dec[i].resize(batch[i].size());
+      decPtrs[i] = dec[i].data();
+    }
+
+    auto status = floatDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        decEncPtrs.data(),
+        decPtrs.data(),
+        sizes.data(),
+        success.data(),
+        decSize.data(),
+        refPtrs.data());
+
+    EXPECT_EQ(status.error, FloatDecompressError::None);
+    for (int i = 0; i < numInBatch; ++i) {
+      EXPECT_TRUE(success[i]);
+      EXPECT_EQ(decSize[i], sizes[i]);
+    }
+
+    EXPECT_EQ(dec, batch);
+
+    // Ranges use the reference words at the range
+    auto rangeConfig = config;
+    rangeConfig.useChecksum = false;
+
+    auto offsets = std::vector<uint32_t>(numInBatch);
+    auto lengths = std::vector<uint32_t>(numInBatch);
+
+    for (int iter = 0; iter < 5; ++iter) {
+      for (int i = 0; i < numInBatch; ++i) {
+        offsets[i] = gen() % sizes[i];
+        lengths[i] = gen() % (sizes[i] - offsets[i] + 1);
+        dec[i].assign(lengths[i] * wordSize, 0xff);
+        decPtrs[i] = dec[i].data();
+      }
+
+      floatDecompressRangeCpu(
+          pool,
+          rangeConfig,
+          numInBatch,
+          decEncPtrs.data(),
+          offsets.data(),
+          lengths.data(),
+          decPtrs.data(),
+          success.data(),
+          refPtrs.data());
+
+      for (int i = 0; i < numInBatch; ++i) {
+        EXPECT_TRUE(success[i]);
+        EXPECT_TRUE(std::equal(
+            dec[i].begin(),
+            dec[i].end(),
+            batch[i].begin() + offsets[i] * wordSize));
+      }
+    }
+  }
+}
+
+// Generates a smooth field of type `ft` on an nx x ny x nz grid, as bytes
+std::vector<uint8_t>
+generateField(FloatType ft, uint32_t nx, uint32_t ny, uint32_t nz) {
+  auto wordSize = getWordSizeFromFloatType(ft);
+  auto out = std::vector<uint8_t>((size_t)nx * ny * nz * wordSize);
+
+  for (uint32_t z = 0; z < nz; ++z) {
+    for (uint32_t y = 0; y < ny; ++y) {
+      for (uint32_t x = 0; x < nx; ++x) {
+        float f = std::sin(0.05f * x) * std::cos(0.07f * y) +
+            0.5f * std::sin(0.03f * z + 0.02f * x) + 0.1f * y / ny;
+        auto w = toFloatWord(ft, f);
+        std::memcpy(
+            out.data() + (((size_t)z * ny + y) * nx + x) * wordSize,
+            &w,
+            wordSize);
+      }
+    }
+  }
+
+  return out;
+}
+
+TEST(CpuFloatTest, Predictor) {
+  ThreadPool pool(4);
+  std::mt19937 gen(15);
+
+  for (auto ft :
+       {FloatType::kFloat16,
+        FloatType::kFloat32,
+        FloatType::kFloat64,
+        FloatType::kFloat8E4M3}) {
+    auto wordSize = getWordSizeFromFloatType(ft);
+
+    for (auto predictor : {FloatPredictor::kXor, FloatPredictor::kSubtract}) {
+      for (auto dims : {std::vector<uint32_t>{0, 0},
+                        std::vector<uint32_t>{37, 0},
+                        std::vector<uint32_t>{37, 11}}) {
+        // Sizes that end within a row and within a plane of the grid
+        auto sizes = std::vector<uint32_t>{0, 1, 36, 37 * 11 + 5, 100000};
+        int numInBatch = sizes.size();
+
+        auto batch = std::vector<std::vector<uint8_t>>();
+        auto inPtrs = std::vector<const void*>(numInBatch);
+        auto residual = std::vector<std::vector<uint8_t>>(numInBatch);
+        auto residualPtrs = std::vector<void*>(numInBatch);
+
+        for (int i = 0; i < numInBatch; ++i) {
+          // Arbitrary bit patterns, including NaNs and infinities
+          batch.emplace_back(sizes[i] * wordSize);
+          for (auto& b : batch[i]) {
+            b = gen();
+          }
+
+          inPtrs[i] = batch[i].data();
+          residual[i].resize(batch[i].size());
+          residualPtrs[i] = residual[i].data();
+        }
+
+        floatPredictBatchCpu(
+            pool,
+            ft,
+            predictor,
+            dims.data(),
+            numInBatch,
+            inPtrs.data(),
+            sizes.data(),
+            residualPtrs.data());
+
+        // The inverse reconstructs the words exactly, in place
+        auto predictors = std::vector<FloatPredictor>(numInBatch, predictor);
+        auto gridDims = std::vector<uint32_t>();
+        for (int i = 0; i < numInBatch; ++i) {
+          gridDims.insert(gridDims.end(), dims.begin(), dims.end());
+        }
+
+        floatUnpredictBatchCpu(
+            pool,
+            ft,
+            predictors.data(),
+            gridDims.data(),
+            numInBatch,
+            (const void**)residualPtrs.data(),
+            sizes.data(),
+            residualPtrs.data());
+
+        EXPECT_EQ(residual, batch);
+      }
+    }
+  }
+
+  // Words whose order preserving integers are linear in the coordinates are
+  // predicted exactly but on the faces of the grid, where the prediction is
+  // that of the face's dimension
+  uint32_t nx = 20;
+  uint32_t ny = 10;
+  uint32_t nz = 5;
+  uint32_t size = nx * ny * nz;
+  uint32_t dims[2] = {nx, ny};
+
+  auto data = std::vector<uint32_t>(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t x = i % nx;
+    uint32_t y = (i / nx) % ny;
+    uint32_t z = i / (nx * ny);
+
+    // The order preserving integer of a positive float sets the sign bit
+    data[i] = (0x3f800000U + 3 * x + 50 * y + 1000 * z) & 0x7fffffffU;
+  }
+
+  auto residual = std::vector<uint32_t>(size);
+  auto inPtr = (const void*)data.data();
+  auto residualPtr = (void*)residual.data();
+
+  floatPredictBatchCpu(
+      pool,
+      FloatType::kFloat32,
+      FloatPredictor::kSubtract,
+      dims,
+      1,
+      &inPtr,
+      &size,
+      &residualPtr);
+
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t x = i % nx;
+    uint32_t y = (i / nx) % ny;
+    uint32_t z = i / (nx * ny);
+
+    if (x > 0 && y > 0 && z > 0) {
+      EXPECT_EQ(residual[i], 0);
+    } else if (i > 0 && ((x > 0) + (y > 0) + (z > 0)) == 1) {
+      // An edge is predicted by the previous word along it, so the residual
+      // is the zigzag encoded step
+      uint32_t step = x > 0 ? 3 : (y > 0 ? 50 : 1000);
+      EXPECT_EQ(residual[i], 2 * step);
+    }
+  }
+}
+
+TEST(CpuFloatTest, PredictorArchive) {
+  ThreadPool pool(4);
+  std::mt19937 gen(16);
+
+  uint32_t nx = 64;
+  uint32_t ny = 48;
+  uint32_t nz = 40;
+
+  for (auto ft :
+       {FloatType::kFloat16, FloatType::kBFloat16, FloatType::kFloat32}) {
+    auto wordSize = getWordSizeFromFloatType(ft);
+
+    // Fields of whole and partial grids
+    auto batch = std::vector<std::vector<uint8_t>>();
+    batch.push_back(generateField(ft, nx, ny, nz));
+    batch.push_back(generateField(ft, nx, ny, nz));
+    batch[1].resize(batch[1].size() - 1000 * wordSize);
+    batch.push_back(generateField(ft, nx, 1, 1));
+    batch[2].resize(wordSize);
+
+    auto sizes = std::vector<uint32_t>();
+    for (auto& b : batch) {
+      sizes.push_back(b.size() / wordSize);
+    }
+
+    int numInBatch = batch.size();
+
+    auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, true);
+    auto plain = compressBatch(pool, config, batch, sizes);
+
+    for (auto predictor : {FloatPredictor::kXor, FloatPredictor::kSubtract}) {
+      size_t predictedSize[3];
+
+      for (int numDims = 1; numDims <= 3; ++numDims) {
+        config.predictor = predictor;
+        config.gridDims[0] = numDims > 1 ? nx : 0;
+        config.gridDims[1] = numDims > 2 ? ny : 0;
+
+        auto enc = compressBatch(pool, config, batch, sizes);
+        predictedSize[numDims - 1] = enc[0].size();
+
+        for (int i = 0; i < numInBatch; ++i) {
+          auto header = (const GpuFloatHeader*)enc[i].data();
+          EXPECT_EQ(header->magicAndVersion, (kFloatMagic << 16) | 5);
+          EXPECT_TRUE(header->getPredictor() == predictor);
+          EXPECT_EQ(header->size, sizes[i]);
+        }
+
+        // Whole members, verifying the checksum
+        auto encPtrs = std::vector<const void*>(numInBatch);
+        auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+        auto decPtrs = std::vector<void*>(numInBatch);
+        auto success = std::vector<uint8_t>(numInBatch);
+        auto decSize = std::vector<uint32_t>(numInBatch);
+
+        for (int i = 0; i < numInBatch; ++i) {
+          encPtrs[i] = enc[i].data();
+          dec[i].resize(batch[i].size());
+          decPtrs[i] = dec[i].data();
+        }
+
+        auto status = floatDecompressCpu(
+            pool,
+            config,
+            numInBatch,
+            encPtrs.data(),
+            decPtrs.data(),
+            sizes.data(),
+            success.data(),
+            decSize.data());
+
+        EXPECT_EQ(status.error, FloatDecompressError::None);
+        for (int i = 0; i < numInBatch; ++i) {
+          EXPECT_TRUE(success[i]);
+          EXPECT_EQ(decSize[i], sizes[i]);
+        }
+
+        EXPECT_EQ(dec, batch);
+
+        // Ranges, alongside a member that is not predicted
+        auto rangeConfig = config;
+        rangeConfig.useChecksum = false;
+
+        encPtrs.push_back(plain[0].data());
+        dec.emplace_back();
+        decPtrs.push_back(nullptr);
+        success.push_back(false);
+
+        auto offsets = std::vector<uint32_t>(numInBatch + 1);
+        auto lengths = std::vector<uint32_t>(numInBatch + 1);
+
+        for (int i = 0; i <= numInBatch; ++i) {
+          uint32_t size = sizes[i % numInBatch];
+          offsets[i] = gen() % size;
+          lengths[i] = gen() % (size - offsets[i] + 1);
+          dec[i].assign(lengths[i] * wordSize, 0xff);
+          decPtrs[i] = dec[i].data();
+        }
+
+        floatDecompressRangeCpu(
+            pool,
+            rangeConfig,
+            numInBatch + 1,
+            encPtrs.data(),
+            offsets.data(),
+            lengths.data(),
+            decPtrs.data(),
+            success.data());
+
+        for (int i = 0; i <= numInBatch; ++i) {
+          EXPECT_TRUE(success[i]);
+          EXPECT_TRUE(std::equal(
+              dec[i].begin(),
+              dec[i].end(),
+              batch[i % numInBatch].begin() + offsets[i] * wordSize));
+        }
+
+        // A range past the end of a predicted member fails
+        offsets[0] = sizes[0] - 1;
+        lengths[0] = 2;
+        dec[0].resize(lengths[0] * wordSize);
+        decPtrs[0] = dec[0].data();
+
+        floatDecompressRangeCpu(
+            pool,
+            rangeConfig,
+            1,
+            encPtrs.data(),
+            offsets.data(),
+            lengths.data(),
+            decPtrs.data(),
+            success.data());
+        EXPECT_FALSE(success[0]);
+      }
+
+      // Each dimension of the grid that the predictor uses helps, and in 3-D
+      // the archive is at most 2/3 the size of the plain one
+      EXPECT_LT(predictedSize[0], plain[0].size());
+      EXPECT_LT(predictedSize[1], predictedSize[0]);
+      EXPECT_LT(predictedSize[2], predictedSize[1]);
+      EXPECT_LT(predictedSize[2] * 3, plain[0].size() * 2);
+    }
+  }
+}
+
+TEST(CpuFloatTest, GroupByType) {
+  auto types = std::vector<FloatType>{
+      FloatType::kFloat32,
+      FloatType::kBFloat16,
+      FloatType::kBFloat16,
+      FloatType::kFloat32,
+      FloatType::kFloat16};
+
+  auto groups = groupFloatBatchByType(types.size(), types.data());
+
+  // One group per type, in order of first appearance
+  ASSERT_EQ(groups.size(), 3);
+  EXPECT_EQ(groups[0].floatType, FloatType::kFloat32);
+  EXPECT_EQ(groups[0].members, (std::vector<uint32_t>{0, 3}));
+  EXPECT_EQ(groups[1].floatType, FloatType::kBFloat16);
+  EXPECT_EQ(groups[1].members, (std::vector<uint32_t>{1, 2}));
+  EXPECT_EQ(groups[2].floatType, FloatType::kFloat16);
+  EXPECT_EQ(groups[2].members, (std::vector<uint32_t>{4}));
+
+  EXPECT_TRUE(groupFloatBatchByType(0, nullptr).empty());
+}
+
+TEST(CpuFloatTest, MixedBatch) {
+  ThreadPool pool(4);
+
+  // A gradient bucket of float32 norms amongst bfloat16 weights
+  auto types = std::vector<FloatType>{
+      FloatType::kBFloat16,
+      FloatType::kFloat32,
+      FloatType::kBFloat16,
+      FloatType::kFloat16,
+      FloatType::kFloat32,
+      FloatType::kFloat64};
+  auto sizes = std::vector<uint32_t>{100000, 1000, 54321, 7, 0, 3000};
+  uint32_t numInBatch = types.size();
+
+  auto batch = std::vector<std::vector<uint8_t>>();
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto encPtrs = std::vector<void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    batch.push_back(generateFloats(types[i], sizes[i]));
+    inPtrs[i] = batch[i].data();
+    enc[i].resize(getMaxFloatCompressedSize(types[i], sizes[i]));
+    encPtrs[i] = enc[i].data();
+  }
+
+  // config.floatType is ignored
+  auto config =
+      FloatCodecConfig(FloatType::kUndefined, ANSCodecConfig(10), false, true);
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  floatCompressMixedCpu(
+      pool,
+      config,
+      numInBatch,
+      types.data(),
+      inPtrs.data(),
+      sizes.data(),
+      encPtrs.data(),
+      encSize.data());
+
+  // Each member is exactly the archive of a single-type batch of it
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    enc[i].resize(encSize[i]);
+
+    auto singleConfig = config;
+    singleConfig.floatType = types[i];
+    EXPECT_EQ(
+        compressBatch(pool, singleConfig, {batch[i]}, {sizes[i]})[0], enc[i]);
+  }
+
+  // The types are taken from the headers on decompression
+  auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+  auto encInPtrs = std::vector<const void*>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    dec[i].resize(batch[i].size());
+    decPtrs[i] = dec[i].data();
+    encInPtrs[i] = enc[i].data();
+  }
+
+  // Corrupt the checksum of the second float32 member
+  auto header = (GpuFloatHeader*)enc[4].data();
+  header->setChecksum(header->getChecksum() ^ 0x1);
+
+  auto decSize = std::vector<uint32_t>(numInBatch);
+
+  auto status = floatDecompressMixedCpu(
+      pool,
+      config,
+      numInBatch,
+      encInPtrs.data(),
+      decPtrs.data(),
+      sizes.data(),
+      nullptr,
+      decSize.data());
+
+  EXPECT_EQ(dec, batch);
+  EXPECT_EQ(decSize, sizes);
+
+  // Errors are reported by batch index
+  EXPECT_EQ(status.error, FloatDecompressError::ChecksumMismatch);
+  ASSERT_EQ(status.errorInfo.size(), 1);
+  EXPECT_EQ(status.errorInfo[0].first, 4);
+}
+
+TEST(CpuFloatTest, BlockChecksum) {
+  ThreadPool pool(4);
+
+  for (auto ft : {FloatType::kBFloat16, FloatType::kFloat32}) {
+    uint32_t wordSize = getWordSizeFromFloatType(ft);
+    auto sizes = std::vector<uint32_t>{0, 1, 2047, 100000};
+    int numInBatch = sizes.size();
+
+    auto batch = std::vector<std::vector<uint8_t>>();
+    for (auto s : sizes) {
+      batch.push_back(generateFloats(ft, s));
+    }
+
+    auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, false);
+    auto plainEnc = compressBatch(pool, config, batch, sizes);
+
+    config.useBlockChecksum = true;
+    auto enc = compressBatch(pool, config, batch, sizes);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      auto header = (const GpuFloatHeader*)enc[i].data();
+      EXPECT_EQ(header->magicAndVersion, (kFloatMagic << 16) | 6);
+      EXPECT_TRUE(header->getUseBlockChecksum());
+      EXPECT_EQ(header->size, sizes[i]);
+      EXPECT_EQ(header->getFloatType(), ft);
+
+      // The checksums of each block of the words and of all of them are
+      // followed by the archive that would otherwise have been produced
+      size_t bytes = (size_t)sizes[i] * wordSize;
+      size_t numBlocks = divUp(bytes, (size_t)kANSChecksumBlockSize);
+      auto checksums = (const uint32_t*)(header + 1);
+
+      for (size_t b = 0; b < numBlocks; ++b) {
+        size_t offset = b * kANSChecksumBlockSize;
+        EXPECT_EQ(
+            checksums[b],
+            crc32cCpu(
+                batch[i].data() + offset,
+                std::min(bytes - offset, (size_t)kANSChecksumBlockSize)));
+      }
+
+      EXPECT_EQ(checksums[numBlocks], crc32cCpu(batch[i].data(), bytes));
+
+      auto inner = enc[i].data() + sizeof(GpuFloatHeader) +
+          getBlockChecksumSize(bytes);
+      EXPECT_EQ(enc[i].size(), inner - enc[i].data() + plainEnc[i].size());
+      EXPECT_TRUE(std::equal(
+          plainEnc[i].begin(), plainEnc[i].end(), (const uint8_t*)inner));
+    }
+
+    // Corrupt the non-compressed data of two words of the last member, and
+    // the checksum of all blocks of the second
+    auto& last = enc[numInBatch - 1];
+    auto innerLast = last.data() + sizeof(GpuFloatHeader) +
+        getBlockChecksumSize((size_t)sizes[numInBatch - 1] * wordSize);
+    // (the non-compressed data starts with the low byte, or for float32 the
+    // low 2 bytes, of each word)
+    uint32_t lowBytes = ft == FloatType::kFloat32 ? 2 : 1;
+
+    for (uint32_t word : {10000, 50000}) {
+      innerLast[sizeof(GpuFloatHeader) + word * lowBytes] ^= 0x1;
+    }
+
+    auto& second = enc[1];
+    auto checksums = (uint32_t*)(second.data() + sizeof(GpuFloatHeader));
+    checksums[1] ^= 0x1;
+
+    auto encPtrs = std::vector<const void*>(numInBatch);
+    auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto decPtrs = std::vector<void*>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      encPtrs[i] = enc[i].data();
+      dec[i].resize(batch[i].size());
+      decPtrs[i] = dec[i].data();
+    }
+
+    auto outSuccess = std::vector<uint8_t>(numInBatch);
+
+    auto status = floatDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        encPtrs.data(),
+        decPtrs.data(),
+        sizes.data(),
+        outSuccess.data(),
+        nullptr);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      EXPECT_TRUE(outSuccess[i]);
+    }
+
+    EXPECT_EQ(status.error, FloatDecompressError::ChecksumMismatch);
+    ASSERT_EQ(status.failedBlocks.size(), 2);
+    ASSERT_EQ(status.errorInfo.size(), 2);
+
+    // The blocks holding the corrupted words are reported
+    EXPECT_EQ(status.failedBlocks[0].first, 1);
+    EXPECT_TRUE(status.failedBlocks[0].second.empty());
+    EXPECT_EQ(status.failedBlocks[1].first, numInBatch - 1);
+    EXPECT_EQ(
+        status.failedBlocks[1].second,
+        std::vector<uint32_t>(
+            {10000 * wordSize / kANSChecksumBlockSize,
+             50000 * wordSize / kANSChecksumBlockSize}));
+
+    EXPECT_EQ(dec[1], batch[1]);
+    EXPECT_NE(dec[numInBatch - 1], batch[numInBatch - 1]);
+
+    // Range decompression does not verify the block checksums
+    uint32_t offset = 5;
+    uint32_t size = 100;
+    auto rangeDec = std::vector<uint8_t>(size * wordSize);
+    auto rangeDecPtr = (void*)rangeDec.data();
+    uint8_t success = false;
+
+    floatDecompressRangeCpu(
+        pool, config, 1, &encPtrs[3], &offset, &size, &rangeDecPtr, &success);
+    EXPECT_TRUE(success);
+    EXPECT_TRUE(std::equal(
+        rangeDec.begin(),
+        rangeDec.end(),
+        batch[3].begin() + offset * wordSize));
+  }
+}
+
+// Block checksums cover the input as given when members are compressed in
+// sparse mode, as the residuals of a predictor or as deltas, as they are
+// computed from the input while the chunks of the words compressed are read
+TEST(CpuFloatTest, BlockChecksumModes) {
+  ThreadPool pool(4);
+  std::mt19937 gen(18);
+
+  auto ft = FloatType::kBFloat16;
+  uint32_t wordSize = getWordSizeFromFloatType(ft);
+  auto sizes = std::vector<uint32_t>{100000, 100000, 5000};
+  int numInBatch = sizes.size();
+
+  // The second member is mostly zeros, and so is compressed in sparse mode
+  auto batch = std::vector<std::vector<uint8_t>>();
+  auto refs = std::vector<std::vector<uint8_t>>();
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto refPtrs = std::vector<const void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    batch.push_back(generateFloats(ft, sizes[i]));
+
+    if (i == 1) {
+      for (uint32_t j = 0; j < sizes[i]; ++j) {
+        if (gen() % 10 != 0) {
+          std::memset(batch[i].data() + j * wordSize, 0, wordSize);
+        }
+      }
+    }
+
+    refs.push_back(batch[i]);
+    for (auto& b : refs[i]) {
+      if (gen() % 20 == 0) {
+        b = gen();
+      }
+    }
+
+    inPtrs[i] = batch[i].data();
+    refPtrs[i] = refs[i].data();
+  }
+
+  for (int mode = 0; mode < 3; ++mode) {
+    auto config = FloatCodecConfig(ft, ANSCodecConfig(10), false, false);
+    config.useBlockChecksum = true;
+    config.predictor = mode == 1 ? FloatPredictor::kXor : FloatPredictor::kNone;
+    auto ref = mode == 2 ? refPtrs.data() : nullptr;
+
+    auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto encPtrs = std::vector<void*>(numInBatch);
+    auto encSize = std::vector<uint32_t>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      enc[i].resize(getMaxFloatCompressedSize(
+          ft,
+          sizes[i],
+          kANSDefaultBlockSize,
+          false,
+          1,
+          config.predictor,
+          true));
+      encPtrs[i] = enc[i].data();
+    }
+
+    floatCompressCpu(
+        pool,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        sizes.data(),
+        encPtrs.data(),
+        encSize.data(),
+        ref);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      enc[i].resize(encSize[i]);
+
+      size_t bytes = (size_t)sizes[i] * wordSize;
+      size_t numBlocks = divUp(bytes, (size_t)kANSChecksumBlockSize);
+      auto header = (const GpuFloatHeader*)enc[i].data();
+      auto checksums = (const uint32_t*)(header + 1);
+
+      for (size_t b = 0; b < numBlocks; ++b) {
+        size_t offset = b * kANSChecksumBlockSize;
+        EXPECT_EQ(
+            checksums[b],
+            crc32cCpu(
+                batch[i].data() + offset,
+                std::min(bytes - offset, (size_t)kANSChecksumBlockSize)));
+      }
+
+      EXPECT_EQ(checksums[numBlocks], crc32cCpu(batch[i].data(), bytes));
+
+      auto inner = (const GpuFloatHeader*)(enc[i].data() +
+          sizeof(GpuFloatHeader) + getBlockChecksumSize(bytes));
+      EXPECT_EQ(inner->getUseDelta(), mode == 2);
+
+      // (deltas and residuals are mostly zero as well)
+      if (mode == 0) {
+        EXPECT_EQ(inner->getUseSparse(), i == 1);
+      }
+    }
+
+    auto decEncPtrs = std::vector<const void*>(numInBatch);
+    auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+    auto decPtrs = std::vector<void*>(numInBatch);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      decEncPtrs[i] = enc[i].data();
+      dec[i].resize(batch[i].size());
+      decPtrs[i] = dec[i].data();
+    }
+
+    auto status = floatDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        decEncPtrs.data(),
+        decPtrs.data(),
+        sizes.data(),
+        nullptr,
+        nullptr,
+        ref);
+
+    EXPECT_EQ(status.error, FloatDecompressError::None);
+    EXPECT_EQ(dec, batch);
+  }
+}
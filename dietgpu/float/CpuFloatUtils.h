@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <assert.h>
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+#include "dietgpu/utils/StaticUtils.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace dietgpu {
+
+// Size of the chunks of float words that the host split/join passes are
+// performed over in parallel
+constexpr uint32_t kFloatChunkSize = 64 * 1024;
+
+// Returns getUncompDataSize for a runtime float type
+inline uint32_t getFloatUncompDataSize(FloatType ft, uint32_t size) {
+  switch (ft) {
+    case FloatType::kFloat16:
+      return FloatTypeInfo<FloatType::kFloat16>::getUncompDataSize(size);
+    case FloatType::kBFloat16:
+      return FloatTypeInfo<FloatType::kBFloat16>::getUncompDataSize(size);
+    case FloatType::kFloat32:
+      return FloatTypeInfo<FloatType::kFloat32>::getUncompDataSize(size);
+    case FloatType::kFloat64:
+      return FloatTypeInfo<FloatType::kFloat64>::getUncompDataSize(size);
+    case FloatType::kFloat8E4M3:
+      return FloatTypeInfo<FloatType::kFloat8E4M3>::getUncompDataSize(size);
+    case FloatType::kFloat8E5M2:
+      return FloatTypeInfo<FloatType::kFloat8E5M2>::getUncompDataSize(size);
+    default:
+      CHECK(false) << "unknown float type " << uint32_t(ft);
+      return 0;
+  }
+}
+
+// Returns the size of the non-compressed portion of the archive with the given
+// header
+inline uint32_t getFloatUncompDataSize(const GpuFloatHeader& header) {
+  return getFloatUncompDataSize(header.getFloatType(), header.size);
+}
+
+// Layout of the non-compressed portion of the float archive, which follows the
+// GpuFloatHeader. For float32, the low 2 bytes of each word are stored first,
+// followed by the high byte in a separate 16 byte aligned section. For
+// float64, the low 4 bytes, middle 2 bytes and high byte are each stored in
+// their own 16 byte aligned section. The bit packed float8 types are written
+// and read by group instead (see kFloat8GroupSize)
+template <FloatType FT>
+struct CpuFloatNonComp {
+  using NonCompT = typename FloatTypeInfo<FT>::NonCompT;
+
+  static void
+  write(uint8_t* base, uint32_t size, uint32_t i, NonCompT nonComp) {
+    if (FT == FloatType::kFloat32) {
+      ((uint16_t*)base)[i] = nonComp & 0xffffU;
+      base[2 * roundUp(size, 8) + i] = nonComp >> 16;
+    } else if (FT == FloatType::kFloat64) {
+      auto mid = base + 4 * roundUp(size, 4);
+      auto high = mid + 2 * roundUp(size, 8);
+
+      ((uint32_t*)base)[i] = uint64_t(nonComp) & 0xffffffffU;
+      ((uint16_t*)mid)[i] = (uint64_t(nonComp) >> 32) & 0xffffU;
+      high[i] = uint64_t(nonComp) >> 48;
+    } else {
+      base[i] = nonComp;
+    }
+  }
+
+  static NonCompT read(const uint8_t* base, uint32_t size, uint32_t i) {
+    if (FT == FloatType::kFloat32) {
+      return NonCompT(((const uint16_t*)base)[i]) |
+          (NonCompT(base[2 * roundUp(size, 8) + i]) << 16);
+    } else if (FT == FloatType::kFloat64) {
+      auto mid = base + 4 * roundUp(size, 4);
+      auto high = mid + 2 * roundUp(size, 8);
+
+      return NonCompT(
+          uint64_t(((const uint32_t*)base)[i]) |
+          (uint64_t(((const uint16_t*)mid)[i]) << 32) |
+          (uint64_t(high[i]) << 48));
+    } else {
+      return base[i];
+    }
+  }
+};
+
+// Chunks of kFloatChunkSize words over all members of a batch
+struct CpuFloatChunks {
+  explicit CpuFloatChunks(uint32_t numInBatch, const uint32_t* sizes)
+      : chunkStart(numInBatch + 1) {
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      chunkStart[i + 1] = chunkStart[i] + divUp(sizes[i], kFloatChunkSize);
+    }
+  }
+
+  uint32_t getNumChunks() const {
+    return chunkStart.back();
+  }
+
+  // Returns the batch member containing the given chunk
+  uint32_t getBatch(uint32_t chunk) const {
+    return std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+        chunkStart.begin() - 1;
+  }
+
+  // The first chunk of each batch member
+  std::vector<uint32_t> chunkStart;
+};
+
+// Replaces each word of the batch members by its residual from its
+// prediction by `predictor` (see FloatPredictor) over the grid `gridDims` (see
+// FloatCodecConfig::gridDims). `in` and `out` must not overlap
+void floatPredictBatchCpu(
+    ThreadPool& pool,
+    FloatType ft,
+    FloatPredictor predictor,
+    const uint32_t* gridDims,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    void** out);
+
+// Inverse of floatPredictBatchCpu, for batch members with their own predictor
+// and grid (gridDims holds 2 entries per member); members with no predictor
+// are left untouched. `in` may be `out`
+void floatUnpredictBatchCpu(
+    ThreadPool& pool,
+    FloatType ft,
+    const FloatPredictor* predictor,
+    const uint32_t* gridDims,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* size,
+    void** out);
+
+} // namespace dietgpu
@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Host-only parts of the float codec API, shared by the GPU
+// (gpu_float_compress) and host (cpu_float_compress) implementations so that
+// the latter does not require the former
+
+#include "dietgpu/ans/GpuANSUtils.cuh"
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+
+#include <glog/logging.h>
+
+namespace dietgpu {
+
+uint32_t getMaxFloatCompressedSize(
+    FloatType floatType,
+    uint32_t size,
+    uint32_t blockSize,
+    bool useWideState,
+    uint32_t numTables,
+    FloatPredictor predictor,
+    bool useBlockChecksum) {
+  // kNotCompressed bytes per float are simply stored uncompressed
+  // rounded up to 16 bytes to ensure alignment of the following ANS data
+  // portion
+  uint32_t baseSize = sizeof(GpuFloatHeader) +
+      getMaxCompressedSize(size, blockSize, useWideState, numTables);
+
+  // A predicted archive wraps the archive of its residuals
+  if (predictor != FloatPredictor::kNone) {
+    baseSize += sizeof(GpuFloatHeader) + sizeof(FloatGridHeader);
+  }
+
+  // As does an archive with block checksums, which follow its header
+  if (useBlockChecksum) {
+    uint64_t bytes = (uint64_t)size * getWordSizeFromFloatType(floatType);
+    baseSize += sizeof(GpuFloatHeader) + getBlockChecksumSize(bytes);
+  }
+
+  switch (floatType) {
+    case FloatType::kFloat16:
+      baseSize += FloatTypeInfo<FloatType::kFloat16>::getUncompDataSize(size);
+      break;
+    case FloatType::kBFloat16:
+      baseSize += FloatTypeInfo<FloatType::kBFloat16>::getUncompDataSize(size);
+      break;
+    case FloatType::kFloat32:
+      baseSize += FloatTypeInfo<FloatType::kFloat32>::getUncompDataSize(size);
+      break;
+    case FloatType::kFloat64:
+      baseSize += FloatTypeInfo<FloatType::kFloat64>::getUncompDataSize(size);
+      break;
+    case FloatType::kFloat8E4M3:
+      baseSize +=
+          FloatTypeInfo<FloatType::kFloat8E4M3>::getUncompDataSize(size);
+      break;
+    case FloatType::kFloat8E5M2:
+      baseSize +=
+          FloatTypeInfo<FloatType::kFloat8E5M2>::getUncompDataSize(size);
+      break;
+    default:
+      CHECK(false);
+      break;
+  }
+
+  return baseSize;
+}
+
+} // namespace dietgpu
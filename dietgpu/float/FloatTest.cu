@@ -6,12 +6,15 @@
  */
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <iostream>
 #include <random>
 #include <vector>
 
+#include "dietgpu/ans/GpuANSUtils.cuh"
+#include "dietgpu/float/CpuFloatCodec.h"
 #include "dietgpu/float/GpuFloatCodec.h"
 #include "dietgpu/float/GpuFloatUtils.cuh"
 #include "dietgpu/utils/StackDeviceMemory.h"
@@ -309,3 +312,458 @@ TEST(FloatTest, BatchSize1) {
     }
   }
 }
+
+TEST(FloatTest, HostOnlyArchivesFail) {
+  using FTI = FloatTypeInfo<FloatType::kFloat32>;
+
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  auto& pool = getDefaultThreadPool();
+
+  auto batchSizes = std::vector<uint32_t>{100000, 4096, 1};
+  int numInBatch = batchSizes.size();
+
+  // Mostly zero words, so that sparse mode is used, with the original words
+  // as the reference for delta mode
+  auto batch_host = std::vector<std::vector<FTI::WordT>>();
+  auto ref_host = std::vector<std::vector<FTI::WordT>>();
+  for (auto size : batchSizes) {
+    ref_host.emplace_back(generateFloats<FloatType::kFloat32>(size));
+    batch_host.emplace_back(ref_host.back());
+    for (uint32_t i = 0; i < size; ++i) {
+      if (i % 8) {
+        batch_host.back()[i] = 0;
+      }
+    }
+  }
+
+  auto inPtrs = std::vector<const void*>();
+  auto refPtrs = std::vector<const void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    inPtrs.push_back(batch_host[i].data());
+    refPtrs.push_back(ref_host[i].data());
+  }
+
+  // Dense, sparse, deltas (decoded here without their reference), predictors,
+  // and block checksums, which the GPU decodes
+  for (int feature = 0; feature < 5; ++feature) {
+    for (auto align : {false, true}) {
+      auto config =
+          FloatCodecConfig(FloatType::kFloat32, ANSCodecConfig(10), align);
+      config.sparseThreshold = feature == 1 ? 0.5f : 2.0f;
+      config.predictor =
+          feature == 3 ? FloatPredictor::kXor : FloatPredictor::kNone;
+      config.useBlockChecksum = feature == 4;
+
+      auto enc = std::vector<std::vector<uint8_t>>();
+      auto encPtrs = std::vector<void*>();
+      for (int i = 0; i < numInBatch; ++i) {
+        enc.emplace_back(std::vector<uint8_t>(getMaxFloatCompressedSize(
+            config.floatType,
+            batchSizes[i],
+            config.ansConfig.blockSize,
+            config.ansConfig.useWideState,
+            config.ansConfig.getMaxTables(),
+            config.predictor,
+            config.useBlockChecksum)));
+        encPtrs.push_back(enc[i].data());
+      }
+
+      floatCompressCpu(
+          pool,
+          config,
+          numInBatch,
+          inPtrs.data(),
+          batchSizes.data(),
+          encPtrs.data(),
+          nullptr,
+          feature == 2 ? refPtrs.data() : nullptr);
+
+      auto enc_dev = std::vector<GpuMemoryReservation<uint8_t>>();
+      auto dec_dev = std::vector<GpuMemoryReservation<FTI::WordT>>();
+      auto encDevPtrs = std::vector<const void*>();
+      auto decPtrs = std::vector<void*>();
+      for (int i = 0; i < numInBatch; ++i) {
+        enc_dev.emplace_back(
+            res.copyAlloc(stream, enc[i], AllocType::Permanent));
+        dec_dev.emplace_back(res.alloc<FTI::WordT>(
+            stream, batchSizes[i], AllocType::Permanent));
+        encDevPtrs.push_back(enc_dev[i].data());
+        decPtrs.push_back(dec_dev[i].data());
+      }
+
+      auto success_dev = res.alloc<uint8_t>(stream, numInBatch);
+      auto size_dev = res.alloc<uint32_t>(stream, numInBatch);
+
+      floatDecompress(
+          res,
+          config,
+          numInBatch,
+          encDevPtrs.data(),
+          decPtrs.data(),
+          batchSizes.data(),
+          success_dev.data(),
+          size_dev.data(),
+          stream);
+
+      // The encoder may not use the feature for every member (e.g., a member
+      // too small to be worth compressing sparsely)
+      auto success = success_dev.copyToHost(stream);
+      for (int i = 0; i < numInBatch; ++i) {
+        auto header = (const GpuFloatHeader*)enc[i].data();
+        bool fails = header->getUseSparse() || header->getUseDelta() ||
+            header->getPredictor() != FloatPredictor::kNone;
+
+        EXPECT_EQ(bool(success[i]), !fails)
+            << "feature " << feature << " align " << align << " member " << i;
+
+        if (success[i]) {
+          auto dec = dec_dev[i].copyToHost(stream);
+          EXPECT_EQ(dec, batch_host[i]);
+        }
+      }
+    }
+  }
+}
+
+// Delta mode, optionally with block checksums, which are of the words rather
+// than their XOR with the reference
+template <FloatType FT>
+void runDeltaTest(StackDeviceMemory& res, bool useBlockChecksum = false) {
+  using FTI = FloatTypeInfo<FT>;
+  using WordT = typename FTI::WordT;
+
+  auto stream = CudaStream::makeNonBlocking();
+  auto& pool = getDefaultThreadPool();
+
+  // Sparse archives are not produced on the GPU, so the host does not use
+  // sparse mode either
+  auto config = FloatCodecConfig(FT, ANSCodecConfig(10), false, true);
+  config.sparseThreshold = 2.0f;
+  config.useBlockChecksum = useBlockChecksum;
+
+  // Every third word differs from its reference in its low significand bits;
+  // the second member is compressed without a reference
+  auto batchSizes = std::vector<uint32_t>{100000, 4097, 1, 3};
+  int numInBatch = batchSizes.size();
+
+  auto batch_host = std::vector<std::vector<WordT>>();
+  auto ref_host = std::vector<std::vector<WordT>>();
+  for (auto size : batchSizes) {
+    ref_host.emplace_back(generateFloats<FT>(size));
+    batch_host.emplace_back(ref_host.back());
+    for (uint32_t i = 0; i < size; i += 3) {
+      batch_host.back()[i] ^= i % 7 + 1;
+    }
+  }
+
+  auto batch_dev = std::vector<GpuMemoryReservation<WordT>>();
+  auto ref_dev = std::vector<GpuMemoryReservation<WordT>>();
+  auto enc_dev = std::vector<GpuMemoryReservation<uint8_t>>();
+  auto inPtrs_host = std::vector<const void*>();
+  auto inPtrs_dev = std::vector<const void*>();
+  auto refPtrs_host = std::vector<const void*>();
+  auto refPtrs_dev = std::vector<const void*>();
+  auto encPtrs_dev = std::vector<void*>();
+  auto enc = std::vector<std::vector<uint8_t>>();
+  auto encPtrs_host = std::vector<void*>();
+  for (int i = 0; i < numInBatch; ++i) {
+    auto maxSize = getMaxFloatCompressedSize(
+        FT,
+        batchSizes[i],
+        config.ansConfig.blockSize,
+        config.ansConfig.useWideState,
+        config.ansConfig.getMaxTables(),
+        config.predictor,
+        useBlockChecksum);
+
+    batch_dev.emplace_back(
+        res.copyAlloc(stream, batch_host[i], AllocType::Permanent));
+    ref_dev.emplace_back(
+        res.copyAlloc(stream, ref_host[i], AllocType::Permanent));
+    enc_dev.emplace_back(
+        res.alloc<uint8_t>(stream, maxSize, AllocType::Permanent));
+    enc.emplace_back(std::vector<uint8_t>(maxSize));
+
+    inPtrs_host.push_back(batch_host[i].data());
+    inPtrs_dev.push_back(batch_dev[i].data());
+    refPtrs_host.push_back(i == 1 ? nullptr : ref_host[i].data());
+    refPtrs_dev.push_back(i == 1 ? nullptr : ref_dev[i].data());
+    encPtrs_dev.push_back(enc_dev[i].data());
+    encPtrs_host.push_back(enc[i].data());
+  }
+
+  floatCompress(
+      res,
+      config,
+      numInBatch,
+      inPtrs_dev.data(),
+      batchSizes.data(),
+      encPtrs_dev.data(),
+      nullptr,
+      stream,
+      refPtrs_dev.data());
+
+  floatCompressCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs_host.data(),
+      batchSizes.data(),
+      encPtrs_host.data(),
+      nullptr,
+      refPtrs_host.data());
+
+  auto encGpu = std::vector<std::vector<uint8_t>>();
+  for (int i = 0; i < numInBatch; ++i) {
+    encGpu.emplace_back(enc_dev[i].copyToHost(stream));
+
+    auto hGpu = (const GpuFloatHeader*)encGpu[i].data();
+    auto hCpu = (const GpuFloatHeader*)enc[i].data();
+    EXPECT_EQ(hGpu->magicAndVersion, hCpu->magicAndVersion);
+    EXPECT_EQ(hGpu->getChecksum(), hCpu->getChecksum());
+    EXPECT_EQ(hGpu->getUseBlockChecksum(), useBlockChecksum);
+
+    if (useBlockChecksum) {
+      // The checksums are followed by the inner archive, which holds the
+      // delta flag
+      auto checksumSize =
+          getBlockChecksumSize((uint64_t)batchSizes[i] * sizeof(WordT));
+      EXPECT_EQ(0, memcmp(hGpu + 1, hCpu + 1, checksumSize))
+          << "member " << i;
+
+      hGpu = (const GpuFloatHeader*)((const uint8_t*)(hGpu + 1) +
+                                     checksumSize);
+    }
+
+    EXPECT_EQ(hGpu->getUseDelta(), i != 1);
+  }
+
+  // With block checksums, a copy of the GPU archives in which the checksum of
+  // block 0 of member 0 is corrupt
+  auto corrupt_dev = std::vector<GpuMemoryReservation<uint8_t>>();
+  if (useBlockChecksum) {
+    for (int i = 0; i < numInBatch; ++i) {
+      auto corrupt = encGpu[i];
+      if (i == 0) {
+        ((uint32_t*)((GpuFloatHeader*)corrupt.data() + 1))[0] ^= 1;
+      }
+
+      corrupt_dev.emplace_back(
+          res.copyAlloc(stream, corrupt, AllocType::Permanent));
+    }
+  }
+
+  // Decode the GPU archives on the GPU into 16 byte aligned (fused decode) and
+  // unaligned (separate join) outputs, then the CPU archives on the GPU, then
+  // any corrupt archives
+  for (int pass = 0; pass < (useBlockChecksum ? 4 : 3); ++pass) {
+    auto in_dev = std::vector<GpuMemoryReservation<uint8_t>>();
+    auto dec_dev = std::vector<GpuMemoryReservation<WordT>>();
+    auto inPtrs = std::vector<const void*>();
+    auto decPtrs = std::vector<void*>();
+    uint32_t outOffset = pass == 1 ? 1 : 0;
+
+    for (int i = 0; i < numInBatch; ++i) {
+      if (pass == 2) {
+        in_dev.emplace_back(
+            res.copyAlloc(stream, enc[i], AllocType::Permanent));
+        inPtrs.push_back(in_dev[i].data());
+      } else if (pass == 3) {
+        inPtrs.push_back(corrupt_dev[i].data());
+      } else {
+        inPtrs.push_back(enc_dev[i].data());
+      }
+
+      dec_dev.emplace_back(res.alloc<WordT>(
+          stream, batchSizes[i] + outOffset, AllocType::Permanent));
+      decPtrs.push_back(dec_dev[i].data() + outOffset);
+    }
+
+    auto success_dev = res.alloc<uint8_t>(stream, numInBatch);
+
+    auto status = floatDecompress(
+        res,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        success_dev.data(),
+        nullptr,
+        stream,
+        refPtrs_dev.data());
+
+    if (pass == 3) {
+      auto expected = std::vector<std::pair<int, std::vector<uint32_t>>>{
+          {0, std::vector<uint32_t>{0}}};
+      EXPECT_EQ(status.error, FloatDecompressError::ChecksumMismatch);
+      EXPECT_EQ(status.failedBlocks, expected);
+    } else {
+      EXPECT_EQ(status.error, FloatDecompressError::None) << "pass " << pass;
+      EXPECT_TRUE(status.failedBlocks.empty()) << "pass " << pass;
+    }
+
+    auto success = success_dev.copyToHost(stream);
+    for (int i = 0; i < numInBatch; ++i) {
+      EXPECT_TRUE(success[i]) << "pass " << pass << " member " << i;
+
+      auto dec = dec_dev[i].copyToHost(stream);
+      EXPECT_TRUE(std::equal(
+          batch_host[i].begin(), batch_host[i].end(), dec.begin() + outOffset))
+          << "pass " << pass << " member " << i;
+    }
+  }
+
+  // Decode the GPU archives on the CPU
+  {
+    auto inPtrs = std::vector<const void*>();
+    auto dec = std::vector<std::vector<WordT>>();
+    auto decPtrs = std::vector<void*>();
+    for (int i = 0; i < numInBatch; ++i) {
+      inPtrs.push_back(encGpu[i].data());
+      dec.emplace_back(std::vector<WordT>(batchSizes[i]));
+      decPtrs.push_back(dec[i].data());
+    }
+
+    auto status = floatDecompressCpu(
+        pool,
+        config,
+        numInBatch,
+        inPtrs.data(),
+        decPtrs.data(),
+        batchSizes.data(),
+        nullptr,
+        nullptr,
+        refPtrs_host.data());
+
+    EXPECT_EQ(status.error, FloatDecompressError::None);
+    EXPECT_EQ(dec, batch_host);
+  }
+}
+
+TEST(FloatTest, Delta) {
+  auto res = makeStackMemory();
+
+  runDeltaTest<FloatType::kFloat16>(res);
+  runDeltaTest<FloatType::kBFloat16>(res);
+  runDeltaTest<FloatType::kFloat32>(res);
+}
+
+TEST(FloatTest, BlockChecksum) {
+  auto res = makeStackMemory();
+
+  runDeltaTest<FloatType::kFloat16>(res, true);
+  runDeltaTest<FloatType::kBFloat16>(res, true);
+  runDeltaTest<FloatType::kFloat32>(res, true);
+}
+
+template <FloatType FT>
+void runRangeTest(
+    StackDeviceMemory& res,
+    const std::vector<uint32_t>& batchSizes) {
+  using FTI = FloatTypeInfo<FT>;
+  using WordT = typename FTI::WordT;
+
+  auto stream = CudaStream::makeNonBlocking();
+  std::mt19937 gen(10 + batchSizes.size());
+
+  int numInBatch = batchSizes.size();
+  uint32_t totalSize = 0;
+  uint32_t maxSize = 0;
+  for (auto v : batchSizes) {
+    totalSize += v;
+    maxSize = std::max(maxSize, v);
+  }
+
+  auto maxCompressedSize = getMaxFloatCompressedSize(FT, maxSize);
+
+  auto orig = generateFloats<FT>(totalSize);
+  auto orig_dev = res.copyAlloc(stream, orig);
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto origOffset = std::vector<uint32_t>(numInBatch);
+  {
+    uint32_t curOffset = 0;
+    for (int i = 0; i < numInBatch; ++i) {
+      inPtrs[i] = (const WordT*)orig_dev.data() + curOffset;
+      origOffset[i] = curOffset;
+      curOffset += batchSizes[i];
+    }
+  }
+
+  auto enc_dev = res.alloc<uint8_t>(stream, numInBatch * maxCompressedSize);
+
+  auto encPtrs = std::vector<void*>(numInBatch);
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs[i] = (uint8_t*)enc_dev.data() + i * maxCompressedSize;
+  }
+
+  auto config = FloatCodecConfig(
+      FT, ANSCodecConfig(10, false, kANSMinBlockSize), false);
+
+  floatCompress(
+      res,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      batchSizes.data(),
+      encPtrs.data(),
+      nullptr,
+      stream);
+
+  for (int iter = 0; iter < 5; ++iter) {
+    auto offsets = std::vector<uint32_t>(numInBatch);
+    auto sizes = std::vector<uint32_t>(numInBatch);
+    auto decOffset = std::vector<uint32_t>(numInBatch);
+    uint32_t totalDec = 0;
+
+    for (int i = 0; i < numInBatch; ++i) {
+      offsets[i] = gen() % batchSizes[i];
+      sizes[i] = gen() % (batchSizes[i] - offsets[i] + 1);
+
+      // Outputs are packed together, so are generally not 16 byte aligned
+      decOffset[i] = totalDec;
+      totalDec += sizes[i];
+    }
+
+    auto dec_dev = res.alloc<WordT>(stream, std::max(totalDec, 1U));
+    auto decPtrs = std::vector<void*>(numInBatch);
+    for (int i = 0; i < numInBatch; ++i) {
+      decPtrs[i] = (WordT*)dec_dev.data() + decOffset[i];
+    }
+
+    auto outSuccess_dev = res.alloc<uint8_t>(stream, numInBatch);
+
+    floatDecompressRange(
+        res,
+        config,
+        numInBatch,
+        (const void**)encPtrs.data(),
+        offsets.data(),
+        sizes.data(),
+        decPtrs.data(),
+        outSuccess_dev.data(),
+        stream);
+
+    auto outSuccess = outSuccess_dev.copyToHost(stream);
+    auto dec = dec_dev.copyToHost(stream);
+
+    for (int i = 0; i < numInBatch; ++i) {
+      EXPECT_TRUE(outSuccess[i]);
+      EXPECT_TRUE(std::equal(
+          dec.begin() + decOffset[i],
+          dec.begin() + decOffset[i] + sizes[i],
+          orig.begin() + origOffset[i] + offsets[i]));
+    }
+  }
+}
+
+TEST(FloatTest, RangeDecode) {
+  auto res = makeStackMemory();
+  auto batchSizes = std::vector<uint32_t>{1, 4097, 33333, 100000};
+
+  runRangeTest<FloatType::kFloat16>(res, batchSizes);
+  runRangeTest<FloatType::kBFloat16>(res, batchSizes);
+  runRangeTest<FloatType::kFloat32>(res, batchSizes);
+}
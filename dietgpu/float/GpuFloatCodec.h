@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <assert.h>
 #include <cuda.h>
+#include <algorithm>
 #include "dietgpu/ans/GpuANSCodec.h"
 
 namespace dietgpu {
@@ -20,6 +22,30 @@ enum class FloatType : uint32_t {
   kFloat16 = 1,
   kBFloat16 = 2,
   kFloat32 = 3,
+  kFloat64 = 4,
+  // OCP 8 bit floating point, with 4 bit exponent and 3 bit significand (the
+  // "fn" variant, without infinities)
+  kFloat8E4M3 = 5,
+  // OCP 8 bit floating point, with 5 bit exponent and 2 bit significand
+  kFloat8E5M2 = 6,
+};
+
+// Predictive front-end for float data sampled on a grid (see
+// FloatCodecConfig::predictor). Each word is predicted from its neighbors
+// that precede it in row-major order by the Lorenzo predictor of the grid's
+// dimension (the previous word in 1-D, W + N - NW in 2-D and the 7 point
+// predictor in 3-D), computed in the integer domain on words mapped to order
+// preserving integers so that the prediction is exactly reproducible
+enum class FloatPredictor : uint32_t {
+  // No prediction; the words are compressed as is
+  kNone = 0,
+  // Each word is compressed as its XOR with the prediction, which clears the
+  // sign, exponent and high order significand bits that the two share
+  kXor = 1,
+  // Each word is compressed as the difference of its order preserving integer
+  // from the prediction, zigzag encoded so that small differences of either
+  // sign have high order bits of zero
+  kSubtract = 2,
 };
 
 // Returns the maximum possible compressed size in bytes of an array of `size`
@@ -27,14 +53,34 @@ enum class FloatType : uint32_t {
 // size * sizeof(the float word type), as if something is uncompressible it will
 // be expanded during compression.
 // This can be used to bound memory consumption for the destination compressed
-// buffer
-uint32_t getMaxFloatCompressedSize(FloatType floatType, uint32_t size);
+// buffer. `blockSize`, `useWideState` and `numTables` must match the ANS
+// configuration used for compression (see ANSCodecConfig::getMaxTables), and
+// `predictor` and `useBlockChecksum` must match FloatCodecConfig::predictor and
+// FloatCodecConfig::useBlockChecksum
+uint32_t getMaxFloatCompressedSize(
+    FloatType floatType,
+    uint32_t size,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false,
+    uint32_t numTables = 1,
+    FloatPredictor predictor = FloatPredictor::kNone,
+    bool useBlockChecksum = false);
+
+// Default minimum fraction of zero words for which a batch member is
+// compressed in sparse mode. A zero then costs a bit of the zero bitmap rather
+// than its non-compressed bytes (at least 1) and its ANS symbol, so sparse mode
+// pays off at this fraction even for the 16 bit float types
+constexpr float kFloatDefaultSparseThreshold = 0.125f;
 
 struct FloatCodecConfig {
   inline FloatCodecConfig()
       : floatType(FloatType::kFloat16),
         useChecksum(false),
-        is16ByteAligned(false) {}
+        is16ByteAligned(false),
+        sparseThreshold(kFloatDefaultSparseThreshold),
+        predictor(FloatPredictor::kNone),
+        gridDims{0, 0},
+        useBlockChecksum(false) {}
 
   inline FloatCodecConfig(
       FloatType ft,
@@ -44,7 +90,11 @@ struct FloatCodecConfig {
       : floatType(ft),
         useChecksum(checksum),
         ansConfig(ansConf),
-        is16ByteAligned(align) {
+        is16ByteAligned(align),
+        sparseThreshold(kFloatDefaultSparseThreshold),
+        predictor(FloatPredictor::kNone),
+        gridDims{0, 0},
+        useBlockChecksum(false) {
     // ANS-level checksumming is not allowed in float mode, only float level
     // checksumming
     assert(!ansConf.useChecksum);
@@ -74,6 +124,41 @@ struct FloatCodecConfig {
   // should be aligned to the floating point word size (e.g.,
   // FloatType::kFloat16, all are assumed sizeof(float16) == 2 byte aligned)
   bool is16ByteAligned;
+
+  // Compression only: a batch member in which at least this fraction of the
+  // words are zero (all bits clear) is compressed in sparse mode, where a
+  // bitmap records the zero words and only the non-zero words are split and
+  // ANS coded. Sparse mode is not used if it could exceed
+  // getMaxFloatCompressedSize, and a value above 1 disables it. Sparse
+  // archives are at present produced and decoded by the host codec only; the
+  // GPU compressor ignores this setting
+  float sparseThreshold;
+
+  // Compression only: the predictive front-end applied to each batch member
+  // before it is split and ANS coded, for smooth data such as the fields of
+  // a simulation. The residuals are compressed as an ordinary float archive
+  // (which may be sparse), behind a header that records the predictor and
+  // grid. Predicted archives are at present produced and decoded by the host
+  // codec only; the GPU compressor rejects this setting
+  FloatPredictor predictor;
+
+  // Compression only: the grid that each batch member holds in row-major
+  // order, for the predictor. gridDims[0] is the extent of the fastest
+  // varying dimension (x) and gridDims[1] that of the next (y); the extent of
+  // the slowest varying dimension follows from the member's size. 0 marks a
+  // dimension that is not present, so {0, 0} is a 1-D array, {nx, 0} a 2-D
+  // grid of rows of nx words and {nx, ny} a 3-D grid
+  uint32_t gridDims[2];
+
+  // On compression, store a CRC32C of each kANSChecksumBlockSize block of
+  // each batch member's words, and of all of them, ahead of its archive (see
+  // ANSCodecConfig::useBlockChecksum, which must be false here). The host
+  // decompressor always verifies them, and reports the blocks that do not
+  // match in FloatDecompressStatus::failedBlocks; the GPU decompressor does
+  // so only if this is set on decompression, as reporting them synchronizes
+  // with the stream. Both decompressors decode archives with block checksums
+  // whatever this setting
+  bool useBlockChecksum;
 };
 
 // Same config options for compression and decompression for now
@@ -94,8 +179,47 @@ struct FloatDecompressStatus {
 
   // Error-specific information for the batch
   std::vector<std::pair<int, std::string>> errorInfo;
+
+  // The batch members whose block checksums did not match, each with the
+  // indices of its failed blocks (see ANSDecodeStatus::failedBlocks); block b
+  // holds bytes [b, b + 1) * kANSChecksumBlockSize of the words
+  std::vector<std::pair<int, std::vector<uint32_t>>> failedBlocks;
+};
+
+// The members of a batch that share a float type
+struct FloatTypeBatchGroup {
+  FloatType floatType;
+
+  // Indices of the members in the batch, in increasing order
+  std::vector<uint32_t> members;
 };
 
+// Splits a batch whose members have the float types `floatTypes` into one
+// group per distinct type, in order of first appearance. The mixed-type entry
+// points (de)compress each group as a single-type sub-batch
+inline std::vector<FloatTypeBatchGroup> groupFloatBatchByType(
+    uint32_t numInBatch,
+    const FloatType* floatTypes) {
+  auto groups = std::vector<FloatTypeBatchGroup>();
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    // There are only a handful of float types
+    auto it = std::find_if(
+        groups.begin(), groups.end(), [&](const FloatTypeBatchGroup& g) {
+          return g.floatType == floatTypes[i];
+        });
+
+    if (it == groups.end()) {
+      groups.push_back(FloatTypeBatchGroup{floatTypes[i], {}});
+      it = groups.end() - 1;
+    }
+
+    it->members.push_back(i);
+  }
+
+  return groups;
+}
+
 //
 // Encode
 //
@@ -136,7 +260,14 @@ void floatCompress(
     uint32_t* outSize_dev,
 
     // stream on the current device on which this runs
-    cudaStream_t stream);
+    cudaStream_t stream,
+
+    // Delta mode (optional, can be nullptr): host array with addresses of
+    // device pointers to a reference of inSize[i] float words for each batch
+    // member, or nullptr for a member compressed without one, as for
+    // floatCompressCpu. The XOR with the reference is formed as the words are
+    // split, and the checksum is that of the XOR
+    const void** ref = nullptr);
 
 void floatCompressSplitSize(
     StackDeviceMemory& res,
@@ -169,9 +300,43 @@ void floatCompressSplitSize(
     // stream on the current device on which this runs
     cudaStream_t stream);
 
+// Compresses a batch whose members may be of different float types, with
+// member i of type floatTypes[i] (config.floatType is ignored), so that e.g.
+// float32 and bfloat16 tensors can be compressed in a single call. This is an
+// API convenience only: the kernels are specialized by float type, so the
+// members of each type are compressed in turn as a sub-batch by
+// floatCompress on `stream`, at the cost of one kernel launch sequence per
+// distinct type, reusing the temporary memory of `res` (the peak temporary
+// memory usage is that of the largest sub-batch). Other arguments are as for
+// floatCompress, with each out[i] of at least size
+// getMaxFloatCompressedSize(floatTypes[i], inSize[i])
+void floatCompressMixed(
+    StackDeviceMemory& res,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    // Host array with the float type of each batch member
+    const FloatType* floatTypes,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize_dev,
+    cudaStream_t stream);
+
 //
 // Decode
 //
+// Archives that the GPU decoder does not handle (sparse and predicted
+// archives, which are at present decoded by the host codec only) or that are
+// not of config.floatType are not decoded, and are reported as failures in
+// outSuccess_dev. Archives with block checksums are decoded, and their
+// checksums verified if config.useBlockChecksum is set (see
+// FloatCodecConfig::useBlockChecksum).
+// Delta archives (see floatCompress) are decoded by the functions taking a
+// `ref` host array of device pointers, with ref[i] the reference of archive i,
+// of its size in float words, or nullptr if archive i is not in delta mode. An
+// archive in delta mode without a reference, or with a reference but not in
+// delta mode, is reported as a failure
+//
 
 FloatDecompressStatus floatDecompress(
     StackDeviceMemory& res,
@@ -205,7 +370,11 @@ FloatDecompressStatus floatDecompress(
     uint32_t* outSize_dev,
 
     // stream on the current device on which this runs
-    cudaStream_t stream);
+    cudaStream_t stream,
+
+    // Optional (can be null): host array with addresses of device pointers to
+    // the reference of each delta archive, or nullptr for the other archives
+    const void** ref = nullptr);
 
 FloatDecompressStatus floatDecompressSplitSize(
     StackDeviceMemory& res,
@@ -245,6 +414,67 @@ FloatDecompressStatus floatDecompressSplitSize(
     // stream on the current device on which this runs
     cudaStream_t stream);
 
+// Random-access decode: decompresses only float words
+// [rangeOffset[i], rangeOffset[i] + rangeSize[i]) of each archive into out[i],
+// decoding only the ANS blocks that cover the range (see
+// ansDecodeRangeBatchPointer). config.useChecksum must be false, as the
+// checksum covers the entire data
+void floatDecompressRange(
+    StackDeviceMemory& res,
+    // How should we decompress our data?
+    const FloatDecompressConfig& config,
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of device pointers comprising the batch
+    const void** in,
+
+    // Host arrays with the offset and size of the range to decode from each
+    // batch member, in float words
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+
+    // Host array with addresses of device pointers of outputs, each pointing
+    // to a valid region of memory of at least rangeSize[i] float words
+    void** out,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a device pointer to an array of length numInBatch,
+    // with true/false for whether or not the range could be decoded (it must
+    // lie within the data)
+    uint8_t* outSuccess_dev,
+
+    // stream on the current device on which this runs
+    cudaStream_t stream,
+
+    // Optional (can be null): host array with addresses of device pointers to
+    // the reference of each delta archive (covering the whole of its data, not
+    // just the range), or nullptr for the other archives
+    const void** ref = nullptr);
+
+// Decompresses a batch of archives that may be of different float types, with
+// archive i of type floatTypes[i] (config.floatType is ignored). As for
+// floatCompressMixed, this is an API convenience only: the members of each
+// type are decompressed in turn as a sub-batch by floatDecompress on `stream`.
+// The types are given by the caller so that no synchronization with the
+// device is needed; an archive not of its given type is reported as a failure
+// (floatGetCompressedInfo reports the type of each archive). outCapacity[i]
+// and the reported sizes are in words of the type of member i. Other
+// arguments are as for floatDecompress; the errorInfo index of the returned
+// status is the index of the member in the batch
+FloatDecompressStatus floatDecompressMixed(
+    StackDeviceMemory& res,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    // Host array with the float type of each batch member
+    const FloatType* floatTypes,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess_dev,
+    uint32_t* outSize_dev,
+    cudaStream_t stream);
+
 //
 // Information
 //
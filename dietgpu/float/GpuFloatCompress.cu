@@ -20,30 +20,6 @@
 
 namespace dietgpu {
 
-uint32_t getMaxFloatCompressedSize(FloatType floatType, uint32_t size) {
-  // kNotCompressed bytes per float are simply stored uncompressed
-  // rounded up to 16 bytes to ensure alignment of the following ANS data
-  // portion
-  uint32_t baseSize = sizeof(GpuFloatHeader) + getMaxCompressedSize(size);
-
-  switch (floatType) {
-    case FloatType::kFloat16:
-      baseSize += FloatTypeInfo<FloatType::kFloat16>::getUncompDataSize(size);
-      break;
-    case FloatType::kBFloat16:
-      baseSize += FloatTypeInfo<FloatType::kBFloat16>::getUncompDataSize(size);
-      break;
-    case FloatType::kFloat32:
-      baseSize += FloatTypeInfo<FloatType::kFloat32>::getUncompDataSize(size);
-      break;
-    default:
-      CHECK(false);
-      break;
-  }
-
-  return baseSize;
-}
-
 void floatCompress(
     StackDeviceMemory& res,
     const FloatCompressConfig& config,
@@ -52,7 +28,11 @@ void floatCompress(
     const uint32_t* inSize,
     void** out,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    const void** ref) {
+  // predicted archives are not yet produced on the GPU
+  CHECK(config.predictor == FloatPredictor::kNone);
+
   // Get the total and maximum input size
   uint32_t maxSize = 0;
 
@@ -66,38 +46,58 @@ void floatCompress(
   static_assert(sizeof(void*) == sizeof(uintptr_t), "");
   static_assert(sizeof(uint32_t) <= sizeof(uintptr_t), "");
 
-  // in, inSize, out
-  auto params_dev = res.alloc<uintptr_t>(stream, numInBatch * 3);
+  // in, inSize, out, ref (if given)
+  uint32_t numParams = ref ? 4 : 3;
+  auto params_dev = res.alloc<uintptr_t>(stream, numInBatch * numParams);
   auto params_host =
-      std::unique_ptr<uintptr_t[]>(new uintptr_t[3 * numInBatch]);
+      std::unique_ptr<uintptr_t[]>(new uintptr_t[numParams * numInBatch]);
 
   std::memcpy(&params_host[0], in, numInBatch * sizeof(void*));
   std::memcpy(&params_host[numInBatch], inSize, numInBatch * sizeof(uint32_t));
   std::memcpy(&params_host[2 * numInBatch], out, numInBatch * sizeof(void*));
+  if (ref) {
+    std::memcpy(&params_host[3 * numInBatch], ref, numInBatch * sizeof(void*));
+  }
 
   CUDA_VERIFY(cudaMemcpyAsync(
       params_dev.data(),
       params_host.get(),
-      3 * numInBatch * sizeof(uintptr_t),
+      numParams * numInBatch * sizeof(uintptr_t),
       cudaMemcpyHostToDevice,
       stream));
 
   auto in_dev = (const void**)params_dev.data();
   auto inSize_dev = (const uint32_t*)(params_dev.data() + numInBatch);
   auto out_dev = (void**)(params_dev.data() + 2 * numInBatch);
+  auto ref_dev =
+      ref ? (const void**)(params_dev.data() + 3 * numInBatch) : nullptr;
 
   auto inProvider = BatchProviderPointer((void**)in_dev, inSize_dev);
   auto outProvider = BatchProviderPointer(out_dev);
 
-  floatCompressDevice(
-      res,
-      config,
-      numInBatch,
-      inProvider,
-      maxSize,
-      outProvider,
-      outSize_dev,
-      stream);
+  if (config.useBlockChecksum) {
+    floatCompressBlockChecksumDevice(
+        res,
+        config,
+        numInBatch,
+        inProvider,
+        maxSize,
+        outProvider,
+        outSize_dev,
+        stream,
+        ref_dev);
+  } else {
+    floatCompressDevice(
+        res,
+        config,
+        numInBatch,
+        inProvider,
+        maxSize,
+        outProvider,
+        outSize_dev,
+        stream,
+        ref_dev);
+  }
 }
 
 void floatCompressSplitSize(
@@ -110,6 +110,9 @@ void floatCompressSplitSize(
     uint32_t outStride,
     uint32_t* outSize_dev,
     cudaStream_t stream) {
+  // predicted archives are not yet produced on the GPU
+  CHECK(config.predictor == FloatPredictor::kNone);
+
   auto floatWordSize = getWordSizeFromFloatType(config.floatType);
 
   auto splitSizeHost = std::vector<uint32_t>(numInBatch * 2);
@@ -147,15 +150,27 @@ void floatCompressSplitSize(
 
   auto outProvider = BatchProviderStride(out_dev, outStride);
 
-  floatCompressDevice(
-      res,
-      config,
-      numInBatch,
-      inProvider,
-      maxSplitSize,
-      outProvider,
-      outSize_dev,
-      stream);
+  if (config.useBlockChecksum) {
+    floatCompressBlockChecksumDevice(
+        res,
+        config,
+        numInBatch,
+        inProvider,
+        maxSplitSize,
+        outProvider,
+        outSize_dev,
+        stream);
+  } else {
+    floatCompressDevice(
+        res,
+        config,
+        numInBatch,
+        inProvider,
+        maxSplitSize,
+        outProvider,
+        outSize_dev,
+        stream);
+  }
 }
 
 } // namespace dietgpu
@@ -27,6 +27,7 @@ template <FloatType FT, int Threads>
 struct SplitFloatNonAligned {
   static __device__ void split(
       const typename FloatTypeInfo<FT>::WordT* in,
+      const typename FloatTypeInfo<FT>::WordT* ref,
       uint32_t size,
       typename FloatTypeInfo<FT>::CompT* compOut,
       typename FloatTypeInfo<FT>::NonCompT* nonCompOut,
@@ -39,7 +40,7 @@ struct SplitFloatNonAligned {
          i += gridDim.x * blockDim.x) {
       CompT comp;
       NonCompT nonComp;
-      FTI::split(in[i], comp, nonComp);
+      FTI::split(xorDelta(in[i], ref, i), comp, nonComp);
 
       atomicAdd(&warpHistogram[comp], 1);
 
@@ -53,6 +54,7 @@ template <int Threads>
 struct SplitFloatNonAligned<FloatType::kFloat32, Threads> {
   static __device__ void split(
       const typename FloatTypeInfo<FloatType::kFloat32>::WordT* in,
+      const typename FloatTypeInfo<FloatType::kFloat32>::WordT* ref,
       uint32_t size,
       typename FloatTypeInfo<FloatType::kFloat32>::CompT* compOut,
       typename FloatTypeInfo<FloatType::kFloat32>::NonCompT* nonCompOut,
@@ -71,7 +73,7 @@ struct SplitFloatNonAligned<FloatType::kFloat32, Threads> {
          i += gridDim.x * blockDim.x) {
       CompT comp;
       NonCompT nonComp;
-      FTI::split(in[i], comp, nonComp);
+      FTI::split(xorDelta(in[i], ref, i), comp, nonComp);
 
       nonComp2Out[i] = nonComp & 0xffffU;
       nonComp1Out[i] = nonComp >> 16;
@@ -86,6 +88,7 @@ template <FloatType FT, int Threads>
 struct SplitFloatAligned16 {
   static __device__ void split(
       const typename FloatTypeInfo<FT>::WordT* __restrict__ in,
+      const typename FloatTypeInfo<FT>::WordT* __restrict__ ref,
       uint32_t size,
       typename FloatTypeInfo<FT>::CompT* __restrict__ compOut,
       typename FloatTypeInfo<FT>::NonCompT* __restrict__ nonCompOut,
@@ -123,11 +126,13 @@ struct SplitFloatAligned16 {
                   inV += gridDim.x * kWordsPerBlock,
                   compOutV += gridDim.x * kWordsPerBlock,
                   nonCompOutV += gridDim.x * kWordsPerBlock) {
+      // The reference at the same position, in delta mode
+      auto refV = ref ? (const VecT*)ref + (inV - (const VecT*)in) : nullptr;
       VecT v[kOuterUnroll];
 
 #pragma unroll
       for (uint32_t i = 0; i < kOuterUnroll; ++i) {
-        v[i] = inV[i * Threads];
+        v[i] = xorDeltaVec(inV[i * Threads], refV, i * Threads);
       }
 
       CompVecT compV[kOuterUnroll];
@@ -162,7 +167,7 @@ struct SplitFloatAligned16 {
          i += gridDim.x * Threads) {
       CompT comp;
       NonCompT nonComp;
-      FTI::split(in[i], comp, nonComp);
+      FTI::split(xorDelta(in[i], ref, i), comp, nonComp);
 
       atomicAdd(&warpHistogram[comp], 1);
 
@@ -177,6 +182,8 @@ template <int Threads>
 struct SplitFloatAligned16<FloatType::kFloat32, Threads> {
   static __device__ void split(
       const typename FloatTypeInfo<FloatType::kFloat32>::WordT* __restrict__ in,
+      const typename FloatTypeInfo<
+          FloatType::kFloat32>::WordT* __restrict__ ref,
       uint32_t size,
       typename FloatTypeInfo<FloatType::kFloat32>::CompT* __restrict__ compOut,
       typename FloatTypeInfo<
@@ -218,11 +225,14 @@ struct SplitFloatAligned16<FloatType::kFloat32, Threads> {
                   compOutV += gridDim.x * kWordsPerBlock,
                   nonCompOutV2 += gridDim.x * kWordsPerBlock,
                   nonCompOutV1 += gridDim.x * kWordsPerBlock) {
+      // The reference at the same position, in delta mode
+      auto refV =
+          ref ? (const uint32x4*)ref + (inV - (const uint32x4*)in) : nullptr;
       uint32x4 v[kOuterUnroll];
 
 #pragma unroll
       for (uint32_t i = 0; i < kOuterUnroll; ++i) {
-        v[i] = inV[i * Threads];
+        v[i] = xorDeltaVec(inV[i * Threads], refV, i * Threads);
       }
 
       uint8x4 compV[kOuterUnroll];
@@ -266,7 +276,7 @@ struct SplitFloatAligned16<FloatType::kFloat32, Threads> {
          i += gridDim.x * Threads) {
       CompT comp;
       NonCompT nonComp;
-      FTI::split(in[i], comp, nonComp);
+      FTI::split(xorDelta(in[i], ref, i), comp, nonComp);
 
       atomicAdd(&warpHistogram[comp], 1);
 
@@ -277,6 +287,118 @@ struct SplitFloatAligned16<FloatType::kFloat32, Threads> {
   }
 };
 
+template <int Threads>
+struct SplitFloatNonAligned<FloatType::kFloat64, Threads> {
+  static __device__ void split(
+      const typename FloatTypeInfo<FloatType::kFloat64>::WordT* in,
+      const typename FloatTypeInfo<FloatType::kFloat64>::WordT* ref,
+      uint32_t size,
+      typename FloatTypeInfo<FloatType::kFloat64>::CompT* compOut,
+      typename FloatTypeInfo<FloatType::kFloat64>::NonCompT* nonCompOut,
+      uint32_t* warpHistogram) {
+    using FTI = FloatTypeInfo<FloatType::kFloat64>;
+    using CompT = typename FTI::CompT;
+    using NonCompT = typename FTI::NonCompT;
+
+    // Where the low order 4 bytes are written
+    uint32_t* nonComp4Out = (uint32_t*)nonCompOut;
+
+    // Where the middle 2 bytes are written
+    uint16_t* nonComp2Out = (uint16_t*)(nonComp4Out + roundUp(size, 4));
+
+    // Where the high order byte is written
+    uint8_t* nonComp1Out = (uint8_t*)(nonComp2Out + roundUp(size, 8));
+
+    for (uint32_t i = blockIdx.x * blockDim.x + threadIdx.x; i < size;
+         i += gridDim.x * blockDim.x) {
+      CompT comp;
+      NonCompT nonComp;
+      FTI::split(xorDelta(in[i], ref, i), comp, nonComp);
+
+      nonComp4Out[i] = nonComp & 0xffffffffU;
+      nonComp2Out[i] = (nonComp >> 32) & 0xffffU;
+      nonComp1Out[i] = nonComp >> 48;
+      compOut[i] = comp;
+
+      atomicAdd(&warpHistogram[comp], 1);
+    }
+  }
+};
+
+// float64 specialization
+template <int Threads>
+struct SplitFloatAligned16<FloatType::kFloat64, Threads> {
+  static __device__ void split(
+      const typename FloatTypeInfo<FloatType::kFloat64>::WordT* __restrict__ in,
+      const typename FloatTypeInfo<
+          FloatType::kFloat64>::WordT* __restrict__ ref,
+      uint32_t size,
+      typename FloatTypeInfo<FloatType::kFloat64>::CompT* __restrict__ compOut,
+      typename FloatTypeInfo<
+          FloatType::kFloat64>::NonCompT* __restrict__ nonCompOut,
+      uint32_t* warpHistogram) {
+    // FIXME: implement vectorization
+    SplitFloatNonAligned<FloatType::kFloat64, Threads>::split(
+        in, ref, size, compOut, nonCompOut, warpHistogram);
+  }
+};
+
+// The float8 types bit pack the significands of groups of kFloat8GroupSize
+// words, so each thread handles a whole group
+template <FloatType FT, int Threads>
+struct SplitFloat8 {
+  static __device__ void split(
+      const typename FloatTypeInfo<FT>::WordT* in,
+      const typename FloatTypeInfo<FT>::WordT* ref,
+      uint32_t size,
+      typename FloatTypeInfo<FT>::CompT* compOut,
+      typename FloatTypeInfo<FT>::NonCompT* nonCompOut,
+      uint32_t* warpHistogram) {
+    using FTI = FloatTypeInfo<FT>;
+    using CompT = typename FTI::CompT;
+    using NonCompT = typename FTI::NonCompT;
+
+    uint32_t numGroups = divUp(size, kFloat8GroupSize);
+
+    for (uint32_t g = blockIdx.x * blockDim.x + threadIdx.x; g < numGroups;
+         g += gridDim.x * blockDim.x) {
+      uint32_t start = g * kFloat8GroupSize;
+      NonCompT nonComp[kFloat8GroupSize];
+
+#pragma unroll
+      for (uint32_t j = 0; j < kFloat8GroupSize; ++j) {
+        nonComp[j] = 0;
+
+        if (start + j < size) {
+          CompT comp;
+          FTI::split(xorDelta(in[start + j], ref, start + j), comp, nonComp[j]);
+
+          atomicAdd(&warpHistogram[comp], 1);
+          compOut[start + j] = comp;
+        }
+      }
+
+      FTI::writeGroup(nonCompOut, size, g, nonComp);
+    }
+  }
+};
+
+template <int Threads>
+struct SplitFloatNonAligned<FloatType::kFloat8E4M3, Threads>
+    : SplitFloat8<FloatType::kFloat8E4M3, Threads> {};
+
+template <int Threads>
+struct SplitFloatAligned16<FloatType::kFloat8E4M3, Threads>
+    : SplitFloat8<FloatType::kFloat8E4M3, Threads> {};
+
+template <int Threads>
+struct SplitFloatNonAligned<FloatType::kFloat8E5M2, Threads>
+    : SplitFloat8<FloatType::kFloat8E5M2, Threads> {};
+
+template <int Threads>
+struct SplitFloatAligned16<FloatType::kFloat8E5M2, Threads>
+    : SplitFloat8<FloatType::kFloat8E5M2, Threads> {};
+
 template <
     typename InProvider,
     typename NonCompProvider,
@@ -284,6 +406,8 @@ template <
     int Threads>
 __global__ void splitFloat(
     InProvider inProvider,
+    // Optional per-batch member reference, for delta mode
+    const void* const* __restrict__ ref,
     bool useChecksum,
     const uint32_t* __restrict__ checksum,
     void* __restrict__ compOut,
@@ -317,6 +441,7 @@ __global__ void splitFloat(
   uint32_t* warpHistogram = histogram[warpId];
 
   auto curIn = (const WordT*)inProvider.getBatchStart(batch);
+  auto curRef = ref ? (const WordT*)ref[batch] : nullptr;
   auto headerOut = (GpuFloatHeader*)nonCompProvider.getBatchStart(batch);
   auto curCompOut = (CompT*)compOut + compOutStride * batch;
   auto curSize = inProvider.getBatchSize(batch);
@@ -324,29 +449,30 @@ __global__ void splitFloat(
   // Write size as a header
   if (blockIdx.x == 0 && threadIdx.x == 0) {
     GpuFloatHeader h;
-    h.setMagicAndVersion();
     h.size = curSize;
+    h.options = 0;
     h.setFloatType(FT);
     h.setUseChecksum(useChecksum);
-
-    if (useChecksum) {
-      h.setChecksum(*checksum);
-    }
+    h.setChecksum(useChecksum ? *checksum : 0);
+    h.setUseDelta(curRef != nullptr);
+    h.setMagicAndVersion();
 
     *headerOut = h;
   }
 
   auto curNonCompOut = (NonCompT*)(headerOut + 1);
 
-  // How many bytes are before the point where we are 16 byte aligned?
-  auto nonAlignedBytes = getAlignmentRoundUp<sizeof(uint4)>(curIn);
+  // How many bytes are before the point where we are 16 byte aligned? The
+  // vectorized path also loads the reference by 16 byte words
+  auto nonAlignedBytes = getAlignmentRoundUp<sizeof(uint4)>(curIn) +
+      (curRef ? getAlignmentRoundUp<sizeof(uint4)>(curRef) : 0);
 
   if (nonAlignedBytes > 0) {
     SplitFloatNonAligned<FT, Threads>::split(
-        curIn, curSize, curCompOut, curNonCompOut, warpHistogram);
+        curIn, curRef, curSize, curCompOut, curNonCompOut, warpHistogram);
   } else {
     SplitFloatAligned16<FT, Threads>::split(
-        curIn, curSize, curCompOut, curNonCompOut, warpHistogram);
+        curIn, curRef, curSize, curCompOut, curNonCompOut, warpHistogram);
   }
 
   // Accumulate warp histogram data and write into the gmem histogram
@@ -452,19 +578,23 @@ void floatCompressDevice(
     uint32_t maxSize,
     OutProvider& outProvider,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
-  auto maxUncompressedWords = maxSize / sizeof(ANSDecodedT);
-  uint32_t maxNumCompressedBlocks =
-      divUp(maxUncompressedWords, kDefaultBlockSize);
-
-  // Compute checksum on input data (optional)
+    cudaStream_t stream,
+    // Optional device array of numInBatch device pointers to the reference of
+    // each batch member compressed in delta mode, or nullptr for the others
+    const void* const* ref_dev = nullptr) {
+  // Compute checksum on input data (optional); in delta mode, that of the XOR
+  // with the reference
   auto checksum_dev = res.alloc<uint32_t>(stream, numInBatch);
 
   // not allowed in float mode
   assert(!config.ansConfig.useChecksum);
+  CHECK(!config.ansConfig.useBlockChecksum)
+      << "block checksums are stored at the float level";
+  // see floatCompressBlockChecksumDevice
+  CHECK(!config.useBlockChecksum);
 
   if (config.useChecksum) {
-    checksumBatch(numInBatch, inProvider, checksum_dev.data(), stream);
+    checksumBatch(numInBatch, inProvider, checksum_dev.data(), stream, ref_dev);
   }
 
   // Temporary space for the extracted exponents; all rows must be 16 byte
@@ -500,6 +630,7 @@ void floatCompressDevice(
     splitFloat<InProvider, OutProvider, FLOAT_TYPE, kBlock>        \
         <<<grid, kBlock, 0, stream>>>(                             \
             inProvider,                                            \
+            ref_dev,                                               \
             config.useChecksum,                                    \
             checksum_dev.data(),                                   \
             toComp_dev.data(),                                     \
@@ -518,6 +649,15 @@ void floatCompressDevice(
     case FloatType::kFloat32:
       RUN_SPLIT(FloatType::kFloat32);
       break;
+    case FloatType::kFloat64:
+      RUN_SPLIT(FloatType::kFloat64);
+      break;
+    case FloatType::kFloat8E4M3:
+      RUN_SPLIT(FloatType::kFloat8E4M3);
+      break;
+    case FloatType::kFloat8E5M2:
+      RUN_SPLIT(FloatType::kFloat8E5M2);
+      break;
     default:
       assert(false);
       break;
@@ -568,6 +708,15 @@ void floatCompressDevice(
     case FloatType::kFloat32:
       RUN_ANS(FloatType::kFloat32);
       break;
+    case FloatType::kFloat64:
+      RUN_ANS(FloatType::kFloat64);
+      break;
+    case FloatType::kFloat8E4M3:
+      RUN_ANS(FloatType::kFloat8E4M3);
+      break;
+    case FloatType::kFloat8E5M2:
+      RUN_ANS(FloatType::kFloat8E5M2);
+      break;
     default:
       assert(false);
       break;
@@ -578,4 +727,131 @@ void floatCompressDevice(
   CUDA_TEST_ERROR();
 }
 
+// With block checksums (see FloatCodecConfig::useBlockChecksum), provides the
+// output of the inner float archive, which follows the outer header and the
+// block checksums of the words. Also provides the block checksums for
+// blockChecksumBatch
+template <typename OutProvider, typename SizeProvider>
+struct FloatBlockChecksumOutProvider {
+  using Writer = BatchWriter;
+
+  __host__ FloatBlockChecksumOutProvider(
+      OutProvider& outProvider,
+      SizeProvider& sizeProvider,
+      uint32_t wordSize)
+      : outProvider_(outProvider),
+        sizeProvider_(sizeProvider),
+        wordSize_(wordSize) {}
+
+  __device__ GpuFloatHeader* getHeader(uint32_t batch) {
+    return (GpuFloatHeader*)outProvider_.getBatchStart(batch);
+  }
+
+  __device__ uint32_t* getBlockChecksums(uint32_t batch) {
+    return (uint32_t*)(getHeader(batch) + 1);
+  }
+
+  __device__ uint32_t getBytes(uint32_t batch) {
+    return sizeProvider_.getBatchSize(batch) * wordSize_;
+  }
+
+  __device__ void* getBatchStart(uint32_t batch) {
+    return (uint8_t*)getBlockChecksums(batch) +
+        getBlockChecksumSize(getBytes(batch));
+  }
+
+  __device__ BatchWriter getWriter(uint32_t batch) {
+    return BatchWriter(getBatchStart(batch));
+  }
+
+  OutProvider outProvider_;
+  SizeProvider sizeProvider_;
+  uint32_t wordSize_;
+};
+
+// Writes the outer header of each archive with block checksums, once the
+// inner archive has been written, and adds the header and checksums to the
+// size of the inner archive
+template <typename OutProvider, typename SizeProvider>
+__global__ void writeFloatBlockChecksumHeader(
+    FloatBlockChecksumOutProvider<OutProvider, SizeProvider> outProvider,
+    FloatType floatType,
+    bool useChecksum,
+    uint32_t* outSize,
+    uint32_t numInBatch) {
+  uint32_t batch = blockIdx.x * blockDim.x + threadIdx.x;
+  if (batch >= numInBatch) {
+    return;
+  }
+
+  auto headerOut = outProvider.getHeader(batch);
+  auto inner = (const GpuFloatHeader*)outProvider.getBatchStart(batch);
+
+  GpuFloatHeader header{};
+  header.size = inner->size;
+  header.setFloatType(floatType);
+  header.setUseChecksum(useChecksum);
+  header.setUseBlockChecksum(true);
+  header.setChecksum(inner->getChecksum());
+  header.setMagicAndVersion();
+
+  *headerOut = header;
+
+  outSize[batch] += (const uint8_t*)inner - (const uint8_t*)headerOut;
+}
+
+// floatCompressDevice with block checksums: the words are compressed as an
+// ordinary archive following the outer header and the block checksums of the
+// words, which are those of the input as given, with any delta applied by the
+// inner archive
+template <typename InProvider, typename OutProvider>
+void floatCompressBlockChecksumDevice(
+    StackDeviceMemory& res,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    InProvider& inProvider,
+    uint32_t maxSize,
+    OutProvider& outProvider,
+    uint32_t* outSize_dev,
+    cudaStream_t stream,
+    const void* const* ref_dev = nullptr) {
+  CHECK(config.useBlockChecksum);
+
+  auto innerConfig = config;
+  innerConfig.useBlockChecksum = false;
+
+  uint32_t wordSize = getWordSizeFromFloatType(config.floatType);
+  auto innerOutProvider =
+      FloatBlockChecksumOutProvider<OutProvider, InProvider>(
+          outProvider, inProvider, wordSize);
+
+  floatCompressDevice(
+      res,
+      innerConfig,
+      numInBatch,
+      inProvider,
+      maxSize,
+      innerOutProvider,
+      outSize_dev,
+      stream,
+      ref_dev);
+
+  writeFloatBlockChecksumHeader<<<divUp(numInBatch, 128), 128, 0, stream>>>(
+      innerOutProvider,
+      config.floatType,
+      config.useChecksum,
+      outSize_dev,
+      numInBatch);
+
+  blockChecksumBatch(
+      res,
+      numInBatch,
+      inProvider,
+      innerOutProvider,
+      maxSize * wordSize,
+      stream);
+
+  CUDA_TEST_ERROR();
+}
+
 } // namespace dietgpu
@@ -28,9 +28,10 @@ FloatDecompressStatus floatDecompress(
     const uint32_t* outCapacity,
     uint8_t* outSuccess_dev,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    const void** ref) {
   // If the batch size is <= kBSLimit, we avoid cudaMemcpy and send all data at
-  // kernel launch
+  // kernel launch; the references are always copied
   constexpr int kLimit = 128;
 
   // Investigate all of the output pointers; are they 16 byte aligned? If so, we
@@ -53,7 +54,7 @@ FloatDecompressStatus floatDecompress(
     maxCapacity = std::max(maxCapacity, outCapacity[i]);
   }
 
-  if (numInBatch <= kLimit) {
+  if (numInBatch <= kLimit && !ref) {
     // We can do everything in a single pass without a h2d memcpy
     auto inProvider =
         BatchProviderInlinePointer<kLimit>(numInBatch, (void**)in);
@@ -78,26 +79,32 @@ FloatDecompressStatus floatDecompress(
   static_assert(sizeof(void*) == sizeof(uintptr_t));
   static_assert(sizeof(uint32_t) <= sizeof(uintptr_t));
 
-  // in, out, outCapacity
-  auto params_dev = res.alloc<uintptr_t>(stream, numInBatch * 3);
+  // in, out, outCapacity, ref (if given)
+  uint32_t numParams = ref ? 4 : 3;
+  auto params_dev = res.alloc<uintptr_t>(stream, numInBatch * numParams);
   auto params_host =
-      std::unique_ptr<uintptr_t[]>(new uintptr_t[3 * numInBatch]);
+      std::unique_ptr<uintptr_t[]>(new uintptr_t[numParams * numInBatch]);
 
   std::memcpy(&params_host[0], in, numInBatch * sizeof(void*));
   std::memcpy(&params_host[numInBatch], out, numInBatch * sizeof(void*));
   std::memcpy(
       &params_host[2 * numInBatch], outCapacity, numInBatch * sizeof(uint32_t));
+  if (ref) {
+    std::memcpy(&params_host[3 * numInBatch], ref, numInBatch * sizeof(void*));
+  }
 
   CUDA_VERIFY(cudaMemcpyAsync(
       params_dev.data(),
       params_host.get(),
-      3 * numInBatch * sizeof(uintptr_t),
+      numParams * numInBatch * sizeof(uintptr_t),
       cudaMemcpyHostToDevice,
       stream));
 
   auto in_dev = params_dev.data();
   auto out_dev = params_dev.data() + numInBatch;
   auto outCapacity_dev = (const uint32_t*)(params_dev.data() + 2 * numInBatch);
+  auto ref_dev =
+      ref ? (const void**)(params_dev.data() + 3 * numInBatch) : nullptr;
 
   auto inProvider = BatchProviderPointer((void**)in_dev);
   auto outProvider = BatchProviderPointer((void**)out_dev, outCapacity_dev);
@@ -111,7 +118,8 @@ FloatDecompressStatus floatDecompress(
       maxCapacity,
       outSuccess_dev,
       outSize_dev,
-      stream);
+      stream,
+      ref_dev);
 }
 
 FloatDecompressStatus floatDecompressSplitSize(
@@ -178,4 +186,98 @@ FloatDecompressStatus floatDecompressSplitSize(
       stream);
 }
 
+void floatDecompressRange(
+    StackDeviceMemory& res,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* rangeOffset,
+    const uint32_t* rangeSize,
+    void** out,
+    uint8_t* outSuccess_dev,
+    cudaStream_t stream,
+    const void** ref) {
+  CHECK(!config.useChecksum)
+      << "the checksum cannot be verified when decoding a range";
+  CHECK(!config.useBlockChecksum)
+      << "block checksums cannot be verified when decoding a range";
+  // not allowed in float mode
+  CHECK(!config.ansConfig.useChecksum);
+
+  auto range = std::vector<uint2>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    range[i] = make_uint2(rangeOffset[i], rangeSize[i]);
+  }
+
+  auto range_dev = res.copyAlloc<uint2>(stream, range);
+  auto in_dev = res.copyAlloc<void*>(stream, (void**)in, numInBatch);
+  auto out_dev = res.copyAlloc<void*>(stream, out, numInBatch);
+  auto ref_dev =
+      res.copyAlloc<void*>(stream, (void**)ref, ref ? numInBatch : 0);
+  auto curRef_dev = ref ? (const void**)ref_dev.data() : nullptr;
+
+  // Archives with block checksums are decoded through their inner archive
+  using InProvider = FloatBlockChecksumInProvider<BatchProviderPointer>;
+
+  auto inPointerProvider = BatchProviderPointer(in_dev.data());
+  auto inProvider = InProvider(
+      inPointerProvider,
+      config.floatType,
+      getWordSizeFromFloatType(config.floatType));
+  auto outProvider = BatchProviderPointer(out_dev.data());
+
+  // One exponent is encoded per float word, so the float range is also the
+  // range of ANS symbols. The range writer stores words individually, so we
+  // always decode in a single pass regardless of output alignment
+#define RUN_RANGE(FT)                                                     \
+  do {                                                                    \
+    using OutProviderFloat =                                              \
+        FloatOutProvider<InProvider, BatchProviderPointer, FT>;           \
+                                                                          \
+    auto inProviderANS =                                                  \
+        FloatANSProvider<FT, InProvider>(inProvider, curRef_dev);         \
+    auto outProviderANS = BatchProviderRange<OutProviderFloat>(           \
+        OutProviderFloat(inProvider, outProvider, curRef_dev),            \
+        range_dev.data());                                                \
+                                                                          \
+    ansDecodeBatch(                                                       \
+        res,                                                              \
+        config.ansConfig,                                                 \
+        numInBatch,                                                       \
+        inProviderANS,                                                    \
+        outProviderANS,                                                   \
+        outSuccess_dev,                                                   \
+        nullptr,                                                          \
+        stream);                                                          \
+  } while (false)
+
+  switch (config.floatType) {
+    case FloatType::kFloat16:
+      RUN_RANGE(FloatType::kFloat16);
+      break;
+    case FloatType::kBFloat16:
+      RUN_RANGE(FloatType::kBFloat16);
+      break;
+    case FloatType::kFloat32:
+      RUN_RANGE(FloatType::kFloat32);
+      break;
+    case FloatType::kFloat64:
+      RUN_RANGE(FloatType::kFloat64);
+      break;
+    case FloatType::kFloat8E4M3:
+      RUN_RANGE(FloatType::kFloat8E4M3);
+      break;
+    case FloatType::kFloat8E5M2:
+      RUN_RANGE(FloatType::kFloat8E5M2);
+      break;
+    default:
+      CHECK(false);
+      break;
+  }
+
+#undef RUN_RANGE
+
+  CUDA_TEST_ERROR();
+}
+
 } // namespace dietgpu
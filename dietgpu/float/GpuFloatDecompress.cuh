@@ -27,11 +27,13 @@ struct JoinFloatNonAligned {
   static __device__ void join(
       const typename FloatTypeInfo<FT>::CompT* __restrict__ compIn,
       const typename FloatTypeInfo<FT>::NonCompT* __restrict__ nonCompIn,
+      const typename FloatTypeInfo<FT>::WordT* __restrict__ ref,
       uint32_t size,
       typename FloatTypeInfo<FT>::WordT* __restrict__ out) {
     for (uint32_t i = blockIdx.x * Threads + threadIdx.x; i < size;
          i += gridDim.x * Threads) {
-      out[i] = FloatTypeInfo<FT>::join(compIn[i], nonCompIn[i]);
+      out[i] = xorDelta(
+          FloatTypeInfo<FT>::join(compIn[i], nonCompIn[i]), ref, i);
     }
   }
 };
@@ -43,6 +45,8 @@ struct JoinFloatNonAligned<FloatType::kFloat32, Threads> {
           FloatType::kFloat32>::CompT* __restrict__ compIn,
       const typename FloatTypeInfo<
           FloatType::kFloat32>::NonCompT* __restrict__ nonCompIn,
+      const typename FloatTypeInfo<
+          FloatType::kFloat32>::WordT* __restrict__ ref,
       uint32_t size,
       typename FloatTypeInfo<FloatType::kFloat32>::WordT* __restrict__ out) {
     using FTI = FloatTypeInfo<FloatType::kFloat32>;
@@ -60,7 +64,7 @@ struct JoinFloatNonAligned<FloatType::kFloat32, Threads> {
       uint32_t nc =
           (uint32_t(nonComp1In[i]) * 65536U) + uint32_t(nonComp2In[i]);
 
-      out[i] = FTI::join(compIn[i], nc);
+      out[i] = xorDelta(FTI::join(compIn[i], nc), ref, i);
     }
   }
 };
@@ -70,6 +74,7 @@ struct JoinFloatAligned16 {
   static __device__ void join(
       const typename FloatTypeInfo<FT>::CompT* __restrict__ compIn,
       const typename FloatTypeInfo<FT>::NonCompT* __restrict__ nonCompIn,
+      const typename FloatTypeInfo<FT>::WordT* __restrict__ ref,
       uint32_t size,
       typename FloatTypeInfo<FT>::WordT* __restrict__ out) {
     using FTI = FloatTypeInfo<FT>;
@@ -124,9 +129,12 @@ struct JoinFloatAligned16 {
         }
       }
 
+      // The reference at the same position, in delta mode
+      auto refV = ref ? (const VecT*)ref + (outV - (VecT*)out) : nullptr;
+
 #pragma unroll
       for (uint32_t i = 0; i < kOuterUnroll; ++i) {
-        outV[i * Threads] = v[i];
+        outV[i * Threads] = xorDeltaVec(v[i], refV, i * Threads);
       }
     }
 
@@ -135,7 +143,7 @@ struct JoinFloatAligned16 {
              fullBlocks * kFloatsPerBlock + blockIdx.x * Threads + threadIdx.x;
          i < size;
          i += blockDim.x) {
-      out[i] = FTI::join(compIn[i], nonCompIn[i]);
+      out[i] = xorDelta(FTI::join(compIn[i], nonCompIn[i]), ref, i);
     }
   }
 };
@@ -148,6 +156,8 @@ struct JoinFloatAligned16<FloatType::kFloat32, Threads> {
           FloatType::kFloat32>::CompT* __restrict__ compIn,
       const typename FloatTypeInfo<
           FloatType::kFloat32>::NonCompT* __restrict__ nonCompIn,
+      const typename FloatTypeInfo<
+          FloatType::kFloat32>::WordT* __restrict__ ref,
       uint32_t size,
       typename FloatTypeInfo<FloatType::kFloat32>::WordT* __restrict__ out) {
     using FTI = FloatTypeInfo<FloatType::kFloat32>;
@@ -216,9 +226,13 @@ struct JoinFloatAligned16<FloatType::kFloat32, Threads> {
         }
       }
 
+      // The reference at the same position, in delta mode
+      auto refV =
+          ref ? (const uint32x4*)ref + (outV - (uint32x4*)out) : nullptr;
+
 #pragma unroll
       for (uint32_t i = 0; i < kOuterUnroll; ++i) {
-        outV[i * Threads] = v[i];
+        outV[i * Threads] = xorDeltaVec(v[i], refV, i * Threads);
       }
     }
 
@@ -231,7 +245,7 @@ struct JoinFloatAligned16<FloatType::kFloat32, Threads> {
       uint32_t nc1 = nonCompIn1[i];
       uint32_t nc = nc1 * 65536U + nc2;
 
-      out[i] = FTI::join(compIn[i], nc);
+      out[i] = xorDelta(FTI::join(compIn[i], nc), ref, i);
     }
   }
 };
@@ -241,17 +255,21 @@ struct JoinFloatImpl {
   static __device__ void join(
       const typename FloatTypeInfo<FT>::CompT* compIn,
       const typename FloatTypeInfo<FT>::NonCompT* nonCompIn,
+      const typename FloatTypeInfo<FT>::WordT* ref,
       uint32_t size,
       typename FloatTypeInfo<FT>::WordT* out) {
     // compIn should always be aligned, as we decompress into temporary memory
     auto compUnalignedBytes = getAlignmentRoundUp<sizeof(uint4)>(compIn);
     auto nonCompUnalignedBytes = getAlignmentRoundUp<sizeof(uint4)>(nonCompIn);
     auto outUnalignedBytes = getAlignmentRoundUp<sizeof(uint4)>(out);
+    auto refUnalignedBytes = ref ? getAlignmentRoundUp<sizeof(uint4)>(ref) : 0;
 
-    if (compUnalignedBytes || nonCompUnalignedBytes || outUnalignedBytes) {
-      JoinFloatNonAligned<FT, Threads>::join(compIn, nonCompIn, size, out);
+    if (compUnalignedBytes || nonCompUnalignedBytes || outUnalignedBytes ||
+        refUnalignedBytes) {
+      JoinFloatNonAligned<FT, Threads>::join(
+          compIn, nonCompIn, ref, size, out);
     } else {
-      JoinFloatAligned16<FT, Threads>::join(compIn, nonCompIn, size, out);
+      JoinFloatAligned16<FT, Threads>::join(compIn, nonCompIn, ref, size, out);
     }
   }
 };
@@ -261,14 +279,127 @@ struct JoinFloatImpl<FloatType::kFloat32, Threads> {
   static __device__ void join(
       const typename FloatTypeInfo<FloatType::kFloat32>::CompT* compIn,
       const typename FloatTypeInfo<FloatType::kFloat32>::NonCompT* nonCompIn,
+      const typename FloatTypeInfo<FloatType::kFloat32>::WordT* ref,
       uint32_t size,
       typename FloatTypeInfo<FloatType::kFloat32>::WordT* out) {
     // FIXME: implement vectorization
     JoinFloatNonAligned<FloatType::kFloat32, Threads>::join(
-        compIn, nonCompIn, size, out);
+        compIn, nonCompIn, ref, size, out);
   }
 };
 
+template <int Threads>
+struct JoinFloatNonAligned<FloatType::kFloat64, Threads> {
+  static __device__ void join(
+      const typename FloatTypeInfo<
+          FloatType::kFloat64>::CompT* __restrict__ compIn,
+      const typename FloatTypeInfo<
+          FloatType::kFloat64>::NonCompT* __restrict__ nonCompIn,
+      const typename FloatTypeInfo<
+          FloatType::kFloat64>::WordT* __restrict__ ref,
+      uint32_t size,
+      typename FloatTypeInfo<FloatType::kFloat64>::WordT* __restrict__ out) {
+    using FTI = FloatTypeInfo<FloatType::kFloat64>;
+
+    // Where the low order 4 bytes are read
+    const uint32_t* nonComp4In = (const uint32_t*)nonCompIn;
+
+    // Where the middle 2 bytes are read
+    const uint16_t* nonComp2In =
+        (const uint16_t*)(nonComp4In + roundUp(size, 4));
+
+    // Where the high order byte is read
+    const uint8_t* nonComp1In = (const uint8_t*)(nonComp2In + roundUp(size, 8));
+
+    for (uint32_t i = blockIdx.x * Threads + threadIdx.x; i < size;
+         i += gridDim.x * Threads) {
+      uint64_t nc = (uint64_t(nonComp1In[i]) << 48) |
+          (uint64_t(nonComp2In[i]) << 32) | uint64_t(nonComp4In[i]);
+
+      out[i] = xorDelta(FTI::join(compIn[i], nc), ref, i);
+    }
+  }
+};
+
+template <int Threads>
+struct JoinFloatImpl<FloatType::kFloat64, Threads> {
+  static __device__ void join(
+      const typename FloatTypeInfo<FloatType::kFloat64>::CompT* compIn,
+      const typename FloatTypeInfo<FloatType::kFloat64>::NonCompT* nonCompIn,
+      const typename FloatTypeInfo<FloatType::kFloat64>::WordT* ref,
+      uint32_t size,
+      typename FloatTypeInfo<FloatType::kFloat64>::WordT* out) {
+    // FIXME: implement vectorization
+    JoinFloatNonAligned<FloatType::kFloat64, Threads>::join(
+        compIn, nonCompIn, ref, size, out);
+  }
+};
+
+// The float8 significands are bit packed (see kFloat8GroupSize), and are read
+// individually
+template <FloatType FT, int Threads>
+struct JoinFloat8 {
+  static __device__ void join(
+      const typename FloatTypeInfo<FT>::CompT* __restrict__ compIn,
+      const typename FloatTypeInfo<FT>::NonCompT* __restrict__ nonCompIn,
+      const typename FloatTypeInfo<FT>::WordT* __restrict__ ref,
+      uint32_t size,
+      typename FloatTypeInfo<FT>::WordT* __restrict__ out) {
+    using FTI = FloatTypeInfo<FT>;
+
+    for (uint32_t i = blockIdx.x * Threads + threadIdx.x; i < size;
+         i += gridDim.x * Threads) {
+      out[i] =
+          xorDelta(FTI::join(compIn[i], FTI::read(nonCompIn, size, i)), ref, i);
+    }
+  }
+};
+
+template <int Threads>
+struct JoinFloatImpl<FloatType::kFloat8E4M3, Threads>
+    : JoinFloat8<FloatType::kFloat8E4M3, Threads> {};
+
+template <int Threads>
+struct JoinFloatImpl<FloatType::kFloat8E5M2, Threads>
+    : JoinFloat8<FloatType::kFloat8E5M2, Threads> {};
+
+// Returns whether the GPU decoder handles the format and features of a float
+// archive of type FT, given whether a reference is provided for it. Sparse
+// and predicted archives are only decoded by the host codec at present, and a
+// delta archive requires a reference (and only it takes one). Archives with
+// block checksums are decoded through their inner archive (see
+// FloatBlockChecksumInProvider)
+template <FloatType FT>
+inline __device__ bool floatIsGpuDecodable(
+    const GpuFloatHeader& h,
+    bool hasRef) {
+  return h.isValidMagicAndVersion() && h.getFloatType() == FT &&
+      !h.getUseSparse() && h.getUseDelta() == hasRef &&
+      h.getPredictor() == FloatPredictor::kNone && !h.getUseBlockChecksum();
+}
+
+// Zero-filled, and thus without a valid magic number, so that the ANS decoder
+// reports it as a failure. The float ANS providers hand it to the ANS decoder
+// in place of the archives that the GPU cannot decode
+static __device__ ANSCoalescedHeader floatUndecodableArchive;
+
+// Returns the ANS archive within the float archive at p, or
+// floatUndecodableArchive if the GPU cannot decode the float archive
+template <FloatType FT>
+inline __device__ const uint8_t* getFloatANSArchive(
+    const uint8_t* p,
+    bool hasRef) {
+  // This is the first place that touches the header
+  GpuFloatHeader h = *((const GpuFloatHeader*)p);
+  if (!floatIsGpuDecodable<FT>(h, hasRef)) {
+    return (const uint8_t*)&floatUndecodableArchive;
+  }
+
+  // Increment the pointer to past the floating point data
+  return p + sizeof(GpuFloatHeader) +
+      FloatTypeInfo<FT>::getUncompDataSize(h.size);
+}
+
 template <
     typename InProviderComp,
     typename InProviderNonComp,
@@ -279,6 +410,8 @@ __global__ void joinFloat(
     InProviderComp inProviderComp,
     InProviderNonComp inProviderNonComp,
     OutProvider outProvider,
+    // Optional per-batch member reference, for delta archives
+    const void* const* __restrict__ ref,
     uint8_t* __restrict__ outSuccess,
     uint32_t* __restrict__ outSize) {
   using FTI = FloatTypeInfo<FT>;
@@ -292,6 +425,7 @@ __global__ void joinFloat(
   auto curHeaderIn =
       (const GpuFloatHeader*)inProviderNonComp.getBatchStart(batch);
   auto curOut = (WordT*)outProvider.getBatchStart(batch);
+  auto curRef = ref ? (const WordT*)ref[batch] : nullptr;
 
   // FIXME: test out capacity
 
@@ -302,52 +436,52 @@ __global__ void joinFloat(
 
   // Get size as a header
   GpuFloatHeader h = *curHeaderIn;
-  h.checkMagicAndVersion();
 
   auto curSize = h.size;
 
-  if (outSize && (curSize != outSize[batch])) {
-    // Reported size mismatch between ANS decompression and fp unpacking
-    assert(false);
+  // Archives that we cannot decode were failed by the ANS decoder, which is
+  // only seen here if success is reported. A size mismatch between ANS
+  // decompression and fp unpacking means the archive is corrupt
+  if (!floatIsGpuDecodable<FT>(h, curRef != nullptr) ||
+      (outSize && (curSize != outSize[batch]))) {
+    if (outSuccess && blockIdx.x == 0 && threadIdx.x == 0) {
+      outSuccess[batch] = false;
+    }
     return;
   }
 
   auto curNonCompIn = (const NonCompT*)(curHeaderIn + 1);
 
-  JoinFloatImpl<FT, Threads>::join(curCompIn, curNonCompIn, curSize, curOut);
+  JoinFloatImpl<FT, Threads>::join(
+      curCompIn, curNonCompIn, curRef, curSize, curOut);
 }
 
 template <FloatType FT, typename InProvider>
 struct FloatANSProvider {
   using FTI = FloatTypeInfo<FT>;
 
-  __host__ FloatANSProvider(InProvider& provider) : inProvider_(provider) {}
+  __host__ FloatANSProvider(
+      InProvider& provider,
+      const void* const* ref = nullptr)
+      : inProvider_(provider), ref_(ref) {}
 
   __device__ void* getBatchStart(uint32_t batch) {
-    uint8_t* p = (uint8_t*)inProvider_.getBatchStart(batch);
-
-    // This is the first place that touches the header
-    GpuFloatHeader h = *((GpuFloatHeader*)p);
-    h.checkMagicAndVersion();
-    assert(FT == h.getFloatType());
-
-    // Increment the pointer to past the floating point data
-    return p + sizeof(GpuFloatHeader) + FTI::getUncompDataSize(h.size);
+    return (void*)getFloatANSArchive<FT>(
+        (const uint8_t*)inProvider_.getBatchStart(batch), hasRef(batch));
   }
 
   __device__ const void* getBatchStart(uint32_t batch) const {
-    const uint8_t* p = (const uint8_t*)inProvider_.getBatchStart(batch);
-
-    // This is the first place that touches the header
-    GpuFloatHeader h = *((const GpuFloatHeader*)p);
-    h.checkMagicAndVersion();
-    assert(FT == h.getFloatType());
+    return getFloatANSArchive<FT>(
+        (const uint8_t*)inProvider_.getBatchStart(batch), hasRef(batch));
+  }
 
-    // Increment the pointer to past the floating point data
-    return p + sizeof(GpuFloatHeader) + FTI::getUncompDataSize(h.size);
+  __device__ bool hasRef(uint32_t batch) const {
+    return ref_ && ref_[batch];
   }
 
   InProvider inProvider_;
+  // Optional per-batch member reference, for delta archives
+  const void* const* ref_;
 };
 
 template <FloatType FT, int N>
@@ -362,53 +496,46 @@ struct FloatANSProviderInline {
   }
 
   __device__ void* getBatchStart(uint32_t batch) {
-    uint8_t* p = (uint8_t*)in_[batch];
-
-    // This is the first place that touches the header
-    GpuFloatHeader h = *((GpuFloatHeader*)p);
-    h.checkMagicAndVersion();
-    assert(FT == h.getFloatType());
-
-    // Increment the pointer to past the floating point data
-    return p + sizeof(GpuFloatHeader) + FTI::getUncompDataSize(h.size);
+    return (void*)getFloatANSArchive<FT>((const uint8_t*)in_[batch], false);
   }
 
   __device__ const void* getBatchStart(uint32_t batch) const {
-    const uint8_t* p = (const uint8_t*)in_[batch];
-
-    // This is the first place that touches the header
-    GpuFloatHeader h = *((const GpuFloatHeader*)p);
-    h.checkMagicAndVersion();
-    assert(FT == h.getFloatType());
-
-    // Increment the pointer to past the floating point data
-    return p + sizeof(GpuFloatHeader) + FTI::getUncompDataSize(h.size);
+    return getFloatANSArchive<FT>((const uint8_t*)in_[batch], false);
   }
 
   const void* in_[N];
 };
 
-template <FloatType FT, uint32_t BlockSize>
+template <FloatType FT>
 struct JoinFloatWriter {
   using FTI = FloatTypeInfo<FT>;
 
   __host__ __device__ JoinFloatWriter(
       uint32_t size,
       typename FTI::WordT* out,
-      const typename FTI::NonCompT* nonComp)
+      const typename FTI::NonCompT* nonComp,
+      const typename FTI::WordT* ref)
       : out_(out),
         nonComp_(nonComp),
+        ref_(ref),
         outBlock_(nullptr),
-        nonCompBlock_(nullptr) {}
+        nonCompBlock_(nullptr),
+        refBlock_(nullptr) {}
 
-  __host__ __device__ void setBlock(uint32_t block) {
-    outBlock_ = out_ + block * BlockSize;
-    nonCompBlock_ = nonComp_ + block * BlockSize;
+  __host__ __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    outBlock_ = out_ + block * blockSize;
+    nonCompBlock_ = nonComp_ + block * blockSize;
+    refBlock_ = ref_ ? ref_ + block * blockSize : nullptr;
   }
 
   __device__ void write(uint32_t offset, uint8_t sym) {
     auto nonComp = nonCompBlock_[offset];
-    outBlock_[offset] = FTI::join(sym, nonComp);
+    outBlock_[offset] = xorDelta(FTI::join(sym, nonComp), refBlock_, offset);
+  }
+
+  __device__ void writeAt(uint32_t pos, uint32_t offset, uint8_t sym) {
+    auto nonComp = nonCompBlock_[offset];
+    out_[pos] = xorDelta(FTI::join(sym, nonComp), refBlock_, offset);
   }
 
   // // The preload is an offset of a NonCompVec4
@@ -434,39 +561,53 @@ struct JoinFloatWriter {
   // typename FTI::NonCompVec4 preload_;
   typename FTI::WordT* out_;
   const typename FTI::NonCompT* nonComp_;
+  // Reference of a delta archive, or nullptr
+  const typename FTI::WordT* ref_;
   typename FTI::WordT* outBlock_;
   const typename FTI::NonCompT* nonCompBlock_;
+  const typename FTI::WordT* refBlock_;
 };
 
-template <uint32_t BlockSize>
-struct JoinFloatWriter<FloatType::kFloat32, BlockSize> {
+template <>
+struct JoinFloatWriter<FloatType::kFloat32> {
   static constexpr bool kVectorize = false;
   using FTI = FloatTypeInfo<FloatType::kFloat32>;
 
   __host__ __device__ JoinFloatWriter(
       uint32_t size,
       typename FTI::WordT* out,
-      const typename FTI::NonCompT* nonComp)
+      const typename FTI::NonCompT* nonComp,
+      const typename FTI::WordT* ref)
       : size_(size),
         out_(out),
         nonComp_(nonComp),
+        ref_(ref),
         outBlock_(nullptr),
+        refBlock_(nullptr),
         nonCompBlock2_(nullptr),
         nonCompBlock1_(nullptr) {}
 
-  __host__ __device__ void setBlock(uint32_t block) {
-    nonCompBlock2_ = (const uint16_t*)nonComp_ + block * BlockSize;
+  __host__ __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    nonCompBlock2_ = (const uint16_t*)nonComp_ + block * blockSize;
     nonCompBlock1_ =
         (const uint8_t*)((const uint16_t*)nonComp_ + roundUp(size_, 8U)) +
-        block * BlockSize;
-    outBlock_ = out_ + block * BlockSize;
+        block * blockSize;
+    outBlock_ = out_ + block * blockSize;
+    refBlock_ = ref_ ? ref_ + block * blockSize : nullptr;
   }
 
   __device__ void write(uint32_t offset, uint8_t sym) {
     uint32_t nc = uint32_t(nonCompBlock1_[offset]) * 65536U +
         uint32_t(nonCompBlock2_[offset]);
 
-    outBlock_[offset] = FTI::join(sym, nc);
+    outBlock_[offset] = xorDelta(FTI::join(sym, nc), refBlock_, offset);
+  }
+
+  __device__ void writeAt(uint32_t pos, uint32_t offset, uint8_t sym) {
+    uint32_t nc = uint32_t(nonCompBlock1_[offset]) * 65536U +
+        uint32_t(nonCompBlock2_[offset]);
+
+    out_[pos] = xorDelta(FTI::join(sym, nc), refBlock_, offset);
   }
 
   // // This implementation does not preload
@@ -480,22 +621,141 @@ struct JoinFloatWriter<FloatType::kFloat32, BlockSize> {
   uint32_t size_;
   typename FTI::WordT* out_;
   const typename FTI::NonCompT* nonComp_;
+  // Reference of a delta archive, or nullptr
+  const typename FTI::WordT* ref_;
   typename FTI::WordT* outBlock_;
+  const typename FTI::WordT* refBlock_;
   const uint16_t* nonCompBlock2_;
   const uint8_t* nonCompBlock1_;
 };
 
-template <
-    typename InProvider,
-    typename OutProvider,
-    FloatType FT,
-    uint32_t BlockSize>
+template <>
+struct JoinFloatWriter<FloatType::kFloat64> {
+  using FTI = FloatTypeInfo<FloatType::kFloat64>;
+
+  __host__ __device__ JoinFloatWriter(
+      uint32_t size,
+      typename FTI::WordT* out,
+      const typename FTI::NonCompT* nonComp,
+      const typename FTI::WordT* ref)
+      : size_(size),
+        out_(out),
+        nonComp_(nonComp),
+        ref_(ref),
+        outBlock_(nullptr),
+        refBlock_(nullptr),
+        nonCompBlock4_(nullptr),
+        nonCompBlock2_(nullptr),
+        nonCompBlock1_(nullptr) {}
+
+  __host__ __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    auto nonComp4 = (const uint32_t*)nonComp_;
+    auto nonComp2 = (const uint16_t*)(nonComp4 + roundUp(size_, 4U));
+    auto nonComp1 = (const uint8_t*)(nonComp2 + roundUp(size_, 8U));
+
+    nonCompBlock4_ = nonComp4 + block * blockSize;
+    nonCompBlock2_ = nonComp2 + block * blockSize;
+    nonCompBlock1_ = nonComp1 + block * blockSize;
+    outBlock_ = out_ + block * blockSize;
+    refBlock_ = ref_ ? ref_ + block * blockSize : nullptr;
+  }
+
+  __device__ uint64_t getNonComp(uint32_t offset) const {
+    return (uint64_t(nonCompBlock1_[offset]) << 48) |
+        (uint64_t(nonCompBlock2_[offset]) << 32) |
+        uint64_t(nonCompBlock4_[offset]);
+  }
+
+  __device__ void write(uint32_t offset, uint8_t sym) {
+    outBlock_[offset] =
+        xorDelta(FTI::join(sym, getNonComp(offset)), refBlock_, offset);
+  }
+
+  __device__ void writeAt(uint32_t pos, uint32_t offset, uint8_t sym) {
+    out_[pos] = xorDelta(FTI::join(sym, getNonComp(offset)), refBlock_, offset);
+  }
+
+  uint32_t size_;
+  typename FTI::WordT* out_;
+  const typename FTI::NonCompT* nonComp_;
+  // Reference of a delta archive, or nullptr
+  const typename FTI::WordT* ref_;
+  typename FTI::WordT* outBlock_;
+  const typename FTI::WordT* refBlock_;
+  const uint32_t* nonCompBlock4_;
+  const uint16_t* nonCompBlock2_;
+  const uint8_t* nonCompBlock1_;
+};
+
+// Writer for the bit packed float8 types, which may begin a block at any word
+template <FloatType FT>
+struct JoinFloat8Writer {
+  using FTI = FloatTypeInfo<FT>;
+
+  __host__ __device__ JoinFloat8Writer(
+      uint32_t size,
+      typename FTI::WordT* out,
+      const typename FTI::NonCompT* nonComp,
+      const typename FTI::WordT* ref)
+      : size_(size),
+        blockStart_(0),
+        out_(out),
+        nonComp_(nonComp),
+        ref_(ref),
+        outBlock_(nullptr),
+        refBlock_(nullptr) {}
+
+  __host__ __device__ void setBlock(uint32_t block, uint32_t blockSize) {
+    blockStart_ = block * blockSize;
+    outBlock_ = out_ + blockStart_;
+    refBlock_ = ref_ ? ref_ + blockStart_ : nullptr;
+  }
+
+  __device__ typename FTI::NonCompT getNonComp(uint32_t offset) const {
+    return FTI::read(nonComp_, size_, blockStart_ + offset);
+  }
+
+  __device__ void write(uint32_t offset, uint8_t sym) {
+    outBlock_[offset] =
+        xorDelta(FTI::join(sym, getNonComp(offset)), refBlock_, offset);
+  }
+
+  __device__ void writeAt(uint32_t pos, uint32_t offset, uint8_t sym) {
+    out_[pos] = xorDelta(FTI::join(sym, getNonComp(offset)), refBlock_, offset);
+  }
+
+  uint32_t size_;
+  uint32_t blockStart_;
+  typename FTI::WordT* out_;
+  const typename FTI::NonCompT* nonComp_;
+  // Reference of a delta archive, or nullptr
+  const typename FTI::WordT* ref_;
+  typename FTI::WordT* outBlock_;
+  const typename FTI::WordT* refBlock_;
+};
+
+template <>
+struct JoinFloatWriter<FloatType::kFloat8E4M3>
+    : JoinFloat8Writer<FloatType::kFloat8E4M3> {
+  using JoinFloat8Writer<FloatType::kFloat8E4M3>::JoinFloat8Writer;
+};
+
+template <>
+struct JoinFloatWriter<FloatType::kFloat8E5M2>
+    : JoinFloat8Writer<FloatType::kFloat8E5M2> {
+  using JoinFloat8Writer<FloatType::kFloat8E5M2>::JoinFloat8Writer;
+};
+
+template <typename InProvider, typename OutProvider, FloatType FT>
 struct FloatOutProvider {
-  using Writer = JoinFloatWriter<FT, BlockSize>;
+  using Writer = JoinFloatWriter<FT>;
   using FTI = FloatTypeInfo<FT>;
 
-  __host__ FloatOutProvider(InProvider& inProvider, OutProvider& outProvider)
-      : inProvider_(inProvider), outProvider_(outProvider) {}
+  __host__ FloatOutProvider(
+      InProvider& inProvider,
+      OutProvider& outProvider,
+      const void* const* ref = nullptr)
+      : inProvider_(inProvider), outProvider_(outProvider), ref_(ref) {}
 
   __device__ void* getBatchStart(uint32_t batch) {
     return inProvider_.getBatchStart(batch);
@@ -513,17 +773,20 @@ struct FloatOutProvider {
         h->size,
         (typename FTI::WordT*)outProvider_.getBatchStart(batch),
         // advance past the header
-        (const typename FTI::NonCompT*)(h + 1));
+        (const typename FTI::NonCompT*)(h + 1),
+        ref_ ? (const typename FTI::WordT*)ref_[batch] : nullptr);
   }
 
   InProvider inProvider_;
   OutProvider outProvider_;
+  // Optional per-batch member reference, for delta archives
+  const void* const* ref_;
 };
 
-template <int N, FloatType FT, uint32_t BlockSize>
+template <int N, FloatType FT>
 struct FloatOutProviderInline {
   using FTI = FloatTypeInfo<FT>;
-  using Writer = JoinFloatWriter<FT, BlockSize>;
+  using Writer = JoinFloatWriter<FT>;
 
   __host__ FloatOutProviderInline(
       int num,
@@ -554,7 +817,8 @@ struct FloatOutProviderInline {
         h->size,
         (typename FTI::WordT*)out_[batch],
         // advance past the header
-        (const typename FTI::NonCompT*)(h + 1));
+        (const typename FTI::NonCompT*)(h + 1),
+        nullptr);
   }
 
   const void* in_[N];
@@ -562,8 +826,81 @@ struct FloatOutProviderInline {
   uint32_t outCapacity_[N];
 };
 
+// Provides the ordinary float archive within each batch member: the inner
+// archive of an archive with block checksums (see
+// GpuFloatHeader::getUseBlockChecksum), or else the archive itself. Also
+// provides the block checksums for verifyBlockChecksumBatch
+template <typename InProvider>
+struct FloatBlockChecksumInProvider {
+  __host__ FloatBlockChecksumInProvider(
+      InProvider& inProvider,
+      FloatType floatType,
+      uint32_t wordSize)
+      : inProvider_(inProvider), floatType_(floatType), wordSize_(wordSize) {}
+
+  __device__ const GpuFloatHeader* getHeader(uint32_t batch) const {
+    return (const GpuFloatHeader*)inProvider_.getBatchStart(batch);
+  }
+
+  // An archive of another float type is left as is, for the decoder to
+  // report as a failure
+  __device__ bool hasBlockChecksum(uint32_t batch) const {
+    auto h = getHeader(batch);
+
+    return h->isValidMagicAndVersion() && h->getFloatType() == floatType_ &&
+        h->getUseBlockChecksum();
+  }
+
+  __device__ uint32_t getBytes(uint32_t batch) const {
+    return getHeader(batch)->size * wordSize_;
+  }
+
+  __device__ uint32_t* getBlockChecksums(uint32_t batch) const {
+    return hasBlockChecksum(batch) ? (uint32_t*)(getHeader(batch) + 1)
+                                   : nullptr;
+  }
+
+  __device__ const void* getBatchStart(uint32_t batch) const {
+    auto h = getHeader(batch);
+    if (!hasBlockChecksum(batch)) {
+      return h;
+    }
+
+    return (const uint8_t*)(h + 1) + getBlockChecksumSize(getBytes(batch));
+  }
+
+  __device__ void* getBatchStart(uint32_t batch) {
+    return const_cast<void*>(
+        static_cast<const FloatBlockChecksumInProvider*>(this)->getBatchStart(
+            batch));
+  }
+
+  InProvider inProvider_;
+  FloatType floatType_;
+  uint32_t wordSize_;
+};
+
+// The block checksums of the archives of floatDecompressDevice that hold
+// them, for verifyBlockChecksumBatch; only those of the archives that were
+// decoded are verified
+template <typename InProvider>
+struct FloatBlockChecksumIn {
+  __device__ uint32_t* getBlockChecksums(uint32_t batch) {
+    return success[batch] ? inProvider.getBlockChecksums(batch) : nullptr;
+  }
+
+  __device__ uint32_t getBytes(uint32_t batch) {
+    return inProvider.getBytes(batch);
+  }
+
+  FloatBlockChecksumInProvider<InProvider> inProvider;
+  const uint8_t* success;
+};
+
+// Decodes a batch of ordinary float archives, as provided by
+// FloatBlockChecksumInProvider
 template <typename InProvider, typename OutProvider>
-FloatDecompressStatus floatDecompressDevice(
+FloatDecompressStatus floatDecompressArchiveDevice(
     StackDeviceMemory& res,
     const FloatDecompressConfig& config,
     uint32_t numInBatch,
@@ -572,7 +909,8 @@ FloatDecompressStatus floatDecompressDevice(
     uint32_t maxCapacity,
     uint8_t* outSuccess_dev,
     uint32_t* outSize_dev,
-    cudaStream_t stream) {
+    cudaStream_t stream,
+    const void* const* ref_dev) {
   // not allowed in float mode
   assert(!config.ansConfig.useChecksum);
 
@@ -583,22 +921,22 @@ FloatDecompressStatus floatDecompressDevice(
     // Fused kernel: perform decompression in a single pass
     //
 
-#define RUN_FUSED(FT)                                                     \
-  do {                                                                    \
-    auto inProviderANS = FloatANSProvider<FT, InProvider>(inProvider);    \
-    auto outProviderANS =                                                 \
-        FloatOutProvider<InProvider, OutProvider, FT, kDefaultBlockSize>( \
-            inProvider, outProvider);                                     \
-                                                                          \
-    ansDecodeBatch(                                                       \
-        res,                                                              \
-        config.ansConfig,                                                 \
-        numInBatch,                                                       \
-        inProviderANS,                                                    \
-        outProviderANS,                                                   \
-        outSuccess_dev,                                                   \
-        outSize_dev,                                                      \
-        stream);                                                          \
+#define RUN_FUSED(FT)                                                    \
+  do {                                                                   \
+    auto inProviderANS =                                                 \
+        FloatANSProvider<FT, InProvider>(inProvider, ref_dev);           \
+    auto outProviderANS = FloatOutProvider<InProvider, OutProvider, FT>( \
+        inProvider, outProvider, ref_dev);                               \
+                                                                         \
+    ansDecodeBatch(                                                      \
+        res,                                                             \
+        config.ansConfig,                                                \
+        numInBatch,                                                      \
+        inProviderANS,                                                   \
+        outProviderANS,                                                  \
+        outSuccess_dev,                                                  \
+        outSize_dev,                                                     \
+        stream);                                                         \
   } while (false)
 
     switch (config.floatType) {
@@ -611,6 +949,15 @@ FloatDecompressStatus floatDecompressDevice(
       case FloatType::kFloat32:
         RUN_FUSED(FloatType::kFloat32);
         break;
+      case FloatType::kFloat64:
+        RUN_FUSED(FloatType::kFloat64);
+        break;
+      case FloatType::kFloat8E4M3:
+        RUN_FUSED(FloatType::kFloat8E4M3);
+        break;
+      case FloatType::kFloat8E5M2:
+        RUN_FUSED(FloatType::kFloat8E5M2);
+        break;
       default:
         CHECK(false);
         break;
@@ -635,7 +982,7 @@ FloatDecompressStatus floatDecompressDevice(
 #define RUN_DECODE(FT)                                                    \
   do {                                                                    \
     using InProviderANS = FloatANSProvider<FT, InProvider>;               \
-    auto inProviderANS = InProviderANS(inProvider);                       \
+    auto inProviderANS = InProviderANS(inProvider, ref_dev);              \
                                                                           \
     using OutProviderANS = BatchProviderStride;                           \
     auto outProviderANS = OutProviderANS(                                 \
@@ -671,6 +1018,7 @@ FloatDecompressStatus floatDecompressDevice(
             outProviderANS,                                               \
             inProvider,                                                   \
             outProvider,                                                  \
+            ref_dev,                                                      \
             outSuccess_dev,                                               \
             outSize_dev);                                                 \
   } while (false)
@@ -685,6 +1033,15 @@ FloatDecompressStatus floatDecompressDevice(
       case FloatType::kFloat32:
         RUN_DECODE(FloatType::kFloat32);
         break;
+      case FloatType::kFloat64:
+        RUN_DECODE(FloatType::kFloat64);
+        break;
+      case FloatType::kFloat8E4M3:
+        RUN_DECODE(FloatType::kFloat8E4M3);
+        break;
+      case FloatType::kFloat8E5M2:
+        RUN_DECODE(FloatType::kFloat8E5M2);
+        break;
       default:
         CHECK(false);
         break;
@@ -701,8 +1058,10 @@ FloatDecompressStatus floatDecompressDevice(
     auto sizes_dev = res.alloc<uint32_t>(stream, numInBatch);
     auto archiveChecksum_dev = res.alloc<uint32_t>(stream, numInBatch);
 
-    // Checksum the output data
-    checksumBatch(numInBatch, outProvider, checksum_dev.data(), stream);
+    // Checksum the output data; that of a delta archive covers its XOR with
+    // the reference
+    checksumBatch(
+        numInBatch, outProvider, checksum_dev.data(), stream, ref_dev);
 
     // Get prior checksum from the float headers
     floatGetCompressedInfo(
@@ -737,4 +1096,93 @@ FloatDecompressStatus floatDecompressDevice(
   return status;
 }
 
+template <typename InProvider, typename OutProvider>
+FloatDecompressStatus floatDecompressDevice(
+    StackDeviceMemory& res,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    InProvider& inProvider,
+    OutProvider& outProvider,
+    uint32_t maxCapacity,
+    uint8_t* outSuccess_dev,
+    uint32_t* outSize_dev,
+    cudaStream_t stream,
+    // Optional device array of numInBatch device pointers to the reference of
+    // each delta archive, or nullptr for the other archives
+    const void* const* ref_dev = nullptr) {
+  uint32_t wordSize = getWordSizeFromFloatType(config.floatType);
+
+  // Verifying block checksums needs the status of each batch member, which we
+  // hold in temporary memory if the caller does not want it
+  bool verifyBlockChecksum = config.useBlockChecksum;
+
+  auto tempSuccess_dev = res.alloc<uint8_t>(
+      stream, verifyBlockChecksum && !outSuccess_dev ? numInBatch : 0);
+  auto tempSize_dev = res.alloc<uint32_t>(
+      stream, verifyBlockChecksum && !outSize_dev ? numInBatch : 0);
+
+  if (verifyBlockChecksum) {
+    outSuccess_dev = outSuccess_dev ? outSuccess_dev : tempSuccess_dev.data();
+    outSize_dev = outSize_dev ? outSize_dev : tempSize_dev.data();
+  }
+
+  auto archiveProvider = FloatBlockChecksumInProvider<InProvider>(
+      inProvider, config.floatType, wordSize);
+
+  auto status = floatDecompressArchiveDevice(
+      res,
+      config,
+      numInBatch,
+      archiveProvider,
+      outProvider,
+      maxCapacity,
+      outSuccess_dev,
+      outSize_dev,
+      stream,
+      ref_dev);
+
+  // Verify the block checksums of the decoded archives that hold them
+  // (optional), which cover the words as given
+  if (verifyBlockChecksum) {
+    auto success = std::vector<uint8_t>(numInBatch);
+    auto sizes = std::vector<uint32_t>(numInBatch);
+
+    CUDA_VERIFY(cudaMemcpyAsync(
+        success.data(),
+        outSuccess_dev,
+        sizeof(uint8_t) * numInBatch,
+        cudaMemcpyDeviceToHost,
+        stream));
+    CUDA_VERIFY(cudaMemcpyAsync(
+        sizes.data(),
+        outSize_dev,
+        sizeof(uint32_t) * numInBatch,
+        cudaMemcpyDeviceToHost,
+        stream));
+    CUDA_VERIFY(cudaStreamSynchronize(stream));
+
+    // The size of a member that failed to decode may be anything
+    uint32_t maxSize = 0;
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      if (success[i]) {
+        maxSize = std::max(maxSize, sizes[i]);
+      }
+    }
+
+    if (!verifyBlockChecksumBatch(
+            res,
+            numInBatch,
+            outProvider,
+            FloatBlockChecksumIn<InProvider>{archiveProvider, outSuccess_dev},
+            maxSize * wordSize,
+            status.failedBlocks,
+            status.errorInfo,
+            stream)) {
+      status.error = FloatDecompressError::ChecksumMismatch;
+    }
+  }
+
+  return status;
+}
+
 } // namespace dietgpu
@@ -0,0 +1,230 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/utils/DeviceUtils.h"
+#include "dietgpu/utils/StackDeviceMemory.h"
+#include "dietgpu/utils/StaticUtils.h"
+
+#include <glog/logging.h>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Moves the per-member results of the sub-batches, which are produced in
+// group order, to their members' positions in the batch
+template <typename T>
+__global__ void scatterBatchKernel(
+    const T* __restrict__ in,
+    const uint32_t* __restrict__ member,
+    uint32_t numInBatch,
+    T* __restrict__ out) {
+  uint32_t i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < numInBatch) {
+    out[member[i]] = in[i];
+  }
+}
+
+// The batch index of each member, in group order
+std::vector<uint32_t> getGroupOrder(
+    const std::vector<FloatTypeBatchGroup>& groups) {
+  auto order = std::vector<uint32_t>();
+
+  for (auto& g : groups) {
+    order.insert(order.end(), g.members.begin(), g.members.end());
+  }
+
+  return order;
+}
+
+template <typename T>
+void scatterBatch(
+    StackDeviceMemory& res,
+    const std::vector<uint32_t>& order,
+    const T* in_dev,
+    T* out_dev,
+    cudaStream_t stream) {
+  uint32_t numInBatch = order.size();
+  auto order_dev = res.copyAlloc(stream, order);
+
+  scatterBatchKernel<<<divUp(numInBatch, 128), 128, 0, stream>>>(
+      in_dev, order_dev.data(), numInBatch, out_dev);
+
+  CUDA_TEST_ERROR();
+}
+
+} // namespace
+
+void floatCompressMixed(
+    StackDeviceMemory& res,
+    const FloatCompressConfig& config,
+    uint32_t numInBatch,
+    const FloatType* floatTypes,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize_dev,
+    cudaStream_t stream) {
+  auto groups = groupFloatBatchByType(numInBatch, floatTypes);
+
+  // A batch of a single type needs no regrouping
+  if (groups.size() <= 1) {
+    auto groupConfig = config;
+    groupConfig.floatType =
+        groups.empty() ? config.floatType : groups.front().floatType;
+
+    floatCompress(
+        res,
+        groupConfig,
+        numInBatch,
+        in,
+        inSize,
+        out,
+        outSize_dev,
+        stream);
+    return;
+  }
+
+  // The sub-batches write their sizes in group order
+  auto groupOutSize_dev = res.alloc<uint32_t>(stream, numInBatch);
+  uint32_t start = 0;
+
+  for (auto& g : groups) {
+    uint32_t num = g.members.size();
+    auto groupIn = std::vector<const void*>(num);
+    auto groupInSize = std::vector<uint32_t>(num);
+    auto groupOut = std::vector<void*>(num);
+
+    for (uint32_t i = 0; i < num; ++i) {
+      groupIn[i] = in[g.members[i]];
+      groupInSize[i] = inSize[g.members[i]];
+      groupOut[i] = out[g.members[i]];
+    }
+
+    auto groupConfig = config;
+    groupConfig.floatType = g.floatType;
+
+    floatCompress(
+        res,
+        groupConfig,
+        num,
+        groupIn.data(),
+        groupInSize.data(),
+        groupOut.data(),
+        groupOutSize_dev.data() + start,
+        stream);
+
+    start += num;
+  }
+
+  if (outSize_dev) {
+    scatterBatch(
+        res,
+        getGroupOrder(groups),
+        groupOutSize_dev.data(),
+        outSize_dev,
+        stream);
+  }
+}
+
+FloatDecompressStatus floatDecompressMixed(
+    StackDeviceMemory& res,
+    const FloatDecompressConfig& config,
+    uint32_t numInBatch,
+    const FloatType* floatTypes,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess_dev,
+    uint32_t* outSize_dev,
+    cudaStream_t stream) {
+  auto groups = groupFloatBatchByType(numInBatch, floatTypes);
+
+  // A batch of a single type needs no regrouping
+  if (groups.size() <= 1) {
+    auto groupConfig = config;
+    groupConfig.floatType =
+        groups.empty() ? config.floatType : groups.front().floatType;
+
+    return floatDecompress(
+        res,
+        groupConfig,
+        numInBatch,
+        in,
+        out,
+        outCapacity,
+        outSuccess_dev,
+        outSize_dev,
+        stream);
+  }
+
+  // The sub-batches write their status in group order
+  auto groupOutSuccess_dev = res.alloc<uint8_t>(stream, numInBatch);
+  auto groupOutSize_dev = res.alloc<uint32_t>(stream, numInBatch);
+  auto status = FloatDecompressStatus();
+  uint32_t start = 0;
+
+  for (auto& g : groups) {
+    uint32_t num = g.members.size();
+    auto groupIn = std::vector<const void*>(num);
+    auto groupOut = std::vector<void*>(num);
+    auto groupOutCapacity = std::vector<uint32_t>(num);
+
+    for (uint32_t i = 0; i < num; ++i) {
+      groupIn[i] = in[g.members[i]];
+      groupOut[i] = out[g.members[i]];
+      groupOutCapacity[i] = outCapacity[g.members[i]];
+    }
+
+    auto groupConfig = config;
+    groupConfig.floatType = g.floatType;
+
+    auto groupStatus = floatDecompress(
+        res,
+        groupConfig,
+        num,
+        groupIn.data(),
+        groupOut.data(),
+        groupOutCapacity.data(),
+        groupOutSuccess_dev.data() + start,
+        groupOutSize_dev.data() + start,
+        stream);
+
+    if (groupStatus.error != FloatDecompressError::None) {
+      status.error = groupStatus.error;
+    }
+
+    for (auto& info : groupStatus.errorInfo) {
+      status.errorInfo.push_back(
+          std::make_pair(g.members[info.first], std::move(info.second)));
+    }
+
+    for (auto& failed : groupStatus.failedBlocks) {
+      status.failedBlocks.push_back(
+          std::make_pair(g.members[failed.first], std::move(failed.second)));
+    }
+
+    start += num;
+  }
+
+  auto order = getGroupOrder(groups);
+
+  if (outSuccess_dev) {
+    scatterBatch(
+        res, order, groupOutSuccess_dev.data(), outSuccess_dev, stream);
+  }
+
+  if (outSize_dev) {
+    scatterBatch(res, order, groupOutSize_dev.data(), outSize_dev, stream);
+  }
+
+  return status;
+}
+
+} // namespace dietgpu
@@ -8,9 +8,12 @@
 #pragma once
 
 #include "dietgpu/utils/DeviceDefs.cuh"
-#include "dietgpu/utils/PtxUtils.cuh"
 #include "dietgpu/utils/StaticUtils.h"
 
+#ifdef __CUDACC__
+#include "dietgpu/utils/PtxUtils.cuh"
+#endif
+
 #include <cuda.h>
 #include <glog/logging.h>
 
@@ -19,18 +22,55 @@ namespace dietgpu {
 // magic number to verify archive integrity
 constexpr uint32_t kFloatMagic = 0xf00f;
 
-// current DietGPU version number
-constexpr uint32_t kFloatVersion = 0x0001;
+// current DietGPU version number. Archives are written with the oldest version
+// that can represent them (see GpuFloatHeader::getRequiredVersion): sparse
+// archives require version 2, the float8 types version 3, deltas version 4,
+// predictors version 5 and block checksums version 6
+constexpr uint32_t kFloatVersion = 0x0006;
+
+// oldest version that we can decode
+constexpr uint32_t kFloatMinVersion = 0x0001;
 
 // Header on our compressed floating point data
 struct __align__(16) GpuFloatHeader {
+  // The oldest version able to represent an archive with our options
+  __host__ __device__ uint32_t getRequiredVersion() const {
+    // block checksums were introduced in version 6, predictors in version 5,
+    // deltas in version 4, the float8 types in version 3, and sparse archives
+    // in version 2
+    if (getUseBlockChecksum()) {
+      return 6;
+    } else if (getPredictor() != FloatPredictor::kNone) {
+      return 5;
+    } else if (getUseDelta()) {
+      return 4;
+    } else if (getFloatType() == FloatType::kFloat8E4M3 ||
+        getFloatType() == FloatType::kFloat8E5M2) {
+      return 3;
+    } else if (getUseSparse()) {
+      return 2;
+    }
+
+    return kFloatMinVersion;
+  }
+
+  // Archives are written with the oldest version able to represent them, so
+  // this must be called after all options are set
   __host__ __device__ void setMagicAndVersion() {
-    magicAndVersion = (kFloatMagic << 16) | kFloatVersion;
+    magicAndVersion = (kFloatMagic << 16) | getRequiredVersion();
+  }
+
+  __host__ __device__ uint32_t getVersion() const {
+    return magicAndVersion & 0xffffU;
+  }
+
+  __host__ __device__ bool isValidMagicAndVersion() const {
+    return (magicAndVersion >> 16) == kFloatMagic &&
+        getVersion() >= getRequiredVersion() && getVersion() <= kFloatVersion;
   }
 
   __host__ __device__ void checkMagicAndVersion() const {
-    assert((magicAndVersion >> 16) == kFloatMagic);
-    assert((magicAndVersion & 0xffffU) == kFloatVersion);
+    assert(isValidMagicAndVersion());
   }
 
   __host__ __device__ FloatType getFloatType() const {
@@ -50,6 +90,55 @@ struct __align__(16) GpuFloatHeader {
     options = (options & 0xffffffef) | (uint32_t(uc) << 4);
   }
 
+  // In a sparse archive, the header is followed by a bitmap with a bit set for
+  // each word that is not zero (see getFloatSparseBitmapSize), then by an
+  // ordinary (dense) float archive of the non-zero words alone
+  __host__ __device__ bool getUseSparse() const {
+    return options & 0x20;
+  }
+
+  __host__ __device__ void setUseSparse(bool us) {
+    options = (options & 0xffffffdf) | (uint32_t(us) << 5);
+  }
+
+  // The data was XORed with a reference of the same size before compression
+  // (see floatCompressCpu), and must be XORed with it again on decompression.
+  // In a sparse archive, only the outer header holds this flag
+  __host__ __device__ bool getUseDelta() const {
+    return options & 0x40;
+  }
+
+  __host__ __device__ void setUseDelta(bool ud) {
+    options = (options & 0xffffffbf) | (uint32_t(ud) << 6);
+  }
+
+  // In a predicted archive, the header is followed by a FloatGridHeader, then
+  // by an ordinary float archive (which may be sparse) of the residuals of
+  // the words from their predictions. In an archive that is also a delta,
+  // only the outer header holds the delta flag, and the prediction is of the
+  // XOR with the reference
+  __host__ __device__ FloatPredictor getPredictor() const {
+    return FloatPredictor((options >> 7) & 0x3);
+  }
+
+  __host__ __device__ void setPredictor(FloatPredictor fp) {
+    assert(uint32_t(fp) <= 0x3);
+    options = (options & 0xfffffe7f) | (uint32_t(fp) << 7);
+  }
+
+  // The header is followed by the block checksums of the words (see
+  // FloatCodecConfig::useBlockChecksum), of
+  // getBlockChecksumSize(size * word size) bytes, then by an ordinary float
+  // archive of the words. The inner archive holds any delta flag and
+  // predictor
+  __host__ __device__ bool getUseBlockChecksum() const {
+    return options & 0x200;
+  }
+
+  __host__ __device__ void setUseBlockChecksum(bool ub) {
+    options = (options & 0xfffffdff) | (uint32_t(ub) << 9);
+  }
+
   __host__ __device__ uint32_t getChecksum() const {
     return checksum;
   }
@@ -64,7 +153,8 @@ struct __align__(16) GpuFloatHeader {
   // Number of floating point words of the given float type in the archive
   uint32_t size;
 
-  // (27: unused)(1: use checksum)(4: float type)
+  // (22: unused)(1: block checksum)(2: predictor)(1: delta)(1: sparse)
+  // (1: use checksum)(4: float type)
   uint32_t options;
 
   // Optional checksum computed on the input data
@@ -73,6 +163,53 @@ struct __align__(16) GpuFloatHeader {
 
 static_assert(sizeof(GpuFloatHeader) == 16, "");
 
+// The grid of a predicted archive (see FloatCodecConfig::gridDims), which
+// follows its GpuFloatHeader
+struct __align__(16) FloatGridHeader {
+  uint32_t gridDims[2];
+  uint32_t unused[2];
+};
+
+static_assert(sizeof(FloatGridHeader) == 16, "");
+
+// Size in bytes of the zero bitmap of a sparse archive of `size` words. Word i
+// is non-zero if bit (i % 32) of 32 bit word (i / 32) of the bitmap is set;
+// the bitmap is padded to a multiple of 16 bytes to keep the following dense
+// archive aligned
+inline __host__ __device__ uint32_t getFloatSparseBitmapSize(uint32_t size) {
+  return roundUp(divUp(size, 32U) * sizeof(uint32_t), 16U);
+}
+
+// Bit rotations usable from both host and device code (the split/join
+// functions below are shared with the CPU float codec)
+inline __host__ __device__ uint32_t
+floatRotateLeft(uint32_t v, uint32_t shift) {
+#ifdef __CUDA_ARCH__
+  return rotateLeft(v, shift);
+#else
+  return (v << shift) | (v >> (32 - shift));
+#endif
+}
+
+inline __host__ __device__ uint32_t
+floatRotateRight(uint32_t v, uint32_t shift) {
+#ifdef __CUDA_ARCH__
+  return rotateRight(v, shift);
+#else
+  return (v >> shift) | (v << (32 - shift));
+#endif
+}
+
+inline __host__ __device__ uint64_t
+floatRotateLeft(uint64_t v, uint32_t shift) {
+  return (v << shift) | (v >> (64 - shift));
+}
+
+inline __host__ __device__ uint64_t
+floatRotateRight(uint64_t v, uint32_t shift) {
+  return (v >> shift) | (v << (64 - shift));
+}
+
 struct __align__(16) uint32x4 {
   uint32_t x[4];
 };
@@ -93,6 +230,30 @@ struct __align__(4) uint8x4 {
   uint8_t x[4];
 };
 
+// Returns w, the word at index i of some data, XORed with word i of the
+// reference in delta mode (ref != nullptr)
+template <typename T>
+inline __device__ T xorDelta(T w, const T* ref, uint32_t i) {
+  return ref ? T(w ^ ref[i]) : w;
+}
+
+// As xorDelta, for one of the vector types above
+template <typename VecT>
+inline __device__ VecT xorDeltaVec(VecT v, const VecT* ref, uint32_t i) {
+  constexpr int kWords = sizeof(v.x) / sizeof(v.x[0]);
+
+  if (ref) {
+    VecT r = ref[i];
+
+#pragma unroll
+    for (int j = 0; j < kWords; ++j) {
+      v.x[j] ^= r.x[j];
+    }
+  }
+
+  return v;
+}
+
 // Convert FloatType to word size/type
 template <FloatType FT>
 struct FloatTypeInfo;
@@ -108,13 +269,14 @@ struct FloatTypeInfo<FloatType::kFloat16> {
   using CompVecT = uint8x8;
   using NonCompVecT = uint8x8;
 
-  static __device__ void split(WordT in, CompT& comp, NonCompT& nonComp) {
+  static __host__ __device__ void
+  split(WordT in, CompT& comp, NonCompT& nonComp) {
     // don't bother extracting the specific exponent
     comp = in >> 8;
     nonComp = in & 0xff;
   }
 
-  static __device__ WordT join(CompT comp, NonCompT nonComp) {
+  static __host__ __device__ WordT join(CompT comp, NonCompT nonComp) {
     return WordT(comp) * WordT(256) + WordT(nonComp);
   }
 
@@ -138,23 +300,28 @@ struct FloatTypeInfo<FloatType::kBFloat16> {
   using CompVecT = uint8x8;
   using NonCompVecT = uint8x8;
 
-  static __device__ void split(WordT in, CompT& comp, NonCompT& nonComp) {
+  static __host__ __device__ void
+  split(WordT in, CompT& comp, NonCompT& nonComp) {
     uint32_t v = uint32_t(in) * 65536U + uint32_t(in);
 
-    v = rotateLeft(v, 1);
+    v = floatRotateLeft(v, 1);
     comp = v >> 24;
     nonComp = v & 0xff;
   }
 
-  static __device__ WordT join(CompT comp, NonCompT nonComp) {
+  static __host__ __device__ WordT join(CompT comp, NonCompT nonComp) {
     uint32_t lo = uint32_t(comp) * 256U + uint32_t(nonComp);
     lo <<= 16;
     uint32_t hi = nonComp;
 
     uint32_t out;
+#ifdef __CUDA_ARCH__
     asm("shf.r.clamp.b32 %0, %1, %2, %3;"
         : "=r"(out)
         : "r"(lo), "r"(hi), "r"(1));
+#else
+    out = (lo >> 1) | (hi << 31);
+#endif
     return out >>= 16;
   }
 
@@ -178,15 +345,16 @@ struct FloatTypeInfo<FloatType::kFloat32> {
   using CompVecT = uint8x4;
   using NonCompVecT = uint32x4;
 
-  static __device__ void split(WordT in, CompT& comp, NonCompT& nonComp) {
-    auto v = rotateLeft(in, 1);
+  static __host__ __device__ void
+  split(WordT in, CompT& comp, NonCompT& nonComp) {
+    auto v = floatRotateLeft(in, 1);
     comp = v >> 24;
     nonComp = v & 0xffffffU;
   }
 
-  static __device__ WordT join(CompT comp, NonCompT nonComp) {
+  static __host__ __device__ WordT join(CompT comp, NonCompT nonComp) {
     uint32_t v = (uint32_t(comp) * 16777216U) + uint32_t(nonComp);
-    return rotateRight(v, 1);
+    return floatRotateRight(v, 1);
   }
 
   // How many bytes of data are in the non-compressed portion past the float
@@ -203,13 +371,164 @@ struct FloatTypeInfo<FloatType::kFloat32> {
   }
 };
 
+template <>
+struct FloatTypeInfo<FloatType::kFloat64> {
+  using WordT = uint64_t;
+  using CompT = uint8_t;
+  using NonCompT = uint64_t;
+
+  static __host__ __device__ void
+  split(WordT in, CompT& comp, NonCompT& nonComp) {
+    // With the sign rotated to the bottom, the compressed symbol is the high 8
+    // bits of the 11 bit exponent. These are nearly constant for typical data,
+    // while the low 3 bits of the exponent are closer to random and are left
+    // in the non-compressed portion with the significand
+    auto v = floatRotateLeft(in, 1);
+    comp = v >> 56;
+    nonComp = v & 0xffffffffffffffULL;
+  }
+
+  static __host__ __device__ WordT join(CompT comp, NonCompT nonComp) {
+    uint64_t v = (uint64_t(comp) << 56) | nonComp;
+    return floatRotateRight(v, 1);
+  }
+
+  // How many bytes of data are in the non-compressed portion past the float
+  // header?
+  static __host__ __device__ uint32_t getUncompDataSize(uint32_t size) {
+    // The size of the uncompressed data is always a multiple of 16 bytes, to
+    // guarantee alignment for proceeding data segments
+    // We store the low order 4 bytes first, then the next 2 bytes, then the
+    // high order uncompressed byte, each section 16 byte aligned
+    return 4 * roundUp(size, 4) + // low order 4 bytes
+        2 * roundUp(size, 8) + // middle 2 bytes
+        roundUp(size, 16); // high order 1 byte
+  }
+};
+
+// The float8 types split each word at its field boundaries: the compressed
+// symbol is the sign and the exponent, and the significand is stored
+// uncompressed, bit packed into planes of whole bytes. A plane of the low 2
+// bits of the significand of each word, 4 words to a byte, is followed for
+// e4m3 by a plane of its high bit, 8 words to a byte; each plane is 16 byte
+// aligned. Words are packed in groups of 8, so that a group fills whole bytes
+// of each plane
+constexpr uint32_t kFloat8GroupSize = 8;
+
+template <>
+struct FloatTypeInfo<FloatType::kFloat8E4M3> {
+  using WordT = uint8_t;
+  using CompT = uint8_t;
+  using NonCompT = uint8_t;
+
+  static __host__ __device__ void
+  split(WordT in, CompT& comp, NonCompT& nonComp) {
+    comp = in >> 3;
+    nonComp = in & 0x7;
+  }
+
+  static __host__ __device__ WordT join(CompT comp, NonCompT nonComp) {
+    return (comp << 3) | nonComp;
+  }
+
+  // Packs the significands of the words [8 * group, 8 * group + 8) into the
+  // non-compressed portion of an array of `size` words
+  static __host__ __device__ void writeGroup(
+      uint8_t* base,
+      uint32_t size,
+      uint32_t group,
+      const NonCompT* nonComp) {
+    uint32_t low = 0;
+    uint32_t high = 0;
+
+    for (uint32_t i = 0; i < kFloat8GroupSize; ++i) {
+      low |= uint32_t(nonComp[i] & 0x3) << (2 * i);
+      high |= uint32_t(nonComp[i] >> 2) << i;
+    }
+
+    base[2 * group] = low & 0xff;
+    base[2 * group + 1] = low >> 8;
+    base[roundUp(divUp(size, 4U), 16U) + group] = high;
+  }
+
+  // Returns the significand of word i of an array of `size` words
+  static __host__ __device__ NonCompT
+  read(const uint8_t* base, uint32_t size, uint32_t i) {
+    auto highBase = base + roundUp(divUp(size, 4U), 16U);
+    uint32_t low = (base[i / 4] >> (2 * (i % 4))) & 0x3;
+    uint32_t high = (highBase[i / 8] >> (i % 8)) & 0x1;
+
+    return low | (high << 2);
+  }
+
+  // How many bytes of data are in the non-compressed portion past the float
+  // header?
+  static __host__ __device__ uint32_t getUncompDataSize(uint32_t size) {
+    // Both planes are 16 byte aligned
+    return roundUp(divUp(size, 4U), 16U) + // low 2 bits, 4 words to a byte
+        roundUp(divUp(size, 8U), 16U); // high bit, 8 words to a byte
+  }
+};
+
+template <>
+struct FloatTypeInfo<FloatType::kFloat8E5M2> {
+  using WordT = uint8_t;
+  using CompT = uint8_t;
+  using NonCompT = uint8_t;
+
+  static __host__ __device__ void
+  split(WordT in, CompT& comp, NonCompT& nonComp) {
+    comp = in >> 2;
+    nonComp = in & 0x3;
+  }
+
+  static __host__ __device__ WordT join(CompT comp, NonCompT nonComp) {
+    return (comp << 2) | nonComp;
+  }
+
+  // Packs the significands of the words [8 * group, 8 * group + 8) into the
+  // non-compressed portion of an array of `size` words
+  static __host__ __device__ void writeGroup(
+      uint8_t* base,
+      uint32_t size,
+      uint32_t group,
+      const NonCompT* nonComp) {
+    uint32_t low = 0;
+
+    for (uint32_t i = 0; i < kFloat8GroupSize; ++i) {
+      low |= uint32_t(nonComp[i]) << (2 * i);
+    }
+
+    base[2 * group] = low & 0xff;
+    base[2 * group + 1] = low >> 8;
+  }
+
+  // Returns the significand of word i of an array of `size` words
+  static __host__ __device__ NonCompT
+  read(const uint8_t* base, uint32_t size, uint32_t i) {
+    return (base[i / 4] >> (2 * (i % 4))) & 0x3;
+  }
+
+  // How many bytes of data are in the non-compressed portion past the float
+  // header?
+  static __host__ __device__ uint32_t getUncompDataSize(uint32_t size) {
+    // The single plane of 2 bits per word is 16 byte aligned
+    return roundUp(divUp(size, 4U), 16U);
+  }
+};
+
 inline size_t getWordSizeFromFloatType(FloatType ft) {
   switch (ft) {
+    case FloatType::kFloat8E4M3:
+    case FloatType::kFloat8E5M2:
+      return sizeof(uint8_t);
     case FloatType::kFloat16:
     case FloatType::kBFloat16:
       return sizeof(uint16_t);
     case FloatType::kFloat32:
       return sizeof(uint32_t);
+    case FloatType::kFloat64:
+      return sizeof(uint64_t);
     default:
       CHECK(false);
       return 0;
@@ -52,7 +52,7 @@ class TestFloatCodec(unittest.TestCase):
         dev = torch.device("cuda:0")
         temp_mem = torch.empty([64 * 1024 * 1024], dtype=torch.uint8, device=dev)
 
-        for dt in [torch.bfloat16, torch.float16, torch.float32]:
+        for dt in [torch.bfloat16, torch.float16, torch.float32, torch.float64]:
             for tm in [False, True]:
                 ts = [
                     torch.normal(0, 1.0, [i], dtype=dt, device=dev)
@@ -77,7 +77,7 @@ class TestFloatCodec(unittest.TestCase):
 
     def test_simple(self):
         dev = torch.device("cuda:0")
-        for dt in [torch.bfloat16, torch.float16, torch.float32]:
+        for dt in [torch.bfloat16, torch.float16, torch.float32, torch.float64]:
             ts = [
                 torch.normal(0, 1.0, [i], dtype=dt, device=dev)
                 for i in [10000, 100000, 1000000]
@@ -95,9 +95,50 @@ class TestFloatCodec(unittest.TestCase):
             for orig, after in zip(ts, dts):
                 assert torch.equal(orig, after)
 
+    def test_float8(self):
+        dev = torch.device("cuda:0")
+        for dt in [torch.float8_e4m3fn, torch.float8_e5m2]:
+            # torch does not generate float8 values directly
+            ts = [
+                torch.normal(0, 1.0, [i], dtype=torch.float32, device=dev).to(dt)
+                for i in [1, 10000, 100001, 1000000]
+            ]
+
+            cts = torch.ops.dietgpu.compress_data_simple(True, ts, True)
+            for before, after in zip(ts[1:], cts[1:]):
+                # We should actually be compressing data
+                assert before.numel() > after.numel()
+
+            dts = torch.ops.dietgpu.decompress_data_simple(True, cts, True)
+            for orig, after in zip(ts, dts):
+                assert after.dtype == dt
+                assert torch.equal(orig.view(torch.uint8), after.view(torch.uint8))
+
+    def test_mixed(self):
+        dev = torch.device("cuda:0")
+        temp_mem = torch.empty([64 * 1024 * 1024], dtype=torch.uint8, device=dev)
+
+        # float32 norms amongst bfloat16 weights, in a single batch
+        ts = [
+            torch.normal(0, 1.0, [100000], dtype=torch.bfloat16, device=dev),
+            torch.normal(0, 1.0, [1000], dtype=torch.float32, device=dev),
+            torch.normal(0, 1.0, [54321], dtype=torch.bfloat16, device=dev),
+            torch.normal(0, 1.0, [7], dtype=torch.float16, device=dev),
+            torch.normal(0, 1.0, [3000], dtype=torch.float32, device=dev),
+        ]
+
+        run_test(dev, ts)
+        run_test(dev, ts, temp_mem)
+
+        cts = torch.ops.dietgpu.compress_data_simple(True, ts, True)
+        dts = torch.ops.dietgpu.decompress_data_simple(True, cts, True)
+        for orig, after in zip(ts, dts):
+            assert after.dtype == orig.dtype
+            assert torch.equal(orig, after)
+
     def test_empty(self):
         dev = torch.device("cuda:0")
-        for dt in [torch.bfloat16, torch.float16, torch.float32]:
+        for dt in [torch.bfloat16, torch.float16, torch.float32, torch.float64]:
             ts = [torch.empty([0], dtype=dt, device=dev)]
             comp_ts = torch.ops.dietgpu.compress_data_simple(True, ts, True)
 
@@ -111,7 +152,7 @@ class TestFloatCodec(unittest.TestCase):
         dev = torch.device("cuda:0")
         temp_mem = torch.empty([64 * 1024 * 1024], dtype=torch.uint8, device=dev)
 
-        for dt in [torch.bfloat16, torch.float16, torch.float32]:
+        for dt in [torch.bfloat16, torch.float16, torch.float32, torch.float64]:
             for align16 in [True, False]:
                 for tries in range(5):
                     batch_size = random.randrange(1, 15)
@@ -148,7 +189,7 @@ class TestFloatCodec(unittest.TestCase):
         dev = torch.device("cuda:0")
         temp_mem = torch.empty([64 * 1024 * 1024], dtype=torch.uint8, device=dev)
 
-        for dt in [torch.bfloat16, torch.float16, torch.float32]:
+        for dt in [torch.bfloat16, torch.float16, torch.float32, torch.float64]:
             for align16 in [True, False]:
                 for tries in range(5):
                     batch_size = random.randrange(1, 15)
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "dietgpu/int/IntCodec.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+namespace dietgpu {
+
+//
+// Host (CPU) implementation of the integer codec (see IntCodec.h)
+//
+// All pointers are host pointers, and no GPU is required. Work is spread
+// across the threads of `pool`: the LZ parse and expansion over the chunks of
+// all members of the batch, and the ANS stage over ANS blocks (see
+// CpuANSCodec.h).
+//
+
+void intCompressCpu(
+    ThreadPool& pool,
+    // How should we compress our data?
+    const IntCompressConfig& config,
+
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the batch, each
+    // aligned to the word size
+    const void** in,
+    // Host array with sizes of batch members (in integer words, NOT bytes)
+    const uint32_t* inSize,
+
+    // Host array with addresses of host pointers of outputs, each pointing
+    // to a valid region of memory of at least size
+    // getMaxIntCompressedSize(it, inSize[i], config.ansConfig.blockSize,
+    // config.ansConfig.useWideState, config.ansConfig.getMaxTables(),
+    // config.ansConfig.useBlockChecksum)
+    void** out,
+    // Host array of size numInBatch (optional)
+    // Provides the size of actual used memory in bytes for each batch element
+    uint32_t* outSize);
+
+void intCompressSplitSizeCpu(
+    ThreadPool& pool,
+    // How should we compress our data?
+    const IntCompressConfig& config,
+
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host pointer into a valid region of memory of size at least
+    // sum_i(inSplitSizes[i]) integer words
+    const void* in,
+
+    // Host array with the size (in integer words) of the input arrays in the
+    // batch. Each array in the batch is read starting at the sum of the sizes
+    // of the arrays preceding it
+    const uint32_t* inSplitSizes,
+
+    // Host pointer to a matrix of at least size
+    // numInBatch x getMaxIntCompressedSize(it, max(inSplitSizes[i]), ...)
+    void* out,
+
+    // Stride between rows in bytes
+    uint32_t outStride,
+
+    // Host array of size numInBatch (optional)
+    // Provides the size of actual used memory in bytes for each batch element
+    uint32_t* outSize);
+
+IntDecompressStatus intDecompressCpu(
+    ThreadPool& pool,
+    // How should we decompress our data?
+    const IntDecompressConfig& config,
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the batch
+    const void** in,
+
+    // Host array with addresses of host pointers of outputs, each pointing
+    // to a valid region of memory of at least size outCapacity[i], aligned to
+    // the word size
+    void** out,
+    // Host array of size numInBatch
+    // Provides the maximum amount of space present for decompressing each
+    // batch problem, in integer words
+    const uint32_t* outCapacity,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with true/false
+    // for whether or not decompression status was successful
+    uint8_t* outSuccess,
+
+    // Decode size status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with either the
+    // size decompressed reported if successful, or the required size reported
+    // if our outCapacity was insufficient. Size reported is in integer words
+    uint32_t* outSize);
+
+IntDecompressStatus intDecompressSplitSizeCpu(
+    ThreadPool& pool,
+    // How should we decompress our data?
+    const IntDecompressConfig& config,
+    // Number of separate, independent compression problems
+    uint32_t numInBatch,
+
+    // Host array with addresses of host pointers comprising the batch
+    const void** in,
+
+    // Host pointer into a valid region of memory of size at least
+    // sum_i(outSplitSizes[i]) integer words
+    void* out,
+
+    // Host array with the size (in integer words) of the output arrays in the
+    // batch, each of which is written following the arrays preceding it.
+    // The decompressed size must match exactly these sizes, otherwise there's a
+    // decompression error
+    const uint32_t* outSplitSizes,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with true/false
+    // for whether or not decompression status was successful
+    uint8_t* outSuccess,
+
+    // Decode size status (optional, can be nullptr)
+    // If present, this is a host array of length numInBatch, with either the
+    // size decompressed reported if successful, or the required size reported
+    // if our outSplitSizes was insufficient. Size reported is in integer words
+    uint32_t* outSize);
+
+} // namespace dietgpu
@@ -0,0 +1,386 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/int/CpuIntCodec.h"
+#include "dietgpu/int/IntUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Number of bits of the hash of a pair of words used to find matches
+constexpr int kIntHashBits = 14;
+
+// The LZ parse of a chunk, as the bytes of each stream before ANS coding
+struct IntChunkStreams {
+  std::vector<uint8_t> stream[kIntNumStreams];
+};
+
+template <typename WordT>
+inline uint32_t hashWordPair(WordT a, WordT b) {
+  uint64_t h = uint64_t(a) * 0x9e3779b97f4a7c15ULL + uint64_t(b);
+  return (h * 0xc2b2ae3d27d4eb4fULL) >> (64 - kIntHashBits);
+}
+
+inline void writeVarint(std::vector<uint8_t>& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back(uint8_t(v) | 0x80);
+    v >>= 7;
+  }
+
+  out.push_back(uint8_t(v));
+}
+
+// Appends a sequence of numLiterals literal words followed by a match of
+// matchLength words (0 for none) at `offset` words back
+template <typename WordT>
+void writeSequence(
+    const WordT* literals,
+    uint32_t numLiterals,
+    uint32_t matchLength,
+    uint32_t offset,
+    IntChunkStreams& out) {
+  uint32_t matchCode = matchLength ? matchLength - kIntMinMatch + 1 : 0;
+
+  out.stream[kIntStreamTokens].push_back(
+      (std::min(numLiterals, kIntTokenMaxLength) << 4) |
+      std::min(matchCode, kIntTokenMaxLength));
+
+  auto& lengths = out.stream[kIntStreamLengths];
+  if (numLiterals >= kIntTokenMaxLength) {
+    writeVarint(lengths, numLiterals - kIntTokenMaxLength);
+  }
+
+  if (matchCode >= kIntTokenMaxLength) {
+    writeVarint(lengths, matchCode - kIntTokenMaxLength);
+  }
+
+  if (matchLength) {
+    writeVarint(out.stream[kIntStreamOffsets], offset - 1);
+  }
+
+  auto lit = (const uint8_t*)literals;
+  auto& literalStream = out.stream[kIntStreamLiterals];
+  literalStream.insert(
+      literalStream.end(), lit, lit + numLiterals * sizeof(WordT));
+}
+
+// Greedy LZ parse of the `num` words of a chunk. `table` (of size
+// 2^kIntHashBits) receives the position + 1 of the last occurrence of each
+// hashed pair of words, or 0 if none
+template <typename WordT>
+void parseIntChunk(
+    const WordT* words,
+    uint32_t num,
+    uint32_t windowSize,
+    std::vector<uint32_t>& table,
+    IntChunkStreams& out) {
+  std::fill(table.begin(), table.end(), 0);
+  out.stream[kIntStreamLiterals].reserve(num * sizeof(WordT));
+
+  uint32_t litStart = 0;
+  uint32_t i = 0;
+
+  while (i + kIntMinMatch <= num) {
+    auto h = hashWordPair(words[i], words[i + 1]);
+    uint32_t candidate = table[h];
+    table[h] = i + 1;
+
+    if (candidate > 0) {
+      uint32_t c = candidate - 1;
+
+      if (i - c <= windowSize && words[c] == words[i] &&
+          words[c + 1] == words[i + 1]) {
+        // Matches may overlap the words being matched
+        uint32_t length = kIntMinMatch;
+        while (i + length < num && words[c + length] == words[i + length]) {
+          ++length;
+        }
+
+        writeSequence(words + litStart, i - litStart, length, i - c, out);
+
+        // Later words may match the words within this match
+        for (uint32_t j = i + 1; j < i + length && j + 1 < num; ++j) {
+          table[hashWordPair(words[j], words[j + 1])] = j + 1;
+        }
+
+        i += length;
+        litStart = i;
+        continue;
+      }
+    }
+
+    ++i;
+  }
+
+  // Every chunk ends with a sequence without a match
+  writeSequence(words + litStart, num - litStart, 0, 0, out);
+}
+
+} // namespace
+
+uint32_t getMaxIntCompressedSize(
+    IntType intType,
+    uint32_t size,
+    uint32_t blockSize,
+    bool useWideState,
+    uint32_t numTables,
+    bool useBlockChecksum) {
+  auto wordSize = getWordSizeFromIntType(intType);
+  CHECK_LE(size, std::numeric_limits<uint32_t>::max() / wordSize);
+
+  uint32_t streamSize[kIntNumStreams];
+  getIntMaxStreamSizes(size, wordSize, streamSize);
+
+  uint32_t bytes =
+      sizeof(IntHeader) + getIntNumChunks(size) * sizeof(IntChunkInfo);
+
+  for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+    // The literals are byte shuffled, each byte plane being a segment
+    auto tables =
+        s == kIntStreamLiterals ? std::max(numTables, wordSize) : numTables;
+
+    bytes += roundUp(
+        getMaxCompressedSize(
+            streamSize[s], blockSize, useWideState, tables, useBlockChecksum),
+        16U);
+  }
+
+  return bytes;
+}
+
+void intCompressCpu(
+    ThreadPool& pool,
+    const IntCompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    const uint32_t* inSize,
+    void** out,
+    uint32_t* outSize) {
+  // not allowed in integer mode
+  CHECK(!config.ansConfig.useChecksum);
+  CHECK(!config.ansConfig.dictionary)
+      << "dictionaries are not supported by the integer codec";
+  CHECK(
+      config.intType == IntType::kInt32 || config.intType == IntType::kInt64)
+      << "unknown int type " << uint32_t(config.intType);
+  CHECK(isValidIntWindowSize(config.windowSize))
+      << "invalid window size " << config.windowSize;
+
+  auto wordSize = getWordSizeFromIntType(config.intType);
+  auto chunks = CpuIntChunks(numInBatch, inSize);
+  auto numChunks = chunks.getNumChunks();
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    CHECK_EQ(uintptr_t(in[i]) % wordSize, 0);
+    CHECK_LE(inSize[i], std::numeric_limits<uint32_t>::max() / wordSize);
+  }
+
+  auto chunkStreams = std::vector<IntChunkStreams>(numChunks);
+  auto chunkChecksum =
+      std::vector<uint32_t>(config.useChecksum ? numChunks : 0);
+
+  // Parse each chunk into its streams
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kIntChunkSize;
+    uint32_t num = std::min(inSize[batch] - start, kIntChunkSize);
+
+    auto table = std::vector<uint32_t>(1 << kIntHashBits);
+
+    if (config.intType == IntType::kInt32) {
+      parseIntChunk(
+          (const uint32_t*)in[batch] + start,
+          num,
+          config.windowSize,
+          table,
+          chunkStreams[chunk]);
+    } else {
+      parseIntChunk(
+          (const uint64_t*)in[batch] + start,
+          num,
+          config.windowSize,
+          table,
+          chunkStreams[chunk]);
+    }
+
+    // Chunks start at a multiple of 8 bytes, so the checksums of the chunks
+    // combine into that of the whole input
+    if (config.useChecksum) {
+      chunkChecksum[chunk] = ansChecksumCpu(
+          (const uint8_t*)in[batch] + (size_t)start * wordSize,
+          num * wordSize);
+    }
+  });
+
+  // Each stream of all batch members is gathered into a buffer of 16 byte
+  // aligned rows for ANS coding. chunkOffset holds the offset of each chunk's
+  // part of each stream within its row
+  auto streamStart =
+      std::vector<size_t>(kIntNumStreams * (size_t)(numInBatch + 1));
+  auto streamSize = std::vector<uint32_t>(kIntNumStreams * numInBatch);
+  auto chunkOffset = std::vector<uint32_t>(kIntNumStreams * numChunks);
+
+  for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+    auto start = streamStart.data() + s * (numInBatch + 1);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      uint32_t size = 0;
+      for (auto c = chunks.chunkStart[i]; c < chunks.chunkStart[i + 1]; ++c) {
+        chunkOffset[c * kIntNumStreams + s] = size;
+        size += chunkStreams[c].stream[s].size();
+      }
+
+      streamSize[s * numInBatch + i] = size;
+      start[i + 1] = start[i] + roundUp(size, sizeof(uint4));
+    }
+  }
+
+  std::vector<uint8_t> streams[kIntNumStreams];
+  for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+    streams[s].resize(streamStart[s * (numInBatch + 1) + numInBatch]);
+  }
+
+  // Write the headers and chunk tables
+  pool.parallelFor(numInBatch, [&](size_t batch) {
+    auto header = (IntHeader*)out[batch];
+    std::memset(header, 0, sizeof(IntHeader));
+
+    header->size = inSize[batch];
+    header->setIntType(config.intType);
+    header->setUseChecksum(config.useChecksum);
+    header->setWindowSize(config.windowSize);
+    header->setMagicAndVersion();
+
+    auto info = (IntChunkInfo*)(header + 1);
+    uint32_t checksum = 0;
+
+    for (auto c = chunks.chunkStart[batch]; c < chunks.chunkStart[batch + 1];
+         ++c) {
+      for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+        info->streamSize[s] = chunkStreams[c].stream[s].size();
+      }
+
+      if (config.useChecksum) {
+        checksum ^= chunkChecksum[c];
+      }
+
+      ++info;
+    }
+
+    header->checksum = checksum;
+  });
+
+  // Gather the streams of each chunk
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+
+    for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+      auto& stream = chunkStreams[chunk].stream[s];
+
+      std::memcpy(
+          streams[s].data() + streamStart[s * (numInBatch + 1) + batch] +
+              chunkOffset[chunk * kIntNumStreams + s],
+          stream.data(),
+          stream.size());
+
+      // Release the memory as we go
+      stream = std::vector<uint8_t>();
+    }
+  });
+
+  // ANS code each stream in turn, each archive following the previous one
+  auto ansOffset = std::vector<uint32_t>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    ansOffset[i] = sizeof(IntHeader) +
+        (chunks.chunkStart[i + 1] - chunks.chunkStart[i]) *
+            sizeof(IntChunkInfo);
+  }
+
+  auto ansIn = std::vector<const void*>(numInBatch);
+  auto ansOut = std::vector<void*>(numInBatch);
+  auto ansBytes = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      ansIn[i] = streams[s].data() + streamStart[s * (numInBatch + 1) + i];
+      ansOut[i] = (uint8_t*)out[i] + ansOffset[i];
+    }
+
+    ansEncodeBatchCpu(
+        pool,
+        getIntStreamANSConfig(config, s),
+        numInBatch,
+        ansIn.data(),
+        streamSize.data() + s * numInBatch,
+        nullptr,
+        ansOut.data(),
+        ansBytes.data());
+
+    streams[s] = std::vector<uint8_t>();
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      ((IntHeader*)out[i])->streamBytes[s] = ansBytes[i];
+
+      if (s == kIntStreamLiterals) {
+        ansOffset[i] += ansBytes[i];
+      } else {
+        // Zero the alignment padding so the output is deterministic
+        auto padded = roundUp(ansBytes[i], 16U);
+        std::memset((uint8_t*)ansOut[i] + ansBytes[i], 0, padded - ansBytes[i]);
+        ansOffset[i] += padded;
+      }
+    }
+  }
+
+  if (outSize) {
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      outSize[i] = ansOffset[i];
+    }
+  }
+}
+
+void intCompressSplitSizeCpu(
+    ThreadPool& pool,
+    const IntCompressConfig& config,
+    uint32_t numInBatch,
+    const void* in,
+    const uint32_t* inSplitSizes,
+    void* out,
+    uint32_t outStride,
+    uint32_t* outSize) {
+  auto wordSize = getWordSizeFromIntType(config.intType);
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto outPtrs = std::vector<void*>(numInBatch);
+
+  size_t offset = 0;
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    inPtrs[i] = (const uint8_t*)in + offset * wordSize;
+    outPtrs[i] = (uint8_t*)out + (size_t)i * outStride;
+    offset += inSplitSizes[i];
+  }
+
+  intCompressCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      inSplitSizes,
+      outPtrs.data(),
+      outSize);
+}
+
+} // namespace dietgpu
@@ -0,0 +1,382 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/ans/CpuANSUtils.h"
+#include "dietgpu/int/CpuIntCodec.h"
+#include "dietgpu/int/IntUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Reads a LEB128 varint of at most 4 bytes, returning false if it runs past
+// `end` or is longer
+inline bool readVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+  v = 0;
+
+  for (int shift = 0; shift < 28; shift += 7) {
+    if (p == end) {
+      return false;
+    }
+
+    uint32_t b = *p++;
+    v |= (b & 0x7fU) << shift;
+
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Expands the LZ parse of a chunk of `num` words into `out`, given the start
+// of the chunk's part of each stream. Returns false if the streams are not
+// exactly consumed in producing the chunk
+template <typename WordT>
+bool expandIntChunk(
+    const uint8_t* const* streams,
+    const IntChunkInfo& info,
+    uint32_t windowSize,
+    uint32_t num,
+    WordT* out) {
+  auto token = streams[kIntStreamTokens];
+  auto tokenEnd = token + info.streamSize[kIntStreamTokens];
+  auto length = streams[kIntStreamLengths];
+  auto lengthEnd = length + info.streamSize[kIntStreamLengths];
+  auto offset = streams[kIntStreamOffsets];
+  auto offsetEnd = offset + info.streamSize[kIntStreamOffsets];
+  auto literal = streams[kIntStreamLiterals];
+  auto literalEnd = literal + info.streamSize[kIntStreamLiterals];
+
+  uint32_t pos = 0;
+
+  while (token < tokenEnd) {
+    uint32_t t = *token++;
+    uint32_t numLiterals = t >> 4;
+    uint32_t matchCode = t & 0xf;
+    uint32_t extra;
+
+    if (numLiterals == kIntTokenMaxLength) {
+      if (!readVarint(length, lengthEnd, extra)) {
+        return false;
+      }
+
+      numLiterals += extra;
+    }
+
+    if (matchCode == kIntTokenMaxLength) {
+      if (!readVarint(length, lengthEnd, extra)) {
+        return false;
+      }
+
+      matchCode += extra;
+    }
+
+    if (numLiterals > num - pos ||
+        numLiterals > (literalEnd - literal) / sizeof(WordT)) {
+      return false;
+    }
+
+    std::memcpy(out + pos, literal, numLiterals * sizeof(WordT));
+    literal += numLiterals * sizeof(WordT);
+    pos += numLiterals;
+
+    // Only the last sequence of a chunk has no match
+    if (matchCode == 0) {
+      if (token != tokenEnd) {
+        return false;
+      }
+
+      break;
+    }
+
+    uint32_t matchLength = matchCode + kIntMinMatch - 1;
+    uint32_t distance;
+
+    if (!readVarint(offset, offsetEnd, distance)) {
+      return false;
+    }
+
+    ++distance;
+
+    if (distance > pos || distance > windowSize || matchLength > num - pos) {
+      return false;
+    }
+
+    // The match may overlap the words that it produces
+    auto src = out + pos - distance;
+    for (uint32_t i = 0; i < matchLength; ++i) {
+      out[pos + i] = src[i];
+    }
+
+    pos += matchLength;
+  }
+
+  return pos == num && token == tokenEnd && length == lengthEnd &&
+      offset == offsetEnd && literal == literalEnd;
+}
+
+} // namespace
+
+IntDecompressStatus intDecompressCpu(
+    ThreadPool& pool,
+    const IntDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void** out,
+    const uint32_t* outCapacity,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  // not allowed in integer mode
+  CHECK(!config.ansConfig.useChecksum);
+  CHECK(
+      config.intType == IntType::kInt32 || config.intType == IntType::kInt64)
+      << "unknown int type " << uint32_t(config.intType);
+
+  auto wordSize = getWordSizeFromIntType(config.intType);
+  auto sizes = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto header = (const IntHeader*)in[i];
+
+    CHECK(header->isValidMagicAndVersion())
+        << "batch member " << i << " has invalid int magic and version "
+        << std::hex << header->magicAndVersion;
+    CHECK(header->getIntType() == config.intType)
+        << "batch member " << i << " has int type "
+        << uint32_t(header->getIntType()) << " but expected "
+        << uint32_t(config.intType);
+    CHECK_EQ(uintptr_t(out[i]) % wordSize, 0);
+
+    sizes[i] = header->size;
+  }
+
+  auto chunks = CpuIntChunks(numInBatch, sizes.data());
+  auto numChunks = chunks.getNumChunks();
+
+  // We decode the members that fit in their output and whose streams are no
+  // larger than their size allows. Each stream of all batch members is
+  // decoded into a buffer of 16 byte aligned rows, and chunkOffset holds the
+  // offset of each chunk's part of each stream within its row
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto streamStart =
+      std::vector<size_t>(kIntNumStreams * (size_t)(numInBatch + 1));
+  auto streamSize = std::vector<uint32_t>(kIntNumStreams * numInBatch);
+  auto chunkOffset = std::vector<uint32_t>(kIntNumStreams * numChunks);
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    auto info = (const IntChunkInfo*)((const IntHeader*)in[i] + 1);
+
+    uint32_t maxSize[kIntNumStreams];
+    getIntMaxStreamSizes(sizes[i], wordSize, maxSize);
+
+    bool valid = sizes[i] <= outCapacity[i];
+    uint64_t total[kIntNumStreams] = {0, 0, 0, 0};
+
+    for (auto c = chunks.chunkStart[i]; valid && c < chunks.chunkStart[i + 1];
+         ++c, ++info) {
+      for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+        chunkOffset[c * kIntNumStreams + s] = total[s];
+        total[s] += info->streamSize[s];
+        valid = valid && total[s] <= maxSize[s];
+      }
+    }
+
+    success[i] = valid;
+
+    for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+      auto start = streamStart.data() + s * (numInBatch + 1);
+      uint32_t size = valid ? total[s] : 0;
+
+      streamSize[s * numInBatch + i] = size;
+      start[i + 1] = start[i] + roundUp(size, sizeof(uint4));
+    }
+  }
+
+  // ANS decode each stream in turn
+  std::vector<uint8_t> streams[kIntNumStreams];
+
+  auto ansOffset = std::vector<uint32_t>(numInBatch);
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    ansOffset[i] = sizeof(IntHeader) +
+        (chunks.chunkStart[i + 1] - chunks.chunkStart[i]) *
+            sizeof(IntChunkInfo);
+  }
+
+  auto ansIn = std::vector<const void*>(numInBatch);
+  auto ansOut = std::vector<void*>(numInBatch);
+  auto ansSuccess = std::vector<uint8_t>(numInBatch);
+  auto ansSize = std::vector<uint32_t>(numInBatch);
+
+  for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+    streams[s].resize(streamStart[s * (numInBatch + 1) + numInBatch]);
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      ansIn[i] = (const uint8_t*)in[i] + ansOffset[i];
+      ansOut[i] = streams[s].data() + streamStart[s * (numInBatch + 1) + i];
+    }
+
+    ansDecodeBatchCpu(
+        pool,
+        getIntStreamANSConfig(config, s),
+        numInBatch,
+        ansIn.data(),
+        ansOut.data(),
+        streamSize.data() + s * numInBatch,
+        ansSuccess.data(),
+        ansSize.data());
+
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      success[i] = success[i] && ansSuccess[i] &&
+          ansSize[i] == streamSize[s * numInBatch + i];
+      ansOffset[i] +=
+          roundUp(((const IntHeader*)in[i])->streamBytes[s], 16U);
+    }
+  }
+
+  // Expand the chunks of the members that we could decode
+  auto chunkSuccess = std::vector<uint8_t>(numChunks);
+  auto chunkChecksum =
+      std::vector<uint32_t>(config.useChecksum ? numChunks : 0);
+
+  pool.parallelFor(numChunks, [&](size_t chunk) {
+    uint32_t batch = chunks.getBatch(chunk);
+
+    if (!success[batch]) {
+      return;
+    }
+
+    uint32_t start = (chunk - chunks.chunkStart[batch]) * kIntChunkSize;
+    uint32_t num = std::min(sizes[batch] - start, kIntChunkSize);
+
+    auto header = (const IntHeader*)in[batch];
+    auto& info = ((const IntChunkInfo*)(header + 1))
+        [chunk - chunks.chunkStart[batch]];
+
+    const uint8_t* chunkStreams[kIntNumStreams];
+    for (uint32_t s = 0; s < kIntNumStreams; ++s) {
+      chunkStreams[s] = streams[s].data() +
+          streamStart[s * (numInBatch + 1) + batch] +
+          chunkOffset[chunk * kIntNumStreams + s];
+    }
+
+    if (config.intType == IntType::kInt32) {
+      chunkSuccess[chunk] = expandIntChunk(
+          chunkStreams,
+          info,
+          header->getWindowSize(),
+          num,
+          (uint32_t*)out[batch] + start);
+    } else {
+      chunkSuccess[chunk] = expandIntChunk(
+          chunkStreams,
+          info,
+          header->getWindowSize(),
+          num,
+          (uint64_t*)out[batch] + start);
+    }
+
+    if (config.useChecksum && chunkSuccess[chunk]) {
+      chunkChecksum[chunk] = ansChecksumCpu(
+          (const uint8_t*)out[batch] + (size_t)start * wordSize,
+          num * wordSize);
+    }
+  });
+
+  IntDecompressStatus status;
+
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    for (auto c = chunks.chunkStart[i]; c < chunks.chunkStart[i + 1]; ++c) {
+      success[i] = success[i] && chunkSuccess[c];
+    }
+
+    if (outSuccess) {
+      outSuccess[i] = success[i];
+    }
+
+    if (outSize) {
+      outSize[i] = sizes[i];
+    }
+
+    // Perform optional checksum, if desired
+    auto header = (const IntHeader*)in[i];
+
+    if (config.useChecksum && success[i] && header->getUseChecksum()) {
+      uint32_t checksum = 0;
+      for (auto c = chunks.chunkStart[i]; c < chunks.chunkStart[i + 1]; ++c) {
+        checksum ^= chunkChecksum[c];
+      }
+
+      if (header->checksum != checksum) {
+        status.error = IntDecompressError::ChecksumMismatch;
+
+        std::stringstream errStr;
+        errStr << "Checksum mismatch in batch member " << i
+               << ": expected checksum " << std::hex << header->checksum
+               << " got " << checksum << "\n";
+        status.errorInfo.push_back(std::make_pair(i, errStr.str()));
+      }
+    }
+  }
+
+  return status;
+}
+
+IntDecompressStatus intDecompressSplitSizeCpu(
+    ThreadPool& pool,
+    const IntDecompressConfig& config,
+    uint32_t numInBatch,
+    const void** in,
+    void* out,
+    const uint32_t* outSplitSizes,
+    uint8_t* outSuccess,
+    uint32_t* outSize) {
+  auto wordSize = getWordSizeFromIntType(config.intType);
+  auto outPtrs = std::vector<void*>(numInBatch);
+
+  size_t offset = 0;
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    outPtrs[i] = (uint8_t*)out + offset * wordSize;
+    offset += outSplitSizes[i];
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto size = std::vector<uint32_t>(numInBatch);
+
+  auto status = intDecompressCpu(
+      pool,
+      config,
+      numInBatch,
+      in,
+      outPtrs.data(),
+      outSplitSizes,
+      success.data(),
+      size.data());
+
+  // The decompressed sizes must be exactly the split sizes
+  for (uint32_t i = 0; i < numInBatch; ++i) {
+    if (outSuccess) {
+      outSuccess[i] = success[i] && size[i] == outSplitSizes[i];
+    }
+
+    if (outSize) {
+      outSize[i] = size[i];
+    }
+  }
+
+  return status;
+}
+
+} // namespace dietgpu
@@ -0,0 +1,361 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/int/CpuIntCodec.h"
+#include "dietgpu/int/IntUtils.h"
+
+using namespace dietgpu;
+
+// Generates integer ids (such as token ids) of which a fraction `repeat` are
+// copies of phrases seen in the last `history` ids, as bytes
+std::vector<uint8_t> generateIds(
+    IntType it,
+    uint32_t num,
+    double repeat,
+    uint32_t history = 4096,
+    uint64_t maxValue = 50000) {
+  std::mt19937_64 gen(10 + num);
+  std::uniform_int_distribution<uint64_t> valueDist(0, maxValue);
+  std::uniform_real_distribution<double> repeatDist;
+  std::uniform_int_distribution<uint32_t> phraseDist(2, 24);
+
+  auto ids = std::vector<uint64_t>();
+
+  while (ids.size() < num) {
+    uint32_t phrase = phraseDist(gen);
+
+    if (ids.size() > phrase && repeatDist(gen) < repeat) {
+      uint32_t back = std::min<size_t>(history, ids.size() - phrase);
+      size_t start = ids.size() - phrase - gen() % back;
+
+      for (uint32_t i = 0; i < phrase; ++i) {
+        ids.push_back(ids[start + i]);
+      }
+    } else {
+      for (uint32_t i = 0; i < phrase; ++i) {
+        ids.push_back(valueDist(gen));
+      }
+    }
+  }
+
+  auto wordSize = getWordSizeFromIntType(it);
+  auto out = std::vector<uint8_t>(num * wordSize);
+
+  for (uint32_t i = 0; i < num; ++i) {
+    std::memcpy(out.data() + i * wordSize, &ids[i], wordSize);
+  }
+
+  return out;
+}
+
+std::vector<std::vector<uint8_t>> compressBatch(
+    ThreadPool& pool,
+    const IntCompressConfig& config,
+    const std::vector<std::vector<uint8_t>>& batch,
+    const std::vector<uint32_t>& batchSizes) {
+  int numInBatch = batch.size();
+
+  auto inPtrs = std::vector<const void*>(numInBatch);
+  auto enc = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto encPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    inPtrs[i] = batch[i].data();
+    enc[i].resize(getMaxIntCompressedSize(
+        config.intType,
+        batchSizes[i],
+        config.ansConfig.blockSize,
+        config.ansConfig.useWideState,
+        config.ansConfig.getMaxTables(),
+        config.ansConfig.useBlockChecksum));
+    encPtrs[i] = enc[i].data();
+  }
+
+  auto encSize = std::vector<uint32_t>(numInBatch);
+
+  intCompressCpu(
+      pool,
+      config,
+      numInBatch,
+      inPtrs.data(),
+      batchSizes.data(),
+      encPtrs.data(),
+      encSize.data());
+
+  for (int i = 0; i < numInBatch; ++i) {
+    EXPECT_LE(encSize[i], enc[i].size());
+    enc[i].resize(encSize[i]);
+  }
+
+  return enc;
+}
+
+// Decompresses the batch, checking that it succeeds with the given sizes
+std::vector<std::vector<uint8_t>> decompressBatch(
+    ThreadPool& pool,
+    const IntDecompressConfig& config,
+    const std::vector<std::vector<uint8_t>>& enc,
+    const std::vector<uint32_t>& batchSizes) {
+  int numInBatch = enc.size();
+  auto wordSize = getWordSizeFromIntType(config.intType);
+
+  auto encPtrs = std::vector<const void*>(numInBatch);
+  auto dec = std::vector<std::vector<uint8_t>>(numInBatch);
+  auto decPtrs = std::vector<void*>(numInBatch);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    encPtrs[i] = enc[i].data();
+    dec[i].resize(batchSizes[i] * wordSize);
+    decPtrs[i] = dec[i].data();
+  }
+
+  auto success = std::vector<uint8_t>(numInBatch);
+  auto size = std::vector<uint32_t>(numInBatch);
+
+  auto status = intDecompressCpu(
+      pool,
+      config,
+      numInBatch,
+      encPtrs.data(),
+      decPtrs.data(),
+      batchSizes.data(),
+      success.data(),
+      size.data());
+
+  EXPECT_TRUE(status.error == IntDecompressError::None);
+
+  for (int i = 0; i < numInBatch; ++i) {
+    EXPECT_TRUE(success[i]);
+    EXPECT_EQ(size[i], batchSizes[i]);
+  }
+
+  return dec;
+}
+
+TEST(CpuIntTest, RoundTrip) {
+  ThreadPool pool(4);
+
+  for (auto it : {IntType::kInt32, IntType::kInt64}) {
+    for (auto checksum : {false, true}) {
+      for (uint32_t window : {kIntMinWindowSize, kIntDefaultWindowSize}) {
+        auto config =
+            IntCodecConfig(it, ANSCodecConfig(10), checksum, window);
+
+        // Sizes around the chunk size, and data from incompressible to
+        // highly repetitive
+        auto batchSizes = std::vector<uint32_t>{
+            0, 1, 2, 3, 100, 4097, 65535, 65536, 65537, 200000};
+        auto batch = std::vector<std::vector<uint8_t>>();
+
+        for (uint32_t i = 0; i < batchSizes.size(); ++i) {
+          batch.push_back(generateIds(
+              it, batchSizes[i], 0.25 * (i % 4), 4096, ~0ULL >> (i * 6)));
+        }
+
+        auto enc = compressBatch(pool, config, batch, batchSizes);
+
+        for (uint32_t i = 0; i < batchSizes.size(); ++i) {
+          auto header = (const IntHeader*)enc[i].data();
+          EXPECT_TRUE(header->isValidMagicAndVersion());
+          EXPECT_TRUE(header->getIntType() == it);
+          EXPECT_EQ(header->getUseChecksum(), checksum);
+          EXPECT_EQ(header->getWindowSize(), window);
+          EXPECT_EQ(header->size, batchSizes[i]);
+        }
+
+        EXPECT_EQ(decompressBatch(pool, config, enc, batchSizes), batch);
+      }
+    }
+  }
+}
+
+TEST(CpuIntTest, BlockChecksum) {
+  ThreadPool pool(4);
+
+  for (auto it : {IntType::kInt32, IntType::kInt64}) {
+    auto config = IntCodecConfig(it, ANSCodecConfig(10));
+    config.ansConfig.useBlockChecksum = true;
+
+    // Incompressible data, whose streams are stored, come closest to
+    // getMaxIntCompressedSize (checked by compressBatch)
+    auto batchSizes = std::vector<uint32_t>{0, 1, 4097, 65537, 200000};
+    auto batch = std::vector<std::vector<uint8_t>>();
+
+    for (auto size : batchSizes) {
+      batch.push_back(generateIds(it, size, 0.0, 4096, ~0ULL));
+    }
+
+    auto enc = compressBatch(pool, config, batch, batchSizes);
+    EXPECT_EQ(decompressBatch(pool, config, enc, batchSizes), batch);
+  }
+}
+
+TEST(CpuIntTest, SplitSize) {
+  ThreadPool pool(4);
+  auto config = IntCodecConfig(IntType::kInt64, ANSCodecConfig(10));
+
+  auto splitSizes = std::vector<uint32_t>{1000, 0, 70000, 5};
+  uint32_t total = 0;
+  for (auto s : splitSizes) {
+    total += s;
+  }
+
+  auto data = generateIds(IntType::kInt64, total, 0.5);
+
+  uint32_t maxSize = getMaxIntCompressedSize(IntType::kInt64, 70000);
+  auto enc = std::vector<uint8_t>(splitSizes.size() * maxSize);
+  auto encSize = std::vector<uint32_t>(splitSizes.size());
+
+  intCompressSplitSizeCpu(
+      pool,
+      config,
+      splitSizes.size(),
+      data.data(),
+      splitSizes.data(),
+      enc.data(),
+      maxSize,
+      encSize.data());
+
+  auto encPtrs = std::vector<const void*>(splitSizes.size());
+  for (uint32_t i = 0; i < splitSizes.size(); ++i) {
+    encPtrs[i] = enc.data() + i * maxSize;
+    EXPECT_LE(encSize[i], maxSize);
+  }
+
+  auto dec = std::vector<uint8_t>(data.size());
+  auto success = std::vector<uint8_t>(splitSizes.size());
+  auto size = std::vector<uint32_t>(splitSizes.size());
+
+  intDecompressSplitSizeCpu(
+      pool,
+      config,
+      splitSizes.size(),
+      encPtrs.data(),
+      dec.data(),
+      splitSizes.data(),
+      success.data(),
+      size.data());
+
+  for (uint32_t i = 0; i < splitSizes.size(); ++i) {
+    EXPECT_TRUE(success[i]);
+    EXPECT_EQ(size[i], splitSizes[i]);
+  }
+
+  EXPECT_EQ(dec, data);
+
+  // The decompressed sizes must match the split sizes exactly
+  auto largerSizes = splitSizes;
+  ++largerSizes[0];
+  dec.resize(dec.size() + sizeof(uint64_t));
+
+  intDecompressSplitSizeCpu(
+      pool,
+      config,
+      splitSizes.size(),
+      encPtrs.data(),
+      dec.data(),
+      largerSizes.data(),
+      success.data(),
+      size.data());
+
+  EXPECT_FALSE(success[0]);
+  EXPECT_EQ(size[0], splitSizes[0]);
+  EXPECT_TRUE(success[2]);
+}
+
+TEST(CpuIntTest, Ratio) {
+  ThreadPool pool(4);
+
+  for (auto it : {IntType::kInt32, IntType::kInt64}) {
+    auto wordSize = getWordSizeFromIntType(it);
+    auto config = IntCodecConfig(it, ANSCodecConfig(10));
+    uint32_t size = 500000;
+
+    // ANS coding the bytes alone (byte shuffled by the word size)
+    auto ansConfig = ANSCodecConfig(10);
+    ansConfig.shuffleWidth = wordSize;
+
+    for (double repeat : {0.0, 0.5, 0.9}) {
+      auto data = generateIds(it, size, repeat);
+      auto enc = compressBatch(pool, config, {data}, {size});
+
+      uint32_t bytes = size * wordSize;
+      auto ansEnc = std::vector<uint8_t>(getMaxCompressedSize(
+          bytes,
+          ansConfig.blockSize,
+          ansConfig.useWideState,
+          ansConfig.getMaxTables()));
+      auto inPtr = (const void*)data.data();
+      auto ansEncPtr = (void*)ansEnc.data();
+      uint32_t ansSize = 0;
+
+      ansEncodeBatchCpu(
+          pool, ansConfig, 1, &inPtr, &bytes, nullptr, &ansEncPtr, &ansSize);
+
+      // Without repeats the LZ finds nothing and costs little, while with
+      // repeats it does better than the entropy coder alone
+      if (repeat == 0.0) {
+        EXPECT_LT(enc[0].size(), ansSize * 1.01);
+      } else {
+        EXPECT_LT(enc[0].size(), ansSize * (1.0 - repeat * 0.75));
+      }
+
+      EXPECT_EQ(decompressBatch(pool, config, enc, {size})[0], data);
+    }
+  }
+}
+
+TEST(CpuIntTest, Errors) {
+  ThreadPool pool(4);
+  auto config = IntCodecConfig(IntType::kInt32, ANSCodecConfig(10), true);
+
+  uint32_t size = 100000;
+  auto data = generateIds(IntType::kInt32, size, 0.5);
+  auto enc = compressBatch(pool, config, {data}, {size});
+
+  auto dec = std::vector<uint8_t>(size * sizeof(uint32_t));
+  auto encPtr = (const void*)enc[0].data();
+  auto decPtr = (void*)dec.data();
+  uint8_t success = true;
+  uint32_t decSize = 0;
+
+  // Insufficient capacity reports the required size
+  uint32_t capacity = size - 1;
+  intDecompressCpu(
+      pool, config, 1, &encPtr, &decPtr, &capacity, &success, &decSize);
+  EXPECT_FALSE(success);
+  EXPECT_EQ(decSize, size);
+
+  // A chunk table inconsistent with the streams fails to decode
+  auto corrupt = enc[0];
+  auto info = (IntChunkInfo*)(corrupt.data() + sizeof(IntHeader));
+  ++info[0].streamSize[kIntStreamTokens];
+  --info[1].streamSize[kIntStreamTokens];
+
+  encPtr = corrupt.data();
+  capacity = size;
+  intDecompressCpu(
+      pool, config, 1, &encPtr, &decPtr, &capacity, &success, &decSize);
+  EXPECT_FALSE(success);
+
+  // A checksum mismatch is reported
+  corrupt = enc[0];
+  ((IntHeader*)corrupt.data())->checksum ^= 1;
+
+  encPtr = corrupt.data();
+  auto status = intDecompressCpu(
+      pool, config, 1, &encPtr, &decPtr, &capacity, &success, &decSize);
+  EXPECT_TRUE(status.error == IntDecompressError::ChecksumMismatch);
+  EXPECT_EQ(status.errorInfo.size(), 1);
+}
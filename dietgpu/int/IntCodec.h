@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include "dietgpu/ans/GpuANSCodec.h"
+
+namespace dietgpu {
+
+//
+// Integer codec
+//
+// Compresses arrays of int32 or int64 words (such as embedding indices, token
+// ids or sparse gradient indices) with a fixed-word LZ77: repeats of two or
+// more words within a bounded window of previous words are replaced by
+// matches, and the match tokens, lengths, offsets and the remaining literal
+// words are each entropy coded with the ANS codec (the literals byte shuffled,
+// see ANSCodecConfig::shuffleWidth).
+//
+// Each array is parsed in independent chunks of kIntChunkSize words, whose
+// stream sizes are recorded in the archive so that chunks may be expanded in
+// parallel.
+//
+
+// The integer types we support for compression. Words are compressed as their
+// bit patterns, so signed and unsigned data are handled alike
+enum class IntType : uint32_t {
+  kUndefined = 0,
+  kInt32 = 1,
+  kInt64 = 2,
+};
+
+inline uint32_t getWordSizeFromIntType(IntType it) {
+  switch (it) {
+    case IntType::kInt32:
+      return sizeof(uint32_t);
+    case IntType::kInt64:
+      return sizeof(uint64_t);
+    default:
+      assert(false);
+      return 0;
+  }
+}
+
+// Smallest and largest LZ window sizes, in words. Matches never cross the
+// start of a chunk, so the window is bounded by the chunk size
+constexpr uint32_t kIntMinWindowSize = 16;
+constexpr uint32_t kIntMaxWindowSize = 64 * 1024;
+constexpr uint32_t kIntDefaultWindowSize = kIntMaxWindowSize;
+
+inline bool isValidIntWindowSize(uint32_t windowSize) {
+  return windowSize >= kIntMinWindowSize && windowSize <= kIntMaxWindowSize &&
+      (windowSize & (windowSize - 1)) == 0;
+}
+
+// Returns the maximum possible compressed size in bytes of an array of `size`
+// integer words of type `intType`. `blockSize`, `useWideState`, `numTables`
+// and `useBlockChecksum` must match the ANS configuration used for
+// compression (see ANSCodecConfig::getMaxTables)
+uint32_t getMaxIntCompressedSize(
+    IntType intType,
+    uint32_t size,
+    uint32_t blockSize = kANSDefaultBlockSize,
+    bool useWideState = false,
+    uint32_t numTables = 1,
+    bool useBlockChecksum = false);
+
+struct IntCodecConfig {
+  inline IntCodecConfig()
+      : intType(IntType::kInt32),
+        useChecksum(false),
+        windowSize(kIntDefaultWindowSize) {}
+
+  inline IntCodecConfig(
+      IntType it,
+      const ANSCodecConfig& ansConf,
+      bool checksum = false,
+      uint32_t window = kIntDefaultWindowSize)
+      : intType(it),
+        useChecksum(checksum),
+        ansConfig(ansConf),
+        windowSize(window) {
+    // ANS-level checksumming is not allowed in integer mode, only integer
+    // level checksumming
+    assert(!ansConf.useChecksum);
+  }
+
+  // What kind of integers are we compressing/decompressing?
+  IntType intType;
+
+  // If true, we calculate a checksum on the uncompressed input data to
+  // compression and store it in the archive, which is verified against the
+  // decompressed data
+  bool useChecksum;
+
+  // ANS entropy coder parameters, used for each of the streams of the
+  // archive. ansConfig.useChecksum must be false, and dictionaries are not
+  // supported. The literal stream is always byte shuffled by the word size
+  ANSCodecConfig ansConfig;
+
+  // Compression only: the number of previous words (a power of 2 between
+  // kIntMinWindowSize and kIntMaxWindowSize) searched for matches. The window
+  // size is recorded in the archive
+  uint32_t windowSize;
+};
+
+// Same config options for compression and decompression for now
+using IntCompressConfig = IntCodecConfig;
+using IntDecompressConfig = IntCodecConfig;
+
+enum class IntDecompressError : uint32_t {
+  None = 0,
+  ChecksumMismatch = 1,
+};
+
+// Error status for decompression
+struct IntDecompressStatus {
+  inline IntDecompressStatus() : error(IntDecompressError::None) {}
+
+  // Overall error status
+  IntDecompressError error;
+
+  // Error-specific information for the batch
+  std::vector<std::pair<int, std::string>> errorInfo;
+};
+
+} // namespace dietgpu
@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "dietgpu/int/IntCodec.h"
+#include "dietgpu/utils/StaticUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <vector>
+
+namespace dietgpu {
+
+// magic number to verify archive integrity
+constexpr uint32_t kIntMagic = 0xf11f;
+
+// current integer archive version number
+constexpr uint32_t kIntVersion = 0x0001;
+
+// Number of words in each independently parsed chunk of an array
+constexpr uint32_t kIntChunkSize = 64 * 1024;
+
+// Shortest match, in words
+constexpr uint32_t kIntMinMatch = 2;
+
+// Largest length held in a token nibble; longer lengths continue in the
+// lengths stream
+constexpr uint32_t kIntTokenMaxLength = 15;
+
+// The streams of an archive, in their order in the archive:
+//
+// tokens: a byte per sequence of literals followed by a match, holding the
+// number of literals (high nibble) and the match length code (low nibble),
+// which is 0 for no match (only in the last sequence of a chunk) or else the
+// match length - kIntMinMatch + 1. A nibble of kIntTokenMaxLength is continued
+// by a LEB128 varint in the lengths stream
+//
+// lengths: the varint continuations of the literal and match lengths
+//
+// offsets: a LEB128 varint of the distance back to the match - 1, in words,
+// for each sequence with a match
+//
+// literals: the literal words, byte shuffled by ANS
+constexpr uint32_t kIntStreamTokens = 0;
+constexpr uint32_t kIntStreamLengths = 1;
+constexpr uint32_t kIntStreamOffsets = 2;
+constexpr uint32_t kIntStreamLiterals = 3;
+constexpr uint32_t kIntNumStreams = 4;
+
+// Header on our compressed integer data. The archive layout is:
+//
+// [IntHeader][IntChunkInfo per chunk][ANS archive of each stream]
+//
+// with each ANS archive starting at a 16 byte aligned offset
+struct alignas(16) IntHeader {
+  void setMagicAndVersion() {
+    magicAndVersion = (kIntMagic << 16) | kIntVersion;
+  }
+
+  uint32_t getVersion() const {
+    return magicAndVersion & 0xffffU;
+  }
+
+  bool isValidMagicAndVersion() const {
+    return (magicAndVersion >> 16) == kIntMagic && getVersion() == kIntVersion;
+  }
+
+  IntType getIntType() const {
+    return IntType(options & 0xf);
+  }
+
+  void setIntType(IntType it) {
+    assert(uint32_t(it) <= 0xf);
+    options = (options & 0xfffffff0U) | uint32_t(it);
+  }
+
+  bool getUseChecksum() const {
+    return options & 0x10;
+  }
+
+  void setUseChecksum(bool uc) {
+    options = (options & 0xffffffefU) | (uint32_t(uc) << 4);
+  }
+
+  uint32_t getWindowSize() const {
+    return 1U << ((options >> 5) & 0x1f);
+  }
+
+  void setWindowSize(uint32_t windowSize) {
+    assert(isValidIntWindowSize(windowSize));
+    options = (options & 0xfffffc1fU) | (uint32_t(log2(windowSize)) << 5);
+  }
+
+  // (16: magic)(16: version)
+  uint32_t magicAndVersion;
+
+  // (22: unused)(5: log2 window size)(1: checksum)(4: int type)
+  uint32_t options;
+
+  // Number of integer words
+  uint32_t size;
+
+  // Optional checksum of the input data
+  uint32_t checksum;
+
+  // Size in bytes of the ANS archive of each stream
+  uint32_t streamBytes[kIntNumStreams];
+};
+
+static_assert(sizeof(IntHeader) == 32, "");
+
+// Size in bytes of each stream of a chunk, before ANS coding
+struct IntChunkInfo {
+  uint32_t streamSize[kIntNumStreams];
+};
+
+static_assert(sizeof(IntChunkInfo) == 16, "");
+
+inline uint32_t getIntNumChunks(uint32_t size) {
+  return divUp(size, kIntChunkSize);
+}
+
+// Returns the largest size in bytes that each stream of an array of `size`
+// words may have. Every sequence but the last of a chunk has a match of at
+// least kIntMinMatch words, the varint continuation of a length L is at most
+// L / kIntTokenMaxLength bytes, and an offset is at most 3 varint bytes
+inline void getIntMaxStreamSizes(
+    uint32_t size,
+    uint32_t wordSize,
+    uint32_t* streamSize) {
+  uint32_t maxMatches = size / kIntMinMatch;
+
+  streamSize[kIntStreamTokens] = maxMatches + getIntNumChunks(size);
+  streamSize[kIntStreamLengths] = size / kIntTokenMaxLength;
+  streamSize[kIntStreamOffsets] = 3 * maxMatches;
+  streamSize[kIntStreamLiterals] = size * wordSize;
+}
+
+// Returns the ANS configuration used for a stream of an archive
+inline ANSCodecConfig getIntStreamANSConfig(
+    const IntCodecConfig& config,
+    uint32_t stream) {
+  auto ansConfig = config.ansConfig;
+
+  if (stream == kIntStreamLiterals) {
+    ansConfig.numContexts = 1;
+    ansConfig.shuffleWidth = getWordSizeFromIntType(config.intType);
+  }
+
+  return ansConfig;
+}
+
+// Chunks of kIntChunkSize words over all members of a batch
+struct CpuIntChunks {
+  explicit CpuIntChunks(uint32_t numInBatch, const uint32_t* sizes)
+      : chunkStart(numInBatch + 1) {
+    for (uint32_t i = 0; i < numInBatch; ++i) {
+      chunkStart[i + 1] = chunkStart[i] + getIntNumChunks(sizes[i]);
+    }
+  }
+
+  uint32_t getNumChunks() const {
+    return chunkStart.back();
+  }
+
+  // Returns the batch member containing the given chunk
+  uint32_t getBatch(uint32_t chunk) const {
+    return std::upper_bound(chunkStart.begin(), chunkStart.end(), chunk) -
+        chunkStart.begin() - 1;
+  }
+
+  // The first chunk of each batch member
+  std::vector<uint32_t> chunkStart;
+};
+
+} // namespace dietgpu
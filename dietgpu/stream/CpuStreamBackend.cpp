@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+#include "dietgpu/stream/StreamCodec.h"
+
+#include <glog/logging.h>
+#include <string>
+#include <vector>
+
+namespace dietgpu {
+
+CpuStreamCodecBackend::CpuStreamCodecBackend(ThreadPool& pool)
+    : pool_(pool) {}
+
+void CpuStreamCodecBackend::compress(
+    const StreamConfig& config,
+    uint32_t numFrames,
+    const void* in,
+    const uint32_t* inSize,
+    void* out,
+    uint32_t outStride,
+    uint32_t* outSize) {
+  auto inPtrs = std::vector<const void*>(numFrames);
+  auto outPtrs = std::vector<void*>(numFrames);
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    inPtrs[i] = (const uint8_t*)in + (size_t)i * config.frameSize;
+    outPtrs[i] = (uint8_t*)out + (size_t)i * outStride;
+  }
+
+  if (config.floatType == FloatType::kUndefined) {
+    auto ansConfig = config.ansConfig;
+    ansConfig.useChecksum = config.useChecksum;
+
+    ansEncodeBatchCpu(
+        pool_,
+        ansConfig,
+        numFrames,
+        inPtrs.data(),
+        inSize,
+        nullptr,
+        outPtrs.data(),
+        outSize);
+    return;
+  }
+
+  // The float codec takes sizes in float words
+  auto wordSize = getWordSizeFromFloatType(config.floatType);
+  auto inWords = std::vector<uint32_t>(numFrames);
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    inWords[i] = inSize[i] / wordSize;
+  }
+
+  floatCompressCpu(
+      pool_,
+      getStreamFloatConfig(config),
+      numFrames,
+      inPtrs.data(),
+      inWords.data(),
+      outPtrs.data(),
+      outSize);
+}
+
+void CpuStreamCodecBackend::decompress(
+    const StreamConfig& config,
+    uint32_t numFrames,
+    const void* in,
+    uint32_t inStride,
+    const uint32_t* inSize,
+    void* out,
+    const uint32_t* outSize,
+    uint8_t* outSuccess) {
+  auto inPtrs = std::vector<const void*>(numFrames);
+  auto outPtrs = std::vector<void*>(numFrames);
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    inPtrs[i] = (const uint8_t*)in + (size_t)i * inStride;
+    outPtrs[i] = (uint8_t*)out + (size_t)i * config.frameSize;
+  }
+
+  auto decSize = std::vector<uint32_t>(numFrames);
+
+  // Batch members whose checksum did not match
+  std::vector<std::pair<int, std::string>> errorInfo;
+
+  if (config.floatType == FloatType::kUndefined) {
+    auto ansConfig = config.ansConfig;
+    ansConfig.useChecksum = config.useChecksum;
+
+    auto status = ansDecodeBatchCpu(
+        pool_,
+        ansConfig,
+        numFrames,
+        inPtrs.data(),
+        outPtrs.data(),
+        outSize,
+        outSuccess,
+        decSize.data());
+    errorInfo = status.errorInfo;
+
+    for (uint32_t i = 0; i < numFrames; ++i) {
+      outSuccess[i] = outSuccess[i] && decSize[i] == outSize[i];
+    }
+  } else {
+    // The float codec takes sizes in float words
+    auto wordSize = getWordSizeFromFloatType(config.floatType);
+    auto outWords = std::vector<uint32_t>(numFrames);
+    for (uint32_t i = 0; i < numFrames; ++i) {
+      outWords[i] = outSize[i] / wordSize;
+    }
+
+    auto status = floatDecompressCpu(
+        pool_,
+        getStreamFloatConfig(config),
+        numFrames,
+        inPtrs.data(),
+        outPtrs.data(),
+        outWords.data(),
+        outSuccess,
+        decSize.data());
+    errorInfo = status.errorInfo;
+
+    for (uint32_t i = 0; i < numFrames; ++i) {
+      outSuccess[i] = outSuccess[i] && decSize[i] == outWords[i];
+    }
+  }
+
+  for (auto& e : errorInfo) {
+    outSuccess[e.first] = false;
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,339 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dietgpu/ans/CpuANSCodec.h"
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+#include "dietgpu/stream/StreamCodec.h"
+
+using namespace dietgpu;
+
+// Generates data whose low bytes are compressible, viewed as bytes or as
+// floats of a given type
+std::vector<uint8_t> generateData(FloatType ft, size_t num) {
+  std::mt19937 gen(10 + num);
+  std::normal_distribution<float> dist;
+
+  auto out = std::vector<uint8_t>(num);
+
+  if (ft == FloatType::kUndefined) {
+    std::exponential_distribution<float> expDist(20.0f);
+
+    for (auto& v : out) {
+      v = std::min(expDist(gen), 1.0f) * 255.0f;
+    }
+
+    return out;
+  }
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+  for (size_t i = 0; i < num; i += wordSize) {
+    float f = dist(gen);
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(float));
+
+    // bfloat16 fields are the top half of a float32, and serve equally well
+    // as test data for float16
+    if (wordSize == sizeof(uint16_t)) {
+      x >>= 16;
+    }
+
+    std::memcpy(out.data() + i, &x, wordSize);
+  }
+
+  return out;
+}
+
+// Compresses `data` as a stream pushed in pieces of random size up to
+// maxPiece, returning the stream and the number of frames
+std::vector<uint8_t> compressStream(
+    StreamCodecBackend& backend,
+    const StreamConfig& config,
+    const std::vector<uint8_t>& data,
+    size_t maxPiece,
+    uint64_t* numFrames = nullptr) {
+  std::mt19937 gen(1);
+  auto stream = std::vector<uint8_t>();
+
+  auto maxFrame =
+      sizeof(StreamFrameHeader) + getMaxStreamFrameCompressedSize(config);
+
+  StreamCompressor comp(config, backend, [&](const void* p, size_t size) {
+    // Output is emitted a frame at a time
+    EXPECT_LE(size, maxFrame);
+
+    stream.insert(stream.end(), (const uint8_t*)p, (const uint8_t*)p + size);
+  });
+
+  for (size_t pos = 0; pos < data.size();) {
+    size_t n = std::min(data.size() - pos, 1 + gen() % maxPiece);
+    comp.push(data.data() + pos, n);
+    pos += n;
+  }
+
+  comp.finish();
+
+  if (numFrames) {
+    *numFrames = comp.getNumFrames();
+  }
+
+  return stream;
+}
+
+std::vector<uint8_t> decompressStream(
+    StreamCodecBackend& backend,
+    const StreamConfig& config,
+    const std::vector<uint8_t>& stream,
+    size_t maxPiece) {
+  std::mt19937 gen(2);
+  auto out = std::vector<uint8_t>();
+
+  StreamDecompressor decomp(config, backend, [&](const void* p, size_t size) {
+    EXPECT_LE(size, config.frameSize);
+
+    out.insert(out.end(), (const uint8_t*)p, (const uint8_t*)p + size);
+  });
+
+  for (size_t pos = 0; pos < stream.size();) {
+    EXPECT_FALSE(decomp.isFinished());
+
+    size_t n = std::min(stream.size() - pos, 1 + gen() % maxPiece);
+    auto status = decomp.push(stream.data() + pos, n);
+    EXPECT_TRUE(status.error == StreamDecompressError::None);
+    pos += n;
+  }
+
+  EXPECT_TRUE(decomp.isFinished());
+  auto status = decomp.finish();
+  EXPECT_TRUE(status.error == StreamDecompressError::None);
+
+  return out;
+}
+
+TEST(CpuStreamTest, RoundTrip) {
+  ThreadPool pool(4);
+  CpuStreamCodecBackend backend(pool);
+
+  for (auto ft :
+       {FloatType::kUndefined,
+        FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32}) {
+    for (auto checksum : {false, true}) {
+      for (auto blockChecksum : {false, true}) {
+        // 3 frames to a batch, so streams end with both full and partial
+        // batches
+        auto config = StreamConfig(
+            ft,
+            ANSCodecConfig(10, false, kANSMinBlockSize),
+            40000,
+            3,
+            checksum);
+
+        // The frame archives, which compressStream checks against
+        // getMaxStreamFrameCompressedSize, then also hold block checksums
+        config.ansConfig.useBlockChecksum = blockChecksum;
+
+        for (size_t size : {0, 4, 40000, 40004, 120000, 333332}) {
+          auto data = generateData(ft, size);
+
+          uint64_t numFrames = 0;
+          auto stream =
+              compressStream(backend, config, data, 50000, &numFrames);
+          EXPECT_EQ(numFrames, (size + 39999) / 40000 + 1);
+
+          // The frames are decompressed whether received in small or large
+          // pieces
+          EXPECT_EQ(decompressStream(backend, config, stream, 7), data);
+          EXPECT_EQ(decompressStream(backend, config, stream, 100000), data);
+        }
+      }
+    }
+  }
+}
+
+TEST(CpuStreamTest, FrameFormat) {
+  ThreadPool pool(4);
+  CpuStreamCodecBackend backend(pool);
+
+  auto config = StreamConfig(
+      FloatType::kUndefined, ANSCodecConfig(10, false), 10000, 2);
+
+  auto data = generateData(FloatType::kUndefined, 25000);
+  auto stream = compressStream(backend, config, data, 3000);
+
+  // Each frame is a header followed by an ordinary ANS archive
+  size_t pos = 0;
+  for (uint64_t seq = 0; seq < 4; ++seq) {
+    ASSERT_LE(pos + sizeof(StreamFrameHeader), stream.size());
+
+    StreamFrameHeader header;
+    std::memcpy(&header, stream.data() + pos, sizeof(header));
+    pos += sizeof(header);
+
+    EXPECT_TRUE(header.isValidMagicAndVersion());
+    EXPECT_TRUE(header.getFloatType() == FloatType::kUndefined);
+    EXPECT_EQ(header.sequence, seq);
+
+    if (seq == 3) {
+      EXPECT_TRUE(header.getEndOfStream());
+      EXPECT_EQ(header.uncompressedBytes, 0);
+      EXPECT_EQ(header.compressedBytes, 0);
+      break;
+    }
+
+    EXPECT_FALSE(header.getEndOfStream());
+    EXPECT_EQ(header.uncompressedBytes, seq < 2 ? 10000 : 5000);
+
+    auto archive = std::vector<uint8_t>(
+        stream.begin() + pos, stream.begin() + pos + header.compressedBytes);
+    pos += header.compressedBytes;
+
+    auto archivePtr = (const void*)archive.data();
+    auto dec = std::vector<uint8_t>(header.uncompressedBytes);
+    auto decPtr = (void*)dec.data();
+    uint8_t success = false;
+
+    ansDecodeBatchCpu(
+        pool,
+        config.ansConfig,
+        1,
+        &archivePtr,
+        &decPtr,
+        &header.uncompressedBytes,
+        &success,
+        nullptr);
+
+    EXPECT_TRUE(success);
+    EXPECT_TRUE(std::equal(
+        dec.begin(), dec.end(), data.begin() + seq * config.frameSize));
+  }
+
+  EXPECT_EQ(pos, stream.size());
+}
+
+TEST(CpuStreamTest, CorruptStream) {
+  ThreadPool pool(4);
+  CpuStreamCodecBackend backend(pool);
+
+  auto config = StreamConfig(
+      FloatType::kUndefined, ANSCodecConfig(10, false), 10000, 2, true);
+
+  auto data = generateData(FloatType::kUndefined, 45000);
+  auto stream = compressStream(backend, config, data, 3000);
+
+  // Byte offset of each frame header (5 data frames and the end of stream)
+  auto frames = std::vector<size_t>();
+  for (size_t pos = 0; pos < stream.size();) {
+    frames.push_back(pos);
+
+    StreamFrameHeader header;
+    std::memcpy(&header, stream.data() + pos, sizeof(header));
+    pos += sizeof(header) + header.compressedBytes;
+  }
+  ASSERT_EQ(frames.size(), 6);
+
+  // Decompresses `s` in one piece, returning the status of finish() and the
+  // number of bytes passed to the sink
+  auto decompress = [&](const std::vector<uint8_t>& s, size_t* outBytes) {
+    *outBytes = 0;
+    StreamDecompressor decomp(config, backend, [&](const void*, size_t size) {
+      *outBytes += size;
+    });
+
+    auto pushStatus = decomp.push(s.data(), s.size());
+    auto status = decomp.finish();
+
+    // Errors found by push() are reported again by finish()
+    if (pushStatus.error != StreamDecompressError::None) {
+      EXPECT_TRUE(pushStatus.error == status.error);
+    }
+
+    return status;
+  };
+
+  size_t outBytes = 0;
+
+  // Frame 3 (in the second batch) is corrupted: frames 0 to 2 are emitted
+  {
+    auto s = stream;
+    s[frames[3] + sizeof(StreamFrameHeader) + 100] ^= 0xff;
+
+    auto status = decompress(s, &outBytes);
+    EXPECT_TRUE(status.error == StreamDecompressError::FrameDecompressFailed);
+    ASSERT_EQ(status.errorInfo.size(), 1);
+    EXPECT_EQ(status.errorInfo[0].first, 3);
+    EXPECT_EQ(outBytes, 30000);
+  }
+
+  // Frame 2 is missing: the frames before it are emitted
+  {
+    auto s = stream;
+    s.erase(s.begin() + frames[2], s.begin() + frames[3]);
+
+    auto status = decompress(s, &outBytes);
+    EXPECT_TRUE(status.error == StreamDecompressError::InvalidFrame);
+    ASSERT_EQ(status.errorInfo.size(), 1);
+    EXPECT_EQ(status.errorInfo[0].first, 2);
+    EXPECT_EQ(outBytes, 20000);
+  }
+
+  // A frame header with a bad magic number
+  {
+    auto s = stream;
+    s[frames[1] + 3] ^= 0xff;
+
+    auto status = decompress(s, &outBytes);
+    EXPECT_TRUE(status.error == StreamDecompressError::InvalidFrame);
+    EXPECT_EQ(outBytes, 10000);
+  }
+
+  // A frame larger than the configured frame size
+  {
+    auto s = stream;
+    StreamFrameHeader header;
+    std::memcpy(&header, s.data() + frames[0], sizeof(header));
+    header.uncompressedBytes = config.frameSize + 1;
+    std::memcpy(s.data() + frames[0], &header, sizeof(header));
+
+    auto status = decompress(s, &outBytes);
+    EXPECT_TRUE(status.error == StreamDecompressError::InvalidFrame);
+    EXPECT_EQ(outBytes, 0);
+  }
+
+  // A stream truncated within frame 4, and one without its end of stream
+  // frame: all complete frames are emitted
+  for (auto end : {frames[4] + 50, frames[5]}) {
+    auto s = std::vector<uint8_t>(stream.begin(), stream.begin() + end);
+
+    auto status = decompress(s, &outBytes);
+    EXPECT_TRUE(status.error == StreamDecompressError::Truncated);
+    EXPECT_EQ(outBytes, end == frames[5] ? 45000 : 40000);
+  }
+
+  // Data following the end of stream frame
+  {
+    auto s = stream;
+    s.push_back(0);
+
+    auto status = decompress(s, &outBytes);
+    EXPECT_TRUE(status.error == StreamDecompressError::InvalidFrame);
+    EXPECT_EQ(outBytes, 45000);
+  }
+
+  // The intact stream
+  auto status = decompress(stream, &outBytes);
+  EXPECT_TRUE(status.error == StreamDecompressError::None);
+  EXPECT_EQ(outBytes, 45000);
+}
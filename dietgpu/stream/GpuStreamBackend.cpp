@@ -0,0 +1,197 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/ans/GpuANSCodec.h"
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+#include "dietgpu/stream/StreamCodec.h"
+#include "dietgpu/utils/DeviceUtils.h"
+#include "dietgpu/utils/StackDeviceMemory.h"
+
+#include <glog/logging.h>
+#include <string>
+#include <vector>
+
+namespace dietgpu {
+
+GpuStreamCodecBackend::GpuStreamCodecBackend(
+    StackDeviceMemory& res,
+    cudaStream_t stream)
+    : res_(res), stream_(stream) {}
+
+void GpuStreamCodecBackend::compress(
+    const StreamConfig& config,
+    uint32_t numFrames,
+    const void* in,
+    const uint32_t* inSize,
+    void* out,
+    uint32_t outStride,
+    uint32_t* outSize) {
+  // All frames but the last are full
+  size_t inBytes =
+      (size_t)(numFrames - 1) * config.frameSize + inSize[numFrames - 1];
+
+  auto in_dev = res_.alloc<uint8_t>(stream_, inBytes);
+  CUDA_VERIFY(cudaMemcpyAsync(
+      in_dev.data(), in, inBytes, cudaMemcpyHostToDevice, stream_));
+
+  auto out_dev = res_.alloc<uint8_t>(stream_, (size_t)numFrames * outStride);
+  auto outSize_dev = res_.alloc<uint32_t>(stream_, numFrames);
+
+  auto inPtrs = std::vector<const void*>(numFrames);
+  auto outPtrs = std::vector<void*>(numFrames);
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    inPtrs[i] = in_dev.data() + (size_t)i * config.frameSize;
+    outPtrs[i] = out_dev.data() + (size_t)i * outStride;
+  }
+
+  if (config.floatType == FloatType::kUndefined) {
+    auto ansConfig = config.ansConfig;
+    ansConfig.useChecksum = config.useChecksum;
+
+    ansEncodeBatchPointer(
+        res_,
+        ansConfig,
+        numFrames,
+        inPtrs.data(),
+        inSize,
+        nullptr,
+        outPtrs.data(),
+        outSize_dev.data(),
+        stream_);
+  } else {
+    // The float codec takes sizes in float words
+    auto wordSize = getWordSizeFromFloatType(config.floatType);
+    auto inWords = std::vector<uint32_t>(numFrames);
+    for (uint32_t i = 0; i < numFrames; ++i) {
+      inWords[i] = inSize[i] / wordSize;
+    }
+
+    floatCompress(
+        res_,
+        getStreamFloatConfig(config),
+        numFrames,
+        inPtrs.data(),
+        inWords.data(),
+        outPtrs.data(),
+        outSize_dev.data(),
+        stream_);
+  }
+
+  // Only the used part of each archive is copied back
+  auto sizes = outSize_dev.copyToHost(stream_);
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    outSize[i] = sizes[i];
+
+    CUDA_VERIFY(cudaMemcpyAsync(
+        (uint8_t*)out + (size_t)i * outStride,
+        outPtrs[i],
+        sizes[i],
+        cudaMemcpyDeviceToHost,
+        stream_));
+  }
+
+  CUDA_VERIFY(cudaStreamSynchronize(stream_));
+}
+
+void GpuStreamCodecBackend::decompress(
+    const StreamConfig& config,
+    uint32_t numFrames,
+    const void* in,
+    uint32_t inStride,
+    const uint32_t* inSize,
+    void* out,
+    const uint32_t* outSize,
+    uint8_t* outSuccess) {
+  auto in_dev = res_.alloc<uint8_t>(stream_, (size_t)numFrames * inStride);
+  auto out_dev =
+      res_.alloc<uint8_t>(stream_, (size_t)numFrames * config.frameSize);
+  auto outSuccess_dev = res_.alloc<uint8_t>(stream_, numFrames);
+  auto decSize_dev = res_.alloc<uint32_t>(stream_, numFrames);
+
+  auto inPtrs = std::vector<const void*>(numFrames);
+  auto outPtrs = std::vector<void*>(numFrames);
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    inPtrs[i] = in_dev.data() + (size_t)i * inStride;
+    outPtrs[i] = out_dev.data() + (size_t)i * config.frameSize;
+
+    CUDA_VERIFY(cudaMemcpyAsync(
+        (void*)inPtrs[i],
+        (const uint8_t*)in + (size_t)i * inStride,
+        inSize[i],
+        cudaMemcpyHostToDevice,
+        stream_));
+  }
+
+  // The expected size of each frame, in the units of the codec
+  auto expectedSize = std::vector<uint32_t>(outSize, outSize + numFrames);
+
+  // Batch members whose checksum did not match
+  std::vector<std::pair<int, std::string>> errorInfo;
+
+  if (config.floatType == FloatType::kUndefined) {
+    auto ansConfig = config.ansConfig;
+    ansConfig.useChecksum = config.useChecksum;
+
+    auto status = ansDecodeBatchPointer(
+        res_,
+        ansConfig,
+        numFrames,
+        inPtrs.data(),
+        outPtrs.data(),
+        expectedSize.data(),
+        outSuccess_dev.data(),
+        decSize_dev.data(),
+        stream_);
+    errorInfo = status.errorInfo;
+  } else {
+    // The float codec takes sizes in float words
+    auto wordSize = getWordSizeFromFloatType(config.floatType);
+    for (auto& s : expectedSize) {
+      s /= wordSize;
+    }
+
+    auto status = floatDecompress(
+        res_,
+        getStreamFloatConfig(config),
+        numFrames,
+        inPtrs.data(),
+        outPtrs.data(),
+        expectedSize.data(),
+        outSuccess_dev.data(),
+        decSize_dev.data(),
+        stream_);
+    errorInfo = status.errorInfo;
+  }
+
+  auto success = outSuccess_dev.copyToHost(stream_);
+  auto decSize = decSize_dev.copyToHost(stream_);
+
+  for (auto& e : errorInfo) {
+    success[e.first] = false;
+  }
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    outSuccess[i] = success[i] && decSize[i] == expectedSize[i];
+
+    if (outSuccess[i]) {
+      CUDA_VERIFY(cudaMemcpyAsync(
+          (uint8_t*)out + (size_t)i * config.frameSize,
+          outPtrs[i],
+          outSize[i],
+          cudaMemcpyDeviceToHost,
+          stream_));
+    }
+  }
+
+  CUDA_VERIFY(cudaStreamSynchronize(stream_));
+}
+
+} // namespace dietgpu
@@ -0,0 +1,381 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/stream/StreamCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+#include "dietgpu/utils/StaticUtils.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace dietgpu {
+
+namespace {
+
+void checkStreamConfig(const StreamConfig& config) {
+  CHECK_GT(config.frameSize, 0);
+  CHECK_GT(config.framesPerBatch, 0);
+
+  if (config.floatType != FloatType::kUndefined) {
+    CHECK_EQ(config.frameSize % getWordSizeFromFloatType(config.floatType), 0)
+        << "frame size must be a multiple of the float word size";
+  }
+}
+
+} // namespace
+
+uint32_t getMaxStreamFrameCompressedSize(const StreamConfig& config) {
+  uint32_t size = 0;
+
+  if (config.floatType == FloatType::kUndefined) {
+    size = getMaxCompressedSize(
+        config.frameSize,
+        config.ansConfig.blockSize,
+        config.ansConfig.useWideState,
+        config.ansConfig.getMaxTables(),
+        config.ansConfig.useBlockChecksum);
+  } else {
+    auto floatConfig = getStreamFloatConfig(config);
+
+    size = getMaxFloatCompressedSize(
+        config.floatType,
+        config.frameSize / getWordSizeFromFloatType(config.floatType),
+        floatConfig.ansConfig.blockSize,
+        floatConfig.ansConfig.useWideState,
+        floatConfig.ansConfig.getMaxTables(),
+        floatConfig.predictor,
+        floatConfig.useBlockChecksum);
+  }
+
+  // Archives are held at this stride, and must be 16 byte aligned
+  return roundUp(size, 16U);
+}
+
+FloatCodecConfig getStreamFloatConfig(const StreamConfig& config) {
+  // Checksums are held at the float level
+  auto ansConfig = config.ansConfig;
+  ansConfig.useChecksum = false;
+  ansConfig.useBlockChecksum = false;
+
+  auto floatConfig =
+      FloatCodecConfig(config.floatType, ansConfig, false, config.useChecksum);
+  floatConfig.useBlockChecksum = config.ansConfig.useBlockChecksum;
+
+  return floatConfig;
+}
+
+StreamCodecBackend::~StreamCodecBackend() = default;
+
+//
+// StreamCompressor
+//
+
+StreamCompressor::StreamCompressor(
+    const StreamConfig& config,
+    StreamCodecBackend& backend,
+    StreamSink sink)
+    : config_(config),
+      backend_(backend),
+      sink_(std::move(sink)),
+      maxCompressedSize_(getMaxStreamFrameCompressedSize(config)),
+      in_((size_t)config.framesPerBatch * config.frameSize),
+      inSize_(0),
+      out_(
+          (size_t)config.framesPerBatch *
+          (sizeof(StreamFrameHeader) + maxCompressedSize_)),
+      frameInSize_(config.framesPerBatch),
+      frameOutSize_(config.framesPerBatch),
+      sequence_(0),
+      finished_(false) {
+  checkStreamConfig(config);
+}
+
+void StreamCompressor::push(const void* data, size_t size) {
+  CHECK(!finished_) << "data pushed to a finished stream";
+
+  auto p = (const uint8_t*)data;
+
+  while (size > 0) {
+    size_t n = std::min(size, in_.size() - inSize_);
+
+    std::memcpy(in_.data() + inSize_, p, n);
+    inSize_ += n;
+    p += n;
+    size -= n;
+
+    if (inSize_ == in_.size()) {
+      flush();
+    }
+  }
+}
+
+void StreamCompressor::finish() {
+  CHECK(!finished_) << "stream already finished";
+
+  flush();
+
+  StreamFrameHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.setMagicAndVersion();
+  header.setFloatType(config_.floatType);
+  header.setEndOfStream(true);
+  header.sequence = sequence_++;
+
+  sink_(&header, sizeof(header));
+  finished_ = true;
+}
+
+uint64_t StreamCompressor::getNumFrames() const {
+  return sequence_;
+}
+
+void StreamCompressor::flush() {
+  if (inSize_ == 0) {
+    return;
+  }
+
+  if (config_.floatType != FloatType::kUndefined) {
+    CHECK_EQ(inSize_ % getWordSizeFromFloatType(config_.floatType), 0)
+        << "stream length must be a multiple of the float word size";
+  }
+
+  uint32_t numFrames = divUp(inSize_, config_.frameSize);
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    frameInSize_[i] = std::min(
+        (size_t)config_.frameSize, inSize_ - (size_t)i * config_.frameSize);
+  }
+
+  // Archives are written after the space for their frame header
+  uint32_t outStride = sizeof(StreamFrameHeader) + maxCompressedSize_;
+
+  backend_.compress(
+      config_,
+      numFrames,
+      in_.data(),
+      frameInSize_.data(),
+      out_.data() + sizeof(StreamFrameHeader),
+      outStride,
+      frameOutSize_.data());
+
+  for (uint32_t i = 0; i < numFrames; ++i) {
+    auto frame = out_.data() + (size_t)i * outStride;
+
+    StreamFrameHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.setMagicAndVersion();
+    header.setFloatType(config_.floatType);
+    header.sequence = sequence_++;
+    header.uncompressedBytes = frameInSize_[i];
+    header.compressedBytes = frameOutSize_[i];
+    std::memcpy(frame, &header, sizeof(header));
+
+    sink_(frame, sizeof(header) + frameOutSize_[i]);
+  }
+
+  inSize_ = 0;
+}
+
+//
+// StreamDecompressor
+//
+
+StreamDecompressor::StreamDecompressor(
+    const StreamConfig& config,
+    StreamCodecBackend& backend,
+    StreamSink sink)
+    : config_(config),
+      backend_(backend),
+      sink_(std::move(sink)),
+      maxCompressedSize_(getMaxStreamFrameCompressedSize(config)),
+      headerBytes_(0),
+      archiveBytes_(0),
+      in_((size_t)config.framesPerBatch * maxCompressedSize_),
+      out_((size_t)config.framesPerBatch * config.frameSize),
+      frameInSize_(config.framesPerBatch),
+      frameOutSize_(config.framesPerBatch),
+      frameSuccess_(config.framesPerBatch),
+      numFrames_(0),
+      sequence_(0),
+      finished_(false),
+      closed_(false) {
+  checkStreamConfig(config);
+}
+
+StreamDecompressStatus StreamDecompressor::push(
+    const void* data,
+    size_t size) {
+  CHECK(!closed_) << "data pushed to a finished stream";
+
+  auto p = (const uint8_t*)data;
+
+  while (size > 0 && status_.error == StreamDecompressError::None) {
+    if (finished_) {
+      setError(
+          StreamDecompressError::InvalidFrame,
+          sequence_,
+          "data found past the end of the stream");
+      break;
+    }
+
+    // Receive the frame header
+    if (headerBytes_ < sizeof(StreamFrameHeader)) {
+      size_t n = std::min(size, sizeof(StreamFrameHeader) - headerBytes_);
+
+      std::memcpy((uint8_t*)&header_ + headerBytes_, p, n);
+      headerBytes_ += n;
+      p += n;
+      size -= n;
+
+      if (headerBytes_ < sizeof(StreamFrameHeader)) {
+        break;
+      }
+
+      if (!checkHeader()) {
+        break;
+      }
+
+      ++sequence_;
+      archiveBytes_ = 0;
+
+      if (header_.getEndOfStream()) {
+        finished_ = true;
+        headerBytes_ = 0;
+        flush();
+        continue;
+      }
+    }
+
+    // Receive the archive into the frame's slot in the batch
+    size_t n = std::min(size, header_.compressedBytes - archiveBytes_);
+
+    std::memcpy(
+        in_.data() + (size_t)numFrames_ * maxCompressedSize_ + archiveBytes_,
+        p,
+        n);
+    archiveBytes_ += n;
+    p += n;
+    size -= n;
+
+    if (archiveBytes_ == header_.compressedBytes) {
+      frameInSize_[numFrames_] = header_.compressedBytes;
+      frameOutSize_[numFrames_] = header_.uncompressedBytes;
+      ++numFrames_;
+      headerBytes_ = 0;
+
+      if (numFrames_ == config_.framesPerBatch) {
+        flush();
+      }
+    }
+  }
+
+  return status_;
+}
+
+StreamDecompressStatus StreamDecompressor::finish() {
+  CHECK(!closed_) << "stream already finished";
+  closed_ = true;
+
+  if (status_.error == StreamDecompressError::None && !finished_) {
+    // Emit the complete frames received, so that as much of a truncated
+    // stream as possible is recovered
+    flush();
+
+    if (status_.error == StreamDecompressError::None) {
+      setError(
+          StreamDecompressError::Truncated,
+          sequence_,
+          "stream ended before its end of stream frame");
+    }
+  }
+
+  return status_;
+}
+
+bool StreamDecompressor::isFinished() const {
+  return finished_;
+}
+
+bool StreamDecompressor::checkHeader() {
+  std::stringstream ss;
+
+  if (!header_.isValidMagicAndVersion()) {
+    ss << "invalid stream frame magic and version " << std::hex
+       << header_.magicAndVersion;
+  } else if (header_.getFloatType() != config_.floatType) {
+    ss << "stream has float type " << uint32_t(header_.getFloatType())
+       << " but expected " << uint32_t(config_.floatType);
+  } else if (header_.sequence != sequence_) {
+    ss << "stream frames missing or out of order: found frame "
+       << header_.sequence;
+  } else if (header_.uncompressedBytes > config_.frameSize) {
+    ss << "stream frame of " << header_.uncompressedBytes
+       << " bytes larger than the configured frame size";
+  } else if (header_.compressedBytes > maxCompressedSize_) {
+    ss << "stream frame archive of " << header_.compressedBytes
+       << " bytes larger than the maximum size";
+  } else if (header_.getEndOfStream() && header_.compressedBytes != 0) {
+    ss << "end of stream frame holds data";
+  } else if (!header_.getEndOfStream() && header_.compressedBytes == 0) {
+    // An archive is never empty
+    ss << "stream frame has an empty archive";
+  } else {
+    return true;
+  }
+
+  // The frames preceding the invalid one are still emitted
+  flush();
+  setError(StreamDecompressError::InvalidFrame, sequence_, ss.str());
+  return false;
+}
+
+void StreamDecompressor::flush() {
+  if (numFrames_ == 0) {
+    return;
+  }
+
+  backend_.decompress(
+      config_,
+      numFrames_,
+      in_.data(),
+      maxCompressedSize_,
+      frameInSize_.data(),
+      out_.data(),
+      frameOutSize_.data(),
+      frameSuccess_.data());
+
+  // The sequence number of the first frame held (sequence_ has also counted
+  // the end of stream frame, if received)
+  uint64_t firstSequence = sequence_ - numFrames_ - (finished_ ? 1 : 0);
+
+  for (uint32_t i = 0; i < numFrames_; ++i) {
+    if (!frameSuccess_[i]) {
+      setError(
+          StreamDecompressError::FrameDecompressFailed,
+          firstSequence + i,
+          "failed to decompress stream frame");
+      break;
+    }
+
+    sink_(out_.data() + (size_t)i * config_.frameSize, frameOutSize_[i]);
+  }
+
+  numFrames_ = 0;
+}
+
+void StreamDecompressor::setError(
+    StreamDecompressError error,
+    uint64_t sequence,
+    const std::string& info) {
+  if (status_.error == StreamDecompressError::None) {
+    status_.error = error;
+    status_.errorInfo.push_back(std::make_pair(sequence, info));
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,400 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+namespace dietgpu {
+
+//
+// Streaming compression of inputs of unbounded length
+//
+// A stream is cut into frames of a fixed number of input bytes (the last frame
+// may be shorter), and each frame is compressed independently into an ordinary
+// ANS or float archive. A stream is a sequence of frames, each a
+// StreamFrameHeader followed by its archive, terminated by a frame with no
+// data that has the end of stream flag set:
+//
+// [header 0][archive 0][header 1][archive 1] ... [header n (end)]
+//
+// StreamCompressor and StreamDecompressor accept data in pieces of any size
+// and hand their output to a callback, holding at most framesPerBatch frames
+// at a time, so their memory use does not depend upon the length of the
+// stream. The frames held are (de)compressed together as one batch by a
+// StreamCodecBackend, on either the CPU or the GPU.
+//
+
+class StackDeviceMemory;
+
+// magic number to verify frame integrity
+constexpr uint32_t kStreamMagic = 0xf4a3;
+
+// current stream format version number
+constexpr uint32_t kStreamVersion = 0x0001;
+
+// Default number of input bytes per frame
+constexpr uint32_t kStreamDefaultFrameSize = 16 * 1024 * 1024;
+
+// Default number of frames compressed or decompressed as a batch
+constexpr uint32_t kStreamDefaultFramesPerBatch = 4;
+
+struct StreamConfig {
+  inline StreamConfig()
+      : floatType(FloatType::kUndefined),
+        useChecksum(false),
+        frameSize(kStreamDefaultFrameSize),
+        framesPerBatch(kStreamDefaultFramesPerBatch) {}
+
+  inline StreamConfig(
+      FloatType ft,
+      const ANSCodecConfig& ansConf,
+      uint32_t frameSz = kStreamDefaultFrameSize,
+      uint32_t framesPerB = kStreamDefaultFramesPerBatch,
+      bool checksum = false)
+      : floatType(ft),
+        useChecksum(checksum),
+        ansConfig(ansConf),
+        frameSize(frameSz),
+        framesPerBatch(framesPerB) {}
+
+  // The type of floating point data in the stream, which is compressed with
+  // the float codec; FloatType::kUndefined means the stream is of bytes,
+  // compressed with the ANS codec
+  FloatType floatType;
+
+  // Whether each frame's archive holds a checksum of its data, verified on
+  // decompression
+  bool useChecksum;
+
+  // Configuration of the ANS codec (alone, or within the float codec). Its
+  // useChecksum is ignored in favor of the above. For a float stream, its
+  // useBlockChecksum stores the block checksums at the float level (see
+  // FloatCodecConfig::useBlockChecksum)
+  ANSCodecConfig ansConfig;
+
+  // Number of input bytes per frame, which for floating point data must be a
+  // multiple of the word size. The decompressor must use the same value as the
+  // compressor
+  uint32_t frameSize;
+
+  // Number of frames that are compressed or decompressed together as a batch
+  uint32_t framesPerBatch;
+};
+
+// Header preceding the archive of each frame in a stream
+struct StreamFrameHeader {
+  void setMagicAndVersion() {
+    magicAndVersion = (kStreamMagic << 16) | kStreamVersion;
+  }
+
+  bool isValidMagicAndVersion() const {
+    return (magicAndVersion >> 16) == kStreamMagic &&
+        (magicAndVersion & 0xffffU) == kStreamVersion;
+  }
+
+  FloatType getFloatType() const {
+    return FloatType(options & 0xf);
+  }
+
+  void setFloatType(FloatType ft) {
+    options = (options & 0xfffffff0U) | uint32_t(ft);
+  }
+
+  bool getEndOfStream() const {
+    return options & 0x10;
+  }
+
+  void setEndOfStream(bool end) {
+    options = (options & 0xffffffefU) | (uint32_t(end) << 4);
+  }
+
+  // (16: magic)(16: version)
+  uint32_t magicAndVersion;
+
+  // (27: unused)(1: end of stream)(4: float type)
+  uint32_t options;
+
+  // Position of the frame in the stream, starting at 0
+  uint64_t sequence;
+
+  // Number of bytes of data in the frame
+  uint32_t uncompressedBytes;
+
+  // Size in bytes of the archive following the header
+  uint32_t compressedBytes;
+
+  uint32_t unused0;
+  uint32_t unused1;
+};
+
+static_assert(sizeof(StreamFrameHeader) == 32, "");
+
+// Returns the maximum size of the archive of a single frame
+uint32_t getMaxStreamFrameCompressedSize(const StreamConfig& config);
+
+// Returns the float codec configuration with which the frames of a float
+// stream are compressed and decompressed
+FloatCodecConfig getStreamFloatConfig(const StreamConfig& config);
+
+// Receives the output of a StreamCompressor or StreamDecompressor
+using StreamSink = std::function<void(const void* data, size_t size)>;
+
+enum class StreamDecompressError : uint32_t {
+  None = 0,
+  // A frame header is invalid, does not match the config or is out of
+  // sequence, or data follows the end of stream frame
+  InvalidFrame = 1,
+  // A frame's archive failed to decompress (or its checksum did not match)
+  FrameDecompressFailed = 2,
+  // The stream ended before its end of stream frame
+  Truncated = 3,
+};
+
+// Error status for stream decompression
+struct StreamDecompressStatus {
+  inline StreamDecompressStatus() : error(StreamDecompressError::None) {}
+
+  // Overall error status
+  StreamDecompressError error;
+
+  // Error-specific information: the sequence number of the frame at fault,
+  // with a description
+  std::vector<std::pair<uint64_t, std::string>> errorInfo;
+};
+
+/// Compresses and decompresses batches of frames for a StreamCompressor or
+/// StreamDecompressor. All pointers passed are host pointers; frame i of a
+/// batch is located at byte offset i * stride of the given buffer
+class StreamCodecBackend {
+ public:
+  virtual ~StreamCodecBackend();
+
+  /// Compresses frames of inSize[i] bytes held at a stride of
+  /// config.frameSize in `in` into archives at a stride of outStride in
+  /// `out`, writing the archive sizes to outSize
+  virtual void compress(
+      const StreamConfig& config,
+      uint32_t numFrames,
+      const void* in,
+      const uint32_t* inSize,
+      void* out,
+      uint32_t outStride,
+      uint32_t* outSize) = 0;
+
+  /// Decompresses archives of inSize[i] bytes held at a stride of inStride in
+  /// `in` into frames at a stride of config.frameSize in `out`. Sets
+  /// outSuccess[i] to whether the archive decompressed successfully to
+  /// exactly outSize[i] bytes
+  virtual void decompress(
+      const StreamConfig& config,
+      uint32_t numFrames,
+      const void* in,
+      uint32_t inStride,
+      const uint32_t* inSize,
+      void* out,
+      const uint32_t* outSize,
+      uint8_t* outSuccess) = 0;
+};
+
+/// Runs the codecs on the host (see CpuANSCodec.h and CpuFloatCodec.h)
+class CpuStreamCodecBackend : public StreamCodecBackend {
+ public:
+  explicit CpuStreamCodecBackend(ThreadPool& pool);
+
+  void compress(
+      const StreamConfig& config,
+      uint32_t numFrames,
+      const void* in,
+      const uint32_t* inSize,
+      void* out,
+      uint32_t outStride,
+      uint32_t* outSize) override;
+
+  void decompress(
+      const StreamConfig& config,
+      uint32_t numFrames,
+      const void* in,
+      uint32_t inStride,
+      const uint32_t* inSize,
+      void* out,
+      const uint32_t* outSize,
+      uint8_t* outSuccess) override;
+
+ private:
+  ThreadPool& pool_;
+};
+
+/// Runs the codecs on the current GPU. Each batch is copied to the device,
+/// (de)compressed and copied back using temporary memory from `res`, and the
+/// calls synchronize with `stream` before returning
+class GpuStreamCodecBackend : public StreamCodecBackend {
+ public:
+  GpuStreamCodecBackend(StackDeviceMemory& res, cudaStream_t stream);
+
+  void compress(
+      const StreamConfig& config,
+      uint32_t numFrames,
+      const void* in,
+      const uint32_t* inSize,
+      void* out,
+      uint32_t outStride,
+      uint32_t* outSize) override;
+
+  void decompress(
+      const StreamConfig& config,
+      uint32_t numFrames,
+      const void* in,
+      uint32_t inStride,
+      const uint32_t* inSize,
+      void* out,
+      const uint32_t* outSize,
+      uint8_t* outSuccess) override;
+
+ private:
+  StackDeviceMemory& res_;
+  cudaStream_t stream_;
+};
+
+/// Compresses a stream of data supplied in pieces into a sequence of frames,
+/// each of which is passed to the sink (header and archive together) as soon
+/// as it is produced
+class StreamCompressor {
+ public:
+  StreamCompressor(
+      const StreamConfig& config,
+      StreamCodecBackend& backend,
+      StreamSink sink);
+
+  /// Appends size bytes to the stream, compressing and emitting every batch
+  /// of frames that is filled
+  void push(const void* data, size_t size);
+
+  /// Compresses and emits the data pushed but not yet emitted, followed by the
+  /// end of stream frame. No data may be pushed afterwards
+  void finish();
+
+  /// Returns the number of frames emitted so far, including the end of stream
+  /// frame
+  uint64_t getNumFrames() const;
+
+ private:
+  /// Compresses and emits all frames held
+  void flush();
+
+  const StreamConfig config_;
+  StreamCodecBackend& backend_;
+  StreamSink sink_;
+
+  /// Maximum size of a frame archive
+  const uint32_t maxCompressedSize_;
+
+  /// Input held for the current batch, framesPerBatch * frameSize bytes
+  std::vector<uint8_t> in_;
+
+  /// Number of bytes held in in_
+  size_t inSize_;
+
+  /// Frame header and archive of each frame of the batch
+  std::vector<uint8_t> out_;
+
+  std::vector<uint32_t> frameInSize_;
+  std::vector<uint32_t> frameOutSize_;
+
+  /// Sequence number of the next frame
+  uint64_t sequence_;
+
+  bool finished_;
+};
+
+/// Decompresses a stream of frames supplied in pieces, passing the data of
+/// each frame to the sink in order.
+/// A corrupted or truncated stream is reported through the returned status:
+/// the frames preceding the first error are passed to the sink, and once an
+/// error is found all further data is ignored and the same status returned
+class StreamDecompressor {
+ public:
+  StreamDecompressor(
+      const StreamConfig& config,
+      StreamCodecBackend& backend,
+      StreamSink sink);
+
+  /// Appends size bytes of compressed stream, decompressing and emitting every
+  /// batch of frames that is completed
+  StreamDecompressStatus push(const void* data, size_t size);
+
+  /// Decompresses and emits any frames held, and reports whether the stream
+  /// was complete, i.e., the end of stream frame was received. No data may be
+  /// pushed afterwards
+  StreamDecompressStatus finish();
+
+  /// Returns whether the end of stream frame has been received
+  bool isFinished() const;
+
+ private:
+  /// Validates the frame header just received. If invalid, emits the frames
+  /// held and records the error
+  bool checkHeader();
+
+  /// Decompresses and emits all frames held, until a frame fails
+  void flush();
+
+  /// Records the first error found in the stream
+  void setError(
+      StreamDecompressError error,
+      uint64_t sequence,
+      const std::string& info);
+
+  const StreamConfig config_;
+  StreamCodecBackend& backend_;
+  StreamSink sink_;
+
+  /// Maximum size of a frame archive
+  const uint32_t maxCompressedSize_;
+
+  /// Header of the frame currently being received
+  StreamFrameHeader header_;
+
+  /// Number of bytes received of the current frame's header, then of its
+  /// archive
+  size_t headerBytes_;
+  size_t archiveBytes_;
+
+  /// Archives of the frames of the current batch, at a stride of
+  /// maxCompressedSize_
+  std::vector<uint8_t> in_;
+
+  /// Decompressed data of the frames of the current batch
+  std::vector<uint8_t> out_;
+
+  std::vector<uint32_t> frameInSize_;
+  std::vector<uint32_t> frameOutSize_;
+  std::vector<uint8_t> frameSuccess_;
+
+  /// Number of frames held in in_
+  uint32_t numFrames_;
+
+  /// Sequence number of the next frame
+  uint64_t sequence_;
+
+  /// Whether the end of stream frame has been received
+  bool finished_;
+
+  /// Whether finish() has been called
+  bool closed_;
+
+  /// The first error found, after which the stream is no longer processed
+  StreamDecompressStatus status_;
+};
+
+} // namespace dietgpu
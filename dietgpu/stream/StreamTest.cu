@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/float/GpuFloatUtils.cuh"
+#include "dietgpu/stream/StreamCodec.h"
+#include "dietgpu/utils/DeviceUtils.h"
+#include "dietgpu/utils/StackDeviceMemory.h"
+
+using namespace dietgpu;
+
+std::vector<uint8_t> generateData(FloatType ft, size_t num) {
+  std::mt19937 gen(10 + num);
+  std::normal_distribution<float> dist;
+
+  auto out = std::vector<uint8_t>(num);
+
+  if (ft == FloatType::kUndefined) {
+    std::exponential_distribution<float> expDist(20.0f);
+
+    for (auto& v : out) {
+      v = std::min(expDist(gen), 1.0f) * 255.0f;
+    }
+
+    return out;
+  }
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+  for (size_t i = 0; i < num; i += wordSize) {
+    float f = dist(gen);
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(float));
+
+    if (wordSize == sizeof(uint16_t)) {
+      x >>= 16;
+    }
+
+    std::memcpy(out.data() + i, &x, wordSize);
+  }
+
+  return out;
+}
+
+std::vector<uint8_t> compressStream(
+    StreamCodecBackend& backend,
+    const StreamConfig& config,
+    const std::vector<uint8_t>& data,
+    size_t maxPiece) {
+  std::mt19937 gen(1);
+  auto stream = std::vector<uint8_t>();
+
+  StreamCompressor comp(config, backend, [&](const void* p, size_t size) {
+    stream.insert(stream.end(), (const uint8_t*)p, (const uint8_t*)p + size);
+  });
+
+  for (size_t pos = 0; pos < data.size();) {
+    size_t n = std::min(data.size() - pos, 1 + gen() % maxPiece);
+    comp.push(data.data() + pos, n);
+    pos += n;
+  }
+
+  comp.finish();
+  return stream;
+}
+
+std::vector<uint8_t> decompressStream(
+    StreamCodecBackend& backend,
+    const StreamConfig& config,
+    const std::vector<uint8_t>& stream,
+    size_t maxPiece) {
+  std::mt19937 gen(2);
+  auto out = std::vector<uint8_t>();
+
+  StreamDecompressor decomp(config, backend, [&](const void* p, size_t size) {
+    out.insert(out.end(), (const uint8_t*)p, (const uint8_t*)p + size);
+  });
+
+  for (size_t pos = 0; pos < stream.size();) {
+    size_t n = std::min(stream.size() - pos, 1 + gen() % maxPiece);
+    auto status = decomp.push(stream.data() + pos, n);
+    EXPECT_TRUE(status.error == StreamDecompressError::None);
+    pos += n;
+  }
+
+  auto status = decomp.finish();
+  EXPECT_TRUE(status.error == StreamDecompressError::None);
+  return out;
+}
+
+TEST(StreamTest, RoundTrip) {
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  GpuStreamCodecBackend backend(res, stream);
+
+  for (auto ft :
+       {FloatType::kUndefined,
+        FloatType::kFloat16,
+        FloatType::kBFloat16,
+        FloatType::kFloat32}) {
+    for (auto checksum : {false, true}) {
+      auto config = StreamConfig(
+          ft, ANSCodecConfig(10, false), 1024 * 1024, 3, checksum);
+
+      for (size_t size : {0, 4, 1024 * 1024, 5 * 1024 * 1024 + 12}) {
+        auto data = generateData(ft, size);
+        auto comp = compressStream(backend, config, data, 300000);
+
+        EXPECT_EQ(decompressStream(backend, config, comp, 7777), data);
+        EXPECT_EQ(decompressStream(backend, config, comp, 3000000), data);
+      }
+    }
+  }
+}
+
+TEST(StreamTest, CpuCompatible) {
+  auto res = makeStackMemory();
+  auto stream = CudaStream::makeNonBlocking();
+  GpuStreamCodecBackend gpuBackend(res, stream);
+
+  ThreadPool pool(4);
+  CpuStreamCodecBackend cpuBackend(pool);
+
+  // Streams produced by either backend are decompressed by the other
+  for (auto ft : {FloatType::kUndefined, FloatType::kFloat32}) {
+    auto config = StreamConfig(ft, ANSCodecConfig(10, false), 256 * 1024, 2);
+
+    auto data = generateData(ft, 1000 * 1024);
+
+    auto gpuComp = compressStream(gpuBackend, config, data, 100000);
+    EXPECT_EQ(decompressStream(cpuBackend, config, gpuComp, 100000), data);
+
+    auto cpuComp = compressStream(cpuBackend, config, data, 100000);
+    EXPECT_EQ(decompressStream(gpuBackend, config, cpuComp, 100000), data);
+  }
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "dietgpu/table/TableCodec.h"
+#include "dietgpu/utils/ThreadPool.h"
+
+namespace dietgpu {
+
+//
+// Host (CPU) implementation of the row-grouped table codec (see TableCodec.h)
+//
+// All pointers are host pointers, and no GPU is required. The row groups are
+// (de)compressed as a batch by the host float codec (see CpuFloatCodec.h),
+// spreading the work across the threads of `pool`.
+//
+
+void tableCompressCpu(
+    ThreadPool& pool,
+    // How should we compress our data?
+    const TableCompressConfig& config,
+
+    // Host pointer to the table, numRows x rowSize float words in row-major
+    // order
+    const void* in,
+    uint32_t numRows,
+    uint32_t rowSize,
+
+    // Host pointer to a region of memory of at least size
+    // getMaxTableCompressedSize(config, numRows, rowSize), aligned to 16 bytes
+    void* out,
+    // Size of the table archive in bytes (optional, can be nullptr)
+    size_t* outSize);
+
+FloatDecompressStatus tableGatherCpu(
+    ThreadPool& pool,
+    // How should we decompress our data?
+    const TableDecompressConfig& config,
+
+    // Host pointer to the table archive, aligned to 16 bytes
+    const void* in,
+
+    // Host array of numIds row ids (each less than the number of rows of the
+    // table) of the rows to gather, in any order and with any repeats
+    uint32_t numIds,
+    const uint32_t* rowIds,
+
+    // Host pointer to a region of memory of at least numIds x rowSize float
+    // words, into which row rowIds[i] is written as row i
+    void* out,
+
+    // Decode success/fail status (optional, can be nullptr)
+    // If present, this is a host array of length numIds, with true/false for
+    // whether or not each row could be decoded from its group. If
+    // config.floatConfig.useChecksum is set, the groups holding the rows are
+    // decoded in full to verify their checksums; mismatches are reported in
+    // the returned status, with the errorInfo and failedBlocks indices being
+    // the group number
+    uint8_t* outSuccess);
+
+} // namespace dietgpu
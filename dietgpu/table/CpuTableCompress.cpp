@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+#include "dietgpu/table/CpuTableCodec.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Returns the maximum size of the archive of a single group, at which the
+// group archives are compressed before being packed together
+size_t getMaxTableGroupCompressedSize(
+    const TableCompressConfig& config,
+    uint32_t rowSize) {
+  CHECK_GT(config.rowsPerGroup, 0);
+  CHECK_LE(
+      (uint64_t)config.rowsPerGroup * rowSize,
+      std::numeric_limits<uint32_t>::max())
+      << "a group of " << config.rowsPerGroup << " rows of " << rowSize
+      << " words is too large for a float archive";
+
+  auto& fc = config.floatConfig;
+  return roundUp(
+      (size_t)getMaxFloatCompressedSize(
+          fc.floatType,
+          config.rowsPerGroup * rowSize,
+          fc.ansConfig.blockSize,
+          fc.ansConfig.useWideState,
+          fc.ansConfig.getMaxTables(),
+          fc.predictor,
+          fc.useBlockChecksum),
+      16);
+}
+
+} // namespace
+
+size_t getMaxTableCompressedSize(
+    const TableCompressConfig& config,
+    uint32_t numRows,
+    uint32_t rowSize) {
+  uint32_t numGroups = divUp(numRows, config.rowsPerGroup);
+
+  return getTableIndexedHeaderSize(numGroups) +
+      numGroups * getMaxTableGroupCompressedSize(config, rowSize);
+}
+
+void tableCompressCpu(
+    ThreadPool& pool,
+    const TableCompressConfig& config,
+    const void* in,
+    uint32_t numRows,
+    uint32_t rowSize,
+    void* out,
+    size_t* outSize) {
+  CHECK_EQ(uintptr_t(out) % 16, 0);
+
+  auto wordSize = getWordSizeFromFloatType(config.floatConfig.floatType);
+  auto maxGroupSize = getMaxTableGroupCompressedSize(config, rowSize);
+  uint32_t numGroups = divUp(numRows, config.rowsPerGroup);
+  size_t headerSize = getTableIndexedHeaderSize(numGroups);
+
+  // Each group is compressed at a stride of the maximum group size, then the
+  // group archives are packed together
+  auto groupIn = std::vector<const void*>(numGroups);
+  auto groupSize = std::vector<uint32_t>(numGroups);
+  auto groupOut = std::vector<void*>(numGroups);
+  auto groupOutSize = std::vector<uint32_t>(numGroups);
+
+  for (uint32_t g = 0; g < numGroups; ++g) {
+    uint32_t startRow = g * config.rowsPerGroup;
+    uint32_t rows = std::min(numRows - startRow, config.rowsPerGroup);
+
+    groupIn[g] = (const uint8_t*)in + (size_t)startRow * rowSize * wordSize;
+    groupSize[g] = rows * rowSize;
+    groupOut[g] = (uint8_t*)out + headerSize + g * maxGroupSize;
+  }
+
+  floatCompressCpu(
+      pool,
+      config.floatConfig,
+      numGroups,
+      groupIn.data(),
+      groupSize.data(),
+      groupOut.data(),
+      groupOutSize.data());
+
+  auto header = (TableHeader*)out;
+  std::memset(header, 0, headerSize);
+
+  header->numRows = numRows;
+  header->rowSize = rowSize;
+  header->rowsPerGroup = config.rowsPerGroup;
+  header->setFloatType(config.floatConfig.floatType);
+  header->setMagicAndVersion();
+
+  // Each group archive moves down to (at most) its own position, so they are
+  // packed in order
+  auto index = (uint64_t*)(header + 1);
+  index[0] = headerSize;
+
+  for (uint32_t g = 0; g < numGroups; ++g) {
+    std::memmove(
+        (uint8_t*)out + index[g], groupOut[g], groupOutSize[g]);
+    index[g + 1] = index[g] + roundUp(groupOutSize[g], 16U);
+  }
+
+  if (outSize) {
+    *outSize = index[numGroups];
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+#include "dietgpu/table/CpuTableCodec.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace dietgpu {
+
+namespace {
+
+// Gathers the rows by decoding, from each group archive, only the ANS blocks
+// covering each run of requested rows that are consecutive in both rowIds and
+// the table, straight into the output
+void tableGatherRangeCpu(
+    ThreadPool& pool,
+    const TableDecompressConfig& config,
+    const void* in,
+    uint32_t numIds,
+    const uint32_t* rowIds,
+    void* out,
+    uint8_t* outSuccess) {
+  auto header = (const TableHeader*)in;
+  auto index = header->getGroupIndex();
+  auto wordSize = getWordSizeFromFloatType(header->getFloatType());
+  size_t rowBytes = (size_t)header->rowSize * wordSize;
+  uint32_t rowsPerGroup = header->rowsPerGroup;
+
+  // The position in rowIds at which each run starts, followed by numIds
+  auto runStart = std::vector<uint32_t>();
+  for (uint32_t i = 0; i < numIds; ++i) {
+    if (i == 0 || rowIds[i] != rowIds[i - 1] + 1 ||
+        rowIds[i] % rowsPerGroup == 0) {
+      runStart.push_back(i);
+    }
+  }
+
+  uint32_t numRuns = runStart.size();
+  runStart.push_back(numIds);
+
+  auto runIn = std::vector<const void*>(numRuns);
+  auto runOffset = std::vector<uint32_t>(numRuns);
+  auto runSize = std::vector<uint32_t>(numRuns);
+  auto runOut = std::vector<void*>(numRuns);
+  auto runSuccess = std::vector<uint8_t>(numRuns);
+
+  for (uint32_t r = 0; r < numRuns; ++r) {
+    uint32_t row = rowIds[runStart[r]];
+
+    runIn[r] = (const uint8_t*)in + index[row / rowsPerGroup];
+    runOffset[r] = (row % rowsPerGroup) * header->rowSize;
+    runSize[r] = (runStart[r + 1] - runStart[r]) * header->rowSize;
+    runOut[r] = (uint8_t*)out + runStart[r] * rowBytes;
+  }
+
+  floatDecompressRangeCpu(
+      pool,
+      config.floatConfig,
+      numRuns,
+      runIn.data(),
+      runOffset.data(),
+      runSize.data(),
+      runOut.data(),
+      runSuccess.data());
+
+  if (outSuccess) {
+    for (uint32_t r = 0; r < numRuns; ++r) {
+      // A group decodes successfully only if it holds exactly its rows
+      uint32_t g = rowIds[runStart[r]] / rowsPerGroup;
+      uint32_t rows =
+          std::min(header->numRows - g * rowsPerGroup, rowsPerGroup);
+      bool success = runSuccess[r] &&
+          ((const GpuFloatHeader*)runIn[r])->size == rows * header->rowSize;
+
+      std::fill(
+          outSuccess + runStart[r], outSuccess + runStart[r + 1], success);
+    }
+  }
+}
+
+} // namespace
+
+FloatDecompressStatus tableGatherCpu(
+    ThreadPool& pool,
+    const TableDecompressConfig& config,
+    const void* in,
+    uint32_t numIds,
+    const uint32_t* rowIds,
+    void* out,
+    uint8_t* outSuccess) {
+  auto header = (const TableHeader*)in;
+
+  CHECK_EQ(uintptr_t(in) % 16, 0);
+  CHECK(header->isValidMagicAndVersion())
+      << "invalid table magic and version " << std::hex
+      << header->magicAndVersion;
+  CHECK(header->getFloatType() == config.floatConfig.floatType)
+      << "table has float type " << uint32_t(header->getFloatType())
+      << " but expected " << uint32_t(config.floatConfig.floatType);
+
+  CHECK_GT(header->rowsPerGroup, 0) << "table has no rows per group";
+
+  auto wordSize = getWordSizeFromFloatType(header->getFloatType());
+  size_t rowBytes = (size_t)header->rowSize * wordSize;
+  uint32_t rowsPerGroup = header->rowsPerGroup;
+
+  for (uint32_t i = 0; i < numIds; ++i) {
+    CHECK_LT(rowIds[i], header->numRows) << "row id " << i << " out of range";
+  }
+
+  // The checksum of a group covers all of its rows, so it can only be
+  // verified by decoding the whole group
+  if (!config.floatConfig.useChecksum) {
+    tableGatherRangeCpu(pool, config, in, numIds, rowIds, out, outSuccess);
+    return FloatDecompressStatus();
+  }
+
+  // The distinct groups holding the rows, in order; we touch nothing that
+  // depends upon the number of groups in the table
+  auto groups = std::vector<uint32_t>(numIds);
+  for (uint32_t i = 0; i < numIds; ++i) {
+    groups[i] = rowIds[i] / rowsPerGroup;
+  }
+
+  std::sort(groups.begin(), groups.end());
+  groups.erase(std::unique(groups.begin(), groups.end()), groups.end());
+
+  uint32_t numDecoded = groups.size();
+
+  // Decode the groups as a batch
+  auto index = header->getGroupIndex();
+  auto groupIn = std::vector<const void*>(numDecoded);
+  auto groupStart = std::vector<size_t>(numDecoded + 1);
+  auto groupOut = std::vector<void*>(numDecoded);
+  auto groupCapacity = std::vector<uint32_t>(numDecoded);
+  auto groupSuccess = std::vector<uint8_t>(numDecoded);
+  auto groupSize = std::vector<uint32_t>(numDecoded);
+
+  for (uint32_t i = 0; i < numDecoded; ++i) {
+    uint32_t g = groups[i];
+    uint32_t rows = std::min(header->numRows - g * rowsPerGroup, rowsPerGroup);
+
+    groupIn[i] = (const uint8_t*)in + index[g];
+    groupCapacity[i] = rows * header->rowSize;
+    groupStart[i + 1] = groupStart[i] + roundUp(rows * rowBytes, 16);
+  }
+
+  auto decoded = std::vector<uint8_t>(groupStart[numDecoded]);
+  for (uint32_t i = 0; i < numDecoded; ++i) {
+    groupOut[i] = decoded.data() + groupStart[i];
+  }
+
+  auto status = floatDecompressCpu(
+      pool,
+      config.floatConfig,
+      numDecoded,
+      groupIn.data(),
+      groupOut.data(),
+      groupCapacity.data(),
+      groupSuccess.data(),
+      groupSize.data());
+
+  // Report errors by group number
+  for (auto& info : status.errorInfo) {
+    info.first = groups[info.first];
+  }
+
+  for (auto& failed : status.failedBlocks) {
+    failed.first = groups[failed.first];
+  }
+
+  // A group decodes successfully only if it holds exactly its rows
+  for (uint32_t i = 0; i < numDecoded; ++i) {
+    groupSuccess[i] = groupSuccess[i] && groupSize[i] == groupCapacity[i];
+  }
+
+  // Copy out the rows
+  pool.parallelFor(numIds, [&](size_t i) {
+    uint32_t row = rowIds[i];
+    uint32_t slot =
+        std::lower_bound(groups.begin(), groups.end(), row / rowsPerGroup) -
+        groups.begin();
+
+    if (groupSuccess[slot]) {
+      std::memcpy(
+          (uint8_t*)out + i * rowBytes,
+          (const uint8_t*)groupOut[slot] + (row % rowsPerGroup) * rowBytes,
+          rowBytes);
+    }
+
+    if (outSuccess) {
+      outSuccess[i] = groupSuccess[slot];
+    }
+  });
+
+  return status;
+}
+
+} // namespace dietgpu
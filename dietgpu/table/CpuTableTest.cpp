@@ -0,0 +1,276 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dietgpu/float/CpuFloatCodec.h"
+#include "dietgpu/float/CpuFloatUtils.h"
+#include "dietgpu/table/CpuTableCodec.h"
+
+using namespace dietgpu;
+
+// Generates a table of normally distributed float16, bfloat16 or float32
+// words, as bytes
+std::vector<uint8_t>
+generateTable(FloatType ft, uint32_t numRows, uint32_t rowSize) {
+  std::mt19937 gen(10 + numRows);
+  std::normal_distribution<float> dist(0.0f, 0.1f);
+
+  auto wordSize = getWordSizeFromFloatType(ft);
+  auto out = std::vector<uint8_t>((size_t)numRows * rowSize * wordSize);
+
+  for (size_t i = 0; i < (size_t)numRows * rowSize; ++i) {
+    float f = dist(gen);
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(float));
+
+    if (ft == FloatType::kFloat16) {
+      // (rounding toward zero, without subnormals)
+      int exp = int((x >> 23) & 0xff) - 127 + 15;
+      uint32_t w = exp <= 0
+          ? 0
+          : (((x >> 16) & 0x8000) | (exp << 10) | ((x >> 13) & 0x3ff));
+      std::memcpy(out.data() + i * wordSize, &w, wordSize);
+    } else if (ft == FloatType::kBFloat16) {
+      uint32_t w = x >> 16;
+      std::memcpy(out.data() + i * wordSize, &w, wordSize);
+    } else {
+      std::memcpy(out.data() + i * wordSize, &x, wordSize);
+    }
+  }
+
+  return out;
+}
+
+// Compresses the table, checking the archive layout
+std::vector<uint8_t> compressTable(
+    ThreadPool& pool,
+    const TableCompressConfig& config,
+    const std::vector<uint8_t>& table,
+    uint32_t numRows,
+    uint32_t rowSize) {
+  // (vectors of uint4 are 16 byte aligned)
+  auto maxSize = getMaxTableCompressedSize(config, numRows, rowSize);
+  auto enc = std::vector<uint4>(divUp(maxSize, sizeof(uint4)));
+  size_t encSize = 0;
+
+  tableCompressCpu(
+      pool, config, table.data(), numRows, rowSize, enc.data(), &encSize);
+  EXPECT_LE(encSize, maxSize);
+
+  auto header = (const TableHeader*)enc.data();
+  EXPECT_TRUE(header->isValidMagicAndVersion());
+  EXPECT_TRUE(header->getFloatType() == config.floatConfig.floatType);
+  EXPECT_EQ(header->numRows, numRows);
+  EXPECT_EQ(header->rowSize, rowSize);
+  EXPECT_EQ(header->rowsPerGroup, config.rowsPerGroup);
+
+  // Each group is an aligned float archive of its rows
+  uint32_t numGroups = header->getNumGroups();
+  auto index = header->getGroupIndex();
+  EXPECT_EQ(index[0], getTableIndexedHeaderSize(numGroups));
+  EXPECT_EQ(index[numGroups], encSize);
+
+  for (uint32_t g = 0; g < numGroups; ++g) {
+    EXPECT_EQ(index[g] % 16, 0);
+    EXPECT_LT(index[g], index[g + 1]);
+
+    auto groupHeader =
+        (const GpuFloatHeader*)((const uint8_t*)enc.data() + index[g]);
+    EXPECT_TRUE(groupHeader->isValidMagicAndVersion());
+    EXPECT_EQ(
+        groupHeader->size,
+        std::min(numRows - g * config.rowsPerGroup, config.rowsPerGroup) *
+            rowSize);
+  }
+
+  auto out = std::vector<uint8_t>(encSize);
+  std::memcpy(out.data(), enc.data(), encSize);
+  return out;
+}
+
+// Gathers the rows from the archive, which must succeed
+std::vector<uint8_t> gatherRows(
+    ThreadPool& pool,
+    const TableDecompressConfig& config,
+    const std::vector<uint8_t>& archive,
+    const std::vector<uint32_t>& rowIds,
+    FloatDecompressError expectedError = FloatDecompressError::None) {
+  auto header = (const TableHeader*)archive.data();
+  auto wordSize = getWordSizeFromFloatType(header->getFloatType());
+
+  // Copied to ensure 16 byte alignment
+  auto in = std::vector<uint4>(divUp(archive.size(), sizeof(uint4)));
+  std::memcpy(in.data(), archive.data(), archive.size());
+
+  auto out = std::vector<uint8_t>(rowIds.size() * header->rowSize * wordSize);
+  auto success = std::vector<uint8_t>(rowIds.size());
+
+  auto status = tableGatherCpu(
+      pool,
+      config,
+      in.data(),
+      rowIds.size(),
+      rowIds.data(),
+      out.data(),
+      success.data());
+
+  EXPECT_EQ(status.error, expectedError);
+  for (auto s : success) {
+    EXPECT_TRUE(s);
+  }
+
+  return out;
+}
+
+// Returns the rows of the table, as bytes
+std::vector<uint8_t> selectRows(
+    const std::vector<uint8_t>& table,
+    size_t rowBytes,
+    const std::vector<uint32_t>& rowIds) {
+  auto out = std::vector<uint8_t>();
+
+  for (auto id : rowIds) {
+    out.insert(
+        out.end(),
+        table.begin() + id * rowBytes,
+        table.begin() + (id + 1) * rowBytes);
+  }
+
+  return out;
+}
+
+TEST(CpuTableTest, Gather) {
+  ThreadPool pool(4);
+  std::mt19937 gen(11);
+
+  for (auto ft :
+       {FloatType::kFloat16, FloatType::kBFloat16, FloatType::kFloat32}) {
+    auto wordSize = getWordSizeFromFloatType(ft);
+
+    for (uint32_t rowSize : {1, 64, 100}) {
+      for (uint32_t numRows : {0, 1, 1000, 10007}) {
+        auto table = generateTable(ft, numRows, rowSize);
+
+        // Without a checksum, runs of rows are range decoded from their
+        // groups; with one, whole groups are decoded to verify it
+        for (bool useChecksum : {false, true}) {
+          for (uint32_t rowsPerGroup : {1, 100, 256, 1 << 20}) {
+            // (a group per row is slow to compress for large tables)
+            if (rowsPerGroup == 1 && numRows > 1000) {
+              continue;
+            }
+
+            auto config = TableCodecConfig(
+                FloatCodecConfig(ft, ANSCodecConfig(10), false, useChecksum),
+                rowsPerGroup);
+            auto archive =
+                compressTable(pool, config, table, numRows, rowSize);
+
+            // Random rows in any order and with repeats, a run of
+            // consecutive rows crossing groups, and all rows
+            auto rowIds = std::vector<uint32_t>();
+            for (uint32_t i = 0; numRows > 0 && i < 500; ++i) {
+              rowIds.push_back(gen() % numRows);
+            }
+
+            for (uint32_t i = 0; numRows > 0 && i < 300; ++i) {
+              rowIds.push_back((numRows / 3 + i) % numRows);
+            }
+
+            EXPECT_EQ(
+                gatherRows(pool, config, archive, rowIds),
+                selectRows(table, rowSize * wordSize, rowIds));
+
+            rowIds.clear();
+            for (uint32_t i = 0; i < numRows; ++i) {
+              rowIds.push_back(i);
+            }
+
+            EXPECT_EQ(gatherRows(pool, config, archive, rowIds), table);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(CpuTableTest, GatherTouchesOnlyItsGroups) {
+  ThreadPool pool(4);
+
+  uint32_t numRows = 5000;
+  uint32_t rowSize = 64;
+  auto ft = FloatType::kFloat16;
+  auto wordSize = getWordSizeFromFloatType(ft);
+  auto table = generateTable(ft, numRows, rowSize);
+
+  auto config = TableCodecConfig(
+      FloatCodecConfig(ft, ANSCodecConfig(10), false, true), 100);
+  auto archive = compressTable(pool, config, table, numRows, rowSize);
+
+  // Corrupt the non-compressed data of group 7 (rows [700, 800)), which its
+  // checksum detects
+  auto index = ((const TableHeader*)archive.data())->getGroupIndex();
+  archive[index[7] + sizeof(GpuFloatHeader)] ^= 0xff;
+
+  // Gathers of rows of other groups are unaffected
+  auto rowIds = std::vector<uint32_t>{0, 699, 800, 4999, 1234};
+  EXPECT_EQ(
+      gatherRows(pool, config, archive, rowIds),
+      selectRows(table, rowSize * wordSize, rowIds));
+
+  // A gather that includes a row of group 7 reports it
+  rowIds.push_back(750);
+
+  auto in = std::vector<uint4>(divUp(archive.size(), sizeof(uint4)));
+  std::memcpy(in.data(), archive.data(), archive.size());
+  auto out = std::vector<uint8_t>(rowIds.size() * rowSize * wordSize);
+
+  auto status = tableGatherCpu(
+      pool,
+      config,
+      in.data(),
+      rowIds.size(),
+      rowIds.data(),
+      out.data(),
+      nullptr);
+
+  EXPECT_EQ(status.error, FloatDecompressError::ChecksumMismatch);
+  ASSERT_EQ(status.errorInfo.size(), 1);
+  EXPECT_EQ(status.errorInfo[0].first, 7);
+}
+
+TEST(CpuTableTest, GroupOverhead) {
+  ThreadPool pool(4);
+
+  uint32_t numRows = 20000;
+  uint32_t rowSize = 128;
+
+  for (auto ft : {FloatType::kFloat16, FloatType::kBFloat16}) {
+    auto table = generateTable(ft, numRows, rowSize);
+    auto floatConfig = FloatCodecConfig(ft, ANSCodecConfig(10), false);
+
+    // The whole table as a single float archive
+    auto maxSize = getMaxFloatCompressedSize(ft, numRows * rowSize);
+    auto enc = std::vector<uint4>(divUp(maxSize, sizeof(uint4)));
+    auto inPtr = (const void*)table.data();
+    auto encPtr = (void*)enc.data();
+    uint32_t size = numRows * rowSize;
+    uint32_t encSize = 0;
+
+    floatCompressCpu(pool, floatConfig, 1, &inPtr, &size, &encPtr, &encSize);
+
+    // With the default group size, the index and the per-group archives cost
+    // little
+    auto archive = compressTable(
+        pool, TableCodecConfig(floatConfig), table, numRows, rowSize);
+    EXPECT_LT(archive.size(), encSize * 1.03);
+  }
+}
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include "dietgpu/float/GpuFloatCodec.h"
+#include "dietgpu/utils/StaticUtils.h"
+
+namespace dietgpu {
+
+//
+// Row-grouped table codec
+//
+// Compresses a row-major table of float words (such as an embedding table) so
+// that individual rows can be gathered without decompressing the whole table.
+// The rows are cut into groups of a fixed number of rows (the last group may
+// be shorter), and each group is compressed independently into an ordinary
+// float archive. The archive of the table is:
+//
+// [TableHeader][group index][archive of group 0][archive of group 1] ...
+//
+// where the group index holds numGroups + 1 uint64_t byte offsets from the
+// start of the table archive: the start of each group's archive, followed by
+// the end of the last. Each group archive starts at a 16 byte aligned offset.
+//
+// A gather of a list of row ids decodes, from the groups holding those rows,
+// only the ANS blocks covering each run of consecutive rows fetched, so its
+// cost depends upon the number and spread of the rows fetched rather than the
+// size of the table. Verifying a group checksum requires decoding the whole
+// group, so gathers with checksums enabled decode the groups in full.
+//
+
+// magic number to verify archive integrity
+constexpr uint32_t kTableMagic = 0xf33f;
+
+// current table archive version number
+constexpr uint32_t kTableVersion = 0x0001;
+
+// Default number of rows per group. Smaller groups decode less data per
+// gathered row, while larger groups amortize the per-archive header and pdf
+// over more data and so compress better
+constexpr uint32_t kTableDefaultRowsPerGroup = 256;
+
+struct TableCodecConfig {
+  inline TableCodecConfig() : rowsPerGroup(kTableDefaultRowsPerGroup) {}
+
+  inline TableCodecConfig(
+      const FloatCodecConfig& floatConf,
+      uint32_t rowsPerGrp = kTableDefaultRowsPerGroup)
+      : floatConfig(floatConf), rowsPerGroup(rowsPerGrp) {}
+
+  // Configuration of the float codec with which each row group is compressed
+  // and decompressed (including the optional checksum of each group)
+  FloatCodecConfig floatConfig;
+
+  // Compression only: the number of rows in each group. The group size is
+  // recorded in the archive
+  uint32_t rowsPerGroup;
+};
+
+// Same config options for compression and decompression for now
+using TableCompressConfig = TableCodecConfig;
+using TableDecompressConfig = TableCodecConfig;
+
+// Header on a compressed table
+struct alignas(16) TableHeader {
+  void setMagicAndVersion() {
+    magicAndVersion = (kTableMagic << 16) | kTableVersion;
+  }
+
+  bool isValidMagicAndVersion() const {
+    return (magicAndVersion >> 16) == kTableMagic &&
+        (magicAndVersion & 0xffffU) == kTableVersion;
+  }
+
+  FloatType getFloatType() const {
+    return FloatType(options & 0xf);
+  }
+
+  void setFloatType(FloatType ft) {
+    options = (options & 0xfffffff0U) | uint32_t(ft);
+  }
+
+  uint32_t getNumGroups() const {
+    return divUp(numRows, rowsPerGroup);
+  }
+
+  // Offsets of the group archives (see above)
+  const uint64_t* getGroupIndex() const {
+    return (const uint64_t*)(this + 1);
+  }
+
+  // (16: magic)(16: version)
+  uint32_t magicAndVersion;
+
+  // (28: unused)(4: float type)
+  uint32_t options;
+
+  // Number of rows in the table
+  uint32_t numRows;
+
+  // Number of float words in each row
+  uint32_t rowSize;
+
+  // Number of rows in each group but the last
+  uint32_t rowsPerGroup;
+
+  uint32_t unused0;
+  uint32_t unused1;
+  uint32_t unused2;
+};
+
+static_assert(sizeof(TableHeader) == 32, "");
+
+// Returns the size in bytes of the header and group index of a table archive
+// with `numGroups` groups
+inline size_t getTableIndexedHeaderSize(uint32_t numGroups) {
+  // The index is padded to keep the group archives 16 byte aligned
+  return sizeof(TableHeader) +
+      roundUp(((size_t)numGroups + 1) * sizeof(uint64_t), 16);
+}
+
+// Returns the maximum possible compressed size in bytes of a table of
+// `numRows` rows of `rowSize` float words compressed with `config`
+size_t getMaxTableCompressedSize(
+    const TableCompressConfig& config,
+    uint32_t numRows,
+    uint32_t rowSize);
+
+} // namespace dietgpu
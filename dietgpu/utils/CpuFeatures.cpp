@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/utils/CpuFeatures.h"
+#include <glog/logging.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace dietgpu {
+
+namespace {
+
+CpuSimdLevel detectCpuSimdLevel() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f")) {
+    return CpuSimdLevel::AVX512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    return CpuSimdLevel::AVX2;
+  }
+#endif
+
+  return CpuSimdLevel::Scalar;
+}
+
+CpuSimdLevel getEnvCpuSimdLevel(CpuSimdLevel detected) {
+  auto env = std::getenv("DIETGPU_CPU_SIMD");
+  if (!env) {
+    return detected;
+  }
+
+  CpuSimdLevel requested = detected;
+  if (std::strcmp(env, "scalar") == 0) {
+    requested = CpuSimdLevel::Scalar;
+  } else if (std::strcmp(env, "avx2") == 0) {
+    requested = CpuSimdLevel::AVX2;
+  } else if (std::strcmp(env, "avx512") == 0) {
+    requested = CpuSimdLevel::AVX512;
+  } else {
+    LOG(WARNING) << "DIETGPU_CPU_SIMD: unknown instruction set " << env;
+  }
+
+  return (int)requested < (int)detected ? requested : detected;
+}
+
+} // namespace
+
+CpuSimdLevel getCpuSimdLevel() {
+  static const CpuSimdLevel level = getEnvCpuSimdLevel(detectCpuSimdLevel());
+  return level;
+}
+
+bool isCpuSimdLevelSupported(CpuSimdLevel level) {
+  static const CpuSimdLevel detected = detectCpuSimdLevel();
+  return (int)level <= (int)detected;
+}
+
+const char* getCpuSimdLevelName(CpuSimdLevel level) {
+  switch (level) {
+    case CpuSimdLevel::Scalar:
+      return "scalar";
+    case CpuSimdLevel::AVX2:
+      return "avx2";
+    case CpuSimdLevel::AVX512:
+      return "avx512";
+  }
+
+  return "unknown";
+}
+
+} // namespace dietgpu
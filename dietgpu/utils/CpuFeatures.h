@@ -0,0 +1,32 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+namespace dietgpu {
+
+/// Vector instruction sets that host code paths may be specialized for, in
+/// increasing order of capability
+enum class CpuSimdLevel : int {
+  Scalar = 0,
+  AVX2 = 1,
+  AVX512 = 2,
+};
+
+/// Returns the widest instruction set supported by the host CPU (and by the
+/// compiler used to build the library). This may be lowered (but not raised)
+/// by setting the environment variable DIETGPU_CPU_SIMD to one of `scalar`,
+/// `avx2` or `avx512`
+CpuSimdLevel getCpuSimdLevel();
+
+/// Returns true if the host CPU can run code specialized for `level`
+bool isCpuSimdLevelSupported(CpuSimdLevel level);
+
+/// Returns a printable name for the instruction set
+const char* getCpuSimdLevelName(CpuSimdLevel level);
+
+} // namespace dietgpu
@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/utils/Crc32c.h"
+#include <glog/logging.h>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DIETGPU_CPU_X86 1
+#include <immintrin.h>
+#endif
+
+namespace dietgpu {
+
+namespace {
+
+// The CRC32C polynomial, bit reflected
+constexpr uint32_t kCrc32cPoly = 0x82f63b78;
+
+// Tables for the portable CRC, which consumes 8 bytes at a time: entry k of
+// table b is the CRC of byte b followed by k zero bytes
+struct Crc32cTables {
+  Crc32cTables() {
+    for (uint32_t b = 0; b < 256; ++b) {
+      uint32_t crc = b;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = crc & 1 ? (crc >> 1) ^ kCrc32cPoly : crc >> 1;
+      }
+
+      table[0][b] = crc;
+    }
+
+    for (uint32_t b = 0; b < 256; ++b) {
+      for (int k = 1; k < 8; ++k) {
+        uint32_t prev = table[k - 1][b];
+        table[k][b] = (prev >> 8) ^ table[0][prev & 0xff];
+      }
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+const Crc32cTables& getCrc32cTables() {
+  static const Crc32cTables tables;
+  return tables;
+}
+
+// Multiplies the polynomials a and b (bit reflected, so the high bit is x^0)
+// modulo the CRC polynomial; a must not be zero
+uint32_t multModP(uint32_t a, uint32_t b) {
+  uint32_t m = 1U << 31;
+  uint32_t p = 0;
+
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) {
+        break;
+      }
+    }
+
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kCrc32cPoly : b >> 1;
+  }
+
+  return p;
+}
+
+// Returns x^n modulo the CRC polynomial
+uint32_t xPowModP(uint64_t n) {
+  // x^0 and x^1
+  uint32_t p = 1U << 31;
+  uint32_t square = 1U << 30;
+
+  while (n) {
+    if (n & 1) {
+      p = multModP(square, p);
+    }
+
+    n >>= 1;
+    if (n) {
+      square = multModP(square, square);
+    }
+  }
+
+  return p;
+}
+
+uint64_t load64(const uint8_t* p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t crc32cPortable(const void* data, size_t size, uint32_t crc) {
+  auto& t = getCrc32cTables().table;
+  auto p = (const uint8_t*)data;
+  crc = ~crc;
+
+  // (the 8 byte loads assume a little endian host)
+  for (; size >= 8; size -= 8, p += 8) {
+    uint64_t v = load64(p) ^ crc;
+    uint32_t lo = uint32_t(v);
+    uint32_t hi = uint32_t(v >> 32);
+
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^
+        t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+        t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+
+  for (; size > 0; --size, ++p) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+  }
+
+  return ~crc;
+}
+
+#ifdef DIETGPU_CPU_X86
+
+// The SSE4.2 CRC consumes 3 lanes of this many bytes at a time, as
+// independent CRCs that hide the latency of the crc32 instruction, then
+// combines them
+constexpr size_t kCrc32cLaneSize = 256;
+
+const Crc32cCombiner& getLaneCombiner() {
+  static const Crc32cCombiner combiner(kCrc32cLaneSize);
+  return combiner;
+}
+
+__attribute__((target("sse4.2"))) uint32_t
+crc32cSSE42(const void* data, size_t size, uint32_t crc) {
+  auto p = (const uint8_t*)data;
+  uint64_t c0 = ~crc;
+
+  for (; size > 0 && uintptr_t(p) % 8 != 0; --size, ++p) {
+    c0 = _mm_crc32_u8(uint32_t(c0), *p);
+  }
+
+  if (size >= 3 * kCrc32cLaneSize) {
+    auto& combine = getLaneCombiner();
+
+    // The lane CRCs are of the raw CRC state (without the inversions), which
+    // combines in the same way
+    for (; size >= 3 * kCrc32cLaneSize; size -= 3 * kCrc32cLaneSize) {
+      uint64_t c1 = 0;
+      uint64_t c2 = 0;
+
+      for (size_t i = 0; i < kCrc32cLaneSize; i += 8, p += 8) {
+        c0 = _mm_crc32_u64(c0, load64(p));
+        c1 = _mm_crc32_u64(c1, load64(p + kCrc32cLaneSize));
+        c2 = _mm_crc32_u64(c2, load64(p + 2 * kCrc32cLaneSize));
+      }
+
+      c0 = combine(combine(uint32_t(c0), uint32_t(c1)), uint32_t(c2));
+      p += 2 * kCrc32cLaneSize;
+    }
+  }
+
+  for (; size >= 8; size -= 8, p += 8) {
+    c0 = _mm_crc32_u64(c0, load64(p));
+  }
+
+  for (; size > 0; --size, ++p) {
+    c0 = _mm_crc32_u8(uint32_t(c0), *p);
+  }
+
+  return ~uint32_t(c0);
+}
+
+#endif // DIETGPU_CPU_X86
+
+} // namespace
+
+Crc32cCpuFn getCrc32cCpu(CpuSimdLevel level) {
+  CHECK(isCpuSimdLevelSupported(level))
+      << "instruction set " << getCpuSimdLevelName(level)
+      << " is not supported by this CPU";
+
+#ifdef DIETGPU_CPU_X86
+  if (level != CpuSimdLevel::Scalar) {
+    return crc32cSSE42;
+  }
+#endif
+
+  return crc32cPortable;
+}
+
+uint32_t crc32cCpu(const void* data, size_t size, uint32_t crc) {
+  static const Crc32cCpuFn fn = getCrc32cCpu(getCpuSimdLevel());
+  return fn(data, size, crc);
+}
+
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t sizeB) {
+  return multModP(xPowModP(uint64_t(sizeB) * 8), crcA) ^ crcB;
+}
+
+Crc32cCombiner::Crc32cCombiner(size_t sizeB) {
+  uint32_t op = xPowModP(uint64_t(sizeB) * 8);
+
+  for (int k = 0; k < 4; ++k) {
+    for (uint32_t b = 0; b < 256; ++b) {
+      table_[k][b] = multModP(op, b << (8 * k));
+    }
+  }
+}
+
+} // namespace dietgpu
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dietgpu/utils/CpuFeatures.h"
+
+namespace dietgpu {
+
+/// Host CRC32C (Castagnoli polynomial 0x1edc6f41, as used by iSCSI, ext4 and
+/// SSE4.2), with which the block checksums of archives are computed (see
+/// ANSCodecConfig::useBlockChecksum)
+
+/// A CRC32C implementation, computing the CRC of `size` bytes of `data`
+/// continuing from `crc`, the CRC of the data preceding it (0 for none)
+using Crc32cCpuFn = uint32_t (*)(const void* data, size_t size, uint32_t crc);
+
+/// Returns the CRC32C implementation for the given instruction set (which
+/// must be supported by the host CPU): the SSE4.2 crc32 instruction, which
+/// all AVX2 capable CPUs have, or otherwise a portable table driven
+/// (slicing-by-8) implementation. All return the same values
+Crc32cCpuFn getCrc32cCpu(CpuSimdLevel level);
+
+/// Computes the CRC32C of `size` bytes of `data`, continuing from `crc`, with
+/// the implementation for getCpuSimdLevel()
+uint32_t crc32cCpu(const void* data, size_t size, uint32_t crc = 0);
+
+/// Returns the CRC32C of the concatenation of data A and data B of sizeB
+/// bytes, given the CRC32C of each
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t sizeB);
+
+/// crc32cCombine for a fixed sizeB, which combines with 4 table lookups
+class Crc32cCombiner {
+ public:
+  explicit Crc32cCombiner(size_t sizeB);
+
+  uint32_t operator()(uint32_t crcA, uint32_t crcB) const {
+    return table_[0][crcA & 0xff] ^ table_[1][(crcA >> 8) & 0xff] ^
+        table_[2][(crcA >> 16) & 0xff] ^ table_[3][crcA >> 24] ^ crcB;
+  }
+
+ private:
+  /// The multiple of each byte of crcA by x^(8 * sizeB)
+  uint32_t table_[4][256];
+};
+
+} // namespace dietgpu
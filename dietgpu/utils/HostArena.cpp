@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/utils/HostArena.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include "dietgpu/utils/ThreadPool.h"
+
+namespace dietgpu {
+
+HostArena::HostArena(size_t chunkSize)
+    : chunkSize_(chunkSize), offset_(0), last_(nullptr) {
+  CHECK_GT(chunkSize_, 0);
+}
+
+void* HostArena::alloc(size_t bytes, size_t align) {
+  CHECK(align > 0 && align <= 16 && (align & (align - 1)) == 0);
+
+  if (!chunks_.empty()) {
+    auto& chunk = chunks_.back();
+    auto start = (offset_ + align - 1) & ~(align - 1);
+
+    if (start + bytes <= chunk.size) {
+      last_ = chunk.data.get() + start;
+      offset_ = start + bytes;
+      return last_;
+    }
+  }
+
+  // Start a new chunk. Storage from new[] is aligned to at least 16 bytes
+  Chunk chunk;
+  chunk.size = std::max(bytes, chunkSize_);
+  chunk.data.reset(new uint8_t[chunk.size]);
+
+  last_ = chunk.data.get();
+  offset_ = bytes;
+  chunks_.push_back(std::move(chunk));
+
+  return last_;
+}
+
+void HostArena::shrinkLast(void* p, size_t bytes) {
+  CHECK_EQ((uint8_t*)p, last_);
+  CHECK_LE(last_ + bytes, chunks_.back().data.get() + offset_);
+
+  offset_ = (last_ - chunks_.back().data.get()) + bytes;
+}
+
+void HostArena::reset() {
+  if (chunks_.size() > 1) {
+    chunks_.resize(1);
+  }
+
+  offset_ = 0;
+  last_ = nullptr;
+}
+
+size_t HostArena::getBytesReserved() const {
+  size_t total = 0;
+  for (auto& c : chunks_) {
+    total += c.size;
+  }
+
+  return total;
+}
+
+HostArenaSet::HostArenaSet(int numThreads, size_t chunkSize) {
+  CHECK_GT(numThreads, 0);
+
+  for (int i = 0; i < numThreads; ++i) {
+    arenas_.emplace_back(chunkSize);
+  }
+}
+
+HostArena& HostArenaSet::get() {
+  auto index = ThreadPool::getCurrentThreadIndex();
+  CHECK_LT(index, arenas_.size());
+
+  return arenas_[index];
+}
+
+} // namespace dietgpu
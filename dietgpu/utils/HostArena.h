@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+namespace dietgpu {
+
+/// A simple bump allocator for host scratch memory that is owned by a single
+/// thread, used by the CPU codecs to hold per-block intermediate results.
+/// Memory is obtained in large chunks that are not initialized by the
+/// allocator, so the pages are first touched (and thus, under the default
+/// first-touch NUMA policy, placed) by the thread that writes to them.
+/// Allocations remain valid until reset() or destruction of the arena.
+class HostArena {
+ public:
+  explicit HostArena(size_t chunkSize = kDefaultChunkSize);
+  HostArena(HostArena&&) = default;
+  HostArena& operator=(HostArena&&) = default;
+
+  /// Returns a region of at least `bytes` bytes aligned to `align` (a power
+  /// of 2, at most 16)
+  void* alloc(size_t bytes, size_t align = 16);
+
+  /// Shrinks the most recent allocation `p` to `bytes` bytes, returning the
+  /// remainder to the arena
+  void shrinkLast(void* p, size_t bytes);
+
+  /// Releases all allocations; the first chunk is retained for reuse
+  void reset();
+
+  /// Total size of the chunks held by the arena
+  size_t getBytesReserved() const;
+
+  static constexpr size_t kDefaultChunkSize = 1024 * 1024;
+
+ private:
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+
+  size_t chunkSize_;
+
+  std::vector<Chunk> chunks_;
+
+  /// Allocation offset within the last chunk
+  size_t offset_;
+
+  /// Start of the most recent allocation
+  uint8_t* last_;
+};
+
+/// One HostArena for each thread of a ThreadPool. Tasks running within a
+/// parallelFor on the pool can call get() to obtain the arena of the thread
+/// on which they run, without synchronization
+class HostArenaSet {
+ public:
+  explicit HostArenaSet(
+      int numThreads,
+      size_t chunkSize = HostArena::kDefaultChunkSize);
+
+  /// Returns the arena belonging to the calling pool thread
+  HostArena& get();
+
+ private:
+  std::vector<HostArena> arenas_;
+};
+
+} // namespace dietgpu
@@ -25,6 +25,72 @@ size_t adjustStackSize(size_t sz) {
   }
 }
 
+// A CUDA event recorded on a stream; the events are returned to the backend
+// for reuse when no longer referenced
+class CudaStreamMarker : public StreamMarker {
+ public:
+  CudaStreamMarker(std::shared_ptr<std::vector<cudaEvent_t>> pool, int device)
+      : event_(nullptr), pool_(std::move(pool)), device_(device) {
+    if (pool_->empty()) {
+      DeviceScope s(device_);
+      CUDA_VERIFY(cudaEventCreateWithFlags(&event_, cudaEventDisableTiming));
+    } else {
+      event_ = pool_->back();
+      pool_->pop_back();
+    }
+  }
+
+  ~CudaStreamMarker() override {
+    pool_->push_back(event_);
+  }
+
+  bool isComplete() override {
+    auto err = cudaEventQuery(event_);
+    if (err == cudaErrorNotReady) {
+      return false;
+    }
+
+    CUDA_VERIFY(err);
+    return true;
+  }
+
+  cudaEvent_t event_;
+
+ private:
+  std::shared_ptr<std::vector<cudaEvent_t>> pool_;
+  int device_;
+};
+
+class CudaStreamMarkerBackend : public StreamMarkerBackend {
+ public:
+  explicit CudaStreamMarkerBackend(int device)
+      : device_(device), pool_(std::make_shared<std::vector<cudaEvent_t>>()) {}
+
+  ~CudaStreamMarkerBackend() override {
+    // All markers have been released by the arena by now
+    DeviceScope s(device_);
+    for (auto event : *pool_) {
+      CUDA_VERIFY(cudaEventDestroy(event));
+    }
+  }
+
+  std::shared_ptr<StreamMarker> record(ArenaStream stream) override {
+    auto marker = std::make_shared<CudaStreamMarker>(pool_, device_);
+    CUDA_VERIFY(cudaEventRecord(marker->event_, (cudaStream_t)stream));
+
+    return marker;
+  }
+
+  void streamWait(ArenaStream stream, StreamMarker& marker) override {
+    auto event = static_cast<CudaStreamMarker&>(marker).event_;
+    CUDA_VERIFY(cudaStreamWaitEvent((cudaStream_t)stream, event, 0));
+  }
+
+ private:
+  int device_;
+  std::shared_ptr<std::vector<cudaEvent_t>> pool_;
+};
+
 } // namespace
 
 //
@@ -39,7 +105,8 @@ StackDeviceMemory::Stack::Stack(int d, size_t sz)
       end_(nullptr),
       head_(nullptr),
       overflowSize_(0),
-      maxSeenSize_(0) {
+      maxSeenSize_(0),
+      arena_(nullptr) {
   if (allocSize_ == 0) {
     return;
   }
@@ -64,7 +131,8 @@ StackDeviceMemory::Stack::Stack(int device, void* p, size_t size)
       end_(nullptr),
       head_(nullptr),
       overflowSize_(0),
-      maxSeenSize_(0) {
+      maxSeenSize_(0),
+      arena_(nullptr) {
   CHECK(p || size == 0);
 
   // the minimum size that can be provided (see adjustStackSize), if we are
@@ -91,7 +159,7 @@ StackDeviceMemory::Stack::~Stack() {
 }
 
 size_t StackDeviceMemory::Stack::getSizeAvailable() const {
-  return (end_ - head_);
+  return arena_ ? arena_->getLargestFree() : (end_ - head_);
 }
 
 size_t StackDeviceMemory::Stack::getSizeTotal() const {
@@ -99,7 +167,7 @@ size_t StackDeviceMemory::Stack::getSizeTotal() const {
 }
 
 size_t StackDeviceMemory::Stack::getStackSizeUsed() const {
-  return (head_ - start_);
+  return arena_ ? arena_->getSizeUsed() : (head_ - start_);
 }
 
 void* StackDeviceMemory::Stack::getAlloc(
@@ -113,10 +181,12 @@ void* StackDeviceMemory::Stack::getAlloc(
 
   void* out = nullptr;
 
-  size_t stackMemUsed = head_ - start_;
+  size_t stackMemUsed = getStackSizeUsed();
   auto sizeRemaining = getSizeAvailable();
 
-  if (size > sizeRemaining || type == AllocType::Permanent) {
+  // In stream-ordered mode, we are only asked for what the arena could not
+  // provide
+  if (arena_ || size > sizeRemaining || type == AllocType::Permanent) {
     // No space in the stack, fallback to cudaMalloc
     if (type == AllocType::Temporary) {
       // Current memory used after this allocation
@@ -128,7 +198,8 @@ void* StackDeviceMemory::Stack::getAlloc(
                 << "Resize temp memory to >= "
                 << std::max(maxSeenSize_, curUsed)
                 << " bytes to avoid performance problems. "
-                << "(Current usage: " << getStackSizeUsed() << " bytes stack "
+                << "(Current usage: " << stackMemUsed
+                << (arena_ ? " bytes arena " : " bytes stack ")
                 << overflowSize_ << " bytes overflow)\n";
     }
 
@@ -188,25 +259,72 @@ std::string StackDeviceMemory::Stack::toString() const {
 
   s << "SDM device " << device_ << ": Total memory " << allocSize_ << " ["
     << (void*)start_ << ", " << (void*)end_ << ")\n";
-  s << "     Available memory " << (size_t)(end_ - head_) << " ["
-    << (void*)head_ << ", " << (void*)end_ << ")\n";
+
+  if (!arena_) {
+    s << "     Available memory " << (size_t)(end_ - head_) << " ["
+      << (void*)head_ << ", " << (void*)end_ << ")\n";
+  }
+
   s << "     Maximum seen mem usage " << maxSeenSize_ << "\n";
 
   return s.str();
 }
 
-StackDeviceMemory::StackDeviceMemory(int device, size_t allocPerDevice)
-    : device_(device), stack_(device, allocPerDevice) {}
+StackDeviceMemory::StackDeviceMemory(
+    int device,
+    size_t allocPerDevice,
+    AllocMode mode)
+    : device_(device), stack_(device, allocPerDevice) {
+  initMode(mode);
+}
 
-StackDeviceMemory::StackDeviceMemory(int device, void* p, size_t size)
-    : device_(device), stack_(device, p, size) {}
+StackDeviceMemory::StackDeviceMemory(
+    int device,
+    void* p,
+    size_t size,
+    AllocMode mode)
+    : device_(device), stack_(device, p, size) {
+  initMode(mode);
+}
 
-StackDeviceMemory::~StackDeviceMemory() {}
+StackDeviceMemory::~StackDeviceMemory() {
+  if (arena_) {
+    // Make sure there are no outstanding memory allocations
+    CHECK_EQ(arena_->getSizeUsed(), 0);
+
+    // The region may still be in use by work preceding the last markers
+    DeviceScope s(device_);
+    CUDA_VERIFY(cudaDeviceSynchronize());
+
+    stack_.arena_ = nullptr;
+    arena_.reset();
+    stack_.head_ = stack_.start_;
+  }
+}
+
+void StackDeviceMemory::initMode(AllocMode mode) {
+  if (mode == AllocMode::StreamOrdered) {
+    // The whole of the stack's region (in multiples of the alignment) is
+    // handed to the arena, so the stack only provides the overflow
+    // allocations
+    markers_ = std::make_shared<CudaStreamMarkerBackend>(device_);
+    arena_ = std::make_shared<StreamOrderedArena>(
+        roundDown(stack_.getSizeTotal(), kSDMAlignment),
+        kSDMAlignment,
+        markers_);
+    stack_.head_ = stack_.end_;
+    stack_.arena_ = arena_.get();
+  }
+}
 
 int StackDeviceMemory::getDevice() const {
   return device_;
 }
 
+AllocMode StackDeviceMemory::getMode() const {
+  return arena_ ? AllocMode::StreamOrdered : AllocMode::Stack;
+}
+
 size_t StackDeviceMemory::getSizeAvailable() const {
   return stack_.getSizeAvailable();
 }
@@ -224,13 +342,24 @@ void StackDeviceMemory::resetMaxMemoryUsage() {
 }
 
 std::string StackDeviceMemory::toString() const {
-  return stack_.toString();
+  return arena_ ? stack_.toString() + arena_->toString() : stack_.toString();
 }
 
 void* StackDeviceMemory::allocPointer(
     cudaStream_t stream,
     size_t size,
     AllocType type) {
+  size_t offset = 0;
+
+  if (arena_ && type == AllocType::Temporary &&
+      arena_->alloc(size, stream, offset)) {
+    stack_.maxSeenSize_ = std::max(
+        stack_.maxSeenSize_,
+        stack_.getStackSizeUsed() + stack_.overflowSize_);
+
+    return stack_.start_ + offset;
+  }
+
   return stack_.getAlloc(size, stream, type);
 }
 
@@ -242,11 +371,18 @@ void StackDeviceMemory::deallocPointer(
   CHECK(p);
   CHECK_EQ(device, device_);
 
+  char* pc = static_cast<char*>(p);
+
+  if (arena_ && pc >= stack_.start_ && pc < stack_.end_) {
+    arena_->free(pc - stack_.start_, size, stream);
+    return;
+  }
+
   stack_.returnAlloc(p, size, stream);
 }
 
-StackDeviceMemory makeStackMemory(size_t bytes) {
-  return StackDeviceMemory(getCurrentDevice(), bytes);
+StackDeviceMemory makeStackMemory(size_t bytes, AllocMode mode) {
+  return StackDeviceMemory(getCurrentDevice(), bytes, mode);
 }
 
 } // namespace dietgpu
@@ -10,6 +10,7 @@
 #include <cuda_runtime.h>
 #include <dietgpu/utils/DeviceUtils.h>
 #include <dietgpu/utils/StaticUtils.h>
+#include <dietgpu/utils/StreamOrderedArena.h>
 #include <glog/logging.h>
 #include <list>
 #include <memory>
@@ -29,6 +30,20 @@ enum class AllocType {
   Permanent,
 };
 
+/// How StackDeviceMemory sub-allocates temporary memory from its region
+enum class AllocMode {
+  /// A stack, from which allocations must be freed in the reverse order they
+  /// were made. Memory is reused without regard to the stream using it, so a
+  /// StackDeviceMemory in this mode should be used with a single stream
+  Stack,
+
+  /// A StreamOrderedArena, from which allocations may be freed in any order.
+  /// Memory freed on one stream is reused by another only after a CUDA event
+  /// recorded upon the free, so a single region can be shared by work on
+  /// several concurrent streams
+  StreamOrdered,
+};
+
 /// A RAII object that manages a temporary memory request
 template <typename T>
 struct GpuMemoryReservation {
@@ -127,14 +142,23 @@ struct GpuMemoryReservation {
 class StackDeviceMemory {
  public:
   /// Allocate a new region of memory that we manage
-  StackDeviceMemory(int device, size_t allocPerDevice);
+  StackDeviceMemory(
+      int device,
+      size_t allocPerDevice,
+      AllocMode mode = AllocMode::Stack);
 
   /// Manage a region of memory for a particular device, without ownership
-  StackDeviceMemory(int device, void* p, size_t size);
+  StackDeviceMemory(
+      int device,
+      void* p,
+      size_t size,
+      AllocMode mode = AllocMode::Stack);
   ~StackDeviceMemory();
 
   int getDevice() const;
 
+  AllocMode getMode() const;
+
   // Allocate a chunk of memory on our device ordered wrt the given stream
   // of size sizeof(T) * num bytes
   template <typename T>
@@ -194,6 +218,8 @@ class StackDeviceMemory {
   void resetMaxMemoryUsage();
 
  protected:
+  void initMode(AllocMode mode);
+
   /// Previous allocation ranges and the streams for which
   /// synchronization is required
   struct Range {
@@ -222,7 +248,8 @@ class StackDeviceMemory {
     /// Returns how large our temporary buffer is in total
     size_t getSizeTotal() const;
 
-    /// Returns how much stack memory is in use
+    /// Returns how much of our temporary buffer is in use, by the stack or
+    /// by the arena
     size_t getStackSizeUsed() const;
 
     /// Obtains an allocation; all allocations are guaranteed to be 16
@@ -262,6 +289,10 @@ class StackDeviceMemory {
     /// The current maximum seen memory usage, including both stack usage and
     /// overflow allocations
     size_t maxSeenSize_;
+
+    /// In stream-ordered mode, the arena that our temporary buffer is handed
+    /// to, in which case we only make overflow allocations
+    const StreamOrderedArena* arena_;
   };
 
   /// Our device
@@ -269,6 +300,11 @@ class StackDeviceMemory {
 
   /// Memory stack
   Stack stack_;
+
+  /// In stream-ordered mode, the events upon which memory is reused and the
+  /// arena that the stack's region is handed to
+  std::shared_ptr<StreamMarkerBackend> markers_;
+  std::shared_ptr<StreamOrderedArena> arena_;
 };
 
 template <typename T>
@@ -295,6 +331,8 @@ void GpuMemoryReservation<T>::release() {
 
 // Construct a StackDeviceMemory for the current device pre-allocating the given
 // amount of memory
-StackDeviceMemory makeStackMemory(size_t bytes = 256 * 1024 * 1024);
+StackDeviceMemory makeStackMemory(
+    size_t bytes = 256 * 1024 * 1024,
+    AllocMode mode = AllocMode::Stack);
 
 } // namespace dietgpu
@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/utils/StreamOrderedArena.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace dietgpu {
+
+StreamMarker::~StreamMarker() {}
+
+StreamMarkerBackend::~StreamMarkerBackend() {}
+
+StreamOrderedArena::StreamOrderedArena(
+    size_t size,
+    size_t alignment,
+    std::shared_ptr<StreamMarkerBackend> backend)
+    : size_(size),
+      alignment_(alignment),
+      backend_(std::move(backend)),
+      used_(0),
+      nextSeq_(0) {
+  CHECK(backend_);
+  CHECK_GT(alignment_, 0);
+  CHECK_EQ(size_ % alignment_, 0);
+
+  if (size_ > 0) {
+    free_[0] = FreeRange{size_, {}};
+  }
+}
+
+bool StreamOrderedArena::prune(FreeRange& range, ArenaStream stream) {
+  bool ready = true;
+
+  range.pending.erase(
+      std::remove_if(
+          range.pending.begin(),
+          range.pending.end(),
+          [&](Pending& p) {
+            if (p.marker->isComplete()) {
+              return true;
+            }
+
+            // Our own prior work is ordered before anything we enqueue
+            ready = ready && p.stream == stream;
+            return false;
+          }),
+      range.pending.end());
+
+  return ready;
+}
+
+void StreamOrderedArena::mergePending(
+    std::vector<Pending>& to,
+    const std::vector<Pending>& from) {
+  for (auto& p : from) {
+    auto it = std::find_if(to.begin(), to.end(), [&](const Pending& q) {
+      return q.stream == p.stream;
+    });
+
+    if (it == to.end()) {
+      to.push_back(p);
+    } else if (it->seq < p.seq) {
+      *it = p;
+    }
+  }
+}
+
+bool StreamOrderedArena::alloc(
+    size_t size,
+    ArenaStream stream,
+    size_t& offset) {
+  CHECK_GT(size, 0);
+  CHECK_EQ(size % alignment_, 0);
+
+  // First fit among the ranges that need no wait, otherwise the first fit
+  auto best = free_.end();
+
+  for (auto it = free_.begin(); it != free_.end(); ++it) {
+    if (it->second.size < size) {
+      continue;
+    }
+
+    if (prune(it->second, stream)) {
+      best = it;
+      break;
+    }
+
+    if (best == free_.end()) {
+      best = it;
+    }
+  }
+
+  if (best == free_.end()) {
+    return false;
+  }
+
+  offset = best->first;
+  auto range = std::move(best->second);
+  free_.erase(best);
+
+  // Work on `stream` using the allocation must follow the prior use of the
+  // range by other streams
+  for (auto& p : range.pending) {
+    if (p.stream != stream) {
+      backend_->streamWait(stream, *p.marker);
+    }
+  }
+
+  // The remainder stays free, still subject to the prior use of the range
+  if (range.size > size) {
+    range.size -= size;
+    free_[offset + size] = std::move(range);
+  }
+
+  used_ += size;
+  return true;
+}
+
+void StreamOrderedArena::free(size_t offset, size_t size, ArenaStream stream) {
+  CHECK_GT(size, 0);
+  CHECK_EQ(offset % alignment_, 0);
+  CHECK_EQ(size % alignment_, 0);
+  CHECK_LE(offset + size, size_);
+  CHECK_GE(used_, size);
+
+  auto range =
+      FreeRange{size, {Pending{stream, backend_->record(stream), nextSeq_++}}};
+
+  auto next = free_.lower_bound(offset);
+  CHECK(next == free_.end() || next->first >= offset + size)
+      << "free of [" << offset << ", " << offset + size
+      << ") overlaps a free range";
+
+  // Coalesce with the following range
+  if (next != free_.end() && next->first == offset + size) {
+    range.size += next->second.size;
+    mergePending(range.pending, next->second.pending);
+    next = free_.erase(next);
+  }
+
+  // Coalesce with the preceding range
+  if (next != free_.begin()) {
+    auto prev = std::prev(next);
+    CHECK_LE(prev->first + prev->second.size, offset)
+        << "free of [" << offset << ", " << offset + size
+        << ") overlaps a free range";
+
+    if (prev->first + prev->second.size == offset) {
+      prev->second.size += range.size;
+      mergePending(prev->second.pending, range.pending);
+      used_ -= size;
+      return;
+    }
+  }
+
+  free_[offset] = std::move(range);
+  used_ -= size;
+}
+
+size_t StreamOrderedArena::getSizeTotal() const {
+  return size_;
+}
+
+size_t StreamOrderedArena::getSizeUsed() const {
+  return used_;
+}
+
+size_t StreamOrderedArena::getLargestFree() const {
+  size_t largest = 0;
+  for (auto& f : free_) {
+    largest = std::max(largest, f.second.size);
+  }
+
+  return largest;
+}
+
+size_t StreamOrderedArena::getNumPendingMarkers() const {
+  size_t num = 0;
+  for (auto& f : free_) {
+    for (auto& p : f.second.pending) {
+      num += !p.marker->isComplete();
+    }
+  }
+
+  return num;
+}
+
+std::string StreamOrderedArena::toString() const {
+  std::stringstream s;
+
+  s << "Stream-ordered arena: " << used_ << " of " << size_
+    << " bytes in use, " << free_.size() << " free ranges, largest "
+    << getLargestFree() << " bytes\n";
+
+  return s.str();
+}
+
+} // namespace dietgpu
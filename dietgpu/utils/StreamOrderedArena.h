@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dietgpu {
+
+/// An opaque handle to a stream of work (a cudaStream_t for device memory)
+using ArenaStream = void*;
+
+/// A point in the work of a stream, recorded by a StreamMarkerBackend
+class StreamMarker {
+ public:
+  virtual ~StreamMarker();
+
+  /// Whether all work on the stream preceding the marker has completed
+  virtual bool isComplete() = 0;
+};
+
+/// Records and waits upon markers in streams. For device memory this is
+/// implemented with CUDA events; it is separated from the arena so that the
+/// arena bookkeeping can be tested with host streams
+class StreamMarkerBackend {
+ public:
+  virtual ~StreamMarkerBackend();
+
+  /// Records a marker following all work currently enqueued on `stream`
+  virtual std::shared_ptr<StreamMarker> record(ArenaStream stream) = 0;
+
+  /// Makes all work subsequently enqueued on `stream` wait until `marker` has
+  /// completed, without blocking the host
+  virtual void streamWait(ArenaStream stream, StreamMarker& marker) = 0;
+};
+
+/// Stream-ordered sub-allocator of a region of `size` bytes, which hands out
+/// offsets within the region from an address ordered free list. Allocations
+/// may be freed in any order and from any stream.
+///
+/// An allocation is assumed to be used only by work on the stream it is freed
+/// with, so freeing it does not wait for that work: a marker is recorded on
+/// the stream instead, and remains attached to the freed range. A stream may
+/// immediately reuse memory last used by itself (its work is ordered), while
+/// reuse by another stream is made to wait on the markers of the range that
+/// have not yet completed. Ranges that need no wait are preferred.
+///
+/// Like StackDeviceMemory, this is not thread safe.
+class StreamOrderedArena {
+ public:
+  StreamOrderedArena(
+      size_t size,
+      size_t alignment,
+      std::shared_ptr<StreamMarkerBackend> backend);
+
+  /// Allocates `size` bytes (a non-zero multiple of the alignment) for use by
+  /// work on `stream`, returning their offset in `offset`. Returns false if
+  /// no free range is large enough
+  bool alloc(size_t size, ArenaStream stream, size_t& offset);
+
+  /// Returns an allocation once all of its use has been enqueued on `stream`
+  void free(size_t offset, size_t size, ArenaStream stream);
+
+  /// Total size of the region
+  size_t getSizeTotal() const;
+
+  /// Size of the region currently allocated
+  size_t getSizeUsed() const;
+
+  /// Size of the largest allocation that can currently be made
+  size_t getLargestFree() const;
+
+  /// Number of markers attached to free ranges that are not yet known to
+  /// have completed
+  size_t getNumPendingMarkers() const;
+
+  std::string toString() const;
+
+ private:
+  /// A marker on a stream that the reuse of a free range must follow
+  struct Pending {
+    ArenaStream stream;
+    std::shared_ptr<StreamMarker> marker;
+
+    /// Order in which markers were recorded; of two markers on the same
+    /// stream, the later one completes after the earlier
+    uint64_t seq;
+  };
+
+  struct FreeRange {
+    size_t size;
+
+    /// At most one marker per stream, the latest recorded
+    std::vector<Pending> pending;
+  };
+
+  /// Drops the markers of `range` that have completed, and returns whether
+  /// `stream` could reuse it without waiting
+  bool prune(FreeRange& range, ArenaStream stream);
+
+  /// Adds the markers of `from` to `to`, keeping the latest for each stream
+  static void mergePending(
+      std::vector<Pending>& to,
+      const std::vector<Pending>& from);
+
+  size_t size_;
+  size_t alignment_;
+  std::shared_ptr<StreamMarkerBackend> backend_;
+
+  /// Free ranges keyed by offset; adjacent ranges are coalesced
+  std::map<size_t, FreeRange> free_;
+
+  size_t used_;
+  uint64_t nextSeq_;
+};
+
+} // namespace dietgpu
@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "dietgpu/utils/StreamOrderedArena.h"
+
+using namespace dietgpu;
+
+namespace {
+
+// A host stream, whose work is simply counted
+struct HostStream {
+  // Number of pieces of work enqueued and completed so far
+  uint64_t enqueued = 0;
+  uint64_t completed = 0;
+
+  // Enqueues a piece of work
+  void run() {
+    ++enqueued;
+  }
+
+  // Completes all work enqueued so far
+  void finish() {
+    completed = enqueued;
+  }
+};
+
+struct HostMarker : public StreamMarker {
+  HostMarker(HostStream* s, uint64_t a) : stream(s), at(a) {}
+
+  bool isComplete() override {
+    return stream->completed >= at;
+  }
+
+  HostStream* stream;
+  uint64_t at;
+};
+
+struct HostMarkerBackend : public StreamMarkerBackend {
+  std::shared_ptr<StreamMarker> record(ArenaStream stream) override {
+    auto s = (HostStream*)stream;
+    return std::make_shared<HostMarker>(s, s->enqueued);
+  }
+
+  void streamWait(ArenaStream stream, StreamMarker& marker) override {
+    waits.push_back(
+        std::make_pair((HostStream*)stream, static_cast<HostMarker&>(marker)));
+  }
+
+  // The waits made, by waiting stream and the marker waited upon
+  std::vector<std::pair<HostStream*, HostMarker>> waits;
+};
+
+constexpr size_t kAlign = 256;
+
+} // namespace
+
+TEST(StreamOrderedArenaTest, OutOfOrderFree) {
+  auto backend = std::make_shared<HostMarkerBackend>();
+  StreamOrderedArena arena(16 * kAlign, kAlign, backend);
+  HostStream s;
+
+  size_t a = 0;
+  size_t b = 0;
+  size_t c = 0;
+  EXPECT_TRUE(arena.alloc(2 * kAlign, &s, a));
+  EXPECT_TRUE(arena.alloc(3 * kAlign, &s, b));
+  EXPECT_TRUE(arena.alloc(4 * kAlign, &s, c));
+  EXPECT_EQ(a, 0);
+  EXPECT_EQ(b, 2 * kAlign);
+  EXPECT_EQ(c, 5 * kAlign);
+  EXPECT_EQ(arena.getSizeUsed(), 9 * kAlign);
+
+  // Not in the reverse order of allocation
+  s.run();
+  arena.free(b, 3 * kAlign, &s);
+  arena.free(a, 2 * kAlign, &s);
+  EXPECT_EQ(arena.getLargestFree(), 7 * kAlign);
+
+  // The freed range is immediately reusable by the same stream
+  size_t d = 0;
+  EXPECT_TRUE(arena.alloc(5 * kAlign, &s, d));
+  EXPECT_EQ(d, 0);
+
+  arena.free(c, 4 * kAlign, &s);
+  arena.free(d, 5 * kAlign, &s);
+
+  // Everything coalesces back into one range
+  EXPECT_EQ(arena.getSizeUsed(), 0);
+  EXPECT_EQ(arena.getLargestFree(), 16 * kAlign);
+  EXPECT_TRUE(backend->waits.empty());
+
+  // Only the latest marker of the stream is kept
+  EXPECT_EQ(arena.getNumPendingMarkers(), 1);
+  s.finish();
+  EXPECT_EQ(arena.getNumPendingMarkers(), 0);
+}
+
+TEST(StreamOrderedArenaTest, CrossStreamReuse) {
+  auto backend = std::make_shared<HostMarkerBackend>();
+  StreamOrderedArena arena(8 * kAlign, kAlign, backend);
+  HostStream s1;
+  HostStream s2;
+
+  size_t a = 0;
+  EXPECT_TRUE(arena.alloc(8 * kAlign, &s1, a));
+  s1.run();
+  arena.free(a, 8 * kAlign, &s1);
+
+  // The work of s1 using the memory may still be running, so s2 must wait
+  // for it
+  size_t b = 0;
+  EXPECT_TRUE(arena.alloc(4 * kAlign, &s2, b));
+  ASSERT_EQ(backend->waits.size(), 1);
+  EXPECT_EQ(backend->waits[0].first, &s2);
+  EXPECT_EQ(backend->waits[0].second.stream, &s1);
+  EXPECT_EQ(backend->waits[0].second.at, s1.enqueued);
+
+  // Once it has completed, no wait is needed
+  s1.finish();
+  size_t c = 0;
+  EXPECT_TRUE(arena.alloc(4 * kAlign, &s2, c));
+  EXPECT_EQ(backend->waits.size(), 1);
+
+  s2.run();
+  arena.free(b, 4 * kAlign, &s2);
+  arena.free(c, 4 * kAlign, &s2);
+  EXPECT_EQ(arena.getNumPendingMarkers(), 1);
+}
+
+TEST(StreamOrderedArenaTest, PrefersReadyRange) {
+  auto backend = std::make_shared<HostMarkerBackend>();
+  StreamOrderedArena arena(8 * kAlign, kAlign, backend);
+  HostStream s1;
+  HostStream s2;
+
+  size_t a = 0;
+  size_t b = 0;
+  size_t c = 0;
+  EXPECT_TRUE(arena.alloc(2 * kAlign, &s1, a));
+  EXPECT_TRUE(arena.alloc(2 * kAlign, &s1, b));
+  EXPECT_TRUE(arena.alloc(4 * kAlign, &s1, c));
+
+  // c is no longer in use by s1's work when freed, a is
+  arena.free(c, 4 * kAlign, &s1);
+  s1.run();
+  arena.free(a, 2 * kAlign, &s1);
+
+  // s2 takes c rather than waiting on s1 for a
+  size_t d = 0;
+  EXPECT_TRUE(arena.alloc(2 * kAlign, &s2, d));
+  EXPECT_EQ(d, c);
+  EXPECT_TRUE(backend->waits.empty());
+
+  // Whereas s1 can reuse a without waiting
+  size_t e = 0;
+  s1.run();
+  arena.free(d, 2 * kAlign, &s2);
+  EXPECT_TRUE(arena.alloc(2 * kAlign, &s1, e));
+  EXPECT_EQ(e, a);
+  EXPECT_TRUE(backend->waits.empty());
+
+  arena.free(b, 2 * kAlign, &s1);
+  arena.free(e, 2 * kAlign, &s1);
+  EXPECT_EQ(arena.getSizeUsed(), 0);
+}
+
+TEST(StreamOrderedArenaTest, Exhaustion) {
+  auto backend = std::make_shared<HostMarkerBackend>();
+  StreamOrderedArena arena(4 * kAlign, kAlign, backend);
+  HostStream s;
+
+  size_t a = 0;
+  size_t b = 0;
+  EXPECT_FALSE(arena.alloc(5 * kAlign, &s, a));
+  EXPECT_TRUE(arena.alloc(kAlign, &s, a));
+  EXPECT_TRUE(arena.alloc(2 * kAlign, &s, b));
+
+  // One range of kAlign bytes is left
+  size_t c = 0;
+  EXPECT_FALSE(arena.alloc(2 * kAlign, &s, c));
+  EXPECT_TRUE(arena.alloc(kAlign, &s, c));
+  EXPECT_FALSE(arena.alloc(kAlign, &s, c));
+
+  arena.free(a, kAlign, &s);
+  arena.free(c, kAlign, &s);
+
+  // Freed ranges that are not adjacent do not make a larger allocation
+  // possible
+  EXPECT_EQ(arena.getLargestFree(), kAlign);
+  EXPECT_FALSE(arena.alloc(2 * kAlign, &s, c));
+
+  arena.free(b, 2 * kAlign, &s);
+  EXPECT_TRUE(arena.alloc(4 * kAlign, &s, c));
+  arena.free(c, 4 * kAlign, &s);
+}
+
+// Random allocations and frees from several streams never overlap, and any
+// reuse of memory last used by another stream whose work has not completed
+// waits for it
+TEST(StreamOrderedArenaTest, Random) {
+  std::mt19937 gen(10);
+  constexpr size_t kSize = 64 * kAlign;
+  constexpr int kNumStreams = 3;
+
+  auto backend = std::make_shared<HostMarkerBackend>();
+  StreamOrderedArena arena(kSize, kAlign, backend);
+  auto streams = std::vector<HostStream>(kNumStreams);
+
+  struct Alloc {
+    size_t offset;
+    size_t size;
+    int stream;
+  };
+
+  auto live = std::vector<Alloc>();
+
+  // The stream and the amount of its work at the time each unit of memory
+  // was last freed, or -1
+  auto lastUse = std::vector<std::pair<int, uint64_t>>(
+      kSize / kAlign, std::make_pair(-1, 0));
+
+  for (int iter = 0; iter < 5000; ++iter) {
+    int str = gen() % kNumStreams;
+    auto& s = streams[str];
+
+    switch (gen() % 4) {
+      case 0:
+      case 1: {
+        size_t size = (1 + gen() % 8) * kAlign;
+        size_t offset = 0;
+        size_t numWaits = backend->waits.size();
+
+        if (!arena.alloc(size, &s, offset)) {
+          EXPECT_LT(arena.getLargestFree(), size);
+          break;
+        }
+
+        for (auto& a : live) {
+          EXPECT_TRUE(
+              offset + size <= a.offset || a.offset + a.size <= offset);
+        }
+
+        for (size_t u = offset / kAlign; u < (offset + size) / kAlign; ++u) {
+          int prev = lastUse[u].first;
+          if (prev < 0 || prev == str ||
+              streams[prev].completed >= lastUse[u].second) {
+            continue;
+          }
+
+          // s must have waited upon the work of prev
+          bool waited = false;
+          for (size_t w = numWaits; w < backend->waits.size(); ++w) {
+            auto& wait = backend->waits[w];
+            waited = waited ||
+                (wait.first == &s && wait.second.stream == &streams[prev] &&
+                 wait.second.at >= lastUse[u].second);
+          }
+
+          EXPECT_TRUE(waited);
+        }
+
+        live.push_back(Alloc{offset, size, str});
+        s.run();
+        break;
+      }
+      case 2:
+        if (!live.empty()) {
+          size_t i = gen() % live.size();
+          auto a = live[i];
+          live.erase(live.begin() + i);
+
+          auto& as = streams[a.stream];
+          as.run();
+          arena.free(a.offset, a.size, &as);
+
+          for (size_t u = a.offset / kAlign; u < (a.offset + a.size) / kAlign;
+               ++u) {
+            lastUse[u] = std::make_pair(a.stream, as.enqueued);
+          }
+        }
+        break;
+      case 3:
+        s.finish();
+        break;
+    }
+
+    size_t used = 0;
+    for (auto& a : live) {
+      used += a.size;
+    }
+
+    EXPECT_EQ(arena.getSizeUsed(), used);
+  }
+
+  for (auto& a : live) {
+    arena.free(a.offset, a.size, &streams[a.stream]);
+  }
+
+  EXPECT_EQ(arena.getSizeUsed(), 0);
+  EXPECT_EQ(arena.getLargestFree(), kSize);
+  EXPECT_LE(arena.getNumPendingMarkers(), kNumStreams);
+
+  // (memory was reused across streams)
+  EXPECT_GT(backend->waits.size(), 0);
+}
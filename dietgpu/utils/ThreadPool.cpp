@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "dietgpu/utils/ThreadPool.h"
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+
+namespace dietgpu {
+
+namespace {
+
+// Set for threads that are currently executing a task from a pool, so that
+// nested parallelFor calls do not wait on themselves
+thread_local bool tlsInPoolTask = false;
+
+// Index of the pool thread running the current task
+thread_local int tlsThreadIndex = 0;
+
+inline uint64_t packRange(uint64_t begin, uint64_t end) {
+  return (end << 32) | begin;
+}
+
+inline uint32_t rangeBegin(uint64_t r) {
+  return (uint32_t)r;
+}
+
+inline uint32_t rangeEnd(uint64_t r) {
+  return (uint32_t)(r >> 32);
+}
+
+int getDefaultNumThreads() {
+  return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(int numThreads)
+    : job_(nullptr), generation_(0), active_(0), stop_(false) {
+  if (numThreads <= 0) {
+    numThreads = getDefaultNumThreads();
+  }
+
+  // The thread calling parallelFor also participates
+  for (int i = 0; i < numThreads - 1; ++i) {
+    workers_.emplace_back([this, i]() { workerLoop(i + 1); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+
+  workCv_.notify_all();
+
+  for (auto& t : workers_) {
+    t.join();
+  }
+}
+
+int ThreadPool::getNumThreads() const {
+  return workers_.size() + 1;
+}
+
+int ThreadPool::getCurrentThreadIndex() {
+  return tlsThreadIndex;
+}
+
+void ThreadPool::runJob(Job& job, int threadIndex) {
+  bool prevInPoolTask = tlsInPoolTask;
+  int prevThreadIndex = tlsThreadIndex;
+  tlsInPoolTask = true;
+  tlsThreadIndex = threadIndex;
+
+  int numThreads = getNumThreads();
+  auto& own = job.ranges[threadIndex].v;
+
+  while (true) {
+    // Run tasks from the front of our own range
+    while (true) {
+      uint64_t r = own.load();
+      uint32_t begin = rangeBegin(r);
+      uint32_t end = rangeEnd(r);
+
+      if (begin >= end) {
+        break;
+      }
+
+      if (own.compare_exchange_weak(r, packRange(begin + 1, end))) {
+        (*job.fn)(begin);
+        job.done.fetch_add(1);
+      }
+    }
+
+    // Our range is exhausted; steal the back half of the largest remaining
+    // range of another thread
+    bool stole = false;
+
+    while (!stole) {
+      int victim = -1;
+      uint32_t victimSize = 0;
+
+      for (int i = 1; i < numThreads; ++i) {
+        int t = (threadIndex + i) % numThreads;
+        uint64_t r = job.ranges[t].v.load(std::memory_order_relaxed);
+        uint32_t size = rangeEnd(r) > rangeBegin(r)
+            ? rangeEnd(r) - rangeBegin(r)
+            : 0;
+
+        if (size > victimSize) {
+          victim = t;
+          victimSize = size;
+        }
+      }
+
+      if (victim < 0) {
+        // All work has been handed out
+        break;
+      }
+
+      auto& other = job.ranges[victim].v;
+      uint64_t r = other.load();
+      uint32_t begin = rangeBegin(r);
+      uint32_t end = rangeEnd(r);
+
+      if (begin >= end) {
+        continue;
+      }
+
+      // The owner keeps [begin, mid); if there is only a single task left, we
+      // take it
+      uint32_t mid = begin + (end - begin) / 2;
+
+      if (other.compare_exchange_strong(r, packRange(begin, mid))) {
+        // Only we modify our own range while it is empty
+        own.store(packRange(mid, end));
+        stole = true;
+      }
+    }
+
+    if (!stole) {
+      break;
+    }
+  }
+
+  tlsInPoolTask = prevInPoolTask;
+  tlsThreadIndex = prevThreadIndex;
+}
+
+void ThreadPool::workerLoop(int threadIndex) {
+  uint64_t seenGeneration = 0;
+
+  while (true) {
+    Job* job = nullptr;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      workCv_.wait(lock, [&]() {
+        return stop_ || (job_ && generation_ != seenGeneration);
+      });
+
+      if (stop_) {
+        return;
+      }
+
+      seenGeneration = generation_;
+      job = job_;
+      ++active_;
+    }
+
+    runJob(*job, threadIndex);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --active_;
+    }
+
+    doneCv_.notify_all();
+  }
+}
+
+void ThreadPool::parallelFor(
+    size_t num,
+    const std::function<void(size_t)>& fn) {
+  if (num == 0) {
+    return;
+  }
+
+  // Nothing to distribute, or we are already running on a pool thread
+  if (num == 1 || workers_.empty() || tlsInPoolTask) {
+    for (size_t i = 0; i < num; ++i) {
+      fn(i);
+    }
+
+    return;
+  }
+
+  CHECK_LE(num, std::numeric_limits<uint32_t>::max());
+  std::lock_guard<std::mutex> submitLock(submitMutex_);
+
+  // Initially, each thread receives a contiguous range of equal size
+  int numThreads = getNumThreads();
+
+  Job job;
+  job.fn = &fn;
+  job.num = num;
+  job.ranges.reset(new Range[numThreads]);
+  job.done = 0;
+
+  for (int i = 0; i < numThreads; ++i) {
+    job.ranges[i].v =
+        packRange((num * i) / numThreads, (num * (i + 1)) / numThreads);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &job;
+    ++generation_;
+  }
+
+  workCv_.notify_all();
+
+  // The calling thread works as well
+  runJob(job, 0);
+
+  {
+    // Wait for all tasks to complete and for all workers to have let go of the
+    // job, as it lives on our stack
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCv_.wait(lock, [&]() { return job.done == num && active_ == 0; });
+    job_ = nullptr;
+  }
+}
+
+ThreadPool& getDefaultThreadPool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+} // namespace dietgpu
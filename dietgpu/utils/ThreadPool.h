@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dietgpu {
+
+/// A fixed-size pool of host worker threads, used by the CPU implementations
+/// of the codecs to spread per-block and per-batch work across cores.
+/// Each parallelFor initially splits its index space into one contiguous range
+/// per thread; threads that run out of work steal half of the remaining range
+/// of another thread, so that imbalanced work (e.g., batches of varying size)
+/// still keeps all threads busy.
+class ThreadPool {
+ public:
+  /// Creates a pool that runs work on numThreads threads in total (the thread
+  /// calling parallelFor counts as one of them). If numThreads <= 0, the
+  /// number of hardware threads is used
+  explicit ThreadPool(int numThreads = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  /// Returns the number of threads (including the caller) that work is
+  /// distributed across
+  int getNumThreads() const;
+
+  /// Calls fn(i) for each i in [0, num) across the threads in the pool and
+  /// returns once all calls have completed. Work is balanced dynamically,
+  /// so calls may be of unequal cost. Neighboring indices tend to run on the
+  /// same thread.
+  /// If called from within a task running on this pool, the loop is run
+  /// serially on the calling thread.
+  void parallelFor(size_t num, const std::function<void(size_t)>& fn);
+
+  /// Returns the index in [0, getNumThreads()) of the pool thread running the
+  /// current task (the thread calling parallelFor is index 0), for use in
+  /// selecting per-thread scratch space. A parallelFor nested within a task
+  /// runs serially and keeps the index of the enclosing task's thread
+  static int getCurrentThreadIndex();
+
+ private:
+  /// The range of indices [begin, end) remaining for a thread, packed as
+  /// (end << 32) | begin so it can be updated with a single CAS. Padded so
+  /// that ranges of different threads do not share a cache line
+  struct Range {
+    std::atomic<uint64_t> v;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  struct Job {
+    const std::function<void(size_t)>* fn;
+    size_t num;
+    std::unique_ptr<Range[]> ranges;
+    std::atomic<size_t> done;
+  };
+
+  void workerLoop(int threadIndex);
+
+  /// Runs tasks from the job (our own range, then stolen ones) until none
+  /// remain
+  void runJob(Job& job, int threadIndex);
+
+  /// Serializes calls to parallelFor from different external threads
+  std::mutex submitMutex_;
+
+  /// Protects job_, generation_, active_ and stop_
+  std::mutex mutex_;
+  std::condition_variable workCv_;
+  std::condition_variable doneCv_;
+
+  /// The job currently being run, if any
+  Job* job_;
+
+  /// Incremented for each new job, so workers run each job at most once
+  uint64_t generation_;
+
+  /// Number of workers currently running tasks from job_
+  int active_;
+
+  bool stop_;
+
+  std::vector<std::thread> workers_;
+};
+
+/// Returns a process-wide pool sized to the number of hardware threads
+ThreadPool& getDefaultThreadPool();
+
+} // namespace dietgpu